@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+
+# Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation, either
+# version 3 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, see <http://www.gnu.org/licenses/>.
+#
+
+# Converts a trace dump produced by services/src/trace_recorder.cpp to the Chrome trace event
+# format that can be opened in chrome://tracing or https://ui.perfetto.dev
+
+import struct
+import argparse
+import json
+import sys
+
+TRACE_DUMP_MAGIC = 0x43525450
+TRACE_DUMP_VERSION = 1
+
+HEADER_FORMAT = '<IHHII'
+RECORD_FORMAT = '<IIIIIHBB'
+
+TRACE_EVENT_INSTANT = 0
+TRACE_EVENT_BEGIN = 1
+TRACE_EVENT_END = 2
+TRACE_EVENT_COUNTER = 3
+
+TRACE_ID_USER = 32768
+
+# Keep in sync with trace_event_id in services/inc/trace_recorder.h
+EVENT_NAMES = {
+    1: 'sys:loop',
+    2: 'sys:cloud:connect',
+    3: 'sys:cloud:handshake',
+    4: 'sys:publish',
+    5: 'sys:ota:chunk',
+    6: 'sys:ota:finish',
+    32: 'proto:loop',
+    33: 'proto:msg',
+    34: 'dtls:recv',
+    35: 'dtls:send',
+    36: 'dtls:handshake',
+    64: 'ppp:rx',
+    65: 'ppp:tx',
+    66: 'at:cmd'
+}
+
+PHASES = {
+    TRACE_EVENT_INSTANT: 'i',
+    TRACE_EVENT_BEGIN: 'B',
+    TRACE_EVENT_END: 'E',
+    TRACE_EVENT_COUNTER: 'C'
+}
+
+def event_name(id):
+    if id in EVENT_NAMES:
+        return EVENT_NAMES[id]
+    if id >= TRACE_ID_USER:
+        return 'user:{}'.format(id - TRACE_ID_USER)
+    return 'event:{}'.format(id)
+
+def convert(data):
+    header_size = struct.calcsize(HEADER_FORMAT)
+    if len(data) < header_size:
+        raise ValueError('Trace dump is too short')
+    (magic, version, record_size, count, dropped) = struct.unpack_from(HEADER_FORMAT, data, 0)
+    if magic != TRACE_DUMP_MAGIC:
+        raise ValueError('Invalid magic number')
+    if version != TRACE_DUMP_VERSION:
+        raise ValueError('Unsupported format version: {}'.format(version))
+    if record_size < struct.calcsize(RECORD_FORMAT):
+        raise ValueError('Invalid record size: {}'.format(record_size))
+    if len(data) < header_size + count * record_size:
+        raise ValueError('Trace dump is truncated')
+    events = []
+    skipped = 0
+    last_time = None
+    offset = 0 # Accumulated 32-bit timer wraparounds
+    for i in range(count):
+        (seq, time, thread, arg1, arg2, id, type, _) = struct.unpack_from(RECORD_FORMAT, data, header_size + i * record_size)
+        if seq == 0:
+            skipped += 1 # The record was being written while the dump was taken
+            continue
+        # Records written concurrently by different threads can be slightly out of order, so only
+        # a backward jump by more than half of the timer range is treated as a wraparound
+        if last_time is not None and last_time - time > 1 << 31:
+            offset += 1 << 32
+        last_time = time
+        event = {
+            'name': event_name(id),
+            'ph': PHASES.get(type, 'i'),
+            'ts': time + offset,
+            'pid': 0,
+            'tid': thread
+        }
+        if type == TRACE_EVENT_COUNTER:
+            event['args'] = { 'value': arg1 }
+        else:
+            event['args'] = { 'arg1': arg1, 'arg2': arg2 }
+            if type == TRACE_EVENT_INSTANT:
+                event['s'] = 't'
+        events.append(event)
+    return {
+        'traceEvents': events,
+        'otherData': {
+            'dropped': dropped,
+            'skipped': skipped
+        }
+    }
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert a trace dump to the Chrome trace event format')
+    parser.add_argument('input', nargs='?', type=argparse.FileType('rb'), default=sys.stdin.buffer,
+            help='trace dump file (default: stdin)')
+    parser.add_argument('-o', '--output', type=argparse.FileType('w'), default=sys.stdout,
+            help='output JSON file (default: stdout)')
+    args = parser.parse_args()
+    try:
+        trace = convert(args.input.read())
+    except ValueError as e:
+        print('Error: {}'.format(e), file=sys.stderr)
+        sys.exit(1)
+    json.dump(trace, args.output)
+    args.output.write('\n')
+
+if __name__ == '__main__':
+    main()
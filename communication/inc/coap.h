@@ -82,6 +82,7 @@ namespace CoAPCode {
 	NOT_MODIFIED = COAP_RESPONSE(2,03),
 	CHANGED = COAP_RESPONSE(2,04),
 	CONTENT = COAP_RESPONSE(2,05),
+	BLOCKWISE_CONTINUE = COAP_RESPONSE(2,31), // RFC 7959
 	BAD_REQUEST = COAP_RESPONSE(4,00),
 	UNAUTHORIZED = COAP_RESPONSE(4,01),
 	BAD_OPTION = COAP_RESPONSE(4,02),
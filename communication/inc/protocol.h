@@ -14,6 +14,7 @@
 #include "subscriptions.h"
 #include "variables.h"
 #include "description.h"
+#include "outbound_scheduler.h"
 #include "hal_platform.h"
 #include "timesyncmanager.h"
 
@@ -123,6 +124,11 @@ class Protocol
 	 */
 	TimeSyncManager timesync_;
 
+	/**
+	 * Schedules outbound messages of different priority classes.
+	 */
+	OutboundScheduler outbound;
+
 	Vector<message_handle_t> subscription_msg_ids;
 
 	/**
@@ -132,6 +138,14 @@ class Protocol
 
 	uint32_t protocol_flags;
 
+	/**
+	 * Whether a resumed session is used without confirming it with the server first.
+	 *
+	 * Unlike the protocol flags, this setting is local to the device and is not part of the cached
+	 * application state, so toggling it doesn't invalidate the session.
+	 */
+	bool fast_resume;
+
 	uint8_t initialized;
 
 protected:
@@ -155,7 +169,11 @@ protected:
 		/**
 		 * Support for compressed/combined OTA updates.
 		 */
-		COMPRESSED_OTA = 0x10
+		COMPRESSED_OTA = 0x10,
+		/**
+		 * Support for blockwise transfers of large payloads.
+		 */
+		BLOCKWISE_TRANSFERS = 0x20
 	};
 
 	/**
@@ -237,7 +255,12 @@ protected:
 		}
 		last_message_millis = callbacks.millis();
 		message.set_length(len);
-		return channel.send(message);
+		const ProtocolError error = channel.send(message);
+		if (error == NO_ERROR)
+		{
+			outbound_sent(OutboundClass::CONTROL, message);
+		}
+		return error;
 	}
 
 	/**
@@ -267,6 +290,11 @@ protected:
 		{
 			return error;
 		}
+		error = publisher.process(channel);
+		if (error)
+		{
+			return error;
+		}
 #if HAL_PLATFORM_OTA_PROTOCOL_V3
 		if (firmwareUpdate.isRunning())
 		{
@@ -334,6 +362,7 @@ public:
 			description(this),
 			last_ack_handlers_update(0),
 			protocol_flags(0),
+			fast_resume(false),
 			initialized(false),
 			max_binary_size(0), // Unlimited
 			ota_chunk_size(DEFAULT_OTA_CHUNK_SIZE),
@@ -381,6 +410,26 @@ public:
 		}
 	}
 
+	void set_blockwise_transfers_enabled(bool enabled)
+	{
+		if (enabled) {
+			protocol_flags |= ProtocolFlag::BLOCKWISE_TRANSFERS;
+		} else {
+			protocol_flags &= ~ProtocolFlag::BLOCKWISE_TRANSFERS;
+		}
+	}
+
+	void set_fast_resume_enabled(bool enabled)
+	{
+		fast_resume = enabled;
+	}
+
+	bool is_blockwise_enabled() const
+	{
+		// Blockwise transfers rely on CoAP acknowledgements, which are only used with unreliable channels
+		return (protocol_flags & ProtocolFlag::BLOCKWISE_TRANSFERS) && channel.is_unreliable();
+	}
+
 	void set_system_version(uint16_t version)
 	{
 		system_version = version;
@@ -404,6 +453,16 @@ public:
 	size_t get_max_transmit_message_size() const;
 
 	size_t get_max_event_data_size() const {
+		if (is_blockwise_enabled()) {
+			return MAX_BLOCKWISE_DATA_LENGTH;
+		}
+		return get_max_event_message_data_size();
+	}
+
+	/**
+	 * Get the maximum size of event data that fits in a single message.
+	 */
+	size_t get_max_event_message_data_size() const {
 		// Check if there's a runtime limit
 		if (max_transmit_message_size && max_transmit_message_size < MAX_EVENT_MESSAGE_SIZE) {
 			// While the MAX_TRANSMIT_MESSAGE_SIZE setting only limits the maximum size of device-
@@ -415,6 +474,16 @@ public:
 	}
 
 	size_t get_max_variable_value_size() const {
+		if (is_blockwise_enabled()) {
+			return MAX_BLOCKWISE_DATA_LENGTH;
+		}
+		return get_max_variable_message_value_size();
+	}
+
+	/**
+	 * Get the maximum size of a variable value that fits in a single message.
+	 */
+	size_t get_max_variable_message_value_size() const {
 		if (max_transmit_message_size && max_transmit_message_size < MAX_VARIABLE_VALUE_MESSAGE_SIZE) {
 			return max_transmit_message_size - (MAX_VARIABLE_VALUE_MESSAGE_SIZE - MAX_VARIABLE_VALUE_LENGTH);
 		}
@@ -422,6 +491,9 @@ public:
 	}
 
 	size_t get_max_function_arg_size() const {
+		if (is_blockwise_enabled()) {
+			return MAX_BLOCKWISE_DATA_LENGTH;
+		}
 		// Function calls are not affected by the MAX_TRANSMIT_MESSAGE_SIZE setting
 		return MAX_FUNCTION_ARG_LENGTH;
 	}
@@ -618,6 +690,25 @@ public:
 
 	void notify_message_complete(message_id_t msg_id, CoAPCode::Enum responseCode);
 
+	/**
+	 * Check if a deferrable message of the given class can be sent now.
+	 *
+	 * If this method returns `false`, the caller is expected to try again from the idle loop.
+	 */
+	bool outbound_ready(OutboundClass cls)
+	{
+		return outbound.acquire(cls, callbacks.millis());
+	}
+
+	/**
+	 * Account for a message sent over the channel.
+	 */
+	void outbound_sent(OutboundClass cls, Message& msg);
+
+	OutboundScheduler& get_outbound_scheduler() {
+		return outbound;
+	}
+
 	/**
 	 * Retrieves the next token.
 	 */
@@ -94,6 +94,11 @@ const size_t MAX_EVENT_DATA_LENGTH = 1024;
 const size_t MAX_FUNCTION_ARG_LENGTH = 1024;
 const size_t MAX_VARIABLE_VALUE_LENGTH = 1024;
 
+// Maximum size of event data, a variable value or a function argument sent using a blockwise transfer
+const size_t MAX_BLOCKWISE_DATA_LENGTH = 16384;
+// Maximum number of blocks of a device-originated blockwise transfer that can be in flight
+const unsigned BLOCKWISE_WINDOW_SIZE = 4;
+
 // Timeout in milliseconds given to receive an acknowledgement for a published event
 const unsigned SEND_EVENT_ACK_TIMEOUT = 20000;
 
@@ -152,7 +157,9 @@ enum Enum
     MAX_TRANSMIT_MESSAGE_SIZE = 7, ///< Maximum size of of outgoing CoAP message (set).
     MAX_EVENT_DATA_SIZE = 8, ///< Maximum size of event data (get).
     MAX_VARIABLE_VALUE_SIZE = 9, ///< Maximum size of a variable value (get).
-    MAX_FUNCTION_ARGUMENT_SIZE = 10 ///< Maximum size of a function call argument (get).
+    MAX_FUNCTION_ARGUMENT_SIZE = 10, ///< Maximum size of a function call argument (get).
+    BLOCKWISE_TRANSFERS = 11, ///< Enable/disable blockwise transfers of large payloads (set).
+    FAST_RESUME = 12 ///< Enable/disable fast resumption of the session (set).
 };
 
 }
@@ -53,7 +53,8 @@ namespace SparkAppStateSelector {
 		SYSTEM_MODULE_VERSION = 5,
 		MAX_MESSAGE_SIZE = 6,
 		MAX_BINARY_SIZE = 7,
-		OTA_CHUNK_SIZE = 8
+		OTA_CHUNK_SIZE = 8,
+		DESCRIBE_METRICS = 9
 	};
 }
 
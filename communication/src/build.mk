@@ -38,6 +38,9 @@ CPPSRC += $(TARGET_SRC_PATH)/coap_message_decoder.cpp
 CPPSRC += $(TARGET_SRC_PATH)/coap_util.cpp
 CPPSRC += $(TARGET_SRC_PATH)/firmware_update.cpp
 CPPSRC += $(TARGET_SRC_PATH)/description.cpp
+CPPSRC += $(TARGET_SRC_PATH)/coap_blockwise.cpp
+CPPSRC += $(TARGET_SRC_PATH)/outbound_scheduler.cpp
+CPPSRC += $(TARGET_SRC_PATH)/coap_rtt_estimator.cpp
 
 # ASM source files included in this build.
 ASRC +=
@@ -47,6 +47,7 @@ CoAPCode::Enum CoAP::code(const unsigned char *message) {
         case CoAPCode::CHANGED: return CoAPCode::CHANGED;
         case CoAPCode::NOT_MODIFIED: return CoAPCode::NOT_MODIFIED;
         case CoAPCode::CONTENT: return CoAPCode::CONTENT;
+        case CoAPCode::BLOCKWISE_CONTINUE: return CoAPCode::BLOCKWISE_CONTINUE;
         default:
             // todo - add all recognised codes. Via a smart macro to void manually repeating them.
             if (CoAPCode::is_success(code)) {    // should have been handled above.
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "coap_blockwise.h"
+
+#include "system_error.h"
+#include "service_debug.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace particle {
+
+namespace protocol {
+
+namespace {
+
+// RFC 7959, 2.2: The block size is encoded as SZX = log2(size) - 4. SZX 7 is reserved
+const unsigned MAX_SZX = 6;
+
+} // namespace
+
+unsigned encodeBlockOption(unsigned num, size_t size, bool more) {
+    SPARK_ASSERT(size >= COAP_MIN_BLOCK_SIZE && size <= COAP_MAX_BLOCK_SIZE && !(size & (size - 1)));
+    const unsigned szx = __builtin_ctz(size) - 4;
+    unsigned opt = (num << 4) | szx;
+    if (more) {
+        opt |= 0x08;
+    }
+    return opt;
+}
+
+bool decodeBlockOption(unsigned opt, unsigned* num, size_t* size, bool* more) {
+    const unsigned szx = opt & 0x07;
+    if (szx > MAX_SZX) {
+        return false;
+    }
+    *size = (size_t)1 << (szx + 4);
+    *num = opt >> 4;
+    *more = opt & 0x08;
+    return true;
+}
+
+size_t blockSizeForMessageSize(size_t maxMsgSize, size_t coapOverhead) {
+    for (size_t size = COAP_MAX_BLOCK_SIZE; size >= COAP_MIN_BLOCK_SIZE; size >>= 1) {
+        if (size + coapOverhead <= maxMsgSize) {
+            return size;
+        }
+    }
+    return 0;
+}
+
+BlockwiseSender::BlockwiseSender() :
+        blockSize_(0),
+        windowSize_(0),
+        inFlight_(0),
+        acked_(0) {
+}
+
+int BlockwiseSender::init(const char* data, size_t size, size_t blockSize, unsigned windowSize) {
+    if (!size || !blockSize || !windowSize) {
+        return SYSTEM_ERROR_INVALID_ARGUMENT;
+    }
+    reset();
+    const size_t count = (size + blockSize - 1) / blockSize;
+    if (!data_.resize(size) || !blocks_.resize(count)) {
+        reset();
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    memcpy(data_.data(), data, size);
+    blockSize_ = blockSize;
+    windowSize_ = windowSize;
+    return 0;
+}
+
+bool BlockwiseSender::nextBlock(Block* block) const {
+    if (inFlight_ >= windowSize_) {
+        return false;
+    }
+    for (int i = 0; i < blocks_.size(); ++i) {
+        if (blocks_.at(i).state == BlockState::PENDING) {
+            const size_t offs = i * blockSize_;
+            block->data = data_.data() + offs;
+            block->size = std::min(blockSize_, data_.size() - offs);
+            block->num = i;
+            block->more = (i != blocks_.size() - 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+int BlockwiseSender::blockSent(unsigned num, message_id_t msgId) {
+    if (num >= (unsigned)blocks_.size() || blocks_[num].state != BlockState::PENDING) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
+    auto& b = blocks_[num];
+    b.state = BlockState::IN_FLIGHT;
+    b.msgId = msgId;
+    ++inFlight_;
+    return 0;
+}
+
+int BlockwiseSender::ackReceived(message_id_t msgId) {
+    const int num = findBlock(msgId);
+    if (num < 0) {
+        return num;
+    }
+    blocks_[num].state = BlockState::ACKED;
+    --inFlight_;
+    ++acked_;
+    return num;
+}
+
+void BlockwiseSender::reset() {
+    data_.clear();
+    blocks_.clear();
+    blockSize_ = 0;
+    windowSize_ = 0;
+    inFlight_ = 0;
+    acked_ = 0;
+}
+
+int BlockwiseSender::findBlock(message_id_t msgId) const {
+    for (int i = 0; i < blocks_.size(); ++i) {
+        const auto& b = blocks_.at(i);
+        if (b.state == BlockState::IN_FLIGHT && b.msgId == msgId) {
+            return i;
+        }
+    }
+    return SYSTEM_ERROR_NOT_FOUND;
+}
+
+BlockwiseReceiver::BlockwiseReceiver() :
+        maxSize_(0),
+        blockSize_(0),
+        size_(0),
+        count_(0),
+        lastNum_(-1) {
+}
+
+void BlockwiseReceiver::init(size_t maxSize) {
+    reset();
+    maxSize_ = maxSize;
+}
+
+int BlockwiseReceiver::receiveBlock(unsigned num, size_t blockSize, bool more, const char* data, size_t size) {
+    if (!blockSize_) {
+        blockSize_ = blockSize;
+    } else if (blockSize != blockSize_) {
+        return SYSTEM_ERROR_INVALID_ARGUMENT; // Changing the block size mid-transfer is not supported
+    }
+    if (size > blockSize || (more && size != blockSize)) {
+        return SYSTEM_ERROR_INVALID_ARGUMENT;
+    }
+    if (lastNum_ >= 0 && (num > (unsigned)lastNum_ || (num == (unsigned)lastNum_ && more))) {
+        return SYSTEM_ERROR_INVALID_ARGUMENT;
+    }
+    if (num > maxSize_ / blockSize || num * blockSize + size > maxSize_) {
+        return SYSTEM_ERROR_TOO_LARGE;
+    }
+    if (num < (unsigned)received_.size() && received_[num]) {
+        return 0; // Duplicate block
+    }
+    if (!more && num + 1 < (unsigned)received_.size()) {
+        return SYSTEM_ERROR_INVALID_ARGUMENT; // A block after the last one has been received
+    }
+    const size_t offs = num * blockSize;
+    const size_t end = offs + size;
+    if (num >= (unsigned)received_.size() && !received_.resize(num + 1)) {
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    if (end > (size_t)data_.size() && !data_.resize(end)) {
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    memcpy(data_.data() + offs, data, size);
+    received_[num] = true;
+    ++count_;
+    if (!more) {
+        lastNum_ = num;
+        size_ = end;
+    }
+    return 0;
+}
+
+Vector<char> BlockwiseReceiver::takeData() {
+    Vector<char> data = std::move(data_);
+    reset();
+    return data;
+}
+
+void BlockwiseReceiver::reset() {
+    data_.clear();
+    received_.clear();
+    blockSize_ = 0;
+    size_ = 0;
+    count_ = 0;
+    lastNum_ = -1;
+}
+
+} // namespace protocol
+
+} // namespace particle
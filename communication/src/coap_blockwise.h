@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "protocol_defs.h"
+#include "coap.h"
+
+#include "spark_wiring_vector.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace particle {
+
+namespace protocol {
+
+/**
+ * Minimum block size supported by RFC 7959.
+ */
+const size_t COAP_MIN_BLOCK_SIZE = 16;
+
+/**
+ * Maximum block size supported by RFC 7959.
+ */
+const size_t COAP_MAX_BLOCK_SIZE = 1024;
+
+/**
+ * Time in milliseconds after which the data of a blockwise response is discarded if the server
+ * stops requesting its blocks.
+ */
+const system_tick_t COAP_BLOCKWISE_RESPONSE_TIMEOUT = 90000;
+
+/**
+ * Encode the value of a Block1 or Block2 option.
+ *
+ * @param num Block number.
+ * @param size Block size. Must be a power of two between `COAP_MIN_BLOCK_SIZE` and `COAP_MAX_BLOCK_SIZE`.
+ * @param more Whether more blocks follow.
+ * @return Option value.
+ */
+unsigned encodeBlockOption(unsigned num, size_t size, bool more);
+
+/**
+ * Decode the value of a Block1 or Block2 option.
+ *
+ * @param opt Option value.
+ * @param[out] num Block number.
+ * @param[out] size Block size.
+ * @param[out] more Whether more blocks follow.
+ * @return `false` if the option value is invalid, otherwise `true`.
+ */
+bool decodeBlockOption(unsigned opt, unsigned* num, size_t* size, bool* more);
+
+/**
+ * Get the largest block size that fits in a message of the given size.
+ *
+ * @param maxMsgSize Maximum message size.
+ * @param coapOverhead Maximum size of the CoAP framing in a block message.
+ * @return Block size, or 0 if no block size is suitable.
+ */
+size_t blockSizeForMessageSize(size_t maxMsgSize, size_t coapOverhead);
+
+/**
+ * Sender side of a blockwise transfer.
+ *
+ * The payload data is split into blocks of equal size, and up to a given number of blocks are
+ * allowed to be in flight at the same time. The class only tracks the state of the transfer and
+ * does not send anything on its own.
+ *
+ * Each block is sent in a confirmable message, so a lost block is retransmitted by the CoAP layer
+ * using the same message ID. A block is never sent again in a new message.
+ */
+class BlockwiseSender {
+public:
+    /**
+     * Block descriptor.
+     */
+    struct Block {
+        const char* data; ///< Block data.
+        size_t size; ///< Size of the block data.
+        unsigned num; ///< Block number.
+        bool more; ///< Whether more blocks follow.
+    };
+
+    BlockwiseSender();
+
+    /**
+     * Initialize the transfer.
+     *
+     * The payload data is copied.
+     *
+     * @param data Payload data.
+     * @param size Payload size.
+     * @param blockSize Block size.
+     * @param windowSize Maximum number of blocks in flight.
+     * @return 0 on success, otherwise an error code defined by `system_error_t`.
+     */
+    int init(const char* data, size_t size, size_t blockSize, unsigned windowSize);
+
+    /**
+     * Get the next block to send.
+     *
+     * @param[out] block Block descriptor.
+     * @return `false` if the window is full or there are no blocks to send, otherwise `true`.
+     */
+    bool nextBlock(Block* block) const;
+
+    /**
+     * Mark a block as sent.
+     *
+     * @param num Block number.
+     * @param msgId ID of the message carrying the block.
+     * @return 0 on success, otherwise an error code defined by `system_error_t`.
+     */
+    int blockSent(unsigned num, message_id_t msgId);
+
+    /**
+     * Process an acknowledgement.
+     *
+     * @param msgId Message ID.
+     * @return Block number, or `SYSTEM_ERROR_NOT_FOUND` if the message doesn't carry a block of
+     *         this transfer.
+     */
+    int ackReceived(message_id_t msgId);
+
+    bool isComplete() const;
+    bool isEmpty() const;
+
+    unsigned blockCount() const;
+    unsigned blocksInFlight() const;
+    size_t blockSize() const;
+
+    void reset();
+
+private:
+    enum BlockState: uint8_t {
+        PENDING,
+        IN_FLIGHT,
+        ACKED
+    };
+
+    struct BlockInfo {
+        message_id_t msgId; // ID of the message that carries the block
+        BlockState state; // Block state
+    };
+
+    Vector<char> data_; // Payload data
+    Vector<BlockInfo> blocks_; // Block states
+    size_t blockSize_; // Block size
+    unsigned windowSize_; // Maximum number of blocks in flight
+    unsigned inFlight_; // Number of blocks in flight
+    unsigned acked_; // Number of acknowledged blocks
+
+    int findBlock(message_id_t msgId) const;
+};
+
+/**
+ * Receiver side of a blockwise transfer.
+ *
+ * Blocks can be received in any order. Duplicate blocks are ignored.
+ */
+class BlockwiseReceiver {
+public:
+    BlockwiseReceiver();
+
+    /**
+     * Initialize the transfer.
+     *
+     * @param maxSize Maximum size of the payload data.
+     */
+    void init(size_t maxSize);
+
+    /**
+     * Process a received block.
+     *
+     * @param num Block number.
+     * @param blockSize Block size.
+     * @param more Whether more blocks follow.
+     * @param data Block data.
+     * @param size Size of the block data.
+     * @return 0 on success, otherwise an error code defined by `system_error_t`.
+     */
+    int receiveBlock(unsigned num, size_t blockSize, bool more, const char* data, size_t size);
+
+    /**
+     * Check if a block has been received.
+     *
+     * @param num Block number.
+     */
+    bool hasBlock(unsigned num) const;
+
+    /**
+     * Check if all blocks have been received.
+     */
+    bool isComplete() const;
+
+    /**
+     * Get the payload data.
+     *
+     * The data is only valid after all blocks have been received.
+     */
+    const char* data() const;
+    size_t size() const;
+
+    /**
+     * Take ownership of the payload data.
+     */
+    Vector<char> takeData();
+
+    void reset();
+
+private:
+    Vector<char> data_; // Payload data
+    Vector<bool> received_; // Flags of the received blocks
+    size_t maxSize_; // Maximum payload size
+    size_t blockSize_; // Block size
+    size_t size_; // Payload size, or 0 if not known yet
+    unsigned count_; // Number of received blocks
+    int lastNum_; // Number of the last block, or -1 if not known yet
+};
+
+inline bool BlockwiseSender::isComplete() const {
+    return !blocks_.isEmpty() && acked_ == (unsigned)blocks_.size();
+}
+
+inline bool BlockwiseSender::isEmpty() const {
+    return blocks_.isEmpty();
+}
+
+inline unsigned BlockwiseSender::blockCount() const {
+    return blocks_.size();
+}
+
+inline unsigned BlockwiseSender::blocksInFlight() const {
+    return inFlight_;
+}
+
+inline size_t BlockwiseSender::blockSize() const {
+    return blockSize_;
+}
+
+inline bool BlockwiseReceiver::hasBlock(unsigned num) const {
+    return num < (unsigned)received_.size() && received_.at(num);
+}
+
+inline bool BlockwiseReceiver::isComplete() const {
+    return lastNum_ >= 0 && count_ == (unsigned)lastNum_ + 1;
+}
+
+inline const char* BlockwiseReceiver::data() const {
+    return data_.data();
+}
+
+inline size_t BlockwiseReceiver::size() const {
+    return size_;
+}
+
+} // namespace protocol
+
+} // namespace particle
@@ -48,7 +48,7 @@ ProtocolError CoAPMessageStore::send_message(CoAPMessage* msg, Channel& channel)
  */
 bool CoAPMessageStore::retransmit(CoAPMessage* msg, Channel& channel, system_tick_t now)
 {
-	bool retransmit = (msg->prepare_retransmit(now));
+	bool retransmit = (msg->prepare_retransmit(now, &rtt));
 	if (retransmit)
 	{
 		LOG(TRACE, "Retransmitting CoAP message; ID: %d; attempt %d of %d", (int)msg->get_id(),
@@ -114,7 +114,7 @@ ProtocolError CoAPMessageStore::send(Message& msg, system_tick_t time)
 		if (coapType==CoAPType::CON)
 		{
 			coapmsg->set_send_time(time);
-			coapmsg->prepare_retransmit(time);
+			coapmsg->prepare_retransmit(time, &rtt);
 		}
 		else
 		{
@@ -137,7 +137,12 @@ ProtocolError CoAPMessageStore::receive(Message& msg, Channel& channel, system_t
 		message_id_t id = msg.get_id();
 		CoAPMessage* coap_msg = from_id(id);
 		if (coap_msg) {
-			g_coapRoundTripMSec = time - coap_msg->get_send_time();
+			const system_tick_t round_trip = time - coap_msg->get_send_time();
+			g_coapRoundTripMSec = round_trip;
+			if (msgtype==CoAPType::ACK && coap_msg->get_type()==CoAPType::CON) {
+				rtt.update(round_trip, coap_msg->get_transmit_count(), time);
+				g_coapRetransmissionTimeoutMSec = rtt.rto(time);
+			}
 		}
 		if (msgtype==CoAPType::RESET) {
 			LOG(WARN, "Received RST message; discarding session");
@@ -20,6 +20,7 @@
 
 #include "message_channel.h"
 #include "coap.h"
+#include "coap_rtt_estimator.h"
 #include "timer_hal.h"
 #include "stdlib.h"
 #include "service_debug.h"
@@ -135,6 +136,12 @@ private:
 	 */
 	system_tick_t send_time;
 
+	/**
+	 * The randomized timeout of the first transmission, or 0 if the message is retransmitted
+	 * using the fixed timeouts.
+	 */
+	uint16_t initial_timeout;
+
 	/**
 	 * How many data bytes follow.
 	 */
@@ -171,7 +178,7 @@ public:
 	static const uint8_t NSTART = 1;
 
 
-	CoAPMessage(message_id_t id_) : next(nullptr), timeout(0), id(id_), transmit_count(0), delivered(nullptr), send_time(0), data_len(0) {
+	CoAPMessage(message_id_t id_) : next(nullptr), timeout(0), id(id_), transmit_count(0), delivered(nullptr), send_time(0), initial_timeout(0), data_len(0) {
 		message_count++;
 	}
 
@@ -222,13 +229,18 @@ public:
 
 	/**
 	 * Prepares to retransmit this message after a timeout.
+	 * @param rtt The estimator of the retransmission timeout. If it has no estimate
+	 * 	when the message is first transmitted, the fixed timeouts are used.
 	 * @return false if the message cannot be retransmitted.
 	 */
-	bool prepare_retransmit(system_tick_t now)
+	bool prepare_retransmit(system_tick_t now, CoapRttEstimator* rtt=nullptr)
 	{
 		CoAPType::Enum coapType = CoAP::type(get_data());
 		if (coapType==CoAPType::CON) {
-			timeout = now + transmit_timeout(transmit_count);
+			if (transmit_count == 0) {
+				initial_timeout = (rtt && rtt->hasEstimate()) ? randomize_timeout(rtt->rto(now)) : 0;
+			}
+			timeout = now + next_transmit_timeout();
 			if (transmit_count == 0) {
 				g_trasmittedMessageCounter++;
 			}
@@ -264,11 +276,35 @@ public:
 	 */
 	static inline system_tick_t transmit_timeout(uint8_t transmit_count)
 	{
-		system_tick_t timeout = (ACK_TIMEOUT << transmit_count);
-		timeout += ((timeout * (rand()%256))>>9);
+		return randomize_timeout(ACK_TIMEOUT << transmit_count);
+	}
+
+	/**
+	 * Adds a random amount of up to half of the given timeout.
+	 */
+	static inline system_tick_t randomize_timeout(system_tick_t timeout)
+	{
+		return timeout + ((timeout * (rand()%256))>>9);
+	}
+
+	/**
+	 * Determines the timeout of the next transmission of this message.
+	 */
+	system_tick_t next_transmit_timeout() const
+	{
+		if (!initial_timeout)
+			return transmit_timeout(transmit_count);
+		system_tick_t timeout = initial_timeout;
+		for (uint8_t i=0; i<transmit_count; i++)
+			timeout = CoapRttEstimator::backoff(timeout, initial_timeout);
 		return timeout;
 	}
 
+	uint16_t get_initial_timeout() const
+	{
+		return initial_timeout;
+	}
+
 	inline CoAPType::Enum get_type() const
 	{
 		return data_len>0 ? CoAP::type(data) : CoAPType::ERROR;
@@ -339,6 +375,11 @@ class CoAPMessageStore
 	 */
 	CoAPMessage* head;
 
+	/**
+	 * Estimates the retransmission timeout from the round-trip times of the acknowledged messages.
+	 */
+	CoapRttEstimator rtt;
+
 	/**
 	 * Retrieves the message with the given ID and the previous message.
 	 * If no message exists with the given id, nullptr is returned.
@@ -386,6 +427,11 @@ public:
 
 	bool has_unacknowledged_requests() const;
 
+	CoapRttEstimator& rtt_estimator()
+	{
+		return rtt;
+	}
+
 	/**
 	 * Retrieves the current confirmable message that is still
 	 * waiting acknowledgement.
@@ -571,6 +617,10 @@ public:
 		return server;
 	}
 
+	CoapRttEstimator& rtt_estimator() {
+		return client.rtt_estimator();
+	}
+
 	/**
 	 * Establish this channel for communication.
 	 */
@@ -587,6 +637,7 @@ public:
 	{
 		server.clear();
 		client.clear();
+		client.rtt_estimator().reset();
 		channel::reset();
 	}
 
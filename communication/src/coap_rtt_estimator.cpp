@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "coap_rtt_estimator.h"
+
+#include <algorithm>
+
+namespace particle {
+
+namespace protocol {
+
+namespace {
+
+// Variance multipliers of the strong and weak estimators
+const unsigned STRONG_K = 4;
+const unsigned WEAK_K = 1;
+
+// Timeouts below and above these values use a larger and smaller backoff factor respectively
+const system_tick_t SHORT_RTO = 1000;
+const system_tick_t LONG_RTO = 3000;
+
+// A short RTO is doubled if it hasn't been updated for this many times its value
+const unsigned SHORT_RTO_AGING_FACTOR = 16;
+// A long RTO is moved towards SHORT_RTO if it hasn't been updated for this many times its value
+const unsigned LONG_RTO_AGING_FACTOR = 4;
+
+} // namespace
+
+CoapRttEstimator::CoapRttEstimator() {
+    reset();
+}
+
+void CoapRttEstimator::update(system_tick_t rtt, unsigned transmitCount, system_tick_t now) {
+    if (!transmitCount || transmitCount > MAX_WEAK_RETRANSMITS + 1) {
+        // It's unknown which of the transmissions has been acknowledged
+        return;
+    }
+    system_tick_t rto = this->rto(now); // Apply the aging first
+    if (transmitCount == 1) {
+        rto = (updateEstimator(&strong_, rtt, STRONG_K) + rto) / 2;
+    } else {
+        rto = (updateEstimator(&weak_, rtt, WEAK_K) + rto * 3) / 4;
+    }
+    rto_ = std::min(std::max(rto, MIN_RTO), MAX_RTO);
+    lastUpdate_ = now;
+}
+
+system_tick_t CoapRttEstimator::rto(system_tick_t now) {
+    if (!hasEstimate()) {
+        return rto_;
+    }
+    for (;;) {
+        const system_tick_t elapsed = now - lastUpdate_;
+        if (rto_ < SHORT_RTO && elapsed >= rto_ * SHORT_RTO_AGING_FACTOR) {
+            lastUpdate_ += rto_ * SHORT_RTO_AGING_FACTOR;
+            rto_ *= 2;
+        } else if (rto_ > LONG_RTO && elapsed >= rto_ * LONG_RTO_AGING_FACTOR) {
+            lastUpdate_ += rto_ * LONG_RTO_AGING_FACTOR;
+            rto_ = SHORT_RTO + rto_ / 2;
+        } else {
+            break;
+        }
+    }
+    return rto_;
+}
+
+void CoapRttEstimator::reset() {
+    strong_ = Estimator();
+    weak_ = Estimator();
+    rto_ = DEFAULT_RTO;
+    lastUpdate_ = 0;
+}
+
+system_tick_t CoapRttEstimator::backoff(system_tick_t timeout, system_tick_t initialTimeout) {
+    if (initialTimeout < SHORT_RTO) {
+        return timeout * 3;
+    }
+    if (initialTimeout > LONG_RTO) {
+        return timeout * 3 / 2;
+    }
+    return timeout * 2;
+}
+
+system_tick_t CoapRttEstimator::updateEstimator(Estimator* e, system_tick_t rtt, unsigned k) {
+    if (!e->samples) {
+        e->srtt = rtt;
+        e->rttvar = rtt / 2;
+    } else {
+        const system_tick_t delta = (e->srtt > rtt) ? e->srtt - rtt : rtt - e->srtt;
+        e->rttvar = (e->rttvar * 3 + delta) / 4;
+        e->srtt = (e->srtt * 7 + rtt) / 8;
+    }
+    ++e->samples;
+    return e->srtt + e->rttvar * k;
+}
+
+} // namespace protocol
+
+} // namespace particle
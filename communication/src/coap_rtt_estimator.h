@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_tick_hal.h"
+
+namespace particle {
+
+namespace protocol {
+
+/**
+ * Estimates the retransmission timeout of confirmable CoAP messages.
+ *
+ * The estimator implements the CoCoA algorithm (draft-ietf-core-cocoa). Round-trip times of the
+ * exchanges that completed without retransmissions are fed to the strong estimator. Round-trip
+ * times of the exchanges that needed up to `MAX_WEAK_RETRANSMITS` retransmissions are measured from
+ * the first transmission and fed to the weak estimator, which has a smaller weight. The overall
+ * retransmission timeout (RTO) is a moving average of the estimators' RTOs.
+ *
+ * Until the first round-trip time is measured, the estimator reports no estimate and the messages
+ * are retransmitted using the fixed timeouts of RFC 7252.
+ */
+class CoapRttEstimator {
+public:
+    /**
+     * Initial retransmission timeout in milliseconds (`ACK_TIMEOUT` of the CoAP channel).
+     */
+    static constexpr system_tick_t DEFAULT_RTO = 4000;
+
+    /**
+     * Minimum retransmission timeout in milliseconds.
+     */
+    static constexpr system_tick_t MIN_RTO = 500;
+
+    /**
+     * Maximum retransmission timeout in milliseconds.
+     *
+     * The limit ensures that all retransmissions of a message happen within `MAX_TRANSMIT_SPAN`
+     * even if the initial timeout is randomized to its maximum.
+     */
+    static constexpr system_tick_t MAX_RTO = 6000;
+
+    /**
+     * Maximum number of retransmissions after which a round-trip time is still used as a weak
+     * estimate.
+     */
+    static constexpr unsigned MAX_WEAK_RETRANSMITS = 2;
+
+    CoapRttEstimator();
+
+    /**
+     * Process a measured round-trip time.
+     *
+     * @param rtt Time elapsed between the first transmission of a message and its acknowledgement.
+     * @param transmitCount Number of times the message has been transmitted.
+     * @param now Current time.
+     */
+    void update(system_tick_t rtt, unsigned transmitCount, system_tick_t now);
+
+    /**
+     * Get the current retransmission timeout.
+     *
+     * If the estimate hasn't been updated for a while, it ages towards the default value.
+     *
+     * @param now Current time.
+     * @return Timeout in milliseconds.
+     */
+    system_tick_t rto(system_tick_t now);
+
+    /**
+     * Check if at least one round-trip time has been measured.
+     */
+    bool hasEstimate() const;
+
+    /**
+     * Reset the estimator to its initial state.
+     */
+    void reset();
+
+    /**
+     * Get the number of round-trip times fed to the strong estimator.
+     */
+    unsigned strongSamples() const;
+
+    /**
+     * Get the number of round-trip times fed to the weak estimator.
+     */
+    unsigned weakSamples() const;
+
+    /**
+     * Get the timeout of the next retransmission of a message.
+     *
+     * The backoff factor depends on the initial timeout of the message: short timeouts are tripled,
+     * long ones are increased by half and all other timeouts are doubled.
+     *
+     * @param timeout Timeout of the previous transmission.
+     * @param initialTimeout Timeout of the first transmission.
+     * @return Timeout in milliseconds.
+     */
+    static system_tick_t backoff(system_tick_t timeout, system_tick_t initialTimeout);
+
+private:
+    struct Estimator {
+        system_tick_t srtt; // Smoothed round-trip time
+        system_tick_t rttvar; // Round-trip time variation
+        unsigned samples;
+    };
+
+    Estimator strong_;
+    Estimator weak_;
+    system_tick_t rto_; // Overall RTO
+    system_tick_t lastUpdate_; // Time the overall RTO was last changed
+
+    static system_tick_t updateEstimator(Estimator* e, system_tick_t rtt, unsigned k);
+};
+
+inline bool CoapRttEstimator::hasEstimate() const {
+    return strong_.samples || weak_.samples;
+}
+
+inline unsigned CoapRttEstimator::strongSamples() const {
+    return strong_.samples;
+}
+
+inline unsigned CoapRttEstimator::weakSamples() const {
+    return weak_.samples;
+}
+
+} // namespace protocol
+
+} // namespace particle
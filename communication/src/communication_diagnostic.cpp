@@ -1,7 +1,11 @@
 #include "communication_diagnostic.h"
 
-particle::SimpleUnsignedIntegerDiagnosticData g_rateLimitedEventsCounter(DIAG_ID_CLOUD_RATE_LIMITED_EVENTS, DIAG_NAME_CLOUD_RATE_LIMITED_EVENTS);
-particle::SimpleUnsignedIntegerDiagnosticData g_unacknowledgedMessageCounter(DIAG_ID_CLOUD_UNACKNOWLEDGED_MESSAGES, DIAG_NAME_CLOUD_UNACKNOWLEDGED_MESSAGES);
-particle::SimpleUnsignedIntegerDiagnosticData g_trasmittedMessageCounter(DIAG_ID_CLOUD_TRANSMITTED_MESSAGES, DIAG_NAME_CLOUD_TRANSMITTED_MESSAGES);
-particle::SimpleUnsignedIntegerDiagnosticData g_retransmittedMessageCounter(DIAG_ID_CLOUD_RETRANSMITTED_MESSAGES, DIAG_NAME_CLOUD_RETRANSMITTED_MESSAGES);
+particle::CounterDiagnosticData g_rateLimitedEventsCounter(DIAG_ID_CLOUD_RATE_LIMITED_EVENTS, DIAG_NAME_CLOUD_RATE_LIMITED_EVENTS);
+particle::CounterDiagnosticData g_unacknowledgedMessageCounter(DIAG_ID_CLOUD_UNACKNOWLEDGED_MESSAGES, DIAG_NAME_CLOUD_UNACKNOWLEDGED_MESSAGES);
+particle::CounterDiagnosticData g_trasmittedMessageCounter(DIAG_ID_CLOUD_TRANSMITTED_MESSAGES, DIAG_NAME_CLOUD_TRANSMITTED_MESSAGES);
+particle::CounterDiagnosticData g_retransmittedMessageCounter(DIAG_ID_CLOUD_RETRANSMITTED_MESSAGES, DIAG_NAME_CLOUD_RETRANSMITTED_MESSAGES);
 particle::SimpleUnsignedIntegerDiagnosticData g_coapRoundTripMSec(DIAG_ID_CLOUD_COAP_ROUND_TRIP, DIAG_NAME_CLOUD_COAP_ROUND_TRIP);
+particle::SimpleUnsignedIntegerDiagnosticData g_handshakeSavedTimeMSec(DIAG_ID_CLOUD_HANDSHAKE_SAVED_TIME, DIAG_NAME_CLOUD_HANDSHAKE_SAVED_TIME);
+particle::SimpleUnsignedIntegerDiagnosticData g_coapSystemQueueLatencyMSec(DIAG_ID_CLOUD_SYSTEM_QUEUE_LATENCY, DIAG_NAME_CLOUD_SYSTEM_QUEUE_LATENCY);
+particle::SimpleUnsignedIntegerDiagnosticData g_coapApplicationQueueLatencyMSec(DIAG_ID_CLOUD_APPLICATION_QUEUE_LATENCY, DIAG_NAME_CLOUD_APPLICATION_QUEUE_LATENCY);
+particle::SimpleUnsignedIntegerDiagnosticData g_coapRetransmissionTimeoutMSec(DIAG_ID_CLOUD_COAP_RETRANSMISSION_TIMEOUT, DIAG_NAME_CLOUD_COAP_RETRANSMISSION_TIMEOUT);
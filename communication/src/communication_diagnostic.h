@@ -1,7 +1,11 @@
 #include "spark_wiring_diagnostics.h"
 
-extern particle::SimpleUnsignedIntegerDiagnosticData g_rateLimitedEventsCounter;
-extern particle::SimpleUnsignedIntegerDiagnosticData g_unacknowledgedMessageCounter;
-extern particle::SimpleUnsignedIntegerDiagnosticData g_trasmittedMessageCounter;
-extern particle::SimpleUnsignedIntegerDiagnosticData g_retransmittedMessageCounter;
+extern particle::CounterDiagnosticData g_rateLimitedEventsCounter;
+extern particle::CounterDiagnosticData g_unacknowledgedMessageCounter;
+extern particle::CounterDiagnosticData g_trasmittedMessageCounter;
+extern particle::CounterDiagnosticData g_retransmittedMessageCounter;
 extern particle::SimpleUnsignedIntegerDiagnosticData g_coapRoundTripMSec;
+extern particle::SimpleUnsignedIntegerDiagnosticData g_handshakeSavedTimeMSec;
+extern particle::SimpleUnsignedIntegerDiagnosticData g_coapSystemQueueLatencyMSec;
+extern particle::SimpleUnsignedIntegerDiagnosticData g_coapApplicationQueueLatencyMSec;
+extern particle::SimpleUnsignedIntegerDiagnosticData g_coapRetransmissionTimeoutMSec;
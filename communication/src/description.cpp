@@ -23,6 +23,7 @@
 #include "message_channel.h"
 #include "coap_message_encoder.h"
 #include "coap_message_decoder.h"
+#include "scope_guard.h"
 
 #include "mbedtls_config.h"
 
@@ -61,7 +62,7 @@ const size_t MAX_REQUEST_COAP_OVERHEAD = 14;
 // - Payload marker: 1 byte.
 const size_t MAX_RESPONSE_COAP_OVERHEAD = 16;
 
-// Minimum and maximum supported block sizes for blockwise transfers
+// Minimum and maximum block sizes supported by the server for blockwise Describe transfers
 const size_t MIN_BLOCK_SIZE = 512;
 const size_t MAX_BLOCK_SIZE = 1024;
 
@@ -160,30 +161,6 @@ private:
     }
 };
 
-unsigned encodeBlockOption(unsigned num, unsigned size, bool m) {
-    // RFC 7959, 2.2. Structure of a Block Option
-    static_assert(MIN_BLOCK_SIZE == 512 && MAX_BLOCK_SIZE == 1024, "This code needs to be updated accordingly");
-    SPARK_ASSERT(size == 1024 || size == 512);
-    size = (size == 1024) ? 6 : 5; // SZX
-    unsigned opt = (num << 4) | size;
-    if (m) {
-        opt |= 0x08;
-    }
-    return opt;
-}
-
-bool decodeBlockOption(unsigned opt, unsigned* num, unsigned* size, bool* m) {
-    static_assert(MIN_BLOCK_SIZE == 512 && MAX_BLOCK_SIZE == 1024, "This code needs to be updated accordingly");
-    switch (opt & 0x07) { // SZX
-        case 6: *size = 1024; break;
-        case 5: *size = 512; break;
-        default: return false; // Unsupported block size
-    }
-    *num = opt >> 4;
-    *m = opt & 0x08;
-    return true;
-}
-
 void initDescribeRequest(CoapMessageEncoder* enc, token_t token, int flags) {
     enc->type(CoapType::CON);
     enc->code(CoapCode::POST);
@@ -262,7 +239,7 @@ ProtocolError Description::receiveRequest(const Message& msg) {
     iter = dec.findOption(CoapOption::BLOCK2);
     if (iter) {
         const auto blockOpt = iter.toUInt();
-        unsigned recvBlockSize = 0;
+        size_t recvBlockSize = 0;
         bool hasMore = false; // Ignored
         if (!decodeBlockOption(blockOpt, &blockIndex, &recvBlockSize, &hasMore)) {
             LOG(WARN, "Invalid message options");
@@ -272,7 +249,7 @@ ProtocolError Description::receiveRequest(const Message& msg) {
             // This is a deviation from RFC 7959 but we require the server, that knows the maximum
             // size of a CoAP message supported by the device, to always use the maximum supported
             // block size in its requests
-            LOG(WARN, "Unexpected block size: %u", recvBlockSize);
+            LOG(WARN, "Unexpected block size: %u", (unsigned)recvBlockSize);
             return sendErrorResponse(dec, CoapCode::BAD_OPTION);
         }
     }
@@ -299,11 +276,18 @@ ProtocolError Description::receiveRequest(const Message& msg) {
     CHECK_PROTOCOL(proto_->get_channel().create(respMsg));
     CoapMessageEncoder enc((char*)respMsg.buf(), respMsg.capacity());
     size_t payloadSize = 0;
+    bool serialized = false;
+    NAMED_SCOPE_GUARD(notSentGuard, {
+        if (serialized) {
+            describeNotSent(flags);
+        }
+    });
     if (!resp) {
         initDescribeResponse(&enc, reqToken);
         const size_t msgOffs = enc.payloadData() - (char*)respMsg.buf();
         Vector<char> buf;
         CHECK_PROTOCOL(getDescribeData(flags, &respMsg, msgOffs, &buf, &payloadSize));
+        serialized = true;
         if (!buf.isEmpty()) {
             // Prepare a blockwise response
             newResp.data = std::move(buf);
@@ -349,6 +333,7 @@ ProtocolError Description::receiveRequest(const Message& msg) {
             return ProtocolError::NO_MEMORY;
         }
     }
+    notSentGuard.dismiss();
     if (resp) {
         if (!resp->reqCount && respIndex < activeResps_.size()) {
             activeResps_.removeAt(respIndex);
@@ -382,17 +367,13 @@ ProtocolError Description::receiveAckOrRst(const Message& msg, int* descFlags) {
         }
         if (!activeReq_->data.isEmpty()) {
             // Send the next block of the current blockwise request
-            Message msg;
-            CHECK_PROTOCOL(proto_->get_channel().create(msg));
-            const auto token = proto_->get_next_token();
-            CHECK_PROTOCOL(sendNextRequestBlock(&*activeReq_, &msg, token));
+            activeReq_->blockPending = true;
+            CHECK_PROTOCOL(sendPending());
         } else {
             // Received an ACK for the last block of the current blockwise request
             const auto flags = activeReq_->flags;
             activeReq_.reset();
-            if (!reqQueue_.isEmpty()) {
-                CHECK_PROTOCOL(sendNextRequest(reqQueue_.takeFirst()));
-            }
+            CHECK_PROTOCOL(sendPending());
             *descFlags = flags;
         }
     } else {
@@ -414,6 +395,8 @@ ProtocolError Description::receiveAckOrRst(const Message& msg, int* descFlags) {
 }
 
 ProtocolError Description::processTimeouts() {
+    // Send the request blocks that have been deferred by the outbound scheduler
+    CHECK_PROTOCOL(sendPending());
     if (activeResps_.isEmpty()) {
         return ProtocolError::NO_ERROR;
     }
@@ -516,6 +499,25 @@ void Description::reset() {
     blockSize_ = 0;
 }
 
+ProtocolError Description::sendPending() {
+    if (activeReq_.has_value()) {
+        if (!activeReq_->blockPending || !proto_->outbound_ready(OutboundClass::SYSTEM)) {
+            return ProtocolError::NO_ERROR;
+        }
+        Message msg;
+        CHECK_PROTOCOL(proto_->get_channel().create(msg));
+        const auto token = proto_->get_next_token();
+        activeReq_->blockPending = false;
+        CHECK_PROTOCOL(sendNextRequestBlock(&*activeReq_, &msg, token));
+    } else if (!reqQueue_.isEmpty()) {
+        if (!proto_->outbound_ready(OutboundClass::SYSTEM)) {
+            return ProtocolError::NO_ERROR;
+        }
+        CHECK_PROTOCOL(sendNextRequest(reqQueue_.takeFirst()));
+    }
+    return ProtocolError::NO_ERROR;
+}
+
 ProtocolError Description::sendNextRequest(int flags) {
     SPARK_ASSERT(!activeReq_.has_value());
     // Serialize a Describe request
@@ -528,6 +530,9 @@ ProtocolError Description::sendNextRequest(int flags) {
     Vector<char> buf;
     size_t payloadSize = 0;
     CHECK_PROTOCOL(getDescribeData(flags, &msg, msgOffs, &buf, &payloadSize));
+    NAMED_SCOPE_GUARD(notSentGuard, {
+        describeNotSent(flags);
+    });
     if (!buf.isEmpty()) {
         // Send a blockwise request
         Request req = {};
@@ -547,6 +552,7 @@ ProtocolError Description::sendNextRequest(int flags) {
             return ProtocolError::NO_MEMORY;
         }
     }
+    notSentGuard.dismiss();
     return ProtocolError::NO_ERROR;
 }
 
@@ -609,7 +615,7 @@ ProtocolError Description::sendErrorResponse(const CoapMessageDecoder& reqDec, C
     if (isCon) {
         msg.set_id(reqDec.id());
     }
-    CHECK_PROTOCOL(encodeAndSend(&enc, &msg));
+    CHECK_PROTOCOL(encodeAndSend(&enc, &msg, OutboundClass::CONTROL));
     return ProtocolError::NO_ERROR;
 }
 
@@ -621,11 +627,11 @@ ProtocolError Description::sendEmptyAck(message_id_t msgId) {
     enc.code(CoapCode::EMPTY);
     enc.id(0); // Encoded by the message channel
     msg.set_id(msgId);
-    CHECK_PROTOCOL(encodeAndSend(&enc, &msg));
+    CHECK_PROTOCOL(encodeAndSend(&enc, &msg, OutboundClass::CONTROL));
     return ProtocolError::NO_ERROR;
 }
 
-ProtocolError Description::encodeAndSend(CoapMessageEncoder* enc, Message* msg) {
+ProtocolError Description::encodeAndSend(CoapMessageEncoder* enc, Message* msg, OutboundClass cls) {
     const size_t maxMsgSize = proto_->get_max_transmit_message_size();
     const int r = enc->encode();
     if (r < 0 || r > (int)maxMsgSize) {
@@ -634,6 +640,7 @@ ProtocolError Description::encodeAndSend(CoapMessageEncoder* enc, Message* msg)
     }
     msg->set_length(r);
     CHECK_PROTOCOL(proto_->get_channel().send(*msg));
+    proto_->outbound_sent(cls, *msg);
     return ProtocolError::NO_ERROR;
 }
 
@@ -643,6 +650,7 @@ ProtocolError Description::getDescribeData(int flags, Message* msg, size_t msgOf
     BufferAppender2 appender((char*)msg->buf() + msgOffs, maxMsgSize - msgOffs, buf);
     CHECK_PROTOCOL(serialize(&appender, flags));
     if (!appender.ok()) {
+        describeNotSent(flags);
         return ProtocolError::NO_MEMORY;
     }
     *size = appender.size();
@@ -650,23 +658,29 @@ ProtocolError Description::getDescribeData(int flags, Message* msg, size_t msgOf
 }
 
 ProtocolError Description::getBlockSize(size_t* size) {
-    static_assert(MIN_BLOCK_SIZE == 512 && MAX_BLOCK_SIZE == 1024, "This code needs to be updated accordingly");
     if (!blockSize_) {
         const size_t maxMsgSize = proto_->get_max_transmit_message_size();
         const size_t coapOverhead = std::max(MAX_REQUEST_COAP_OVERHEAD, MAX_RESPONSE_COAP_OVERHEAD);
-        if (coapOverhead + 1024 <= maxMsgSize) {
-            blockSize_ = 1024;
-        } else if (coapOverhead + 512 <= maxMsgSize) {
-            blockSize_ = 512;
-        } else {
+        const size_t blockSize = std::min(blockSizeForMessageSize(maxMsgSize, coapOverhead), MAX_BLOCK_SIZE);
+        if (blockSize < MIN_BLOCK_SIZE) {
             LOG(ERROR, "Failed to determine block size");
             return ProtocolError::INTERNAL;
         }
+        blockSize_ = blockSize;
     }
     *size = blockSize_;
     return ProtocolError::NO_ERROR;
 }
 
+void Description::describeNotSent(int flags) {
+    const auto& descriptor = proto_->get_descriptor();
+    if (flags == DescriptionType::DESCRIBE_METRICS && descriptor.app_state_selector_info) {
+        // The serialized metrics will never be acknowledged
+        descriptor.app_state_selector_info(SparkAppStateSelector::DESCRIBE_METRICS, SparkAppStateUpdate::RESET,
+                0, nullptr);
+    }
+}
+
 system_tick_t Description::millis() const {
     return proto_->get_callbacks().millis();
 }
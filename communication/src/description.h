@@ -19,6 +19,8 @@
 
 #include "protocol_defs.h"
 #include "coap_defs.h"
+#include "coap_blockwise.h"
+#include "outbound_scheduler.h"
 
 #include "spark_wiring_vector.h"
 
@@ -39,8 +41,6 @@ class CoapMessageDecoder;
 class Protocol;
 class Message;
 
-const system_tick_t COAP_BLOCKWISE_RESPONSE_TIMEOUT = 90000;
-
 class Description {
 public:
     explicit Description(Protocol* proto);
@@ -61,6 +61,7 @@ private:
         message_id_t msgId; // Message ID of the last sent block request
         unsigned nextBlockIndex; // Index of the next block to send
         int flags; // Describe flags
+        bool blockPending; // Whether the next block is waiting to be sent
     };
 
     struct Response {
@@ -85,14 +86,16 @@ private:
     size_t blockSize_; // Block size used for blockwise transfers
     unsigned lastEtag_; // Last used ETag
 
+    ProtocolError sendPending();
     ProtocolError sendNextRequest(int flags);
     ProtocolError sendNextRequestBlock(Request* req, Message* msg, token_t token);
     ProtocolError sendResponseBlock(const Response& resp, Message* msg, token_t token, unsigned blockIndex);
     ProtocolError sendErrorResponse(const CoapMessageDecoder& reqDec, CoapCode code);
     ProtocolError sendEmptyAck(message_id_t msgId);
-    ProtocolError encodeAndSend(CoapMessageEncoder* enc, Message* msg);
+    ProtocolError encodeAndSend(CoapMessageEncoder* enc, Message* msg, OutboundClass cls = OutboundClass::SYSTEM);
     ProtocolError getDescribeData(int flags, Message* msg, size_t msgOffs, Vector<char>* buf, size_t* size);
     ProtocolError getBlockSize(size_t* size);
+    void describeNotSent(int flags);
     system_tick_t millis() const;
 };
 
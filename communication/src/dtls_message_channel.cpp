@@ -43,6 +43,9 @@ void mbedtls_ssl_update_out_pointers(mbedtls_ssl_context *ssl, mbedtls_ssl_trans
 #include "mbedtls/error.h"
 #include "mbedtls/ssl_internal.h"
 #include "mbedtls_util.h"
+#include "ecc_precompute.h"
+#include "communication_diagnostic.h"
+#include "trace_recorder.h"
 #include "mbedtls/version.h"
 #include "timer_hal.h"
 #include <stdio.h>
@@ -391,6 +394,7 @@ ProtocolError DTLSMessageChannel::setup_context()
 
 ProtocolError DTLSMessageChannel::establish()
 {
+	TRACE_SCOPE(TRACE_ID_DTLS_HANDSHAKE, 0, 0);
 	int ret = 0;
 	// LOG(INFO,"setup context");
 	ProtocolError error = setup_context();
@@ -425,6 +429,11 @@ ProtocolError DTLSMessageChannel::establish()
 	}
 	uint8_t random[64];
 
+	// Used to determine how much time the precomputed handshake crypto has saved
+	ecc_precompute_stats precomputeStats = {};
+	precomputeStats.size = sizeof(precomputeStats);
+	const bool hasPrecomputeStats = (ecc_precompute_get_stats(&precomputeStats, nullptr) == 0);
+
 	do
 	{
 		while (ssl_context.state != MBEDTLS_SSL_HANDSHAKE_OVER)
@@ -456,6 +465,14 @@ ProtocolError DTLSMessageChannel::establish()
 		return IO_ERROR_GENERIC_ESTABLISH;
 	}
 
+	if (hasPrecomputeStats) {
+		const uint32_t savedTime = precomputeStats.saved_time;
+		if (ecc_precompute_get_stats(&precomputeStats, nullptr) == 0) {
+			g_handshakeSavedTimeMSec = precomputeStats.saved_time - savedTime;
+			LOG(TRACE, "Precomputed crypto saved %u ms", (unsigned)(precomputeStats.saved_time - savedTime));
+		}
+	}
+
 	return NO_ERROR;
 }
 
@@ -500,6 +517,7 @@ ProtocolError DTLSMessageChannel::receive(Message& message)
 	}
 	message.set_length(ret);
 	if (ret > 0) {
+		TRACE_EVENT(TRACE_ID_DTLS_RECEIVE, ret, 0);
 		cancel_move_session();
 		sessionPersist.update(&ssl_context, callbacks.save, coap_state ? *coap_state : 0);
 		if (debug_enabled) {
@@ -542,6 +560,7 @@ ProtocolError DTLSMessageChannel::send(Message& message)
 	}
 
 	int ret = mbedtls_ssl_write(&ssl_context, message.buf(), message.length());
+	TRACE_EVENT(TRACE_ID_DTLS_SEND, message.length(), ret);
 	if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
 		LOG(ERROR, "mbedtls_ssl_write() failed: -0x%x", -ret);
 		if (ret == MBEDTLS_ERR_NET_SEND_FAILED) {
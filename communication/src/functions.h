@@ -20,10 +20,14 @@
 #pragma once
 
 #include <string.h>
+#include <algorithm>
 #include "protocol_defs.h"
 #include "message_channel.h"
 #include "messages.h"
 #include "spark_descriptor.h"
+#include "coap_blockwise.h"
+#include "coap_message_encoder.h"
+#include "coap_message_decoder.h"
 
 
 namespace particle
@@ -36,6 +40,93 @@ class Functions
     // TODO: This is quite a large buffer and there's no need for it to be allocated statically
     char function_arg[MAX_FUNCTION_ARG_LENGTH+1]; // add one for null terminator
 
+    // State of a function call whose argument is received using a blockwise transfer
+    BlockwiseReceiver blockwise_receiver;
+    Vector<char> blockwise_arg; // Reassembled argument data
+    char blockwise_key[MAX_FUNCTION_KEY_LENGTH+1]; // Function name
+
+    ProtocolError send_block_ack(MessageChannel& channel, const CoapMessageDecoder& dec, CoapCode code,
+            unsigned block_opt)
+    {
+        Message response;
+        ProtocolError error = channel.create(response);
+        if (error) {
+            return error;
+        }
+        CoapMessageEncoder enc((char*)response.buf(), response.capacity());
+        enc.type(CoapType::ACK);
+        enc.code(code);
+        enc.id(0); // Encoded by the message channel
+        if (code != CoapCode::EMPTY) {
+            enc.token(dec.token(), dec.tokenSize());
+        }
+        if (code == CoapCode::CONTINUE) {
+            enc.option(CoapOption::BLOCK1, block_opt);
+        }
+        const int r = enc.encode();
+        if (r < 0 || r > (int)response.capacity()) {
+            return INTERNAL;
+        }
+        response.set_length(r);
+        response.set_id(dec.id());
+        return channel.send(response);
+    }
+
+    /**
+     * Handle a block of a function call whose argument doesn't fit in a single message.
+     */
+    ProtocolError handle_function_call_block(token_t token, const CoapMessageDecoder& dec, size_t max_arg_size,
+            MessageChannel& channel,
+            int (*call_function)(const char *function_key, const char *arg, SparkDescriptor::FunctionResultCallback callback, void* reserved))
+    {
+        const auto block_opt = dec.findOption(CoapOption::BLOCK1).toUInt();
+        unsigned num = 0;
+        size_t size = 0;
+        bool more = false;
+        if (!decodeBlockOption(block_opt, &num, &size, &more)) {
+            return send_block_ack(channel, dec, CoapCode::BAD_OPTION, block_opt);
+        }
+        // The function name is the second Uri-Path option
+        auto it = dec.findOption(CoapOption::URI_PATH);
+        if (!it || !it.next() || it.option() != (unsigned)CoapOption::URI_PATH) {
+            return send_block_ack(channel, dec, CoapCode::BAD_REQUEST, block_opt);
+        }
+        const size_t key_len = std::min(it.size(), MAX_FUNCTION_KEY_LENGTH);
+        // The blocks can arrive in any order, so any block of a function that is not being called
+        // starts a new call. A repeated first block means that the server has restarted the call
+        const bool same_call = (blockwise_key[0] && strlen(blockwise_key) == key_len &&
+                memcmp(blockwise_key, it.data(), key_len) == 0);
+        if (!same_call || (num == 0 && blockwise_receiver.hasBlock(0))) {
+            blockwise_receiver.init(max_arg_size);
+            memcpy(blockwise_key, it.data(), key_len);
+            blockwise_key[key_len] = 0;
+        }
+        const int r = blockwise_receiver.receiveBlock(num, size, more, dec.payload(), dec.payloadSize());
+        if (r < 0) {
+            reset();
+            return send_block_ack(channel, dec, (r == SYSTEM_ERROR_TOO_LARGE) ? CoapCode::REQUEST_ENTITY_TOO_LARGE :
+                    CoapCode::BAD_REQUEST, block_opt);
+        }
+        if (!blockwise_receiver.isComplete()) {
+            return send_block_ack(channel, dec, CoapCode::CONTINUE, block_opt);
+        }
+        blockwise_arg = blockwise_receiver.takeData();
+        if (!blockwise_arg.append('\0')) {
+            reset();
+            return send_block_ack(channel, dec, CoapCode::INTERNAL_SERVER_ERROR, block_opt);
+        }
+        // Acknowledge the last block and send the result in a separate response
+        const ProtocolError error = send_block_ack(channel, dec, CoapCode::EMPTY, block_opt);
+        if (error) {
+            return error;
+        }
+        auto callback = [=,&channel] (const void* result, SparkReturnType::Enum resultType )
+            { return this->function_result(channel, result, resultType, token); };
+        call_function(blockwise_key, blockwise_arg.data(), callback, NULL);
+        blockwise_key[0] = 0;
+        return NO_ERROR;
+    }
+
     ProtocolError function_result(MessageChannel& channel, const void* result, SparkReturnType::Enum, token_t token)
     {
         Message message;
@@ -46,9 +137,21 @@ class Functions
     }
 
 public:
+    Functions()
+    {
+        blockwise_key[0] = 0;
+    }
+
     ProtocolError handle_function_call(token_t token, message_id_t message_id, Message& message, MessageChannel& channel,
+            size_t max_arg_size,
             int (*call_function)(const char *function_key, const char *arg, SparkDescriptor::FunctionResultCallback callback, void* reserved))
     {
+        {
+            CoapMessageDecoder dec;
+            if (dec.decode((const char*)message.buf(), message.length()) >= 0 && dec.hasOption(CoapOption::BLOCK1)) {
+                return handle_function_call_block(token, dec, max_arg_size, channel, call_function);
+            }
+        }
         // copy the function key
         char function_key[MAX_FUNCTION_KEY_LENGTH+1]; // add one for null terminator
         memset(function_key, 0, sizeof(function_key));
@@ -119,6 +222,15 @@ public:
         call_function(function_key, function_arg, callback, NULL);
         return NO_ERROR;
     }
+
+    /**
+     * Cancel the current blockwise function call.
+     */
+    void reset()
+    {
+        blockwise_receiver.reset();
+        blockwise_key[0] = 0;
+    }
 };
 
 
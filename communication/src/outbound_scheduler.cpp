@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "outbound_scheduler.h"
+
+#include <algorithm>
+
+namespace particle {
+
+namespace protocol {
+
+namespace {
+
+const unsigned DEFAULT_SYSTEM_WEIGHT = 2;
+const unsigned DEFAULT_APPLICATION_WEIGHT = 1;
+
+// The virtual cost of a message is its size divided by the weight of its class. The size is scaled
+// to keep the precision with larger weights
+const uint64_t COST_SCALE = 1000;
+
+} // namespace
+
+OutboundScheduler::OutboundScheduler() :
+        classes_(),
+        msgs_(),
+        virtTime_(0),
+        windowSize_(BLOCKWISE_WINDOW_SIZE) {
+    for (auto& c: classes_) {
+        c.weight = 1;
+    }
+    classes_[(unsigned)OutboundClass::SYSTEM].weight = DEFAULT_SYSTEM_WEIGHT;
+    classes_[(unsigned)OutboundClass::APPLICATION].weight = DEFAULT_APPLICATION_WEIGHT;
+}
+
+void OutboundScheduler::configure(OutboundClass cls, unsigned weight, unsigned maxInFlight) {
+    auto& c = classes_[(unsigned)cls];
+    c.weight = std::max(weight, 1u);
+    c.maxInFlight = maxInFlight;
+}
+
+bool OutboundScheduler::acquire(OutboundClass cls, system_tick_t now) {
+    const unsigned index = (unsigned)cls;
+    auto& c = classes_[index];
+    if (!c.pending) {
+        c.pending = true;
+        c.queuedSince = now;
+    }
+    c.lastPoll = now;
+    if (cls == OutboundClass::CONTROL) {
+        return true;
+    }
+    expire(now);
+    bool ok = canSend(c);
+    if (ok) {
+        // Serve the waiting class with the smallest start tag first. Ties are resolved in favor of
+        // the higher priority class
+        const auto start = startTag(c);
+        for (unsigned i = (unsigned)OutboundClass::SYSTEM; i < CLASS_COUNT; ++i) {
+            if (i == index || !isEligible(classes_[i], now)) {
+                continue;
+            }
+            const auto otherStart = startTag(classes_[i]);
+            if (otherStart < start || (otherStart == start && i < index)) {
+                ok = false;
+                break;
+            }
+        }
+    }
+    if (!ok && !c.waiting) {
+        c.waiting = true;
+        ++c.stats.deferred;
+    }
+    return ok;
+}
+
+void OutboundScheduler::sent(OutboundClass cls, message_id_t id, size_t size, bool confirmable, system_tick_t now) {
+    auto& c = classes_[(unsigned)cls];
+    if (c.pending) {
+        const auto queueTime = now - c.queuedSince;
+        c.stats.totalQueueTime += queueTime;
+        c.stats.maxQueueTime = std::max(c.stats.maxQueueTime, queueTime);
+        c.pending = false;
+        c.waiting = false;
+    }
+    ++c.stats.sent;
+    if (cls != OutboundClass::CONTROL) {
+        const auto start = startTag(c);
+        virtTime_ = start;
+        c.finishTag = start + std::max(size, (size_t)1) * COST_SCALE / c.weight;
+    }
+    if (!confirmable) {
+        return;
+    }
+    expire(now);
+    for (auto& msg: msgs_) {
+        if (!msg.used) {
+            msg.time = now;
+            msg.id = id;
+            msg.cls = cls;
+            msg.used = true;
+            ++c.inFlight;
+            break;
+        }
+    }
+    // If all entries are in use, the message is not tracked and doesn't count towards the limit
+}
+
+void OutboundScheduler::completed(message_id_t id) {
+    for (auto& msg: msgs_) {
+        if (msg.used && msg.id == id) {
+            untrack(&msg);
+            break;
+        }
+    }
+}
+
+void OutboundScheduler::cancel(OutboundClass cls) {
+    auto& c = classes_[(unsigned)cls];
+    c.pending = false;
+    c.waiting = false;
+}
+
+void OutboundScheduler::reset() {
+    for (auto& c: classes_) {
+        c.stats = Stats();
+        c.finishTag = 0;
+        c.inFlight = 0;
+        c.pending = false;
+        c.waiting = false;
+    }
+    for (auto& msg: msgs_) {
+        msg.used = false;
+    }
+    virtTime_ = 0;
+}
+
+uint64_t OutboundScheduler::startTag(const Class& c) const {
+    return std::max(virtTime_, c.finishTag);
+}
+
+bool OutboundScheduler::canSend(const Class& c) const {
+    if (c.maxInFlight && c.inFlight >= c.maxInFlight) {
+        return false;
+    }
+    const unsigned n = classes_[(unsigned)OutboundClass::SYSTEM].inFlight +
+            classes_[(unsigned)OutboundClass::APPLICATION].inFlight;
+    return !windowSize_ || n < windowSize_;
+}
+
+bool OutboundScheduler::isEligible(const Class& c, system_tick_t now) const {
+    return c.waiting && now - c.lastPoll < WAIT_TIMEOUT && canSend(c);
+}
+
+void OutboundScheduler::expire(system_tick_t now) {
+    for (auto& msg: msgs_) {
+        if (msg.used && now - msg.time >= IN_FLIGHT_TIMEOUT) {
+            untrack(&msg);
+        }
+    }
+}
+
+void OutboundScheduler::untrack(TrackedMessage* msg) {
+    --classes_[(unsigned)msg->cls].inFlight;
+    msg->used = false;
+}
+
+} // namespace protocol
+
+} // namespace particle
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "protocol_defs.h"
+#include "coap.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace particle {
+
+namespace protocol {
+
+/**
+ * Priority class of an outbound message.
+ */
+enum class OutboundClass: uint8_t {
+    CONTROL = 0, ///< Acknowledgements, pings and firmware update responses. Never deferred.
+    SYSTEM = 1, ///< Describe messages, including the device vitals.
+    APPLICATION = 2 ///< Events.
+};
+
+/**
+ * Schedules the outbound messages of different priority classes.
+ *
+ * Messages are sent synchronously, so the scheduler doesn't queue them. Instead, the producers that
+ * can defer a message, such as the senders of blockwise transfers, ask the scheduler for permission
+ * to send it and retry later if the permission is not granted. All other messages are only accounted
+ * for when they are sent.
+ *
+ * The system and application classes share a window of confirmable messages that can be in flight
+ * at the same time. When the window is full, the producers wait for acknowledgements, and the freed
+ * slots are given out using start-time fair queueing: each class gets a share of the bandwidth
+ * proportional to its weight while it has messages to send. The number of messages in flight can
+ * also be limited per class. Control messages are never deferred and don't count towards the window.
+ */
+class OutboundScheduler {
+public:
+    /**
+     * Number of priority classes.
+     */
+    static constexpr unsigned CLASS_COUNT = 3;
+
+    /**
+     * Maximum number of confirmable messages whose acknowledgements are tracked.
+     */
+    static constexpr unsigned MAX_TRACKED_MESSAGES = 16;
+
+    /**
+     * Time in milliseconds after which an unacknowledged message is no longer considered in flight
+     * (`MAX_TRANSMIT_SPAN` of the CoAP channel).
+     */
+    static constexpr system_tick_t IN_FLIGHT_TIMEOUT = 45000;
+
+    /**
+     * Time in milliseconds after which a class that was denied sending is no longer considered to
+     * be waiting if its producer hasn't asked again.
+     */
+    static constexpr system_tick_t WAIT_TIMEOUT = 1000;
+
+    /**
+     * Per-class statistics.
+     */
+    struct Stats {
+        unsigned sent; ///< Number of sent messages.
+        unsigned deferred; ///< Number of times sending was deferred.
+        system_tick_t maxQueueTime; ///< Maximum time a message was deferred for.
+        system_tick_t totalQueueTime; ///< Total time the messages were deferred for.
+    };
+
+    OutboundScheduler();
+
+    /**
+     * Set the size of the window shared by the system and application classes.
+     *
+     * By default, the window size is `BLOCKWISE_WINDOW_SIZE`.
+     *
+     * @param size Maximum number of confirmable messages in flight, or 0 if not limited.
+     */
+    void windowSize(unsigned size);
+
+    /**
+     * Configure a priority class.
+     *
+     * By default, the system class has a weight of 2 and the application class has a weight of 1.
+     * Neither class limits the number of messages in flight.
+     *
+     * @param cls Priority class.
+     * @param weight Weight of the class. Must be greater than 0.
+     * @param maxInFlight Maximum number of confirmable messages in flight, or 0 if not limited.
+     */
+    void configure(OutboundClass cls, unsigned weight, unsigned maxInFlight);
+
+    /**
+     * Check if a message of the given class can be sent now.
+     *
+     * If the message can't be sent, the class is considered to be waiting until the message is
+     * sent or `cancel()` is called, and the producer is expected to ask again later.
+     *
+     * @param cls Priority class.
+     * @param now Current time.
+     * @return `true` if the message can be sent, otherwise `false`.
+     */
+    bool acquire(OutboundClass cls, system_tick_t now);
+
+    /**
+     * Account for a sent message.
+     *
+     * @param cls Priority class.
+     * @param id Message ID.
+     * @param size Message size.
+     * @param confirmable Whether the message needs to be acknowledged.
+     * @param now Current time.
+     */
+    void sent(OutboundClass cls, message_id_t id, size_t size, bool confirmable, system_tick_t now);
+
+    /**
+     * Process an acknowledgement or reset message.
+     *
+     * @param id Message ID.
+     */
+    void completed(message_id_t id);
+
+    /**
+     * Notify the scheduler that a producer no longer has messages of the given class to send.
+     *
+     * @param cls Priority class.
+     */
+    void cancel(OutboundClass cls);
+
+    /**
+     * Reset the scheduler state.
+     *
+     * The configuration of the priority classes is preserved.
+     */
+    void reset();
+
+    /**
+     * Get the number of confirmable messages of the given class that are in flight.
+     *
+     * @param cls Priority class.
+     */
+    unsigned inFlight(OutboundClass cls) const;
+
+    /**
+     * Get the statistics of a priority class.
+     *
+     * @param cls Priority class.
+     */
+    const Stats& stats(OutboundClass cls) const;
+
+private:
+    struct Class {
+        Stats stats;
+        uint64_t finishTag; // Virtual finish time of the last sent message
+        system_tick_t queuedSince; // Time the producer first asked to send the current message
+        system_tick_t lastPoll; // Time the producer last asked to send the current message
+        unsigned weight;
+        unsigned maxInFlight;
+        unsigned inFlight;
+        bool pending; // The producer has asked to send a message
+        bool waiting; // Sending of the message has been deferred
+    };
+
+    struct TrackedMessage {
+        system_tick_t time;
+        message_id_t id;
+        OutboundClass cls;
+        bool used;
+    };
+
+    Class classes_[CLASS_COUNT];
+    TrackedMessage msgs_[MAX_TRACKED_MESSAGES];
+    uint64_t virtTime_; // Start tag of the last sent message
+    unsigned windowSize_;
+
+    uint64_t startTag(const Class& c) const;
+    bool canSend(const Class& c) const;
+    bool isEligible(const Class& c, system_tick_t now) const;
+    void expire(system_tick_t now);
+    void untrack(TrackedMessage* msg);
+};
+
+inline void OutboundScheduler::windowSize(unsigned size) {
+    windowSize_ = size;
+}
+
+inline unsigned OutboundScheduler::inFlight(OutboundClass cls) const {
+    return classes_[(unsigned)cls].inFlight;
+}
+
+inline const OutboundScheduler::Stats& OutboundScheduler::stats(OutboundClass cls) const {
+    return classes_[(unsigned)cls].stats;
+}
+
+} // namespace protocol
+
+} // namespace particle
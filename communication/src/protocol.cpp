@@ -21,6 +21,7 @@
 #define LOG_COMPILE_TIME_LEVEL LOG_LEVEL_ALL
 
 #include "logging.h"
+#include "trace_recorder.h"
 
 LOG_SOURCE_CATEGORY("comm.protocol")
 
@@ -30,6 +31,8 @@ LOG_SOURCE_CATEGORY("comm.protocol")
 #include "chunked_transfer.h"
 #include "subscriptions.h"
 #include "functions.h"
+#include "protocol_util.h"
+#include "communication_diagnostic.h"
 
 namespace particle { namespace protocol {
 
@@ -43,7 +46,8 @@ enum HelloFlag {
 	HELLO_FLAG_GOODBYE_SUPPORT = 0x10,
 	HELLO_FLAG_DEVICE_INITIATED_DESCRIBE = 0x20,
 	HELLO_FLAG_COMPRESSED_OTA = 0x40,
-	HELLO_FLAG_OTA_PROTOCOL_V3 = 0x80
+	HELLO_FLAG_OTA_PROTOCOL_V3 = 0x80,
+	HELLO_FLAG_BLOCKWISE_TRANSFERS = 0x100
 };
 
 } // namespace
@@ -55,7 +59,11 @@ ProtocolError Protocol::send_empty_ack(Message& message, message_id_t msg_id)
 {
 	message.set_length(Messages::empty_ack(message.buf(), 0, 0));
 	message.set_id(msg_id);
-	return channel.send(message);
+	const ProtocolError error = channel.send(message);
+	if (error == NO_ERROR) {
+		outbound_sent(OutboundClass::CONTROL, message);
+	}
+	return error;
 }
 
 /**
@@ -68,6 +76,7 @@ ProtocolError Protocol::handle_received_message(Message& message,
 	pinger.message_received();
 	uint8_t* queue = message.buf();
 	message_type = Messages::decodeType(queue, message.length());
+	TRACE_SCOPE(TRACE_ID_PROTOCOL_HANDLE_MESSAGE, message_type, message.length());
 	// todo - not all requests/responses have tokens. These device requests do not use tokens:
 	// Update Done, ChunkMissed, event, ping, hello
 	token_t token = 0;
@@ -86,9 +95,17 @@ ProtocolError Protocol::handle_received_message(Message& message,
 			LOG(TRACE, "Reset received, setting error code to internal server error.");
 			code = CoAPCode::INTERNAL_SERVER_ERROR;
 		}
+		outbound.completed(msg_id);
 		notify_message_complete(msg_id, code);
 		bool handled = false;
-		ProtocolError error = handle_app_state_reply(message, &handled);
+		ProtocolError error = publisher.handle_ack(channel, msg_id, code, &handled);
+		if (error != ProtocolError::NO_ERROR) {
+			return error;
+		}
+		if (handled) {
+			return ProtocolError::NO_ERROR;
+		}
+		error = handle_app_state_reply(message, &handled);
 		if (error != ProtocolError::NO_ERROR) {
 			return error;
 		}
@@ -132,7 +149,7 @@ ProtocolError Protocol::handle_received_message(Message& message,
 			return ProtocolError::MISSING_REQUEST_TOKEN;
 		}
 		return functions.handle_function_call(token, msg_id, message, channel,
-				descriptor.call_function);
+				get_max_function_arg_size(), descriptor.call_function);
 	}
 
 	case CoAPMessageType::VARIABLE_REQUEST:
@@ -211,20 +228,21 @@ ProtocolError Protocol::handle_received_message(Message& message,
 }
 
 void Protocol::notify_message_complete(message_id_t msg_id, CoAPCode::Enum responseCode) {
-	const auto codeClass = (int)responseCode >> 5;
 	if (CoAPCode::is_success(responseCode)) {
 		ack_handlers.setResult(msg_id);
 	} else {
-		int error = SYSTEM_ERROR_COAP;
-		switch (codeClass) {
-		case 4:
-			error = SYSTEM_ERROR_COAP_4XX;
-			break;
-		case 5:
-			error = SYSTEM_ERROR_COAP_5XX;
-			break;
-		}
-		ack_handlers.setError(msg_id, error);
+		ack_handlers.setError(msg_id, coapCodeToSystemError(responseCode));
+	}
+}
+
+void Protocol::outbound_sent(OutboundClass cls, Message& msg) {
+	// Only confirmable messages sent over an unreliable channel get acknowledged by the server
+	const bool confirmable = channel.is_unreliable() && msg.has_id() && msg.get_type() == CoAPType::CON;
+	outbound.sent(cls, msg.get_id(), msg.length(), confirmable, callbacks.millis());
+	if (cls == OutboundClass::SYSTEM) {
+		g_coapSystemQueueLatencyMSec = outbound.stats(cls).maxQueueTime;
+	} else if (cls == OutboundClass::APPLICATION) {
+		g_coapApplicationQueueLatencyMSec = outbound.stats(cls).maxQueueTime;
 	}
 }
 
@@ -372,9 +390,15 @@ int Protocol::begin()
 		const auto cachedState = channel.cached_app_state_descriptor();
 		if (currentState.equalsTo(cachedState, stateFlags)) {
 			LOG(INFO, "Skipping HELLO message");
-			error = ping(true);
-			if (error != ProtocolError::NO_ERROR) {
-				return error;
+			if (fast_resume) {
+				// Don't spend a round trip on confirming the session: the first confirmable message
+				// sent by the device will time out if the server no longer has the session
+				LOG(INFO, "Skipping session validation");
+			} else {
+				error = ping(true);
+				if (error != ProtocolError::NO_ERROR) {
+					return error;
+				}
 			}
 			return ProtocolError::SESSION_RESUMED; // Not an error
 		} else {
@@ -439,9 +463,13 @@ void Protocol::reset() {
 	pinger.reset();
 	timesync_.reset();
 	description.reset();
+	publisher.reset();
+	variables.reset();
+	functions.reset();
 	ack_handlers.clear();
 	channel.reset();
 	subscription_msg_ids.clear();
+	outbound.reset();
 }
 
 /**
@@ -464,6 +492,9 @@ ProtocolError Protocol::hello(bool was_ota_upgrade_successful)
 	if (protocol_flags & ProtocolFlag::COMPRESSED_OTA) {
 		flags |= HELLO_FLAG_COMPRESSED_OTA;
 	}
+	if (protocol_flags & ProtocolFlag::BLOCKWISE_TRANSFERS) {
+		flags |= HELLO_FLAG_BLOCKWISE_TRANSFERS;
+	}
 #if HAL_PLATFORM_OTA_PROTOCOL_V3
 	flags |= HELLO_FLAG_OTA_PROTOCOL_V3;
 #endif
@@ -520,6 +551,7 @@ ProtocolError Protocol::event_loop(CoAPMessageType::Enum message_type,
  */
 ProtocolError Protocol::event_loop(CoAPMessageType::Enum& message_type)
 {
+	TRACE_SCOPE(TRACE_ID_PROTOCOL_EVENT_LOOP, 0, 0);
 	// Process expired completion handlers
 	const system_tick_t t = callbacks.millis();
 	ack_handlers.update(t - last_ack_handlers_update);
@@ -660,6 +692,12 @@ ProtocolError Protocol::handle_app_state_reply(const Message& msg, bool* handled
 			channel.command(Channel::LOAD_SESSION);
 			*handled = true;
 		}
+		if (desc_flags & DescriptionType::DESCRIBE_METRICS) {
+			// The acknowledged metrics become the baseline for delta encoded vitals
+			descriptor.app_state_selector_info(SparkAppStateSelector::DESCRIBE_METRICS,
+					SparkAppStateUpdate::COMPUTE_AND_PERSIST, 0, nullptr);
+			*handled = true;
+		}
 	}
 	return ProtocolError::NO_ERROR;
 }
@@ -56,6 +56,17 @@ int formatDiagnosticPayload(char* buf, size_t size, int error) {
     return payloadSize;
 }
 
+int coapCodeToSystemError(unsigned code) {
+    switch (code >> 5) { // Code class
+    case 4:
+        return SYSTEM_ERROR_COAP_4XX;
+    case 5:
+        return SYSTEM_ERROR_COAP_5XX;
+    default:
+        return SYSTEM_ERROR_COAP;
+    }
+}
+
 } // namespace protocol
 
 } // namespace particle
@@ -28,6 +28,11 @@ namespace protocol {
  */
 int formatDiagnosticPayload(char* buf, size_t size, int error);
 
+/**
+ * Get the system error code corresponding to an unsuccessful CoAP response code.
+ */
+int coapCodeToSystemError(unsigned code);
+
 } // namespace protocol
 
 } // namespace particle
@@ -18,11 +18,33 @@
 #include "publisher.h"
 
 #include "protocol.h"
+#include "protocol_util.h"
+#include "coap_message_encoder.h"
+
+#include <cstring>
 
 namespace particle {
 
 namespace protocol {
 
+namespace {
+
+// Maximum CoAP overhead per block of an event:
+//
+// - Message header: 4 bytes;
+// - Token: 1 byte;
+// - Uri-Path (11): 2 bytes;
+// - Uri-Path (11): 2 + MAX_EVENT_NAME_LENGTH bytes;
+// - Max-Age (14): 4 bytes;
+// - Block1 (27): 5 bytes;
+// - Payload marker: 1 byte.
+const size_t MAX_EVENT_BLOCK_COAP_OVERHEAD = 19 + MAX_EVENT_NAME_LENGTH;
+
+// Default Max-Age of an event
+const int DEFAULT_EVENT_TTL = 60;
+
+} // namespace
+
 void Publisher::add_ack_handler(message_id_t msg_id, CompletionHandler handler) {
     protocol->add_ack_handler(msg_id, std::move(handler), SEND_EVENT_ACK_TIMEOUT);
 }
@@ -50,12 +72,23 @@ ProtocolError Publisher::send_event(MessageChannel& channel, const char* event_n
     if (data) {
         const auto max_data_size = protocol->get_max_event_data_size();
         data_size = strnlen(data, max_data_size);
+        const auto max_msg_data_size = protocol->get_max_event_message_data_size();
+        if (data_size > max_msg_data_size) {
+            if (confirmable) {
+                return send_blockwise_event(channel, event_name, data, data_size, ttl, event_type, flags,
+                        std::move(handler));
+            }
+            data_size = max_msg_data_size; // Truncate the data
+        }
     }
     size_t msglen = Messages::event(message.buf(), 0, event_name, data, data_size, ttl,
             event_type, confirmable);
     message.set_length(msglen);
     const ProtocolError result = channel.send(message);
     if (result == NO_ERROR) {
+        // Single-message events are not deferred but count towards the bandwidth share of the
+        // application class
+        protocol->outbound_sent(OutboundClass::APPLICATION, message);
         // Register completion handler only if acknowledgement was requested explicitly
         if ((flags & EventType::WITH_ACK) && message.has_id()) {
             add_ack_handler(message.get_id(), std::move(handler));
@@ -66,6 +99,127 @@ ProtocolError Publisher::send_event(MessageChannel& channel, const char* event_n
     return result;
 }
 
+ProtocolError Publisher::handle_ack(MessageChannel& channel, message_id_t msg_id, CoAPCode::Enum code, bool* handled) {
+    if (!blockwise_event) {
+        return NO_ERROR;
+    }
+    auto& sender = blockwise_event->sender;
+    if (sender.ackReceived(msg_id) < 0) {
+        return NO_ERROR; // Not a block of the current event
+    }
+    *handled = true;
+    if (!CoAPCode::is_success(code)) {
+        LOG(ERROR, "Blockwise event was rejected: %d.%02d", (int)code >> 5, (int)code & 0x1f);
+        finish_blockwise_event(coapCodeToSystemError(code));
+        return NO_ERROR;
+    }
+    if (sender.isComplete()) {
+        finish_blockwise_event(SYSTEM_ERROR_NONE);
+        return NO_ERROR;
+    }
+    return send_event_blocks(channel);
+}
+
+ProtocolError Publisher::process(MessageChannel& channel) {
+    if (!blockwise_event) {
+        return NO_ERROR;
+    }
+    return send_event_blocks(channel);
+}
+
+void Publisher::reset() {
+    if (blockwise_event) {
+        finish_blockwise_event(SYSTEM_ERROR_ABORTED);
+    }
+}
+
+ProtocolError Publisher::send_blockwise_event(MessageChannel& channel, const char* event_name,
+        const char* data, size_t data_size, int ttl, EventType::Enum event_type, int flags,
+        CompletionHandler handler) {
+    if (blockwise_event) {
+        // Only one blockwise event can be sent at a time
+        handler.setError(SYSTEM_ERROR_BUSY);
+        return INVALID_STATE;
+    }
+    const size_t block_size = blockSizeForMessageSize(protocol->get_max_transmit_message_size(),
+            MAX_EVENT_BLOCK_COAP_OVERHEAD);
+    if (!block_size) {
+        return INTERNAL;
+    }
+    std::unique_ptr<BlockwiseEvent> ev(new(std::nothrow) BlockwiseEvent());
+    if (!ev || ev->sender.init(data, data_size, block_size, BLOCKWISE_WINDOW_SIZE) < 0) {
+        return NO_MEMORY;
+    }
+    strncpy(ev->name, event_name, MAX_EVENT_NAME_LENGTH);
+    ev->name[MAX_EVENT_NAME_LENGTH] = '\0';
+    ev->ttl = ttl;
+    ev->flags = flags;
+    ev->type = event_type;
+    ev->token = protocol->get_next_token();
+    if (flags & EventType::WITH_ACK) {
+        ev->handler = std::move(handler);
+    } else {
+        handler.setResult(); // The event data has been copied
+    }
+    blockwise_event = std::move(ev);
+    const auto result = send_event_blocks(channel);
+    if (result != NO_ERROR) {
+        finish_blockwise_event(toSystemError(result));
+    }
+    return result;
+}
+
+ProtocolError Publisher::send_event_blocks(MessageChannel& channel) {
+    auto ev = blockwise_event.get();
+    BlockwiseSender::Block block = {};
+    while (ev->sender.nextBlock(&block)) {
+        if (!protocol->outbound_ready(OutboundClass::APPLICATION)) {
+            break; // The remaining blocks will be sent by process()
+        }
+        Message msg;
+        auto result = channel.create(msg);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        CoapMessageEncoder enc((char*)msg.buf(), msg.capacity());
+        enc.type(CoapType::CON);
+        enc.code(CoapCode::POST);
+        enc.id(0); // Encoded by the message channel
+        enc.token((const char*)&ev->token, sizeof(ev->token));
+        const char type = ev->type;
+        enc.option(CoapOption::URI_PATH, &type, sizeof(type));
+        enc.option(CoapOption::URI_PATH, ev->name);
+        if (ev->ttl != DEFAULT_EVENT_TTL) {
+            enc.option(CoapOption::MAX_AGE, ev->ttl);
+        }
+        enc.option(CoapOption::BLOCK1, encodeBlockOption(block.num, ev->sender.blockSize(), block.more));
+        enc.payload(block.data, block.size);
+        const int r = enc.encode();
+        if (r < 0 || r > (int)msg.capacity()) {
+            LOG(ERROR, "Failed to encode message: %d", r);
+            return INTERNAL;
+        }
+        msg.set_length(r);
+        result = channel.send(msg);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        protocol->outbound_sent(OutboundClass::APPLICATION, msg);
+        ev->sender.blockSent(block.num, msg.get_id());
+    }
+    return NO_ERROR;
+}
+
+void Publisher::finish_blockwise_event(int error) {
+    const auto ev = std::move(blockwise_event);
+    protocol->get_outbound_scheduler().cancel(OutboundClass::APPLICATION);
+    if (error < 0) {
+        ev->handler.setError(error);
+    } else {
+        ev->handler.setResult();
+    }
+}
+
 } // protocol
 
 } // particle
@@ -23,10 +23,13 @@
 #include "events.h"
 #include "message_channel.h"
 #include "messages.h"
+#include "coap_blockwise.h"
 
 #include "completion_handler.h"
 #include "communication_diagnostic.h"
 
+#include <memory>
+
 namespace particle
 {
 namespace protocol
@@ -91,10 +94,52 @@ public:
 			const char* data, int ttl, EventType::Enum event_type, int flags,
 			system_tick_t time, CompletionHandler handler);
 
+	/**
+	 * Process an acknowledgement for a block of a blockwise event.
+	 *
+	 * @param channel Message channel.
+	 * @param msg_id ID of the acknowledged message.
+	 * @param code Response code.
+	 * @param[out] handled Set to `true` if the message carried a block of the current event.
+	 */
+	ProtocolError handle_ack(MessageChannel& channel, message_id_t msg_id, CoAPCode::Enum code, bool* handled);
+
+	/**
+	 * Send the blocks of the current blockwise event that have been deferred by the outbound scheduler.
+	 *
+	 * Lost blocks are retransmitted by the CoAP layer. If a block is not acknowledged after the
+	 * maximum number of retransmissions, the connection is closed and the event is cancelled when
+	 * the protocol is reset.
+	 */
+	ProtocolError process(MessageChannel& channel);
+
+	/**
+	 * Cancel the current blockwise event.
+	 */
+	void reset();
+
 private:
+	struct BlockwiseEvent
+	{
+		BlockwiseSender sender;
+		CompletionHandler handler;
+		char name[MAX_EVENT_NAME_LENGTH + 1];
+		int ttl;
+		int flags;
+		EventType::Enum type;
+		token_t token;
+	};
+
 	Protocol* protocol;
+	std::unique_ptr<BlockwiseEvent> blockwise_event;
 
 	void add_ack_handler(message_id_t msg_id, CompletionHandler handler);
+
+	ProtocolError send_blockwise_event(MessageChannel& channel, const char* event_name,
+			const char* data, size_t data_size, int ttl, EventType::Enum event_type, int flags,
+			CompletionHandler handler);
+	ProtocolError send_event_blocks(MessageChannel& channel);
+	void finish_blockwise_event(int error);
 };
 
 }}
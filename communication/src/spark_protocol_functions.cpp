@@ -211,6 +211,14 @@ int spark_protocol_set_connection_property(ProtocolFacade* protocol, unsigned pr
         protocol->set_max_transmit_message_size(value);
         return 0;
     }
+    case Connection::BLOCKWISE_TRANSFERS: {
+        protocol->set_blockwise_transfers_enabled(value);
+        return 0;
+    }
+    case Connection::FAST_RESUME: {
+        protocol->set_fast_resume_enabled(value);
+        return 0;
+    }
     default:
         return ProtocolError::NOT_IMPLEMENTED;
     }
@@ -19,9 +19,13 @@
 
 #include "protocol.h"
 #include "messages.h"
+#include "coap_blockwise.h"
+#include "coap_message_encoder.h"
+#include "coap_message_decoder.h"
 
 #include "endian_util.h"
 
+#include <algorithm>
 #include <memory>
 #include <cstring>
 
@@ -29,14 +33,29 @@ namespace particle {
 
 namespace protocol {
 
+namespace {
+
+// Maximum CoAP overhead per block of a variable value:
+//
+// - Message header: 4 bytes;
+// - Token: 1 byte;
+// - Block2 (23): 5 bytes;
+// - Payload marker: 1 byte.
+const size_t MAX_VALUE_BLOCK_COAP_OVERHEAD = 11;
+
+} // namespace
+
 struct Variables::Context {
-    Context(Variables* self, token_t token) :
+    Context(Variables* self, token_t token, const char* key) :
             self(self),
             token(token) {
+        strncpy(this->key, key, MAX_VARIABLE_KEY_LENGTH);
+        this->key[MAX_VARIABLE_KEY_LENGTH] = '\0';
     }
 
     Variables* self;
     token_t token;
+    char key[MAX_VARIABLE_KEY_LENGTH + 1];
 };
 
 ProtocolError Variables::handle_request(Message& message, token_t token, message_id_t id) {
@@ -45,6 +64,16 @@ ProtocolError Variables::handle_request(Message& message, token_t token, message
     if (result != ProtocolError::NO_ERROR) {
         return send_error_ack(message, token, id, CoAPCode::BAD_REQUEST);
     }
+    unsigned block_num = 0;
+    size_t block_size = 0;
+    result = decode_block_option(message, &block_num, &block_size);
+    if (result != ProtocolError::NO_ERROR) {
+        return send_error_ack(message, token, id, CoAPCode::BAD_OPTION);
+    }
+    if (block_num > 0) {
+        // The server is requesting a subsequent block of a large value
+        return send_block(token, id, key, block_num, block_size);
+    }
     if (protocol_->get_descriptor().get_variable_async) {
         result = handle_request(message, token, id, key);
     } else {
@@ -56,7 +85,7 @@ ProtocolError Variables::handle_request(Message& message, token_t token, message
 
 ProtocolError Variables::handle_request(Message& message, token_t token, message_id_t id, const char* key) {
     // Allocate a context for the request
-    std::unique_ptr<Context> ctx(new(std::nothrow) Context(this, token));
+    std::unique_ptr<Context> ctx(new(std::nothrow) Context(this, token, key));
     if (!ctx) {
         return send_error_ack(message, token, id, CoAPCode::INTERNAL_SERVER_ERROR);
     }
@@ -106,7 +135,7 @@ ProtocolError Variables::handle_request_compat(Message& message, token_t token,
         return result;
     }
     // Send a separate response
-    return send_response(token, value, value_size, value_type);
+    return send_response(token, key, value, value_size, value_type);
 }
 
 ProtocolError Variables::decode_request(Message& message, char* key) {
@@ -128,8 +157,24 @@ ProtocolError Variables::decode_request(Message& message, char* key) {
     return ProtocolError::NO_ERROR;
 }
 
-ProtocolError Variables::encode_response(Message& message, token_t token, const void* value, size_t value_size,
-        SparkReturnType::Enum value_type) {
+ProtocolError Variables::decode_block_option(Message& message, unsigned* block_num, size_t* block_size) {
+    CoapMessageDecoder dec;
+    const int r = dec.decode((const char*)message.buf(), message.length());
+    if (r < 0) {
+        return ProtocolError::MALFORMED_MESSAGE;
+    }
+    const auto iter = dec.findOption(CoapOption::BLOCK2);
+    if (iter) {
+        bool more = false; // Ignored
+        if (!decodeBlockOption(iter.toUInt(), block_num, block_size, &more)) {
+            return ProtocolError::MALFORMED_MESSAGE;
+        }
+    }
+    return ProtocolError::NO_ERROR;
+}
+
+ProtocolError Variables::encode_response(Message& message, token_t token, const char* key, const void* value,
+        size_t value_size, SparkReturnType::Enum value_type) {
     const auto max_value_size = protocol_->get_max_variable_value_size();
     if (value_size > max_value_size) {
         value_size = max_value_size; // Truncate the value data
@@ -160,6 +205,10 @@ ProtocolError Variables::encode_response(Message& message, token_t token, const
         break;
     }
     case SparkReturnType::STRING: {
+        if (value_size > protocol_->get_max_variable_message_value_size()) {
+            // The value doesn't fit in a single message, start a blockwise transfer
+            return encode_first_block(message, token, key, value, value_size);
+        }
         msg_size = encode_response(message.buf(), token, value, value_size);
         break;
     }
@@ -176,20 +225,98 @@ size_t Variables::encode_response(uint8_t* buffer, token_t token, const void* va
             (const uint8_t*)value, value_size, channel.is_unreliable());
 }
 
-ProtocolError Variables::send_response(token_t token, const void* value, size_t value_size, SparkReturnType::Enum value_type) {
+ProtocolError Variables::encode_first_block(Message& message, token_t token, const char* key, const void* value,
+        size_t value_size) {
+    const size_t block_size = blockSizeForMessageSize(protocol_->get_max_transmit_message_size(),
+            MAX_VALUE_BLOCK_COAP_OVERHEAD);
+    if (!block_size) {
+        return ProtocolError::INTERNAL;
+    }
+    std::unique_ptr<BlockwiseValue> v(new(std::nothrow) BlockwiseValue());
+    if (!v || !v->data.resize(value_size)) {
+        return ProtocolError::NO_MEMORY;
+    }
+    memcpy(v->data.data(), value, value_size);
+    strncpy(v->key, key, MAX_VARIABLE_KEY_LENGTH);
+    v->key[MAX_VARIABLE_KEY_LENGTH] = '\0';
+    v->lastAccessTime = protocol_->get_callbacks().millis();
+    v->blockSize = block_size;
+    CoapMessageEncoder enc((char*)message.buf(), message.capacity());
+    enc.type(CoapType::CON);
+    enc.code(CoapCode::CONTENT);
+    enc.id(0); // Encoded by the message channel
+    enc.token((const char*)&token, sizeof(token));
+    enc.option(CoapOption::BLOCK2, encodeBlockOption(0 /* num */, block_size, true /* more */));
+    enc.payload(v->data.data(), block_size);
+    const int r = enc.encode();
+    if (r < 0 || r > (int)message.capacity()) {
+        return ProtocolError::INTERNAL;
+    }
+    message.set_length(r);
+    blockwiseValue_ = std::move(v); // Replaces the previous value if there was one
+    return ProtocolError::NO_ERROR;
+}
+
+ProtocolError Variables::send_response(token_t token, const char* key, const void* value, size_t value_size,
+        SparkReturnType::Enum value_type) {
     Message msg;
     auto& channel = protocol_->get_channel();
     ProtocolError result = channel.create(msg);
     if (result != ProtocolError::NO_ERROR) {
         return result;
     }
-    result = encode_response(msg, token, value, value_size, value_type);
+    result = encode_response(msg, token, key, value, value_size, value_type);
     if (result != ProtocolError::NO_ERROR) {
         return send_error_response(msg, token, CoAPCode::INTERNAL_SERVER_ERROR);
     }
     return channel.send(msg);
 }
 
+ProtocolError Variables::send_block(token_t token, message_id_t id, const char* key, unsigned block_num, size_t block_size) {
+    Message msg;
+    auto& channel = protocol_->get_channel();
+    ProtocolError result = channel.create(msg);
+    if (result != ProtocolError::NO_ERROR) {
+        return result;
+    }
+    const auto v = blockwiseValue_.get();
+    const auto now = protocol_->get_callbacks().millis();
+    if (!v || strcmp(v->key, key) != 0 || now - v->lastAccessTime >= COAP_BLOCKWISE_RESPONSE_TIMEOUT) {
+        // The value is not available anymore, the server needs to restart the transfer
+        return send_error_ack(msg, token, id, CoAPCode::REQUEST_ENTITY_INCOMPLETE);
+    }
+    // The server may only reduce the block size chosen by the device
+    const size_t offs = block_num * block_size;
+    if (block_size > v->blockSize || offs >= (size_t)v->data.size()) {
+        return send_error_ack(msg, token, id, CoAPCode::BAD_OPTION);
+    }
+    const size_t size = std::min(block_size, v->data.size() - offs);
+    const bool more = (offs + size < (size_t)v->data.size());
+    CoapMessageEncoder enc((char*)msg.buf(), msg.capacity());
+    enc.type(CoapType::ACK);
+    enc.code(CoapCode::CONTENT);
+    enc.id(0); // Encoded by the message channel
+    enc.token((const char*)&token, sizeof(token));
+    enc.option(CoapOption::BLOCK2, encodeBlockOption(block_num, block_size, more));
+    enc.payload(v->data.data() + offs, size);
+    const int r = enc.encode();
+    if (r < 0 || r > (int)msg.capacity()) {
+        return send_error_ack(msg, token, id, CoAPCode::INTERNAL_SERVER_ERROR);
+    }
+    msg.set_length(r);
+    msg.set_id(id);
+    if (more) {
+        v->lastAccessTime = now;
+    } else {
+        blockwiseValue_.reset(); // Sent the last block
+    }
+    return channel.send(msg);
+}
+
+void Variables::reset() {
+    blockwiseValue_.reset();
+}
+
 ProtocolError Variables::send_error_response(token_t token, uint8_t code) {
     Message msg;
     auto& channel = protocol_->get_channel();
@@ -229,7 +356,7 @@ void Variables::get_variable_callback(int result, int type, void* data, size_t s
         const auto code = CoAP::codeForProtocolError((ProtocolError)result);
         p->self->send_error_response(p->token, code);
     } else {
-        p->self->send_response(p->token, data, size, (SparkReturnType::Enum)type);
+        p->self->send_response(p->token, p->key, data, size, (SparkReturnType::Enum)type);
     }
     free(data);
     delete p;
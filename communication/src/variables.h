@@ -23,6 +23,9 @@
 #include "protocol_defs.h"
 #include "coap.h"
 
+#include "spark_wiring_vector.h"
+
+#include <memory>
 #include <cstddef>
 
 namespace particle {
@@ -39,19 +42,38 @@ public:
 
     ProtocolError handle_request(Message& message, token_t token, message_id_t id);
 
+    /**
+     * Discard the cached value of a blockwise response.
+     */
+    void reset();
+
 private:
     struct Context;
 
+    // Value served to the server using a blockwise transfer
+    struct BlockwiseValue {
+        Vector<char> data; // Value data
+        char key[MAX_VARIABLE_KEY_LENGTH + 1]; // Variable name
+        system_tick_t lastAccessTime; // Last time a block of the value was requested
+        size_t blockSize; // Block size
+    };
+
     Protocol* protocol_;
+    std::unique_ptr<BlockwiseValue> blockwiseValue_;
 
     ProtocolError handle_request(Message& message, token_t token, message_id_t id, const char* key);
     ProtocolError handle_request_compat(Message& message, token_t token, message_id_t id, const char* key);
 
     ProtocolError decode_request(Message& message, char* key);
-    ProtocolError encode_response(Message& message, token_t token, const void* value, size_t value_size, SparkReturnType::Enum value_type);
+    ProtocolError decode_block_option(Message& message, unsigned* block_num, size_t* block_size);
+    ProtocolError encode_response(Message& message, token_t token, const char* key, const void* value, size_t value_size,
+            SparkReturnType::Enum value_type);
     size_t encode_response(uint8_t* buffer, token_t token, const void* value, size_t value_size);
+    ProtocolError encode_first_block(Message& message, token_t token, const char* key, const void* value, size_t value_size);
 
-    ProtocolError send_response(token_t token, const void* value, size_t value_size, SparkReturnType::Enum value_type);
+    ProtocolError send_response(token_t token, const char* key, const void* value, size_t value_size,
+            SparkReturnType::Enum value_type);
+    ProtocolError send_block(token_t token, message_id_t id, const char* key, unsigned block_num, size_t block_size);
     ProtocolError send_error_response(token_t token, uint8_t code);
     ProtocolError send_error_response(Message& message, token_t token, uint8_t code);
 
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Precomputation of the handshake crypto.
+ *
+ * On platforms without an ECC accelerator, generating the ephemeral ECDH key and the ECDSA nonce
+ * takes a considerable part of the DTLS handshake. Neither depends on the peer, so both can be
+ * computed ahead of time, e.g. while the device is waiting for the network to come up. The pool
+ * is consumed by the implementations of mbedtls_ecdh_gen_public() and mbedtls_ecdsa_sign() that are
+ * enabled via MBEDTLS_ECDH_GEN_PUBLIC_ALT and MBEDTLS_ECDSA_SIGN_ALT in the mbedTLS configuration.
+ *
+ * Only the secp256r1 curve is supported. Each precomputed value is used at most once and is erased
+ * from memory as soon as it's taken from the pool. When the pool is empty, the values are computed
+ * on demand as usual.
+ */
+
+#ifndef ECC_PRECOMPUTE_KEYPAIR_POOL_SIZE
+#define ECC_PRECOMPUTE_KEYPAIR_POOL_SIZE 2
+#endif
+
+#ifndef ECC_PRECOMPUTE_NONCE_POOL_SIZE
+#define ECC_PRECOMPUTE_NONCE_POOL_SIZE 2
+#endif
+
+typedef enum ecc_precompute_type {
+    ECC_PRECOMPUTE_NONE = 0,
+    ECC_PRECOMPUTE_KEYPAIR = 1, ///< Ephemeral ECDH keypair.
+    ECC_PRECOMPUTE_NONCE = 2 ///< ECDSA nonce and the corresponding `r` value.
+} ecc_precompute_type;
+
+typedef struct ecc_precompute_stats {
+    uint16_t size; ///< Size of this structure.
+    uint16_t keypairs; ///< Number of keypairs in the pool.
+    uint16_t nonces; ///< Number of nonces in the pool.
+    uint16_t reserved;
+    uint32_t keypair_hits; ///< Number of keypairs taken from the pool.
+    uint32_t keypair_misses; ///< Number of keypairs generated on demand.
+    uint32_t nonce_hits; ///< Number of nonces taken from the pool.
+    uint32_t nonce_misses; ///< Number of nonces generated on demand.
+    uint32_t keypair_time; ///< Time it took to generate the last keypair (microseconds).
+    uint32_t nonce_time; ///< Time it took to generate the last nonce (microseconds).
+    uint32_t saved_time; ///< Total time saved by using precomputed values (milliseconds).
+} ecc_precompute_stats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Compute one missing value of the pool.
+ *
+ * The function blocks for as long as it takes to do a single scalar multiplication.
+ *
+ * @param f_rng Random number generator.
+ * @param p_rng Generator context.
+ * @param reserved Reserved argument. Must be set to `NULL`.
+ * @return Type of the computed value (`ecc_precompute_type`), `ECC_PRECOMPUTE_NONE` if the pool is
+ *         full, or an error code defined by `system_error_t`.
+ */
+int ecc_precompute_fill(int (*f_rng)(void*, unsigned char*, size_t), void* p_rng, void* reserved);
+
+/**
+ * Erase all precomputed values.
+ *
+ * @param reserved Reserved argument. Must be set to `NULL`.
+ */
+void ecc_precompute_clear(void* reserved);
+
+/**
+ * Get the statistics.
+ *
+ * @param stats Statistics. The `size` field must be initialized by the caller.
+ * @param reserved Reserved argument. Must be set to `NULL`.
+ * @return 0 on success, otherwise an error code defined by `system_error_t`.
+ */
+int ecc_precompute_get_stats(ecc_precompute_stats* stats, void* reserved);
+
+#ifdef __cplusplus
+}
+#endif
@@ -281,6 +281,13 @@
 //#define MBEDTLS_AES_ENCRYPT_ALT
 //#define MBEDTLS_AES_DECRYPT_ALT
 
+/*
+ * Use the ephemeral ECDH keys and ECDSA nonces precomputed in the background to speed up the
+ * handshake (see crypto/inc/ecc_precompute.h)
+ */
+#define MBEDTLS_ECDH_GEN_PUBLIC_ALT
+#define MBEDTLS_ECDSA_SIGN_ALT
+
 /**
  * \def MBEDTLS_ENTROPY_HARDWARE_ALT
  *
@@ -0,0 +1,396 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ecc_precompute.h"
+
+#include "mbedtls/ecp.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/ecdsa.h"
+#include "mbedtls/platform_util.h"
+
+#include "system_error.h"
+
+#if defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT) || defined(MBEDTLS_ECDSA_SIGN_ALT)
+
+#include "mbedtls_util.h"
+#include "timer_hal.h"
+
+#include <algorithm>
+#include <mutex>
+#include <cstring>
+
+namespace {
+
+// Size of a scalar or a coordinate of the secp256r1 curve
+const size_t ECC_SIZE = 32;
+
+const unsigned MAX_NONCE_ATTEMPTS = 10;
+
+struct Keypair {
+    uint8_t d[ECC_SIZE];
+    uint8_t x[ECC_SIZE];
+    uint8_t y[ECC_SIZE];
+};
+
+struct Nonce {
+    uint8_t k[ECC_SIZE];
+    uint8_t r[ECC_SIZE];
+};
+
+template<typename T, size_t N>
+class Pool {
+public:
+    Pool() :
+            count_(0) {
+    }
+
+    ~Pool() {
+        clear();
+    }
+
+    bool put(const T& item) {
+        if (count_ == N) {
+            return false;
+        }
+        items_[count_++] = item;
+        return true;
+    }
+
+    bool take(T* item) {
+        if (!count_) {
+            return false;
+        }
+        --count_;
+        *item = items_[count_];
+        mbedtls_platform_zeroize(&items_[count_], sizeof(T));
+        return true;
+    }
+
+    void clear() {
+        mbedtls_platform_zeroize(items_, sizeof(items_));
+        count_ = 0;
+    }
+
+    size_t count() const {
+        return count_;
+    }
+
+    bool isFull() const {
+        return count_ == N;
+    }
+
+private:
+    T items_[N];
+    size_t count_;
+};
+
+struct PrecomputeState {
+    Pool<Keypair, ECC_PRECOMPUTE_KEYPAIR_POOL_SIZE> keypairs;
+    Pool<Nonce, ECC_PRECOMPUTE_NONCE_POOL_SIZE> nonces;
+    ecc_precompute_stats stats;
+    uint64_t savedTime; // Microseconds
+    std::mutex mutex;
+
+    PrecomputeState() :
+            stats(),
+            savedTime(0) {
+    }
+};
+
+// The pool can be accessed by the system thread and by any thread that uses mbedTLS directly
+PrecomputeState g_state;
+
+void updateTime(ecc_precompute_type type, uint32_t time) {
+    std::lock_guard<std::mutex> lock(g_state.mutex);
+    if (type == ECC_PRECOMPUTE_KEYPAIR) {
+        g_state.stats.keypair_time = time;
+    } else {
+        g_state.stats.nonce_time = time;
+    }
+}
+
+bool takeKeypair(Keypair* kp) {
+    std::lock_guard<std::mutex> lock(g_state.mutex);
+    if (!g_state.keypairs.take(kp)) {
+        ++g_state.stats.keypair_misses;
+        return false;
+    }
+    ++g_state.stats.keypair_hits;
+    g_state.savedTime += g_state.stats.keypair_time;
+    return true;
+}
+
+bool takeNonce(Nonce* n) {
+    std::lock_guard<std::mutex> lock(g_state.mutex);
+    if (!g_state.nonces.take(n)) {
+        ++g_state.stats.nonce_misses;
+        return false;
+    }
+    ++g_state.stats.nonce_hits;
+    g_state.savedTime += g_state.stats.nonce_time;
+    return true;
+}
+
+bool isSupportedGroup(const mbedtls_ecp_group* grp) {
+    return grp->id == MBEDTLS_ECP_DP_SECP256R1;
+}
+
+int genKeypair(mbedtls_ecp_group* grp, mbedtls_mpi* d, mbedtls_ecp_point* Q,
+        int (*f_rng)(void*, unsigned char*, size_t), void* p_rng) {
+    const auto t = HAL_Timer_Get_Micro_Seconds();
+    const int ret = mbedtls_ecp_gen_keypair(grp, d, Q, f_rng, p_rng);
+    if (ret == 0 && isSupportedGroup(grp)) {
+        updateTime(ECC_PRECOMPUTE_KEYPAIR, HAL_Timer_Get_Micro_Seconds() - t);
+    }
+    return ret;
+}
+
+// Generates a random k and computes r = x(k * G) mod n
+int genNonce(mbedtls_ecp_group* grp, mbedtls_mpi* k, mbedtls_mpi* r,
+        int (*f_rng)(void*, unsigned char*, size_t), void* p_rng) {
+    const auto t = HAL_Timer_Get_Micro_Seconds();
+    int ret = 0;
+    unsigned attempts = 0;
+    mbedtls_ecp_point R;
+    mbedtls_ecp_point_init(&R);
+    do {
+        if (++attempts > MAX_NONCE_ATTEMPTS) {
+            ret = MBEDTLS_ERR_ECP_RANDOM_FAILED;
+            goto cleanup;
+        }
+        MBEDTLS_MPI_CHK(mbedtls_ecp_gen_keypair(grp, k, &R, f_rng, p_rng));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(r, &R.X, &grp->N));
+    } while (mbedtls_mpi_cmp_int(r, 0) == 0);
+    if (isSupportedGroup(grp)) {
+        updateTime(ECC_PRECOMPUTE_NONCE, HAL_Timer_Get_Micro_Seconds() - t);
+    }
+cleanup:
+    mbedtls_ecp_point_free(&R);
+    return ret;
+}
+
+int getNonce(mbedtls_ecp_group* grp, mbedtls_mpi* k, mbedtls_mpi* r,
+        int (*f_rng)(void*, unsigned char*, size_t), void* p_rng) {
+    Nonce n;
+    if (!isSupportedGroup(grp) || !takeNonce(&n)) {
+        return genNonce(grp, k, r, f_rng, p_rng);
+    }
+    int ret = 0;
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(k, n.k, sizeof(n.k)));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(r, n.r, sizeof(n.r)));
+cleanup:
+    mbedtls_platform_zeroize(&n, sizeof(n));
+    return ret;
+}
+
+// Converts a hash to an integer modulo n (see derive_mpi() in ecdsa.c)
+int deriveMpi(const mbedtls_ecp_group* grp, mbedtls_mpi* x, const unsigned char* buf, size_t blen) {
+    int ret = 0;
+    const size_t nSize = (grp->nbits + 7) / 8;
+    const size_t useSize = std::min(blen, nSize);
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(x, buf, useSize));
+    if (useSize * 8 > grp->nbits) {
+        MBEDTLS_MPI_CHK(mbedtls_mpi_shift_r(x, useSize * 8 - grp->nbits));
+    }
+    if (mbedtls_mpi_cmp_mpi(x, &grp->N) >= 0) {
+        MBEDTLS_MPI_CHK(mbedtls_mpi_sub_mpi(x, x, &grp->N));
+    }
+cleanup:
+    return ret;
+}
+
+int fillKeypair(mbedtls_ecp_group* grp, int (*f_rng)(void*, unsigned char*, size_t), void* p_rng) {
+    int ret = 0;
+    Keypair kp;
+    mbedtls_mpi d;
+    mbedtls_ecp_point Q;
+    mbedtls_mpi_init(&d);
+    mbedtls_ecp_point_init(&Q);
+    MBEDTLS_MPI_CHK(genKeypair(grp, &d, &Q, f_rng, p_rng));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&d, kp.d, sizeof(kp.d)));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&Q.X, kp.x, sizeof(kp.x)));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&Q.Y, kp.y, sizeof(kp.y)));
+    {
+        std::lock_guard<std::mutex> lock(g_state.mutex);
+        g_state.keypairs.put(kp);
+    }
+cleanup:
+    mbedtls_platform_zeroize(&kp, sizeof(kp));
+    mbedtls_mpi_free(&d);
+    mbedtls_ecp_point_free(&Q);
+    return ret;
+}
+
+int fillNonce(mbedtls_ecp_group* grp, int (*f_rng)(void*, unsigned char*, size_t), void* p_rng) {
+    int ret = 0;
+    Nonce n;
+    mbedtls_mpi k, r;
+    mbedtls_mpi_init(&k);
+    mbedtls_mpi_init(&r);
+    MBEDTLS_MPI_CHK(genNonce(grp, &k, &r, f_rng, p_rng));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&k, n.k, sizeof(n.k)));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&r, n.r, sizeof(n.r)));
+    {
+        std::lock_guard<std::mutex> lock(g_state.mutex);
+        g_state.nonces.put(n);
+    }
+cleanup:
+    mbedtls_platform_zeroize(&n, sizeof(n));
+    mbedtls_mpi_free(&k);
+    mbedtls_mpi_free(&r);
+    return ret;
+}
+
+} // namespace
+
+int ecc_precompute_fill(int (*f_rng)(void*, unsigned char*, size_t), void* p_rng, void* reserved) {
+    ecc_precompute_type type = ECC_PRECOMPUTE_NONE;
+    {
+        std::lock_guard<std::mutex> lock(g_state.mutex);
+        // Keep the number of keypairs and nonces balanced, as a handshake needs one of each
+        const bool needKeypair = !g_state.keypairs.isFull();
+        const bool needNonce = !g_state.nonces.isFull();
+        if (needKeypair && (!needNonce || g_state.keypairs.count() <= g_state.nonces.count())) {
+            type = ECC_PRECOMPUTE_KEYPAIR;
+        } else if (needNonce) {
+            type = ECC_PRECOMPUTE_NONCE;
+        }
+    }
+    if (type == ECC_PRECOMPUTE_NONE) {
+        return ECC_PRECOMPUTE_NONE;
+    }
+    mbedtls_ecp_group grp;
+    mbedtls_ecp_group_init(&grp);
+    int ret = mbedtls_ecp_group_load(&grp, MBEDTLS_ECP_DP_SECP256R1);
+    if (ret == 0) {
+        if (type == ECC_PRECOMPUTE_KEYPAIR) {
+            ret = fillKeypair(&grp, f_rng, p_rng);
+        } else {
+            ret = fillNonce(&grp, f_rng, p_rng);
+        }
+    }
+    mbedtls_ecp_group_free(&grp);
+    if (ret != 0) {
+        return mbedtls_to_system_error(ret);
+    }
+    return type;
+}
+
+void ecc_precompute_clear(void* reserved) {
+    std::lock_guard<std::mutex> lock(g_state.mutex);
+    g_state.keypairs.clear();
+    g_state.nonces.clear();
+}
+
+int ecc_precompute_get_stats(ecc_precompute_stats* stats, void* reserved) {
+    if (!stats || stats->size < sizeof(uint16_t)) {
+        return SYSTEM_ERROR_INVALID_ARGUMENT;
+    }
+    ecc_precompute_stats s = {};
+    {
+        std::lock_guard<std::mutex> lock(g_state.mutex);
+        s = g_state.stats;
+        s.keypairs = g_state.keypairs.count();
+        s.nonces = g_state.nonces.count();
+        s.saved_time = g_state.savedTime / 1000;
+    }
+    s.size = std::min<size_t>(stats->size, sizeof(s));
+    memcpy(stats, &s, s.size);
+    return 0;
+}
+
+#if defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT)
+
+int mbedtls_ecdh_gen_public(mbedtls_ecp_group* grp, mbedtls_mpi* d, mbedtls_ecp_point* Q,
+        int (*f_rng)(void*, unsigned char*, size_t), void* p_rng) {
+    Keypair kp;
+    if (!isSupportedGroup(grp) || !takeKeypair(&kp)) {
+        return genKeypair(grp, d, Q, f_rng, p_rng);
+    }
+    int ret = 0;
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(d, kp.d, sizeof(kp.d)));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&Q->X, kp.x, sizeof(kp.x)));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_read_binary(&Q->Y, kp.y, sizeof(kp.y)));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_lset(&Q->Z, 1));
+cleanup:
+    mbedtls_platform_zeroize(&kp, sizeof(kp));
+    return ret;
+}
+
+#endif // defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT)
+
+#if defined(MBEDTLS_ECDSA_SIGN_ALT)
+
+// Same as the default implementation in ecdsa.c, except that the nonce is taken from the pool if
+// possible. Note that when MBEDTLS_ECDSA_DETERMINISTIC is enabled, mbedtls_ecdsa_sign_det() calls
+// this function with an HMAC_DRBG generator seeded from the key and the message, so a signature is
+// deterministic only if it's computed on demand
+int mbedtls_ecdsa_sign(mbedtls_ecp_group* grp, mbedtls_mpi* r, mbedtls_mpi* s, const mbedtls_mpi* d,
+        const unsigned char* buf, size_t blen, int (*f_rng)(void*, unsigned char*, size_t), void* p_rng) {
+    if (!grp->N.p) {
+        return MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+    }
+    if (mbedtls_mpi_cmp_int(d, 1) < 0 || mbedtls_mpi_cmp_mpi(d, &grp->N) >= 0) {
+        return MBEDTLS_ERR_ECP_INVALID_KEY;
+    }
+    int ret = 0;
+    unsigned attempts = 0;
+    mbedtls_mpi k, e, t;
+    mbedtls_mpi_init(&k);
+    mbedtls_mpi_init(&e);
+    mbedtls_mpi_init(&t);
+    do {
+        if (++attempts > MAX_NONCE_ATTEMPTS) {
+            ret = MBEDTLS_ERR_ECP_RANDOM_FAILED;
+            goto cleanup;
+        }
+        MBEDTLS_MPI_CHK(getNonce(grp, &k, r, f_rng, p_rng));
+        MBEDTLS_MPI_CHK(deriveMpi(grp, &e, buf, blen));
+        // Compute s = (e + r * d) / k with a random blinding value t
+        MBEDTLS_MPI_CHK(mbedtls_ecp_gen_privkey(grp, &t, f_rng, p_rng));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_mul_mpi(s, r, d));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_add_mpi(&e, &e, s));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_mul_mpi(&e, &e, &t));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_mul_mpi(&k, &k, &t));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(&k, &k, &grp->N));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_inv_mod(s, &k, &grp->N));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_mul_mpi(s, s, &e));
+        MBEDTLS_MPI_CHK(mbedtls_mpi_mod_mpi(s, s, &grp->N));
+    } while (mbedtls_mpi_cmp_int(s, 0) == 0);
+cleanup:
+    mbedtls_mpi_free(&k);
+    mbedtls_mpi_free(&e);
+    mbedtls_mpi_free(&t);
+    return ret;
+}
+
+#endif // defined(MBEDTLS_ECDSA_SIGN_ALT)
+
+#else // !defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT) && !defined(MBEDTLS_ECDSA_SIGN_ALT)
+
+int ecc_precompute_fill(int (*f_rng)(void*, unsigned char*, size_t), void* p_rng, void* reserved) {
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+void ecc_precompute_clear(void* reserved) {
+}
+
+int ecc_precompute_get_stats(ecc_precompute_stats* stats, void* reserved) {
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+#endif // !defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT) && !defined(MBEDTLS_ECDSA_SIGN_ALT)
@@ -46,7 +46,9 @@ typedef enum module_info_flags_t {
                                                 // need to be skipped when copying/writing this module into its target location.
     MODULE_INFO_FLAG_COMPRESSED         = 0x02, // Indicates that the module data is compressed.
     MODULE_INFO_FLAG_COMBINED           = 0x04,  // Indicates that this module is combined with another module.
-    MODULE_INFO_FLAG_ENCRYPTED          = 0x08
+    MODULE_INFO_FLAG_ENCRYPTED          = 0x08,
+    MODULE_INFO_FLAG_PATCH              = 0x10  // Indicates that the module data is a binary patch against the module
+                                                // currently installed at the module's start address.
 } module_info_flags_t;
 
 /**
@@ -205,6 +207,54 @@ typedef struct compressed_module_header {
     uint32_t original_size;
 } __attribute__((__packed__)) compressed_module_header;
 
+/**
+ * Patch module header.
+ *
+ * In a patch module, this header immediately follows the module info header (`module_info_t`) and
+ * precedes the patch data. See `module_patch.h` for the format of the patch data.
+ */
+typedef struct patch_module_header {
+    /**
+     * Header size.
+     */
+    uint16_t size;
+    /**
+     * Patch method.
+     *
+     * As of now, the only supported method is sequential (0).
+     */
+    uint8_t method;
+    /**
+     * Compression method of the patch data.
+     *
+     * 0 - no compression, 1 - raw Deflate.
+     */
+    uint8_t compression;
+    /**
+     * Base two logarithm of the window size used when compressing the patch data.
+     *
+     * See `compressed_module_header::window_bits`.
+     */
+    uint8_t window_bits;
+    uint8_t reserved[3];
+    /**
+     * Size of the module the patch is applied to.
+     */
+    uint32_t base_size;
+    /**
+     * CRC-32 of the module the patch is applied to.
+     */
+    uint32_t base_crc;
+    /**
+     * Size of the patched module.
+     */
+    uint32_t target_size;
+    /**
+     * CRC-32 of the patched module.
+     */
+    uint32_t target_crc;
+} __attribute__((__packed__)) patch_module_header;
+
 typedef enum module_info_extension_type_t {
     MODULE_INFO_EXTENSION_END = 0x0000,
     MODULE_INFO_EXTENSION_PRODUCT_DATA = 0x0001,
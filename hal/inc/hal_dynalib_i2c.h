@@ -64,6 +64,8 @@ DYNALIB_FN(19, hal_i2c, hal_i2c_unlock, int32_t(hal_i2c_interface_t, void*))
 DYNALIB_FN(20, hal_i2c, hal_i2c_request_ex, int32_t(hal_i2c_interface_t, const hal_i2c_transmission_config_t*, void*))
 DYNALIB_FN(21, hal_i2c, hal_i2c_sleep, int(hal_i2c_interface_t i2c, bool sleep, void* reserved))
 DYNALIB_FN(22, hal_i2c, hal_i2c_end_transmission_ext, int(hal_i2c_interface_t, uint8_t, void*))
+DYNALIB_FN(23, hal_i2c, hal_i2c_queue_transaction, int(hal_i2c_interface_t, hal_i2c_transaction_t*, void*))
+DYNALIB_FN(24, hal_i2c, hal_i2c_cancel_transactions, int(hal_i2c_interface_t, void*))
 
 DYNALIB_END(hal_i2c)
 
@@ -63,6 +63,8 @@ DYNALIB_FN(17, hal_spi, hal_spi_release, int32_t(hal_spi_interface_t, void*))
 #define BASE_IDX 16
 #endif
 DYNALIB_FN(BASE_IDX + 0, hal_spi, hal_spi_sleep, int(hal_spi_interface_t, bool, void*))
+DYNALIB_FN(BASE_IDX + 1, hal_spi, hal_spi_queue_transaction, int(hal_spi_interface_t, hal_spi_transaction_t*, void*))
+DYNALIB_FN(BASE_IDX + 2, hal_spi, hal_spi_cancel_transactions, int(hal_spi_interface_t, void*))
 DYNALIB_END(hal_spi)
 
 #undef BASE_IDX
@@ -276,6 +276,14 @@
 #define HAL_PLATFORM_COMPRESSED_OTA (0)
 #endif // HAL_PLATFORM_COMPRESSED_OTA
 
+#ifndef HAL_PLATFORM_DELTA_OTA
+#define HAL_PLATFORM_DELTA_OTA (0)
+#endif // HAL_PLATFORM_DELTA_OTA
+
+#ifndef HAL_PLATFORM_COAP_BLOCKWISE
+#define HAL_PLATFORM_COAP_BLOCKWISE (0)
+#endif // HAL_PLATFORM_COAP_BLOCKWISE
+
 #ifndef HAL_PLATFORM_NETWORK_MULTICAST
 #define HAL_PLATFORM_NETWORK_MULTICAST (0)
 #endif // HAL_PLATFORM_NETWORK_MULTICAST
@@ -328,6 +336,14 @@
 #define HAL_PLATFORM_PACKET_BUFFER_FLOW_CONTROL_THRESHOLD (0)
 #endif // HAL_PLATFORM_PACKET_BUFFER_FLOW_CONTROL_THRESHOLD
 
+#ifndef HAL_PLATFORM_PACKET_BUFFER_FLOW_CONTROL_RESUME_THRESHOLD
+#define HAL_PLATFORM_PACKET_BUFFER_FLOW_CONTROL_RESUME_THRESHOLD (HAL_PLATFORM_PACKET_BUFFER_FLOW_CONTROL_THRESHOLD + 1)
+#endif // HAL_PLATFORM_PACKET_BUFFER_FLOW_CONTROL_RESUME_THRESHOLD
+
+#ifndef HAL_PLATFORM_PPP_FAST_INPUT
+#define HAL_PLATFORM_PPP_FAST_INPUT (0)
+#endif // HAL_PLATFORM_PPP_FAST_INPUT
+
 #ifndef HAL_PLATFORM_MUXER_MAY_NEED_DELAY_IN_TX
 #define HAL_PLATFORM_MUXER_MAY_NEED_DELAY_IN_TX (0)
 #endif //HAL_PLATFORM_MUXER_MAY_NEED_DELAY_IN_TX
@@ -82,6 +82,56 @@ typedef enum hal_i2c_state_t {
     HAL_I2C_STATE_SUSPENDED
 } hal_i2c_state_t;
 
+typedef enum hal_i2c_transaction_segment_flag_t {
+    HAL_I2C_TRANSACTION_SEGMENT_FLAG_NONE = 0x00,
+    HAL_I2C_TRANSACTION_SEGMENT_FLAG_READ = 0x01, ///< Read data from the slave device.
+    HAL_I2C_TRANSACTION_SEGMENT_FLAG_STOP = 0x02  ///< Generate a stop condition after the segment.
+} hal_i2c_transaction_segment_flag_t;
+
+/**
+ * A segment of a queued I2C transaction.
+ *
+ * Unless `HAL_I2C_TRANSACTION_SEGMENT_FLAG_STOP` is set, the next segment is started with a
+ * repeated start condition. A stop condition is always generated after the last segment.
+ */
+typedef struct hal_i2c_transaction_segment_t {
+    void* buffer; ///< Data to send or buffer for the received data.
+    uint32_t length; ///< Segment length. Must not be 0 or exceed the size of the interface buffers.
+    uint32_t flags; ///< Flags defined by `hal_i2c_transaction_segment_flag_t`.
+} hal_i2c_transaction_segment_t;
+
+typedef struct hal_i2c_transaction_t hal_i2c_transaction_t;
+
+/**
+ * Completion callback of a queued I2C transaction.
+ *
+ * The callback is invoked from the worker thread of the interface and should return quickly.
+ *
+ * @param transaction Transaction.
+ * @param error 0 on success, otherwise an error code defined by `system_error_t`.
+ * @param context User data.
+ */
+typedef void (*hal_i2c_transaction_callback_t)(hal_i2c_transaction_t* transaction, int error, void* context);
+
+/**
+ * Queued I2C transaction.
+ *
+ * The transaction object, its segments and the buffers must remain valid until the completion
+ * callback is invoked.
+ */
+struct hal_i2c_transaction_t {
+    uint16_t size; ///< Size of this structure.
+    uint16_t version; ///< Structure version.
+    const hal_i2c_transaction_segment_t* segments; ///< Segments.
+    uint16_t segment_count; ///< Number of segments.
+    uint8_t address; ///< Slave address.
+    uint8_t reserved;
+    system_tick_t timeout_ms; ///< Timeout of each segment, or 0 to use the default timeout.
+    hal_i2c_transaction_callback_t callback; ///< Completion callback.
+    void* context; ///< User data passed to the callback.
+    hal_i2c_transaction_t* next; ///< Used internally.
+};
+
 /* Exported macros -----------------------------------------------------------*/
 #define CLOCK_SPEED_100KHZ         (uint32_t)100000
 #define CLOCK_SPEED_400KHZ         (uint32_t)400000
@@ -117,6 +167,37 @@ int hal_i2c_sleep(hal_i2c_interface_t i2c, bool sleep, void* reserved);
 int32_t hal_i2c_lock(hal_i2c_interface_t i2c, void* reserved);
 int32_t hal_i2c_unlock(hal_i2c_interface_t i2c, void* reserved);
 
+/**
+ * Queue an I2C transaction.
+ *
+ * Queued transactions are performed in order by a worker thread of the interface, which holds
+ * the interface lock only for the duration of each transaction. The calling thread doesn't block
+ * on the interface lock. The interface must be enabled in master mode.
+ *
+ * The worker thread of the interface is created when the first transaction is queued and is never
+ * destroyed. It takes about 1.2 KB of RAM for its stack, control block and semaphore, so interfaces
+ * that are never used with this function don't incur any cost.
+ *
+ * @param i2c Interface.
+ * @param transaction Transaction.
+ * @param reserved Reserved argument. Must be set to `NULL`.
+ * @return 0 on success, otherwise an error code defined by `system_error_t`.
+ */
+int hal_i2c_queue_transaction(hal_i2c_interface_t i2c, hal_i2c_transaction_t* transaction, void* reserved);
+
+/**
+ * Cancel all I2C transactions that haven't been started yet.
+ *
+ * The completion callbacks of the cancelled transactions are invoked with
+ * `SYSTEM_ERROR_CANCELLED` in the calling thread. The transaction that is being performed is not
+ * affected.
+ *
+ * @param i2c Interface.
+ * @param reserved Reserved argument. Must be set to `NULL`.
+ * @return 0 on success, otherwise an error code defined by `system_error_t`.
+ */
+int hal_i2c_cancel_transactions(hal_i2c_interface_t i2c, void* reserved);
+
 void hal_i2c_set_speed_deprecated(uint32_t speed);
 void hal_i2c_enable_dma_mode_deprecated(bool enable);
 void hal_i2c_stretch_clock_deprecated(bool stretch);
@@ -99,6 +99,21 @@ typedef uint32_t network_interface_t;
 int inet_gethostbyname(const char* hostname, uint16_t hostnameLen, HAL_IPAddress* out_ip_addr,
         network_interface_t nif, void* reserved);
 
+/**
+ * Same as inet_gethostbyname() but the answer may be served from a cache. Only positive answers
+ * are cached. This function is meant to be used for the cloud server address only.
+ */
+int inet_gethostbyname_cached(const char* hostname, uint16_t hostnameLen, HAL_IPAddress* out_ip_addr,
+        network_interface_t nif, void* reserved);
+
+/**
+ * Discards the DNS answers cached by inet_gethostbyname_cached()
+ *
+ * @param reserved  reserved for future use
+ * @return 0 on success or non-zero error code in case of failure.
+ */
+int inet_clear_dns_cache(void* reserved);
+
 
 /**
  *
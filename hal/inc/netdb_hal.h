@@ -46,6 +46,16 @@ extern "C" {
 #define NI_NUMERICSERV AI_NUMERICSERV
 #endif /* NI_NUMERICHOST */
 
+/**
+ * Flag for the `ai_flags` field of the hints passed to netdb_getaddrinfo().
+ *
+ * Allows the answer for a non-numeric host name to be served from, and stored in, the DNS cache.
+ * The cache is small and is kept in retained memory, so it's meant for the cloud server address.
+ */
+#ifndef AI_HAL_CACHE
+#define AI_HAL_CACHE 0x8000
+#endif /* AI_HAL_CACHE */
+
 /**
  * Gets the IPv4 address for the given hostname.
  *
@@ -81,6 +91,9 @@ void netdb_freeaddrinfo(struct addrinfo* ai);
 /**
  * Get a list of IP addresses and port numbers for host hostname and service servname.
  *
+ * Depending on the platform, answers for non-numeric host names may be served from a cache if
+ * `AI_HAL_CACHE` is set in the hints.
+ *
  * @param[in]  hostname  the hostname
  * @param[in]  servname  the service name
  * @param[in]  hints     the hints
@@ -107,6 +120,15 @@ int netdb_getaddrinfo(const char* hostname, const char* servname,
 int netdb_getnameinfo(const struct sockaddr* sa, socklen_t salen, char* host,
                       socklen_t hostlen, char* serv, socklen_t servlen, int flags);
 
+/**
+ * Discards the DNS answers cached by netdb_getaddrinfo()
+ *
+ * @param      reserved  reserved for future use
+ *
+ * @returns    0 on success or non-zero error code in case of failure.
+ */
+int netdb_clear_cache(void* reserved);
+
 /**
  * @}
  *
@@ -105,6 +105,50 @@ typedef struct hal_spi_acquire_config_t {
     system_tick_t timeout;
 } hal_spi_acquire_config_t;
 
+/**
+ * A segment of a queued SPI transaction.
+ */
+typedef struct hal_spi_transaction_segment_t {
+    const void* tx_buffer; ///< Data to send, or `NULL` to send zeros.
+    void* rx_buffer; ///< Buffer for the received data, or `NULL` to discard it.
+    uint32_t length; ///< Segment length. Must not be 0.
+} hal_spi_transaction_segment_t;
+
+typedef struct hal_spi_transaction_t hal_spi_transaction_t;
+
+/**
+ * Completion callback of a queued SPI transaction.
+ *
+ * The callback is invoked by the worker thread of the interface, or by the thread that cancelled
+ * the transaction. Transactions can be queued from the callback.
+ *
+ * @param transaction Transaction.
+ * @param error 0 on success, otherwise an error code defined by `system_error_t`.
+ * @param context User data.
+ */
+typedef void (*hal_spi_transaction_callback_t)(hal_spi_transaction_t* transaction, int error, void* context);
+
+/**
+ * Queued SPI transaction.
+ *
+ * The transaction object, its segments and the buffers must remain valid until the completion
+ * callback is invoked.
+ */
+struct hal_spi_transaction_t {
+    uint16_t size; ///< Size of this structure.
+    uint16_t version; ///< Structure version.
+    const hal_spi_transaction_segment_t* segments; ///< Segments that are transferred with the chip select asserted.
+    uint16_t segment_count; ///< Number of segments.
+    hal_pin_t cs_pin; ///< Chip select pin (active low), or `PIN_INVALID`.
+    uint8_t set_default; ///< Use the default settings instead of the ones below.
+    uint8_t clock_divider; ///< Clock divider (`SPI_CLOCK_DIVx`).
+    uint8_t bit_order; ///< Bit order.
+    uint8_t data_mode; ///< Data mode.
+    hal_spi_transaction_callback_t callback; ///< Completion callback.
+    void* context; ///< User data passed to the callback.
+    hal_spi_transaction_t* next; ///< Used internally.
+};
+
 void hal_spi_init(hal_spi_interface_t spi);
 void hal_spi_begin(hal_spi_interface_t spi, uint16_t pin);
 void hal_spi_begin_ext(hal_spi_interface_t spi, hal_spi_mode_t mode, uint16_t pin, void* reserved);
@@ -132,6 +176,38 @@ int32_t hal_spi_release(hal_spi_interface_t spi, void* reserved);
 
 int hal_spi_get_clock_divider(hal_spi_interface_t spi, uint32_t clock, void* reserved);
 
+/**
+ * Queue an SPI transaction.
+ *
+ * Queued transactions are performed back-to-back by a worker thread that holds the bus lock (see
+ * `hal_spi_acquire()`) until the queue is drained: the HAL applies the settings of each transaction
+ * if they differ from those of the previous one, asserts the chip select, transfers all segments
+ * via DMA and deasserts the chip select before starting the next transaction. The interface must
+ * be enabled in master mode. The transmit and receive buffers must be located in RAM.
+ *
+ * The worker thread of the interface is created when the first transaction is queued and is never
+ * destroyed. It takes about 1.3 KB of RAM for its stack, control block and semaphores.
+ *
+ * @param spi Interface.
+ * @param transaction Transaction.
+ * @param reserved Reserved argument. Must be set to `NULL`.
+ * @return 0 on success, otherwise an error code defined by `system_error_t`.
+ */
+int hal_spi_queue_transaction(hal_spi_interface_t spi, hal_spi_transaction_t* transaction, void* reserved);
+
+/**
+ * Cancel all queued SPI transactions.
+ *
+ * The completion callbacks of the cancelled transactions are invoked with
+ * `SYSTEM_ERROR_CANCELLED`. The transaction that is being transferred is completed once the DMA
+ * transfer of its current segment is finished.
+ *
+ * @param spi Interface.
+ * @param reserved Reserved argument. Must be set to `NULL`.
+ * @return 0 on success, otherwise an error code defined by `system_error_t`.
+ */
+int hal_spi_cancel_transactions(hal_spi_interface_t spi, void* reserved);
+
 #include "spi_hal_compat.h"
 
 #ifdef __cplusplus
@@ -106,7 +106,8 @@ PppNcpNetif::PppNcpNetif()
           exit_(false),
           lastNetifEvent_(NetifEvent::None),
           expectedNcpState_(NcpState::OFF),
-          expectedConnectionState_(NcpConnectionState::DISCONNECTED) {
+          expectedConnectionState_(NcpConnectionState::DISCONNECTED),
+          flowControl_(HAL_PLATFORM_PACKET_BUFFER_FLOW_CONTROL_THRESHOLD, HAL_PLATFORM_PACKET_BUFFER_FLOW_CONTROL_RESUME_THRESHOLD) {
 
     LOG(INFO, "Creating PppNcpNetif LwIP interface");
     // A boolean semaphore is sufficient to synchronize the internal thread.
@@ -463,7 +464,7 @@ int PppNcpNetif::ncpDataHandlerCb(int id, const uint8_t* data, size_t size, void
     SPARK_ASSERT(ctx);
     PppNcpNetif* self = static_cast<PppNcpNetif*>(ctx);
     int r = self->client_.input(data, size);
-    if (r == SYSTEM_ERROR_NO_MEMORY) {
+    if (r == SYSTEM_ERROR_NO_MEMORY && self->flowControl_.stop()) {
         self->celMan_->ncpClient()->dataChannelFlowControl(true);
     }
     return r;
@@ -471,7 +472,9 @@ int PppNcpNetif::ncpDataHandlerCb(int id, const uint8_t* data, size_t size, void
 
 void PppNcpNetif::mempEventHandler(memp_t type, unsigned available, unsigned size, void* ctx) {
     PppNcpNetif* self = static_cast<PppNcpNetif*>(ctx);
-    if (available > HAL_PLATFORM_PACKET_BUFFER_FLOW_CONTROL_THRESHOLD) {
+    // Resume the data flow only after enough buffers have been freed to avoid toggling the flow
+    // control with every freed buffer
+    if (available >= HAL_PLATFORM_PACKET_BUFFER_FLOW_CONTROL_RESUME_THRESHOLD && self->flowControl_.resume()) {
         self->celMan_->ncpClient()->dataChannelFlowControl(false);
     }
 }
@@ -26,6 +26,7 @@
 #include <lwip/pbuf.h>
 #include "gsm0710muxer/muxer.h"
 #include "ppp_client.h"
+#include "ppp_hdlc.h"
 #include "network/ncp/cellular/cellular_network_manager.h"
 #include "ncp_client.h"
 
@@ -92,6 +93,7 @@ private:
     std::atomic<NcpConnectionState> expectedConnectionState_;
     CellularNetworkManager* celMan_ = nullptr;
     volatile system_tick_t connectStart_ = 0;
+    particle::net::ppp::FlowControlHysteresis flowControl_;
 };
 
 } } // namespace particle::net
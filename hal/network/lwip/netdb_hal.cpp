@@ -23,25 +23,53 @@
 
 /* netdb_hal_impl.h should get included from netdb_hal.h automagically */
 #include "netdb_hal.h"
+#include "dns_cache.h"
+#include "lwiplock.h"
+#include "rtc_hal.h"
+#include "platform_headers.h"
 #include <lwip/sockets.h>
 #include <errno.h>
 #include <algorithm>
+#include <cstring>
 
-struct hostent* netdb_gethostbyname(const char *name) {
-    return lwip_gethostbyname(name);
+using namespace particle;
+using namespace particle::net;
+
+namespace {
+
+// The cache is kept in retained memory so that a device waking up from sleep doesn't need to
+// resolve the server address again
+retained_system DnsCacheData g_dnsCacheData;
+
+DnsCache* dnsCache() {
+    static DnsCache cache(&g_dnsCacheData);
+    return &cache;
 }
 
-int netdb_gethostbyname_r(const char* name, struct hostent* ret, char* buf,
-                          size_t buflen, struct hostent** result, int* h_errnop) {
-    return lwip_gethostbyname_r(name, ret, buf, buflen, result, h_errnop);
+// Cache entries are timestamped using the RTC as it keeps running while the device is sleeping
+bool getCacheTime(uint32_t* now) {
+    if (!hal_rtc_time_is_valid(nullptr)) {
+        return false;
+    }
+    struct timeval tv = {};
+    if (hal_rtc_get_time(&tv, nullptr) != 0) {
+        return false;
+    }
+    *now = tv.tv_sec;
+    return true;
 }
 
-void netdb_freeaddrinfo(struct addrinfo* ai) {
-    return lwip_freeaddrinfo(ai);
+bool isNumericHost(const char* hostname) {
+    uint8_t addr[16] = {};
+    return lwip_inet_pton(AF_INET, hostname, addr) == 1 || lwip_inet_pton(AF_INET6, hostname, addr) == 1;
 }
 
-int netdb_getaddrinfo(const char* hostname, const char* servname,
-                      const struct addrinfo* hints, struct addrinfo** res) {
+bool isCacheable(const char* hostname, const struct addrinfo* hints) {
+    return hostname && *hostname && hints && (hints->ai_flags & AI_HAL_CACHE) && !(hints->ai_flags & AI_NUMERICHOST) &&
+            !isNumericHost(hostname);
+}
+
+int resolve(const char* hostname, const char* servname, const struct addrinfo* hints, struct addrinfo** res) {
     /* Change the behavior when AF_UNSPEC is used */
     if (hints && hints->ai_family == AF_UNSPEC) {
         struct addrinfo h = *hints;
@@ -64,6 +92,117 @@ int netdb_getaddrinfo(const char* hostname, const char* servname,
     return lwip_getaddrinfo(hostname, servname, hints, res);
 }
 
+// Builds an addrinfo list out of cached addresses without doing any network requests
+int cachedAddrInfo(const DnsCacheAddress* addrs, size_t count, const char* servname, const struct addrinfo* hints,
+        struct addrinfo** res) {
+    struct addrinfo h = {};
+    if (hints) {
+        h = *hints;
+    }
+    h.ai_flags |= AI_NUMERICHOST;
+    struct addrinfo* list = nullptr;
+    struct addrinfo** last = &list;
+    for (size_t i = 0; i < count; ++i) {
+        h.ai_family = (addrs[i].size == 4) ? AF_INET : AF_INET6;
+        char host[INET6_ADDRSTRLEN] = {};
+        struct addrinfo* ai = nullptr;
+        if (!lwip_inet_ntop(h.ai_family, addrs[i].addr, host, sizeof(host)) ||
+                lwip_getaddrinfo(host, servname, &h, &ai) != 0) {
+            lwip_freeaddrinfo(list);
+            return EAI_FAIL;
+        }
+        *last = ai;
+        while (*last) {
+            last = &(*last)->ai_next;
+        }
+    }
+    *res = list;
+    return 0;
+}
+
+size_t addrInfoToCacheAddresses(const struct addrinfo* ai, DnsCacheAddress* addrs, size_t maxCount) {
+    size_t count = 0;
+    for (; ai && count < maxCount; ai = ai->ai_next) {
+        DnsCacheAddress a = {};
+        if (ai->ai_family == AF_INET && ai->ai_addr) {
+            a.size = 4;
+            memcpy(a.addr, &((const struct sockaddr_in*)ai->ai_addr)->sin_addr, a.size);
+        } else if (ai->ai_family == AF_INET6 && ai->ai_addr) {
+            a.size = 16;
+            memcpy(a.addr, &((const struct sockaddr_in6*)ai->ai_addr)->sin6_addr, a.size);
+        } else {
+            continue;
+        }
+        // The same address can be returned for different socket types
+        const auto end = addrs + count;
+        if (std::find_if(addrs, end, [&a](const DnsCacheAddress& b) {
+                    return a.size == b.size && memcmp(a.addr, b.addr, a.size) == 0;
+                }) == end) {
+            addrs[count++] = a;
+        }
+    }
+    return count;
+}
+
+} // anonymous
+
+struct hostent* netdb_gethostbyname(const char *name) {
+    return lwip_gethostbyname(name);
+}
+
+int netdb_gethostbyname_r(const char* name, struct hostent* ret, char* buf,
+                          size_t buflen, struct hostent** result, int* h_errnop) {
+    return lwip_gethostbyname_r(name, ret, buf, buflen, result, h_errnop);
+}
+
+void netdb_freeaddrinfo(struct addrinfo* ai) {
+    return lwip_freeaddrinfo(ai);
+}
+
+int netdb_getaddrinfo(const char* hostname, const char* servname,
+                      const struct addrinfo* hints, struct addrinfo** res) {
+    struct addrinfo h = {};
+    if (hints) {
+        h = *hints;
+        h.ai_flags &= ~AI_HAL_CACHE;
+    }
+    uint32_t now = 0;
+    if (!isCacheable(hostname, hints) || !getCacheTime(&now)) {
+        return resolve(hostname, servname, hints ? &h : nullptr, res);
+    }
+    hints = &h;
+    const int family = h.ai_family;
+    DnsCacheAddress addrs[dns::MAX_CACHED_ADDRESSES] = {};
+    int count = 0;
+    {
+        LwipTcpIpCoreLock lk;
+        count = dnsCache()->get(hostname, family, now, addrs, dns::MAX_CACHED_ADDRESSES);
+    }
+    if (count > 0 && cachedAddrInfo(addrs, count, servname, hints, res) == 0) {
+        return 0;
+    }
+    int r = resolve(hostname, servname, hints, res);
+    /*
+     * Only positive answers are cached. lwIP reports all resolution failures as EAI_FAIL, so an
+     * answer saying that the name doesn't exist can't be told apart from a timeout
+     */
+    if (r == 0) {
+        count = addrInfoToCacheAddresses(*res, addrs, dns::MAX_CACHED_ADDRESSES);
+        if (count > 0) {
+            /* lwIP doesn't report TTLs of the answers */
+            LwipTcpIpCoreLock lk;
+            dnsCache()->put(hostname, family, addrs, count, dns::DEFAULT_TTL, now);
+        }
+    }
+    return r;
+}
+
+int netdb_clear_cache(void* reserved) {
+    LwipTcpIpCoreLock lk;
+    dnsCache()->clear();
+    return 0;
+}
+
 int netdb_getnameinfo(const struct sockaddr* sa, socklen_t salen, char* host,
                       socklen_t hostlen, char* serv, socklen_t servlen, int flags) {
 
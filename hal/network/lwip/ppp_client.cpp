@@ -23,9 +23,12 @@
 #if defined(PPP_SUPPORT) && PPP_SUPPORT
 
 #include "service_debug.h"
+#include "trace_recorder.h"
 extern "C" {
 #include <netif/ppp/pppos.h>
+#include <netif/ppp/ppp_impl.h>
 }
+#include <lwip/tcpip.h>
 #include <lwip/netifapi.h>
 #include <netif/ppp/pppapi.h>
 #include <mutex>
@@ -65,6 +68,25 @@ const char* pppPhaseToString(uint8_t phase) {
 }
 #endif // !PPP_DEBUG
 
+#if HAL_PLATFORM_PPP_FAST_INPUT
+// Stored in front of a received frame while it's being passed to the TCPIP thread
+struct InputHeader {
+  ppp_pcb* pcb;
+};
+
+// Space reserved at the beginning of a frame for the input header and for expanding a compressed
+// protocol field
+const size_t FRAME_HEADROOM = sizeof(InputHeader) + 1;
+
+void inputFrameCb(void* arg) {
+  auto p = (pbuf*)arg;
+  InputHeader h;
+  memcpy(&h, p->payload, sizeof(h));
+  pbuf_remove_header(p, sizeof(h));
+  ppp_input(h.pcb, p);
+}
+#endif // HAL_PLATFORM_PPP_FAST_INPUT
+
 } // anonymous
 
 Client::Client() {
@@ -149,6 +171,9 @@ void Client::deinit() {
       os_queue_destroy(queue_, nullptr);
       queue_ = nullptr;
     }
+#if HAL_PLATFORM_PPP_FAST_INPUT
+    decoder_.reset();
+#endif // HAL_PLATFORM_PPP_FAST_INPUT
     if (pcb_) {
       pppapi_free(pcb_);
       pcb_ = nullptr;
@@ -231,11 +256,17 @@ int Client::input(const uint8_t* data, size_t size) {
       case STATE_DISCONNECTING:
       case STATE_CONNECTED: {
         LOG_DEBUG(TRACE, "RX: %lu", size);
+        TRACE_EVENT(TRACE_ID_PPP_INPUT, size, 0);
 
         if (platform_primary_ncp_identifier() == PLATFORM_NCP_SARA_R410) {
+#if HAL_PLATFORM_PPP_FAST_INPUT
+          const bool frameStart = decoder_.isIdle();
+#else
           auto pppos = (pppos_pcb*)pcb_->link_ctx_cb;
+          const bool frameStart = pppos && pppos->in_state == PDADDRESS;
+#endif // HAL_PLATFORM_PPP_FAST_INPUT
           const char NO_CARRIER[] = "\r\nNO CARRIER\r\n";
-          if (pppos && pppos->in_state == PDADDRESS && pcb_->phase == PPP_PHASE_NETWORK && data[0] != PPP_FLAG && size >= sizeof(NO_CARRIER) - 1 && !strncmp((const char*)data, NO_CARRIER, size)) {
+          if (frameStart && pcb_->phase == PPP_PHASE_NETWORK && data[0] != PPP_FLAG && size >= sizeof(NO_CARRIER) - 1 && !strncmp((const char*)data, NO_CARRIER, size)) {
             LOG(ERROR, "NO CARRIER in network PPP phase");
             pppapi_close(pcb_, 1);
             notifyEvent(EVENT_ERROR, ERROR_NO_CARRIER_IN_NETWORK_PHASE);
@@ -245,6 +276,9 @@ int Client::input(const uint8_t* data, size_t size) {
 
 #if !PPP_INPROC_IRQ_SAFE
         err_t err = pppos_input_tcpip(pcb_, (u8_t*)data, size);
+#else
+#if HAL_PLATFORM_PPP_FAST_INPUT
+        fastInput(data, size);
 #else
         // We can safely pass the data directly to PPPoS without going
         // through TCPIP thread mailbox and wasting a buffer for each tiny chunk of data
@@ -260,6 +294,7 @@ int Client::input(const uint8_t* data, size_t size) {
           LOG(WARN, "May have dropped %u bytes/packets (received %u bytes)", linkDropAfter - linkDropBefore, size);
         }
 #endif // DEBUG_BUILD
+#endif // HAL_PLATFORM_PPP_FAST_INPUT
         // FIXME
         err_t err = ERR_OK;
         int poolAvail = MEMP_STATS_GET(avail, MEMP_PBUF_POOL) - MEMP_STATS_GET(used, MEMP_PBUF_POOL);
@@ -278,6 +313,91 @@ int Client::input(const uint8_t* data, size_t size) {
   return SYSTEM_ERROR_INVALID_STATE;
 }
 
+#if HAL_PLATFORM_PPP_FAST_INPUT
+void Client::fastInput(const uint8_t* data, size_t size) {
+  auto pppos = (pppos_pcb*)pcb_->link_ctx_cb;
+  uint32_t accm = 0;
+  SYS_ARCH_DECL_PROTECT(lev);
+  SYS_ARCH_PROTECT(lev);
+  const bool open = pppos && pppos->open;
+  if (open) {
+    // Only the map of the control characters is negotiated (see pppos_recv_config())
+    accm = pppos->in_accm[0] | (pppos->in_accm[1] << 8) | (pppos->in_accm[2] << 16) | ((uint32_t)pppos->in_accm[3] << 24);
+  }
+  SYS_ARCH_UNPROTECT(lev);
+  if (!open) {
+    decoder_.reset();
+    return;
+  }
+  decoder_.accm(accm);
+  decoder_.input(data, size);
+}
+
+uint8_t* Client::FrameSink::frameBuffer(size_t* size) {
+  auto p = pbuf_alloc(PBUF_RAW, PBUF_POOL_BUFSIZE, PBUF_POOL);
+  if (!p) {
+    return nullptr;
+  }
+  if (!head_) {
+    pbuf_remove_header(p, FRAME_HEADROOM);
+    head_ = p;
+  } else {
+    pbuf_cat(head_, p);
+  }
+  *size = p->len;
+  return (uint8_t*)p->payload;
+}
+
+void Client::FrameSink::frameReceived(size_t size) {
+  auto p = head_;
+  head_ = nullptr;
+  pbuf_realloc(p, size);
+  // The address and control fields may be omitted (RFC 1662, 3.2), and the protocol field may be
+  // compressed to a single byte (RFC 1661, 6.5)
+  auto d = (const uint8_t*)p->payload;
+  size_t offs = 0;
+  if (offs < size && d[offs] == PPP_ALLSTATIONS) {
+    ++offs;
+  }
+  if (offs < size && d[offs] == PPP_UI) {
+    ++offs;
+  }
+  const bool shortProto = offs < size && (d[offs] & 1);
+  if (!shortProto && offs + 2 > size) {
+    pbuf_free(p);
+    LINK_STATS_INC(link.drop);
+    return;
+  }
+  pbuf_remove_header(p, offs);
+  if (shortProto) {
+    pbuf_add_header(p, 1);
+    ((uint8_t*)p->payload)[0] = 0;
+  }
+  const InputHeader h = { client_->pcb_ };
+  pbuf_add_header(p, sizeof(h));
+  memcpy(p->payload, &h, sizeof(h));
+  if (tcpip_try_callback(inputFrameCb, p) != ERR_OK) {
+    pbuf_free(p);
+    LINK_STATS_INC(link.drop);
+    MIB2_STATS_NETIF_INC(&client_->if_, ifindiscards);
+  }
+}
+
+void Client::FrameSink::frameDropped(int error) {
+  if (head_) {
+    pbuf_free(head_);
+    head_ = nullptr;
+  }
+  if (error == SYSTEM_ERROR_NO_MEMORY) {
+    LINK_STATS_INC(link.memerr);
+  } else if (error == SYSTEM_ERROR_BAD_DATA) {
+    LINK_STATS_INC(link.chkerr);
+  }
+  LINK_STATS_INC(link.drop);
+  LOG_DEBUG(WARN, "Dropped PPP frame: %d", error);
+}
+#endif // HAL_PLATFORM_PPP_FAST_INPUT
+
 void Client::setNotifyCallback(NotifyCallback cb, void* ctx) {
   std::lock_guard<std::mutex> lk(mutex_);
   cb_ = cb;
@@ -485,6 +605,7 @@ uint32_t Client::outputCb(ppp_pcb* pcb, uint8_t* data, uint32_t len, void* ctx)
 
 uint32_t Client::output(const uint8_t* data, size_t len) {
   LOG_DEBUG(TRACE, "TX: %lu", len);
+  TRACE_EVENT(TRACE_ID_PPP_OUTPUT, len, 0);
 
   if (oCb_) {
     auto r = oCb_(data, len, oCbCtx_);
@@ -32,6 +32,15 @@ extern "C" {
 #include <mutex>
 #include <atomic>
 #include "stream.h"
+#include "hal_platform.h"
+
+#if HAL_PLATFORM_PPP_FAST_INPUT
+#include "ppp_hdlc.h"
+
+#if !PPP_INPROC_IRQ_SAFE
+#error "HAL_PLATFORM_PPP_FAST_INPUT requires PPP_INPROC_IRQ_SAFE"
+#endif // !PPP_INPROC_IRQ_SAFE
+#endif // HAL_PLATFORM_PPP_FAST_INPUT
 
 #ifdef __cplusplus
 
@@ -158,6 +167,26 @@ private:
 
   void transition(State newState);
 
+#if HAL_PLATFORM_PPP_FAST_INPUT
+  // Assembles the decoded frames directly in chains of pool pbufs
+  class FrameSink: public HdlcFrameSink {
+  public:
+    explicit FrameSink(Client* client) :
+        client_(client) {
+    }
+
+    uint8_t* frameBuffer(size_t* size) override;
+    void frameReceived(size_t size) override;
+    void frameDropped(int error) override;
+
+  private:
+    Client* client_;
+    pbuf* head_ = nullptr;
+  };
+
+  void fastInput(const uint8_t* data, size_t size);
+#endif // HAL_PLATFORM_PPP_FAST_INPUT
+
 private:
 
   struct QueueEvent {
@@ -197,6 +226,11 @@ private:
   std::atomic_bool running_;
   std::atomic_bool exit_;
 
+#if HAL_PLATFORM_PPP_FAST_INPUT
+  FrameSink frameSink_{this};
+  HdlcDecoder decoder_{&frameSink_, PPP_MRU + PPP_HDRLEN + HDLC_FCS_SIZE};
+#endif // HAL_PLATFORM_PPP_FAST_INPUT
+
   static std::once_flag once_;
   static netif_ext_callback_t netifCb_;
   static int netifClientDataIdx_;
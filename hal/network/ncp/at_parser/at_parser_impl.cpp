@@ -21,6 +21,7 @@
 
 #include "stream.h"
 #include "logging.h"
+#include "trace_recorder.h"
 #include "scope_guard.h"
 #include "check.h"
 #include "debug.h"
@@ -133,7 +134,12 @@ int AtParserImpl::sendCommand() {
     clearStatus(StatusFlag::WRITE_CMD);
     setStatus(StatusFlag::FLUSH_CMD);
     cmdTermOffs_ = 0;
+    TRACE_BEGIN(TRACE_ID_AT_COMMAND, cmdSize_, 0);
+    NAMED_SCOPE_GUARD(traceGuard, {
+        TRACE_END(TRACE_ID_AT_COMMAND, -1 /* No result */, 0);
+    });
     PARSER_CHECK(flushCommand(&cmdTimeout_));
+    traceGuard.dismiss();
     return 0;
 }
 
@@ -173,6 +179,10 @@ int AtParserImpl::readResult(int* errorCode) {
         return error(SYSTEM_ERROR_INVALID_STATE);
     }
     if (!checkStatus(StatusFlag::HAS_RESULT)) {
+        // The command is reset if reading its result fails
+        NAMED_SCOPE_GUARD(traceGuard, {
+            TRACE_END(TRACE_ID_AT_COMMAND, -1 /* No result */, 0);
+        });
         if (checkStatus(StatusFlag::ECHO_ENABLED) && !checkStatus(StatusFlag::HAS_ECHO)) {
             PARSER_CHECK(waitEcho());
             setStatus(StatusFlag::HAS_ECHO);
@@ -186,6 +196,8 @@ int AtParserImpl::readResult(int* errorCode) {
             }
             PARSER_CHECK(nextLine(&cmdTimeout_));
         }
+        traceGuard.dismiss();
+        TRACE_END(TRACE_ID_AT_COMMAND, result_, errorCode_);
     }
     if (errorCode) {
         *errorCode = errorCode_;
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cellular_attach_cache.h"
+
+#include "at_parser.h"
+#include "at_response.h"
+
+#include "hal_platform.h"
+#if HAL_PLATFORM_FILESYSTEM
+#include "simple_file_storage.h"
+#endif
+
+#include "logging.h"
+#include "check.h"
+
+#include <cstring>
+
+LOG_SOURCE_CATEGORY("ncp.attach")
+
+namespace particle {
+
+namespace {
+
+const unsigned PLMN_MIN_LENGTH = 5;
+
+template<size_t N>
+void copyString(char (&dest)[N], const char* src) {
+    strncpy(dest, src, N - 1);
+    dest[N - 1] = '\0';
+}
+
+} // unnamed
+
+int CellularAttachCache::load() {
+#if HAL_PLATFORM_FILESYSTEM
+    CellularAttachProfile p = {};
+    const int r = SimpleFileStorage::load(fileName_, &p, sizeof(p));
+    if (r != sizeof(p) || p.version != PROFILE_VERSION || strnlen(p.plmn, sizeof(p.plmn)) < PLMN_MIN_LENGTH) {
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+    profile_ = p;
+    // Ensure the strings are terminated
+    profile_.iccid[sizeof(profile_.iccid) - 1] = '\0';
+    profile_.imsi[sizeof(profile_.imsi) - 1] = '\0';
+    profile_.plmn[sizeof(profile_.plmn) - 1] = '\0';
+    valid_ = true;
+    // The profile may have been used to select the network manually
+    manual_ = true;
+    if (iccid_[0] && strcmp(iccid_, profile_.iccid) != 0) {
+        discard();
+    }
+    return 0;
+#else
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+void CellularAttachCache::iccid(const char* iccid) {
+    copyString(iccid_, iccid);
+    if (valid_ && strcmp(iccid_, profile_.iccid) != 0) {
+        LOG(TRACE, "SIM card has changed");
+        discard();
+    }
+}
+
+void CellularAttachCache::imsi(const char* imsi) {
+    copyString(imsi_, imsi);
+}
+
+const char* CellularAttachCache::imsi() const {
+    if (!hasProfile() || !profile_.imsi[0]) {
+        return nullptr;
+    }
+    return profile_.imsi;
+}
+
+int CellularAttachCache::selectNetwork(AtParser* parser, unsigned timeout) {
+    CHECK_TRUE(hasProfile(), SYSTEM_ERROR_INVALID_STATE);
+    LOG(TRACE, "Selecting network %s, AcT: %d", profile_.plmn, (int)profile_.act);
+    manual_ = true;
+    // Manual selection with a fallback to automatic selection
+    const int r = parser->execCommand(timeout, "AT+COPS=4,2,\"%s\",%d", profile_.plmn, (int)profile_.act);
+    if (r != AtResponse::OK) {
+        LOG(WARN, "Unable to select network: %d", r);
+        clear();
+        return (r < 0) ? r : SYSTEM_ERROR_AT_NOT_OK;
+    }
+    return 0;
+}
+
+int CellularAttachCache::registered(AtParser* parser, uint32_t lac, uint32_t cellId) {
+    CHECK_TRUE(iccid_[0], SYSTEM_ERROR_INVALID_STATE);
+    if (hasProfile() && profile_.lac == lac && profile_.cellId == cellId && (!imsi_[0] ||
+            strcmp(imsi_, profile_.imsi) == 0)) {
+        return 0; // Nothing has changed
+    }
+    // Query the network in the numeric format
+    int r = parser->execCommand("AT+COPS=3,2");
+    CHECK_TRUE(r == AtResponse::OK, (r < 0) ? r : SYSTEM_ERROR_AT_NOT_OK);
+    auto resp = parser->sendCommand("AT+COPS?");
+    char plmn[sizeof(CellularAttachProfile::plmn)] = {};
+    int act = -1;
+    r = resp.scanf("+COPS: %*d,%*d,\"%7[0-9]\",%d", plmn, &act);
+    CHECK_TRUE(r >= 0, r);
+    CHECK_TRUE(r == 2 && strlen(plmn) >= PLMN_MIN_LENGTH, SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED);
+    r = resp.readResult();
+    CHECK_TRUE(r == AtResponse::OK, (r < 0) ? r : SYSTEM_ERROR_AT_NOT_OK);
+    CellularAttachProfile p = {};
+    p.version = PROFILE_VERSION;
+    copyString(p.iccid, iccid_);
+    if (imsi_[0]) {
+        copyString(p.imsi, imsi_);
+    } else if (hasProfile()) {
+        copyString(p.imsi, profile_.imsi);
+    }
+    copyString(p.plmn, plmn);
+    p.act = act;
+    p.lac = lac;
+    p.cellId = cellId;
+    profile_ = p;
+    valid_ = true;
+    LOG(TRACE, "Updated profile; network: %s, AcT: %d, LAC: 0x%x, CI: 0x%x", plmn, act, (unsigned)lac,
+            (unsigned)cellId);
+    return save();
+}
+
+void CellularAttachCache::clear() {
+    if (valid_) {
+        discard();
+#if HAL_PLATFORM_FILESYSTEM
+        SimpleFileStorage::clear(fileName_);
+#endif
+    }
+}
+
+int CellularAttachCache::save() {
+#if HAL_PLATFORM_FILESYSTEM
+    CHECK(SimpleFileStorage::save(fileName_, &profile_, sizeof(profile_)));
+#endif
+    return 0;
+}
+
+void CellularAttachCache::discard() {
+    profile_ = CellularAttachProfile();
+    valid_ = false;
+}
+
+} // particle
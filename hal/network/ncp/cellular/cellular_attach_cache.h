@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace particle {
+
+class AtParser;
+
+/**
+ * Parameters of the last successful network registration.
+ */
+struct CellularAttachProfile {
+    uint32_t version; ///< Format version (`CellularAttachCache::PROFILE_VERSION`).
+    char iccid[24]; ///< ICCID of the SIM card.
+    char imsi[16]; ///< IMSI of the SIM card, or an empty string if it's unknown.
+    char plmn[8]; ///< MCC and MNC of the network, e.g. "310410".
+    int32_t act; ///< Access technology (`CellularAccessTechnology`).
+    uint32_t lac; ///< Location or tracking area code of the serving cell.
+    uint32_t cellId; ///< ID of the serving cell.
+};
+
+/**
+ * Caches the parameters of the last network registration, so that the next registration with the
+ * same SIM card can skip the discovery steps.
+ *
+ * While the SIM card is unchanged:
+ *
+ * - The network settings can be looked up using the cached IMSI instead of querying it.
+ * - The cached network is selected with `AT+COPS=4`, which only searches for the last network and
+ *   access technology, and makes the modem fall back to automatic selection if they're not
+ *   available.
+ *
+ * The profile is updated when the device registers on a different cell, and discarded if the SIM
+ * card changes or the registration with the cached parameters fails.
+ */
+class CellularAttachCache {
+public:
+    /**
+     * Format version of the persisted profile.
+     */
+    static const uint32_t PROFILE_VERSION = 1;
+
+    /**
+     * Constructor.
+     *
+     * @param fileName File storing the profile. If the platform has no filesystem, the profile is
+     *        only kept in RAM.
+     */
+    explicit CellularAttachCache(const char* fileName = "/sys/cellular_attach.bin");
+
+    /**
+     * Load the profile from the file.
+     *
+     * @return 0 on success, otherwise an error code defined by `system_error_t`.
+     */
+    int load();
+
+    /**
+     * Set the ICCID of the SIM card.
+     *
+     * If the profile was stored for a different SIM card, it is discarded.
+     *
+     * @param iccid ICCID.
+     */
+    void iccid(const char* iccid);
+
+    /**
+     * Get the ICCID of the SIM card.
+     *
+     * @return ICCID, or an empty string if it's unknown.
+     */
+    const char* iccid() const;
+
+    /**
+     * Set the IMSI of the SIM card.
+     *
+     * @param imsi IMSI.
+     */
+    void imsi(const char* imsi);
+
+    /**
+     * Get the cached IMSI of the SIM card.
+     *
+     * @return IMSI, or `nullptr` if there's no profile for the SIM card.
+     */
+    const char* imsi() const;
+
+    /**
+     * Check if there's a profile for the SIM card.
+     */
+    bool hasProfile() const;
+
+    /**
+     * Get the profile.
+     */
+    const CellularAttachProfile& profile() const;
+
+    /**
+     * Select the cached network.
+     *
+     * @param parser AT parser.
+     * @param timeout Timeout of the `AT+COPS` command.
+     * @return 0 on success, otherwise an error code defined by `system_error_t`. If the command
+     *         fails, the profile is discarded.
+     */
+    int selectNetwork(AtParser* parser, unsigned timeout);
+
+    /**
+     * Check if the network needs to be reselected automatically.
+     *
+     * This is the case after the profile has been discarded, since the modem may still be in the
+     * manual selection mode.
+     */
+    bool automaticSelectionNeeded() const;
+
+    /**
+     * Notify the cache that the network has been reselected automatically.
+     */
+    void automaticSelectionDone();
+
+    /**
+     * Update the profile after the device has registered.
+     *
+     * The network is only queried if the serving cell has changed.
+     *
+     * @param parser AT parser.
+     * @param lac Location or tracking area code of the serving cell.
+     * @param cellId ID of the serving cell.
+     * @return 0 on success, otherwise an error code defined by `system_error_t`.
+     */
+    int registered(AtParser* parser, uint32_t lac, uint32_t cellId);
+
+    /**
+     * Discard the profile.
+     */
+    void clear();
+
+private:
+    CellularAttachProfile profile_;
+    char iccid_[sizeof(CellularAttachProfile::iccid)];
+    char imsi_[sizeof(CellularAttachProfile::imsi)];
+    const char* fileName_;
+    bool valid_;
+    bool manual_;
+
+    int save();
+    void discard();
+};
+
+inline CellularAttachCache::CellularAttachCache(const char* fileName) :
+        profile_(),
+        iccid_(),
+        imsi_(),
+        fileName_(fileName),
+        valid_(false),
+        manual_(false) {
+}
+
+inline const char* CellularAttachCache::iccid() const {
+    return iccid_;
+}
+
+inline bool CellularAttachCache::hasProfile() const {
+    return valid_ && iccid_[0];
+}
+
+inline const CellularAttachProfile& CellularAttachCache::profile() const {
+    return profile_;
+}
+
+inline bool CellularAttachCache::automaticSelectionNeeded() const {
+    return manual_ && !hasProfile();
+}
+
+inline void CellularAttachCache::automaticSelectionDone() {
+    manual_ = false;
+}
+
+} // particle
@@ -174,6 +174,10 @@ inline void* NcpClientConfig::dataHandlerData() const {
 }
 
 
+inline AtParser* NcpClient::atParser() {
+    return nullptr;
+}
+
 inline NcpClientLock::NcpClientLock(NcpClient* client) :
         client_(client),
         locked_(false) {
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "wifi_connector.h"
+
+#include "wifi_ncp_client.h"
+
+#include "logging.h"
+#include "check.h"
+
+#include <algorithm>
+#include <cstring>
+
+LOG_SOURCE_CATEGORY("ncp.mgr")
+
+namespace particle {
+
+using spark::Vector;
+
+namespace {
+
+int networkIndexForSsid(const char* ssid, const Vector<WifiNetworkConfig>& networks) {
+    for (int i = 0; i < networks.size(); ++i) {
+        if (strcmp(ssid, networks.at(i).ssid()) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Scans all channels if `channel` is 0
+int scan(WifiNcpClient* client, const char* ssid, int channel, Vector<WifiScanResult>* scanResults) {
+    CHECK_TRUE(scanResults->reserve(10), SYSTEM_ERROR_NO_MEMORY);
+    const auto callback = [](WifiScanResult result, void* data) -> int {
+        auto scanResults = (Vector<WifiScanResult>*)data;
+        CHECK_TRUE(scanResults->append(std::move(result)), SYSTEM_ERROR_NO_MEMORY);
+        return 0;
+    };
+    if (channel > 0) {
+        CHECK(client->scanChannel(ssid, channel, callback, scanResults));
+    } else {
+        CHECK(client->scan(callback, scanResults));
+    }
+    // Sort discovered networks by RSSI
+    std::sort(scanResults->begin(), scanResults->end(), [](const WifiScanResult& ap1, const WifiScanResult& ap2) {
+        return (ap1.rssi() > ap2.rssi()); // In descending order
+    });
+    return 0;
+}
+
+} // unnamed
+
+int WifiConnector::connect(Vector<WifiNetworkConfig>* networks, const char* ssid, bool* updated) {
+    *updated = false;
+    int index = 0;
+    if (ssid) {
+        index = networkIndexForSsid(ssid, *networks);
+    }
+    if (index < 0 || index >= networks->size()) {
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+    auto network = &networks->at(index);
+    MacAddress failedBssid = INVALID_MAC_ADDRESS;
+    // ESP32 doesn't support 802.11v/k/r and connects to the first access point it finds, so it
+    // needs to know the BSSID of the access point in order to skip the scan
+    if (client_->ncpId() != PlatformNCPIdentifier::PLATFORM_NCP_ESP32 || network->bssid() != INVALID_MAC_ADDRESS) {
+        const int r = client_->connect(network->ssid(), network->bssid(), network->security(), network->credentials());
+        if (r == 0) {
+            if (network->bssid() == INVALID_MAC_ADDRESS || network->channel() <= 0) {
+                WifiNetworkInfo info;
+                if (client_->getNetworkInfo(&info) == 0) {
+                    network->bssid(info.bssid());
+                    network->channel(info.channel());
+                    *updated = true;
+                }
+            }
+            return index;
+        }
+        failedBssid = network->bssid();
+    }
+    Vector<WifiScanResult> scanResults;
+    if (network->channel() > 0) {
+        // The access point may have been restarted or the device may have moved to another access
+        // point of the same network, which is likely to use the same channel
+        const int r = scan(client_, network->ssid(), network->channel(), &scanResults);
+        if (r < 0) {
+            LOG(WARN, "Channel scan failed: %d", r);
+        } else {
+            index = connectToAny(networks, network->ssid(), scanResults, failedBssid, updated);
+            if (index >= 0) {
+                return index;
+            }
+        }
+        scanResults.clear();
+    }
+    CHECK(scan(client_, nullptr /* ssid */, 0 /* channel */, &scanResults));
+    return connectToAny(networks, ssid, scanResults, INVALID_MAC_ADDRESS, updated);
+}
+
+int WifiConnector::connectToAny(Vector<WifiNetworkConfig>* networks, const char* ssid,
+        const Vector<WifiScanResult>& scanResults, const MacAddress& skipBssid, bool* updated) {
+    // Try to connect to any known network among the discovered ones
+    for (const auto& ap: scanResults) {
+        if (!ap.ssid() || (ssid && strcmp(ssid, ap.ssid()) != 0) ||
+                (skipBssid != INVALID_MAC_ADDRESS && ap.bssid() == skipBssid)) {
+            continue;
+        }
+        const int index = networkIndexForSsid(ap.ssid(), *networks);
+        if (index < 0) {
+            continue;
+        }
+        auto network = &networks->at(index);
+        const int r = client_->connect(network->ssid(), ap.bssid(), network->security(), network->credentials());
+        if (r == 0) {
+            if (network->bssid() != ap.bssid() || network->channel() != ap.channel()) {
+                network->bssid(ap.bssid());
+                network->channel(ap.channel());
+                *updated = true;
+            }
+            return index;
+        }
+    }
+    return SYSTEM_ERROR_NOT_FOUND;
+}
+
+} // particle
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "wifi_network_manager.h"
+
+#include "spark_wiring_vector.h"
+
+namespace particle {
+
+class WifiNcpClient;
+
+/**
+ * Connects to one of the configured WiFi networks.
+ *
+ * The BSSID and channel of the access point the device was last connected to are used as hints:
+ *
+ * 1. The device tries to associate with the last known access point without scanning.
+ * 2. If that fails, only the last known channel is scanned for the access points of the network.
+ * 3. If that fails too, all channels are scanned for the access points of any configured network.
+ */
+class WifiConnector {
+public:
+    explicit WifiConnector(WifiNcpClient* client);
+
+    /**
+     * Connect to a network.
+     *
+     * @param networks Configured networks, most recently used first. On success, the BSSID and
+     *        channel of the network are updated.
+     * @param ssid SSID of the network, or `nullptr` to connect to any of the configured networks.
+     * @param[out] updated Set to `true` if the network settings were updated.
+     * @return Index of the network on success, otherwise an error code defined by `system_error_t`.
+     */
+    int connect(spark::Vector<WifiNetworkConfig>* networks, const char* ssid, bool* updated);
+
+private:
+    WifiNcpClient* client_;
+
+    int connectToAny(spark::Vector<WifiNetworkConfig>* networks, const char* ssid,
+            const spark::Vector<WifiScanResult>& scanResults, const MacAddress& skipBssid, bool* updated);
+};
+
+inline WifiConnector::WifiConnector(WifiNcpClient* client) :
+        client_(client) {
+}
+
+} // particle
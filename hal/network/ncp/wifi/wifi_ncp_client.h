@@ -20,6 +20,8 @@
 #include "ncp_client.h"
 #include "wifi_network_manager.h"
 
+#include <cstring>
+
 namespace particle {
 
 class WifiNcpClient: public NcpClient {
@@ -27,8 +29,28 @@ public:
     virtual int connect(const char* ssid, const MacAddress& bssid, WifiSecurity sec, const WifiCredentials& cred) = 0;
     virtual int getNetworkInfo(WifiNetworkInfo* info) = 0;
     virtual int scan(WifiScanCallback callback, void* data) = 0;
+    // Scan for the access points of a network on the specified channel. The default implementation
+    // performs a full scan and filters the results
+    virtual int scanChannel(const char* ssid, int channel, WifiScanCallback callback, void* data);
     virtual int getMacAddress(MacAddress* addr) = 0;
     virtual int getFirmwareModuleVersion(uint16_t* version) = 0;
 };
 
+inline int WifiNcpClient::scanChannel(const char* ssid, int channel, WifiScanCallback callback, void* data) {
+    struct Context {
+        const char* ssid;
+        int channel;
+        WifiScanCallback callback;
+        void* data;
+    };
+    Context ctx = { ssid, channel, callback, data };
+    return scan([](WifiScanResult result, void* data) -> int {
+        const auto ctx = (Context*)data;
+        if (result.channel() != ctx->channel || !result.ssid() || strcmp(result.ssid(), ctx->ssid) != 0) {
+            return 0;
+        }
+        return ctx->callback(std::move(result), ctx->data);
+    }, &ctx);
+}
+
 } // particle
@@ -18,6 +18,7 @@
 #include "wifi_network_manager.h"
 
 #include "wifi_ncp_client.h"
+#include "wifi_connector.h"
 
 #include "file_util.h"
 #include "logging.h"
@@ -26,8 +27,6 @@
 
 #include "spark_wiring_vector.h"
 
-#include <algorithm>
-
 // FIXME: Move nanopb utilities to a common header file
 #include "../../../system/src/control/common.h"
 
@@ -62,18 +61,34 @@ void bssidFromPb(MacAddress* bssid, const T& pbBssid) {
     }
 }
 
+// Cached contents of the configuration file. Access is protected by the filesystem lock
+Vector<WifiNetworkConfig> g_networks;
+bool g_networksLoaded = false;
+
+int setCachedConfig(const Vector<WifiNetworkConfig>& networks) {
+    g_networks = networks;
+    if (g_networks.size() != networks.size()) {
+        g_networks.clear();
+        g_networksLoaded = false;
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    g_networksLoaded = true;
+    return 0;
+}
+
+int getCachedConfig(Vector<WifiNetworkConfig>* networks) {
+    *networks = g_networks;
+    CHECK_TRUE(networks->size() == g_networks.size(), SYSTEM_ERROR_NO_MEMORY);
+    return 0;
+}
+
 // TODO: Implement a couple functions to conveniently save/load a protobuf message to/from a file
-int loadConfig(Vector<WifiNetworkConfig>* networks) {
-    // Get filesystem instance
-    const auto fs = filesystem_get_instance(nullptr);
-    CHECK_TRUE(fs, SYSTEM_ERROR_FILE);
-    fs::FsLock lock(fs);
-    CHECK(filesystem_mount(fs));
+int loadConfigFromFile(lfs_t* lfs, Vector<WifiNetworkConfig>* networks) {
     // Open configuration file
     lfs_file_t file = {};
     CHECK(openFile(&file, CONFIG_FILE, LFS_O_RDONLY));
     NAMED_SCOPE_GUARD(fileGuard, {
-        lfs_file_close(&fs->instance, &file);
+        lfs_file_close(lfs, &file);
     });
     // Parse configuration
     PB(WifiConfig) pbConf = {};
@@ -97,7 +112,8 @@ int loadConfig(Vector<WifiNetworkConfig>* networks) {
             .ssid(dSsid.data)
             .bssid(bssid)
             .security((WifiSecurity)pbConf.security)
-            .credentials(std::move(cred));
+            .credentials(std::move(cred))
+            .channel(pbConf.channel);
         if (!networks->append(std::move(conf))) {
             return false;
         }
@@ -108,13 +124,27 @@ int loadConfig(Vector<WifiNetworkConfig>* networks) {
         LOG(ERROR, "Unable to parse network settings");
         networks->clear();
         LOG(WARN, "Removing file: %s", CONFIG_FILE);
-        lfs_file_close(&fs->instance, &file);
+        lfs_file_close(lfs, &file);
         fileGuard.dismiss();
-        lfs_remove(&fs->instance, CONFIG_FILE);
+        lfs_remove(lfs, CONFIG_FILE);
     }
     return 0;
 }
 
+int loadConfig(Vector<WifiNetworkConfig>* networks) {
+    // Get filesystem instance
+    const auto fs = filesystem_get_instance(nullptr);
+    CHECK_TRUE(fs, SYSTEM_ERROR_FILE);
+    fs::FsLock lock(fs);
+    if (g_networksLoaded) {
+        return getCachedConfig(networks);
+    }
+    CHECK(filesystem_mount(fs));
+    CHECK(loadConfigFromFile(&fs->instance, networks));
+    setCachedConfig(*networks); // Ignore error
+    return 0;
+}
+
 int saveConfig(const Vector<WifiNetworkConfig>& networks) {
     // Get filesystem instance
     const auto fs = filesystem_get_instance(nullptr);
@@ -140,6 +170,7 @@ int saveConfig(const Vector<WifiNetworkConfig>& networks) {
             EncodedString ePwd(&pbConf.credentials.password);
             bssidToPb(conf.bssid(), &pbConf.bssid);
             pbConf.security = (PB_WIFI(Security))conf.security();
+            pbConf.channel = conf.channel();
             pbConf.credentials.type = (PB_WIFI(CredentialsType))conf.credentials().type();
             if (conf.credentials().type() == WifiCredentials::PASSWORD) {
                 const auto s = conf.credentials().password();
@@ -155,8 +186,11 @@ int saveConfig(const Vector<WifiNetworkConfig>& networks) {
         }
         return true;
     };
+    // Make sure the cache is reloaded if the file cannot be updated
+    g_networksLoaded = false;
     CHECK(encodeMessageToFile(&file, PB(WifiConfig_fields), &pbConf));
     LOG(TRACE, "Updated file: %s", CONFIG_FILE);
+    setCachedConfig(networks); // Ignore error
     return 0;
 }
 
@@ -169,12 +203,6 @@ int networkIndexForSsid(const char* ssid, const Vector<WifiNetworkConfig>& netwo
     return -1;
 }
 
-void sortByRssi(Vector<WifiScanResult>* scanResults) {
-    std::sort(scanResults->begin(), scanResults->end(), [](const WifiScanResult& ap1, const WifiScanResult& ap2) {
-        return (ap1.rssi() > ap2.rssi()); // In descending order
-    });
-}
-
 } // unnamed
 
 WifiNetworkManager::WifiNetworkManager(WifiNcpClient* client) :
@@ -188,77 +216,10 @@ int WifiNetworkManager::connect(const char* ssid) {
     // Get known networks
     Vector<WifiNetworkConfig> networks;
     CHECK(loadConfig(&networks));
-    int index = 0;
-    if (ssid) {
-        // Find network with the given SSID
-        for (; index < networks.size(); ++index) {
-            if (strcmp(networks.at(index).ssid(), ssid) == 0) {
-                break;
-            }
-        }
-    }
-    if (index == networks.size()) {
-        return SYSTEM_ERROR_NOT_FOUND;
-    }
     // Connect to the network
     bool updateConfig = false;
-    auto network = &networks.at(index);
-    // Perform a network scan on ESP32 devices because ESP32 doesn't support 802.11v/k/r
-    int r = SYSTEM_ERROR_INTERNAL;
-    if (client_->ncpId() != PlatformNCPIdentifier::PLATFORM_NCP_ESP32) {
-        r = client_->connect(network->ssid(), network->bssid(), network->security(), network->credentials());
-    }
-    if (r < 0) {
-        // Perform network scan
-        Vector<WifiScanResult> scanResults;
-        CHECK_TRUE(scanResults.reserve(10), SYSTEM_ERROR_NO_MEMORY);
-        CHECK(client_->scan([](WifiScanResult result, void* data) -> int {
-            auto scanResults = (Vector<WifiScanResult>*)data;
-            CHECK_TRUE(scanResults->append(std::move(result)), SYSTEM_ERROR_NO_MEMORY);
-            return 0;
-        }, &scanResults));
-        // Sort discovered networks by RSSI
-        sortByRssi(&scanResults);
-        // Try to connect to any known network among the discovered ones
-        bool connected = false;
-        for (const auto& ap: scanResults) {
-            if (!ssid) {
-                index = 0;
-                for (; index < networks.size(); ++index) {
-                    network = &networks.at(index);
-                    if (strcmp(network->ssid(), ap.ssid()) == 0) {
-                        break;
-                    }
-                }
-                if (index == networks.size()) {
-                    continue;
-                }
-            } else if (strcmp(ssid, ap.ssid()) != 0) {
-                continue;
-            }
-            r = client_->connect(network->ssid(), ap.bssid(), network->security(), network->credentials());
-            if (r == 0) {
-                if (network->bssid() != ap.bssid()) {
-                    // Update BSSID
-                    network->bssid(ap.bssid());
-                    updateConfig = true;
-                }
-                connected = true;
-                break;
-            }
-        }
-        if (!connected) {
-            return SYSTEM_ERROR_NOT_FOUND;
-        }
-    } else if (network->bssid() == INVALID_MAC_ADDRESS) {
-        // Update BSSID
-        WifiNetworkInfo info;
-        r = client_->getNetworkInfo(&info);
-        if (r == 0) {
-            network->bssid(info.bssid());
-            updateConfig = true;
-        }
-    }
+    WifiConnector connector(client_);
+    const int index = CHECK(connector.connect(&networks, ssid, &updateConfig));
     if (index != 0) {
         // Move the network to the beginning of the list
         auto network = networks.takeAt(index);
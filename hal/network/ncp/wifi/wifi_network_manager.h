@@ -79,11 +79,15 @@ public:
     WifiNetworkConfig& credentials(WifiCredentials cred);
     const WifiCredentials& credentials() const;
 
+    WifiNetworkConfig& channel(int channel);
+    int channel() const;
+
 private:
     CString ssid_;
     MacAddress bssid_;
     WifiCredentials cred_;
     WifiSecurity sec_;
+    int channel_;
 };
 
 class WifiNetworkInfo {
@@ -185,7 +189,8 @@ inline WifiCredentials::Type WifiCredentials::type() const {
 
 inline WifiNetworkConfig::WifiNetworkConfig() :
         bssid_(INVALID_MAC_ADDRESS),
-        sec_(WifiSecurity::NONE) {
+        sec_(WifiSecurity::NONE),
+        channel_(0) {
 }
 
 inline WifiNetworkConfig& WifiNetworkConfig::ssid(const char* ssid) {
@@ -224,6 +229,15 @@ inline const WifiCredentials& WifiNetworkConfig::credentials() const {
     return cred_;
 }
 
+inline WifiNetworkConfig& WifiNetworkConfig::channel(int channel) {
+    channel_ = channel;
+    return *this;
+}
+
+inline int WifiNetworkConfig::channel() const {
+    return channel_;
+}
+
 inline WifiNetworkInfo::WifiNetworkInfo() :
         bssid_(INVALID_MAC_ADDRESS),
         channel_(0),
@@ -442,13 +442,38 @@ int Esp32NcpClient::scan(WifiScanCallback callback, void* data) {
     const NcpClientLock lock(this);
     CHECK(checkParser());
     auto resp = parser_.sendCommand("AT+CWLAP");
-    while (resp.hasNextLine()) {
+    CHECK(parseScanResults(&resp, callback, data));
+    const int r = CHECK_PARSER(resp.readResult());
+    CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
+    return 0;
+}
+
+int Esp32NcpClient::scanChannel(const char* ssid, int channel, WifiScanCallback callback, void* data) {
+    const NcpClientLock lock(this);
+    CHECK(checkParser());
+    auto cmd = parser_.command();
+    char escSsid[MAX_SSID_SIZE * 2 + 1] = {}; // Escaped SSID
+    espEscape(ssid, escSsid, sizeof(escSsid) - 1);
+    cmd.printf("AT+CWLAP=\"%s\",,%d", escSsid, channel);
+    auto resp = cmd.send();
+    CHECK(parseScanResults(&resp, callback, data));
+    const int r = CHECK_PARSER(resp.readResult());
+    if (r != AtResponse::OK) {
+        // Older NCP firmware versions don't support filtering the scan results
+        LOG(TRACE, "Filtered scan is not supported");
+        return WifiNcpClient::scanChannel(ssid, channel, callback, data);
+    }
+    return 0;
+}
+
+int Esp32NcpClient::parseScanResults(AtResponse* resp, WifiScanCallback callback, void* data) {
+    while (resp->hasNextLine()) {
         char ssid[MAX_SSID_SIZE + 2] = {};
         char bssidStr[MAC_ADDRESS_STRING_SIZE + 1] = {};
         int security = 0;
         int channel = 0;
         int rssi = 0;
-        const int r = CHECK_PARSER(resp.scanf("+CWLAP:(%d,\"%33[^,],%d,\"%17[^\"]\",%d)", &security, ssid, &rssi,
+        const int r = CHECK_PARSER(resp->scanf("+CWLAP:(%d,\"%33[^,],%d,\"%17[^\"]\",%d)", &security, ssid, &rssi,
                 bssidStr, &channel));
         if (r != 5) {
             // FIXME: ESP32 doesn't escape special characters, such as ',' and '"', in SSIDs. For now,
@@ -465,8 +490,6 @@ int Esp32NcpClient::scan(WifiScanCallback callback, void* data) {
                 .rssi(rssi);
         CHECK(callback(std::move(result), data));
     }
-    const int r = CHECK_PARSER(resp.readResult());
-    CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
     return 0;
 }
 
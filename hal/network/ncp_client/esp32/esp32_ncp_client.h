@@ -68,6 +68,7 @@ public:
     int connect(const char* ssid, const MacAddress& bssid, WifiSecurity sec, const WifiCredentials& cred) override;
     int getNetworkInfo(WifiNetworkInfo* info) override;
     int scan(WifiScanCallback callback, void* data) override;
+    int scanChannel(const char* ssid, int channel, WifiScanCallback callback, void* data) override;
     int getMacAddress(MacAddress* addr) override;
 
 private:
@@ -102,6 +103,7 @@ private:
     void parserError(int error);
     int getFirmwareModuleVersionImpl(uint16_t* ver);
     int getMacAddressImpl(MacAddress* addr);
+    int parseScanResults(AtResponse* resp, WifiScanCallback callback, void* data);
     int espOff();
 };
 
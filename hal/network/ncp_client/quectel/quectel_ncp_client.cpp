@@ -108,6 +108,7 @@ const unsigned REGISTRATION_CHECK_INTERVAL = 15 * 1000;
 const unsigned REGISTRATION_TIMEOUT = 10 * 60 * 1000;
 const unsigned REGISTRATION_INTERVENTION_TIMEOUT = 15 * 1000;
 const unsigned REGISTRATION_TWILIO_HOLDOFF_TIMEOUT = 5 * 60 * 1000;
+const unsigned REGISTRATION_FAST_ATTACH_TIMEOUT = 60 * 1000; // Registration with the cached network
 
 const system_tick_t QUECTEL_COPS_TIMEOUT = 3 * 60 * 1000;
 const system_tick_t QUECTEL_CFUN_TIMEOUT = 3 * 60 * 1000;
@@ -175,6 +176,8 @@ int QuectelNcpClient::init(const NcpClientConfig& conf) {
     ready_ = false;
     registrationTimeout_ = REGISTRATION_TIMEOUT;
     resetRegistrationState();
+    attachCache_.load(); // Ignore errors
+    fastAttach_ = false;
     if (modemPowerState()) {
         serial_->on(true);
         ncpPowerState(NcpPowerState::ON);
@@ -979,6 +982,7 @@ int QuectelNcpClient::checkNetConfForImsi() {
         }
         const int r = CHECK_PARSER(resp.readResult());
         if (r == AtResponse::OK && imsiLength > 0) {
+            attachCache_.imsi(buf);
             netConf_ = networkConfigForImsi(buf, imsiLength);
             return SYSTEM_ERROR_NONE;
         } else if (imsiCount >= IMSI_MAX_RETRY_CNT) {
@@ -1271,7 +1275,15 @@ int QuectelNcpClient::checkSimCard() {
     r = CHECK_PARSER(resp.readResult());
     CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_UNKNOWN);
     if (!strcmp(code, "READY")) {
-        CHECK_PARSER_OK(parser_.execCommand("AT+CCID"));
+        // The ICCID is read again with retries when configuring the APN, so a bad response here
+        // doesn't fail the SIM card check
+        char iccid[32] = {};
+        r = getIccidImpl(iccid, sizeof(iccid));
+        if (r > 5) {
+            attachCache_.iccid(iccid);
+        } else {
+            LOG(WARN, "Failed to read ICCID: %d", r);
+        }
         return SYSTEM_ERROR_NONE;
     }
     return SYSTEM_ERROR_UNKNOWN;
@@ -1284,21 +1296,34 @@ int QuectelNcpClient::configureApn(const CellularNetworkConfig& conf) {
 
     netConf_ = conf;
     if (!netConf_.isValid()) {
-        // First look for network settings based on ICCID
-        char buf[32] = {};
-        int ccidCount = 0;
-        do {
-            memset(buf, 0, sizeof(buf));
-            auto lenCcid = getIccidImpl(buf, sizeof(buf));
-            if (lenCcid > 5) {
-                netConf_ = networkConfigForIccid(buf, lenCcid);
-                break;
-            }
-        } while (++ccidCount < CCID_MAX_RETRY_CNT);
+        // First look for network settings based on ICCID. The ICCID is normally known already
+        // after the SIM card check
+        int lenCcid = strlen(attachCache_.iccid());
+        if (lenCcid > 5) {
+            netConf_ = networkConfigForIccid(attachCache_.iccid(), lenCcid);
+        } else {
+            char buf[32] = {};
+            int ccidCount = 0;
+            do {
+                memset(buf, 0, sizeof(buf));
+                lenCcid = getIccidImpl(buf, sizeof(buf));
+                if (lenCcid > 5) {
+                    attachCache_.iccid(buf);
+                    netConf_ = networkConfigForIccid(buf, lenCcid);
+                    break;
+                }
+            } while (++ccidCount < CCID_MAX_RETRY_CNT);
+        }
 
         // If failed above i.e., netConf_ is still not valid, look for network settings based on IMSI
         if (!netConf_.isValid()) {
-            CHECK(checkNetConfForImsi());
+            const auto imsi = attachCache_.imsi();
+            if (imsi) {
+                // The SIM card hasn't changed since the last registration
+                netConf_ = networkConfigForImsi(imsi, strlen(imsi));
+            } else {
+                CHECK(checkNetConfForImsi());
+            }
         }
     }
     // XXX: we've seen CGDCONT fail on cold boot, retrying here a few times
@@ -1336,33 +1361,40 @@ int QuectelNcpClient::registerNet() {
 
     connectionState(NcpConnectionState::CONNECTING);
 
-    // EG91NA can get stuck in an COPS? ERROR init loop, retry 2 times.
-    int copsCount = 0;
-    int copsState = 2;
-    char copsResponse[64] = {};
-    do {
-        auto resp = parser_.sendCommand("AT+COPS?");
-        if (resp.hasNextLine()) {
-            CHECK_PARSER(resp.readLine(copsResponse, sizeof(copsResponse)));
-            CHECK_PARSER(::sscanf(copsResponse, "+COPS: %d", &copsState));
-        }
-        r = CHECK_PARSER(resp.readResult());
-        if (r == AtResponse::OK) {
-            break;
-        } else if (copsCount >= COPS_MAX_RETRY_CNT) {
-            // if max retries are exhausted
-            return SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED;
-        }
-        ++copsCount;
-        HAL_Delay_Milliseconds(2000 * copsCount);
-    } while (copsCount < COPS_MAX_RETRY_CNT);
+    // If the SIM card hasn't changed since the last registration, select the same network
+    // directly. The modem falls back to the automatic selection if the network is not available
+    fastAttach_ = attachCache_.hasProfile() && attachCache_.selectNetwork(&parser_, QUECTEL_COPS_TIMEOUT) == 0;
+    if (!fastAttach_) {
+        // EG91NA can get stuck in an COPS? ERROR init loop, retry 2 times.
+        int copsCount = 0;
+        int copsState = 2;
+        char copsResponse[64] = {};
+        do {
+            auto resp = parser_.sendCommand("AT+COPS?");
+            if (resp.hasNextLine()) {
+                CHECK_PARSER(resp.readLine(copsResponse, sizeof(copsResponse)));
+                CHECK_PARSER(::sscanf(copsResponse, "+COPS: %d", &copsState));
+            }
+            r = CHECK_PARSER(resp.readResult());
+            if (r == AtResponse::OK) {
+                break;
+            } else if (copsCount >= COPS_MAX_RETRY_CNT) {
+                // if max retries are exhausted
+                return SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED;
+            }
+            ++copsCount;
+            HAL_Delay_Milliseconds(2000 * copsCount);
+        } while (copsCount < COPS_MAX_RETRY_CNT);
 
-    if (copsState != 0 && copsState != 1) {
-        // Only run AT+COPS=0 if currently de-registered, to avoid PLMN reselection
-        // NOTE: up to 3 mins
-        r = CHECK_PARSER(parser_.execCommand(QUECTEL_COPS_TIMEOUT, "AT+COPS=0,2"));
-        // Ignore response code here
-        // CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_UNKNOWN);
+        // The modem may still be in the manual selection mode if the cached network was used before
+        if ((copsState != 0 && copsState != 1) || attachCache_.automaticSelectionNeeded()) {
+            // Only run AT+COPS=0 if currently de-registered, to avoid PLMN reselection
+            // NOTE: up to 3 mins
+            r = CHECK_PARSER(parser_.execCommand(QUECTEL_COPS_TIMEOUT, "AT+COPS=0,2"));
+            // Ignore response code here
+            // CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_UNKNOWN);
+            attachCache_.automaticSelectionDone();
+        }
     }
 
     if (isQuecCatM1Device()) {
@@ -1699,6 +1731,9 @@ void QuectelNcpClient::resetRegistrationState() {
 void QuectelNcpClient::checkRegistrationState() {
     if (connState_ != NcpConnectionState::DISCONNECTED) {
         if (psd_.registered() || eps_.registered()) {
+            if (connState_ != NcpConnectionState::CONNECTED) {
+                updateAttachProfile(); // Ignore errors
+            }
             connectionState(NcpConnectionState::CONNECTED);
         } else if (connState_ == NcpConnectionState::CONNECTED) {
             // FIXME: potentially go back into connecting state only when getting into
@@ -1712,6 +1747,16 @@ void QuectelNcpClient::checkRegistrationState() {
 int QuectelNcpClient::interveneRegistration() {
     CHECK_TRUE(connState_ == NcpConnectionState::CONNECTING, SYSTEM_ERROR_NONE);
 
+    if (fastAttach_ && millis() - regStartTime_ >= REGISTRATION_FAST_ATTACH_TIMEOUT) {
+        LOG(TRACE, "Unable to register with the cached network for %lu s, PLMN reselection",
+                (millis() - regStartTime_) / 1000);
+        fastAttach_ = false;
+        attachCache_.clear();
+        CHECK_PARSER(parser_.execCommand(QUECTEL_COPS_TIMEOUT, "AT+COPS=0,2"));
+        attachCache_.automaticSelectionDone();
+        return 0;
+    }
+
     if (netConf_.netProv() == CellularNetworkProvider::TWILIO && millis() - regStartTime_ <= REGISTRATION_TWILIO_HOLDOFF_TIMEOUT) {
         return 0;
     }
@@ -1791,6 +1836,17 @@ int QuectelNcpClient::interveneRegistration() {
 }
 
 
+int QuectelNcpClient::updateAttachProfile() {
+    fastAttach_ = false;
+    const auto lac = cgi_.location_area_code;
+    const auto cellId = cgi_.cell_id;
+    if ((lac == std::numeric_limits<LacType>::max() && cellId == std::numeric_limits<CidType>::max()) ||
+            (lac == 0 && cellId == 0)) {
+        return SYSTEM_ERROR_INVALID_STATE; // Serving cell is unknown
+    }
+    return attachCache_.registered(&parser_, lac, cellId);
+}
+
 int QuectelNcpClient::checkRunningImsi() {
     // Check current IMSI
     if (checkImsi_) {
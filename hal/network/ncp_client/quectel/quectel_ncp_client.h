@@ -20,6 +20,7 @@
 #include <cstdlib>
 
 #include "network/ncp/cellular/cellular_ncp_client.h"
+#include "network/ncp/cellular/cellular_attach_cache.h"
 #include "platform_ncp.h"
 
 #include "at_parser.h"
@@ -116,6 +117,8 @@ private:
     unsigned registrationInterventions_;
     volatile bool inFlowControl_ = false;
     bool checkImsi_ = false;
+    CellularAttachCache attachCache_;
+    bool fastAttach_ = false;
 
     int queryAndParseAtCops(CellularSignalQuality* qual);
     int initParser(Stream* stream);
@@ -140,6 +143,7 @@ private:
     void resetRegistrationState();
     void checkRegistrationState();
     int interveneRegistration();
+    int updateAttachProfile();
     int checkRunningImsi();
     int processEventsImpl();
     int getIccidImpl(char* buf, size_t size);
@@ -115,6 +115,7 @@ const unsigned REGISTRATION_CHECK_INTERVAL = 15 * 1000;
 const unsigned REGISTRATION_INTERVENTION_TIMEOUT = 15 * 1000;
 const unsigned REGISTRATION_TIMEOUT = 10 * 60 * 1000;
 const unsigned REGISTRATION_TWILIO_HOLDOFF_TIMEOUT = 5 * 60 * 1000;
+const unsigned REGISTRATION_FAST_ATTACH_TIMEOUT = 60 * 1000; // Registration with the cached network
 
 const unsigned CHECK_IMSI_TIMEOUT = 60 * 1000;
 
@@ -196,6 +197,8 @@ int SaraNcpClient::init(const NcpClientConfig& conf) {
     waitReadyRetries_ = 0;
     registrationTimeout_ = REGISTRATION_TIMEOUT;
     resetRegistrationState();
+    attachCache_.load(); // Ignore errors
+    fastAttach_ = false;
     if (modemPowerState()) {
         serial_->on(true);
         ncpPowerState(NcpPowerState::ON);
@@ -1058,6 +1061,7 @@ int SaraNcpClient::checkNetConfForImsi() {
         }
         const int r = CHECK_PARSER(resp.readResult());
         if (r == AtResponse::OK && imsiLength > 0) {
+            attachCache_.imsi(buf);
             netConf_ = networkConfigForImsi(buf, imsiLength);
             return SYSTEM_ERROR_NONE;
         } else if (imsiCount >= IMSI_MAX_RETRY_CNT) {
@@ -1076,20 +1080,33 @@ int SaraNcpClient::selectNetworkProf(ModemState& state) {
     // Note: Not failing on AT error on ICCID/IMSI lookup since SIMs have shown strange edge cases
     // where they error for no reason, and hard resetting the modem or power cycling would not clear it.
     //
-    // Check if we are using a Twilio Super SIM based on ICCID
-    char buf[32] = {};
-    int ccidCount = 0;
-    do {
-        memset(buf, 0, sizeof(buf));
-        auto lenCcid = getIccidImpl(buf, sizeof(buf));
-        if (lenCcid > 5) {
-            netConf_ = networkConfigForIccid(buf, lenCcid);
-            break;
-        }
-    } while (++ccidCount < CCID_MAX_RETRY_CNT);
+    // Check if we are using a Twilio Super SIM based on ICCID. The ICCID is normally known already
+    // after the SIM card check
+    int lenCcid = strlen(attachCache_.iccid());
+    if (lenCcid > 5) {
+        netConf_ = networkConfigForIccid(attachCache_.iccid(), lenCcid);
+    } else {
+        char buf[32] = {};
+        int ccidCount = 0;
+        do {
+            memset(buf, 0, sizeof(buf));
+            lenCcid = getIccidImpl(buf, sizeof(buf));
+            if (lenCcid > 5) {
+                attachCache_.iccid(buf);
+                netConf_ = networkConfigForIccid(buf, lenCcid);
+                break;
+            }
+        } while (++ccidCount < CCID_MAX_RETRY_CNT);
+    }
     // If failed above i.e., netConf_ is still not valid, look for network settings based on IMSI
     if (!netConf_.isValid()) {
-        CHECK(checkNetConfForImsi());
+        const auto imsi = attachCache_.imsi();
+        if (imsi) {
+            // The SIM card hasn't changed since the last registration
+            netConf_ = networkConfigForImsi(imsi, strlen(imsi));
+        } else {
+            CHECK(checkNetConfForImsi());
+        }
     }
 
     bool reset = false;
@@ -1714,7 +1731,15 @@ int SaraNcpClient::checkSimCard(bool* failure) {
         r = CHECK_PARSER(resp.readResult());
         CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
         if (!strcmp(code, "READY")) {
-            CHECK_PARSER_OK(parser_.execCommand("AT+CCID"));
+            // The ICCID is read again with retries when configuring the APN, so a bad response here
+            // doesn't fail the SIM card check
+            char iccid[32] = {};
+            r = getIccidImpl(iccid, sizeof(iccid));
+            if (r > 5) {
+                attachCache_.iccid(iccid);
+            } else {
+                LOG(WARN, "Failed to read ICCID: %d", r);
+            }
             // IFC checks are generally unrelated to the SIM. However, there is a
             // known issue with u-blox R410 that fails IFC and potentially some other
             // commands with `+CME ERROR: SIM failure`
@@ -1804,14 +1829,25 @@ int SaraNcpClient::configureApn(const CellularNetworkConfig& conf) {
     netConf_ = conf;
     if (!netConf_.isValid()) {
         // First look for network settings based on ICCID
-        char buf[32] = {};
-        auto lenCcid = getIccidImpl(buf, sizeof(buf));
-        CHECK_TRUE(lenCcid > 5, SYSTEM_ERROR_BAD_DATA);
-        netConf_ = networkConfigForIccid(buf, lenCcid);
+        int lenCcid = strlen(attachCache_.iccid());
+        if (lenCcid > 5) {
+            netConf_ = networkConfigForIccid(attachCache_.iccid(), lenCcid);
+        } else {
+            char buf[32] = {};
+            lenCcid = getIccidImpl(buf, sizeof(buf));
+            CHECK_TRUE(lenCcid > 5, SYSTEM_ERROR_BAD_DATA);
+            attachCache_.iccid(buf);
+            netConf_ = networkConfigForIccid(buf, lenCcid);
+        }
 
         // If failed above i.e., netConf_ is still not valid, look for network settings based on IMSI
         if (!netConf_.isValid()) {
-            CHECK(checkNetConfForImsi());
+            const auto imsi = attachCache_.imsi();
+            if (imsi) {
+                netConf_ = networkConfigForImsi(imsi, strlen(imsi));
+            } else {
+                CHECK(checkNetConfForImsi());
+            }
         }
     }
 
@@ -1893,20 +1929,27 @@ int SaraNcpClient::registerNet() {
     connectionState(NcpConnectionState::CONNECTING);
     registeredTime_ = 0;
 
-    auto resp = parser_.sendCommand("AT+COPS?");
-    int copsState = 2;
-    r = CHECK_PARSER(resp.scanf("+COPS: %d", &copsState));
-    CHECK_TRUE(r == 1, SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED);
-    r = CHECK_PARSER(resp.readResult());
-    CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
+    // If the SIM card hasn't changed since the last registration, select the same network
+    // directly. The modem falls back to the automatic selection if the network is not available
+    fastAttach_ = attachCache_.hasProfile() && attachCache_.selectNetwork(&parser_, UBLOX_COPS_TIMEOUT) == 0;
+    if (!fastAttach_) {
+        auto resp = parser_.sendCommand("AT+COPS?");
+        int copsState = 2;
+        r = CHECK_PARSER(resp.scanf("+COPS: %d", &copsState));
+        CHECK_TRUE(r == 1, SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED);
+        r = CHECK_PARSER(resp.readResult());
+        CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
 
-    // NOTE: up to 3 mins (FIXME: there seems to be a bug where this timeout of 3 minutes
-    //       is not being respected by u-blox modems.  Setting to 5 for now.)
-    if (copsState != 0 && copsState != 1) {
-        // Only run AT+COPS=0 if currently de-registered, to avoid PLMN reselection
-        r = CHECK_PARSER(parser_.execCommand(UBLOX_COPS_TIMEOUT, "AT+COPS=0,2"));
-        // Ignore response code here
-        // CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
+        // NOTE: up to 3 mins (FIXME: there seems to be a bug where this timeout of 3 minutes
+        //       is not being respected by u-blox modems.  Setting to 5 for now.)
+        // The modem may still be in the manual selection mode if the cached network was used before
+        if ((copsState != 0 && copsState != 1) || attachCache_.automaticSelectionNeeded()) {
+            // Only run AT+COPS=0 if currently de-registered, to avoid PLMN reselection
+            r = CHECK_PARSER(parser_.execCommand(UBLOX_COPS_TIMEOUT, "AT+COPS=0,2"));
+            // Ignore response code here
+            // CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
+            attachCache_.automaticSelectionDone();
+        }
     }
 
     if (ncpId() != PLATFORM_NCP_SARA_R410 && ncpId() != PLATFORM_NCP_SARA_R510) {
@@ -2206,6 +2249,9 @@ void SaraNcpClient::checkRegistrationState() {
             if (memoryIssuePresent_ && connState_ != NcpConnectionState::CONNECTED) {
                 registeredTime_ = millis(); // start registered timer for memory issue power off delays
             }
+            if (connState_ != NcpConnectionState::CONNECTED) {
+                updateAttachProfile(); // Ignore errors
+            }
             connectionState(NcpConnectionState::CONNECTED);
         } else if (connState_ == NcpConnectionState::CONNECTED) {
             // FIXME: potentially go back into connecting state only when getting into
@@ -2219,6 +2265,16 @@ void SaraNcpClient::checkRegistrationState() {
 int SaraNcpClient::interveneRegistration() {
     CHECK_TRUE(connState_ == NcpConnectionState::CONNECTING, SYSTEM_ERROR_NONE);
 
+    if (fastAttach_ && millis() - regStartTime_ >= REGISTRATION_FAST_ATTACH_TIMEOUT) {
+        LOG(TRACE, "Unable to register with the cached network for %lu s, PLMN reselection",
+                (millis() - regStartTime_) / 1000);
+        fastAttach_ = false;
+        attachCache_.clear();
+        CHECK_PARSER(parser_.execCommand(UBLOX_COPS_TIMEOUT, "AT+COPS=0,2"));
+        attachCache_.automaticSelectionDone();
+        return 0;
+    }
+
     if (netConf_.netProv() == CellularNetworkProvider::TWILIO && millis() - regStartTime_ <= REGISTRATION_TWILIO_HOLDOFF_TIMEOUT) {
         return 0;
     }
@@ -2282,6 +2338,17 @@ int SaraNcpClient::interveneRegistration() {
     return 0;
 }
 
+int SaraNcpClient::updateAttachProfile() {
+    fastAttach_ = false;
+    const auto lac = cgi_.location_area_code;
+    const auto cellId = cgi_.cell_id;
+    if ((lac == std::numeric_limits<LacType>::max() && cellId == std::numeric_limits<CidType>::max()) ||
+            (lac == 0 && cellId == 0)) {
+        return SYSTEM_ERROR_INVALID_STATE; // Serving cell is unknown
+    }
+    return attachCache_.registered(&parser_, lac, cellId);
+}
+
 int SaraNcpClient::checkRunningImsi() {
     // Check current IMSI if registered successfully in which case imsiCheckTime_ will be 0,
     // Else, if not registered, check after CHECK_IMSI_TIMEOUT is expired
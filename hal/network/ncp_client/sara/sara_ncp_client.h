@@ -20,6 +20,7 @@
 #include <cstdlib>
 
 #include "network/ncp/cellular/cellular_ncp_client.h"
+#include "network/ncp/cellular/cellular_attach_cache.h"
 #include "platform_ncp.h"
 
 #include "at_parser.h"
@@ -117,6 +118,8 @@ private:
     unsigned registrationTimeout_;
     unsigned registrationInterventions_;
     volatile bool inFlowControl_ = false;
+    CellularAttachCache attachCache_;
+    bool fastAttach_ = false;
     bool firmwareUpdateR510_ = false;
     int firmwareInstallRespCodeR510_ = 0;
     int lastFirmwareInstallRespCodeR510_ = 0;
@@ -151,6 +154,7 @@ private:
     void resetRegistrationState();
     void checkRegistrationState();
     int interveneRegistration();
+    int updateAttachProfile();
     int checkRunningImsi();
     int processEventsImpl();
     int getIccidImpl(char* buf, size_t size);
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dns_cache.h"
+
+#include "system_error.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+
+namespace particle {
+
+namespace {
+
+const uint32_t CACHE_MAGIC = 0x434e5344; // "DSNC"
+const uint16_t CACHE_VERSION = 1;
+
+bool isExpired(const DnsCacheEntry& e, uint32_t now) {
+    // Treat the entry as expired if the clock went backwards
+    return now < e.time || now - e.time >= e.ttl;
+}
+
+bool isNameEqual(const char* name1, const char* name2) {
+    for (;; ++name1, ++name2) {
+        if (std::tolower((unsigned char)*name1) != std::tolower((unsigned char)*name2)) {
+            return false;
+        }
+        if (!*name1) {
+            return true;
+        }
+    }
+}
+
+bool isEntryValid(const DnsCacheEntry& e) {
+    if (e.valid != 1 || e.count > dns::MAX_CACHED_ADDRESSES || e.ttl > dns::MAX_TTL ||
+            !memchr(e.name, '\0', sizeof(e.name))) {
+        return false;
+    }
+    for (size_t i = 0; i < e.count; ++i) {
+        if (e.addrs[i].size != 4 && e.addrs[i].size != 16) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+DnsCache::DnsCache(DnsCacheData* data) :
+        d_(data) {
+    if (d_->magic != CACHE_MAGIC || d_->version != CACHE_VERSION || d_->size != sizeof(DnsCacheData)) {
+        clear();
+        return;
+    }
+    for (auto& e: d_->entries) {
+        if (!isEntryValid(e)) {
+            memset(&e, 0, sizeof(e));
+        }
+    }
+}
+
+int DnsCache::get(const char* name, int family, uint32_t now, DnsCacheAddress* addrs, size_t maxCount) {
+    const auto e = find(name, family);
+    if (!e) {
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+    if (isExpired(*e, now)) {
+        memset(e, 0, sizeof(DnsCacheEntry));
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+    const size_t n = std::min<size_t>(e->count, maxCount);
+    memcpy(addrs, e->addrs, n * sizeof(DnsCacheAddress));
+    return n;
+}
+
+int DnsCache::put(const char* name, int family, const DnsCacheAddress* addrs, size_t count, uint32_t ttl, uint32_t now) {
+    const size_t nameLen = strlen(name);
+    if (!nameLen) {
+        return SYSTEM_ERROR_INVALID_ARGUMENT;
+    }
+    if (nameLen > dns::MAX_CACHED_NAME_LENGTH) {
+        return SYSTEM_ERROR_TOO_LARGE;
+    }
+    count = std::min(count, dns::MAX_CACHED_ADDRESSES);
+    for (size_t i = 0; i < count; ++i) {
+        if (addrs[i].size != 4 && addrs[i].size != 16) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+    }
+    if (!ttl) {
+        remove(name, family);
+        return 0;
+    }
+    auto e = find(name, family);
+    if (!e) {
+        // Use a free or expired slot, or evict the entry that is going to expire first
+        for (auto& entry: d_->entries) {
+            if (!entry.valid || isExpired(entry, now)) {
+                e = &entry;
+                break;
+            }
+            if (!e || entry.time + entry.ttl < e->time + e->ttl) {
+                e = &entry;
+            }
+        }
+    }
+    memset(e, 0, sizeof(DnsCacheEntry));
+    memcpy(e->name, name, nameLen + 1);
+    memcpy(e->addrs, addrs, count * sizeof(DnsCacheAddress));
+    e->time = now;
+    e->ttl = std::min(ttl, dns::MAX_TTL);
+    e->family = family;
+    e->count = count;
+    e->valid = 1;
+    return 0;
+}
+
+void DnsCache::remove(const char* name, int family) {
+    const auto e = find(name, family);
+    if (e) {
+        memset(e, 0, sizeof(DnsCacheEntry));
+    }
+}
+
+void DnsCache::clear() {
+    memset(d_, 0, sizeof(DnsCacheData));
+    d_->magic = CACHE_MAGIC;
+    d_->version = CACHE_VERSION;
+    d_->size = sizeof(DnsCacheData);
+}
+
+DnsCacheEntry* DnsCache::find(const char* name, int family) {
+    for (auto& e: d_->entries) {
+        if (e.valid && e.family == family && isNameEqual(e.name, name)) {
+            return &e;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace particle
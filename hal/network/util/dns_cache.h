@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+// Only the cloud server address is cached by default (see AI_HAL_CACHE in netdb_hal.h and
+// inet_gethostbyname_cached() in inet_hal_compat.h)
+#ifndef DNS_CACHE_MAX_ENTRIES
+#define DNS_CACHE_MAX_ENTRIES 1
+#endif
+
+namespace particle {
+
+namespace dns {
+
+const size_t MAX_CACHE_ENTRIES = DNS_CACHE_MAX_ENTRIES;
+const size_t MAX_CACHED_ADDRESSES = 4;
+const size_t MAX_CACHED_NAME_LENGTH = 63;
+
+// TTL of a positive answer when the resolver doesn't report one (seconds)
+const uint32_t DEFAULT_TTL = 300;
+// TTL of a negative answer (seconds). The platform resolvers can't tell a name that doesn't exist
+// from a failed lookup, so they only cache positive answers
+const uint32_t NEGATIVE_TTL = 10;
+// Maximum TTL of a cached answer (seconds)
+const uint32_t MAX_TTL = 86400;
+
+} // namespace dns
+
+/**
+ * A cached IPv4 or IPv6 address.
+ */
+struct DnsCacheAddress {
+    uint8_t size; // 4 or 16
+    uint8_t addr[16]; // Network byte order
+};
+
+struct DnsCacheEntry {
+    char name[dns::MAX_CACHED_NAME_LENGTH + 1];
+    DnsCacheAddress addrs[dns::MAX_CACHED_ADDRESSES];
+    uint32_t time; // Time when the entry was stored
+    uint32_t ttl;
+    int16_t family; // Address family requested by the application
+    uint8_t count; // 0 for a negative answer
+    uint8_t valid;
+};
+
+/**
+ * Cache storage.
+ *
+ * The storage is a POD structure so that it can be placed in retained memory and survive sleep.
+ * Its contents are validated when the cache is initialized.
+ */
+struct DnsCacheData {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    DnsCacheEntry entries[dns::MAX_CACHE_ENTRIES];
+};
+
+static_assert(std::is_pod<DnsCacheData>::value, "DnsCacheData is not a POD struct");
+
+/**
+ * A cache of positive and negative DNS answers.
+ *
+ * Entries are keyed by the host name and the address family requested by the application. Time is
+ * passed in by the caller in seconds and should come from a clock that keeps running while the
+ * device is sleeping. The cache doesn't do any locking.
+ */
+class DnsCache {
+public:
+    explicit DnsCache(DnsCacheData* data);
+
+    /**
+     * Get the cached addresses of a host.
+     *
+     * @param name Host name.
+     * @param family Address family requested by the application.
+     * @param now Current time in seconds.
+     * @param[out] addrs Addresses.
+     * @param maxCount Maximum number of addresses to return.
+     * @return Number of addresses, 0 if a negative answer is cached for the host, or
+     *         `SYSTEM_ERROR_NOT_FOUND` if the cache has no valid entry for the host.
+     */
+    int get(const char* name, int family, uint32_t now, DnsCacheAddress* addrs, size_t maxCount);
+
+    /**
+     * Store the addresses of a host.
+     *
+     * Storing an empty list of addresses caches a negative answer.
+     *
+     * @param name Host name.
+     * @param family Address family requested by the application.
+     * @param addrs Addresses.
+     * @param count Number of addresses. Only the first `dns::MAX_CACHED_ADDRESSES` are stored.
+     * @param ttl TTL in seconds.
+     * @param now Current time in seconds.
+     * @return 0 on success, otherwise an error code defined by `system_error_t`.
+     */
+    int put(const char* name, int family, const DnsCacheAddress* addrs, size_t count, uint32_t ttl, uint32_t now);
+
+    /**
+     * Remove a cached answer.
+     *
+     * @param name Host name.
+     * @param family Address family requested by the application.
+     */
+    void remove(const char* name, int family);
+
+    /**
+     * Remove all cached answers.
+     */
+    void clear();
+
+private:
+    DnsCacheData* d_;
+
+    DnsCacheEntry* find(const char* name, int family);
+};
+
+} // namespace particle
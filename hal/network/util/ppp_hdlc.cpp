@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ppp_hdlc.h"
+
+#include "system_error.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace particle {
+
+namespace net {
+
+namespace ppp {
+
+namespace {
+
+const uint16_t FCS_POLY = 0x8408; // x^16 + x^12 + x^5 + 1, bit-reversed
+
+struct FcsTables {
+    uint16_t t[4][256];
+};
+
+constexpr FcsTables makeFcsTables() {
+    FcsTables tables = {};
+    for (unsigned i = 0; i < 256; ++i) {
+        uint16_t fcs = i;
+        for (unsigned j = 0; j < 8; ++j) {
+            fcs = (fcs & 1) ? (fcs >> 1) ^ FCS_POLY : fcs >> 1;
+        }
+        tables.t[0][i] = fcs;
+    }
+    for (unsigned i = 0; i < 256; ++i) {
+        for (unsigned k = 1; k < 4; ++k) {
+            const uint16_t prev = tables.t[k - 1][i];
+            tables.t[k][i] = (prev >> 8) ^ tables.t[0][prev & 0xff];
+        }
+    }
+    return tables;
+}
+
+constexpr FcsTables FCS_TABLES = makeFcsTables();
+
+// Bit tricks for finding a byte value in a 32-bit word. The results are exact as to whether such
+// a byte exists but not as to which one it is
+inline uint32_t hasZeroByte(uint32_t w) {
+    return (w - 0x01010101u) & ~w & 0x80808080u;
+}
+
+inline uint32_t hasByte(uint32_t w, uint8_t c) {
+    return hasZeroByte(w ^ (0x01010101u * c));
+}
+
+inline uint32_t hasByteLessThan(uint32_t w, uint8_t c) {
+    return (w - 0x01010101u * c) & ~w & 0x80808080u;
+}
+
+inline bool isSpecialByte(uint8_t c, uint32_t accm) {
+    return c == HDLC_FLAG || c == HDLC_ESCAPE || (c < 0x20 && (accm & (1u << c)));
+}
+
+} // namespace
+
+uint16_t hdlcFcs16(uint16_t fcs, const uint8_t* data, size_t size) {
+    const auto& t = FCS_TABLES.t;
+    while (size >= 4) {
+        fcs ^= data[0] | (data[1] << 8);
+        fcs = t[3][fcs & 0xff] ^ t[2][fcs >> 8] ^ t[1][data[2]] ^ t[0][data[3]];
+        data += 4;
+        size -= 4;
+    }
+    while (size > 0) {
+        fcs = (fcs >> 8) ^ t[0][(fcs ^ *data++) & 0xff];
+        --size;
+    }
+    return fcs;
+}
+
+size_t hdlcFindSpecial(const uint8_t* data, size_t size, uint32_t accm) {
+    size_t i = 0;
+    // Scan the bytes preceding the first aligned word
+    for (; i < size && ((uintptr_t)(data + i) & 3); ++i) {
+        if (isSpecialByte(data[i], accm)) {
+            return i;
+        }
+    }
+    for (; i + 4 <= size; i += 4) {
+        uint32_t w = 0;
+        memcpy(&w, data + i, sizeof(w));
+        uint32_t m = hasByte(w, HDLC_FLAG) | hasByte(w, HDLC_ESCAPE);
+        if (accm) {
+            m |= hasByteLessThan(w, 0x20);
+        }
+        if (m) {
+            // Control characters that are not in the map are only a false positive
+            for (size_t j = i; j < i + 4; ++j) {
+                if (isSpecialByte(data[j], accm)) {
+                    return j;
+                }
+            }
+        }
+    }
+    for (; i < size; ++i) {
+        if (isSpecialByte(data[i], accm)) {
+            return i;
+        }
+    }
+    return size;
+}
+
+HdlcDecoder::HdlcDecoder(HdlcFrameSink* sink, size_t maxFrameSize) :
+        sink_(sink),
+        buf_(nullptr),
+        bufSize_(0),
+        bufOffs_(0),
+        frameSize_(0),
+        maxFrameSize_(maxFrameSize),
+        accm_(0),
+        fcs_(HDLC_FCS_INIT),
+        escaped_(false),
+        discard_(false),
+        flag_(false) {
+}
+
+void HdlcDecoder::input(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        if (discard_) {
+            // Skip to the end of the frame
+            const auto p = (const uint8_t*)memchr(data, HDLC_FLAG, size);
+            if (!p) {
+                return;
+            }
+            size -= p - data + 1;
+            data = p + 1;
+            discard_ = false;
+            escaped_ = false;
+            flag_ = true;
+            continue;
+        }
+        if (!escaped_) {
+            const size_t n = hdlcFindSpecial(data, size, accm_);
+            if (n > 0) {
+                append(data, n);
+                data += n;
+                size -= n;
+                continue;
+            }
+        }
+        uint8_t c = *data++;
+        --size;
+        if (c == HDLC_FLAG) {
+            endFrame();
+        } else if (c == HDLC_ESCAPE) {
+            escaped_ = true;
+        } else if (c >= 0x20 || !(accm_ & (1u << c))) {
+            if (escaped_) {
+                c ^= HDLC_TRANS;
+                escaped_ = false;
+            }
+            append(&c, 1);
+        }
+        // Unescaped control characters that are in the map have been inserted by the
+        // physical layer and are discarded
+    }
+}
+
+void HdlcDecoder::reset() {
+    if (buf_ || frameSize_) {
+        dropFrame(SYSTEM_ERROR_CANCELLED);
+    }
+    escaped_ = false;
+    discard_ = false;
+    flag_ = false;
+}
+
+void HdlcDecoder::append(const uint8_t* data, size_t size) {
+    if (frameSize_ + size > maxFrameSize_) {
+        dropFrame(SYSTEM_ERROR_TOO_LARGE);
+        discard_ = true;
+        return;
+    }
+    fcs_ = hdlcFcs16(fcs_, data, size);
+    while (size > 0) {
+        if (bufOffs_ == bufSize_) {
+            buf_ = sink_->frameBuffer(&bufSize_);
+            bufOffs_ = 0;
+            if (!buf_ || !bufSize_) {
+                dropFrame(SYSTEM_ERROR_NO_MEMORY);
+                discard_ = true;
+                return;
+            }
+        }
+        const size_t n = std::min(size, bufSize_ - bufOffs_);
+        memcpy(buf_ + bufOffs_, data, n);
+        bufOffs_ += n;
+        frameSize_ += n;
+        data += n;
+        size -= n;
+    }
+}
+
+void HdlcDecoder::endFrame() {
+    if (escaped_) {
+        // An escape character followed by a flag aborts the frame
+        if (frameSize_) {
+            dropFrame(SYSTEM_ERROR_ABORTED);
+        }
+    } else if (frameSize_) {
+        if (frameSize_ <= HDLC_FCS_SIZE || fcs_ != HDLC_FCS_GOOD) {
+            dropFrame(SYSTEM_ERROR_BAD_DATA);
+        } else {
+            sink_->frameReceived(frameSize_ - HDLC_FCS_SIZE);
+        }
+    }
+    buf_ = nullptr;
+    bufSize_ = 0;
+    bufOffs_ = 0;
+    frameSize_ = 0;
+    fcs_ = HDLC_FCS_INIT;
+    escaped_ = false;
+    flag_ = true;
+}
+
+void HdlcDecoder::dropFrame(int error) {
+    sink_->frameDropped(error);
+    buf_ = nullptr;
+    bufSize_ = 0;
+    bufOffs_ = 0;
+    frameSize_ = 0;
+    fcs_ = HDLC_FCS_INIT;
+}
+
+} // namespace ppp
+
+} // namespace net
+
+} // namespace particle
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+namespace net {
+
+namespace ppp {
+
+// RFC 1662 framing constants
+const uint8_t HDLC_FLAG = 0x7e;
+const uint8_t HDLC_ESCAPE = 0x7d;
+const uint8_t HDLC_TRANS = 0x20;
+
+const uint16_t HDLC_FCS_INIT = 0xffff;
+const uint16_t HDLC_FCS_GOOD = 0xf0b8;
+const size_t HDLC_FCS_SIZE = 2;
+
+/**
+ * Update the 16-bit frame check sequence (RFC 1662, appendix C.2).
+ *
+ * The data is processed four bytes at a time using the slicing-by-4 method.
+ *
+ * @param fcs Current FCS value.
+ * @param data Data.
+ * @param size Data size.
+ * @return Updated FCS value.
+ */
+uint16_t hdlcFcs16(uint16_t fcs, const uint8_t* data, size_t size);
+
+/**
+ * Find the first byte that needs special handling when decoding a HDLC frame.
+ *
+ * The data is scanned a word at a time.
+ *
+ * @param data Data.
+ * @param size Data size.
+ * @param accm Receive async-control-character-map. Characters in the range 0x00-0x1f that are set
+ *        in the map are treated as special.
+ * @return Offset of the byte, or `size` if the data contains no special bytes.
+ */
+size_t hdlcFindSpecial(const uint8_t* data, size_t size, uint32_t accm = 0);
+
+/**
+ * Interface for the storage of the decoded frame data.
+ */
+class HdlcFrameSink {
+public:
+    virtual ~HdlcFrameSink() = default;
+
+    /**
+     * Get a buffer for the frame data.
+     *
+     * The decoder calls this method when it starts a new frame or fills the previously returned
+     * buffer. The data written to each buffer is contiguous within the frame.
+     *
+     * @param[out] size Buffer size.
+     * @return Buffer, or `nullptr` if no memory is available.
+     */
+    virtual uint8_t* frameBuffer(size_t* size) = 0;
+
+    /**
+     * Process a complete frame.
+     *
+     * @param size Frame size, not including the FCS.
+     */
+    virtual void frameReceived(size_t size) = 0;
+
+    /**
+     * Discard the frame data.
+     *
+     * @param error Error code defined by `system_error_t`.
+     */
+    virtual void frameDropped(int error) = 0;
+};
+
+/**
+ * Decoder for the HDLC-like framing used by PPP in asynchronous mode (RFC 1662).
+ *
+ * Runs of bytes that contain no flag, escape or filtered control characters are copied to the
+ * frame buffers in bulk, and the FCS is computed over the whole run at once.
+ */
+class HdlcDecoder {
+public:
+    /**
+     * Construct a decoder.
+     *
+     * @param sink Frame sink.
+     * @param maxFrameSize Maximum size of a frame, including the FCS.
+     */
+    HdlcDecoder(HdlcFrameSink* sink, size_t maxFrameSize);
+
+    /**
+     * Decode the received data.
+     *
+     * @param data Data.
+     * @param size Data size.
+     */
+    void input(const uint8_t* data, size_t size);
+
+    /**
+     * Set the receive async-control-character-map.
+     *
+     * Unescaped control characters that are set in the map are discarded.
+     */
+    void accm(uint32_t accm);
+    uint32_t accm() const;
+
+    /**
+     * Check if the decoder has received a flag and no frame data after it.
+     */
+    bool isIdle() const;
+
+    /**
+     * Discard the current frame and reset the decoder state.
+     */
+    void reset();
+
+private:
+    HdlcFrameSink* sink_;
+    uint8_t* buf_; // Current frame buffer
+    size_t bufSize_; // Size of the current frame buffer
+    size_t bufOffs_; // Offset in the current frame buffer
+    size_t frameSize_; // Number of decoded bytes in the current frame
+    size_t maxFrameSize_;
+    uint32_t accm_;
+    uint16_t fcs_;
+    bool escaped_; // Whether the previous byte was an escape character
+    bool discard_; // Whether the remaining frame data should be discarded
+    bool flag_; // Whether a flag has been received
+
+    void append(const uint8_t* data, size_t size);
+    void endFrame();
+    void dropFrame(int error);
+};
+
+/**
+ * Two-threshold flow control state.
+ *
+ * The flow is stopped when the number of available buffers drops to the low threshold, and it is
+ * resumed only after it reaches the high threshold, so that the flow control doesn't toggle with
+ * every allocated or freed buffer.
+ */
+class FlowControlHysteresis {
+public:
+    FlowControlHysteresis(unsigned lowThreshold, unsigned highThreshold) :
+            low_(lowThreshold),
+            high_(highThreshold > lowThreshold ? highThreshold : lowThreshold + 1),
+            stopped_(false) {
+    }
+
+    /**
+     * Update the flow control state.
+     *
+     * @param available Number of available buffers.
+     * @return 1 if the flow needs to be stopped, -1 if it needs to be resumed, or 0 if the state
+     *         hasn't changed.
+     */
+    int update(unsigned available) {
+        if (available <= low_) {
+            return stop() ? 1 : 0;
+        }
+        if (available >= high_) {
+            return resume() ? -1 : 0;
+        }
+        return 0;
+    }
+
+    /**
+     * Mark the flow as stopped.
+     *
+     * @return `true` if the flow was running.
+     */
+    bool stop() {
+        return !stopped_.exchange(true, std::memory_order_acq_rel);
+    }
+
+    /**
+     * Mark the flow as running.
+     *
+     * @return `true` if the flow was stopped.
+     */
+    bool resume() {
+        return stopped_.exchange(false, std::memory_order_acq_rel);
+    }
+
+    bool isStopped() const {
+        return stopped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    unsigned low_;
+    unsigned high_;
+    std::atomic<bool> stopped_;
+};
+
+inline void HdlcDecoder::accm(uint32_t accm) {
+    accm_ = accm;
+}
+
+inline uint32_t HdlcDecoder::accm() const {
+    return accm_;
+}
+
+inline bool HdlcDecoder::isIdle() const {
+    return flag_ && !frameSize_ && !discard_ && !escaped_;
+}
+
+} // namespace ppp
+
+} // namespace net
+
+} // namespace particle
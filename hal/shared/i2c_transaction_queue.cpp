@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hal_platform.h"
+
+#if HAL_PLATFORM_I2C_NUM > 0
+
+#include "i2c_hal.h"
+#include "concurrent_hal.h"
+#include "hal_irq_flag.h"
+#include "static_recursive_mutex.h"
+#include "check.h"
+#include "system_error.h"
+
+#include <mutex>
+
+namespace {
+
+const size_t WORKER_THREAD_STACK_SIZE = 1024;
+
+struct TransactionQueue {
+    hal_i2c_transaction_t* head; // First queued transaction
+    hal_i2c_transaction_t* tail; // Last queued transaction
+    os_thread_t thread; // Worker thread
+    os_semaphore_t sem; // Signalled when transactions are queued
+    hal_i2c_interface_t i2c;
+};
+
+TransactionQueue g_queues[HAL_PLATFORM_I2C_NUM] = {};
+StaticRecursiveMutex g_initMutex;
+
+int performTransaction(hal_i2c_interface_t i2c, const hal_i2c_transaction_t* t) {
+    int error = 0;
+    bool stopped = true; // Whether the bus was released with a stop condition
+    for (unsigned i = 0; i < t->segment_count; ++i) {
+        const auto seg = &t->segments[i];
+        const bool stop = (i == t->segment_count - 1u) || (seg->flags & HAL_I2C_TRANSACTION_SEGMENT_FLAG_STOP);
+        hal_i2c_transmission_config_t conf = {};
+        conf.size = sizeof(conf);
+        conf.address = t->address;
+        conf.quantity = seg->length;
+        conf.timeout_ms = t->timeout_ms ? t->timeout_ms : HAL_I2C_DEFAULT_TIMEOUT_MS;
+        conf.flags = stop ? HAL_I2C_TRANSMISSION_FLAG_STOP : HAL_I2C_TRANSMISSION_FLAG_NONE;
+        const auto buf = (uint8_t*)seg->buffer;
+        if (seg->flags & HAL_I2C_TRANSACTION_SEGMENT_FLAG_READ) {
+            const int32_t n = hal_i2c_request_ex(i2c, &conf, nullptr);
+            if (n != (int32_t)seg->length) {
+                error = SYSTEM_ERROR_I2C_ABORT;
+                break;
+            }
+            for (int32_t j = 0; j < n; ++j) {
+                buf[j] = hal_i2c_read(i2c, nullptr);
+            }
+        } else {
+            hal_i2c_begin_transmission(i2c, t->address, &conf);
+            for (uint32_t j = 0; j < seg->length; ++j) {
+                if (!hal_i2c_write(i2c, buf[j], nullptr)) {
+                    // Nothing has been sent yet for this segment
+                    error = SYSTEM_ERROR_TOO_LARGE;
+                    break;
+                }
+            }
+            if (error < 0) {
+                break;
+            }
+            error = hal_i2c_end_transmission_ext(i2c, stop, nullptr);
+            if (error < 0) {
+                break;
+            }
+        }
+        stopped = stop;
+    }
+    if (error < 0 && !stopped) {
+        // Release the bus held by a repeated start
+        hal_i2c_reset(i2c, 0, nullptr);
+    }
+    return error;
+}
+
+os_thread_return_t workerThread(void* arg) {
+    const auto q = static_cast<TransactionQueue*>(arg);
+    for (;;) {
+        os_semaphore_take(q->sem, CONCURRENT_WAIT_FOREVER, false);
+        for (;;) {
+            int st = HAL_disable_irq();
+            const auto t = q->head;
+            if (t) {
+                q->head = t->next;
+                if (!q->head) {
+                    q->tail = nullptr;
+                }
+            }
+            HAL_enable_irq(st);
+            if (!t) {
+                break;
+            }
+            t->next = nullptr;
+            hal_i2c_lock(q->i2c, nullptr);
+            const int error = performTransaction(q->i2c, t);
+            hal_i2c_unlock(q->i2c, nullptr);
+            if (t->callback) {
+                t->callback(t, error, t->context);
+            }
+        }
+    }
+    os_thread_exit(nullptr);
+}
+
+int initQueue(hal_i2c_interface_t i2c) {
+    std::lock_guard<StaticRecursiveMutex> lock(g_initMutex);
+    const auto q = &g_queues[i2c];
+    if (q->thread) {
+        return 0;
+    }
+    q->i2c = i2c;
+    if (os_semaphore_create(&q->sem, 1, 0)) {
+        q->sem = nullptr;
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    // Run slightly above the default priority so that queued transactions are not delayed by
+    // application code
+    if (os_thread_create(&q->thread, "i2c", OS_THREAD_PRIORITY_DEFAULT + 1, workerThread, q, WORKER_THREAD_STACK_SIZE)) {
+        os_semaphore_destroy(q->sem);
+        q->sem = nullptr;
+        q->thread = nullptr;
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    return 0;
+}
+
+} // namespace
+
+int hal_i2c_queue_transaction(hal_i2c_interface_t i2c, hal_i2c_transaction_t* transaction, void* reserved) {
+    CHECK_TRUE(i2c < HAL_PLATFORM_I2C_NUM, SYSTEM_ERROR_INVALID_ARGUMENT);
+    CHECK_TRUE(transaction && transaction->segments && transaction->segment_count > 0, SYSTEM_ERROR_INVALID_ARGUMENT);
+    for (unsigned i = 0; i < transaction->segment_count; ++i) {
+        const auto seg = &transaction->segments[i];
+        CHECK_TRUE(seg->buffer && seg->length > 0, SYSTEM_ERROR_INVALID_ARGUMENT);
+    }
+    CHECK_TRUE(hal_i2c_is_enabled(i2c, nullptr), SYSTEM_ERROR_INVALID_STATE);
+    CHECK(initQueue(i2c));
+    const auto q = &g_queues[i2c];
+    transaction->next = nullptr;
+    int st = HAL_disable_irq();
+    if (q->tail) {
+        q->tail->next = transaction;
+    } else {
+        q->head = transaction;
+    }
+    q->tail = transaction;
+    HAL_enable_irq(st);
+    os_semaphore_give(q->sem, false);
+    return 0;
+}
+
+int hal_i2c_cancel_transactions(hal_i2c_interface_t i2c, void* reserved) {
+    CHECK_TRUE(i2c < HAL_PLATFORM_I2C_NUM, SYSTEM_ERROR_INVALID_ARGUMENT);
+    const auto q = &g_queues[i2c];
+    int st = HAL_disable_irq();
+    auto t = q->head;
+    q->head = nullptr;
+    q->tail = nullptr;
+    HAL_enable_irq(st);
+    while (t) {
+        const auto next = t->next;
+        t->next = nullptr;
+        if (t->callback) {
+            t->callback(t, SYSTEM_ERROR_CANCELLED, t->context);
+        }
+        t = next;
+    }
+    return 0;
+}
+
+#endif // HAL_PLATFORM_I2C_NUM > 0
@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hal_platform.h"
+
+#if HAL_PLATFORM_SPI_NUM > 0
+
+#include "spi_hal.h"
+#include "gpio_hal.h"
+#include "concurrent_hal.h"
+#include "hal_irq_flag.h"
+#include "static_recursive_mutex.h"
+#include "check.h"
+#include "system_error.h"
+
+#include <mutex>
+
+namespace {
+
+const size_t WORKER_THREAD_STACK_SIZE = 1024;
+
+// Maximum time it may take to transfer a segment. The platform drivers don't report an error if
+// a DMA transfer can't be started, e.g. because the interface has been disabled
+const system_tick_t SEGMENT_TIMEOUT = 1000;
+
+struct TransactionQueue {
+    hal_spi_transaction_t* head; // First queued transaction
+    hal_spi_transaction_t* tail; // Last queued transaction
+    os_thread_t thread; // Worker thread
+    os_semaphore_t queued; // Signalled when transactions are queued
+    os_semaphore_t done; // Signalled by the DMA completion interrupt
+    hal_spi_interface_t spi;
+    volatile bool cancelled; // Whether the transaction being transferred has been cancelled
+    bool busy; // Whether a transaction is being transferred
+    // Settings applied to the interface. Only valid while the worker holds the bus lock
+    uint8_t setDefault;
+    uint8_t clockDivider;
+    uint8_t bitOrder;
+    uint8_t dataMode;
+    bool settingsValid;
+};
+
+TransactionQueue g_queues[HAL_PLATFORM_SPI_NUM] = {};
+StaticRecursiveMutex g_initMutex;
+
+// The DMA completion callback takes no arguments. Only ISR-safe functions may be called here
+template<hal_spi_interface_t spi>
+void dmaCallback() {
+    os_semaphore_give(g_queues[spi].done, false);
+}
+
+const hal_spi_dma_user_callback DMA_CALLBACKS[] = {
+    dmaCallback<HAL_SPI_INTERFACE1>,
+#if HAL_PLATFORM_SPI_NUM > 1
+    dmaCallback<HAL_SPI_INTERFACE2>,
+#endif
+#if HAL_PLATFORM_SPI_NUM > 2
+    dmaCallback<HAL_SPI_INTERFACE3>,
+#endif
+};
+
+static_assert(sizeof(DMA_CALLBACKS) / sizeof(DMA_CALLBACKS[0]) == HAL_PLATFORM_SPI_NUM,
+        "Unsupported number of SPI interfaces");
+
+// EasyDMA can only access RAM. For data in flash, the nRF52840 driver allocates a bounce buffer
+// and transfers it in chunks, which defeats the purpose of queueing the transfers
+bool isDmaBuffer(const void* ptr) {
+#if HAL_PLATFORM_NRF52840
+    return !ptr || ((uintptr_t)ptr & 0xe0000000) == 0x20000000; // See nrfx_is_in_ram()
+#else
+    return true;
+#endif
+}
+
+void lockBus(hal_spi_interface_t spi) {
+#if HAL_PLATFORM_SPI_HAL_THREAD_SAFETY
+    hal_spi_acquire(spi, nullptr);
+#endif
+}
+
+void unlockBus(hal_spi_interface_t spi) {
+#if HAL_PLATFORM_SPI_HAL_THREAD_SAFETY
+    hal_spi_release(spi, nullptr);
+#endif
+}
+
+void applySettings(TransactionQueue* q, const hal_spi_transaction_t* t) {
+    if (q->settingsValid && q->setDefault == t->set_default && (t->set_default ||
+            (q->clockDivider == t->clock_divider && q->bitOrder == t->bit_order && q->dataMode == t->data_mode))) {
+        // Reconfiguring the peripheral is relatively expensive
+        return;
+    }
+    hal_spi_set_settings(q->spi, t->set_default, t->clock_divider, t->bit_order, t->data_mode, nullptr);
+    q->setDefault = t->set_default;
+    q->clockDivider = t->clock_divider;
+    q->bitOrder = t->bit_order;
+    q->dataMode = t->data_mode;
+    q->settingsValid = true;
+}
+
+int performTransaction(TransactionQueue* q, const hal_spi_transaction_t* t) {
+    applySettings(q, t);
+    if (t->cs_pin != PIN_INVALID) {
+        hal_gpio_write(t->cs_pin, 0);
+    }
+    int error = 0;
+    for (unsigned i = 0; i < t->segment_count; ++i) {
+        if (q->cancelled) {
+            error = SYSTEM_ERROR_CANCELLED;
+            break;
+        }
+        const auto seg = &t->segments[i];
+        hal_spi_transfer_dma(q->spi, seg->tx_buffer, seg->rx_buffer, seg->length, DMA_CALLBACKS[q->spi]);
+        if (os_semaphore_take(q->done, SEGMENT_TIMEOUT, false)) {
+            hal_spi_transfer_dma_cancel(q->spi);
+            os_semaphore_take(q->done, 0, false); // In case the transfer completed in the meantime
+            // The state of the peripheral is unknown
+            q->settingsValid = false;
+            error = SYSTEM_ERROR_TIMEOUT;
+            break;
+        }
+    }
+    if (t->cs_pin != PIN_INVALID) {
+        hal_gpio_write(t->cs_pin, 1);
+    }
+    return error;
+}
+
+// Transactions are performed by a thread rather than chained from the DMA completion interrupt:
+// reconfiguring the peripheral and starting a DMA transfer are not ISR-safe on all platforms,
+// and the bus lock can only be held by a thread
+os_thread_return_t workerThread(void* arg) {
+    const auto q = static_cast<TransactionQueue*>(arg);
+    for (;;) {
+        os_semaphore_take(q->queued, CONCURRENT_WAIT_FOREVER, false);
+        int st = HAL_disable_irq();
+        const bool empty = !q->head;
+        HAL_enable_irq(st);
+        if (empty) {
+            continue; // The transactions have been cancelled or performed already
+        }
+        // Keep the bus locked until the queue is drained
+        lockBus(q->spi);
+        for (;;) {
+            st = HAL_disable_irq();
+            const auto t = q->head;
+            if (t) {
+                q->head = t->next;
+                if (!q->head) {
+                    q->tail = nullptr;
+                }
+                q->cancelled = false;
+                q->busy = true;
+            }
+            HAL_enable_irq(st);
+            if (!t) {
+                break;
+            }
+            t->next = nullptr;
+            const int error = performTransaction(q, t);
+            st = HAL_disable_irq();
+            q->busy = false;
+            HAL_enable_irq(st);
+            if (t->callback) {
+                t->callback(t, error, t->context);
+            }
+        }
+        // Other users of the bus are free to change the settings once it's unlocked
+        q->settingsValid = false;
+        unlockBus(q->spi);
+    }
+    os_thread_exit(nullptr);
+}
+
+int initQueue(hal_spi_interface_t spi) {
+    std::lock_guard<StaticRecursiveMutex> lock(g_initMutex);
+    const auto q = &g_queues[spi];
+    if (q->thread) {
+        return 0;
+    }
+    q->spi = spi;
+    if (os_semaphore_create(&q->queued, 1, 0)) {
+        q->queued = nullptr;
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    if (os_semaphore_create(&q->done, 1, 0)) {
+        os_semaphore_destroy(q->queued);
+        q->queued = nullptr;
+        q->done = nullptr;
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    // Run slightly above the default priority so that queued transactions are not delayed by
+    // application code
+    if (os_thread_create(&q->thread, "spi", OS_THREAD_PRIORITY_DEFAULT + 1, workerThread, q, WORKER_THREAD_STACK_SIZE)) {
+        os_semaphore_destroy(q->done);
+        os_semaphore_destroy(q->queued);
+        q->queued = nullptr;
+        q->done = nullptr;
+        q->thread = nullptr;
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    return 0;
+}
+
+} // namespace
+
+int hal_spi_queue_transaction(hal_spi_interface_t spi, hal_spi_transaction_t* transaction, void* reserved) {
+    CHECK_TRUE(spi < HAL_PLATFORM_SPI_NUM, SYSTEM_ERROR_INVALID_ARGUMENT);
+    CHECK_TRUE(transaction && transaction->segments && transaction->segment_count > 0, SYSTEM_ERROR_INVALID_ARGUMENT);
+    for (unsigned i = 0; i < transaction->segment_count; ++i) {
+        const auto seg = &transaction->segments[i];
+        CHECK_TRUE(seg->length > 0, SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK_TRUE(isDmaBuffer(seg->tx_buffer) && isDmaBuffer(seg->rx_buffer), SYSTEM_ERROR_INVALID_ARGUMENT);
+    }
+    hal_spi_info_t info = {};
+    info.version = HAL_SPI_INFO_VERSION;
+    hal_spi_info(spi, &info, nullptr);
+    CHECK_TRUE(info.enabled && info.mode == SPI_MODE_MASTER, SYSTEM_ERROR_INVALID_STATE);
+    CHECK(initQueue(spi));
+    const auto q = &g_queues[spi];
+    transaction->next = nullptr;
+    int st = HAL_disable_irq();
+    if (q->tail) {
+        q->tail->next = transaction;
+    } else {
+        q->head = transaction;
+    }
+    q->tail = transaction;
+    HAL_enable_irq(st);
+    os_semaphore_give(q->queued, false);
+    return 0;
+}
+
+int hal_spi_cancel_transactions(hal_spi_interface_t spi, void* reserved) {
+    CHECK_TRUE(spi < HAL_PLATFORM_SPI_NUM, SYSTEM_ERROR_INVALID_ARGUMENT);
+    const auto q = &g_queues[spi];
+    int st = HAL_disable_irq();
+    auto t = q->head;
+    q->head = nullptr;
+    q->tail = nullptr;
+    // The transaction being transferred is completed by the worker once its current segment is
+    // transferred
+    if (q->busy) {
+        q->cancelled = true;
+    }
+    HAL_enable_irq(st);
+    while (t) {
+        const auto next = t->next;
+        t->next = nullptr;
+        if (t->callback) {
+            t->callback(t, SYSTEM_ERROR_CANCELLED, t->context);
+        }
+        t = next;
+    }
+    return 0;
+}
+
+#endif // HAL_PLATFORM_SPI_NUM > 0
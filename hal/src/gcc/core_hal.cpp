@@ -38,7 +38,10 @@
 #include "interrupts_hal.h"
 #include <sstream>
 #include <iomanip>
+#include <csignal>
+#include <cstdlib>
 #include "system_error.h"
+#include "trace_recorder.h"
 #include "../../../system/inc/system_mode.h" // FIXME
 
 #include "eeprom_file.h"
@@ -152,6 +155,33 @@ bool removeArg(std::vector<std::string>* args, const std::string& arg) {
     return found;
 }
 
+void write_trace_file()
+{
+    if (deviceConfig.trace_file.empty()) {
+        return;
+    }
+    trace_set_enabled(false);
+    std::string dump;
+    const int r = trace_dump([](void* appender, const uint8_t* data, size_t size) {
+        static_cast<std::string*>(appender)->append((const char*)data, size);
+        return true;
+    }, &dump, nullptr /* reserved */);
+    if (r < 0) {
+        return; // Tracing is not compiled in
+    }
+    write_file(deviceConfig.trace_file, dump);
+    trace_set_enabled(true);
+}
+
+// Set by the signal handler. std::exit() is not async-signal-safe, so the process exits from the
+// system loop instead, which runs the atexit() handlers and writes the trace buffer on Ctrl+C
+volatile std::sig_atomic_t g_exitSignal = 0;
+
+void exit_signal_handler(int signal)
+{
+    g_exitSignal = signal;
+}
+
 } // namespace
 
 void setLoggerLevel(LoggerOutputLevel level)
@@ -178,6 +208,11 @@ extern "C" int main(int argc, char* argv[])
     try {
         log_set_callbacks(log_message_callback, log_write_callback, log_enabled_callback, nullptr);
         if (read_device_config(argc, argv)) {
+                if (!deviceConfig.trace_file.empty()) {
+                    std::atexit(write_trace_file);
+                    std::signal(SIGINT, exit_signal_handler);
+                    std::signal(SIGTERM, exit_signal_handler);
+                }
                 if (!HAL_Core_Validate_Modules(0 /* flags */, nullptr /* reserved */)) {
                     set_system_mode(SAFE_MODE);
                 }
@@ -288,6 +323,7 @@ void HAL_Core_System_Reset(void)
             argv.push_back(arg.data());
         }
         argv.push_back(nullptr);
+        write_trace_file();
         LOG(INFO, "Resetting device");
         LOG_PRINT(INFO, "\r\n\r\n\r\n");
         execvp(argv[0], argv.data());
@@ -437,6 +473,11 @@ bool HAL_watchdog_reset_flagged()
 
 void HAL_Notify_WDT()
 {
+    // Called on every iteration of the system loop
+    const int signal = g_exitSignal;
+    if (signal) {
+        std::exit(128 + signal);
+    }
 }
 
 void HAL_Core_Init(void)
@@ -107,6 +107,7 @@ public:
             ("server_key,sk", po::value<std::string>(&config.server_key)->default_value("server_key.der"), "the filename containing the server public key")
             ("product_version", po::value<uint16_t>(&config.product_version)->default_value(0xffff), "the product version")
             ("describe", po::value<std::string>(&config.describe), "the filename containing the device description")
+            ("trace", po::value<std::string>(&config.trace), "the filename to write the trace buffer to on exit")
             ("protocol,p", po::value<ProtocolFactory>(&config.protocol)->default_value(PROTOCOL_NONE), "the cloud communication protocol to use")
             ;
 
@@ -359,6 +360,7 @@ void DeviceConfig::read(Configuration& config)
         this->describe = Describe::fromString(desc);
     }
     this->product_version = config.product_version;
+    this->trace_file = config.trace;
 
     this->protocol = config.protocol;
     if (this->protocol == PROTOCOL_NONE) {
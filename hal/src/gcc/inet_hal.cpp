@@ -1,26 +1,99 @@
 
 #include "inet_hal.h"
+#include "rtc_hal.h"
+#include "dns_cache.h"
+#include "system_error.h"
 
 #include "device_globals.h"
 
+#include <mutex>
+#include <cstring>
+
 namespace ip = boost::asio::ip;
 
-int inet_gethostbyname(const char* hostname, uint16_t hostnameLen, HAL_IPAddress* out_ip_addr,
-        network_interface_t nif, void* reserved)
-{
-    out_ip_addr->ipv4 = 0;
+using namespace particle;
+
+namespace {
+
+DnsCacheData g_dnsCacheData;
+DnsCache g_dnsCache(&g_dnsCacheData);
+std::mutex g_dnsCacheMutex;
+
+uint32_t cacheTime() {
+    struct timeval tv = {};
+    hal_rtc_get_time(&tv, nullptr);
+    return tv.tv_sec;
+}
+
+uint32_t toIpv4(const DnsCacheAddress& addr) {
+    return ((uint32_t)addr.addr[0] << 24) | ((uint32_t)addr.addr[1] << 16) | ((uint32_t)addr.addr[2] << 8) |
+            (uint32_t)addr.addr[3];
+}
+
+size_t resolve(const char* hostname, DnsCacheAddress* addrs, size_t maxCount) {
+    size_t count = 0;
+    boost::system::error_code ec;
     ip::tcp::resolver resolver(device_io_service);
     ip::tcp::resolver::query query(hostname, "");
-    for(ip::tcp::resolver::iterator i = resolver.resolve(query);
-                            i != ip::tcp::resolver::iterator();
+    for(ip::tcp::resolver::iterator i = resolver.resolve(query, ec);
+                            i != ip::tcp::resolver::iterator() && count < maxCount;
                             ++i)
     {
         ip::tcp::endpoint end = *i;
         ip::address addr = end.address();
         if (addr.is_v4()) {
-            ip::address_v4 addr_v4 = addr.to_v4();
-            out_ip_addr->ipv4 = addr_v4.to_ulong();
+            const auto bytes = addr.to_v4().to_bytes();
+            addrs[count].size = bytes.size();
+            memcpy(addrs[count].addr, bytes.data(), bytes.size());
+            ++count;
+        }
+    }
+    return count;
+}
+
+} // namespace
+
+int inet_gethostbyname(const char* hostname, uint16_t hostnameLen, HAL_IPAddress* out_ip_addr,
+        network_interface_t nif, void* reserved)
+{
+    out_ip_addr->ipv4 = 0;
+    DnsCacheAddress addr = {};
+    if (!resolve(hostname, &addr, 1)) {
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+    out_ip_addr->ipv4 = toIpv4(addr);
+    return 0;
+}
+
+int inet_gethostbyname_cached(const char* hostname, uint16_t hostnameLen, HAL_IPAddress* out_ip_addr,
+        network_interface_t nif, void* reserved)
+{
+    out_ip_addr->ipv4 = 0;
+    const auto now = cacheTime();
+    DnsCacheAddress addrs[dns::MAX_CACHED_ADDRESSES] = {};
+    {
+        std::lock_guard<std::mutex> lock(g_dnsCacheMutex);
+        if (g_dnsCache.get(hostname, AF_INET, now, addrs, dns::MAX_CACHED_ADDRESSES) > 0) {
+            out_ip_addr->ipv4 = toIpv4(addrs[0]);
+            return 0;
         }
     }
+    const size_t count = resolve(hostname, addrs, dns::MAX_CACHED_ADDRESSES);
+    if (!count) {
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+    {
+        // The system resolver doesn't report TTLs of the answers
+        std::lock_guard<std::mutex> lock(g_dnsCacheMutex);
+        g_dnsCache.put(hostname, AF_INET, addrs, count, dns::DEFAULT_TTL, now);
+    }
+    out_ip_addr->ipv4 = toIpv4(addrs[0]);
+    return 0;
+}
+
+int inet_clear_dns_cache(void* reserved)
+{
+    std::lock_guard<std::mutex> lock(g_dnsCacheMutex);
+    g_dnsCache.clear();
     return 0;
 }
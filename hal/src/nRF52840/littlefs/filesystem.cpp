@@ -19,6 +19,10 @@
 #include "platform_config.h"
 #include "exflash_hal.h"
 #include "rgbled.h"
+#include "filesystem_cache.h"
+#include "system_error.h"
+#include "check.h"
+#include <algorithm>
 #include <mutex>
 
 using namespace particle::fs;
@@ -60,10 +64,57 @@ __attribute__((weak)) int filesystem_unlock(filesystem_t* fs) {
 
 namespace {
 
+#ifndef LFS_NO_MALLOC
+
+const size_t MAX_CACHE_LINE_COUNT = 64;
+
+static_assert(FILESYSTEM_CACHE_LINE_SIZE >= 16 && FILESYSTEM_CACHE_LINE_SIZE <= FILESYSTEM_BLOCK_SIZE &&
+        !(FILESYSTEM_CACHE_LINE_SIZE & (FILESYSTEM_CACHE_LINE_SIZE - 1)), "Invalid FILESYSTEM_CACHE_LINE_SIZE");
+static_assert(FILESYSTEM_CACHE_LINE_COUNT <= MAX_CACHE_LINE_COUNT, "Invalid FILESYSTEM_CACHE_LINE_COUNT");
+static_assert(FILESYSTEM_FILE_BUFFER_COUNT <= BufferPool::MAX_BUFFER_COUNT, "Invalid FILESYSTEM_FILE_BUFFER_COUNT");
+
+const filesystem_cache_config s_cacheConfig = {
+    sizeof(filesystem_cache_config),
+    FILESYSTEM_READ_SIZE,
+    FILESYSTEM_PROG_SIZE,
+    FILESYSTEM_LOOKAHEAD,
+    FILESYSTEM_CACHE_LINE_SIZE,
+    FILESYSTEM_CACHE_LINE_COUNT,
+    FILESYSTEM_FILE_BUFFER_COUNT
+};
+
+FlashReadCache s_readCache;
+BufferPool s_fileBufferPool;
+/* The pool only serves the buffers allocated while the filesystem is mounted, i.e. the caches
+ * of the open files. The buffers that littlefs allocates for itself on mount are taken from the heap
+ */
+bool s_fileBufferPoolEnabled = false;
+
+void initCache() {
+    /* Neither the read cache nor the pool is essential, so the filesystem is used without them
+     * if they can't be allocated
+     */
+    int r = s_readCache.init(s_cacheConfig.cache_line_size, s_cacheConfig.cache_line_count, hal_exflash_read);
+    if (r < 0) {
+        LOG_DEBUG(WARN, "Unable to allocate filesystem cache: %d", r);
+        s_readCache.init(s_cacheConfig.cache_line_size, 0 /* lineCount */, hal_exflash_read);
+    }
+    r = s_fileBufferPool.init(std::max(s_cacheConfig.read_size, s_cacheConfig.prog_size), s_cacheConfig.file_buffer_count);
+    if (r < 0) {
+        LOG_DEBUG(WARN, "Unable to allocate file buffers: %d", r);
+    }
+}
+
+#endif /* LFS_NO_MALLOC */
+
 int fs_read(const struct lfs_config* c, lfs_block_t block,
             lfs_off_t off, void* buffer, lfs_size_t size)
 {
+#ifndef LFS_NO_MALLOC
+    int r = s_readCache.read(block * c->block_size + off, (uint8_t*)buffer, size);
+#else
     int r = hal_exflash_read(block * c->block_size + off, (uint8_t*)buffer, size);
+#endif /* LFS_NO_MALLOC */
     if (r) {
         LOG_DEBUG(ERROR, "fs_read error %d", r);
     }
@@ -74,6 +125,9 @@ int fs_prog(const struct lfs_config* c, lfs_block_t block,
             lfs_off_t off, const void* buffer, lfs_size_t size)
 {
     int r = hal_exflash_write(block * c->block_size + off, (const uint8_t*)buffer, size);
+#ifndef LFS_NO_MALLOC
+    s_readCache.invalidate(block * c->block_size + off, size);
+#endif /* LFS_NO_MALLOC */
     if (r) {
         LOG_DEBUG(ERROR, "fs_prog error %d", r);
     }
@@ -83,6 +137,9 @@ int fs_prog(const struct lfs_config* c, lfs_block_t block,
 int fs_erase(const struct lfs_config* c, lfs_block_t block)
 {
     int r = hal_exflash_erase_sector(block * c->block_size, 1);
+#ifndef LFS_NO_MALLOC
+    s_readCache.invalidate(block * c->block_size, c->block_size);
+#endif /* LFS_NO_MALLOC */
     if (r) {
         LOG_DEBUG(ERROR, "fs_erase error %d", r);
     }
@@ -251,17 +308,22 @@ int filesystem_mount(filesystem_t* fs) {
     fs->config.prog = &fs_prog;
     fs->config.erase = &fs_erase;
     fs->config.sync = &fs_sync;
-    fs->config.read_size = FILESYSTEM_READ_SIZE;
-    fs->config.prog_size = FILESYSTEM_PROG_SIZE;
     fs->config.block_size = FILESYSTEM_BLOCK_SIZE;
     fs->config.block_count = FILESYSTEM_BLOCK_COUNT;
-    fs->config.lookahead = FILESYSTEM_LOOKAHEAD;
 
 #ifdef LFS_NO_MALLOC
+    fs->config.read_size = FILESYSTEM_READ_SIZE;
+    fs->config.prog_size = FILESYSTEM_PROG_SIZE;
+    fs->config.lookahead = FILESYSTEM_LOOKAHEAD;
     fs->config.read_buffer = fs->read_buffer;
     fs->config.prog_buffer = fs->prog_buffer;
     fs->config.lookahead_buffer = fs->lookahead_buffer;
     fs->config.file_buffer = fs->file_buffer;
+#else
+    fs->config.read_size = s_cacheConfig.read_size;
+    fs->config.prog_size = s_cacheConfig.prog_size;
+    fs->config.lookahead = s_cacheConfig.lookahead;
+    initCache();
 #endif /* LFS_NO_MALLOC */
 
     ret = lfs_mount(&fs->instance, &fs->config);
@@ -306,6 +368,9 @@ int filesystem_mount(filesystem_t* fs) {
 
     if (!ret) {
         fs->state = true;
+#ifndef LFS_NO_MALLOC
+        s_fileBufferPoolEnabled = true;
+#endif /* LFS_NO_MALLOC */
 #if MODULE_FUNCTION != MOD_FUNC_BOOTLOADER
         // Make sure /usr folder exists
         int r = lfs_mkdir(&fs->instance, "/usr");
@@ -326,6 +391,10 @@ int filesystem_unmount(filesystem_t* fs) {
     if (fs->state) {
         ret = lfs_unmount(&fs->instance);
         fs->state = false;
+#ifndef LFS_NO_MALLOC
+        s_fileBufferPoolEnabled = false;
+        s_readCache.clear();
+#endif /* LFS_NO_MALLOC */
     }
 
     return ret;
@@ -347,4 +416,72 @@ int filesystem_dump_info(filesystem_t* fs) {
 #endif /* DEBUG_BUILD */
 
     return 0;
-}
\ No newline at end of file
+}
+
+int filesystem_get_cache_config(filesystem_t* fs, filesystem_cache_config* config) {
+#ifndef LFS_NO_MALLOC
+    CHECK_TRUE(fs && config, SYSTEM_ERROR_INVALID_ARGUMENT);
+    FsLock lk(fs);
+    const size_t n = std::min<size_t>(config->size, sizeof(filesystem_cache_config));
+    memcpy(config, &s_cacheConfig, n);
+    config->size = n;
+    return 0;
+#else
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+#endif /* LFS_NO_MALLOC */
+}
+
+int filesystem_get_cache_stats(filesystem_t* fs, filesystem_cache_stats* stats) {
+#ifndef LFS_NO_MALLOC
+    CHECK_TRUE(fs && stats && stats->size >= sizeof(filesystem_cache_stats), SYSTEM_ERROR_INVALID_ARGUMENT);
+    FsLock lk(fs);
+    const auto& cache = s_readCache.stats();
+    const auto& pool = s_fileBufferPool.stats();
+    stats->size = sizeof(filesystem_cache_stats);
+    stats->hits = cache.hits;
+    stats->misses = cache.misses;
+    stats->bypassed = cache.bypassed;
+    stats->flash_reads = cache.flashReads;
+    stats->bytes_read = cache.bytesRead;
+    stats->file_buffers_allocated = pool.allocs;
+    stats->file_buffers_failed = pool.failed;
+    stats->file_buffers_max_used = pool.maxUsed;
+    return 0;
+#else
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+#endif /* LFS_NO_MALLOC */
+}
+
+int filesystem_reset_cache_stats(filesystem_t* fs) {
+#ifndef LFS_NO_MALLOC
+    CHECK_TRUE(fs, SYSTEM_ERROR_INVALID_ARGUMENT);
+    FsLock lk(fs);
+    s_readCache.resetStats();
+    s_fileBufferPool.resetStats();
+    return 0;
+#else
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+#endif /* LFS_NO_MALLOC */
+}
+
+#ifndef LFS_NO_MALLOC
+
+extern "C" void* filesystem_malloc(size_t size) {
+    /* littlefs is only called with the filesystem lock held */
+    void* p = nullptr;
+    if (s_fileBufferPoolEnabled) {
+        p = s_fileBufferPool.alloc(size);
+    }
+    if (!p) {
+        p = malloc(size);
+    }
+    return p;
+}
+
+extern "C" void filesystem_free(void* p) {
+    if (!s_fileBufferPool.free(p)) {
+        free(p);
+    }
+}
+
+#endif /* LFS_NO_MALLOC */
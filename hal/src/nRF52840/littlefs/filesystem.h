@@ -37,6 +37,20 @@ extern "C" {
 #define FILESYSTEM_BLOCK_COUNT  (sFLASH_PAGECOUNT / 2)
 #define FILESYSTEM_LOOKAHEAD    (128)
 
+/* Configuration of the read cache and file buffer pool. The filesystem is mounted early during
+ * HAL initialization, so a platform that needs a different configuration overrides these in its
+ * platform_config.h
+ */
+#ifndef FILESYSTEM_CACHE_LINE_SIZE
+#define FILESYSTEM_CACHE_LINE_SIZE      (512)
+#endif /* FILESYSTEM_CACHE_LINE_SIZE */
+#ifndef FILESYSTEM_CACHE_LINE_COUNT
+#define FILESYSTEM_CACHE_LINE_COUNT     (8)
+#endif /* FILESYSTEM_CACHE_LINE_COUNT */
+#ifndef FILESYSTEM_FILE_BUFFER_COUNT
+#define FILESYSTEM_FILE_BUFFER_COUNT    (4)
+#endif /* FILESYSTEM_FILE_BUFFER_COUNT */
+
 /* FIXME */
 typedef struct {
     uint16_t version;
@@ -55,11 +69,37 @@ typedef struct {
 #endif /* LFS_NO_MALLOC */
 } filesystem_t;
 
+typedef struct filesystem_cache_config {
+    uint16_t size; /* Size of this structure */
+    uint16_t read_size; /* Minimum size of a read operation */
+    uint16_t prog_size; /* Minimum size of a program operation */
+    uint16_t lookahead; /* Number of blocks tracked by the block allocator */
+    uint16_t cache_line_size; /* Size of a line of the read cache */
+    uint16_t cache_line_count; /* Number of lines of the read cache, or 0 to disable caching */
+    uint16_t file_buffer_count; /* Number of pooled buffers for the open files */
+} filesystem_cache_config;
+
+typedef struct filesystem_cache_stats {
+    uint16_t size; /* Size of this structure */
+    uint32_t hits; /* Number of cache lines found in the read cache */
+    uint32_t misses; /* Number of cache lines loaded from the flash */
+    uint32_t bypassed; /* Number of reads that bypassed the read cache */
+    uint32_t flash_reads; /* Number of reads from the flash */
+    uint32_t bytes_read; /* Number of bytes read from the flash */
+    uint32_t file_buffers_allocated; /* Number of file buffers allocated from the pool */
+    uint32_t file_buffers_failed; /* Number of file buffers allocated on the heap */
+    uint32_t file_buffers_max_used; /* Maximum number of pooled file buffers in use */
+} filesystem_cache_stats;
+
 int filesystem_mount(filesystem_t* fs);
 int filesystem_unmount(filesystem_t* fs);
 filesystem_t* filesystem_get_instance(void* reserved);
 int filesystem_dump_info(filesystem_t* fs);
 
+int filesystem_get_cache_config(filesystem_t* fs, filesystem_cache_config* config);
+int filesystem_get_cache_stats(filesystem_t* fs, filesystem_cache_stats* stats);
+int filesystem_reset_cache_stats(filesystem_t* fs);
+
 int filesystem_lock(filesystem_t* fs);
 int filesystem_unlock(filesystem_t* fs);
 
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "filesystem_cache.h"
+
+#include "system_error.h"
+#include "check.h"
+
+#include <algorithm>
+#include <new>
+#include <cstring>
+
+namespace particle {
+
+namespace fs {
+
+FlashReadCache::FlashReadCache() :
+        stats_(),
+        read_(nullptr),
+        lineSize_(0),
+        lineCount_(0),
+        useCount_(0) {
+}
+
+int FlashReadCache::init(size_t lineSize, size_t lineCount, ReadFunc read) {
+    CHECK_TRUE(read, SYSTEM_ERROR_INVALID_ARGUMENT);
+    CHECK_TRUE(lineSize && !(lineSize & (lineSize - 1)), SYSTEM_ERROR_INVALID_ARGUMENT);
+    destroy();
+    if (lineCount) {
+        lines_.reset(new(std::nothrow) Line[lineCount]());
+        data_.reset(new(std::nothrow) uint8_t[lineSize * lineCount]);
+        if (!lines_ || !data_) {
+            destroy();
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+    }
+    read_ = read;
+    lineSize_ = lineSize;
+    lineCount_ = lineCount;
+    return 0;
+}
+
+void FlashReadCache::destroy() {
+    lines_.reset();
+    data_.reset();
+    lineCount_ = 0;
+    useCount_ = 0;
+}
+
+int FlashReadCache::read(uintptr_t addr, uint8_t* data, size_t size) {
+    if (!lineCount_ || size > lineSize_) {
+        if (lineCount_) {
+            ++stats_.bypassed;
+        }
+        return readFlash(addr, data, size);
+    }
+    while (size > 0) {
+        const uintptr_t lineAddr = addr & ~(uintptr_t)(lineSize_ - 1);
+        const size_t offs = addr - lineAddr;
+        const size_t n = std::min(size, lineSize_ - offs);
+        auto line = findLine(lineAddr);
+        if (line) {
+            ++stats_.hits;
+        } else {
+            ++stats_.misses;
+            line = evictLine();
+            uint8_t* lineData = data_.get() + (line - lines_.get()) * lineSize_;
+            CHECK(readFlash(lineAddr, lineData, lineSize_));
+            line->addr = lineAddr;
+            line->valid = true;
+        }
+        line->lastUse = ++useCount_;
+        memcpy(data, data_.get() + (line - lines_.get()) * lineSize_ + offs, n);
+        addr += n;
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+void FlashReadCache::invalidate(uintptr_t addr, size_t size) {
+    for (size_t i = 0; i < lineCount_; ++i) {
+        auto& line = lines_[i];
+        if (line.valid && line.addr < addr + size && addr < line.addr + lineSize_) {
+            line.valid = false;
+        }
+    }
+}
+
+void FlashReadCache::clear() {
+    for (size_t i = 0; i < lineCount_; ++i) {
+        lines_[i].valid = false;
+    }
+}
+
+FlashReadCache::Line* FlashReadCache::findLine(uintptr_t addr) {
+    for (size_t i = 0; i < lineCount_; ++i) {
+        auto& line = lines_[i];
+        if (line.valid && line.addr == addr) {
+            return &line;
+        }
+    }
+    return nullptr;
+}
+
+FlashReadCache::Line* FlashReadCache::evictLine() {
+    Line* lru = &lines_[0];
+    for (size_t i = 0; i < lineCount_; ++i) {
+        auto& line = lines_[i];
+        if (!line.valid) {
+            return &line;
+        }
+        // The difference is used to compare the counters so that the order is preserved when the
+        // counter wraps around
+        if (useCount_ - line.lastUse > useCount_ - lru->lastUse) {
+            lru = &line;
+        }
+    }
+    lru->valid = false;
+    return lru;
+}
+
+int FlashReadCache::readFlash(uintptr_t addr, uint8_t* data, size_t size) {
+    ++stats_.flashReads;
+    stats_.bytesRead += size;
+    return read_(addr, data, size);
+}
+
+BufferPool::BufferPool() :
+        stats_(),
+        bufferSize_(0),
+        count_(0),
+        used_(0) {
+}
+
+int BufferPool::init(size_t bufferSize, size_t count) {
+    CHECK_TRUE(count <= MAX_BUFFER_COUNT, SYSTEM_ERROR_INVALID_ARGUMENT);
+    CHECK_FALSE(used_, SYSTEM_ERROR_INVALID_STATE);
+    // Keep the buffers word-aligned
+    bufferSize = (bufferSize + 3) & ~(size_t)3;
+    destroy();
+    if (count && bufferSize) {
+        mem_.reset(new(std::nothrow) uint8_t[bufferSize * count]);
+        CHECK_TRUE(mem_, SYSTEM_ERROR_NO_MEMORY);
+    }
+    bufferSize_ = bufferSize;
+    count_ = count;
+    return 0;
+}
+
+void BufferPool::destroy() {
+    mem_.reset();
+    count_ = 0;
+    used_ = 0;
+}
+
+void* BufferPool::alloc(size_t size) {
+    if (size <= bufferSize_) {
+        for (size_t i = 0; i < count_; ++i) {
+            if (!(used_ & (1u << i))) {
+                used_ |= (1u << i);
+                ++stats_.allocs;
+                stats_.maxUsed = std::max(stats_.maxUsed, usedCount());
+                return mem_.get() + i * bufferSize_;
+            }
+        }
+    }
+    ++stats_.failed;
+    return nullptr;
+}
+
+bool BufferPool::free(void* ptr) {
+    const auto p = (uint8_t*)ptr;
+    if (!count_ || p < mem_.get() || p >= mem_.get() + bufferSize_ * count_) {
+        return false;
+    }
+    used_ &= ~(1u << ((p - mem_.get()) / bufferSize_));
+    return true;
+}
+
+} // namespace fs
+
+} // namespace particle
@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace particle {
+
+namespace fs {
+
+/**
+ * Read cache for the flash device backing the filesystem.
+ *
+ * The cache consists of a number of lines, each holding an aligned chunk of the flash contents.
+ * When all lines are in use, the least recently used one is evicted. Reads that are larger than a
+ * line bypass the cache, so that bulk reads of file contents don't evict the frequently accessed
+ * metadata.
+ *
+ * The cache doesn't buffer writes. Cached lines are invalidated when the underlying flash is
+ * programmed or erased, so that the filesystem can validate the written data by reading it back
+ * from the flash.
+ */
+class FlashReadCache {
+public:
+    typedef int (*ReadFunc)(uintptr_t addr, uint8_t* data, size_t size);
+
+    struct Stats {
+        size_t hits; ///< Number of lines found in the cache.
+        size_t misses; ///< Number of lines loaded from the flash.
+        size_t bypassed; ///< Number of reads that bypassed the cache.
+        size_t flashReads; ///< Number of reads from the flash.
+        size_t bytesRead; ///< Number of bytes read from the flash.
+    };
+
+    FlashReadCache();
+
+    /**
+     * Initialize the cache.
+     *
+     * @param lineSize Size of a cache line. Must be a power of 2 and must not be larger than the
+     *        erase block of the flash.
+     * @param lineCount Number of cache lines, or 0 to disable caching.
+     * @param read Function reading the flash.
+     * @return 0 on success, otherwise an error code defined by `system_error_t`.
+     */
+    int init(size_t lineSize, size_t lineCount, ReadFunc read);
+
+    /**
+     * Release the memory allocated for the cache.
+     */
+    void destroy();
+
+    /**
+     * Read data.
+     *
+     * @param addr Flash address.
+     * @param data Destination buffer.
+     * @param size Number of bytes to read.
+     * @return 0 on success, otherwise an error code defined by `system_error_t`.
+     */
+    int read(uintptr_t addr, uint8_t* data, size_t size);
+
+    /**
+     * Invalidate the cached contents of a range of the flash.
+     *
+     * @param addr Flash address.
+     * @param size Size of the range.
+     */
+    void invalidate(uintptr_t addr, size_t size);
+
+    /**
+     * Invalidate all cached contents.
+     */
+    void clear();
+
+    const Stats& stats() const;
+    void resetStats();
+
+    size_t lineSize() const;
+    size_t lineCount() const;
+
+private:
+    struct Line {
+        uintptr_t addr;
+        uint32_t lastUse;
+        bool valid;
+    };
+
+    std::unique_ptr<Line[]> lines_;
+    std::unique_ptr<uint8_t[]> data_;
+    Stats stats_;
+    ReadFunc read_;
+    size_t lineSize_;
+    size_t lineCount_;
+    uint32_t useCount_;
+
+    Line* findLine(uintptr_t addr);
+    Line* evictLine();
+    int readFlash(uintptr_t addr, uint8_t* data, size_t size);
+};
+
+/**
+ * Pool of fixed-size buffers.
+ *
+ * The pool provides the caches of the open files, so that opening and closing files doesn't
+ * fragment the heap.
+ */
+class BufferPool {
+public:
+    /**
+     * Maximum number of buffers in the pool.
+     */
+    static constexpr size_t MAX_BUFFER_COUNT = 32;
+
+    struct Stats {
+        size_t allocs; ///< Number of allocated buffers.
+        size_t failed; ///< Number of allocations that couldn't be served by the pool.
+        size_t maxUsed; ///< Maximum number of buffers in use at the same time.
+    };
+
+    BufferPool();
+
+    /**
+     * Initialize the pool.
+     *
+     * @param bufferSize Size of a buffer.
+     * @param count Number of buffers.
+     * @return 0 on success, otherwise an error code defined by `system_error_t`.
+     */
+    int init(size_t bufferSize, size_t count);
+
+    /**
+     * Release the memory allocated for the pool.
+     *
+     * All buffers must have been freed.
+     */
+    void destroy();
+
+    /**
+     * Allocate a buffer.
+     *
+     * @param size Number of bytes needed.
+     * @return Buffer, or `nullptr` if the requested size is larger than the size of the pool's
+     *         buffers or all buffers are in use.
+     */
+    void* alloc(size_t size);
+
+    /**
+     * Free a buffer.
+     *
+     * @param ptr Buffer.
+     * @return `true` if the buffer belongs to the pool, otherwise `false`.
+     */
+    bool free(void* ptr);
+
+    const Stats& stats() const;
+    void resetStats();
+
+    size_t bufferSize() const;
+    size_t bufferCount() const;
+    size_t usedCount() const;
+
+private:
+    std::unique_ptr<uint8_t[]> mem_;
+    Stats stats_;
+    size_t bufferSize_;
+    size_t count_;
+    uint32_t used_; // Bitmask of the buffers in use
+};
+
+inline const FlashReadCache::Stats& FlashReadCache::stats() const {
+    return stats_;
+}
+
+inline void FlashReadCache::resetStats() {
+    stats_ = Stats();
+}
+
+inline size_t FlashReadCache::lineSize() const {
+    return lineSize_;
+}
+
+inline size_t FlashReadCache::lineCount() const {
+    return lineCount_;
+}
+
+inline const BufferPool::Stats& BufferPool::stats() const {
+    return stats_;
+}
+
+inline void BufferPool::resetStats() {
+    stats_ = Stats();
+}
+
+inline size_t BufferPool::bufferSize() const {
+    return bufferSize_;
+}
+
+inline size_t BufferPool::bufferCount() const {
+    return count_;
+}
+
+inline size_t BufferPool::usedCount() const {
+    return __builtin_popcount(used_);
+}
+
+} // namespace fs
+
+} // namespace particle
@@ -171,10 +171,16 @@ static inline uint32_t lfs_tole32(uint32_t a) {
 // Calculate CRC-32 with polynomial = 0x04c11db7
 void lfs_crc(uint32_t *crc, const void *buffer, size_t size);
 
+#ifndef LFS_NO_MALLOC
+// Allocate and free the buffers of the open files from a pool (see filesystem.cpp)
+void *filesystem_malloc(size_t size);
+void filesystem_free(void *p);
+#endif /* LFS_NO_MALLOC */
+
 // Allocate memory, only used if buffers are not provided to littlefs
 static inline void *lfs_malloc(size_t size) {
 #ifndef LFS_NO_MALLOC
-    return malloc(size);
+    return filesystem_malloc(size);
 #else
     (void)size;
     return NULL;
@@ -184,7 +190,7 @@ static inline void *lfs_malloc(size_t size) {
 // Deallocate memory, only used if buffers are not provided to littlefs
 static inline void lfs_free(void *p) {
 #ifndef LFS_NO_MALLOC
-    free(p);
+    filesystem_free(p);
 #else
     (void)p;
 #endif
@@ -86,6 +86,9 @@
 #define HAL_PLATFORM_BACKUP_RAM (1)
 
 #define HAL_PLATFORM_PACKET_BUFFER_FLOW_CONTROL_THRESHOLD (2)
+#define HAL_PLATFORM_PACKET_BUFFER_FLOW_CONTROL_RESUME_THRESHOLD (6)
+
+#define HAL_PLATFORM_PPP_FAST_INPUT (1)
 
 #define HAL_PLATFORM_COMPRESSED_OTA (1)
 
@@ -436,6 +436,14 @@ int validateModules(const hal_module_t* modules, size_t moduleCount) {
             SYSTEM_ERROR_MESSAGE("Unsupported compressed module"); // TODO
             return SYSTEM_ERROR_OTA_UNSUPPORTED_MODULE;
         }
+        if (info->flags & MODULE_INFO_FLAG_PATCH) {
+            // The patched module is reconstructed in a scratch area that only fits a user module
+            if (!HAL_PLATFORM_DELTA_OTA || moduleFunc != MODULE_FUNCTION_USER_PART || compressed || dropModuleInfo ||
+                    module->module_info_offset > 0) {
+                SYSTEM_ERROR_MESSAGE("Unsupported patch module");
+                return SYSTEM_ERROR_OTA_UNSUPPORTED_MODULE;
+            }
+        }
         if (moduleFunc == MODULE_FUNCTION_NCP_FIRMWARE) {
 #if HAL_PLATFORM_NCP_UPDATABLE
             const auto moduleNcp = module_mcu_target(info);
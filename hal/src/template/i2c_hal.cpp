@@ -68,6 +68,11 @@ uint8_t hal_i2c_end_transmission(hal_i2c_interface_t i2c, uint8_t stop,void* res
   return SYSTEM_ERROR_NONE;
 }
 
+int hal_i2c_end_transmission_ext(hal_i2c_interface_t i2c, uint8_t stop, void* reserved)
+{
+  return SYSTEM_ERROR_NONE;
+}
+
 uint32_t hal_i2c_write(hal_i2c_interface_t i2c, uint8_t data,void* reserved)
 {
   return SYSTEM_ERROR_NONE;
@@ -153,3 +158,13 @@ int32_t hal_i2c_unlock(hal_i2c_interface_t i2c, void* reserved)
 {
     return SYSTEM_ERROR_NOT_SUPPORTED;
 }
+
+int hal_i2c_queue_transaction(hal_i2c_interface_t i2c, hal_i2c_transaction_t* transaction, void* reserved)
+{
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+int hal_i2c_cancel_transactions(hal_i2c_interface_t i2c, void* reserved)
+{
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
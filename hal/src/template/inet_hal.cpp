@@ -33,6 +33,17 @@ int inet_gethostbyname(const char* hostname, uint16_t hostnameLen, HAL_IPAddress
     return 1;
 }
 
+int inet_gethostbyname_cached(const char* hostname, uint16_t hostnameLen, HAL_IPAddress* out_ip_addr,
+        network_interface_t nif, void* reserved)
+{
+    return inet_gethostbyname(hostname, hostnameLen, out_ip_addr, nif, reserved);
+}
+
+int inet_clear_dns_cache(void* reserved)
+{
+    return 0;
+}
+
 int inet_ping(const HAL_IPAddress* address, network_interface_t nif, uint8_t nTries,
         void* reserved)
 {
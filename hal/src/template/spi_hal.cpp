@@ -25,6 +25,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "spi_hal.h"
+#include "system_error.h"
 
 void hal_spi_init(hal_spi_interface_t spi)
 {
@@ -93,3 +94,11 @@ int32_t hal_spi_set_settings(hal_spi_interface_t spi, uint8_t set_default, uint8
 int hal_spi_sleep(hal_spi_interface_t spi, bool sleep, void* reserved) {
     return 0;
 }
+
+int hal_spi_queue_transaction(hal_spi_interface_t spi, hal_spi_transaction_t* transaction, void* reserved) {
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+int hal_spi_cancel_transactions(hal_spi_interface_t spi, void* reserved) {
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
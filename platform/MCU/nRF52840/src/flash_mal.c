@@ -34,6 +34,8 @@
 #include "exflash_hal.h"
 #include "hal_platform.h"
 #include "inflate.h"
+#include "module_patch.h"
+#include "flash_copy.h"
 #include "nrf_mbr.h"
 #include "check.h"
 
@@ -44,6 +46,13 @@
 #define HAS_COMPRESSED_OTA 0
 #endif
 
+// Same for patch modules. The patched module is reconstructed in the external flash
+#if (HAL_PLATFORM_DELTA_OTA) && (MODULE_FUNCTION == MOD_FUNC_BOOTLOADER) && defined(USE_SERIAL_FLASH)
+#define HAS_DELTA_OTA 1
+#else
+#define HAS_DELTA_OTA 0
+#endif
+
 #if MODULE_FUNCTION == MOD_FUNC_BOOTLOADER
 #define SOFTDEVICE_MBR_UPDATES 1
 #else
@@ -108,6 +117,153 @@ static bool flash_copy(flash_device_t src_dev, uintptr_t src_addr, flash_device_
     return true;
 }
 
+static int internal_flash_read(uintptr_t addr, uint8_t* data, size_t size, void* user_data) {
+    return (hal_flash_read(addr, data, size) == 0) ? 0 : SYSTEM_ERROR_FLASH_IO;
+}
+
+static int internal_flash_write(uintptr_t addr, const uint8_t* data, size_t size, void* user_data) {
+    return (hal_flash_write(addr, data, size) == 0) ? 0 : SYSTEM_ERROR_FLASH_IO;
+}
+
+static int internal_flash_erase(uintptr_t addr, size_t sector_count, void* user_data) {
+    return (hal_flash_erase_sector(addr, sector_count) == 0) ? 0 : SYSTEM_ERROR_FLASH_IO;
+}
+
+static const flash_copy_device internal_flash_device = {
+    .read = internal_flash_read,
+    .write = internal_flash_write,
+    .erase = internal_flash_erase,
+    .sector_size = INTERNAL_FLASH_PAGE_SIZE,
+    .user_data = NULL
+};
+
+#ifdef USE_SERIAL_FLASH
+
+static int external_flash_read(uintptr_t addr, uint8_t* data, size_t size, void* user_data) {
+    return (hal_exflash_read(addr, data, size) == 0) ? 0 : SYSTEM_ERROR_FLASH_IO;
+}
+
+static int external_flash_write(uintptr_t addr, const uint8_t* data, size_t size, void* user_data) {
+    return (hal_exflash_write(addr, data, size) == 0) ? 0 : SYSTEM_ERROR_FLASH_IO;
+}
+
+static int external_flash_erase(uintptr_t addr, size_t sector_count, void* user_data) {
+    return (hal_exflash_erase_sector(addr, sector_count) == 0) ? 0 : SYSTEM_ERROR_FLASH_IO;
+}
+
+static const flash_copy_device external_flash_device = {
+    .read = external_flash_read,
+    .write = external_flash_write,
+    .erase = external_flash_erase,
+    .sector_size = sFLASH_PAGESIZE,
+    .user_data = NULL
+};
+
+#endif // USE_SERIAL_FLASH
+
+static const flash_copy_device* get_flash_copy_device(flash_device_t dev) {
+    switch (dev) {
+    case FLASH_INTERNAL:
+        return &internal_flash_device;
+#ifdef USE_SERIAL_FLASH
+    case FLASH_SERIAL:
+        return &external_flash_device;
+#endif // USE_SERIAL_FLASH
+    default:
+        return NULL;
+    }
+}
+
+static uint32_t update_crc32(const uint8_t* data, size_t size, uint32_t crc) {
+    return Compute_CRC32(data, size, &crc);
+}
+
+// Reads the module once to verify its CRC and to find the destination sectors that need to be
+// updated. Nothing is modified until flash_copy_commit() is called
+static int prepare_module_copy(flash_copy_ctx* copy, flash_device_t src_dev, uint32_t* src_addr, uint32_t* length,
+        flash_device_t dest_dev, uint32_t dest_addr, uint8_t* flags) {
+    const flash_copy_device* src = get_flash_copy_device(src_dev);
+    const flash_copy_device* dest = get_flash_copy_device(dest_dev);
+    if (!src || !dest) {
+        return FLASH_ACCESS_RESULT_BADARG;
+    }
+    uint32_t info_offset = 0;
+    module_info_t info = {};
+    bool has_info = false;
+    if (*flags & MODULE_VERIFY_MASK) {
+        has_info = (FLASH_ModuleInfo(&info, src_dev, *src_addr, &info_offset) == SYSTEM_ERROR_NONE);
+    }
+    // XXX: Device OS versions < 2.0.0 may not be setting this flag in the module slots!
+    // Bootloader should rely on the actual flags within the module header!
+    if (!(*flags & MODULE_DROP_MODULE_INFO) && (*flags & MODULE_VERIFY_MASK)) {
+        // We may only check the module header if we've been asked to verify it
+        if (!has_info) {
+            return FLASH_ACCESS_RESULT_ERROR;
+        }
+        if (info.flags & MODULE_INFO_FLAG_DROP_MODULE_INFO) {
+            // NB: We have corner cases where the module info is not located in the
+            // front of the module but for example after the vector table and we
+            // only want to enable this feature in the case it is in the front,
+            // hence the module_info_t located at the the source address check.
+            if (info_offset == 0) {
+                // Skip module header
+                *flags |= MODULE_DROP_MODULE_INFO;
+            } else {
+                return FLASH_ACCESS_RESULT_ERROR;
+            }
+        }
+    }
+    size_t crc_size = 0;
+    uint32_t crc = 0;
+    uint32_t expected_crc = 0;
+    if (*flags & MODULE_VERIFY_CRC) {
+        if (!has_info) {
+            return FLASH_ACCESS_RESULT_BADARG;
+        }
+        crc_size = (uintptr_t)info.module_end_address - (uintptr_t)info.module_start_address;
+        if (crc_size == 0 || *length < crc_size + 4) {
+            return FLASH_ACCESS_RESULT_BADARG;
+        }
+        uint8_t crc_buf[4];
+        if (!flash_read(src_dev, *src_addr + crc_size, crc_buf, sizeof(crc_buf))) {
+            return FLASH_ACCESS_RESULT_ERROR;
+        }
+        expected_crc = ((uint32_t)crc_buf[0] << 24) | ((uint32_t)crc_buf[1] << 16) | ((uint32_t)crc_buf[2] << 8) | crc_buf[3];
+    }
+    if (*flags & MODULE_DROP_MODULE_INFO) {
+        // Skip the module info header
+        if (*length < sizeof(module_info_t)) { // Sanity check
+            return FLASH_ACCESS_RESULT_BADARG;
+        }
+        if (*flags & MODULE_VERIFY_CRC) {
+            // The module info header is covered by the CRC but not copied
+            if (crc_size < sizeof(module_info_t)) {
+                return FLASH_ACCESS_RESULT_BADARG;
+            }
+            if (!flash_read(src_dev, *src_addr, (uint8_t*)&info, sizeof(module_info_t))) {
+                return FLASH_ACCESS_RESULT_ERROR;
+            }
+            crc = Compute_CRC32((const uint8_t*)&info, sizeof(module_info_t), NULL);
+            crc_size -= sizeof(module_info_t);
+        }
+        *src_addr += sizeof(module_info_t);
+        *length -= sizeof(module_info_t);
+    }
+    if (flash_copy_init(copy, src, *src_addr, dest, dest_addr, *length) != 0) {
+        return FLASH_ACCESS_RESULT_BADARG;
+    }
+    if ((*flags & MODULE_VERIFY_CRC) && flash_copy_set_crc(copy, update_crc32, crc_size, crc) != 0) {
+        return FLASH_ACCESS_RESULT_ERROR;
+    }
+    if (flash_copy_prepare(copy) != 0) {
+        return FLASH_ACCESS_RESULT_ERROR;
+    }
+    if ((*flags & MODULE_VERIFY_CRC) && flash_copy_crc(copy) != expected_crc) {
+        return FLASH_ACCESS_RESULT_BADARG;
+    }
+    return FLASH_ACCESS_RESULT_OK;
+}
+
 static bool verify_module(flash_device_t src_dev, uintptr_t src_addr, size_t src_size, flash_device_t dest_dev,
         uintptr_t dest_addr, size_t dest_size, uint8_t module_func, uint8_t flags) {
     if (!FLASH_CheckValidAddressRange(src_dev, src_addr, src_size)) {
@@ -119,6 +275,9 @@ static bool verify_module(flash_device_t src_dev, uintptr_t src_addr, size_t src
     if ((flags & MODULE_COMPRESSED) && !HAS_COMPRESSED_OTA) {
         return false;
     }
+    if ((flags & MODULE_PATCH) && !HAS_DELTA_OTA) {
+        return false;
+    }
     if (flags & MODULE_VERIFY_MASK) {
         uintptr_t module_info_start_addr = 0;
         size_t module_info_size = 0;
@@ -188,16 +347,11 @@ static int inflate_output_callback(const char* data, size_t size, void* user_dat
     return size;
 }
 
-static bool flash_decompress(flash_device_t src_dev, uintptr_t src_addr, size_t src_size, flash_device_t dest_dev,
-        uintptr_t dest_addr, size_t dest_size) {
+static bool flash_inflate(flash_device_t src_dev, uintptr_t src_addr, size_t src_size, inflate_output output,
+        void* user_data, const inflate_opts* opts) {
     uint8_t in_buf[COPY_BLOCK_SIZE];
-    inflate_output_ctx out = {};
-    out.buf_offs = 0;
-    out.flash_dev = dest_dev;
-    out.flash_addr = dest_addr;
-    out.flash_end_addr = dest_addr + dest_size;
     inflate_ctx* infl = NULL;
-    int r = inflate_create(&infl, NULL, inflate_output_callback, &out);
+    int r = inflate_create(&infl, opts, output, user_data);
     if (r != 0) {
         goto error;
     }
@@ -228,21 +382,31 @@ static bool flash_decompress(flash_device_t src_dev, uintptr_t src_addr, size_t
         goto error;
     }
 done:
+    inflate_destroy(infl);
+    return true;
+error:
+    inflate_destroy(infl);
+    return false;
+}
+
+static bool flash_decompress(flash_device_t src_dev, uintptr_t src_addr, size_t src_size, flash_device_t dest_dev,
+        uintptr_t dest_addr, size_t dest_size) {
+    inflate_output_ctx out = {};
+    out.buf_offs = 0;
+    out.flash_dev = dest_dev;
+    out.flash_addr = dest_addr;
+    out.flash_end_addr = dest_addr + dest_size;
+    if (!flash_inflate(src_dev, src_addr, src_size, inflate_output_callback, &out, NULL)) {
+        return false;
+    }
     if (out.buf_offs > 0) {
         // Flush the output buffer
         if (!flash_write(dest_dev, out.flash_addr, out.buf, out.buf_offs)) {
-            goto error;
+            return false;
         }
         out.flash_addr += out.buf_offs;
     }
-    if (out.flash_addr != out.flash_end_addr) {
-        goto error;
-    }
-    inflate_destroy(infl);
-    return true;
-error:
-    inflate_destroy(infl);
-    return false;
+    return out.flash_addr == out.flash_end_addr;
 }
 
 static bool parse_compressed_module_header(flash_device_t dev, uintptr_t addr, size_t size, compressed_module_header* header) {
@@ -263,6 +427,174 @@ static bool parse_compressed_module_header(flash_device_t dev, uintptr_t addr, s
 
 #endif // HAS_COMPRESSED_OTA
 
+#if HAS_DELTA_OTA
+
+// The reserved area is only used when updating the bootloader, which is always done last
+#define PATCH_SCRATCH_ADDRESS EXTERNAL_FLASH_RESERVED_ADDRESS
+#define PATCH_SCRATCH_LENGTH EXTERNAL_FLASH_RESERVED_LENGTH
+
+typedef struct patch_io_ctx {
+    flash_device_t base_dev;
+    uintptr_t base_addr;
+    uintptr_t target_addr;
+} patch_io_ctx;
+
+static int patch_read_callback(size_t offset, char* data, size_t size, void* user_data) {
+    patch_io_ctx* io = (patch_io_ctx*)user_data;
+    if (!flash_read(io->base_dev, io->base_addr + offset, (uint8_t*)data, size)) {
+        return SYSTEM_ERROR_FLASH_IO;
+    }
+    return 0;
+}
+
+static int patch_write_callback(const char* data, size_t size, void* user_data) {
+    patch_io_ctx* io = (patch_io_ctx*)user_data;
+    if (!flash_write(FLASH_SERIAL, io->target_addr, (const uint8_t*)data, size)) {
+        return SYSTEM_ERROR_FLASH_IO;
+    }
+    io->target_addr += size;
+    return 0;
+}
+
+#if HAS_COMPRESSED_OTA
+
+static int patch_inflate_output_callback(const char* data, size_t size, void* user_data) {
+    module_patch_ctx* patch = (module_patch_ctx*)user_data;
+    int r = module_patch_input(patch, data, size);
+    if (r < 0) {
+        return r;
+    }
+    return size;
+}
+
+#endif // HAS_COMPRESSED_OTA
+
+static bool flash_crc32(flash_device_t dev, uintptr_t addr, size_t size, uint32_t* crc) {
+    uint8_t buf[COPY_BLOCK_SIZE];
+    uint32_t c = 0;
+    const uintptr_t end_addr = addr + size;
+    while (addr < end_addr) {
+        size_t n = end_addr - addr;
+        if (n > sizeof(buf)) {
+            n = sizeof(buf);
+        }
+        if (!flash_read(dev, addr, buf, n)) {
+            return false;
+        }
+        c = Compute_CRC32(buf, n, &c);
+        addr += n;
+    }
+    *crc = c;
+    return true;
+}
+
+static bool flash_patch(flash_device_t src_dev, uintptr_t src_addr, size_t src_size, flash_device_t base_dev,
+        uintptr_t base_addr, const patch_module_header* header) {
+    uint32_t crc = 0;
+    if (!flash_crc32(base_dev, base_addr, header->base_size, &crc)) {
+        return false;
+    }
+    if (crc != header->base_crc) {
+        // The device may have been reset while the patched module was being copied to its
+        // destination, in which case the installed module is no longer intact but the patched
+        // module can still be found in the scratch area
+        return flash_crc32(FLASH_SERIAL, PATCH_SCRATCH_ADDRESS, header->target_size, &crc) &&
+                crc == header->target_crc;
+    }
+    if (!FLASH_EraseMemory(FLASH_SERIAL, PATCH_SCRATCH_ADDRESS, header->target_size)) {
+        return false;
+    }
+    patch_io_ctx io = {};
+    io.base_dev = base_dev;
+    io.base_addr = base_addr;
+    io.target_addr = PATCH_SCRATCH_ADDRESS;
+    module_patch_ctx patch;
+    if (module_patch_init(&patch, header->base_size, header->target_size, patch_read_callback,
+            patch_write_callback, &io) != 0) {
+        return false;
+    }
+    bool ok = false;
+#if HAS_COMPRESSED_OTA
+    if (header->compression != 0) {
+        inflate_opts opts = {};
+        opts.window_bits = header->window_bits;
+        ok = flash_inflate(src_dev, src_addr, src_size, patch_inflate_output_callback, &patch, &opts);
+    } else
+#endif // HAS_COMPRESSED_OTA
+    {
+        ok = true;
+        uint8_t buf[COPY_BLOCK_SIZE];
+        const uintptr_t src_end_addr = src_addr + src_size;
+        while (src_addr < src_end_addr) {
+            size_t n = src_end_addr - src_addr;
+            if (n > sizeof(buf)) {
+                n = sizeof(buf);
+            }
+            if (!flash_read(src_dev, src_addr, buf, n) || module_patch_input(&patch, (const char*)buf, n) != 0) {
+                ok = false;
+                break;
+            }
+            src_addr += n;
+        }
+    }
+    if (!ok) {
+        return false;
+    }
+    if (module_patch_finish(&patch) != 0) {
+        return false;
+    }
+    // Verify what has actually been written to flash
+    return flash_crc32(FLASH_SERIAL, PATCH_SCRATCH_ADDRESS, header->target_size, &crc) && crc == header->target_crc;
+}
+
+static bool parse_patch_module_header(flash_device_t dev, uintptr_t addr, size_t size, patch_module_header* header) {
+    if (size < sizeof(module_info_t) + sizeof(patch_module_header)) {
+        return false;
+    }
+    if (!flash_read(dev, addr + sizeof(module_info_t), (uint8_t*)header, sizeof(patch_module_header))) {
+        return false;
+    }
+    if (header->size < sizeof(patch_module_header) || size < sizeof(module_info_t) + header->size) {
+        return false;
+    }
+    if (header->method != MODULE_PATCH_METHOD_SEQUENTIAL) {
+        return false;
+    }
+    if (header->compression != 0 && (header->compression != 1 /* Raw Deflate */ || !HAS_COMPRESSED_OTA)) {
+        return false;
+    }
+    if (header->target_size == 0 || header->target_size > PATCH_SCRATCH_LENGTH) {
+        return false;
+    }
+    return true;
+}
+
+#endif // HAS_DELTA_OTA
+
+#if HAS_COMPRESSED_OTA || HAS_DELTA_OTA
+
+// Determines the location of the payload of a compressed or patch module. The payload is followed
+// by the module suffix and CRC-32
+static int get_module_payload(flash_device_t dev, uint32_t* addr, uint32_t* length, size_t header_size) {
+    if (*length < sizeof(module_info_t) + header_size + 2 /* Prefix size */ + 4 /* CRC-32 */) { // Sanity check
+        return FLASH_ACCESS_RESULT_BADARG;
+    }
+    *addr += sizeof(module_info_t) + header_size;
+    *length -= sizeof(module_info_t) + header_size + 4;
+    // Determine where the payload ends
+    uint16_t prefix_size = 0;
+    if (!flash_read(dev, *addr + *length - 2, (uint8_t*)&prefix_size, 2)) {
+        return FLASH_ACCESS_RESULT_ERROR;
+    }
+    if (*length < prefix_size) {
+        return FLASH_ACCESS_RESULT_BADARG;
+    }
+    *length -= prefix_size;
+    return FLASH_ACCESS_RESULT_OK;
+}
+
+#endif // HAS_COMPRESSED_OTA || HAS_DELTA_OTA
+
 bool FLASH_CheckValidAddressRange(flash_device_t flashDeviceID, uint32_t startAddress, uint32_t length)
 {
     // FIXME: remove magic numbers
@@ -347,6 +679,16 @@ int FLASH_CheckCopyMemory(flash_device_t sourceDeviceID, uint32_t sourceAddress,
 #else
         return FLASH_ACCESS_RESULT_BADARG;
 #endif // !HAS_COMPRESSED_OTA
+    } else if (flags & MODULE_PATCH) {
+#if HAS_DELTA_OTA
+        patch_module_header header = { 0 };
+        if (!parse_patch_module_header(sourceDeviceID, sourceAddress, length, &header)) {
+            return FLASH_ACCESS_RESULT_ERROR;
+        }
+        dest_size = header.target_size;
+#else
+        return FLASH_ACCESS_RESULT_BADARG;
+#endif // !HAS_DELTA_OTA
     }
     if (!verify_module(sourceDeviceID, sourceAddress, length, destinationDeviceID, destinationAddress, dest_size,
             module_function, flags)) {
@@ -369,10 +711,47 @@ int FLASH_CopyMemory(flash_device_t sourceDeviceID, uint32_t sourceAddress,
         dest_size = comp_header.original_size;
     }
 #endif // HAS_COMPRESSED_OTA
+#if HAS_DELTA_OTA
+    patch_module_header patch_header = { 0 };
+    if (flags & MODULE_PATCH) {
+        if (!parse_patch_module_header(sourceDeviceID, sourceAddress, length, &patch_header)) {
+            return FLASH_ACCESS_RESULT_ERROR;
+        }
+        dest_size = patch_header.target_size;
+    }
+#endif // HAS_DELTA_OTA
+    // The CRC of a module that is copied as is gets verified while the module is being compared
+    // with the destination
+    const bool plain_copy = !(flags & (MODULE_COMPRESSED | MODULE_PATCH));
     if (!verify_module(sourceDeviceID, sourceAddress, length, destinationDeviceID, destinationAddress, dest_size,
-            module_function, flags)) {
+            module_function, plain_copy ? (flags & ~MODULE_VERIFY_CRC) : flags)) {
         return FLASH_ACCESS_RESULT_BADARG;
     }
+#if HAS_DELTA_OTA
+    if (flags & MODULE_PATCH) {
+        // Reconstruct and verify the patched module before the installed one is erased. The patched
+        // module is then installed like a regular module
+        int r = get_module_payload(sourceDeviceID, &sourceAddress, &length, patch_header.size);
+        if (r != FLASH_ACCESS_RESULT_OK) {
+            return r;
+        }
+        if (!flash_patch(sourceDeviceID, sourceAddress, length, destinationDeviceID, destinationAddress, &patch_header)) {
+            return FLASH_ACCESS_RESULT_ERROR;
+        }
+        sourceDeviceID = FLASH_SERIAL;
+        sourceAddress = PATCH_SCRATCH_ADDRESS;
+        length = dest_size;
+        flags &= ~(MODULE_PATCH | MODULE_DROP_MODULE_INFO);
+    }
+#endif // HAS_DELTA_OTA
+    flash_copy_ctx copy = {};
+    if (!(flags & MODULE_COMPRESSED)) {
+        int r = prepare_module_copy(&copy, sourceDeviceID, &sourceAddress, &length, destinationDeviceID,
+                destinationAddress, &flags);
+        if (r != FLASH_ACCESS_RESULT_OK) {
+            return r;
+        }
+    }
 #if SOFTDEVICE_MBR_UPDATES
     if (module_function == MODULE_FUNCTION_BOOTLOADER && destinationAddress == USER_FIRMWARE_IMAGE_LOCATION_COMPAT) {
         // Backup user firmware
@@ -398,29 +777,24 @@ int FLASH_CopyMemory(flash_device_t sourceDeviceID, uint32_t sourceAddress,
         if (!FLASH_EraseMemory(destinationDeviceID, USER_FIRMWARE_IMAGE_LOCATION_COMPAT, INTERNAL_FLASH_PAGE_SIZE)) {
             return FLASH_ACCESS_RESULT_ERROR;
         }
+        // The compat application may overlap with the module being installed
+        if (!(flags & MODULE_COMPRESSED) && flash_copy_invalidate(&copy, USER_FIRMWARE_IMAGE_LOCATION_COMPAT,
+                INTERNAL_FLASH_PAGE_SIZE) != 0) {
+            return FLASH_ACCESS_RESULT_ERROR;
+        }
     }
 #endif // MODULAR_FIRMWARE
 
-    if (!FLASH_EraseMemory(destinationDeviceID, destinationAddress, dest_size)) {
-        return FLASH_ACCESS_RESULT_ERROR;
-    }
     if (flags & MODULE_COMPRESSED) {
 #if HAS_COMPRESSED_OTA
-        // Skip the module info and compressed data headers
-        if (length < sizeof(module_info_t) + comp_header.size + 2 /* Prefix size */ + 4 /* CRC-32 */) { // Sanity check
-            return FLASH_ACCESS_RESULT_BADARG;
-        }
-        sourceAddress += sizeof(module_info_t) + comp_header.size;
-        length -= sizeof(module_info_t) + comp_header.size + 4;
-        // Determine where the compressed data ends
-        uint16_t prefix_size = 0;
-        if (!flash_read(sourceDeviceID, sourceAddress + length - 2, (uint8_t*)&prefix_size, 2)) {
+        if (!FLASH_EraseMemory(destinationDeviceID, destinationAddress, dest_size)) {
             return FLASH_ACCESS_RESULT_ERROR;
         }
-        if (length < prefix_size) {
-            return FLASH_ACCESS_RESULT_BADARG;
+        // Skip the module info and compressed data headers
+        int r = get_module_payload(sourceDeviceID, &sourceAddress, &length, comp_header.size);
+        if (r != FLASH_ACCESS_RESULT_OK) {
+            return r;
         }
-        length -= prefix_size;
         if (!flash_decompress(sourceDeviceID, sourceAddress, length, destinationDeviceID, destinationAddress, dest_size)) {
             return FLASH_ACCESS_RESULT_ERROR;
         }
@@ -428,37 +802,8 @@ int FLASH_CopyMemory(flash_device_t sourceDeviceID, uint32_t sourceAddress,
         return FLASH_ACCESS_RESULT_BADARG;
 #endif // !HAS_COMPRESSED_OTA
     } else {
-        // XXX: Device OS versions < 2.0.0 may not be setting this flag in the module slots!
-        // Bootloader should rely on the actual flags within the module header!
-        if (!(flags & MODULE_DROP_MODULE_INFO) && (flags & MODULE_VERIFY_MASK)) {
-            // We may only check the module header if we've been asked to verify it
-            uint32_t infoOffset = 0;
-            module_info_t info = {};
-            if (FLASH_ModuleInfo(&info, sourceDeviceID, sourceAddress, &infoOffset) != SYSTEM_ERROR_NONE) {
-                return FLASH_ACCESS_RESULT_ERROR;
-            }
-            if (info.flags & MODULE_INFO_FLAG_DROP_MODULE_INFO) {
-                // NB: We have corner cases where the module info is not located in the
-                // front of the module but for example after the vector table and we
-                // only want to enable this feature in the case it is in the front,
-                // hence the module_info_t located at the the source address check.
-                if (infoOffset == 0) {
-                    // Skip module header
-                    flags |= MODULE_DROP_MODULE_INFO;
-                } else {
-                    return FLASH_ACCESS_RESULT_ERROR;
-                }
-            }
-        }
-        if (flags & MODULE_DROP_MODULE_INFO) {
-            // Skip the module info header
-            if (length < sizeof(module_info_t)) { // Sanity check
-                return FLASH_ACCESS_RESULT_BADARG;
-            }
-            sourceAddress += sizeof(module_info_t);
-            length -= sizeof(module_info_t);
-        }
-        if (!flash_copy(sourceDeviceID, sourceAddress, destinationDeviceID, destinationAddress, length)) {
+        // Only the sectors that differ from the module are erased and programmed
+        if (flash_copy_commit(&copy) != 0) {
             return FLASH_ACCESS_RESULT_ERROR;
         }
     }
@@ -48,3 +48,4 @@ gen_proto "${SHARED_DIR}/cloud/cloud.proto"
 
 # Internal definitions
 gen_proto "${INTERNAL_DIR}/network_config.proto"
+gen_proto "${INTERNAL_DIR}/firmware_update.proto"
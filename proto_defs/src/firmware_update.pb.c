@@ -0,0 +1,21 @@
+/* Automatically generated nanopb constant definitions */
+/* Generated by nanopb-0.4.5 */
+
+#include "firmware_update.pb.h"
+#if PB_PROTO_HEADER_VERSION != 40
+#error Regenerate this file with the current version of nanopb generator.
+#endif
+
+PB_BIND(particle_firmware_StartFirmwareUpdateRequestExt, particle_firmware_StartFirmwareUpdateRequestExt, AUTO)
+
+
+PB_BIND(particle_firmware_StartFirmwareUpdateReplyExt, particle_firmware_StartFirmwareUpdateReplyExt, AUTO)
+
+
+PB_BIND(particle_firmware_FirmwareUpdateDataRequestExt, particle_firmware_FirmwareUpdateDataRequestExt, AUTO)
+
+
+PB_BIND(particle_firmware_FirmwareUpdateDataReplyExt, particle_firmware_FirmwareUpdateDataReplyExt, AUTO)
+
+
+
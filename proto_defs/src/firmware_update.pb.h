@@ -0,0 +1,96 @@
+/* Automatically generated nanopb header */
+/* Generated by nanopb-0.4.5 */
+
+#ifndef PB_PARTICLE_FIRMWARE_FIRMWARE_UPDATE_PB_H_INCLUDED
+#define PB_PARTICLE_FIRMWARE_FIRMWARE_UPDATE_PB_H_INCLUDED
+#include <pb.h>
+
+#if PB_PROTO_HEADER_VERSION != 40
+#error Regenerate this file with the current version of nanopb generator.
+#endif
+
+/* Struct definitions */
+/* Fields of particle.ctrl.StartFirmwareUpdateRequest */
+typedef struct _particle_firmware_StartFirmwareUpdateRequestExt { 
+    uint32_t max_pending_chunks; /* Maximum number of data requests the host is going to keep in flight */
+} particle_firmware_StartFirmwareUpdateRequestExt;
+
+/* Fields of particle.ctrl.StartFirmwareUpdateReply */
+typedef struct _particle_firmware_StartFirmwareUpdateReplyExt { 
+    uint32_t max_pending_chunks; /* Maximum number of data requests that can be in flight */
+} particle_firmware_StartFirmwareUpdateReplyExt;
+
+/* Fields of particle.ctrl.FirmwareUpdateDataRequest */
+typedef struct _particle_firmware_FirmwareUpdateDataRequestExt { 
+    uint32_t offset; /* Offset of the chunk in the firmware binary */
+} particle_firmware_FirmwareUpdateDataRequestExt;
+
+/* Fields of particle.ctrl.FirmwareUpdateDataReply */
+typedef struct _particle_firmware_FirmwareUpdateDataReplyExt { 
+    uint32_t bytes_written; /* Number of bytes written to the OTA section */
+} particle_firmware_FirmwareUpdateDataReplyExt;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Initializer values for message structs */
+#define particle_firmware_StartFirmwareUpdateRequestExt_init_default {0}
+#define particle_firmware_StartFirmwareUpdateReplyExt_init_default {0}
+#define particle_firmware_FirmwareUpdateDataRequestExt_init_default {0}
+#define particle_firmware_FirmwareUpdateDataReplyExt_init_default {0}
+#define particle_firmware_StartFirmwareUpdateRequestExt_init_zero {0}
+#define particle_firmware_StartFirmwareUpdateReplyExt_init_zero {0}
+#define particle_firmware_FirmwareUpdateDataRequestExt_init_zero {0}
+#define particle_firmware_FirmwareUpdateDataReplyExt_init_zero {0}
+
+/* Field tags (for use in manual encoding/decoding) */
+#define particle_firmware_StartFirmwareUpdateRequestExt_max_pending_chunks_tag 3
+#define particle_firmware_StartFirmwareUpdateReplyExt_max_pending_chunks_tag 2
+#define particle_firmware_FirmwareUpdateDataRequestExt_offset_tag 2
+#define particle_firmware_FirmwareUpdateDataReplyExt_bytes_written_tag 1
+
+/* Struct field encoding specification for nanopb */
+#define particle_firmware_StartFirmwareUpdateRequestExt_FIELDLIST(X, a) \
+X(a, STATIC,   SINGULAR, UINT32,   max_pending_chunks,   3)
+#define particle_firmware_StartFirmwareUpdateRequestExt_CALLBACK NULL
+#define particle_firmware_StartFirmwareUpdateRequestExt_DEFAULT NULL
+
+#define particle_firmware_StartFirmwareUpdateReplyExt_FIELDLIST(X, a) \
+X(a, STATIC,   SINGULAR, UINT32,   max_pending_chunks,   2)
+#define particle_firmware_StartFirmwareUpdateReplyExt_CALLBACK NULL
+#define particle_firmware_StartFirmwareUpdateReplyExt_DEFAULT NULL
+
+#define particle_firmware_FirmwareUpdateDataRequestExt_FIELDLIST(X, a) \
+X(a, STATIC,   SINGULAR, UINT32,   offset,            2)
+#define particle_firmware_FirmwareUpdateDataRequestExt_CALLBACK NULL
+#define particle_firmware_FirmwareUpdateDataRequestExt_DEFAULT NULL
+
+#define particle_firmware_FirmwareUpdateDataReplyExt_FIELDLIST(X, a) \
+X(a, STATIC,   SINGULAR, UINT32,   bytes_written,     1)
+#define particle_firmware_FirmwareUpdateDataReplyExt_CALLBACK NULL
+#define particle_firmware_FirmwareUpdateDataReplyExt_DEFAULT NULL
+
+extern const pb_msgdesc_t particle_firmware_StartFirmwareUpdateRequestExt_msg;
+extern const pb_msgdesc_t particle_firmware_StartFirmwareUpdateReplyExt_msg;
+extern const pb_msgdesc_t particle_firmware_FirmwareUpdateDataRequestExt_msg;
+extern const pb_msgdesc_t particle_firmware_FirmwareUpdateDataReplyExt_msg;
+
+/* Defines for backwards compatibility with code written before nanopb-0.4.0 */
+#define particle_firmware_StartFirmwareUpdateRequestExt_fields &particle_firmware_StartFirmwareUpdateRequestExt_msg
+#define particle_firmware_StartFirmwareUpdateReplyExt_fields &particle_firmware_StartFirmwareUpdateReplyExt_msg
+#define particle_firmware_FirmwareUpdateDataRequestExt_fields &particle_firmware_FirmwareUpdateDataRequestExt_msg
+#define particle_firmware_FirmwareUpdateDataReplyExt_fields &particle_firmware_FirmwareUpdateDataReplyExt_msg
+
+/* Maximum encoded size of messages (where known) */
+#define particle_firmware_FirmwareUpdateDataReplyExt_size 6
+#define particle_firmware_FirmwareUpdateDataRequestExt_size 6
+#define particle_firmware_StartFirmwareUpdateReplyExt_size 6
+#define particle_firmware_StartFirmwareUpdateRequestExt_size 6
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
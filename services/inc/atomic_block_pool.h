@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+/**
+ * Pool of fixed-size memory blocks.
+ *
+ * The allocation state is kept in a bitmap that is updated atomically, so blocks can be allocated
+ * and freed from any thread or an ISR without locking.
+ *
+ * @tparam BlockSize Block size.
+ * @tparam BlockCount Number of blocks (32 at most).
+ */
+template<size_t BlockSize, size_t BlockCount>
+class AtomicBlockPool {
+public:
+    static_assert(BlockCount > 0 && BlockCount <= 32, "Invalid number of blocks");
+
+    AtomicBlockPool() :
+            blocks_(),
+            used_(0) {
+    }
+
+    /**
+     * Allocate a block.
+     *
+     * @return Pointer to the block, or `nullptr` if all blocks are in use.
+     */
+    void* alloc() {
+        uint32_t used = used_.load(std::memory_order_relaxed);
+        for (;;) {
+            const uint32_t avail = ~used & ALL_BLOCKS;
+            if (!avail) {
+                return nullptr;
+            }
+            const uint32_t bit = avail & (~avail + 1); // Lowest free block
+            if (used_.compare_exchange_weak(used, used | bit, std::memory_order_acquire, std::memory_order_relaxed)) {
+                return blocks_[__builtin_ctz(bit)].data;
+            }
+        }
+    }
+
+    /**
+     * Free a block.
+     *
+     * @param ptr Pointer to the block.
+     */
+    void free(void* ptr) {
+        const size_t index = (Block*)ptr - blocks_;
+        used_.fetch_and(~(1u << index), std::memory_order_release);
+    }
+
+    /**
+     * Check if a pointer belongs to this pool.
+     */
+    bool owns(const void* ptr) const {
+        return ptr >= (const void*)blocks_ && ptr < (const void*)(blocks_ + BlockCount);
+    }
+
+    /**
+     * Get the number of free blocks.
+     */
+    size_t available() const {
+        return BlockCount - __builtin_popcount(used_.load(std::memory_order_relaxed));
+    }
+
+    static constexpr size_t blockSize() {
+        return BlockSize;
+    }
+
+private:
+    static const uint32_t ALL_BLOCKS = (uint32_t)((1ull << BlockCount) - 1);
+
+    struct alignas(alignof(std::max_align_t)) Block {
+        char data[BlockSize];
+    };
+
+    Block blocks_[BlockCount];
+    std::atomic<uint32_t> used_;
+};
+
+} // namespace particle
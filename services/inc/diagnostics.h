@@ -57,9 +57,32 @@
 #define DIAG_NAME_CLOUD_UNACKNOWLEDGED_MESSAGES "coap:unack"
 #define DIAG_NAME_CLOUD_TRANSMITTED_MESSAGES "coap:transmit"
 #define DIAG_NAME_CLOUD_COAP_ROUND_TRIP "coap:roundtrip"
+#define DIAG_NAME_CLOUD_HANDSHAKE_SAVED_TIME "cloud:hssaved"
 #define DIAG_NAME_CLOUD_RATE_LIMITED_EVENTS "pub:limit"
 #define DIAG_NAME_SYSTEM_TOTAL_RAM "sys:tram"
 #define DIAG_NAME_SYSTEM_USED_RAM "sys:uram"
+#define DIAG_NAME_SYSTEM_LOOP_WAKEUPS "sys:loop:wake"
+#define DIAG_NAME_SYSTEM_LOOP_LOAD "sys:loop:load"
+#define DIAG_NAME_SYSTEM_LOOP_ISR_TASKS_MIN "sys:loop:isr:min"
+#define DIAG_NAME_SYSTEM_LOOP_ISR_TASKS_MAX "sys:loop:isr:max"
+#define DIAG_NAME_SYSTEM_LOOP_ISR_TASKS_P99 "sys:loop:isr:p99"
+#define DIAG_NAME_SYSTEM_LOOP_NETWORK_MIN "sys:loop:net:min"
+#define DIAG_NAME_SYSTEM_LOOP_NETWORK_MAX "sys:loop:net:max"
+#define DIAG_NAME_SYSTEM_LOOP_NETWORK_P99 "sys:loop:net:p99"
+#define DIAG_NAME_SYSTEM_LOOP_CLOUD_MIN "sys:loop:cloud:min"
+#define DIAG_NAME_SYSTEM_LOOP_CLOUD_MAX "sys:loop:cloud:max"
+#define DIAG_NAME_SYSTEM_LOOP_CLOUD_P99 "sys:loop:cloud:p99"
+#define DIAG_NAME_SYSTEM_LOOP_FIRMWARE_UPDATE_MIN "sys:loop:ota:min"
+#define DIAG_NAME_SYSTEM_LOOP_FIRMWARE_UPDATE_MAX "sys:loop:ota:max"
+#define DIAG_NAME_SYSTEM_LOOP_FIRMWARE_UPDATE_P99 "sys:loop:ota:p99"
+#define DIAG_NAME_SYSTEM_LOOP_CONTROL_MIN "sys:loop:ctrl:min"
+#define DIAG_NAME_SYSTEM_LOOP_CONTROL_MAX "sys:loop:ctrl:max"
+#define DIAG_NAME_SYSTEM_LOOP_CONTROL_P99 "sys:loop:ctrl:p99"
+#define DIAG_NAME_SYSTEM_THREAD_QUEUE_DEPTH "sys:thr:qdepth"
+#define DIAG_NAME_SYSTEM_THREAD_QUEUE_LATENCY "sys:thr:qlat"
+#define DIAG_NAME_CLOUD_SYSTEM_QUEUE_LATENCY "coap:qlat:sys"
+#define DIAG_NAME_CLOUD_APPLICATION_QUEUE_LATENCY "coap:qlat:app"
+#define DIAG_NAME_CLOUD_COAP_RETRANSMISSION_TIMEOUT "coap:rto"
 
 #ifdef __cplusplus
 extern "C" {
@@ -107,6 +130,29 @@ typedef enum diag_id {
     DIAG_ID_SYSTEM_TOTAL_RAM = 25, // sys:tram
     DIAG_ID_SYSTEM_USED_RAM = 26, // sys:uram
     DIAG_ID_CLOUD_COAP_ROUND_TRIP = 31, // coap:roundtrip
+    DIAG_ID_CLOUD_HANDSHAKE_SAVED_TIME = 44, // cloud:hssaved
+    DIAG_ID_SYSTEM_LOOP_WAKEUPS = 45, // sys:loop:wake
+    DIAG_ID_SYSTEM_LOOP_LOAD = 46, // sys:loop:load
+    DIAG_ID_SYSTEM_LOOP_ISR_TASKS_MIN = 47, // sys:loop:isr:min
+    DIAG_ID_SYSTEM_LOOP_ISR_TASKS_MAX = 48, // sys:loop:isr:max
+    DIAG_ID_SYSTEM_LOOP_ISR_TASKS_P99 = 49, // sys:loop:isr:p99
+    DIAG_ID_SYSTEM_LOOP_NETWORK_MIN = 50, // sys:loop:net:min
+    DIAG_ID_SYSTEM_LOOP_NETWORK_MAX = 51, // sys:loop:net:max
+    DIAG_ID_SYSTEM_LOOP_NETWORK_P99 = 52, // sys:loop:net:p99
+    DIAG_ID_SYSTEM_LOOP_CLOUD_MIN = 53, // sys:loop:cloud:min
+    DIAG_ID_SYSTEM_LOOP_CLOUD_MAX = 54, // sys:loop:cloud:max
+    DIAG_ID_SYSTEM_LOOP_CLOUD_P99 = 55, // sys:loop:cloud:p99
+    DIAG_ID_SYSTEM_LOOP_FIRMWARE_UPDATE_MIN = 56, // sys:loop:ota:min
+    DIAG_ID_SYSTEM_LOOP_FIRMWARE_UPDATE_MAX = 57, // sys:loop:ota:max
+    DIAG_ID_SYSTEM_LOOP_FIRMWARE_UPDATE_P99 = 58, // sys:loop:ota:p99
+    DIAG_ID_SYSTEM_LOOP_CONTROL_MIN = 59, // sys:loop:ctrl:min
+    DIAG_ID_SYSTEM_LOOP_CONTROL_MAX = 60, // sys:loop:ctrl:max
+    DIAG_ID_SYSTEM_LOOP_CONTROL_P99 = 61, // sys:loop:ctrl:p99
+    DIAG_ID_SYSTEM_THREAD_QUEUE_DEPTH = 62, // sys:thr:qdepth
+    DIAG_ID_SYSTEM_THREAD_QUEUE_LATENCY = 63, // sys:thr:qlat
+    DIAG_ID_CLOUD_SYSTEM_QUEUE_LATENCY = 64, // coap:qlat:sys
+    DIAG_ID_CLOUD_APPLICATION_QUEUE_LATENCY = 65, // coap:qlat:app
+    DIAG_ID_CLOUD_COAP_RETRANSMISSION_TIMEOUT = 66, // coap:rto
     DIAG_ID_USER = 32768 // Base value for application-specific source IDs
 } diag_id;
 
@@ -149,6 +195,13 @@ typedef struct diag_source_get_cmd_data {
     size_t data_size; // Buffer size
 } diag_source_get_cmd_data;
 
+typedef struct diag_snapshot_entry {
+    uint16_t id; // Source ID
+    uint16_t type; // Data type
+    int32_t error; // Error code, or 0 if the value has been retrieved successfully
+    uint32_t value; // Source value (values of the DIAG_TYPE_INT type need to be cast to int32_t)
+} diag_snapshot_entry;
+
 // Registers a new data source. Note that in order for the data source to be registered, the service
 // needs to be in its initial stopped state
 int diag_register_source(const diag_source* src, void* reserved);
@@ -161,6 +214,13 @@ int diag_enum_sources(diag_enum_sources_callback callback, size_t* count, void*
 // is not started
 int diag_get_source(uint16_t id, const diag_source** src, void* reserved);
 
+// Retrieves the values of all registered integer data sources in a single pass, ordered by source
+// ID. On input, `count` is the number of elements in the `entries` array; on output, it's set to
+// the number of integer data sources, which can be larger than the size of the array, in which case
+// only the first sources are retrieved. The `entries` argument can be set to NULL to only get the
+// number of sources. This function returns an error if the service is not started
+int diag_snapshot(diag_snapshot_entry* entries, size_t* count, void* reserved);
+
 // Issues a service command
 int diag_command(int cmd, void* data, void* reserved);
 
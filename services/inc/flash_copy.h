@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Copies data between flash devices, skipping destination sectors that already have the
+ * expected contents.
+ *
+ * The copy is done in two passes:
+ *
+ * - `flash_copy_prepare()` reads the source data once, computes its CRC and compares it with the
+ *   destination sector by sector. Nothing is modified, so the caller can still reject the data if
+ *   the CRC doesn't match.
+ * - `flash_copy_commit()` erases and programs only the sectors that differ.
+ */
+
+#define FLASH_COPY_BLOCK_SIZE 256
+#define FLASH_COPY_MAX_SECTORS 512
+
+typedef struct flash_copy_device {
+    /**
+     * Read data.
+     *
+     * @return 0 on success, otherwise an error code defined by `system_error_t`.
+     */
+    int (*read)(uintptr_t addr, uint8_t* data, size_t size, void* user_data);
+    /**
+     * Program erased flash.
+     *
+     * @return 0 on success, otherwise an error code defined by `system_error_t`.
+     */
+    int (*write)(uintptr_t addr, const uint8_t* data, size_t size, void* user_data);
+    /**
+     * Erase sectors.
+     *
+     * @return 0 on success, otherwise an error code defined by `system_error_t`.
+     */
+    int (*erase)(uintptr_t addr, size_t sector_count, void* user_data);
+    size_t sector_size;
+    void* user_data;
+} flash_copy_device;
+
+/**
+ * Update a CRC-32 with a portion of the data.
+ */
+typedef uint32_t (*flash_copy_crc_fn)(const uint8_t* data, size_t size, uint32_t crc);
+
+typedef struct flash_copy_ctx {
+    const flash_copy_device* src;
+    const flash_copy_device* dest;
+    uintptr_t src_addr;
+    uintptr_t dest_addr;
+    size_t size;
+    flash_copy_crc_fn crc_fn;
+    size_t crc_size; // Number of bytes covered by the CRC
+    uint32_t crc;
+    size_t sector_count;
+    size_t dirty_count;
+    uint8_t dirty[FLASH_COPY_MAX_SECTORS / 8];
+    uint8_t state;
+} flash_copy_ctx;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Initialize the context.
+ *
+ * The destination address must be aligned to the destination sector size.
+ *
+ * @return 0 on success, otherwise an error code defined by `system_error_t`.
+ */
+int flash_copy_init(flash_copy_ctx* ctx, const flash_copy_device* src, uintptr_t src_addr,
+        const flash_copy_device* dest, uintptr_t dest_addr, size_t size);
+
+/**
+ * Compute the CRC of the first `crc_size` bytes of the source data while it's being read.
+ *
+ * @param crc Initial CRC value. Can be used to include data that is not copied.
+ * @return 0 on success, otherwise an error code defined by `system_error_t`.
+ */
+int flash_copy_set_crc(flash_copy_ctx* ctx, flash_copy_crc_fn crc_fn, size_t crc_size, uint32_t crc);
+
+/**
+ * Read the source data and determine which destination sectors need to be updated.
+ *
+ * @return 0 on success, otherwise an error code defined by `system_error_t`.
+ */
+int flash_copy_prepare(flash_copy_ctx* ctx);
+
+/**
+ * Erase and program the destination sectors that differ from the source data.
+ *
+ * Must be called after `flash_copy_prepare()`.
+ *
+ * @return 0 on success, otherwise an error code defined by `system_error_t`.
+ */
+int flash_copy_commit(flash_copy_ctx* ctx);
+
+/**
+ * Mark the destination sectors overlapping a range of addresses as needing to be updated.
+ *
+ * Must be called if the destination has been modified after `flash_copy_prepare()`.
+ *
+ * @return 0 on success, otherwise an error code defined by `system_error_t`.
+ */
+int flash_copy_invalidate(flash_copy_ctx* ctx, uintptr_t dest_addr, size_t size);
+
+/**
+ * Get the CRC computed by `flash_copy_prepare()`.
+ */
+uint32_t flash_copy_crc(const flash_copy_ctx* ctx);
+
+/**
+ * Get the number of destination sectors that need to be updated.
+ */
+size_t flash_copy_dirty_sector_count(const flash_copy_ctx* ctx);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
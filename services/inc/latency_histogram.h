@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+/**
+ * Histogram of latency values with logarithmic buckets.
+ *
+ * Every power of two is split into 4 buckets, so a percentile is reported with a relative error
+ * of at most 25%. Values up to `MAX_VALUE` are bucketed, larger values are counted in the last
+ * bucket. The minimum and maximum values are tracked exactly.
+ *
+ * Recording a value takes constant time. The bucket counters are halved when one of them is about
+ * to overflow, which preserves the shape of the distribution.
+ *
+ * This class is not thread-safe.
+ */
+class LatencyHistogram {
+public:
+    /**
+     * Number of buckets per power of two (log2).
+     */
+    static const unsigned SUB_BUCKET_BITS = 2;
+
+    /**
+     * Maximum value that gets its own bucket (about 16.7 seconds if the values are in microseconds).
+     */
+    static const uint32_t MAX_VALUE = (1u << 24) - 1;
+
+    /**
+     * Number of buckets.
+     */
+    static const size_t BUCKET_COUNT = (24 - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+    LatencyHistogram() {
+        reset();
+    }
+
+    /**
+     * Record a value.
+     */
+    void record(uint32_t value);
+
+    /**
+     * Get a percentile.
+     *
+     * @param percentile Percentile (0-100).
+     * @return Upper bound of the bucket containing the percentile, or 0 if no values were recorded.
+     */
+    uint32_t percentile(unsigned percentile) const;
+
+    /**
+     * Get the minimum recorded value.
+     */
+    uint32_t min() const {
+        return count_ ? min_ : 0;
+    }
+
+    /**
+     * Get the maximum recorded value.
+     */
+    uint32_t max() const {
+        return max_;
+    }
+
+    /**
+     * Get the number of values in the buckets.
+     */
+    uint32_t count() const {
+        return count_;
+    }
+
+    /**
+     * Discard all recorded values.
+     */
+    void reset();
+
+    /**
+     * Get the index of the bucket for a value.
+     */
+    static size_t bucketIndex(uint32_t value);
+
+    /**
+     * Get the smallest value that falls into a bucket.
+     */
+    static uint32_t bucketLowerBound(size_t index);
+
+private:
+    uint16_t buckets_[BUCKET_COUNT];
+    uint32_t count_;
+    uint32_t min_;
+    uint32_t max_;
+};
+
+} // namespace particle
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Streaming applier for binary patches of firmware modules.
+ *
+ * The patch is a sequence of bsdiff-style records, each consisting of the following fields:
+ *
+ * - Size of the diff block (unsigned varint).
+ * - Diff block: every byte of it is added to the byte at the current position in the base image
+ *   and the result is written to the target image.
+ * - Size of the extra block (unsigned varint).
+ * - Extra block: copied to the target image as is.
+ * - Adjustment of the current position in the base image (signed zigzag-encoded varint).
+ *
+ * The target image is produced sequentially, so it can be written to flash while the patch is
+ * being read. The base image is accessed via a callback and must not be modified until the
+ * patch is applied.
+ */
+
+#define MODULE_PATCH_BUFFER_SIZE 256
+
+typedef enum module_patch_method {
+    MODULE_PATCH_METHOD_SEQUENTIAL = 0
+} module_patch_method;
+
+/**
+ * Read data from the base image.
+ *
+ * @return 0 on success, otherwise an error code defined by `system_error_t`.
+ */
+typedef int (*module_patch_read_fn)(size_t offset, char* data, size_t size, void* user_data);
+
+/**
+ * Write data to the target image.
+ *
+ * @return 0 on success, otherwise an error code defined by `system_error_t`.
+ */
+typedef int (*module_patch_write_fn)(const char* data, size_t size, void* user_data);
+
+typedef struct module_patch_ctx {
+    char buf[MODULE_PATCH_BUFFER_SIZE];
+    module_patch_read_fn read;
+    module_patch_write_fn write;
+    void* user_data;
+    size_t base_size;
+    size_t target_size;
+    size_t base_offs;
+    size_t target_offs;
+    size_t block_size; // Bytes left in the current diff or extra block
+    uint32_t varint;
+    uint8_t varint_shift;
+    uint8_t state;
+    int result;
+} module_patch_ctx;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Initialize the applier.
+ *
+ * @param ctx Context.
+ * @param base_size Size of the base image.
+ * @param target_size Size of the target image.
+ * @param read Callback reading the base image.
+ * @param write Callback writing the target image.
+ * @param user_data User data passed to the callbacks.
+ * @return 0 on success, otherwise an error code defined by `system_error_t`.
+ */
+int module_patch_init(module_patch_ctx* ctx, size_t base_size, size_t target_size, module_patch_read_fn read,
+        module_patch_write_fn write, void* user_data);
+
+/**
+ * Process a portion of the patch data.
+ *
+ * All of the input data is consumed on success. After an error, all subsequent calls fail with
+ * the same error.
+ *
+ * @return 0 on success, otherwise an error code defined by `system_error_t`.
+ */
+int module_patch_input(module_patch_ctx* ctx, const char* data, size_t size);
+
+/**
+ * Finish applying the patch.
+ *
+ * @return 0 if the patch data ended on a record boundary and the entire target image has been
+ *         written, otherwise an error code defined by `system_error_t`.
+ */
+int module_patch_finish(module_patch_ctx* ctx);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace particle {
+
+/**
+ * Wire types of the protobuf encoding.
+ *
+ * The encoding is described here:
+ * https://developers.google.com/protocol-buffers/docs/encoding
+ */
+enum class ProtobufWireType {
+    VARINT = 0,
+    FIXED64 = 1,
+    LENGTH_DELIMITED = 2,
+    FIXED32 = 5
+};
+
+/**
+ * A field of a protobuf message.
+ */
+struct ProtobufField {
+    unsigned tag; ///< Field number.
+    ProtobufWireType type; ///< Wire type.
+    uint64_t value; ///< Value of a varint or fixed-size field.
+    const char* data; ///< Contents of a length-delimited field. Points into the message buffer.
+    size_t size; ///< Size of a length-delimited field.
+};
+
+/**
+ * Reads the fields of a protobuf message without copying or allocating anything.
+ *
+ * Unlike nanopb, the reader doesn't know the schema of the message: it's up to the caller to
+ * interpret the fields and skip the unknown ones.
+ */
+class ProtobufReader {
+public:
+    /**
+     * Constructor.
+     *
+     * @param data Message data.
+     * @param size Message size.
+     */
+    ProtobufReader(const char* data, size_t size);
+
+    /**
+     * Read the next field.
+     *
+     * @param[out] field Field.
+     * @return 1 if a field was read, 0 if the end of the message has been reached, or a negative
+     *         result code in case of an error.
+     *
+     * `SYSTEM_ERROR_NOT_SUPPORTED` is returned for the deprecated group wire types.
+     */
+    int next(ProtobufField* field);
+
+private:
+    const char* p_;
+    const char* end_;
+
+    int readVarint(uint64_t* val);
+};
+
+/**
+ * Writes the fields of a protobuf message.
+ *
+ * The writer doesn't write more than `size` bytes to the destination buffer but keeps counting the
+ * bytes, so it can also be used with an empty buffer to calculate the size of a message.
+ */
+class ProtobufWriter {
+public:
+    /**
+     * Constructor.
+     *
+     * @param buf Destination buffer.
+     * @param size Buffer size.
+     */
+    explicit ProtobufWriter(char* buf = nullptr, size_t size = 0);
+
+    /**
+     * Write a varint field.
+     */
+    ProtobufWriter& writeVarint(unsigned tag, uint64_t val);
+
+    /**
+     * Write a length-delimited field.
+     */
+    ProtobufWriter& writeBytes(unsigned tag, const char* data, size_t size);
+
+    /**
+     * Write the header of an embedded message field.
+     *
+     * The fields of the embedded message need to be written next.
+     *
+     * @param tag Field number.
+     * @param size Size of the embedded message.
+     */
+    ProtobufWriter& writeMessageHeader(unsigned tag, size_t size);
+
+    /**
+     * Get the size of the written data.
+     *
+     * @return Number of bytes that have been written, or would have been written if the buffer had
+     *         enough space available.
+     */
+    size_t dataSize() const;
+
+private:
+    char* buf_;
+    size_t bufSize_;
+    size_t dataSize_;
+
+    void writeVarint(uint64_t val);
+    void write(const char* data, size_t size);
+};
+
+inline ProtobufReader::ProtobufReader(const char* data, size_t size) :
+        p_(data),
+        end_(data + size) {
+}
+
+inline ProtobufWriter::ProtobufWriter(char* buf, size_t size) :
+        buf_(buf),
+        bufSize_(size),
+        dataSize_(0) {
+}
+
+inline size_t ProtobufWriter::dataSize() const {
+    return dataSize_;
+}
+
+} // particle
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "appender.h"
+
+/**
+ * Set to 1 to compile in the trace points. When disabled, the `TRACE_*` macros expand to nothing.
+ */
+#ifndef PARTICLE_TRACE_ENABLED
+#define PARTICLE_TRACE_ENABLED 0
+#endif
+
+/**
+ * Number of records in the trace buffer.
+ */
+#ifndef PARTICLE_TRACE_BUFFER_SIZE
+#define PARTICLE_TRACE_BUFFER_SIZE 256
+#endif
+
+/**
+ * Magic number at the beginning of a trace dump ("PTRC").
+ */
+#define TRACE_DUMP_MAGIC 0x43525450
+
+/**
+ * Version of the trace dump format.
+ */
+#define TRACE_DUMP_VERSION 1
+
+#if PARTICLE_TRACE_ENABLED
+
+/**
+ * Record an instant event.
+ *
+ * @param _id Event ID (`trace_event_id`).
+ * @param _arg1 First argument.
+ * @param _arg2 Second argument.
+ */
+#define TRACE_EVENT(_id, _arg1, _arg2) \
+        trace_record_event(_id, TRACE_EVENT_INSTANT, (uint32_t)(_arg1), (uint32_t)(_arg2))
+
+/**
+ * Record the beginning of a duration event.
+ */
+#define TRACE_BEGIN(_id, _arg1, _arg2) \
+        trace_record_event(_id, TRACE_EVENT_BEGIN, (uint32_t)(_arg1), (uint32_t)(_arg2))
+
+/**
+ * Record the end of a duration event.
+ */
+#define TRACE_END(_id, _arg1, _arg2) \
+        trace_record_event(_id, TRACE_EVENT_END, (uint32_t)(_arg1), (uint32_t)(_arg2))
+
+/**
+ * Record the value of a counter.
+ */
+#define TRACE_COUNTER(_id, _value) \
+        trace_record_event(_id, TRACE_EVENT_COUNTER, (uint32_t)(_value), 0)
+
+#ifdef __cplusplus
+
+/**
+ * Record a duration event covering the current scope.
+ */
+#define TRACE_SCOPE(_id, _arg1, _arg2) \
+        const ::particle::TraceScope PP_CAT(_trace_scope_, __LINE__)(_id, (uint32_t)(_arg1), (uint32_t)(_arg2))
+
+#endif // defined(__cplusplus)
+
+#else // !PARTICLE_TRACE_ENABLED
+
+#define TRACE_EVENT(_id, _arg1, _arg2)
+#define TRACE_BEGIN(_id, _arg1, _arg2)
+#define TRACE_END(_id, _arg1, _arg2)
+#define TRACE_COUNTER(_id, _value)
+#define TRACE_SCOPE(_id, _arg1, _arg2)
+
+#endif // !PARTICLE_TRACE_ENABLED
+
+/**
+ * Event type.
+ */
+typedef enum trace_event_type {
+    TRACE_EVENT_INSTANT = 0, ///< Instant event.
+    TRACE_EVENT_BEGIN = 1, ///< Beginning of a duration event.
+    TRACE_EVENT_END = 2, ///< End of a duration event.
+    TRACE_EVENT_COUNTER = 3 ///< Counter value.
+} trace_event_type;
+
+/**
+ * Event ID.
+ *
+ * The names of the events used by the host tools are given in the comments. The IDs must not be
+ * reused.
+ */
+typedef enum trace_event_id {
+    TRACE_ID_INVALID = 0,
+    // System
+    TRACE_ID_SYSTEM_LOOP = 1, // sys:loop (force events)
+    TRACE_ID_SYSTEM_CLOUD_CONNECT = 2, // sys:cloud:connect (end: result)
+    TRACE_ID_SYSTEM_CLOUD_HANDSHAKE = 3, // sys:cloud:handshake (end: result)
+    TRACE_ID_SYSTEM_PUBLISH = 4, // sys:publish (data size)
+    TRACE_ID_SYSTEM_OTA_CHUNK = 5, // sys:ota:chunk (offset, size)
+    TRACE_ID_SYSTEM_OTA_FINISH = 6, // sys:ota:finish (flags)
+    // Protocol
+    TRACE_ID_PROTOCOL_EVENT_LOOP = 32, // proto:loop
+    TRACE_ID_PROTOCOL_HANDLE_MESSAGE = 33, // proto:msg (message type, size)
+    TRACE_ID_DTLS_RECEIVE = 34, // dtls:recv (size)
+    TRACE_ID_DTLS_SEND = 35, // dtls:send (size, result)
+    TRACE_ID_DTLS_HANDSHAKE = 36, // dtls:handshake
+    // HAL
+    TRACE_ID_PPP_INPUT = 64, // ppp:rx (size)
+    TRACE_ID_PPP_OUTPUT = 65, // ppp:tx (size)
+    TRACE_ID_AT_COMMAND = 66, // at:cmd (begin: command size; end: result, error code)
+    TRACE_ID_USER = 32768 // Base value for application-specific event IDs
+} trace_event_id;
+
+/**
+ * Trace record.
+ */
+typedef struct trace_record {
+    uint32_t seq; ///< Sequence number of the record plus one. Set to 0 while the record is being written.
+    uint32_t time; ///< Time in microseconds.
+    uint32_t thread; ///< ID of the thread that recorded the event.
+    uint32_t arg1; ///< First argument.
+    uint32_t arg2; ///< Second argument.
+    uint16_t id; ///< Event ID (`trace_event_id`).
+    uint8_t type; ///< Event type (`trace_event_type`).
+    uint8_t reserved; ///< Reserved.
+} trace_record;
+
+/**
+ * Header of a trace dump.
+ *
+ * The header is followed by `count` records ordered from oldest to newest. A record whose `seq`
+ * field is 0 was being written while the dump was taken and should be ignored. All fields are
+ * stored in the little-endian byte order.
+ */
+typedef struct trace_dump_header {
+    uint32_t magic; ///< Magic number (`TRACE_DUMP_MAGIC`).
+    uint16_t version; ///< Format version (`TRACE_DUMP_VERSION`).
+    uint16_t record_size; ///< Size of a record.
+    uint32_t count; ///< Number of records in the dump.
+    uint32_t dropped; ///< Number of records that were overwritten before the dump.
+} trace_dump_header;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Record an event.
+ *
+ * This function can be called from any thread or an ISR.
+ *
+ * @param id Event ID.
+ * @param type Event type.
+ * @param arg1 First argument.
+ * @param arg2 Second argument.
+ */
+void trace_record_event(uint16_t id, uint8_t type, uint32_t arg1, uint32_t arg2);
+
+/**
+ * Enable or disable the recording of events.
+ *
+ * The recording is enabled by default.
+ *
+ * @param enabled Whether the recording should be enabled.
+ */
+void trace_set_enabled(int enabled);
+
+/**
+ * Write the contents of the trace buffer.
+ *
+ * The data is written in the format described by `trace_dump_header`. Recording can be disabled
+ * while the dump is taken to get a consistent snapshot of the buffer.
+ *
+ * @param appender Appender function.
+ * @param appender_data Appender data.
+ * @param reserved Reserved argument. Must be set to `NULL`.
+ * @return 0 on success, otherwise an error code defined by `system_error_t`.
+ */
+int trace_dump(appender_fn appender, void* appender_data, void* reserved);
+
+/**
+ * Discard all recorded events.
+ */
+void trace_clear(void);
+
+#ifdef __cplusplus
+} // extern "C"
+
+#if PARTICLE_TRACE_ENABLED
+
+#include "preprocessor.h"
+
+namespace particle {
+
+/**
+ * Helper class recording the beginning and end of a duration event.
+ */
+class TraceScope {
+public:
+    TraceScope(uint16_t id, uint32_t arg1, uint32_t arg2) :
+            id_(id) {
+        trace_record_event(id, TRACE_EVENT_BEGIN, arg1, arg2);
+    }
+
+    ~TraceScope() {
+        trace_record_event(id_, TRACE_EVENT_END, 0, 0);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    uint16_t id_;
+};
+
+} // namespace particle
+
+#endif // PARTICLE_TRACE_ENABLED
+
+#endif // defined(__cplusplus)
@@ -59,6 +59,34 @@ public:
         return SYSTEM_ERROR_NONE;
     }
 
+    int snapshot(diag_snapshot_entry* entries, size_t* count) {
+        if (!started_) {
+            return SYSTEM_ERROR_INVALID_STATE;
+        }
+        if (!count) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        const size_t maxCount = entries ? *count : 0;
+        size_t n = 0;
+        for (const diag_source* src: srcs_) {
+            if (src->type != DIAG_TYPE_INT && src->type != DIAG_TYPE_UINT) {
+                continue;
+            }
+            if (n < maxCount) {
+                diag_snapshot_entry* e = entries + n;
+                e->id = src->id;
+                e->type = src->type;
+                e->value = 0;
+                diag_source_get_cmd_data d = { sizeof(diag_source_get_cmd_data), 0 /* reserved */, &e->value,
+                        sizeof(e->value) };
+                e->error = src->callback(src, DIAG_SOURCE_CMD_GET, &d);
+            }
+            ++n;
+        }
+        *count = n;
+        return SYSTEM_ERROR_NONE;
+    }
+
     int getSource(uint16_t id, const diag_source** src) {
         if (!started_) {
             return SYSTEM_ERROR_INVALID_STATE;
@@ -126,6 +154,10 @@ int diag_get_source(uint16_t id, const diag_source** src, void* reserved) {
     return Diagnostics::instance()->getSource(id, src);
 }
 
+int diag_snapshot(diag_snapshot_entry* entries, size_t* count, void* reserved) {
+    return Diagnostics::instance()->snapshot(entries, count);
+}
+
 int diag_command(int cmd, void* data, void* reserved) {
     return Diagnostics::instance()->command(cmd, data);
 }
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "flash_copy.h"
+
+#include "check.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+enum State {
+    NEW,
+    PREPARED,
+    DONE
+};
+
+inline bool isDirty(const flash_copy_ctx* ctx, size_t sector) {
+    return ctx->dirty[sector / 8] & (1 << (sector % 8));
+}
+
+inline void setDirty(flash_copy_ctx* ctx, size_t sector) {
+    if (!isDirty(ctx, sector)) {
+        ctx->dirty[sector / 8] |= (1 << (sector % 8));
+        ++ctx->dirty_count;
+    }
+}
+
+inline size_t sectorSize(const flash_copy_ctx* ctx, size_t sector) {
+    const size_t offs = sector * ctx->dest->sector_size;
+    return std::min(ctx->dest->sector_size, ctx->size - offs);
+}
+
+} // namespace
+
+int flash_copy_init(flash_copy_ctx* ctx, const flash_copy_device* src, uintptr_t src_addr,
+        const flash_copy_device* dest, uintptr_t dest_addr, size_t size) {
+    CHECK_TRUE(ctx && src && dest && src->read && dest->read && dest->write && dest->erase,
+            SYSTEM_ERROR_INVALID_ARGUMENT);
+    CHECK_TRUE(dest->sector_size > 0 && dest_addr % dest->sector_size == 0, SYSTEM_ERROR_INVALID_ARGUMENT);
+    const size_t sectorCount = (size + dest->sector_size - 1) / dest->sector_size;
+    CHECK_TRUE(sectorCount <= FLASH_COPY_MAX_SECTORS, SYSTEM_ERROR_TOO_LARGE);
+    memset(ctx, 0, sizeof(flash_copy_ctx));
+    ctx->src = src;
+    ctx->dest = dest;
+    ctx->src_addr = src_addr;
+    ctx->dest_addr = dest_addr;
+    ctx->size = size;
+    ctx->sector_count = sectorCount;
+    ctx->state = NEW;
+    return 0;
+}
+
+int flash_copy_set_crc(flash_copy_ctx* ctx, flash_copy_crc_fn crc_fn, size_t crc_size, uint32_t crc) {
+    CHECK_TRUE(crc_fn && crc_size <= ctx->size, SYSTEM_ERROR_INVALID_ARGUMENT);
+    CHECK_TRUE(ctx->state == NEW, SYSTEM_ERROR_INVALID_STATE);
+    ctx->crc_fn = crc_fn;
+    ctx->crc_size = crc_size;
+    ctx->crc = crc;
+    return 0;
+}
+
+int flash_copy_prepare(flash_copy_ctx* ctx) {
+    CHECK_TRUE(ctx->state == NEW, SYSTEM_ERROR_INVALID_STATE);
+    uint8_t srcBuf[FLASH_COPY_BLOCK_SIZE];
+    uint8_t destBuf[FLASH_COPY_BLOCK_SIZE];
+    size_t offs = 0;
+    for (size_t i = 0; i < ctx->sector_count; ++i) {
+        const size_t sectorEnd = offs + sectorSize(ctx, i);
+        bool dirty = false;
+        while (offs < sectorEnd) {
+            const size_t n = std::min(sectorEnd - offs, sizeof(srcBuf));
+            CHECK(ctx->src->read(ctx->src_addr + offs, srcBuf, n, ctx->src->user_data));
+            if (ctx->crc_fn && offs < ctx->crc_size) {
+                ctx->crc = ctx->crc_fn(srcBuf, std::min(n, ctx->crc_size - offs), ctx->crc);
+            }
+            // The rest of a sector that needs to be updated doesn't need to be compared
+            if (!dirty) {
+                CHECK(ctx->dest->read(ctx->dest_addr + offs, destBuf, n, ctx->dest->user_data));
+                dirty = (memcmp(srcBuf, destBuf, n) != 0);
+            }
+            offs += n;
+        }
+        if (dirty) {
+            setDirty(ctx, i);
+        }
+    }
+    ctx->state = PREPARED;
+    return 0;
+}
+
+int flash_copy_commit(flash_copy_ctx* ctx) {
+    CHECK_TRUE(ctx->state == PREPARED, SYSTEM_ERROR_INVALID_STATE);
+    uint8_t buf[FLASH_COPY_BLOCK_SIZE];
+    for (size_t i = 0; i < ctx->sector_count; ++i) {
+        if (!isDirty(ctx, i)) {
+            continue;
+        }
+        size_t offs = i * ctx->dest->sector_size;
+        const size_t sectorEnd = offs + sectorSize(ctx, i);
+        CHECK(ctx->dest->erase(ctx->dest_addr + offs, 1, ctx->dest->user_data));
+        while (offs < sectorEnd) {
+            const size_t n = std::min(sectorEnd - offs, sizeof(buf));
+            CHECK(ctx->src->read(ctx->src_addr + offs, buf, n, ctx->src->user_data));
+            CHECK(ctx->dest->write(ctx->dest_addr + offs, buf, n, ctx->dest->user_data));
+            offs += n;
+        }
+    }
+    ctx->state = DONE;
+    return 0;
+}
+
+int flash_copy_invalidate(flash_copy_ctx* ctx, uintptr_t dest_addr, size_t size) {
+    CHECK_TRUE(ctx->state == PREPARED, SYSTEM_ERROR_INVALID_STATE);
+    const uintptr_t destEnd = ctx->dest_addr + ctx->size;
+    const uintptr_t start = std::max(dest_addr, ctx->dest_addr);
+    const uintptr_t end = std::min(dest_addr + size, destEnd);
+    if (start >= end) {
+        return 0; // Not within the destination range
+    }
+    const size_t first = (start - ctx->dest_addr) / ctx->dest->sector_size;
+    const size_t last = (end - ctx->dest_addr - 1) / ctx->dest->sector_size;
+    for (size_t i = first; i <= last; ++i) {
+        setDirty(ctx, i);
+    }
+    return 0;
+}
+
+uint32_t flash_copy_crc(const flash_copy_ctx* ctx) {
+    return ctx->crc;
+}
+
+size_t flash_copy_dirty_sector_count(const flash_copy_ctx* ctx) {
+    return ctx->dirty_count;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace particle {
+
+const unsigned LatencyHistogram::SUB_BUCKET_BITS;
+const uint32_t LatencyHistogram::MAX_VALUE;
+const size_t LatencyHistogram::BUCKET_COUNT;
+
+void LatencyHistogram::record(uint32_t value) {
+    if (!count_ || value < min_) {
+        min_ = value;
+    }
+    if (value > max_) {
+        max_ = value;
+    }
+    const size_t index = bucketIndex(value);
+    if (buckets_[index] == std::numeric_limits<uint16_t>::max()) {
+        count_ = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            buckets_[i] /= 2;
+            count_ += buckets_[i];
+        }
+    }
+    ++buckets_[index];
+    ++count_;
+}
+
+uint32_t LatencyHistogram::percentile(unsigned percentile) const {
+    if (!count_) {
+        return 0;
+    }
+    const uint32_t target = std::max<uint32_t>(((uint64_t)count_ * std::min(percentile, 100u) + 99) / 100, 1);
+    uint32_t n = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        n += buckets_[i];
+        if (n >= target) {
+            if (i + 1 < BUCKET_COUNT) {
+                return std::min(bucketLowerBound(i + 1) - 1, max_);
+            }
+            break;
+        }
+    }
+    return max_;
+}
+
+void LatencyHistogram::reset() {
+    std::fill(buckets_, buckets_ + BUCKET_COUNT, 0);
+    count_ = 0;
+    min_ = 0;
+    max_ = 0;
+}
+
+size_t LatencyHistogram::bucketIndex(uint32_t value) {
+    value = std::min(value, MAX_VALUE);
+    if (value < (1u << SUB_BUCKET_BITS)) {
+        return value;
+    }
+    const unsigned exp = 31 - __builtin_clz(value);
+    const unsigned shift = exp - SUB_BUCKET_BITS;
+    return ((shift + 1) << SUB_BUCKET_BITS) + ((value >> shift) & ((1u << SUB_BUCKET_BITS) - 1));
+}
+
+uint32_t LatencyHistogram::bucketLowerBound(size_t index) {
+    if (index < (1u << SUB_BUCKET_BITS)) {
+        return index;
+    }
+    const unsigned shift = (index >> SUB_BUCKET_BITS) - 1;
+    const uint32_t mantissa = (1u << SUB_BUCKET_BITS) + (index & ((1u << SUB_BUCKET_BITS) - 1));
+    return mantissa << shift;
+}
+
+} // namespace particle
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "module_patch.h"
+
+#include "check.h"
+
+#include <algorithm>
+
+namespace {
+
+enum State {
+    DIFF_SIZE,
+    DIFF_DATA,
+    EXTRA_SIZE,
+    EXTRA_DATA,
+    ADJUSTMENT
+};
+
+// Returns 1 if a complete varint has been read, or 0 if more data is needed
+int readVarint(module_patch_ctx* ctx, const char* data, size_t size, size_t* offs) {
+    while (*offs < size) {
+        const uint8_t b = data[(*offs)++];
+        if (ctx->varint_shift > 28 || (ctx->varint_shift == 28 && (b & 0x70))) {
+            return SYSTEM_ERROR_BAD_DATA; // Doesn't fit in 32 bits
+        }
+        ctx->varint |= (uint32_t)(b & 0x7f) << ctx->varint_shift;
+        if (!(b & 0x80)) {
+            ctx->varint_shift = 0;
+            return 1;
+        }
+        ctx->varint_shift += 7;
+    }
+    return 0;
+}
+
+uint32_t takeVarint(module_patch_ctx* ctx) {
+    const uint32_t v = ctx->varint;
+    ctx->varint = 0;
+    return v;
+}
+
+int applyDiff(module_patch_ctx* ctx, const char* data, size_t size) {
+    while (size > 0) {
+        const size_t n = std::min(size, sizeof(ctx->buf));
+        CHECK(ctx->read(ctx->base_offs, ctx->buf, n, ctx->user_data));
+        for (size_t i = 0; i < n; ++i) {
+            ctx->buf[i] += data[i];
+        }
+        CHECK(ctx->write(ctx->buf, n, ctx->user_data));
+        ctx->base_offs += n;
+        ctx->target_offs += n;
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+int processInput(module_patch_ctx* ctx, const char* data, size_t size) {
+    size_t offs = 0;
+    while (offs < size) {
+        switch (ctx->state) {
+        case DIFF_SIZE:
+        case EXTRA_SIZE: {
+            if (!CHECK(readVarint(ctx, data, size, &offs))) {
+                break;
+            }
+            const size_t n = takeVarint(ctx);
+            if (n > ctx->target_size - ctx->target_offs) {
+                return SYSTEM_ERROR_BAD_DATA;
+            }
+            if (ctx->state == DIFF_SIZE) {
+                if (n > ctx->base_size - ctx->base_offs) {
+                    return SYSTEM_ERROR_BAD_DATA;
+                }
+                ctx->state = (n > 0) ? DIFF_DATA : EXTRA_SIZE;
+            } else {
+                ctx->state = (n > 0) ? EXTRA_DATA : ADJUSTMENT;
+            }
+            ctx->block_size = n;
+            break;
+        }
+        case DIFF_DATA:
+        case EXTRA_DATA: {
+            const size_t n = std::min(ctx->block_size, size - offs);
+            if (ctx->state == DIFF_DATA) {
+                CHECK(applyDiff(ctx, data + offs, n));
+            } else {
+                CHECK(ctx->write(data + offs, n, ctx->user_data));
+                ctx->target_offs += n;
+            }
+            ctx->block_size -= n;
+            offs += n;
+            if (ctx->block_size == 0) {
+                ctx->state = (ctx->state == DIFF_DATA) ? EXTRA_SIZE : ADJUSTMENT;
+            }
+            break;
+        }
+        case ADJUSTMENT: {
+            if (!CHECK(readVarint(ctx, data, size, &offs))) {
+                break;
+            }
+            const uint32_t v = takeVarint(ctx);
+            const int64_t adj = (v & 1) ? -(int64_t)(v >> 1) - 1 : (int64_t)(v >> 1);
+            const int64_t pos = (int64_t)ctx->base_offs + adj;
+            if (pos < 0 || pos > (int64_t)ctx->base_size) {
+                return SYSTEM_ERROR_BAD_DATA;
+            }
+            ctx->base_offs = pos;
+            ctx->state = DIFF_SIZE;
+            break;
+        }
+        default:
+            return SYSTEM_ERROR_INTERNAL;
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+int module_patch_init(module_patch_ctx* ctx, size_t base_size, size_t target_size, module_patch_read_fn read,
+        module_patch_write_fn write, void* user_data) {
+    CHECK_TRUE(ctx && read && write, SYSTEM_ERROR_INVALID_ARGUMENT);
+    ctx->read = read;
+    ctx->write = write;
+    ctx->user_data = user_data;
+    ctx->base_size = base_size;
+    ctx->target_size = target_size;
+    ctx->base_offs = 0;
+    ctx->target_offs = 0;
+    ctx->block_size = 0;
+    ctx->varint = 0;
+    ctx->varint_shift = 0;
+    ctx->state = DIFF_SIZE;
+    ctx->result = 0;
+    return 0;
+}
+
+int module_patch_input(module_patch_ctx* ctx, const char* data, size_t size) {
+    if (ctx->result < 0) {
+        return ctx->result;
+    }
+    const int r = processInput(ctx, data, size);
+    if (r < 0) {
+        ctx->result = r;
+    }
+    return r;
+}
+
+int module_patch_finish(module_patch_ctx* ctx) {
+    if (ctx->result < 0) {
+        return ctx->result;
+    }
+    if (ctx->state != DIFF_SIZE || ctx->varint_shift != 0 || ctx->target_offs != ctx->target_size) {
+        ctx->result = SYSTEM_ERROR_NOT_ENOUGH_DATA;
+        return ctx->result;
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "protobuf_wire.h"
+
+#include "system_error.h"
+#include "check.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace particle {
+
+namespace {
+
+const size_t MAX_VARINT_SIZE = 10;
+
+uint64_t readLittleEndian(const char* data, size_t size) {
+    uint64_t val = 0;
+    for (size_t i = 0; i < size; ++i) {
+        val |= (uint64_t)(uint8_t)data[i] << (i * 8);
+    }
+    return val;
+}
+
+} // unnamed
+
+int ProtobufReader::next(ProtobufField* field) {
+    if (p_ == end_) {
+        return 0;
+    }
+    uint64_t key = 0;
+    CHECK(readVarint(&key));
+    const unsigned tag = key >> 3;
+    if (tag == 0 || key > UINT32_MAX) {
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    field->tag = tag;
+    field->type = (ProtobufWireType)(key & 0x07);
+    field->value = 0;
+    field->data = nullptr;
+    field->size = 0;
+    switch (field->type) {
+    case ProtobufWireType::VARINT: {
+        CHECK(readVarint(&field->value));
+        break;
+    }
+    case ProtobufWireType::FIXED64:
+    case ProtobufWireType::FIXED32: {
+        const size_t n = (field->type == ProtobufWireType::FIXED64) ? 8 : 4;
+        if ((size_t)(end_ - p_) < n) {
+            return SYSTEM_ERROR_BAD_DATA;
+        }
+        field->value = readLittleEndian(p_, n);
+        p_ += n;
+        break;
+    }
+    case ProtobufWireType::LENGTH_DELIMITED: {
+        uint64_t n = 0;
+        CHECK(readVarint(&n));
+        if ((uint64_t)(end_ - p_) < n) {
+            return SYSTEM_ERROR_BAD_DATA;
+        }
+        field->data = p_;
+        field->size = n;
+        p_ += n;
+        break;
+    }
+    default:
+        return SYSTEM_ERROR_NOT_SUPPORTED;
+    }
+    return 1;
+}
+
+int ProtobufReader::readVarint(uint64_t* val) {
+    // Fast path for single-byte values such as keys of the fields with small numbers
+    if (p_ != end_ && !(*p_ & 0x80)) {
+        *val = (uint8_t)*p_++;
+        return 0;
+    }
+    uint64_t v = 0;
+    const size_t n = std::min<size_t>(end_ - p_, MAX_VARINT_SIZE);
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t b = p_[i];
+        v |= (uint64_t)(b & 0x7f) << (i * 7);
+        if (!(b & 0x80)) {
+            p_ += i + 1;
+            *val = v;
+            return 0;
+        }
+    }
+    return SYSTEM_ERROR_BAD_DATA;
+}
+
+ProtobufWriter& ProtobufWriter::writeVarint(unsigned tag, uint64_t val) {
+    writeVarint(((uint64_t)tag << 3) | (unsigned)ProtobufWireType::VARINT);
+    writeVarint(val);
+    return *this;
+}
+
+ProtobufWriter& ProtobufWriter::writeBytes(unsigned tag, const char* data, size_t size) {
+    writeMessageHeader(tag, size);
+    write(data, size);
+    return *this;
+}
+
+ProtobufWriter& ProtobufWriter::writeMessageHeader(unsigned tag, size_t size) {
+    writeVarint(((uint64_t)tag << 3) | (unsigned)ProtobufWireType::LENGTH_DELIMITED);
+    writeVarint(size);
+    return *this;
+}
+
+void ProtobufWriter::writeVarint(uint64_t val) {
+    char buf[MAX_VARINT_SIZE];
+    size_t n = 0;
+    do {
+        uint8_t b = val & 0x7f;
+        val >>= 7;
+        if (val) {
+            b |= 0x80;
+        }
+        buf[n++] = b;
+    } while (val);
+    write(buf, n);
+}
+
+void ProtobufWriter::write(const char* data, size_t size) {
+    if (dataSize_ < bufSize_) {
+        memcpy(buf_ + dataSize_, data, std::min(size, bufSize_ - dataSize_));
+    }
+    dataSize_ += size;
+}
+
+} // particle
@@ -30,5 +30,6 @@
 #include "system_error.h"
 #include "led_service.h"
 #include "diagnostics.h"
+#include "trace_recorder.h"
 #include "printf_export.h"
 #include "services_dynalib.h"
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace_recorder.h"
+
+#include "system_error.h"
+
+#if PARTICLE_TRACE_ENABLED
+
+#include "timer_hal.h"
+#include "endian_util.h"
+
+#if PLATFORM_THREADING
+#include "concurrent_hal.h"
+#endif
+
+#include <atomic>
+
+namespace {
+
+static_assert(PARTICLE_LITTLE_ENDIAN, "The trace dump format requires a little-endian platform");
+static_assert(sizeof(trace_record) == 24, "Unexpected size of trace_record");
+static_assert(sizeof(trace_dump_header) == 16, "Unexpected size of trace_dump_header");
+
+// The buffer is shared by all threads: the MCUs supported by Device OS run the system firmware on
+// a single core. A writer reserves a slot by incrementing the write counter and marks the record
+// as complete by setting its sequence number, so the recording never blocks
+class TraceBuffer {
+public:
+    TraceBuffer() :
+            records_(),
+            next_(0),
+            base_(0),
+            enabled_(true) {
+    }
+
+    void record(uint16_t id, uint8_t type, uint32_t arg1, uint32_t arg2) {
+        if (!enabled_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        const uint32_t seq = next_.fetch_add(1, std::memory_order_relaxed);
+        auto& r = records_[seq % PARTICLE_TRACE_BUFFER_SIZE];
+        __atomic_store_n(&r.seq, 0, __ATOMIC_RELAXED);
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        r.time = HAL_Timer_Get_Micro_Seconds();
+#if PLATFORM_THREADING
+        r.thread = (uint32_t)(uintptr_t)os_thread_current(nullptr);
+#else
+        r.thread = 0;
+#endif
+        r.arg1 = arg1;
+        r.arg2 = arg2;
+        r.id = id;
+        r.type = type;
+        r.reserved = 0;
+        __atomic_store_n(&r.seq, seq + 1, __ATOMIC_RELEASE);
+    }
+
+    int dump(appender_fn appender, void* data) {
+        const uint32_t end = next_.load(std::memory_order_acquire);
+        uint32_t begin = base_;
+        if (end - begin > PARTICLE_TRACE_BUFFER_SIZE) {
+            begin = end - PARTICLE_TRACE_BUFFER_SIZE;
+        }
+        trace_dump_header h = {};
+        h.magic = TRACE_DUMP_MAGIC;
+        h.version = TRACE_DUMP_VERSION;
+        h.record_size = sizeof(trace_record);
+        h.count = end - begin;
+        h.dropped = begin - base_;
+        if (!appender(data, (const uint8_t*)&h, sizeof(h))) {
+            return SYSTEM_ERROR_TOO_LARGE;
+        }
+        for (uint32_t seq = begin; seq != end; ++seq) {
+            const auto& src = records_[seq % PARTICLE_TRACE_BUFFER_SIZE];
+            trace_record r = src;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            if (__atomic_load_n(&src.seq, __ATOMIC_ACQUIRE) != seq + 1 || r.seq != seq + 1) {
+                // The record is being written or has been overwritten while it was copied
+                r = {};
+            }
+            if (!appender(data, (const uint8_t*)&r, sizeof(r))) {
+                return SYSTEM_ERROR_TOO_LARGE;
+            }
+        }
+        return 0;
+    }
+
+    void clear() {
+        base_ = next_.load(std::memory_order_acquire);
+    }
+
+    void enabled(bool enabled) {
+        enabled_.store(enabled, std::memory_order_relaxed);
+    }
+
+private:
+    trace_record records_[PARTICLE_TRACE_BUFFER_SIZE];
+    std::atomic<uint32_t> next_; // Sequence number of the next record
+    uint32_t base_; // Sequence number of the first record after the last clear()
+    std::atomic<bool> enabled_;
+};
+
+TraceBuffer g_traceBuffer;
+
+} // namespace
+
+void trace_record_event(uint16_t id, uint8_t type, uint32_t arg1, uint32_t arg2) {
+    g_traceBuffer.record(id, type, arg1, arg2);
+}
+
+void trace_set_enabled(int enabled) {
+    g_traceBuffer.enabled(enabled);
+}
+
+int trace_dump(appender_fn appender, void* appender_data, void* reserved) {
+    return g_traceBuffer.dump(appender, appender_data);
+}
+
+void trace_clear(void) {
+    g_traceBuffer.clear();
+}
+
+#else // !PARTICLE_TRACE_ENABLED
+
+void trace_record_event(uint16_t id, uint8_t type, uint32_t arg1, uint32_t arg2) {
+}
+
+void trace_set_enabled(int enabled) {
+}
+
+int trace_dump(appender_fn appender, void* appender_data, void* reserved) {
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+void trace_clear(void) {
+}
+
+#endif // !PARTICLE_TRACE_ENABLED
@@ -20,6 +20,7 @@
 #pragma once
 
 #include <cstddef>
+#include <atomic>
 
 #if PLATFORM_THREADING
 
@@ -27,10 +28,34 @@
 #include <mutex>
 #include <thread>
 #include <future>
+#include <type_traits>
 
 #include "channel.h"
 #include "concurrent_hal.h"
+#include "timer_hal.h"
 #include "hal_platform.h"
+#include "atomic_block_pool.h"
+
+/**
+ * Size of a block in the pool of task objects.
+ */
+#ifndef ACTIVE_OBJECT_TASK_BLOCK_SIZE
+#define ACTIVE_OBJECT_TASK_BLOCK_SIZE 48
+#endif
+
+/**
+ * Number of blocks in the pool of task objects.
+ */
+#ifndef ACTIVE_OBJECT_TASK_POOL_SIZE
+#define ACTIVE_OBJECT_TASK_POOL_SIZE 16
+#endif
+
+/**
+ * Number of completion semaphores kept for synchronous tasks.
+ */
+#ifndef ACTIVE_OBJECT_SEMAPHORE_POOL_SIZE
+#define ACTIVE_OBJECT_SEMAPHORE_POOL_SIZE 4
+#endif
 
 /**
  * Configuratino data for an active object.
@@ -42,6 +67,11 @@ struct ActiveObjectConfiguration
      */
     typedef std::function<void(void)> background_task_t;
 
+    /**
+     * Function that returns the time to wait for a message in the queue.
+     */
+    typedef unsigned (*take_wait_fn_t)(unsigned max_wait);
+
     /**
      * The function to run when there is nothing else to do.
      */
@@ -58,11 +88,23 @@ struct ActiveObjectConfiguration
      */
     unsigned take_wait;
 
+    /**
+     * Optional function that computes the time to wait for a message in the queue. The function
+     * is called with `take_wait` as the maximum time.
+     */
+    take_wait_fn_t take_wait_fn;
+
     /**
      * How long to wait to put items in the queue before giving up.
      */
     unsigned put_wait;
 
+    /**
+     * Maximum time in milliseconds to spend processing the messages in the queue before the
+     * background task is run. If set to 0, one message is processed at a time.
+     */
+    unsigned drain_time;
+
     /**
      * The message capacity of the queue.
      */
@@ -79,7 +121,9 @@ public:
             background_task(task),
             stack_size(stack_size_),
             take_wait(take_wait_),
+            take_wait_fn(nullptr),
             put_wait(put_wait_),
+            drain_time(0),
             queue_size(queue_size_),
             priority(priority) {
     }
@@ -92,11 +136,42 @@ class Message
 {
 
 public:
-    Message() {}
+    /**
+     * Time when the message was put in the queue (microseconds).
+     */
+    system_tick_t timestamp;
+
+    Message() : timestamp(0) {}
     virtual void operator()()=0;
     virtual ~Message() {}
 };
 
+/**
+ * Statistics of the message queue of an active object.
+ */
+struct ActiveObjectStats
+{
+    /**
+     * Number of processed messages.
+     */
+    uint32_t processed;
+
+    /**
+     * Number of messages in the queue.
+     */
+    uint32_t depth;
+
+    /**
+     * Maximum number of messages in the queue.
+     */
+    uint32_t max_depth;
+
+    /**
+     * Maximum time a message spent in the queue (microseconds).
+     */
+    uint32_t max_latency;
+};
+
 /**
  * Abstract task. Subclasses must define invoke() and task_complete()
  */
@@ -247,11 +322,108 @@ public:
 };
 
 
+/**
+ * An asynchronous task that stores the callable object inline. Disposes itself when complete.
+ */
+template<typename F>
+class InlineAsyncTask : public Message
+{
+    F fn;
+
+public:
+    template<typename FnT>
+    explicit InlineAsyncTask(FnT&& fn_) : fn(std::forward<FnT>(fn_)) {}
+
+    void operator()() override;
+};
+
+/**
+ * Completion semaphore of a synchronous task. The semaphores are taken from a pool shared by all
+ * active objects, and each one is created the first time its block is used and never destroyed.
+ * A semaphore is created and destroyed with the task only if the pool is exhausted.
+ */
+class TaskCompletion
+{
+public:
+    using SemaphorePool = particle::AtomicBlockPool<sizeof(os_semaphore_t), ACTIVE_OBJECT_SEMAPHORE_POOL_SIZE>;
+
+private:
+    os_semaphore_t* pooled;
+    os_semaphore_t sem;
+
+    static SemaphorePool semaphore_pool;
+
+public:
+    TaskCompletion();
+    ~TaskCompletion();
+
+    TaskCompletion(const TaskCompletion&) = delete;
+    TaskCompletion& operator=(const TaskCompletion&) = delete;
+
+    bool isValid() const
+    {
+        return sem;
+    }
+
+    void signal()
+    {
+        os_semaphore_give(sem, false);
+    }
+
+    void wait()
+    {
+        os_semaphore_take(sem, CONCURRENT_WAIT_FOREVER, false);
+    }
+};
+
+/**
+ * A synchronous task that stores a reference to the callable object. The task object is expected
+ * to be allocated on the stack of the calling thread.
+ */
+template<typename F>
+class InlineSyncTask : public Message
+{
+public:
+    typedef typename std::decay<decltype(std::declval<F&>()())>::type ResultType;
+
+private:
+    F& fn;
+    ResultType result;
+    TaskCompletion complete;
+
+public:
+    explicit InlineSyncTask(F& fn_) : fn(fn_), result()
+    {
+    }
+
+    bool isValid() const
+    {
+        return complete.isValid();
+    }
+
+    void operator()() override
+    {
+        result = fn();
+        complete.signal();
+    }
+
+    ResultType get()
+    {
+        complete.wait();
+        return result;
+    }
+};
+
 class ActiveObjectBase
 {
 public:
     using Item = Message*;
 
+    /**
+     * Pool of task objects shared by all active objects.
+     */
+    using TaskPool = particle::AtomicBlockPool<ACTIVE_OBJECT_TASK_BLOCK_SIZE, ACTIVE_OBJECT_TASK_POOL_SIZE>;
+
 protected:
 
     ActiveObjectConfiguration configuration;
@@ -265,16 +437,55 @@ protected:
 
     volatile bool started;
 
+    std::atomic<uint32_t> queue_depth;
+    std::atomic<uint32_t> max_queue_depth;
+    uint32_t processed_count;
+    uint32_t max_queue_latency;
+
+    static TaskPool task_pool;
+
     /**
      * The main run loop for an active object.
      */
     void run();
 
+    /**
+     * Put a message in the queue and update the statistics.
+     */
+    bool enqueue(Item item)
+    {
+        item->timestamp = HAL_Timer_Get_Micro_Seconds();
+        const uint32_t depth = ++queue_depth;
+        uint32_t max_depth = max_queue_depth.load(std::memory_order_relaxed);
+        while (depth > max_depth && !max_queue_depth.compare_exchange_weak(max_depth, depth, std::memory_order_relaxed)) {
+        }
+        if (!put(item))
+        {
+            --queue_depth;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Update the statistics and run a message taken from the queue.
+     */
+    void dispatch(Item item);
+
+    /**
+     * Time to wait for a message in the queue.
+     */
+    unsigned takeWait() const
+    {
+        return configuration.take_wait_fn ? configuration.take_wait_fn(configuration.take_wait) : configuration.take_wait;
+    }
+
 protected:
 
 
     // todo - concurrent queue should be a strategy so it's pluggable without requiring inheritance
     virtual bool take(Item& item)=0;
+    virtual bool try_take(Item& item)=0;
     virtual bool put(Item& item)=0;
 
     /**
@@ -290,7 +501,11 @@ public:
     ActiveObjectBase(const ActiveObjectConfiguration& config) :
             configuration(config),
             _thread(OS_THREAD_INVALID_HANDLE),
-            started(false) {
+            started(false),
+            queue_depth(0),
+            max_queue_depth(0),
+            processed_count(0),
+            max_queue_latency(0) {
     }
 
     bool process();
@@ -307,13 +522,29 @@ public:
         return started;
     }
 
+    ActiveObjectStats stats() const
+    {
+        ActiveObjectStats s = {};
+        s.processed = processed_count;
+        s.depth = queue_depth.load(std::memory_order_relaxed);
+        s.max_depth = max_queue_depth.load(std::memory_order_relaxed);
+        s.max_latency = max_queue_latency;
+        return s;
+    }
+
+    void resetStats()
+    {
+        processed_count = 0;
+        max_queue_depth = queue_depth.load(std::memory_order_relaxed);
+        max_queue_latency = 0;
+    }
+
     template<typename R> void invoke_async(const std::function<R(void)>& work)
     {
         auto task = new AsyncTask<R>(work);
         if (task)
         {
-			Item message = task;
-			if (!put(message))
+			if (!enqueue(task))
 				delete task;
         }
 	}
@@ -323,8 +554,7 @@ public:
         auto promise = new SystemPromise<R>(work);
         if (promise)
         {
-			Item message = promise;
-			if (!put(message))
+			if (!enqueue(promise))
 			{
 				delete promise;
 				promise = nullptr;
@@ -333,8 +563,79 @@ public:
         return promise;
     }
 
+    /**
+     * Asynchronously invoke a callable object. Unlike `invoke_async()`, the callable object is
+     * stored inline in a task object allocated from a pool. The heap is only used if the pool
+     * is exhausted or the callable object doesn't fit in a block.
+     */
+    template<typename F> bool invoke_async_inline(F&& fn)
+    {
+        using Task = InlineAsyncTask<typename std::decay<F>::type>;
+        Task* task = nullptr;
+        if (sizeof(Task) <= TaskPool::blockSize() && alignof(Task) <= alignof(std::max_align_t))
+        {
+            void* p = task_pool.alloc();
+            if (p)
+            {
+                task = new(p) Task(std::forward<F>(fn));
+            }
+        }
+        if (!task)
+        {
+            task = new(std::nothrow) Task(std::forward<F>(fn));
+            if (!task)
+            {
+                return false;
+            }
+        }
+        if (!enqueue(task))
+        {
+            destroy_task(task);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Invoke a callable object and wait for the result. The task object is allocated on the
+     * stack of the calling thread.
+     *
+     * @return Result of the call, or a value-initialized result if the call could not be queued.
+     */
+    template<typename F> typename InlineSyncTask<F>::ResultType invoke_sync_inline(F fn)
+    {
+        InlineSyncTask<F> task(fn);
+        if (!task.isValid() || !enqueue(&task))
+        {
+            return typename InlineSyncTask<F>::ResultType();
+        }
+        return task.get();
+    }
+
+    /**
+     * Destroy a task object created by `invoke_async_inline()`.
+     */
+    template<typename T> static void destroy_task(T* task)
+    {
+        if (task_pool.owns(task))
+        {
+            task->~T();
+            task_pool.free(task);
+        }
+        else
+        {
+            delete task;
+        }
+    }
+
 };
 
+template<typename F>
+void InlineAsyncTask<F>::operator()()
+{
+    fn();
+    ActiveObjectBase::destroy_task(this);
+}
 
 template <size_t queue_size=50>
 class ActiveObjectChannel : public ActiveObjectBase
@@ -348,6 +649,11 @@ protected:
         return cpp::select().recv_only(_channel, item).try_once();
     }
 
+    virtual bool try_take(Item& item) override
+    {
+        return take(item);
+    }
+
     virtual bool put(const Item& item) override
     {
         _channel.send(item);
@@ -378,7 +684,12 @@ protected:
 
     virtual bool take(Item& result)
     {
-        return !os_queue_take(queue, &result, configuration.take_wait, nullptr);
+        return !os_queue_take(queue, &result, takeWait(), nullptr);
+    }
+
+    virtual bool try_take(Item& result)
+    {
+        return !os_queue_take(queue, &result, 0, nullptr);
     }
 
     virtual bool put(Item& item)
@@ -442,7 +753,11 @@ public:
 #if HAL_PLATFORM_SOCKET_IOCTL_NOTIFY
     virtual bool take(Item& result) override
     {
-        auto r = os_thread_wait(configuration.take_wait, nullptr);
+        // Messages left in the queue after the previous pass don't generate a notification
+        if (try_take(result)) {
+            return true;
+        }
+        auto r = os_thread_wait(takeWait(), nullptr);
         if (!os_queue_take(queue, &result, 0, nullptr)) {
             return true;
         }
@@ -481,6 +796,12 @@ public:
 /**
  * This class implements a queue of asynchronous calls that can be scheduled from an ISR and then
  * invoked from an event loop running in a regular thread.
+ *
+ * Any number of threads and ISRs can enqueue tasks, but only one thread is allowed to process
+ * them. The queue is lock-free: tasks are pushed onto an intrusive list with a CAS operation and
+ * the processing thread takes the entire list at once, so interrupts are never disabled.
+ *
+ * A task that is enqueued again while it's still pending is only invoked once.
  */
 class ISRTaskQueue {
 public:
@@ -490,24 +811,36 @@ public:
     struct Task {
         TaskFunc func;
         Task* next; // Next element in the queue
+        bool pending; // Whether the task is in the queue
 
         explicit Task(TaskFunc func = nullptr) :
                 func(func),
-                next(nullptr) {
+                next(nullptr),
+                pending(false) {
         }
 
         virtual ~Task() = default;
     };
 
     ISRTaskQueue() :
-            firstTask_(nullptr),
-            lastTask_(nullptr) {
+            head_(nullptr) {
     }
 
-    void enqueue(Task* task);
+    /**
+     * Add a task to the queue. This method can be called from an ISR.
+     *
+     * @return `false` if the task is already pending, otherwise `true`.
+     */
+    bool enqueue(Task* task);
+
+    /**
+     * Invoke the tasks that were enqueued before this method was called, in the order in which
+     * they were enqueued.
+     *
+     * @return `true` if at least one task was invoked, otherwise `false`.
+     */
     bool process();
 
 private:
-    Task* volatile firstTask_;
-    Task* lastTask_;
+    std::atomic<Task*> head_; // Most recently enqueued task
 };
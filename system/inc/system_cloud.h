@@ -347,7 +347,12 @@ typedef enum spark_connection_property {
     SPARK_CLOUD_DISCONNECT_OPTIONS = 2, ///< Default disconnection options (set).
     SPARK_CLOUD_MAX_EVENT_DATA_SIZE = 3, ///< Maximum size of event data (get).
     SPARK_CLOUD_MAX_VARIABLE_VALUE_SIZE = 4, ///< Maximum size of a variable value (get).
-    SPARK_CLOUD_MAX_FUNCTION_ARGUMENT_SIZE = 5 ///< Maximum size of a function call argument (get).
+    SPARK_CLOUD_MAX_FUNCTION_ARGUMENT_SIZE = 5, ///< Maximum size of a function call argument (get).
+    SPARK_CLOUD_VITALS_DELTA_KEYFRAME_INTERVAL = 6, ///< Number of vitals publications between full snapshots.
+                                                    ///< Setting the interval to 0 disables the delta encoding of vitals (set).
+    SPARK_CLOUD_VITALS_DELTA_THRESHOLD = 7, ///< Minimum change of a diagnostic value that is published in a delta snapshot.
+                                            ///< The `data` argument is a pointer to the `uint16_t` ID of the diagnostic source (set).
+    SPARK_CLOUD_FAST_RESUME_ENABLED = 8 ///< Enable/disable fast resumption of the cloud session (set).
 } spark_connection_property;
 
 int spark_set_connection_property(unsigned property, unsigned value, const void* data, void* reserved);
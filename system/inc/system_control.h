@@ -62,6 +62,8 @@ typedef enum ctrl_request_type {
     CTRL_REQUEST_LOG_CONFIG = 80,
     CTRL_REQUEST_GET_MODULE_INFO = 90,
     CTRL_REQUEST_DIAGNOSTIC_INFO = 100,
+    CTRL_REQUEST_DIAGNOSTIC_TRACE = 101,
+    CTRL_REQUEST_DIAGNOSTIC_RESET_LOOP_STATS = 102,
     // CTRL_REQUEST_WIFI_SET_ANTENNA = 110,
     // CTRL_REQUEST_WIFI_GET_ANTENNA = 111,
     // CTRL_REQUEST_WIFI_SCAN = 112,
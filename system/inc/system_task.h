@@ -27,6 +27,7 @@
 #ifndef __SPARK_WLAN_H
 #define __SPARK_WLAN_H
 
+#include "hal_platform.h"
 #include "socket_hal.h"
 #include "system_cloud.h"
 #include "wlan_hal.h"
@@ -74,6 +75,30 @@ extern bool APPLICATION_SETUP_DONE;
 
 void system_delay_ms(unsigned long ms, bool no_background_loop);
 
+/**
+ * Interval in milliseconds at which the system loop polls the subsystems that are busy.
+ */
+#define SYSTEM_LOOP_ACTIVE_TIMEOUT 100
+
+/**
+ * Maximum time in milliseconds the system loop sleeps while none of the subsystems is busy.
+ *
+ * The system thread can only be woken up early on platforms where it waits for a thread
+ * notification, which is also how the socket HAL signals incoming data. Elsewhere, the loop keeps
+ * polling at the active rate.
+ */
+#if HAL_PLATFORM_SOCKET_IOCTL_NOTIFY
+#define SYSTEM_LOOP_IDLE_TIMEOUT 1000
+#else
+#define SYSTEM_LOOP_IDLE_TIMEOUT SYSTEM_LOOP_ACTIVE_TIMEOUT
+#endif
+
+/**
+ * Returns the time in milliseconds until the next pass of the system loop is due.
+ * @param max_timeout the maximum time to return.
+ */
+unsigned system_loop_timeout(unsigned max_timeout);
+
 /**
  * Determines the backoff period after a number of failed connections.
  */
@@ -74,15 +74,13 @@ os_mutex_recursive_t mutex_usb_serial();
 
 #define _THREAD_CONTEXT_ASYNC_RESULT(thread, fn, result) \
     if (thread.isStarted() && !thread.isCurrentThread()) { \
-        auto lambda = [=]() { (fn); }; \
-        thread.invoke_async(particle::FFL(lambda)); \
+        thread.invoke_async_inline([=]() { (fn); }); \
         return result; \
     }
 
 #define _THREAD_CONTEXT_ASYNC(thread, fn) \
     if (thread.isStarted() && !thread.isCurrentThread()) { \
-        auto lambda = [=]() { (fn); }; \
-        thread.invoke_async(particle::FFL(lambda)); \
+        thread.invoke_async_inline([=]() { (fn); }); \
         return; \
     }
 
@@ -92,11 +90,7 @@ os_mutex_recursive_t mutex_usb_serial();
 // parameters passed by copy.
 #define SYSTEM_THREAD_CONTEXT_SYNC(fn) \
     if (particle::SystemThread.isStarted() && !particle::SystemThread.isCurrentThread()) { \
-        auto callable = particle::FFL([=]() { return (fn); }); \
-        auto future = particle::SystemThread.invoke_future(callable); \
-        auto result = future ? future->get() : 0;  \
-        delete future; \
-        return result; \
+        return particle::SystemThread.invoke_sync_inline([=]() { return (fn); }); \
     }
 
 #define SYSTEM_THREAD_CURRENT() (particle::SystemThread.isCurrentThread())
@@ -19,7 +19,6 @@
 
 #include "active_object.h"
 #include "system_threading.h"
-#include "spark_wiring_interrupts.h"
 #include "debug.h"
 
 using namespace particle;
@@ -75,17 +74,71 @@ void ActiveObjectBase::run()
 #endif // !HAL_PLATFORM_SOCKET_IOCTL_NOTIFY
 }
 
+ActiveObjectBase::TaskPool ActiveObjectBase::task_pool;
+
+TaskCompletion::SemaphorePool TaskCompletion::semaphore_pool;
+
+TaskCompletion::TaskCompletion() :
+        pooled(static_cast<os_semaphore_t*>(semaphore_pool.alloc())),
+        sem(nullptr)
+{
+    if (pooled)
+    {
+        // The blocks of the pool are zero-initialized and keep their contents when freed
+        if (!*pooled && os_semaphore_create(pooled, 1, 0) != 0)
+        {
+            *pooled = nullptr;
+        }
+        sem = *pooled;
+    }
+    else
+    {
+        os_semaphore_create(&sem, 1, 0);
+    }
+}
+
+TaskCompletion::~TaskCompletion()
+{
+    if (pooled)
+    {
+        // The semaphore is either never given or given and taken once, so its count is back to 0
+        semaphore_pool.free(pooled);
+    }
+    else if (sem)
+    {
+        os_semaphore_destroy(sem);
+    }
+}
+
 bool ActiveObjectBase::process()
 {
-    bool result = false;
     Item item = nullptr;
-    if (take(item) && item)
+    if (!take(item) || !item)
     {
-        Message& msg = *item;
-        msg();
-        result = true;
+        return false;
     }
-    return result;
+    // Drain the queue until it's empty or the time budget is exhausted
+    const system_tick_t start = HAL_Timer_Get_Milli_Seconds();
+    do
+    {
+        dispatch(item);
+        item = nullptr;
+    } while (configuration.drain_time && HAL_Timer_Get_Milli_Seconds() - start < configuration.drain_time &&
+            try_take(item) && item);
+    return true;
+}
+
+void ActiveObjectBase::dispatch(Item item)
+{
+    --queue_depth;
+    const system_tick_t latency = HAL_Timer_Get_Micro_Seconds() - item->timestamp;
+    if (latency > max_queue_latency)
+    {
+        max_queue_latency = latency;
+    }
+    ++processed_count;
+    Message& msg = *item;
+    msg();
 }
 
 void ActiveObjectBase::run_active_object(void* data)
@@ -96,37 +149,41 @@ void ActiveObjectBase::run_active_object(void* data)
 
 #endif // PLATFORM_THREADING
 
-void ISRTaskQueue::enqueue(Task* task) {
-    ATOMIC_BLOCK() {
-        // Add task object to the queue
-        if (lastTask_) {
-            lastTask_->next = task;
-        } else { // The queue is empty
-            firstTask_ = task;
-        }
-        task->next = nullptr;
-        lastTask_ = task;
+bool ISRTaskQueue::enqueue(Task* task) {
+    if (__atomic_exchange_n(&task->pending, true, __ATOMIC_ACQ_REL)) {
+        return false; // The task is already in the queue
     }
+    Task* head = head_.load(std::memory_order_relaxed);
+    do {
+        task->next = head;
+    } while (!head_.compare_exchange_weak(head, task, std::memory_order_release, std::memory_order_relaxed));
 // FIXME: some other feature flag?
 #if HAL_PLATFORM_SOCKET_IOCTL_NOTIFY
     SystemThread.notify();
 #endif // HAL_PLATFORM_SOCKET_IOCTL_NOTIFY
+    return true;
 }
 
 bool ISRTaskQueue::process() {
-    Task* task = nullptr;
-    if (!firstTask_) {
+    if (!head_.load(std::memory_order_relaxed)) {
         return false;
     }
-    ATOMIC_BLOCK() {
-        // Take task object from the queue
-        task = firstTask_;
-        firstTask_ = task->next;
-        if (!firstTask_) {
-            lastTask_ = nullptr;
-        }
+    // Take all pending tasks and restore their order
+    Task* task = head_.exchange(nullptr, std::memory_order_acquire);
+    Task* first = nullptr;
+    while (task) {
+        Task* const next = task->next;
+        task->next = first;
+        first = task;
+        task = next;
+    }
+    while (first) {
+        task = first;
+        first = task->next;
+        task->next = nullptr;
+        // The task can be enqueued again, or destroyed, by its own function
+        __atomic_store_n(&task->pending, false, __ATOMIC_RELEASE);
+        task->func(task);
     }
-    // Invoke task function
-    task->func(task);
     return true;
 }
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "firmware_chunk_pipeline.h"
+
+#if SYSTEM_CONTROL_ENABLED
+
+#include "system_error.h"
+
+namespace particle {
+
+namespace control {
+
+const size_t FirmwareChunkPipeline::MAX_PENDING_CHUNKS;
+
+FirmwareChunkPipeline::FirmwareChunkPipeline(WriteFunc write, CompletionFunc complete, void* ctx) :
+        entries_(),
+        head_(0),
+        written_(0),
+        tail_(0),
+        queuedBytes_(0),
+        bytesWritten_(0),
+        error_(0),
+        write_(write),
+        complete_(complete),
+        ctx_(ctx) {
+}
+
+int FirmwareChunkPipeline::push(ctrl_request* req, const char* data, size_t size) {
+    const int error = error_.load(std::memory_order_relaxed);
+    if (error < 0) {
+        return error;
+    }
+    const unsigned tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_ >= MAX_PENDING_CHUNKS) {
+        return SYSTEM_ERROR_LIMIT_EXCEEDED;
+    }
+    auto& e = entries_[tail % MAX_PENDING_CHUNKS];
+    e.req = req;
+    e.data = data;
+    e.size = size;
+    e.offset = queuedBytes_;
+    e.result = 0;
+    queuedBytes_ += size;
+    tail_.store(tail + 1, std::memory_order_release);
+    return 0;
+}
+
+bool FirmwareChunkPipeline::process() {
+    const unsigned written = written_.load(std::memory_order_relaxed);
+    if (written == tail_.load(std::memory_order_acquire)) {
+        return false;
+    }
+    auto& e = entries_[written % MAX_PENDING_CHUNKS];
+    int result = error_.load(std::memory_order_relaxed);
+    if (result == 0) {
+        result = write_(e.data, e.size, e.offset, ctx_);
+        if (result < 0) {
+            error_.store(result, std::memory_order_relaxed);
+        } else {
+            result = 0;
+            bytesWritten_.fetch_add(e.size, std::memory_order_relaxed);
+        }
+    }
+    e.result = result;
+    written_.store(written + 1, std::memory_order_release);
+    return true;
+}
+
+bool FirmwareChunkPipeline::complete() {
+    const unsigned written = written_.load(std::memory_order_acquire);
+    if (head_ == written) {
+        return false;
+    }
+    while (head_ != written) {
+        const auto& e = entries_[head_ % MAX_PENDING_CHUNKS];
+        complete_(e.req, e.data, e.size, e.offset, e.result, ctx_);
+        ++head_;
+    }
+    return true;
+}
+
+void FirmwareChunkPipeline::cancel() {
+    const unsigned tail = tail_.load(std::memory_order_relaxed);
+    while (head_ != tail) {
+        const auto& e = entries_[head_ % MAX_PENDING_CHUNKS];
+        complete_(e.req, e.data, e.size, e.offset, SYSTEM_ERROR_CANCELLED, ctx_);
+        ++head_;
+    }
+    written_.store(tail, std::memory_order_relaxed);
+}
+
+} // namespace particle::control
+
+} // namespace particle
+
+#endif // SYSTEM_CONTROL_ENABLED
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_control.h"
+
+#if SYSTEM_CONTROL_ENABLED
+
+#include <atomic>
+#include <cstddef>
+
+namespace particle {
+
+namespace control {
+
+/**
+ * Ring of firmware update chunks waiting to be written to flash.
+ *
+ * A data request stays open while its chunk is queued: the chunk is written directly from the
+ * request buffer, and the request is completed once the chunk is written. The completion carries
+ * the total number of bytes written so far, which lets the host keep several requests in flight
+ * and treat the replies as cumulative acknowledgements.
+ *
+ * Only the raw flash writes are performed by the flash worker. The written chunks are handed back
+ * to the thread processing control requests, which updates the state of the firmware update and
+ * completes the requests while their buffers are still valid.
+ *
+ * `push()`, `complete()` and `cancel()` are called by the thread processing control requests,
+ * `process()` is called by the flash worker. `cancel()` must not run concurrently with `process()`.
+ */
+class FirmwareChunkPipeline {
+public:
+    /**
+     * Maximum number of chunks that can be queued at the same time.
+     */
+    static const size_t MAX_PENDING_CHUNKS = 4;
+
+    /**
+     * Writes a chunk of the binary to flash.
+     *
+     * This function is called by the flash worker.
+     */
+    typedef int (*WriteFunc)(const char* data, size_t size, size_t offset, void* ctx);
+
+    /**
+     * Completes a data request.
+     *
+     * This function is called by the thread processing control requests.
+     */
+    typedef void (*CompletionFunc)(ctrl_request* req, const char* data, size_t size, size_t offset, int result, void* ctx);
+
+    FirmwareChunkPipeline(WriteFunc write, CompletionFunc complete, void* ctx);
+
+    /**
+     * Queue a chunk.
+     *
+     * On success, the request will be completed by `complete()` or `cancel()`. Otherwise, the
+     * request needs to be completed by the caller.
+     *
+     * @return 0 on success, otherwise an error code defined by `system_error_t`.
+     */
+    int push(ctrl_request* req, const char* data, size_t size);
+
+    /**
+     * Write the oldest chunk that hasn't been written yet.
+     *
+     * After a write error, the remaining chunks are marked with the same error without being
+     * written.
+     *
+     * @return `true` if a chunk was processed, or `false` if there are no chunks to write.
+     */
+    bool process();
+
+    /**
+     * Complete the requests whose chunks have been processed by `process()`.
+     *
+     * @return `true` if at least one request was completed, otherwise `false`.
+     */
+    bool complete();
+
+    /**
+     * Complete all queued requests with `SYSTEM_ERROR_CANCELLED`.
+     */
+    void cancel();
+
+    /**
+     * Get the number of requests that haven't been completed yet.
+     */
+    size_t pendingCount() const;
+    size_t bytesWritten() const;
+
+    /**
+     * Get the error code of the first failed write, or 0 if there were no errors.
+     */
+    int error() const;
+
+private:
+    struct Entry {
+        ctrl_request* req;
+        const char* data;
+        size_t size;
+        size_t offset;
+        int result;
+    };
+
+    Entry entries_[MAX_PENDING_CHUNKS];
+    unsigned head_; // Oldest request that hasn't been completed
+    std::atomic<unsigned> written_; // Oldest chunk that hasn't been written, modified by the flash worker
+    std::atomic<unsigned> tail_; // Modified by the producer
+    size_t queuedBytes_;
+    std::atomic<size_t> bytesWritten_;
+    std::atomic<int> error_;
+    WriteFunc write_;
+    CompletionFunc complete_;
+    void* ctx_;
+};
+
+inline size_t FirmwareChunkPipeline::pendingCount() const {
+    return tail_.load(std::memory_order_relaxed) - head_;
+}
+
+inline size_t FirmwareChunkPipeline::bytesWritten() const {
+    return bytesWritten_.load(std::memory_order_relaxed);
+}
+
+inline int FirmwareChunkPipeline::error() const {
+    return error_.load(std::memory_order_relaxed);
+}
+
+} // namespace particle::control
+
+} // namespace particle
+
+#endif // SYSTEM_CONTROL_ENABLED
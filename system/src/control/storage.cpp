@@ -19,49 +19,299 @@
 
 #if SYSTEM_CONTROL_ENABLED
 
+#include "firmware_chunk_pipeline.h"
+
 #include "system_update.h"
 #include "system_network.h"
+#include "system_threading.h"
+#include "firmware_update.h"
+#if SYSTEM_CONTROL_NANOPB_FALLBACK
 #include "common.h"
+#endif
 
 #include "ota_flash_hal_impl.h"
+#include "ota_flash_hal.h"
 
 #include "delay_hal.h"
+#include "concurrent_hal.h"
 
 #include "protocol_defs.h" // For UpdateFlag enum
-#include "nanopb_misc.h"
+#include "protobuf_wire.h"
+#include "varint.h"
 #include "scope_guard.h"
+#include "thread_runner.h"
+#include "runnable.h"
 #include "check.h"
 
 #include "platforms.h"
 
 #include "control/storage.pb.h"
+#include "firmware_update.pb.h"
 
+#include <algorithm>
 #include <memory>
+#include <cstring>
 
 #define PB(_name) particle_ctrl_##_name
+#define EXT(_name) particle_firmware_##_name
 
 namespace particle {
 
 namespace control {
 
 using namespace protocol;
-using namespace common;
 
 namespace {
 
+#if PLATFORM_THREADING
+
+// Maximum time the flash worker waits for new chunks before checking if it needs to stop
+const system_tick_t FLASH_WORKER_WAIT_TIMEOUT = 100;
+
+void completeWrittenChunks(ISRTaskQueue::Task* task);
+
+// Hands the written chunks back to the system thread
+ISRTaskQueue::Task g_chunksWrittenTask(completeWrittenChunks);
+
+// Writes queued firmware chunks to flash in the pipelined mode
+class FlashWorker: public Runnable {
+public:
+    explicit FlashWorker(FirmwareChunkPipeline* pipeline) :
+            pipeline_(pipeline),
+            sem_(nullptr) {
+    }
+
+    ~FlashWorker() {
+        destroy();
+    }
+
+    int init() {
+        if (os_semaphore_create(&sem_, FirmwareChunkPipeline::MAX_PENDING_CHUNKS, 0) != 0) {
+            sem_ = nullptr;
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+        const int r = runner_.init(this, ThreadRunnerOptions().threadName("fw_update"));
+        if (r < 0) {
+            destroy();
+            return r;
+        }
+        return 0;
+    }
+
+    void destroy() {
+        runner_.destroy();
+        if (sem_) {
+            os_semaphore_destroy(sem_);
+            sem_ = nullptr;
+        }
+    }
+
+    void notify() {
+        os_semaphore_give(sem_, false);
+    }
+
+    int run() override {
+        os_semaphore_take(sem_, FLASH_WORKER_WAIT_TIMEOUT, false);
+        while (pipeline_->process()) {
+            SystemISRTaskQueue.enqueue(&g_chunksWrittenTask);
+        }
+        return 0;
+    }
+
+private:
+    ThreadRunner runner_;
+    FirmwareChunkPipeline* pipeline_;
+    os_semaphore_t sem_;
+};
+
+#endif // PLATFORM_THREADING
+
 // TODO: Move handling of compressed firmware binaries to the common system code
 struct FirmwareUpdate {
     FileTransfer::Descriptor descr; // File transfer descriptor
     size_t bytesLeft; // Number of remaining bytes to receive
     size_t bytesWritten; // Number of bytes written to the OTA section
+#if PLATFORM_THREADING
+    std::unique_ptr<FirmwareChunkPipeline> pipeline; // Queued chunks (pipelined mode only)
+    std::unique_ptr<FlashWorker> worker; // Flash worker (pipelined mode only)
+#endif
 };
 
 std::unique_ptr<FirmwareUpdate> g_update;
 
+// The firmware update messages are decoded and encoded without nanopb, so that the fields used by
+// the pipelined mode (see firmware_update.proto) can be handled in the same pass as the fields of
+// the control request messages, and the chunk data can be returned as a pointer into the request
+// buffer. A data request that uses an encoding the fast decoder doesn't handle is decoded with
+// nanopb unless SYSTEM_CONTROL_NANOPB_FALLBACK is disabled
+
+int readVarintField(const ProtobufField& field, uint32_t* val) {
+    CHECK_TRUE(field.type == ProtobufWireType::VARINT, SYSTEM_ERROR_BAD_DATA);
+    *val = field.value;
+    return 0;
+}
+
+int decodeStartFirmwareUpdateRequest(ctrl_request* req, uint32_t* fileSize, uint32_t* format, uint32_t* maxPendingChunks) {
+    *fileSize = 0;
+    *format = PB(FileFormat_BIN);
+    *maxPendingChunks = 0;
+    ProtobufReader reader((const char*)req->request_data, req->request_size);
+    ProtobufField field = {};
+    int r = 0;
+    while ((r = reader.next(&field)) > 0) {
+        if (field.tag == PB(StartFirmwareUpdateRequest_size_tag)) {
+            CHECK(readVarintField(field, fileSize));
+        } else if (field.tag == PB(StartFirmwareUpdateRequest_format_tag)) {
+            CHECK(readVarintField(field, format));
+        } else if (field.tag == EXT(StartFirmwareUpdateRequestExt_max_pending_chunks_tag)) {
+            CHECK(readVarintField(field, maxPendingChunks));
+        }
+    }
+    CHECK_FALSE(r < 0, SYSTEM_ERROR_BAD_DATA);
+    return 0;
+}
+
+int encodeStartFirmwareUpdateReply(ctrl_request* req, size_t chunkSize, size_t maxPendingChunks) {
+    char buf[(maxUnsignedVarintSize<uint32_t>() + 1) * 2];
+    ProtobufWriter writer(buf, sizeof(buf));
+    writer.writeVarint(PB(StartFirmwareUpdateReply_chunk_size_tag), chunkSize);
+    if (maxPendingChunks) {
+        writer.writeVarint(EXT(StartFirmwareUpdateReplyExt_max_pending_chunks_tag), maxPendingChunks);
+    }
+    CHECK(system_ctrl_alloc_reply_data(req, writer.dataSize(), nullptr));
+    memcpy(req->reply_data, buf, writer.dataSize());
+    return 0;
+}
+
+int decodeFinishFirmwareUpdateRequest(ctrl_request* req, bool* validateOnly) {
+    *validateOnly = false;
+    ProtobufReader reader((const char*)req->request_data, req->request_size);
+    ProtobufField field = {};
+    int r = 0;
+    while ((r = reader.next(&field)) > 0) {
+        if (field.tag == PB(FinishFirmwareUpdateRequest_validate_only_tag)) {
+            uint32_t val = 0;
+            CHECK(readVarintField(field, &val));
+            *validateOnly = val;
+        }
+    }
+    CHECK_FALSE(r < 0, SYSTEM_ERROR_BAD_DATA);
+    return 0;
+}
+
+int decodeFirmwareUpdateDataRequest(ctrl_request* req, uint32_t* offset, const char** data, size_t* size) {
+    *offset = 0;
+    *data = nullptr;
+    *size = 0;
+    ProtobufReader reader((const char*)req->request_data, req->request_size);
+    ProtobufField field = {};
+    int r = 0;
+    while ((r = reader.next(&field)) > 0) {
+        if (field.tag == PB(FirmwareUpdateDataRequest_data_tag)) {
+            CHECK_TRUE(field.type == ProtobufWireType::LENGTH_DELIMITED, SYSTEM_ERROR_NOT_SUPPORTED);
+            *data = field.data;
+            *size = field.size;
+        } else if (field.tag == EXT(FirmwareUpdateDataRequestExt_offset_tag)) {
+            CHECK_TRUE(field.type == ProtobufWireType::VARINT, SYSTEM_ERROR_NOT_SUPPORTED);
+            *offset = field.value;
+        }
+    }
+    CHECK_FALSE(r < 0, SYSTEM_ERROR_BAD_DATA);
+    return 0;
+}
+
+#if SYSTEM_CONTROL_NANOPB_FALLBACK
+
+int decodeFirmwareUpdateDataRequestPb(ctrl_request* req, uint32_t* offset, const char** data, size_t* size) {
+    PB(FirmwareUpdateDataRequest) pbReq = {};
+    common::DecodedString pbData(&pbReq.data);
+    CHECK(common::decodeRequestMessage(req, PB(FirmwareUpdateDataRequest_fields), &pbReq));
+    // The fields of the pipelined mode are defined in a separate message
+    EXT(FirmwareUpdateDataRequestExt) pbExt = {};
+    CHECK(common::decodeRequestMessage(req, EXT(FirmwareUpdateDataRequestExt_fields), &pbExt));
+    *offset = pbExt.offset;
+    *data = pbData.data;
+    *size = pbData.size;
+    return 0;
+}
+
+#endif // SYSTEM_CONTROL_NANOPB_FALLBACK
+
+int encodeFirmwareUpdateDataReply(ctrl_request* req, size_t bytesWritten) {
+    char buf[maxUnsignedVarintSize<uint32_t>() + 1];
+    ProtobufWriter writer(buf, sizeof(buf));
+    writer.writeVarint(EXT(FirmwareUpdateDataReplyExt_bytes_written_tag), bytesWritten);
+    CHECK(system_ctrl_alloc_reply_data(req, writer.dataSize(), nullptr));
+    memcpy(req->reply_data, buf, writer.dataSize());
+    return 0;
+}
+
+int saveFirmwareChunk(FirmwareUpdate* update, const char* data, size_t size) {
+    update->descr.chunk_size = size;
+    CHECK(Spark_Save_Firmware_Chunk(update->descr, (const uint8_t*)data, nullptr));
+    update->descr.chunk_address += size;
+    update->bytesWritten += size;
+    return 0;
+}
+
+#if PLATFORM_THREADING
+
+// Note: This function is called by the flash worker. The firmware update state is owned by the
+// system thread, so only the raw flash write is performed here
+int writeFirmwareChunk(const char* data, size_t size, size_t offset, void* ctx) {
+    const auto update = static_cast<FirmwareUpdate*>(ctx);
+    const uintptr_t addr = update->descr.file_address + offset;
+    const int r = HAL_FLASH_Update((const uint8_t*)data, addr, size, nullptr);
+    if (r != 0) {
+        LOG(ERROR, "Failed to save firmware data: %d", r);
+        return SYSTEM_ERROR_FLASH_IO;
+    }
+    return 0;
+}
+
+void completeFirmwareUpdateDataRequest(ctrl_request* req, const char* data, size_t size, size_t offset, int result, void* ctx) {
+    const auto update = static_cast<FirmwareUpdate*>(ctx);
+    if (result == 0) {
+        result = particle::system::FirmwareUpdate::instance()->chunkWritten(data, size, offset, 0 /* partialSize */);
+    }
+    if (result == 0) {
+        update->descr.chunk_address = update->descr.file_address + offset + size;
+        update->bytesWritten = offset + size;
+        result = encodeFirmwareUpdateDataReply(req, update->bytesWritten);
+    }
+    system_ctrl_set_result(req, result, nullptr, nullptr, nullptr);
+}
+
+int startPipeline(FirmwareUpdate* update) {
+    std::unique_ptr<FirmwareChunkPipeline> pipeline(new(std::nothrow) FirmwareChunkPipeline(
+            writeFirmwareChunk, completeFirmwareUpdateDataRequest, update));
+    CHECK_TRUE(pipeline, SYSTEM_ERROR_NO_MEMORY);
+    std::unique_ptr<FlashWorker> worker(new(std::nothrow) FlashWorker(pipeline.get()));
+    CHECK_TRUE(worker, SYSTEM_ERROR_NO_MEMORY);
+    CHECK(worker->init());
+    update->pipeline = std::move(pipeline);
+    update->worker = std::move(worker);
+    return 0;
+}
+
+void stopPipeline(FirmwareUpdate* update) {
+    // Let the worker finish the chunk it's currently writing
+    update->worker.reset();
+    if (update->pipeline) {
+        update->pipeline->cancel();
+        update->pipeline.reset();
+    }
+}
+
+#endif // PLATFORM_THREADING
+
 void cancelFirmwareUpdate() {
     if (!g_update) {
         return;
     }
+#if PLATFORM_THREADING
+    stopPipeline(g_update.get());
+#endif
     const int ret = Spark_Finish_Firmware_Update(g_update->descr, UpdateFlag::ERROR, nullptr);
     if (ret < 0) {
         LOG(WARN, "Spark_Finish_Firmware_Update() failed: %d", ret);
@@ -69,6 +319,22 @@ void cancelFirmwareUpdate() {
     g_update.reset();
 }
 
+#if PLATFORM_THREADING
+
+// Note: This function is called by the system thread
+void completeWrittenChunks(ISRTaskQueue::Task* task) {
+    if (!g_update || !g_update->pipeline) {
+        return; // The update has been cancelled
+    }
+    g_update->pipeline->complete();
+    if (g_update->pipeline->error() < 0) {
+        // Abort the update as the synchronous mode does on a write error
+        cancelFirmwareUpdate();
+    }
+}
+
+#endif // PLATFORM_THREADING
+
 void firmwareUpdateCompletionHandler(int result, void* data) {
     if (!g_update) {
         return;
@@ -80,6 +346,45 @@ void firmwareUpdateCompletionHandler(int result, void* data) {
     g_update.reset();
 }
 
+int saveFirmwareUpdateData(ctrl_request* req, bool* queued) {
+    uint32_t offset = 0;
+    const char* data = nullptr;
+    size_t size = 0;
+    int r = decodeFirmwareUpdateDataRequest(req, &offset, &data, &size);
+    if (r == SYSTEM_ERROR_NOT_SUPPORTED) {
+#if SYSTEM_CONTROL_NANOPB_FALLBACK
+        r = decodeFirmwareUpdateDataRequestPb(req, &offset, &data, &size);
+#else
+        r = SYSTEM_ERROR_BAD_DATA;
+#endif
+    }
+    CHECK(r);
+    if (!g_update) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
+    if (size == 0 || size > g_update->bytesLeft) {
+        return SYSTEM_ERROR_OUT_OF_RANGE;
+    }
+#if PLATFORM_THREADING
+    if (g_update->pipeline) {
+        // Make sure no chunks were lost or reordered on the way
+        if (offset != g_update->descr.file_length - g_update->bytesLeft) {
+            return SYSTEM_ERROR_OUT_OF_RANGE;
+        }
+        // The request is completed by the flash worker once the chunk is written
+        CHECK(g_update->pipeline->push(req, data, size));
+        g_update->bytesLeft -= size;
+        g_update->worker->notify();
+        *queued = true;
+        return 0;
+    }
+#endif
+    CHECK(saveFirmwareChunk(g_update.get(), data, size));
+    g_update->bytesLeft -= size;
+    CHECK(encodeFirmwareUpdateDataReply(req, g_update->bytesWritten));
+    return 0;
+}
+
 PB(FirmwareModuleType) moduleFunctionToPb(module_function_t func) {
     switch (func) {
     case MODULE_FUNCTION_BOOTLOADER:
@@ -99,18 +404,81 @@ PB(FirmwareModuleType) moduleFunctionToPb(module_function_t func) {
     }
 }
 
+// Proto3 scalar fields that have default values are not encoded
+void writeUInt(ProtobufWriter* writer, unsigned tag, uint32_t val) {
+    if (val) {
+        writer->writeVarint(tag, val);
+    }
+}
+
+void encodeModuleDependency(ProtobufWriter* writer, PB(FirmwareModuleType) type, const module_dependency_t& dep) {
+    writeUInt(writer, PB(GetModuleInfoReply_Dependency_type_tag), type);
+    writeUInt(writer, PB(GetModuleInfoReply_Dependency_index_tag), dep.module_index);
+    writeUInt(writer, PB(GetModuleInfoReply_Dependency_version_tag), dep.module_version);
+}
+
+void encodeModule(ProtobufWriter* writer, PB(FirmwareModuleType) type, const hal_module_t& module) {
+    writeUInt(writer, PB(GetModuleInfoReply_Module_type_tag), type);
+    writeUInt(writer, PB(GetModuleInfoReply_Module_index_tag), module.info.module_index);
+    writeUInt(writer, PB(GetModuleInfoReply_Module_version_tag), module.info.module_version);
+    writeUInt(writer, PB(GetModuleInfoReply_Module_size_tag),
+            (uintptr_t)module.info.module_end_address - (uintptr_t)module.info.module_start_address);
+    unsigned valid = 0;
+    if (!(module.validity_result & MODULE_VALIDATION_INTEGRITY)) {
+        valid |= PB(FirmwareModuleValidityFlag_INTEGRITY_CHECK_FAILED);
+    }
+    if (!(module.validity_result & MODULE_VALIDATION_DEPENDENCIES)) {
+        valid |= PB(FirmwareModuleValidityFlag_DEPENDENCY_CHECK_FAILED);
+    }
+    writeUInt(writer, PB(GetModuleInfoReply_Module_validity_tag), valid);
+    for (unsigned i = 0; i < 2; ++i) {
+        const module_dependency_t& dep = (i == 0) ? module.info.dependency : module.info.dependency2;
+        const auto type = moduleFunctionToPb((module_function_t)dep.module_function);
+        if (type == PB(FirmwareModuleType_INVALID_FIRMWARE_MODULE)) {
+            continue;
+        }
+        ProtobufWriter depSize;
+        encodeModuleDependency(&depSize, type, dep);
+        writer->writeMessageHeader(PB(GetModuleInfoReply_Module_dependencies_tag), depSize.dataSize());
+        encodeModuleDependency(writer, type, dep);
+    }
+}
+
+// Encodes a GetModuleInfoReply message. Returns the size of the message, which may be larger than
+// the size of the buffer
+size_t encodeModuleInfoReply(const hal_system_info_t& info, char* buf, size_t size) {
+    ProtobufWriter writer(buf, size);
+    for (size_t i = 0; i < info.module_count; ++i) {
+        const hal_module_t& module = info.modules[i];
+        if (module.bounds.store != MODULE_STORE_MAIN) {
+            continue;
+        }
+        const auto type = moduleFunctionToPb((module_function_t)module.info.module_function);
+        if (type == PB(FirmwareModuleType_INVALID_FIRMWARE_MODULE)) {
+            continue;
+        }
+        ProtobufWriter moduleSize;
+        encodeModule(&moduleSize, type, module);
+        writer.writeMessageHeader(PB(GetModuleInfoReply_modules_tag), moduleSize.dataSize());
+        encodeModule(&writer, type, module);
+    }
+    return writer.dataSize();
+}
+
 } // namespace
 
 int startFirmwareUpdateRequest(ctrl_request* req) {
-    PB(StartFirmwareUpdateRequest) pbReq = {};
-    CHECK(decodeRequestMessage(req, PB(StartFirmwareUpdateRequest_fields), &pbReq));
+    uint32_t fileSize = 0;
+    uint32_t format = 0;
+    uint32_t maxPendingChunks = 0;
+    CHECK(decodeStartFirmwareUpdateRequest(req, &fileSize, &format, &maxPendingChunks));
     cancelFirmwareUpdate(); // Cancel current transfer
     std::unique_ptr<FirmwareUpdate> update(new(std::nothrow) FirmwareUpdate);
     CHECK_TRUE(update, SYSTEM_ERROR_NO_MEMORY);
-    if (pbReq.format == PB(FileFormat_BIN)) {
-        update->descr.file_length = pbReq.size;
+    if (format == PB(FileFormat_BIN)) {
+        update->descr.file_length = fileSize;
     } else {
-        LOG(ERROR, "Unknown binary format: %u", (unsigned)pbReq.format);
+        LOG(ERROR, "Unknown binary format: %u", (unsigned)format);
         return SYSTEM_ERROR_NOT_SUPPORTED;
     }
     update->descr.store = FileTransfer::Store::FIRMWARE;
@@ -123,12 +491,23 @@ int startFirmwareUpdateRequest(ctrl_request* req) {
         return ret;
     }
     update->descr.chunk_address = update->descr.file_address;
-    update->bytesLeft = pbReq.size;
+    update->bytesLeft = fileSize;
     update->bytesWritten = 0;
     g_update = std::move(update);
-    PB(StartFirmwareUpdateReply) pbRep = {};
-    pbRep.chunk_size = g_update->descr.chunk_size;
-    ret = encodeReplyMessage(req, PB(StartFirmwareUpdateReply_fields), &pbRep);
+    size_t acceptedPendingChunks = 0;
+#if PLATFORM_THREADING
+    // The host opts into the pipelined mode by specifying how many data requests it's going to
+    // keep in flight. Fall back to the synchronous mode if the flash worker can't be started
+    if (maxPendingChunks > 1) {
+        ret = startPipeline(g_update.get());
+        if (ret < 0) {
+            LOG(WARN, "Unable to start flash worker: %d", ret);
+        } else {
+            acceptedPendingChunks = std::min<size_t>(maxPendingChunks, FirmwareChunkPipeline::MAX_PENDING_CHUNKS);
+        }
+    }
+#endif
+    ret = encodeStartFirmwareUpdateReply(req, g_update->descr.chunk_size, acceptedPendingChunks);
     if (ret != 0) {
         cancelFirmwareUpdate();
         return ret;
@@ -137,8 +516,8 @@ int startFirmwareUpdateRequest(ctrl_request* req) {
 }
 
 void finishFirmwareUpdateRequest(ctrl_request* req) {
-    PB(FinishFirmwareUpdateRequest) pbReq = {};
-    int ret = decodeRequestMessage(req, PB(FinishFirmwareUpdateRequest_fields), &pbReq);
+    bool validateOnly = false;
+    int ret = decodeFinishFirmwareUpdateRequest(req, &validateOnly);
     if (ret != 0) {
         goto done;
     }
@@ -146,10 +525,24 @@ void finishFirmwareUpdateRequest(ctrl_request* req) {
         ret = SYSTEM_ERROR_INVALID_STATE;
         goto done;
     }
+#if PLATFORM_THREADING
+    if (g_update->pipeline) {
+        if (g_update->pipeline->pendingCount() > 0) {
+            // The host needs to wait for all data requests to complete
+            system_ctrl_set_result(req, SYSTEM_ERROR_BUSY, nullptr, nullptr, nullptr);
+            return;
+        }
+        ret = g_update->pipeline->error();
+        if (ret < 0) {
+            goto done;
+        }
+        stopPipeline(g_update.get());
+    }
+#endif
     LOG_DEBUG(TRACE, "Firmware size: %u", (unsigned)g_update->bytesWritten);
     // Validate the update
     ret = Spark_Finish_Firmware_Update(g_update->descr, UpdateFlag::SUCCESS | UpdateFlag::VALIDATE_ONLY, nullptr);
-    if (ret >= 0 && !pbReq.validate_only) {
+    if (ret >= 0 && !validateOnly) {
         // Reply to the host and apply the update
         system_ctrl_set_result(req, 0 /* result */, firmwareUpdateCompletionHandler, nullptr, nullptr);
         return;
@@ -164,30 +557,15 @@ int cancelFirmwareUpdateRequest(ctrl_request* req) {
     return 0;
 }
 
-int firmwareUpdateDataRequest(ctrl_request* req) {
-    NAMED_SCOPE_GUARD(guard, {
+void firmwareUpdateDataRequest(ctrl_request* req) {
+    bool queued = false;
+    const int ret = saveFirmwareUpdateData(req, &queued);
+    if (ret < 0) {
         cancelFirmwareUpdate();
-    });
-    PB(FirmwareUpdateDataRequest) pbReq = {};
-    DecodedString pbData(&pbReq.data);
-    CHECK(decodeRequestMessage(req, PB(FirmwareUpdateDataRequest_fields), &pbReq));
-    if (!g_update) {
-        return SYSTEM_ERROR_INVALID_STATE;
     }
-    if (pbData.size == 0 || pbData.size > g_update->bytesLeft) {
-        return SYSTEM_ERROR_OUT_OF_RANGE;
+    if (!queued) {
+        system_ctrl_set_result(req, ret, nullptr, nullptr, nullptr);
     }
-
-    g_update->descr.chunk_size = pbData.size;
-    const int ret = Spark_Save_Firmware_Chunk(g_update->descr, (const uint8_t*)pbData.data, nullptr);
-    if (ret != 0) {
-        return ret;
-    }
-    g_update->descr.chunk_address += pbData.size;
-    g_update->bytesLeft -= pbData.size;
-
-    guard.dismiss();
-    return 0;
 }
 
 int getModuleInfo(ctrl_request* req) {
@@ -198,64 +576,10 @@ int getModuleInfo(ctrl_request* req) {
     SCOPE_GUARD({
         HAL_System_Info(&info, false, nullptr);
     });
-    PB(GetModuleInfoReply) pbRep = {};
-    pbRep.modules.arg = &info;
-    pbRep.modules.funcs.encode = [](pb_ostream_t* strm, const pb_field_iter_t* field, void* const* arg) {
-        const auto info = (const hal_system_info_t*)*arg;
-        for (size_t i = 0; i < info->module_count; ++i) {
-            const hal_module_t& module = info->modules[i];
-            if (module.bounds.store != MODULE_STORE_MAIN) {
-                continue;
-            }
-            const auto type = moduleFunctionToPb((module_function_t)module.info.module_function);
-            if (type == PB(FirmwareModuleType_INVALID_FIRMWARE_MODULE)) {
-                continue;
-            }
-            PB(GetModuleInfoReply_Module) pbModule = {};
-            pbModule.type = type;
-            pbModule.index = module.info.module_index;
-            pbModule.version = module.info.module_version;
-            pbModule.size = (uintptr_t)module.info.module_end_address - (uintptr_t)module.info.module_start_address;
-            unsigned valid = 0;
-            if (!(module.validity_result & MODULE_VALIDATION_INTEGRITY)) {
-                valid |= PB(FirmwareModuleValidityFlag_INTEGRITY_CHECK_FAILED);
-            }
-            if (!(module.validity_result & MODULE_VALIDATION_DEPENDENCIES)) {
-                valid |= PB(FirmwareModuleValidityFlag_DEPENDENCY_CHECK_FAILED);
-            }
-            pbModule.validity = valid;
-            pbModule.dependencies.arg = const_cast<module_info_t*>(&module.info);
-            pbModule.dependencies.funcs.encode = [](pb_ostream_t* strm, const pb_field_iter_t* field, void* const* arg) {
-                const auto info = (const module_info_t*)*arg;
-                for (unsigned i = 0; i < 2; ++i) {
-                    const module_dependency_t& dep = (i == 0) ? info->dependency : info->dependency2;
-                    const auto type = moduleFunctionToPb((module_function_t)dep.module_function);
-                    if (type == PB(FirmwareModuleType_INVALID_FIRMWARE_MODULE)) {
-                        continue;
-                    }
-                    PB(GetModuleInfoReply_Dependency) pbDep = {};
-                    pbDep.type = type;
-                    pbDep.index = dep.module_index;
-                    pbDep.version = dep.module_version;
-                    if (!pb_encode_tag_for_field(strm, field)) {
-                        return false;
-                    }
-                    if (!pb_encode_submessage(strm, PB(GetModuleInfoReply_Dependency_fields), &pbDep)) {
-                        return false;
-                    }
-                }
-                return true;
-            };
-            if (!pb_encode_tag_for_field(strm, field)) {
-                return false;
-            }
-            if (!pb_encode_submessage(strm, PB(GetModuleInfoReply_Module_fields), &pbModule)) {
-                return false;
-            }
-        }
-        return true;
-    };
-    CHECK(encodeReplyMessage(req, PB(GetModuleInfoReply_fields), &pbRep));
+    // Calculate the size of the reply, then encode it directly into the reply buffer
+    const size_t size = encodeModuleInfoReply(info, nullptr, 0);
+    CHECK(system_ctrl_alloc_reply_data(req, size, nullptr));
+    encodeModuleInfoReply(info, (char*)req->reply_data, size);
     return 0;
 }
 
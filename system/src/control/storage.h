@@ -19,6 +19,12 @@
 
 #include "system_control.h"
 
+// Set this macro to 0 to disable the nanopb decoder used for the firmware update data requests
+// that can't be decoded in place
+#ifndef SYSTEM_CONTROL_NANOPB_FALLBACK
+#define SYSTEM_CONTROL_NANOPB_FALLBACK 1
+#endif
+
 namespace particle {
 
 namespace control {
@@ -26,7 +32,7 @@ namespace control {
 int startFirmwareUpdateRequest(ctrl_request* req);
 void finishFirmwareUpdateRequest(ctrl_request* req);
 int cancelFirmwareUpdateRequest(ctrl_request* req);
-int firmwareUpdateDataRequest(ctrl_request* req);
+void firmwareUpdateDataRequest(ctrl_request* req);
 
 int getModuleInfo(ctrl_request* req);
 
@@ -24,10 +24,12 @@ LOG_SOURCE_CATEGORY("system.ota");
 #include "system_task.h"
 #include "system_event.h"
 #include "system_led_signal.h"
+#include "system_describe_cache.h"
 
 #include "ota_flash_hal.h"
 
 #include "scope_guard.h"
+#include "trace_recorder.h"
 #include "check.h"
 #include "debug.h"
 
@@ -188,6 +190,7 @@ int FirmwareUpdate::startUpdate(size_t fileSize, const char* fileHash, size_t* p
 }
 
 int FirmwareUpdate::finishUpdate(FirmwareUpdateFlags flags) {
+    TRACE_SCOPE(TRACE_ID_SYSTEM_OTA_FINISH, flags.value(), 0);
     const bool validateOnly = flags & FirmwareUpdateFlag::VALIDATE_ONLY;
     const bool cancel = flags & FirmwareUpdateFlag::CANCEL;
 #if HAL_PLATFORM_RESUMABLE_OTA
@@ -215,6 +218,8 @@ int FirmwareUpdate::finishUpdate(FirmwareUpdateFlags flags) {
             if (r < 0) {
                 return r;
             }
+            // The module information reported in the system Describe is going to change
+            DescribeCache::instance()->invalidate(DescribeCache::SYSTEM);
             system_pending_shutdown(RESET_REASON_UPDATE); // Always restart for now
         } else {
             CHECK(HAL_FLASH_OTA_Validate(true /* userDepsOptional */,
@@ -236,16 +241,24 @@ int FirmwareUpdate::saveChunk(const char* chunkData, size_t chunkSize, size_t ch
     if (!updating_) {
         return SYSTEM_ERROR_INVALID_STATE;
     }
+    TRACE_SCOPE(TRACE_ID_SYSTEM_OTA_CHUNK, chunkOffset, chunkSize);
     const uintptr_t addr = HAL_OTA_FlashAddress() + chunkOffset;
-    int r = HAL_FLASH_Update((const uint8_t*)chunkData, addr, chunkSize, nullptr);
+    const int r = HAL_FLASH_Update((const uint8_t*)chunkData, addr, chunkSize, nullptr);
     if (r != 0) {
         SYSTEM_ERROR_MESSAGE("Failed to save firmware data: %d", r);
         endUpdate(false /* ok */);
         return SYSTEM_ERROR_FLASH_IO;
     }
+    return chunkWritten(chunkData, chunkSize, chunkOffset, partialSize);
+}
+
+int FirmwareUpdate::chunkWritten(const char* chunkData, size_t chunkSize, size_t chunkOffset, size_t partialSize) {
+    if (!updating_) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
 #if HAL_PLATFORM_RESUMABLE_OTA
     if (transferState_) {
-        r = updateTransferState(chunkData, chunkSize, chunkOffset, partialSize);
+        const int r = updateTransferState(chunkData, chunkSize, chunkOffset, partialSize);
         if (r != 0) {
             // Not a critical error
             LOG(ERROR, "Failed to update transfer state: %d", r);
@@ -73,6 +73,16 @@ public:
      * @return 0 on success or a negative result code in case of an error.
      */
     int saveChunk(const char* chunkData, size_t chunkSize, size_t chunkOffset, size_t partialSize);
+    /**
+     * Update the transfer state after a chunk of the update binary has been written to the OTA
+     * section by the calling code.
+     *
+     * This method is called by `saveChunk()` and is meant for the code that writes the chunks to
+     * flash on a separate thread. The arguments are the same as those of `saveChunk()`.
+     *
+     * @return 0 on success or a negative result code in case of an error.
+     */
+    int chunkWritten(const char* chunkData, size_t chunkSize, size_t chunkOffset, size_t partialSize);
     /**
      * This method needs to be called periodically if an update is in progress.
      */
@@ -60,6 +60,7 @@
 #include "spark_wiring_diagnostics.h"
 #include "spark_wiring_system.h"
 #include "system_power.h"
+#include "system_loop_scheduler.h"
 #include "spark_wiring_wifi.h"
 
 // FIXME
@@ -250,6 +251,7 @@ void system_power_off() {
     LED_SIGNAL_START(POWER_OFF, CRITICAL);
     SYSTEM_POWEROFF = 1;
     cancel_connection(); // Unblock the system thread
+    system::LoopScheduler::instance()->wakeUp();
 }
 
 void system_handle_button_clicks(bool isIsr)
@@ -282,6 +284,7 @@ void reset_button_click()
     if (clicks > 0) {
         system_notify_event(button_final_click, clicks, nullptr, nullptr, nullptr, NOTIFY_SYNCHRONOUSLY);
         button_final_clicks = clicks;
+        system::LoopScheduler::instance()->wakeUp();
 #if HAL_PLATFORM_SETUP_BUTTON_UX
         // Certain numbers of clicks can be processed directly in ISR
         system_handle_button_clicks(hal_interrupt_is_isr());
@@ -617,6 +620,30 @@ public:
     }
 };
 
+class LoopWakeupsDiagnosticData: public AbstractUnsignedIntegerDiagnosticData {
+public:
+    LoopWakeupsDiagnosticData() :
+            AbstractUnsignedIntegerDiagnosticData(DIAG_ID_SYSTEM_LOOP_WAKEUPS, DIAG_NAME_SYSTEM_LOOP_WAKEUPS) {
+    }
+
+    virtual int get(IntType& val) override {
+        val = system::LoopScheduler::instance()->wakeupsPerSecond();
+        return 0; // OK
+    }
+};
+
+class LoopLoadDiagnosticData: public AbstractUnsignedIntegerDiagnosticData {
+public:
+    LoopLoadDiagnosticData() :
+            AbstractUnsignedIntegerDiagnosticData(DIAG_ID_SYSTEM_LOOP_LOAD, DIAG_NAME_SYSTEM_LOOP_LOAD) {
+    }
+
+    virtual int get(IntType& val) override {
+        val = system::LoopScheduler::instance()->load();
+        return 0; // OK
+    }
+};
+
 class RunTimeInfoDiagnosticData: public AbstractIntegerDiagnosticData {
 public:
     typedef IntType(*func_t)(const runtime_info_t&);
@@ -681,6 +708,10 @@ HALEventHandler g_halEventHandler;
 
 UptimeDiagnosticData g_uptimeDiagData;
 
+LoopWakeupsDiagnosticData g_loopWakeupsDiagData;
+
+LoopLoadDiagnosticData g_loopLoadDiagData;
+
 RunTimeInfoDiagnosticData g_totalRamDiagData(DIAG_ID_SYSTEM_TOTAL_RAM, DIAG_NAME_SYSTEM_TOTAL_RAM,
     [](const runtime_info_t& info) -> RunTimeInfoDiagnosticData::IntType {
         return info.total_init_heap;
@@ -35,6 +35,8 @@
 #include "system_cloud.h"
 #include "system_cloud_internal.h"
 #include "system_publish_vitals.h"
+#include "system_vitals_delta.h"
+#include "trace_recorder.h"
 #include "system_task.h"
 #include "system_threading.h"
 #include "system_update.h"
@@ -183,6 +185,8 @@ bool spark_send_event(const char* name, const char* data, int ttl, uint32_t flag
     SYSTEM_THREAD_CONTEXT_SYNC(spark_send_event(name, data, ttl, flags, reserved));
     }
 
+    TRACE_EVENT(TRACE_ID_SYSTEM_PUBLISH, data ? strlen(data) : 0, 0);
+
     spark_protocol_send_event_data d = {};
     d.size = sizeof(d);
     if (reserved) {
@@ -292,6 +296,21 @@ int spark_set_connection_property(unsigned property, unsigned value, const void*
         CloudConnectionSettings::instance()->setDefaultDisconnectOptions(std::move(opts));
         return 0;
     }
+    case SPARK_CLOUD_VITALS_DELTA_KEYFRAME_INTERVAL: {
+        VitalsDeltaEncoder::instance()->keyframeInterval(value);
+        return 0;
+    }
+    case SPARK_CLOUD_VITALS_DELTA_THRESHOLD: {
+        if (!data) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        return VitalsDeltaEncoder::instance()->threshold(*(const uint16_t*)data, value);
+    }
+    case SPARK_CLOUD_FAST_RESUME_ENABLED: {
+        CloudConnectionSettings::instance()->fastResume(value);
+        const auto r = spark_protocol_set_connection_property(sp, protocol::Connection::FAST_RESUME, value, nullptr, nullptr);
+        return spark_protocol_to_system_error(r);
+    }
     // These properties are forwarded to the protocol instance as is
     case SPARK_CLOUD_PING_INTERVAL:
     case SPARK_CLOUD_FAST_OTA_ENABLED: {
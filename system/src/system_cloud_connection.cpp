@@ -25,6 +25,11 @@
 #if HAL_PLATFORM_CLOUD_UDP
 #include "dtls_session_persist.h"
 #endif // HAL_PLATFORM_CLOUD_UDP
+#if HAL_USE_SOCKET_HAL_POSIX
+#include "netdb_hal.h"
+#else
+#include "inet_hal_compat.h"
+#endif // HAL_USE_SOCKET_HAL_POSIX
 #if HAL_PLATFORM_IFAPI && HAL_PLATFORM_BROKEN_MTU
 #include "ifapi.h"
 // FIXME: this should get included from protocol.h
@@ -73,6 +78,15 @@ uint32_t compute_session_checksum(const ServerAddress& addr)
     return checksum;
 }
 
+void clear_dns_cache()
+{
+#if HAL_USE_SOCKET_HAL_POSIX
+    netdb_clear_cache(nullptr);
+#else
+    inet_clear_dns_cache(nullptr);
+#endif // HAL_USE_SOCKET_HAL_POSIX
+}
+
 } /* anonymous */
 
 int SessionConnection::load(const ServerAddress& addr)
@@ -91,6 +105,10 @@ int SessionConnection::load(const ServerAddress& addr)
             this->address = connection->address;
             LOG(INFO, "Loaded cloud server address and port from session data");
         } else {
+            if (connection->server_address_checksum != compute_session_checksum(addr)) {
+                /* The server address has changed, make sure its host name is resolved again */
+                clear_dns_cache();
+            }
             /* Invalidate */
             LOG(ERROR, "Address checksum %08x, expected %08x", connection->server_address_checksum, compute_session_checksum(addr));
             LOG(ERROR, "Address family %lu", connection->address.ss_family);
@@ -88,7 +88,7 @@ int system_cloud_connect(int protocol, const ServerAddress* address, sockaddr* s
                 LOG(TRACE, "Resolving %s", tmphost);
                 HAL_IPAddress haddr = {};
                 for (unsigned i = 0; i < CLOUD_DOMAIN_RESOLVE_ATTEMPTS; i++) {
-                    ret = inet_gethostbyname(tmphost, strnlen(tmphost, sizeof(tmphost)), &haddr, NIF_DEFAULT, nullptr);
+                    ret = inet_gethostbyname_cached(tmphost, strnlen(tmphost, sizeof(tmphost)), &haddr, NIF_DEFAULT, nullptr);
                     if (!ret) {
                         ipAddrPortToSockAddr(haddr.ipv4, address->port, saddr);
                         break;
@@ -133,6 +133,8 @@ int system_cloud_connect(int protocol, const ServerAddress* address, sockaddr* s
         ret = socket_connect(sock, &saddr, sizeof(saddr));
         if (ret) {
             LOG(ERROR, "Failed to connect to %s:%u (%d)", String(waddr).c_str(), dport, ret);
+            /* Make sure the server name is resolved again */
+            inet_clear_dns_cache(nullptr);
         } else {
             LOG(ERROR, "Connected to %s:%u", String(waddr).c_str(), dport);
         }
@@ -31,6 +31,7 @@
 #include "system_mode.h"
 #endif // HAL_PLATFORM_SOCKET_IOCTL_NOTIFY
 #include "simple_ntp_client.h"
+#include <algorithm>
 
 namespace {
 
@@ -45,12 +46,257 @@ struct SystemCloudState {
     int socket = -1;
     struct addrinfo* addr = nullptr;
     struct addrinfo* next = nullptr;
+    /* Address family of the last successful connection */
+    int family = AF_UNSPEC;
 };
 
 SystemCloudState s_state;
 
 const unsigned CLOUD_SOCKET_HALF_CLOSED_WAIT_TIMEOUT = 5000;
 
+/* Delay between two consecutive TCP connection attempts (RFC 8305) */
+const system_tick_t CLOUD_CONNECTION_ATTEMPT_DELAY = 250;
+const system_tick_t CLOUD_TCP_CONNECT_TIMEOUT = 30000;
+const size_t MAX_PARALLEL_CONNECTION_ATTEMPTS = 4;
+
+/*
+ * Reorders the address list so that address families alternate, starting with the preferred
+ * family or, if there's none, with the family of the first address returned by the resolver (RFC 8305)
+ */
+struct addrinfo* interleaveAddressFamilies(struct addrinfo* info, int preferredFamily)
+{
+    if (!info) {
+        return info;
+    }
+    if (preferredFamily == AF_UNSPEC) {
+        preferredFamily = info->ai_family;
+    }
+    struct addrinfo* preferred = nullptr;
+    struct addrinfo** preferredLast = &preferred;
+    struct addrinfo* other = nullptr;
+    struct addrinfo** otherLast = &other;
+    for (struct addrinfo* a = info; a != nullptr;) {
+        struct addrinfo* next = a->ai_next;
+        a->ai_next = nullptr;
+        if (a->ai_family == preferredFamily) {
+            *preferredLast = a;
+            preferredLast = &a->ai_next;
+        } else {
+            *otherLast = a;
+            otherLast = &a->ai_next;
+        }
+        a = next;
+    }
+    struct addrinfo* list = nullptr;
+    struct addrinfo** last = &list;
+    while (preferred || other) {
+        if (preferred) {
+            *last = preferred;
+            last = &preferred->ai_next;
+            preferred = preferred->ai_next;
+        }
+        if (other) {
+            *last = other;
+            last = &other->ai_next;
+            other = other->ai_next;
+        }
+    }
+    *last = nullptr;
+    return list;
+}
+
+void formatAddress(const struct addrinfo* a, char* host, size_t hostSize, uint16_t* port)
+{
+    switch (a->ai_family) {
+        case AF_INET: {
+            inet_inet_ntop(a->ai_family, &((sockaddr_in*)a->ai_addr)->sin_addr, host, hostSize);
+            *port = ntohs(((sockaddr_in*)a->ai_addr)->sin_port);
+            break;
+        }
+        case AF_INET6: {
+            inet_inet_ntop(a->ai_family, &((sockaddr_in6*)a->ai_addr)->sin6_addr, host, hostSize);
+            *port = ntohs(((sockaddr_in6*)a->ai_addr)->sin6_port);
+            break;
+        }
+    }
+}
+
+int createCloudSocket(const struct addrinfo* a, int protocol)
+{
+    int s = sock_socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (s < 0) {
+        LOG(ERROR, "Cloud socket failed, family=%d, type=%d, protocol=%d, errno=%d", a->ai_family, a->ai_socktype, a->ai_protocol, errno);
+        return -1;
+    }
+
+    LOG(TRACE, "Cloud socket=%d, family=%d, type=%d, protocol=%d", s, a->ai_family, a->ai_socktype, a->ai_protocol);
+
+    /* We are using fixed source port only for IPv6 connections */
+    if (protocol == IPPROTO_UDP && a->ai_family == AF_INET6) {
+        struct sockaddr_storage saddr = {};
+        saddr.s2_len = sizeof(saddr);
+        saddr.ss_family = a->ai_family;
+
+        /* NOTE: Always binding to 5684 by default */
+        switch (a->ai_family) {
+            case AF_INET: {
+                ((sockaddr_in*)&saddr)->sin_port = htons(PORT_COAPS);
+                break;
+            }
+            case AF_INET6: {
+                ((sockaddr_in6*)&saddr)->sin6_port = htons(PORT_COAPS);
+                break;
+            }
+        }
+
+        const int one = 1;
+        if (sock_setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one))) {
+            LOG(ERROR, "Cloud socket=%d, failed to set SO_REUSEADDR, errno=%d", s, errno);
+            sock_close(s);
+            return -1;
+        }
+
+        /* Bind socket */
+        if (sock_bind(s, (const struct sockaddr*)&saddr, sizeof(saddr))) {
+            LOG(ERROR, "Cloud socket=%d, failed to bind, errno=%d", s, errno);
+            sock_close(s);
+            return -1;
+        }
+    }
+
+    return s;
+}
+
+int setSocketBlocking(int s, bool blocking)
+{
+    int flags = sock_fcntl(s, F_GETFL, 0);
+    if (flags < 0) {
+        return SYSTEM_ERROR_NETWORK;
+    }
+    flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+    if (sock_fcntl(s, F_SETFL, flags) < 0) {
+        return SYSTEM_ERROR_NETWORK;
+    }
+    return 0;
+}
+
+/*
+ * Connects a TCP socket to one of the addresses in the list. A new connection attempt is started
+ * every CLOUD_CONNECTION_ATTEMPT_DELAY milliseconds, or as soon as the previous attempt fails,
+ * without waiting for the attempts in progress to complete. The first attempt that succeeds wins
+ */
+int connectStaggered(struct addrinfo* info, struct addrinfo** connected)
+{
+    struct Attempt {
+        int socket;
+        struct addrinfo* addr;
+    };
+    Attempt attempts[MAX_PARALLEL_CONNECTION_ATTEMPTS] = {};
+    size_t count = 0;
+    struct addrinfo* next = info;
+    const system_tick_t start = millis();
+    system_tick_t lastAttempt = 0;
+    int result = -1;
+
+    for (;;) {
+        const system_tick_t now = millis();
+        if (now - start >= CLOUD_TCP_CONNECT_TIMEOUT) {
+            LOG(ERROR, "Cloud connection timeout");
+            break;
+        }
+        if (next && count < MAX_PARALLEL_CONNECTION_ATTEMPTS &&
+                (count == 0 || now - lastAttempt >= CLOUD_CONNECTION_ATTEMPT_DELAY)) {
+            struct addrinfo* a = next;
+            next = next->ai_next;
+            char serverHost[INET6_ADDRSTRLEN] = {};
+            uint16_t serverPort = 0;
+            formatAddress(a, serverHost, sizeof(serverHost), &serverPort);
+            int s = createCloudSocket(a, IPPROTO_TCP);
+            if (s < 0) {
+                continue;
+            }
+            if (setSocketBlocking(s, false) < 0) {
+                sock_close(s);
+                continue;
+            }
+            LOG(INFO, "Cloud socket=%d, connecting to %s#%u", s, serverHost, serverPort);
+            if (sock_connect(s, a->ai_addr, a->ai_addrlen) == 0) {
+                result = s;
+                *connected = a;
+                break;
+            }
+            if (errno != EINPROGRESS) {
+                LOG(ERROR, "Cloud socket=%d, failed to connect to %s#%u, errno=%d", s, serverHost, serverPort, errno);
+                sock_close(s);
+                continue;
+            }
+            attempts[count].socket = s;
+            attempts[count].addr = a;
+            ++count;
+            lastAttempt = now;
+        }
+        if (count == 0) {
+            if (!next) {
+                /* All attempts have failed */
+                break;
+            }
+            continue;
+        }
+        system_tick_t timeout = CLOUD_TCP_CONNECT_TIMEOUT - (now - start);
+        if (next && count < MAX_PARALLEL_CONNECTION_ATTEMPTS) {
+            timeout = std::min(timeout, CLOUD_CONNECTION_ATTEMPT_DELAY - std::min(now - lastAttempt, CLOUD_CONNECTION_ATTEMPT_DELAY));
+        }
+        struct pollfd fds[MAX_PARALLEL_CONNECTION_ATTEMPTS] = {};
+        for (size_t i = 0; i < count; ++i) {
+            fds[i].fd = attempts[i].socket;
+            fds[i].events = POLLOUT;
+        }
+        if (sock_poll(fds, count, timeout) < 0) {
+            LOG(ERROR, "sock_poll failed, errno=%d", errno);
+            break;
+        }
+        for (size_t i = count; i > 0; --i) {
+            const auto& p = fds[i - 1];
+            if (!p.revents) {
+                continue;
+            }
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if ((p.revents & POLLOUT) && !sock_getsockopt(p.fd, SOL_SOCKET, SO_ERROR, &err, &len) && !err) {
+                if (result < 0) {
+                    result = p.fd;
+                    *connected = attempts[i - 1].addr;
+                    continue;
+                }
+            } else {
+                LOG(ERROR, "Cloud socket=%d, failed to connect, error=%d", p.fd, err);
+            }
+            if (p.fd != result) {
+                sock_close(p.fd);
+            }
+            attempts[i - 1] = attempts[count - 1];
+            --count;
+        }
+        if (result >= 0) {
+            break;
+        }
+    }
+
+    /* Cancel the attempts that are still in progress */
+    for (size_t i = 0; i < count; ++i) {
+        if (attempts[i].socket != result) {
+            sock_close(attempts[i].socket);
+        }
+    }
+
+    if (result >= 0 && setSocketBlocking(result, true) < 0) {
+        sock_close(result);
+        result = -1;
+    }
+
+    return result;
+}
+
 } /* anonymous */
 
 int system_cloud_connect(int protocol, const ServerAddress* address, sockaddr* saddrCache)
@@ -114,7 +360,7 @@ int system_cloud_connect(int protocol, const ServerAddress* address, sockaddr* s
 
             case DOMAIN_NAME: {
                 struct addrinfo hints = {};
-                hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+                hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG | AI_HAL_CACHE;
                 hints.ai_protocol = protocol;
                 /* FIXME: */
                 hints.ai_socktype = hints.ai_protocol == IPPROTO_UDP ? SOCK_DGRAM : SOCK_STREAM;
@@ -140,76 +386,42 @@ int system_cloud_connect(int protocol, const ServerAddress* address, sockaddr* s
 
     LOG(TRACE, "Address type: %d", type);
 
-    for (struct addrinfo* a = info; a != nullptr; a = a->ai_next) {
-        /* Iterate over all the addresses and attempt to connect */
-
-        int s = sock_socket(a->ai_family, a->ai_socktype, a->ai_protocol);
-        if (s < 0) {
-            LOG(ERROR, "Cloud socket failed, family=%d, type=%d, protocol=%d, errno=%d", a->ai_family, a->ai_socktype, a->ai_protocol, errno);
-            continue;
-        }
-
-        LOG(TRACE, "Cloud socket=%d, family=%d, type=%d, protocol=%d", s, a->ai_family, a->ai_socktype, a->ai_protocol);
-
-        char serverHost[INET6_ADDRSTRLEN] = {};
-        uint16_t serverPort = 0;
-        switch (a->ai_family) {
-            case AF_INET: {
-                inet_inet_ntop(a->ai_family, &((sockaddr_in*)a->ai_addr)->sin_addr, serverHost, sizeof(serverHost));
-                serverPort = ntohs(((sockaddr_in*)a->ai_addr)->sin_port);
-                break;
-            }
-            case AF_INET6: {
-                inet_inet_ntop(a->ai_family, &((sockaddr_in6*)a->ai_addr)->sin6_addr, serverHost, sizeof(serverHost));
-                serverPort = ntohs(((sockaddr_in6*)a->ai_addr)->sin6_port);
-                break;
-            }
-        }
-        LOG(INFO, "Cloud socket=%d, connecting to %s#%u", s, serverHost, serverPort);
-
-        /* We are using fixed source port only for IPv6 connections */
-        if (protocol == IPPROTO_UDP && a->ai_family == AF_INET6) {
-            struct sockaddr_storage saddr = {};
-            saddr.s2_len = sizeof(saddr);
-            saddr.ss_family = a->ai_family;
-
-            /* NOTE: Always binding to 5684 by default */
-            switch (a->ai_family) {
-                case AF_INET: {
-                    ((sockaddr_in*)&saddr)->sin_port = htons(PORT_COAPS);
-                    break;
-                }
-                case AF_INET6: {
-                    ((sockaddr_in6*)&saddr)->sin6_port = htons(PORT_COAPS);
-                    break;
-                }
-            }
+    if (type == CLOUD_SERVER_ADDRESS_TYPE_NEW_ADDRINFO) {
+        info = interleaveAddressFamilies(info, s_state.family);
+    }
 
-            const int one = 1;
-            if (sock_setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one))) {
-                LOG(ERROR, "Cloud socket=%d, failed to set SO_REUSEADDR, errno=%d", s, errno);
-                sock_close(s);
+    struct addrinfo* a = nullptr;
+    int s = -1;
+    if (protocol == IPPROTO_TCP) {
+        s = connectStaggered(info, &a);
+    } else {
+        for (a = info; a != nullptr; a = a->ai_next) {
+            /* Iterate over all the addresses and attempt to connect */
+            s = createCloudSocket(a, protocol);
+            if (s < 0) {
                 continue;
             }
 
-            /* Bind socket */
-            if (sock_bind(s, (const struct sockaddr*)&saddr, sizeof(saddr))) {
-                LOG(ERROR, "Cloud socket=%d, failed to bind, errno=%d");
+            char serverHost[INET6_ADDRSTRLEN] = {};
+            uint16_t serverPort = 0;
+            formatAddress(a, serverHost, sizeof(serverHost), &serverPort);
+            LOG(INFO, "Cloud socket=%d, connecting to %s#%u", s, serverHost, serverPort);
+
+            /* NOTE: we do this for UDP sockets in order to automagically filter
+             * on source address and port */
+            if (sock_connect(s, a->ai_addr, a->ai_addrlen)) {
+                LOG(ERROR, "Cloud socket=%d, failed to connect to %s#%u, errno=%d", s, serverHost, serverPort, errno);
                 sock_close(s);
+                s = -1;
                 continue;
             }
+            LOG(TRACE, "Cloud socket=%d, connected to %s#%u", s, serverHost, serverPort);
+            break;
         }
+    }
 
-        /* FIXME: timeout for TCP */
-        /* NOTE: we do this for UDP sockets as well in order to automagically filter
-         * on source address and port */
-        r = sock_connect(s, a->ai_addr, a->ai_addrlen);
-        if (r) {
-            LOG(ERROR, "Cloud socket=%d, failed to connect to %s#%u, errno=%d", s, serverHost, serverPort, errno);
-            sock_close(s);
-            continue;
-        }
-        LOG(TRACE, "Cloud socket=%d, connected to %s#%u", s, serverHost, serverPort);
+    if (s >= 0) {
+        r = 0;
 
         /* If we got here, we are most likely connected, however keep track of current addrinfo list
          * in order to try the next address if application layer fails to establish the connection
@@ -226,6 +438,9 @@ int system_cloud_connect(int protocol, const ServerAddress* address, sockaddr* s
                 } else {
                     info = s_state.addr;
                     s_state.addr = s_state.next = nullptr;
+                    /* All the resolved addresses have been tried, make sure the server name
+                     * is resolved again if this one doesn't work either */
+                    netdb_clear_cache(nullptr);
                 }
             } else {
                 if (a->ai_next) {
@@ -237,6 +452,7 @@ int system_cloud_connect(int protocol, const ServerAddress* address, sockaddr* s
         }
 
         s_state.socket = s;
+        s_state.family = a->ai_family;
         if (saddrCache) {
             memcpy(saddrCache, a->ai_addr, a->ai_addrlen);
         }
@@ -251,8 +467,9 @@ int system_cloud_connect(int protocol, const ServerAddress* address, sockaddr* s
             sock_ioctl(s, SIOCSPGRP, (void*)&thread);
         }
 #endif // HAL_PLATFORM_SOCKET_IOCTL_NOTIFY
-
-        break;
+    } else if (type == CLOUD_SERVER_ADDRESS_TYPE_NEW_ADDRINFO) {
+        /* None of the resolved addresses is reachable */
+        netdb_clear_cache(nullptr);
     }
 
     if (clean) {
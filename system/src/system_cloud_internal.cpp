@@ -37,6 +37,7 @@
 #include "product_store_hal.h"
 #include "rtc_hal.h"
 #include "socket_hal.h"
+#include "platform_headers.h"
 #include "rgbled.h"
 #include "spark_macros.h"   // for S2M
 #include "string_convert.h"
@@ -57,8 +58,13 @@
 #include "network/ncp/cellular/ncp.h"
 #include "network/ncp/cellular/cellular_ncp_client.h"
 #endif // HAL_PLATFORM_MUXER_MAY_NEED_DELAY_IN_TX
+#if HAL_PLATFORM_CELLULAR
+#include "cellular_hal.h"
+#endif // HAL_PLATFORM_CELLULAR
 #include "system_version.h"
 #include "firmware_update.h"
+#include "system_describe_cache.h"
+#include "system_vitals_delta.h"
 
 #if PLATFORM_ID == PLATFORM_GCC
 #include "device_config.h"
@@ -88,6 +94,23 @@ constexpr const char UPDATES_PENDING_EVENT[] = "pending";
 Vector<User_Var_Lookup_Table_t> g_cloudVars;
 Vector<User_Func_Lookup_Table_t> g_cloudFuncs;
 
+// Firmware update flags last reported to the cloud. The value is kept in retained memory along with
+// the session data so that the flags don't need to be reported again when the session is resumed
+// after waking up from sleep
+#ifdef retained_system
+retained_system
+#endif
+uint16_t g_reportedUpdateFlags;
+
+uint16_t updateFlagsState() {
+    const uint16_t REPORTED_UPDATE_FLAGS_VALID = 0x5a00; // Distinguishes a reported state from uninitialized memory
+    uint8_t enabled = 0;
+    uint8_t forced = 0;
+    system_get_flag(SYSTEM_FLAG_OTA_UPDATE_ENABLED, &enabled, nullptr);
+    system_get_flag(SYSTEM_FLAG_OTA_UPDATE_FORCED, &forced, nullptr);
+    return REPORTED_UPDATE_FLAGS_VALID | (enabled ? 0x01 : 0x00) | (forced ? 0x02 : 0x00);
+}
+
 inline bool isSuffix(const char* eventName, const char* prefix, const char* suffix) {
     // todo - sanity check parameters?
     return !strncmp(eventName+strlen(prefix), suffix, strlen(eventName)-strlen(prefix));
@@ -311,9 +334,13 @@ User_Var_Lookup_Table_t* find_var_by_key_or_add(const char* varKey, const void*
 
     User_Var_Lookup_Table_t* result = find_var_by_key(varKey);
     if (result) {
+        if (result->userVarType != userVarType) {
+            DescribeCache::instance()->invalidate(DescribeCache::APPLICATION);
+        }
         *result = item;
     } else if ((size_t)g_cloudVars.size() < USER_VAR_MAX_COUNT) {
         if (g_cloudVars.append(std::move(item))) {
+            DescribeCache::instance()->invalidate(DescribeCache::APPLICATION);
             result = &g_cloudVars.last();
         } else {
             LOG(ERROR, "Memory allocation error");
@@ -346,6 +373,7 @@ User_Func_Lookup_Table_t* find_func_by_key_or_add(const char* funcKey, const clo
         *result = item;
     } else if ((size_t)g_cloudFuncs.size() < USER_FUNC_MAX_COUNT) {
         if (g_cloudFuncs.append(std::move(item))) {
+            DescribeCache::instance()->invalidate(DescribeCache::APPLICATION);
             result = &g_cloudFuncs.last();
         } else {
             LOG(ERROR, "Memory allocation error");
@@ -432,6 +460,81 @@ uint32_t compute_describe_system_checksum()
     return checksum;
 }
 
+uint32_t describe_app_checksum()
+{
+    return DescribeCache::instance()->checksum(DescribeCache::APPLICATION, compute_describe_app_checksum);
+}
+
+/**
+ * Invalidates the cached system section of the Describe message if the modem or SIM card info that
+ * it includes has become available or has changed.
+ */
+void update_describe_system_properties()
+{
+#if HAL_PLATFORM_CELLULAR
+    CellularDevice dev = {};
+    dev.size = sizeof(dev);
+    if (cellular_device_info(&dev, nullptr) != 0) {
+        return;
+    }
+    uint32_t chk[3];
+    chk[0] = string_crc(dev.imei);
+    chk[1] = string_crc(dev.iccid);
+    chk[2] = string_crc(dev.radiofw);
+    if (DescribeCache::instance()->updateSystemFingerprint(crc(chk, sizeof(chk)))) {
+        LOG(TRACE, "Modem info has changed, regenerating system describe");
+    }
+#endif // HAL_PLATFORM_CELLULAR
+}
+
+uint32_t describe_system_checksum()
+{
+    return DescribeCache::instance()->checksum(DescribeCache::SYSTEM, compute_describe_system_checksum);
+}
+
+/**
+ * Serializes the system section of the Describe message. The data is generated only once and then
+ * served from the cache until a firmware update is applied or the modem info changes.
+ */
+bool append_system_describe(appender_fn appender, void* append_data, void* reserved)
+{
+    return DescribeCache::instance()->append(DescribeCache::SYSTEM, system_module_info, appender, append_data);
+}
+
+/**
+ * Serializes the application section of the Describe message. The data is served from the cache
+ * until a function or variable is registered.
+ */
+bool append_app_describe(appender_fn appender, void* append_data, void* reserved)
+{
+    return DescribeCache::instance()->append(DescribeCache::APPLICATION, system_app_info, appender, append_data);
+}
+
+/**
+ * Serializes the vitals. If the delta encoding is enabled, only the values that have changed
+ * since the last acknowledged snapshot are serialized.
+ */
+bool append_vitals(appender_fn appender, void* append_data, uint32_t flags, uint32_t page, void* reserved)
+{
+    const auto encoder = VitalsDeltaEncoder::instance();
+    if (!(flags & 1) || !encoder->isEnabled()) { // Delta encoding is supported only for binary data
+        return system_metrics(appender, append_data, flags, page, reserved);
+    }
+    Vector<char> data;
+    const auto appendToVector = [](void* data, const uint8_t* buf, size_t size) {
+        return static_cast<Vector<char>*>(data)->append((const char*)buf, size);
+    };
+    if (!system_metrics(appendToVector, &data, flags, page, reserved)) {
+        return false;
+    }
+    const int r = encoder->encode(data.data(), data.size(), appender, append_data);
+    if (r < 0) {
+        LOG(ERROR, "Failed to encode vitals: %d", r);
+        return false;
+    }
+    return true;
+}
+
 
 /**
  * Register a function.
@@ -543,16 +646,19 @@ uint32_t compute_cloud_state_checksum(SparkAppStateSelector::Enum stateSelector,
 		{
 		case SparkAppStateSelector::DESCRIBE_APP:
 			update_persisted_state([](SessionPersistData& data){
-				data.describe_app_crc = compute_describe_app_checksum();
+				data.describe_app_crc = describe_app_checksum();
 				data.app_state_flags |= AppStateDescriptor::APP_DESCRIBE_CRC;
 			});
 			break;
 		case SparkAppStateSelector::DESCRIBE_SYSTEM:
 			update_persisted_state([](SessionPersistData& data){
-				data.describe_system_crc = compute_describe_system_checksum();
+				data.describe_system_crc = describe_system_checksum();
 				data.app_state_flags |= AppStateDescriptor::SYSTEM_DESCRIBE_CRC;
 			});
 			break;
+		case SparkAppStateSelector::DESCRIBE_METRICS:
+			VitalsDeltaEncoder::instance()->acknowledge();
+			break;
 		}
 	}
 	else if (operation == SparkAppStateUpdate::PERSIST)
@@ -609,10 +715,10 @@ uint32_t compute_cloud_state_checksum(SparkAppStateSelector::Enum stateSelector,
 		switch (stateSelector)
 		{
 		case SparkAppStateSelector::DESCRIBE_APP:
-			return compute_describe_app_checksum();
+			return describe_app_checksum();
 
 		case SparkAppStateSelector::DESCRIBE_SYSTEM:
-			return compute_describe_system_checksum();
+			return describe_system_checksum();
 		}
 	}
 	else if (operation == SparkAppStateUpdate::RESET && stateSelector == SparkAppStateSelector::ALL)
@@ -621,6 +727,11 @@ uint32_t compute_cloud_state_checksum(SparkAppStateSelector::Enum stateSelector,
 			data.app_state_flags = 0;
 		});
 	}
+	else if (operation == SparkAppStateUpdate::RESET && stateSelector == SparkAppStateSelector::DESCRIBE_METRICS)
+	{
+		// The last metrics Describe message could not be sent
+		VitalsDeltaEncoder::instance()->cancel();
+	}
 	return 0;
 }
 #endif /* HAL_PLATFORM_CLOUD_UDP */
@@ -1035,9 +1146,9 @@ void Spark_Protocol_Init(void)
         descriptor.get_variable_async = getUserVar;
         descriptor.was_ota_upgrade_successful = HAL_OTA_Flashed_GetStatus;
         descriptor.ota_upgrade_status_sent = HAL_OTA_Flashed_ResetStatus;
-        descriptor.append_system_info = system_module_info;
-        descriptor.append_app_info = system_app_info;
-        descriptor.append_metrics = system_metrics;
+        descriptor.append_system_info = append_system_describe;
+        descriptor.append_app_info = append_app_describe;
+        descriptor.append_metrics = append_vitals;
         descriptor.call_event_handler = invokeEventHandler;
 #if HAL_PLATFORM_CLOUD_UDP
         descriptor.app_state_selector_info = compute_cloud_state_checksum;
@@ -1090,6 +1201,11 @@ void Spark_Protocol_Init(void)
         }
 #endif // HAL_PLATFORM_COMPRESSED_OTA
 
+#if HAL_PLATFORM_COAP_BLOCKWISE
+        // Enable blockwise transfers of large events, variable values and function arguments
+        spark_protocol_set_connection_property(sp, protocol::Connection::BLOCKWISE_TRANSFERS, 1, nullptr, nullptr);
+#endif // HAL_PLATFORM_COAP_BLOCKWISE
+
 #if PLATFORM_ID != PLATFORM_GCC
         spark_protocol_set_connection_property(sp, protocol::Connection::SYSTEM_MODULE_VERSION, MODULE_VERSION,
                 nullptr, nullptr);
@@ -1145,6 +1261,7 @@ int Send_Firmware_Update_Flags()
     	system_refresh_flag(SYSTEM_FLAG_OTA_UPDATE_FORCED);
     }
 
+    g_reportedUpdateFlags = updateFlagsState();
     return 0;
 }
 
@@ -1152,6 +1269,8 @@ int Spark_Handshake(bool presence_announce)
 {
     cloud_socket_aborted = false; // Clear cancellation flag for socket operations
     LOG(INFO,"Starting handshake: presense_announce=%d", presence_announce);
+    // The modem is initialized at this point
+    update_describe_system_properties();
     bool session_resumed = false;
     int err = spark_protocol_handshake(sp);
 
@@ -1220,7 +1339,11 @@ int Spark_Handshake(bool presence_announce)
         LOG(INFO,"cloud connected from existing session.");
 
         publishSafeModeEventIfNeeded();
-        Send_Firmware_Update_Flags();
+        if (!CloudConnectionSettings::instance()->fastResume() || g_reportedUpdateFlags != updateFlagsState()) {
+            Send_Firmware_Update_Flags();
+        } else {
+            LOG(TRACE, "Firmware update flags have not changed; not sending");
+        }
 
         if (!hal_rtc_time_is_valid(nullptr) && spark_sync_time_last(nullptr, nullptr) == 0) {
             spark_protocol_send_time_request(sp);
@@ -1277,6 +1400,20 @@ void Spark_Process_Events()
     }
 }
 
+/**
+ * Returns true if the protocol layer has client messages that are waiting for a response and
+ * thus need the communication loop to be run periodically.
+ */
+bool Spark_Has_Pending_Messages()
+{
+    protocol_status status = {};
+    status.size = sizeof(status);
+    if (spark_protocol_get_status(sp, &status, nullptr) != 0) {
+        return false;
+    }
+    return status.flags & PROTOCOL_STATUS_HAS_PENDING_CLIENT_MESSAGES;
+}
+
 namespace {
 
 CloudDiagnostics g_cloudDiagnostics;
@@ -36,6 +36,7 @@ void Spark_Protocol_Init(void);
 int Spark_Handshake(bool presence_announce);
 bool Spark_Communication_Loop(void);
 void Spark_Process_Events();
+bool Spark_Has_Pending_Messages();
 
 void system_set_time(uint32_t time, unsigned param, void* reserved);
 
@@ -142,7 +143,8 @@ public:
     CloudConnectionSettings() :
             defaultDisconnectTimeout_(DEFAULT_DISCONNECT_TIMEOUT),
             defaultDisconnectGracefully_(DEFAULT_DISCONNECT_GRACEFULLY),
-            defaultDisconnectClearSession_(DEFAULT_DISCONNECT_CLEAR_SESSION) {
+            defaultDisconnectClearSession_(DEFAULT_DISCONNECT_CLEAR_SESSION),
+            fastResume_(false) {
     }
 
     void setDefaultDisconnectOptions(const CloudDisconnectOptions& options) {
@@ -192,6 +194,16 @@ public:
         return result;
     }
 
+    // When enabled, no messages other than the ones queued by the application are sent after resuming
+    // a session if the state of the device hasn't changed
+    void fastResume(bool enabled) {
+        fastResume_ = enabled;
+    }
+
+    bool fastResume() const {
+        return fastResume_;
+    }
+
     static CloudConnectionSettings* instance();
 
 private:
@@ -201,6 +213,8 @@ private:
     unsigned defaultDisconnectTimeout_;
     volatile bool defaultDisconnectGracefully_;
     bool defaultDisconnectClearSession_;
+    // Can only be accessed in the context of the system thread
+    bool fastResume_;
     // Pending disconnection options are set atomically and guarded by a spinlock
     CloudDisconnectOptions pendingDisconnectOptions_;
 };
@@ -25,6 +25,8 @@
 #include "system_update.h"
 #include "spark_wiring_system.h"
 #include "appender.h"
+#include "trace_recorder.h"
+#include "system_loop_stats.h"
 #include "debug.h"
 #include "delay_hal.h"
 #include "hal_platform.h"
@@ -235,6 +237,32 @@ void SystemControl::processRequest(ctrl_request* req, ControlRequestChannel* /*
         }
         break;
     }
+    case CTRL_REQUEST_DIAGNOSTIC_TRACE: {
+        struct Formatter {
+            static int callback(Appender* appender, void* data) {
+                return trace_dump(Appender::callback, appender, nullptr);
+            }
+        };
+        // Pause the recording so that the size of the dump doesn't change if the data needs to be
+        // formatted more than once
+        trace_set_enabled(false);
+        const int ret = formatReplyData(req, Formatter::callback);
+        // A non-zero byte in the request data indicates that the trace buffer should be cleared
+        if (ret == 0 && req->request_size > 0 && req->request_data[0]) {
+            trace_clear();
+        }
+        trace_set_enabled(true);
+        setResult(req, ret);
+        break;
+    }
+    case CTRL_REQUEST_DIAGNOSTIC_RESET_LOOP_STATS: {
+        LoopStats::instance()->reset();
+#if PLATFORM_THREADING
+        SystemThread.resetStats();
+#endif
+        setResult(req, SYSTEM_ERROR_NONE);
+        break;
+    }
     /* config requests */
     case CTRL_REQUEST_SET_CLAIM_CODE: {
         setResult(req, control::config::handleSetClaimCodeRequest(req));
@@ -293,7 +321,7 @@ void SystemControl::processRequest(ctrl_request* req, ControlRequestChannel* /*
         break;
     }
     case CTRL_REQUEST_FIRMWARE_UPDATE_DATA: {
-        setResult(req, control::firmwareUpdateDataRequest(req));
+        control::firmwareUpdateDataRequest(req);
         break;
     }
     case CTRL_REQUEST_CLOUD_GET_CONNECTION_STATUS: {
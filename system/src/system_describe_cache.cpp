@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "system_describe_cache.h"
+
+#include <utility>
+
+namespace particle {
+
+namespace system {
+
+namespace {
+
+bool appendToVector(void* data, const uint8_t* buf, size_t size) {
+    const auto vec = static_cast<Vector<char>*>(data);
+    return vec->append((const char*)buf, size);
+}
+
+} // namespace
+
+DescribeCache::DescribeCache() :
+        entries_(),
+        systemFingerprint_(0),
+        hasSystemFingerprint_(false) {
+}
+
+bool DescribeCache::append(Section section, SerializeFn serialize, appender_fn appender, void* appenderData) {
+    auto& e = entries_[section];
+    if (!e.hasData) {
+        Vector<char> data;
+        if (!serialize(appendToVector, &data, nullptr /* reserved */)) {
+            // Not enough memory or the serialization has failed. Try again without caching
+            return serialize(appender, appenderData, nullptr /* reserved */);
+        }
+        data.trimToSize(); // Ignore error
+        e.data = std::move(data);
+        e.hasData = true;
+    }
+    if (e.data.isEmpty()) {
+        return true;
+    }
+    return appender(appenderData, (const uint8_t*)e.data.data(), e.data.size());
+}
+
+uint32_t DescribeCache::checksum(Section section, ChecksumFn compute) {
+    auto& e = entries_[section];
+    if (!e.hasChecksum) {
+        e.checksum = compute();
+        e.hasChecksum = true;
+    }
+    return e.checksum;
+}
+
+void DescribeCache::invalidate(Section section) {
+    auto& e = entries_[section];
+    e.data = Vector<char>(); // Free the memory
+    e.checksum = 0;
+    e.hasData = false;
+    e.hasChecksum = false;
+}
+
+void DescribeCache::invalidateAll() {
+    invalidate(SYSTEM);
+    invalidate(APPLICATION);
+}
+
+bool DescribeCache::updateSystemFingerprint(uint32_t fingerprint) {
+    if (hasSystemFingerprint_ && fingerprint == systemFingerprint_) {
+        return false;
+    }
+    systemFingerprint_ = fingerprint;
+    hasSystemFingerprint_ = true;
+    invalidate(SYSTEM);
+    return true;
+}
+
+DescribeCache* DescribeCache::instance() {
+    static DescribeCache cache;
+    return &cache;
+}
+
+} // namespace system
+
+} // namespace particle
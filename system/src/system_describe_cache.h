@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "appender.h"
+
+#include "spark_wiring_vector.h"
+
+#include <cstdint>
+
+namespace particle {
+
+namespace system {
+
+/**
+ * Cache of the serialized sections of the Describe message.
+ *
+ * Generating the system section requires enumerating and validating the firmware modules, which
+ * is relatively expensive and would otherwise be done every time the cloud requests the Describe
+ * data or the checksums of the device's state are compared during a handshake. The cached data is
+ * kept until the respective section is explicitly invalidated.
+ *
+ * This class is not thread-safe and is expected to be used in the system thread.
+ */
+class DescribeCache {
+public:
+    /**
+     * Section of the Describe message.
+     */
+    enum Section {
+        SYSTEM = 0, ///< System modules and properties.
+        APPLICATION = 1 ///< Cloud functions and variables.
+    };
+
+    /**
+     * Function that serializes a section of the Describe message.
+     */
+    typedef bool (*SerializeFn)(appender_fn appender, void* appenderData, void* reserved);
+
+    /**
+     * Function that computes the checksum of a section of the Describe message.
+     */
+    typedef uint32_t (*ChecksumFn)();
+
+    DescribeCache();
+
+    /**
+     * Append a section of the Describe message.
+     *
+     * If the section is not cached, it's serialized using the provided function and stored in the
+     * cache. If there's not enough memory to cache the section, it's serialized directly to the
+     * destination appender.
+     *
+     * @param section Section.
+     * @param serialize Serialization function.
+     * @param appender Destination appender.
+     * @param appenderData Destination appender data.
+     * @return `true` on success, otherwise `false`.
+     */
+    bool append(Section section, SerializeFn serialize, appender_fn appender, void* appenderData);
+
+    /**
+     * Get the checksum of a section of the Describe message.
+     *
+     * @param section Section.
+     * @param compute Function that computes the checksum if it's not cached.
+     * @return Checksum.
+     */
+    uint32_t checksum(Section section, ChecksumFn compute);
+
+    /**
+     * Invalidate a section of the Describe message.
+     *
+     * @param section Section.
+     */
+    void invalidate(Section section);
+
+    /**
+     * Invalidate all sections.
+     */
+    void invalidateAll();
+
+    /**
+     * Update the fingerprint of the system properties that are obtained at run time.
+     *
+     * Some of the properties in the system section, such as the IMEI and ICCID on cellular
+     * devices, only become available once the modem is initialized and may change, e.g. when
+     * another SIM card is selected. The system section is invalidated when the fingerprint is set
+     * for the first time or when it changes.
+     *
+     * @param fingerprint Fingerprint of the properties.
+     * @return `true` if the system section has been invalidated, otherwise `false`.
+     */
+    bool updateSystemFingerprint(uint32_t fingerprint);
+
+    /**
+     * Check if the serialized data of a section is cached.
+     *
+     * @param section Section.
+     * @return `true` if the data is cached, otherwise `false`.
+     */
+    bool hasData(Section section) const {
+        return entries_[section].hasData;
+    }
+
+    static DescribeCache* instance();
+
+private:
+    struct Entry {
+        Vector<char> data; // Serialized section
+        uint32_t checksum; // Checksum of the section
+        bool hasData; // Whether the serialized section is cached
+        bool hasChecksum; // Whether the checksum is cached
+    };
+
+    Entry entries_[2];
+    uint32_t systemFingerprint_;
+    bool hasSystemFingerprint_;
+};
+
+} // namespace system
+
+} // namespace particle
@@ -180,6 +180,7 @@ int ListeningModeHandler::enqueueCommand(network_listen_command_t com, void* arg
     task->command = com;
     task->arg = arg;
     task->func = reinterpret_cast<ISRTaskQueue::TaskFunc>(&executeEnqueuedCommand);
+    task->pending = false;
 
     SystemISRTaskQueue.enqueue(task);
 
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "system_loop_scheduler.h"
+
+#include "hal_platform.h"
+
+#if HAL_PLATFORM_SOCKET_IOCTL_NOTIFY
+#include "system_threading.h"
+#endif
+
+#include <algorithm>
+#include <cstdint>
+
+namespace particle {
+
+namespace system {
+
+const system_tick_t LoopScheduler::MAX_DEADLINE;
+const system_tick_t LoopScheduler::STATS_WINDOW;
+
+LoopScheduler::LoopScheduler(ClockFn clock) :
+        clock_(clock),
+        deadline_(0),
+        windowStart_(0),
+        passStart_(0),
+        busyTime_(0),
+        passCount_(0),
+        wakeups_(0),
+        load_(0),
+        depth_(0),
+        pending_(false),
+        hasDeadline_(false),
+        hasWindow_(false) {
+}
+
+void LoopScheduler::wakeIn(system_tick_t timeout) {
+    const system_tick_t t = clock_() + std::min(timeout, MAX_DEADLINE) * 1000;
+    if (!hasDeadline_ || (int32_t)(t - deadline_) < 0) {
+        deadline_ = t;
+        hasDeadline_ = true;
+    }
+}
+
+void LoopScheduler::wakeUp() {
+    pending_.store(true, std::memory_order_release);
+#if HAL_PLATFORM_SOCKET_IOCTL_NOTIFY
+    // The system thread waits for a thread notification rather than on its queue only on the
+    // platforms that support socket notifications. Elsewhere, the loop polls at the active rate
+    // and picks up the pending flag on the next pass
+    SystemThread.notify();
+#endif // HAL_PLATFORM_SOCKET_IOCTL_NOTIFY
+}
+
+system_tick_t LoopScheduler::nextTimeout(system_tick_t maxTimeout) const {
+    if (pending_.load(std::memory_order_acquire)) {
+        return 0;
+    }
+    if (!hasDeadline_) {
+        return maxTimeout;
+    }
+    const int32_t dt = deadline_ - clock_();
+    if (dt <= 0) {
+        return 0;
+    }
+    const system_tick_t timeout = (dt + 999) / 1000;
+    return std::min(timeout, maxTimeout);
+}
+
+void LoopScheduler::beginPass() {
+    if (depth_++ > 0) {
+        return; // The loop is being run recursively, e.g. via delay() in a cloud function handler
+    }
+    passStart_ = clock_();
+    if (!hasWindow_) {
+        windowStart_ = passStart_;
+        hasWindow_ = true;
+    }
+    hasDeadline_ = false;
+    pending_.store(false, std::memory_order_release);
+}
+
+void LoopScheduler::endPass() {
+    if (!depth_ || --depth_ > 0) {
+        return;
+    }
+    const system_tick_t t = clock_();
+    busyTime_ += t - passStart_;
+    ++passCount_;
+    const system_tick_t window = t - windowStart_;
+    if (window >= STATS_WINDOW) {
+        wakeups_ = ((uint64_t)passCount_ * 1000000 + window / 2) / window;
+        load_ = std::min<uint64_t>(((uint64_t)busyTime_ * 10000 + window / 2) / window, 10000);
+        windowStart_ = t;
+        busyTime_ = 0;
+        passCount_ = 0;
+    }
+}
+
+LoopScheduler* LoopScheduler::instance() {
+    static LoopScheduler sched;
+    return &sched;
+}
+
+} // namespace system
+
+} // namespace particle
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "timer_hal.h"
+
+#include <atomic>
+
+namespace particle {
+
+namespace system {
+
+/**
+ * Scheduler of the system loop.
+ *
+ * Instead of polling all subsystems at a fixed rate, the system loop sleeps until the earliest
+ * deadline registered by a subsystem during the last pass of the loop, or until an event is
+ * signaled via `wakeUp()`. Deadlines are only valid for one pass: a subsystem that is busy (e.g.
+ * connecting to the cloud) registers a deadline on every pass, and an idle subsystem relies on
+ * events such as incoming socket data or messages posted to the system thread.
+ *
+ * The scheduler also measures the number of passes of the loop per second and the share of time
+ * spent in the loop.
+ *
+ * `wakeUp()` can be called from any thread or an ISR. The other methods are expected to be called
+ * in the thread running the system loop.
+ */
+class LoopScheduler {
+public:
+    /**
+     * Function returning the current time in microseconds.
+     */
+    typedef system_tick_t (*ClockFn)();
+
+    /**
+     * Maximum time in milliseconds a deadline can be set in the future.
+     */
+    static const system_tick_t MAX_DEADLINE = 3600000;
+
+    /**
+     * Length of the window over which the statistics are computed, in microseconds.
+     */
+    static const system_tick_t STATS_WINDOW = 1000000;
+
+    explicit LoopScheduler(ClockFn clock = HAL_Timer_Get_Micro_Seconds);
+
+    /**
+     * Request a pass of the loop within the specified time.
+     *
+     * @param timeout Time in milliseconds.
+     */
+    void wakeIn(system_tick_t timeout);
+
+    /**
+     * Request a pass of the loop as soon as possible.
+     */
+    void wakeUp();
+
+    /**
+     * Get the time until the next pass of the loop is due.
+     *
+     * @param maxTimeout Maximum time in milliseconds.
+     * @return Time in milliseconds.
+     */
+    system_tick_t nextTimeout(system_tick_t maxTimeout) const;
+
+    /**
+     * Notify the scheduler that a pass of the loop has started.
+     *
+     * All previously registered deadlines and events are discarded.
+     */
+    void beginPass();
+
+    /**
+     * Notify the scheduler that a pass of the loop has finished.
+     */
+    void endPass();
+
+    /**
+     * Get the number of passes of the loop per second.
+     *
+     * @return Number of passes measured over the last complete window.
+     */
+    unsigned wakeupsPerSecond() const {
+        return wakeups_;
+    }
+
+    /**
+     * Get the share of time spent in the loop.
+     *
+     * @return Share of time in hundredths of a percent measured over the last complete window.
+     */
+    unsigned load() const {
+        return load_;
+    }
+
+    static LoopScheduler* instance();
+
+private:
+    ClockFn clock_; // Clock function
+    system_tick_t deadline_; // Time of the next pass (microseconds)
+    system_tick_t windowStart_; // Start time of the current statistics window (microseconds)
+    system_tick_t passStart_; // Start time of the current pass (microseconds)
+    system_tick_t busyTime_; // Time spent in the loop during the current window (microseconds)
+    unsigned passCount_; // Number of passes during the current window
+    unsigned wakeups_; // Number of passes per second during the last window
+    unsigned load_; // Share of time spent in the loop during the last window
+    unsigned depth_; // Nesting level of the current pass
+    std::atomic<bool> pending_; // Whether an event is pending
+    bool hasDeadline_; // Whether a deadline is registered
+    bool hasWindow_; // Whether the statistics window is started
+};
+
+} // namespace system
+
+} // namespace particle
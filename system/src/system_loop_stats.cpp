@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "system_loop_stats.h"
+
+#include "spark_wiring_diagnostics.h"
+#include "hal_platform.h"
+
+namespace particle {
+
+namespace system {
+
+namespace {
+
+enum class LoopStatType {
+    MIN,
+    MAX,
+    P99
+};
+
+class LoopStageDiagnosticData: public AbstractUnsignedIntegerDiagnosticData {
+public:
+    LoopStageDiagnosticData(uint16_t id, const char* name, LoopStage stage, LoopStatType type) :
+            AbstractUnsignedIntegerDiagnosticData(id, name),
+            stage_(stage),
+            type_(type) {
+    }
+
+    virtual int get(IntType& val) override {
+        const auto& hist = LoopStats::instance()->histogram(stage_);
+        switch (type_) {
+        case LoopStatType::MIN:
+            val = hist.min();
+            break;
+        case LoopStatType::MAX:
+            val = hist.max();
+            break;
+        case LoopStatType::P99:
+            val = hist.percentile(99);
+            break;
+        }
+        return 0; // OK
+    }
+
+private:
+    LoopStage stage_;
+    LoopStatType type_;
+};
+
+#define LOOP_STAGE_DIAG_DATA(_stage, _type) \
+        LoopStageDiagnosticData g_loop##_stage##_type##DiagData(DIAG_ID_SYSTEM_LOOP_##_stage##_##_type, \
+                DIAG_NAME_SYSTEM_LOOP_##_stage##_##_type, LoopStage::_stage, LoopStatType::_type)
+
+LOOP_STAGE_DIAG_DATA(ISR_TASKS, MIN);
+LOOP_STAGE_DIAG_DATA(ISR_TASKS, MAX);
+LOOP_STAGE_DIAG_DATA(ISR_TASKS, P99);
+LOOP_STAGE_DIAG_DATA(NETWORK, MIN);
+LOOP_STAGE_DIAG_DATA(NETWORK, MAX);
+LOOP_STAGE_DIAG_DATA(NETWORK, P99);
+LOOP_STAGE_DIAG_DATA(CLOUD, MIN);
+LOOP_STAGE_DIAG_DATA(CLOUD, MAX);
+LOOP_STAGE_DIAG_DATA(CLOUD, P99);
+LOOP_STAGE_DIAG_DATA(FIRMWARE_UPDATE, MIN);
+LOOP_STAGE_DIAG_DATA(FIRMWARE_UPDATE, MAX);
+LOOP_STAGE_DIAG_DATA(FIRMWARE_UPDATE, P99);
+#if HAL_PLATFORM_BLE_SETUP
+// Control requests received over USB are processed as ISR tasks
+LOOP_STAGE_DIAG_DATA(CONTROL, MIN);
+LOOP_STAGE_DIAG_DATA(CONTROL, MAX);
+LOOP_STAGE_DIAG_DATA(CONTROL, P99);
+#endif // HAL_PLATFORM_BLE_SETUP
+
+} // namespace
+
+void LoopStats::reset() {
+    for (auto& hist: hist_) {
+        hist.reset();
+    }
+}
+
+LoopStats* LoopStats::instance() {
+    static LoopStats stats;
+    return &stats;
+}
+
+} // namespace system
+
+} // namespace particle
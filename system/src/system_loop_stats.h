@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "latency_histogram.h"
+#include "timer_hal.h"
+
+namespace particle {
+
+namespace system {
+
+/**
+ * Stages of the system loop.
+ */
+enum class LoopStage {
+    ISR_TASKS, ///< Processing of the ISR task queue.
+    NETWORK, ///< Network connection management.
+    CLOUD, ///< Cloud connection management and protocol processing.
+    FIRMWARE_UPDATE, ///< Firmware update processing.
+    CONTROL, ///< Processing of control requests received over BLE. Only recorded on platforms with BLE setup.
+    COUNT
+};
+
+/**
+ * Latency statistics of the stages of the system loop.
+ *
+ * The time spent in each stage of `Spark_Idle_Events()` is recorded in microseconds. The minimum,
+ * maximum and 99th percentile per stage are exposed as diagnostic sources (`sys:loop:<stage>:min`,
+ * `sys:loop:<stage>:max` and `sys:loop:<stage>:p99`). If the loop is run recursively, the time of
+ * the nested pass is included in the time of the outer stage.
+ *
+ * The statistics are expected to be updated in the thread running the system loop.
+ */
+class LoopStats {
+public:
+    void record(LoopStage stage, system_tick_t micros) {
+        hist_[(int)stage].record(micros);
+    }
+
+    const LatencyHistogram& histogram(LoopStage stage) const {
+        return hist_[(int)stage];
+    }
+
+    void reset();
+
+    static LoopStats* instance();
+
+private:
+    LatencyHistogram hist_[(int)LoopStage::COUNT];
+};
+
+/**
+ * Helper class recording the time spent in a stage of the system loop.
+ */
+class LoopStageTimer {
+public:
+    explicit LoopStageTimer(LoopStage stage) :
+            start_(HAL_Timer_Get_Micro_Seconds()),
+            stage_(stage) {
+    }
+
+    ~LoopStageTimer() {
+        LoopStats::instance()->record(stage_, HAL_Timer_Get_Micro_Seconds() - start_);
+    }
+
+    LoopStageTimer(const LoopStageTimer&) = delete;
+    LoopStageTimer& operator=(const LoopStageTimer&) = delete;
+
+private:
+    system_tick_t start_;
+    LoopStage stage_;
+};
+
+} // namespace system
+
+} // namespace particle
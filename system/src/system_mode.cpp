@@ -21,6 +21,7 @@
 #include "system_task.h"
 #include "system_cloud_internal.h"
 #include "system_threading.h"
+#include "system_loop_scheduler.h"
 
 #include "core_hal.h"
 
@@ -63,11 +64,13 @@ void spark_cloud_flag_connect(void)
     SPARK_WLAN_SLEEP = 0;
     // Reset disconnection options
     CloudConnectionSettings::instance()->takePendingDisconnectOptions();
+    system::LoopScheduler::instance()->wakeUp();
 }
 
 void spark_cloud_flag_disconnect(void)
 {
     SPARK_CLOUD_AUTO_CONNECT = 0;
+    system::LoopScheduler::instance()->wakeUp();
 }
 
 bool spark_cloud_flag_auto_connect()
@@ -44,6 +44,7 @@ LOG_SOURCE_CATEGORY("system.nm")
 #include "timer_hal.h"
 #include "delay_hal.h"
 #include "system_network_diagnostics.h"
+#include "system_loop_scheduler.h"
 
 #define CHECKV(_expr) \
         ({ \
@@ -439,6 +440,9 @@ void NetworkManager::transition(State state) {
     LOG(INFO, "State changed: %s -> %s", stateToName(state_), stateToName(state));
 
     state_ = state;
+    // Interface events are delivered by the network stack's thread. Make sure the system loop
+    // reacts to the new state without waiting for its idle timeout
+    system::LoopScheduler::instance()->wakeUp();
 }
 
 void NetworkManager::ifEventHandlerCb(void* arg, if_t iface, const struct if_event* ev) {
@@ -26,6 +26,10 @@ LOG_SOURCE_CATEGORY("sys.power");
 #include "debug.h"
 #include "spark_wiring_platform.h"
 #include "pinmap_hal.h"
+#include "i2c_hal.h"
+#include "check.h"
+
+#include <atomic>
 
 #if (HAL_PLATFORM_PMIC_BQ24195 && HAL_PLATFORM_FUELGAUGE_MAX17043)
 
@@ -122,6 +126,104 @@ bool isValid(T v) {
   return true;
 }
 
+// Time to wait for the status registers to be read
+constexpr system_tick_t STATUS_READ_TIMEOUT = 1000;
+constexpr system_tick_t PMIC_I2C_TIMEOUT = 10;
+constexpr system_tick_t FUELGAUGE_I2C_TIMEOUT = 10;
+
+// Snapshot of the PMIC and fuel gauge registers used by the power manager
+struct StatusRegisters {
+  uint8_t pmic[FAULT_REGISTER + 1]; // REG00 to REG09
+  uint8_t lastFault; // Fault status latched since the previous read of REG09
+  uint8_t fuelConfig[2]; // CONFIG register of the fuel gauge (MSB, LSB)
+};
+
+// Reads the status registers using queued I2C transactions, so that the bus lock is only held
+// while the registers are being transferred, and in two bursts rather than one transaction per
+// register. Must only be called from the power manager thread
+int readStatusRegisters(StatusRegisters* status) {
+  static StatusRegisters regs = {};
+  static const uint8_t faultReg = FAULT_REGISTER;
+  static const uint8_t firstReg = INPUT_SOURCE_REGISTER;
+  static const uint8_t configReg = CONFIG_REGISTER;
+  static const hal_i2c_transaction_segment_t pmicSegs[] = {
+    // In order to read the current fault status, the host has to read REG09 two times
+    // consecutively. The 1st read returns the fault status latched since the last read
+    { (void*)&faultReg, 1, HAL_I2C_TRANSACTION_SEGMENT_FLAG_NONE },
+    { &regs.lastFault, 1, HAL_I2C_TRANSACTION_SEGMENT_FLAG_READ | HAL_I2C_TRANSACTION_SEGMENT_FLAG_STOP },
+    { (void*)&firstReg, 1, HAL_I2C_TRANSACTION_SEGMENT_FLAG_NONE },
+    { regs.pmic, sizeof(regs.pmic), HAL_I2C_TRANSACTION_SEGMENT_FLAG_READ }
+  };
+  static const hal_i2c_transaction_segment_t fuelSegs[] = {
+    { (void*)&configReg, 1, HAL_I2C_TRANSACTION_SEGMENT_FLAG_NONE },
+    { regs.fuelConfig, sizeof(regs.fuelConfig), HAL_I2C_TRANSACTION_SEGMENT_FLAG_READ }
+  };
+  struct Context {
+    os_semaphore_t sem;
+    int error;
+    // Decremented by the callbacks, which run on the I2C worker threads
+    std::atomic<unsigned> pending;
+  };
+  static Context ctx = {};
+  static hal_i2c_transaction_t pmicTrans = {};
+  static hal_i2c_transaction_t fuelTrans = {};
+
+  if (!ctx.sem && os_semaphore_create(&ctx.sem, 2, 0)) {
+    ctx.sem = nullptr;
+    return SYSTEM_ERROR_NO_MEMORY;
+  }
+  if (ctx.pending.load()) {
+    // The transactions of a previous call that timed out are still queued
+    return SYSTEM_ERROR_BUSY;
+  }
+  // Discard the notifications of the transactions of a previous call that timed out
+  while (!os_semaphore_take(ctx.sem, 0, false)) {
+  }
+  const auto callback = [](hal_i2c_transaction_t* t, int error, void* context) {
+    const auto ctx = static_cast<Context*>(context);
+    if (error < 0) {
+      ctx->error = error;
+    }
+    --ctx->pending;
+    os_semaphore_give(ctx->sem, false);
+  };
+  pmicTrans.size = sizeof(pmicTrans);
+  pmicTrans.segments = pmicSegs;
+  pmicTrans.segment_count = sizeof(pmicSegs) / sizeof(pmicSegs[0]);
+  pmicTrans.address = PMIC_ADDRESS;
+  pmicTrans.timeout_ms = PMIC_I2C_TIMEOUT;
+  pmicTrans.callback = callback;
+  pmicTrans.context = &ctx;
+  fuelTrans.size = sizeof(fuelTrans);
+  fuelTrans.segments = fuelSegs;
+  fuelTrans.segment_count = sizeof(fuelSegs) / sizeof(fuelSegs[0]);
+  fuelTrans.address = MAX17043_ADDRESS;
+  fuelTrans.timeout_ms = FUELGAUGE_I2C_TIMEOUT;
+  fuelTrans.callback = callback;
+  fuelTrans.context = &ctx;
+  ctx.error = 0;
+  // Both transactions are accounted for before the first one can complete
+  ctx.pending = 2;
+  int r = hal_i2c_queue_transaction(HAL_PLATFORM_PMIC_BQ24195_I2C, &pmicTrans, nullptr);
+  if (r < 0) {
+    ctx.pending = 0;
+    return r;
+  }
+  const int fuelResult = hal_i2c_queue_transaction(HAL_PLATFORM_FUELGAUGE_MAX17043_I2C, &fuelTrans, nullptr);
+  if (fuelResult < 0) {
+    --ctx.pending;
+  }
+  for (unsigned i = 0; i < (fuelResult < 0 ? 1u : 2u); ++i) {
+    if (os_semaphore_take(ctx.sem, STATUS_READ_TIMEOUT, false)) {
+      return SYSTEM_ERROR_TIMEOUT;
+    }
+  }
+  CHECK(fuelResult);
+  CHECK(ctx.error);
+  *status = regs;
+  return 0;
+}
+
 } // anonymous
 
 volatile bool PowerManager::update_ = true;
@@ -224,31 +326,36 @@ void PowerManager::handleUpdate() {
 
   update_ = false;
 
-  PMIC power(true);
-  FuelGauge fuel(true);
+  StatusRegisters regs;
+  int r = readStatusRegisters(&regs);
+  if (r < 0) {
+    LOG(ERROR, "Failed to read status registers: %d", r);
+    return;
+  }
 
-  // In order to read the current fault status, the host has to read REG09 two times
-  // consecutively. The 1st reads fault register status from the last read and the 2nd
-  // reads the current fault register status.
-  volatile uint8_t lastFault = power.getFault();
-  const uint8_t curFault = power.getFault() | lastFault;
+  const uint8_t curFault = regs.pmic[FAULT_REGISTER] | regs.lastFault;
 
   // Watchdog fault or buck converter got disabled
-  if ((curFault & 0x80 /*watchdog fault*/) || !power.isBuckEnabled()) {
+  if ((curFault & 0x80 /*watchdog fault*/) || (regs.pmic[INPUT_SOURCE_REGISTER] & 0x80)) {
     // Restore parameters
     initDefault();
+    r = readStatusRegisters(&regs);
+    if (r < 0) {
+      LOG(ERROR, "Failed to read status registers: %d", r);
+      return;
+    }
   } else {
     // It is called in loop
     // handleCharging();
   }
 
-  const uint8_t status = power.getSystemStatus();
+  const uint8_t status = regs.pmic[SYSTEM_STATUS_REGISTER];
   const uint8_t pwr_good = (status >> 2) & 0b01;
 
   // Deduce current battery state
   const uint8_t chrg_stat = (status >> 4) & 0b11;
   if (chrg_stat) {
-    if (power.isChargingEnabled()) {
+    if ((regs.pmic[POWERON_CONFIG_REGISTER] & 0b00110000) == 0b00010000 /* charging enabled */) {
       // Charging or charged
       if (chrg_stat == 0b11) {
         batteryStateTransitioningTo(BATTERY_STATE_CHARGED);
@@ -290,7 +397,7 @@ void PowerManager::handleUpdate() {
   // we also cannot modify input current limit while DPDM is running,
   // as that will cause a race condition and we might be left with 100mA
   // ILIM after it finishes.
-  if (pwr_good && !power.isInDPDM()) {
+  if (pwr_good && !(regs.pmic[MISC_CONTROL_REGISTER] & 0x80 /* DPDM detection in progress */)) {
     switch (powerSourceFromStatus(status)) {
       case POWER_SOURCE_USB_HOST: {
 #if HAL_PLATFORM_POWER_WORKAROUND_USB_HOST_VIN_SOURCE
@@ -336,8 +443,9 @@ void PowerManager::handleUpdate() {
     system_notify_event(power_source, (int)g_powerSource);
   }
 
-  const bool lowBat = fuel.getAlert();
+  const bool lowBat = regs.fuelConfig[1] & 0x20;
   if (lowBat) {
+    FuelGauge fuel(true);
     fuel.clearAlert();
     if (lowBatEnabled_) {
       lowBatEnabled_ = false;
@@ -47,6 +47,12 @@
 #include "system_power.h"
 #include "simple_pool_allocator.h"
 #include "system_ble_prov.h"
+#include "system_vitals_delta.h"
+#include "system_loop_scheduler.h"
+#include "system_loop_stats.h"
+#include "trace_recorder.h"
+#include "ecc_precompute.h"
+#include "mbedtls_util.h"
 
 #include "spark_wiring_network.h"
 #include "spark_wiring_constants.h"
@@ -54,6 +60,7 @@
 #include "system_threading.h"
 #include "spark_wiring_interrupts.h"
 #include "spark_wiring_led.h"
+#include <algorithm>
 #if HAL_PLATFORM_IFAPI
 #include "system_listening_mode.h"
 #endif
@@ -304,7 +311,9 @@ void establish_cloud_connection()
         diag->status(CloudDiagnostics::CONNECTING);
         system_notify_event(cloud_status, cloud_status_connecting);
         diag->connectionAttempt();
+        TRACE_BEGIN(TRACE_ID_SYSTEM_CLOUD_CONNECT, 0, 0);
         int connect_result = spark_cloud_socket_connect();
+        TRACE_END(TRACE_ID_SYSTEM_CLOUD_CONNECT, connect_result, 0);
         if (connect_result >= 0)
         {
             SPARK_CLOUD_SOCKETED = 1;
@@ -347,7 +356,9 @@ int cloud_handshake()
 	bool udp = HAL_Feature_Get(FEATURE_CLOUD_UDP);
     feature_cloud_udp = (uint8_t)udp;
 	bool presence_announce = !udp;
+	TRACE_BEGIN(TRACE_ID_SYSTEM_CLOUD_HANDSHAKE, 0, 0);
 	int err = Spark_Handshake(presence_announce);
+	TRACE_END(TRACE_ID_SYSTEM_CLOUD_HANDSHAKE, err, 0);
 	return err;
 }
 
@@ -432,6 +443,23 @@ void handle_cloud_connection(bool force_events)
     }
 }
 
+/**
+ * Precomputes the handshake crypto while the device is waiting for the network to come up or is
+ * already connected to the cloud, so that the connection attempt itself is not delayed.
+ */
+void manage_handshake_precompute()
+{
+    if (!network_ready(0, 0, 0) || SPARK_CLOUD_CONNECTED)
+    {
+        // Computes at most one value per call
+        if (ecc_precompute_fill(mbedtls_default_rng, nullptr, nullptr) > 0)
+        {
+            // The pool may not be full yet
+            system::LoopScheduler::instance()->wakeIn(SYSTEM_LOOP_ACTIVE_TIMEOUT);
+        }
+    }
+}
+
 void manage_cloud_connection(bool force_events)
 {
     if (spark_cloud_flag_auto_connect() == 0)
@@ -440,6 +468,8 @@ void manage_cloud_connection(bool force_events)
     }
     else // cloud connection is wanted
     {
+        manage_handshake_precompute();
+
         establish_cloud_connection();
 
         handle_cloud_connection(force_events);
@@ -483,6 +513,7 @@ int system_isr_task_queue_free_memory(void *ptrToFree) {
        free(freeTask->arg);
        system_pool_free(task, nullptr);
     };
+    task->pending = false;
 
     SystemISRTaskQueue.enqueue(task);
     return 0;
@@ -497,14 +528,53 @@ static void process_isr_task_queue()
 extern void system_handle_button_clicks(bool isIsr);
 #endif
 
+/**
+ * Registers the deadline of the next pass of the system loop. The subsystems that are busy
+ * connecting or transferring data are polled at a fixed rate, otherwise the loop only runs when
+ * an event is signaled or the idle timeout expires.
+ */
+void schedule_system_loop()
+{
+    bool busy = SPARK_FLASH_UPDATE || system::FirmwareUpdate::instance()->isRunning() ||
+            network_connecting(0, 0, 0) || network_listening(0, 0, 0);
+    if (!busy && spark_cloud_flag_auto_connect() && network_ready(0, 0, 0) && !SPARK_WLAN_SLEEP)
+    {
+        // Connecting to the cloud, performing the handshake or waiting for a response
+        busy = !SPARK_CLOUD_CONNECTED || Spark_Has_Pending_Messages();
+    }
+#if HAL_PLATFORM_BLE_SETUP
+    if (!busy)
+    {
+        // Control requests received over BLE are processed in the system loop
+        busy = hal_ble_gap_is_connected(nullptr, nullptr);
+    }
+#endif
+    if (busy)
+    {
+        system::LoopScheduler::instance()->wakeIn(SYSTEM_LOOP_ACTIVE_TIMEOUT);
+    }
+}
+
+unsigned system_loop_timeout(unsigned max_timeout)
+{
+    return system::LoopScheduler::instance()->nextTimeout(max_timeout);
+}
+
 void Spark_Idle_Events(bool force_events/*=false*/)
 {
+    TRACE_SCOPE(TRACE_ID_SYSTEM_LOOP, force_events, 0);
+    const auto sched = system::LoopScheduler::instance();
+    sched->beginPass();
+
     HAL_Notify_WDT();
 
     ON_EVENT_DELTA();
     spark_loop_total_millis = 0;
 
-    process_isr_task_queue();
+    {
+        const system::LoopStageTimer timer(system::LoopStage::ISR_TASKS);
+        process_isr_task_queue();
+    }
 
     if (!SYSTEM_POWEROFF) {
 
@@ -513,15 +583,25 @@ void Spark_Idle_Events(bool force_events/*=false*/)
 #endif
         manage_serial_flasher();
 
-        manage_network_connection();
+        {
+            const system::LoopStageTimer timer(system::LoopStage::NETWORK);
 
-        manage_smart_config();
+            manage_network_connection();
 
-        manage_ip_config();
+            manage_smart_config();
 
-        manage_cloud_connection(force_events);
+            manage_ip_config();
+        }
 
-        system::FirmwareUpdate::instance()->process();
+        {
+            const system::LoopStageTimer timer(system::LoopStage::CLOUD);
+            manage_cloud_connection(force_events);
+        }
+
+        {
+            const system::LoopStageTimer timer(system::LoopStage::FIRMWARE_UPDATE);
+            system::FirmwareUpdate::instance()->process();
+        }
 
         if (system_mode() != SAFE_MODE) {
             manage_listening_mode_flag();
@@ -533,12 +613,31 @@ void Spark_Idle_Events(bool force_events/*=false*/)
     }
 #if HAL_PLATFORM_BLE_SETUP
     // TODO: Process BLE channel events in a separate thread
-    system::SystemControl::instance()->run();
+    {
+        const system::LoopStageTimer timer(system::LoopStage::CONTROL);
+        system::SystemControl::instance()->run();
+    }
     if (system_mode() != SAFE_MODE) {
         manage_ble_prov_mode();
     }
 #endif
     system_shutdown_if_needed();
+
+    schedule_system_loop();
+    sched->endPass();
+}
+
+/**
+ * Returns the time in milliseconds until the background loop needs to be run from the delay pump.
+ */
+static system_tick_t background_loop_delay()
+{
+#if PLATFORM_THREADING
+    // The system loop runs in its own thread
+    return SPARK_LOOP_DELAY_MILLIS;
+#else
+    return system::LoopScheduler::instance()->nextTimeout(SPARK_LOOP_DELAY_MILLIS);
+#endif
 }
 
 /*
@@ -548,7 +647,7 @@ void system_delay_pump(unsigned long ms, bool force_no_background_loop=false)
 {
     if (ms==0) return;
 
-    system_tick_t spark_loop_elapsed_millis = SPARK_LOOP_DELAY_MILLIS;
+    system_tick_t spark_loop_elapsed_millis = background_loop_delay();
     spark_loop_total_millis += ms;
 
     system_tick_t start_millis = HAL_Timer_Get_Milli_Seconds();
@@ -571,18 +670,22 @@ void system_delay_pump(unsigned long ms, bool force_no_background_loop=false)
         {
             // on the last millisecond, resolve using micros - we don't know how far in that millisecond had come
             // have to be careful with wrap around since start_micros can be greater than end_micros.
-            for (;;)
-            {
-                system_tick_t delay = end_micros - HAL_Timer_Get_Micro_Seconds();
-                if (delay > 100000) {
-                    return;
-                }
-                HAL_Delay_Microseconds(min(delay/2, 1u));
+            system_tick_t delay = end_micros - HAL_Timer_Get_Micro_Seconds();
+            if (delay <= 100000) {
+                HAL_Delay_Microseconds(delay);
             }
+            return;
         }
         else
         {
-            HAL_Delay_Milliseconds(1);
+            // Sleep until the last millisecond or until the background loop needs to run, waking
+            // up at least once a second to kick the watchdog
+            system_tick_t wake_millis = std::min((system_tick_t)(ms - 1), elapsed_millis + SPARK_LOOP_DELAY_MILLIS);
+            if (!SPARK_WLAN_SLEEP && !force_no_background_loop && spark_loop_elapsed_millis < wake_millis)
+            {
+                wake_millis = spark_loop_elapsed_millis;
+            }
+            HAL_Delay_Milliseconds((wake_millis > elapsed_millis) ? wake_millis - elapsed_millis : 1);
         }
 
         if (SPARK_WLAN_SLEEP || force_no_background_loop)
@@ -592,7 +695,7 @@ void system_delay_pump(unsigned long ms, bool force_no_background_loop=false)
         else if ((elapsed_millis >= spark_loop_elapsed_millis) || (spark_loop_total_millis >= SPARK_LOOP_DELAY_MILLIS))
         {
             bool threading = system_thread_get_state(nullptr);
-            spark_loop_elapsed_millis = elapsed_millis + SPARK_LOOP_DELAY_MILLIS;
+            spark_loop_elapsed_millis = elapsed_millis + background_loop_delay();
             //spark_loop_total_millis is reset to 0 in Spark_Idle()
             do
             {
@@ -690,6 +793,8 @@ void cloud_disconnect(unsigned flags, cloud_disconnect_reason cloudReason, netwo
         LED_SIGNAL_STOP(CLOUD_CONNECTING);
 
         INFO("Cloud: disconnected");
+        // The cloud may not have received the last published vitals
+        system::VitalsDeltaEncoder::instance()->reset();
         diag->status(CloudDiagnostics::DISCONNECTED);
         system_notify_event(cloud_status, cloud_status_disconnected);
     }
@@ -1,5 +1,6 @@
 #include "system_threading.h"
 #include "system_task.h"
+#include "spark_wiring_diagnostics.h"
 #include <time.h>
 #include <string.h>
 
@@ -18,13 +19,54 @@ void system_thread_idle()
     Spark_Idle_Events(true);
 }
 
-} // namespace
-
-ActiveObjectThreadQueue SystemThread(ActiveObjectConfiguration(system_thread_idle,
-			100, /* take timeout */
+ActiveObjectConfiguration system_thread_config()
+{
+    ActiveObjectConfiguration config(system_thread_idle,
+			SYSTEM_LOOP_IDLE_TIMEOUT, /* take timeout */
 			0x7FFFFFFF, /* put timeout - wait forever */
 			50, /* queue size */
-			THREAD_STACK_SIZE /* stack size */));
+			THREAD_STACK_SIZE /* stack size */);
+    // Sleep until the next deadline registered by the system loop
+    config.take_wait_fn = system_loop_timeout;
+    // Process the queued calls in batches before running the system loop
+    config.drain_time = 10;
+    return config;
+}
+
+class SystemThreadQueueDiagnosticData: public AbstractUnsignedIntegerDiagnosticData {
+public:
+    typedef IntType(*func_t)(const ActiveObjectStats&);
+    SystemThreadQueueDiagnosticData(uint16_t id, const char* name, func_t f) :
+            AbstractUnsignedIntegerDiagnosticData(id, name),
+            f_(f) {
+    }
+
+    virtual int get(IntType& val) override {
+        val = f_(SystemThread.stats());
+        return 0; // OK
+    }
+
+private:
+    func_t f_;
+};
+
+SystemThreadQueueDiagnosticData g_systemThreadQueueDepthDiagData(DIAG_ID_SYSTEM_THREAD_QUEUE_DEPTH,
+    DIAG_NAME_SYSTEM_THREAD_QUEUE_DEPTH,
+    [](const ActiveObjectStats& stats) -> SystemThreadQueueDiagnosticData::IntType {
+        return stats.max_depth;
+    }
+);
+
+SystemThreadQueueDiagnosticData g_systemThreadQueueLatencyDiagData(DIAG_ID_SYSTEM_THREAD_QUEUE_LATENCY,
+    DIAG_NAME_SYSTEM_THREAD_QUEUE_LATENCY,
+    [](const ActiveObjectStats& stats) -> SystemThreadQueueDiagnosticData::IntType {
+        return stats.max_latency;
+    }
+);
+
+} // namespace
+
+ActiveObjectThreadQueue SystemThread(system_thread_config());
 
 os_mutex_recursive_t mutex_usb_serial()
 {
@@ -35,6 +35,7 @@
 #include "spark_macros.h"
 #include "system_network_internal.h"
 #include "system_threading.h"
+#include "system_loop_scheduler.h"
 #include "check.h"
 #include <cstdio>
 #if HAL_PLATFORM_DCT
@@ -115,6 +116,11 @@ void system_flag_changed(system_flag_t flag, uint8_t oldValue, uint8_t newValue)
         }
     }
 #endif // HAL_PLATFORM_POWER_MANAGEMENT_OPTIONAL
+    else if (flag == SYSTEM_FLAG_RESET_ENABLED)
+    {
+        // A pending reset is performed by the system loop
+        particle::system::LoopScheduler::instance()->wakeUp();
+    }
     else if (flag == SYSTEM_FLAG_OTA_UPDATE_ENABLED)
     {
         // publish the firmware enabled event
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "system_vitals_delta.h"
+
+#include "system_error.h"
+#include "check.h"
+
+#include <algorithm>
+#include <utility>
+#include <cstring>
+
+namespace particle {
+
+namespace system {
+
+namespace {
+
+const uint16_t ERROR_FLAG = 0x8000;
+
+const size_t HEADER_SIZE = 4;
+const size_t ID_SIZE = 2;
+const size_t VALUE_SIZE = 4;
+const size_t RECORD_SIZE = ID_SIZE + VALUE_SIZE;
+
+template<typename T>
+T readValue(const char* data) {
+    T val;
+    memcpy(&val, data, sizeof(val));
+    return val;
+}
+
+template<typename T>
+bool writeValue(appender_fn appender, void* data, T val) {
+    return appender(data, (const uint8_t*)&val, sizeof(val));
+}
+
+template<typename T>
+bool lessById(const T& v, uint16_t id) {
+    return v.id < id;
+}
+
+} // namespace
+
+VitalsDeltaEncoder::VitalsDeltaEncoder() :
+        keyframeInterval_(0),
+        sinceKeyframe_(0),
+        unacked_(0),
+        hasBaseline_(false) {
+}
+
+void VitalsDeltaEncoder::keyframeInterval(unsigned interval) {
+    if (interval != keyframeInterval_) {
+        keyframeInterval_ = interval;
+        reset();
+    }
+}
+
+int VitalsDeltaEncoder::threshold(uint16_t id, uint32_t threshold) {
+    const auto it = std::lower_bound(thresholds_.begin(), thresholds_.end(), id, lessById<Threshold>);
+    if (it != thresholds_.end() && it->id == id) {
+        it->value = threshold;
+        return 0;
+    }
+    Threshold t = {};
+    t.id = id;
+    t.value = threshold;
+    CHECK_TRUE(thresholds_.insert(it - thresholds_.begin(), t), SYSTEM_ERROR_NO_MEMORY);
+    return 0;
+}
+
+int VitalsDeltaEncoder::encode(const char* data, size_t size, appender_fn appender, void* appenderData) {
+    if (size < HEADER_SIZE || readValue<uint16_t>(data) != ID_SIZE || readValue<uint16_t>(data + ID_SIZE) != VALUE_SIZE ||
+            (size - HEADER_SIZE) % RECORD_SIZE != 0) {
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    Vector<Value> vals;
+    CHECK_TRUE(vals.reserve((size - HEADER_SIZE) / RECORD_SIZE), SYSTEM_ERROR_NO_MEMORY);
+    for (size_t offs = HEADER_SIZE; offs < size; offs += RECORD_SIZE) {
+        const auto id = readValue<uint16_t>(data + offs);
+        Value v = {};
+        v.id = id & ~ERROR_FLAG;
+        v.error = id & ERROR_FLAG;
+        v.value = readValue<uint32_t>(data + offs + ID_SIZE);
+        vals.append(v); // Can't fail
+    }
+    std::sort(vals.begin(), vals.end(), [](const Value& v1, const Value& v2) {
+        return v1.id < v2.id;
+    });
+    const bool keyframe = !hasBaseline_ || !isEnabled() || sinceKeyframe_ + 1 >= keyframeInterval_;
+    if (keyframe) {
+        CHECK_TRUE(appender(appenderData, (const uint8_t*)data, size), SYSTEM_ERROR_TOO_LARGE);
+        pending_ = std::move(vals);
+        sinceKeyframe_ = 0;
+    } else {
+        CHECK_TRUE(writeValue<uint16_t>(appender, appenderData, ID_SIZE | DELTA_FLAG), SYSTEM_ERROR_TOO_LARGE);
+        CHECK_TRUE(writeValue<uint16_t>(appender, appenderData, VALUE_SIZE), SYSTEM_ERROR_TOO_LARGE);
+        // Values that didn't change enough are not published and remain in the baseline as is
+        for (auto& v: vals) {
+            const auto it = std::lower_bound(baseline_.begin(), baseline_.end(), v.id, lessById<Value>);
+            const Value* base = (it != baseline_.end() && it->id == v.id) ? it : nullptr;
+            if (changed(v, base)) {
+                const uint16_t id = v.error ? (v.id | ERROR_FLAG) : v.id;
+                CHECK_TRUE(writeValue<uint16_t>(appender, appenderData, id), SYSTEM_ERROR_TOO_LARGE);
+                CHECK_TRUE(writeValue<uint32_t>(appender, appenderData, v.value), SYSTEM_ERROR_TOO_LARGE);
+            } else {
+                v = *base;
+            }
+        }
+        pending_ = std::move(vals);
+        ++sinceKeyframe_;
+    }
+    ++unacked_;
+    return 0;
+}
+
+void VitalsDeltaEncoder::acknowledge() {
+    if (!unacked_) {
+        return;
+    }
+    // The acknowledgements can't be matched with the snapshots so the baseline is only updated
+    // when all the sent snapshots have been acknowledged. The pending values are always based on
+    // the last snapshot, and are discarded if that snapshot could not be sent
+    if (--unacked_ == 0 && !pending_.isEmpty()) {
+        baseline_ = std::move(pending_);
+        pending_.clear();
+        hasBaseline_ = true;
+    }
+}
+
+void VitalsDeltaEncoder::cancel() {
+    if (!unacked_) {
+        return;
+    }
+    // The cloud never received the values of the last snapshot so they can't become the baseline
+    pending_.clear();
+    if (--unacked_ > 0) {
+        // The values of the snapshots that are still in flight are lost, so the baseline can't be
+        // updated when they're acknowledged. Send the full snapshot next time
+        hasBaseline_ = false;
+    }
+}
+
+void VitalsDeltaEncoder::reset() {
+    baseline_.clear();
+    pending_.clear();
+    sinceKeyframe_ = 0;
+    unacked_ = 0;
+    hasBaseline_ = false;
+}
+
+VitalsDeltaEncoder* VitalsDeltaEncoder::instance() {
+    static VitalsDeltaEncoder encoder;
+    return &encoder;
+}
+
+bool VitalsDeltaEncoder::changed(const Value& val, const Value* base) const {
+    if (!base || val.error != base->error) {
+        return true;
+    }
+    if (val.error) {
+        return val.value != base->value;
+    }
+    // The values are either signed or unsigned 32-bit integers
+    const uint32_t d = val.value - base->value;
+    const uint32_t diff = std::min(d, (uint32_t)-d);
+    return diff > thresholdFor(val.id);
+}
+
+uint32_t VitalsDeltaEncoder::thresholdFor(uint16_t id) const {
+    const auto it = std::lower_bound(thresholds_.begin(), thresholds_.end(), id, lessById<Threshold>);
+    if (it != thresholds_.end() && it->id == id) {
+        return it->value;
+    }
+    return 0;
+}
+
+} // namespace system
+
+} // namespace particle
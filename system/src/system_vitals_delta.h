@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "appender.h"
+
+#include "spark_wiring_vector.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace particle {
+
+namespace system {
+
+/**
+ * Delta encoder for the binary vitals data.
+ *
+ * The binary vitals data starts with a header that contains the size of a data source ID and the
+ * size of a value as two 16-bit integers. The header is followed by a list of records each
+ * consisting of a data source ID and its value. If the value of a data source could not be
+ * retrieved, the most significant bit of the ID is set and the value is an error code.
+ *
+ * The encoder tracks the values last acknowledged by the cloud (the baseline) and only includes
+ * the data sources whose values differ from the baseline by more than a per-source threshold.
+ * Such a delta snapshot is marked by setting the most significant bit of the ID size in the
+ * header. Every `keyframeInterval()` publications, or if there's no baseline, the full snapshot
+ * is sent as is.
+ *
+ * This class is not thread-safe and is expected to be used in the system thread.
+ */
+class VitalsDeltaEncoder {
+public:
+    /**
+     * Flag set in the first field of the header of a delta snapshot.
+     */
+    static const uint16_t DELTA_FLAG = 0x8000;
+
+    VitalsDeltaEncoder();
+
+    /**
+     * Set the number of publications between full snapshots.
+     *
+     * @param interval Number of publications. Setting the interval to 0 disables the delta
+     *        encoding.
+     */
+    void keyframeInterval(unsigned interval);
+
+    /**
+     * Get the number of publications between full snapshots.
+     *
+     * @return Number of publications.
+     */
+    unsigned keyframeInterval() const {
+        return keyframeInterval_;
+    }
+
+    /**
+     * Check if the delta encoding is enabled.
+     *
+     * @return `true` if the delta encoding is enabled, otherwise `false`.
+     */
+    bool isEnabled() const {
+        return keyframeInterval_ > 0;
+    }
+
+    /**
+     * Set the minimum change of a data source's value that needs to be published.
+     *
+     * @param id Data source ID.
+     * @param threshold Absolute difference from the baseline value. A change of the value is
+     *        published if the difference exceeds the threshold. By default, any change is published.
+     * @return 0 on success, otherwise an error code defined by `system_error_t`.
+     */
+    int threshold(uint16_t id, uint32_t threshold);
+
+    /**
+     * Encode a snapshot of the vitals.
+     *
+     * @param data Binary vitals data.
+     * @param size Data size.
+     * @param appender Appender function.
+     * @param appenderData Appender data.
+     * @return 0 on success, otherwise an error code defined by `system_error_t`.
+     */
+    int encode(const char* data, size_t size, appender_fn appender, void* appenderData);
+
+    /**
+     * Notify the encoder that a snapshot has been acknowledged by the cloud.
+     */
+    void acknowledge();
+
+    /**
+     * Notify the encoder that the last encoded snapshot could not be sent.
+     */
+    void cancel();
+
+    /**
+     * Discard the baseline.
+     *
+     * The next snapshot will be sent in full.
+     */
+    void reset();
+
+    static VitalsDeltaEncoder* instance();
+
+private:
+    struct Value {
+        uint16_t id; // Data source ID without the error flag
+        bool error; // Whether the value is an error code
+        uint32_t value; // Value or error code
+    };
+
+    struct Threshold {
+        uint16_t id; // Data source ID
+        uint32_t value; // Threshold
+    };
+
+    Vector<Value> baseline_; // Values acknowledged by the cloud, sorted by ID
+    Vector<Value> pending_; // Baseline to use once the sent snapshot is acknowledged
+    Vector<Threshold> thresholds_; // Per-source thresholds, sorted by ID
+    unsigned keyframeInterval_; // Number of publications between full snapshots
+    unsigned sinceKeyframe_; // Number of delta snapshots sent since the last full snapshot
+    unsigned unacked_; // Number of sent snapshots that have not been acknowledged yet
+    bool hasBaseline_; // Whether the baseline is valid
+
+    bool changed(const Value& val, const Value* base) const;
+    uint32_t thresholdFor(uint16_t id) const;
+};
+
+} // namespace system
+
+} // namespace particle
@@ -309,6 +309,7 @@ bool particle::UsbControlRequestChannel::processInitRequest(HAL_USB_SetupRequest
     req->reply_size = 0;
     req->channel = this;
     req->task.req = req;
+    req->task.pending = false;
     req->handler = nullptr;
     req->handlerData = nullptr;
     req->offset = 0;
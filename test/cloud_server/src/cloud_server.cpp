@@ -0,0 +1,874 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cloud_server.h"
+
+#include "coap_message_encoder.h"
+#include "coap_message_decoder.h"
+
+#include "system_error.h"
+#include "check.h"
+
+#include "mbedtls/sha256.h"
+
+#include <boost/crc.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+
+namespace particle {
+
+namespace test {
+
+using namespace protocol;
+
+namespace {
+
+// Flags of the device's Hello message (see protocol.cpp)
+const unsigned HELLO_FLAG_OTA_PROTOCOL_V3 = 0x80;
+
+// Custom CoAP options used by the OTA protocol v3 (see firmware_update.cpp)
+enum OtaCoapOption {
+    CHUNK_INDEX = 2049,
+    WINDOW_SIZE = 2053,
+    FILE_SIZE = 2057,
+    FILE_SHA256 = 2061,
+    CHUNK_SIZE = 2065,
+    CANCEL_UPDATE = 2073
+};
+
+// Legacy OTA protocol: UpdateBegin flags
+const unsigned UPDATE_FLAG_FAST_OTA = 0x01;
+
+const size_t MAX_MESSAGE_SIZE = 1500;
+
+// Number of acknowledgements cached for duplicate detection
+const size_t RECENT_ACK_COUNT = 32;
+
+// Time after which a request without a response is considered failed
+const unsigned REQUEST_TIMEOUT = 30000;
+
+// Minimum OTA chunk size supported by the OTA protocol v3
+const unsigned MIN_OTA_CHUNK_SIZE = 512;
+
+int errorForCoapCode(unsigned code) {
+    switch (coapCodeClass(code)) {
+    case 2:
+        return 0;
+    case 4:
+        return (code == CoapCode::NOT_FOUND) ? SYSTEM_ERROR_NOT_FOUND : SYSTEM_ERROR_COAP_4XX;
+    case 5:
+        return SYSTEM_ERROR_COAP_5XX;
+    default:
+        return SYSTEM_ERROR_PROTOCOL;
+    }
+}
+
+unsigned decodeUint16(const char* data) {
+    return ((unsigned)(uint8_t)data[0] << 8) | (uint8_t)data[1];
+}
+
+uint32_t decodeUint32(const char* data) {
+    return ((uint32_t)(uint8_t)data[0] << 24) | ((uint32_t)(uint8_t)data[1] << 16) |
+            ((uint32_t)(uint8_t)data[2] << 8) | (uint8_t)data[3];
+}
+
+void encodeUint16(char* data, unsigned val) {
+    data[0] = (val >> 8) & 0xff;
+    data[1] = val & 0xff;
+}
+
+void encodeUint32(char* data, uint32_t val) {
+    data[0] = (val >> 24) & 0xff;
+    data[1] = (val >> 16) & 0xff;
+    data[2] = (val >> 8) & 0xff;
+    data[3] = val & 0xff;
+}
+
+std::string toHex(const char* data, size_t size) {
+    static const char alpha[] = "0123456789abcdef";
+    std::string s;
+    s.reserve(size * 2);
+    for (size_t i = 0; i < size; ++i) {
+        s += alpha[((uint8_t)data[i] >> 4) & 0x0f];
+        s += alpha[(uint8_t)data[i] & 0x0f];
+    }
+    return s;
+}
+
+// Returns the URI path segments of a message
+std::vector<std::string> uriPath(const CoapMessageDecoder& d) {
+    std::vector<std::string> path;
+    auto it = d.options();
+    while (it.next()) {
+        if (it.option() == CoapOption::URI_PATH) {
+            path.push_back(std::string(it.data(), it.size()));
+        }
+    }
+    return path;
+}
+
+template<typename F>
+int encodeMessage(std::string* msg, F fn) {
+    char buf[MAX_MESSAGE_SIZE];
+    CoapMessageEncoder e(buf, sizeof(buf));
+    fn(e);
+    const int r = e.encode();
+    if (r < 0) {
+        return r;
+    }
+    if ((size_t)r > sizeof(buf)) {
+        return SYSTEM_ERROR_TOO_LARGE;
+    }
+    msg->assign(buf, r);
+    return 0;
+}
+
+} // namespace
+
+CloudServer::CloudServer() {
+}
+
+CloudServer::~CloudServer() {
+    destroy();
+}
+
+int CloudServer::init(const char* keyData, size_t keySize, const Config& conf) {
+    conf_ = conf;
+    CHECK(dtls_.init(keyData, keySize));
+    CHECK(dtls_.bind(conf_.port));
+    dtls_.onEstablished([this](DtlsServer::Session* session) {
+        if (session->userData()) {
+            return; // The device has resumed its session from a different address
+        }
+        std::unique_ptr<Device> dev(new(std::nothrow) Device(this, session));
+        if (!dev) {
+            dtls_.close(session);
+            return;
+        }
+        session->userData(dev.get());
+        devices_.push_back(std::move(dev));
+    });
+    dtls_.onData([this](DtlsServer::Session* session, const char* data, size_t size) {
+        const auto dev = (Device*)session->userData();
+        if (dev) {
+            dev->receive(data, size);
+        }
+    });
+    dtls_.onClosed([this](DtlsServer::Session* session) {
+        const auto dev = (Device*)session->userData();
+        if (!dev) {
+            return;
+        }
+        session->userData(nullptr);
+        dev->failPendingRequests(SYSTEM_ERROR_CANCELLED);
+        if (disconnectedCb_) {
+            disconnectedCb_(dev);
+        }
+        devices_.erase(std::remove_if(devices_.begin(), devices_.end(), [dev](const std::unique_ptr<Device>& d) {
+            return d.get() == dev;
+        }), devices_.end());
+    });
+    return 0;
+}
+
+void CloudServer::destroy() {
+    devices_.clear();
+    dtls_.destroy();
+}
+
+int CloudServer::poll(unsigned timeout) {
+    CHECK(dtls_.poll(timeout));
+    for (size_t i = 0; i < devices_.size(); ++i) {
+        const int r = devices_[i]->process();
+        if (r < 0) {
+            fprintf(stderr, "Device error: %d\n", r);
+            dtls_.close(devices_[i]->session());
+        }
+    }
+    return 0;
+}
+
+CloudServer::Device* CloudServer::device(const std::string& id) const {
+    Device* dev = nullptr;
+    for (const auto& d: devices_) {
+        if (!d->helloTime()) {
+            continue; // Not connected yet
+        }
+        if (!id.empty()) {
+            if (d->id() == id) {
+                return d.get();
+            }
+        } else if (!dev || d->helloTime() > dev->helloTime()) {
+            dev = d.get();
+        }
+    }
+    return dev;
+}
+
+CloudServer::Device::Device(CloudServer* server, DtlsServer::Session* session) :
+        server_(server),
+        session_(session),
+        helloTime_(0),
+        platformId_(0),
+        productId_(0),
+        productVersion_(0),
+        systemVersion_(0),
+        helloFlags_(0),
+        maxMsgSize_(0),
+        otaChunkSize_(0),
+        nextMsgId_(0),
+        nextToken_(0) {
+    serverRng(nullptr, (unsigned char*)&nextMsgId_, sizeof(nextMsgId_));
+    serverRng(nullptr, (unsigned char*)&nextToken_, sizeof(nextToken_));
+}
+
+CloudServer::Device::~Device() {
+}
+
+int CloudServer::Device::callFunction(const std::string& name, const std::string& arg, FunctionCallback cb) {
+    const uint8_t token = nextToken();
+    std::string msg;
+    // The device expects the argument option to be present even if the argument is empty
+    CHECK(encodeMessage(&msg, [&](CoapMessageEncoder& e) {
+        e.type(CoapType::CON);
+        e.code(CoapCode::POST);
+        e.id(0);
+        e.token((const char*)&token, sizeof(token));
+        e.option(CoapOption::URI_PATH, "f");
+        e.option(CoapOption::URI_PATH, name.data(), name.size());
+        e.option(CoapOption::URI_QUERY, arg.data(), arg.size());
+    }));
+    Request req;
+    req.funcCb = std::move(cb);
+    req.time = monotonicMillis();
+    req.type = RequestType::FUNCTION;
+    CHECK(send(std::move(msg), &req.id));
+    requests_[token] = std::move(req);
+    return 0;
+}
+
+int CloudServer::Device::getVariable(const std::string& name, VariableCallback cb) {
+    const uint8_t token = nextToken();
+    std::string msg;
+    CHECK(encodeMessage(&msg, [&](CoapMessageEncoder& e) {
+        e.type(CoapType::CON);
+        e.code(CoapCode::GET);
+        e.id(0);
+        e.token((const char*)&token, sizeof(token));
+        e.option(CoapOption::URI_PATH, "v");
+        e.option(CoapOption::URI_PATH, name.data(), name.size());
+    }));
+    Request req;
+    req.varCb = std::move(cb);
+    req.time = monotonicMillis();
+    req.type = RequestType::VARIABLE;
+    CHECK(send(std::move(msg), &req.id));
+    requests_[token] = std::move(req);
+    return 0;
+}
+
+int CloudServer::Device::startUpdate(std::string data, bool cancel, UpdateCallback cb) {
+    if (isUpdating()) {
+        return SYSTEM_ERROR_BUSY;
+    }
+    if (data.empty()) {
+        return SYSTEM_ERROR_INVALID_ARGUMENT;
+    }
+    update_ = Update();
+    update_.v3 = hasOtaProtocolV3();
+    update_.chunkSize = server_->conf_.otaChunkSize;
+    if (otaChunkSize_ > 0) {
+        update_.chunkSize = std::min(update_.chunkSize, otaChunkSize_);
+    }
+    if (update_.v3) {
+        update_.chunkSize = std::max(update_.chunkSize & ~3u, MIN_OTA_CHUNK_SIZE);
+    }
+    update_.chunkCount = (data.size() + update_.chunkSize - 1) / update_.chunkSize;
+    update_.token = nextToken();
+    update_.cancel = cancel;
+    update_.cb = std::move(cb);
+    std::string msg;
+    Request req = {};
+    req.time = monotonicMillis();
+    if (update_.v3) {
+        unsigned char hash[32] = {};
+        mbedtls_sha256_ret((const unsigned char*)data.data(), data.size(), hash, 0 /* is224 */);
+        CHECK(encodeMessage(&msg, [&](CoapMessageEncoder& e) {
+            e.type(CoapType::CON);
+            e.code(CoapCode::POST);
+            e.id(0);
+            e.token((const char*)&update_.token, sizeof(update_.token));
+            e.option(CoapOption::URI_PATH, "S");
+            e.option(OtaCoapOption::FILE_SIZE, (unsigned)data.size());
+            e.option(OtaCoapOption::FILE_SHA256, (const char*)hash, sizeof(hash));
+            e.option(OtaCoapOption::CHUNK_SIZE, update_.chunkSize);
+        }));
+        req.type = RequestType::UPDATE_START;
+        update_.state = UpdateState::START;
+    } else {
+        // UpdateBegin: flags (1), chunk size (2), file size (4), destination store (1), destination
+        // address (4)
+        char payload[12] = {};
+        payload[0] = UPDATE_FLAG_FAST_OTA;
+        encodeUint16(payload + 1, update_.chunkSize);
+        encodeUint32(payload + 3, data.size());
+        CHECK(encodeMessage(&msg, [&](CoapMessageEncoder& e) {
+            e.type(CoapType::CON);
+            e.code(CoapCode::POST);
+            e.id(0);
+            e.token((const char*)&update_.token, sizeof(update_.token));
+            e.option(CoapOption::URI_PATH, "u");
+            e.payload(payload, sizeof(payload));
+        }));
+        req.type = RequestType::UPDATE_BEGIN;
+        update_.state = UpdateState::BEGIN;
+    }
+    update_.data = std::move(data);
+    const int r = send(std::move(msg), &req.id);
+    if (r < 0) {
+        update_ = Update();
+        return r;
+    }
+    requests_[update_.token] = std::move(req);
+    return 0;
+}
+
+bool CloudServer::Device::hasOtaProtocolV3() const {
+    return helloFlags_ & HELLO_FLAG_OTA_PROTOCOL_V3;
+}
+
+int CloudServer::Device::receive(const char* data, size_t size) {
+    CoapMessageDecoder d;
+    if (d.decode(data, size) < 0) {
+        fprintf(stderr, "Unable to decode message\n");
+        return 0;
+    }
+    auto& stats = server_->stats_;
+    ++stats.rxMessages;
+    if (d.type() == CoapType::ACK || d.type() == CoapType::RST) {
+        return handleAck(d);
+    }
+    if (d.type() == CoapType::CON) {
+        for (const auto& ack: recentAcks_) {
+            if (ack.first == d.id()) {
+                ++stats.duplicates;
+                CHECK(server_->dtls_.send(session_, ack.second.data(), ack.second.size()));
+                ++stats.txMessages;
+                return 0;
+            }
+        }
+    }
+    if (d.code() == CoapCode::EMPTY) {
+        if (d.type() == CoapType::CON) {
+            CHECK(sendAck(d, (unsigned)CoapCode::EMPTY)); // Ping
+        }
+        return 0;
+    }
+    if (isCoapRequestCode(d.code())) {
+        return handleRequest(d);
+    }
+    return handleResponse(d);
+}
+
+int CloudServer::Device::process() {
+    const auto now = monotonicMillis();
+    const auto& conf = server_->conf_;
+    std::vector<CoapMessageId> expiredMsgs;
+    for (auto it = outMsgs_.begin(); it != outMsgs_.end();) {
+        if (now - it->sendTime < it->timeout) {
+            ++it;
+            continue;
+        }
+        if (it->retries >= conf.maxRetransmit) {
+            expiredMsgs.push_back(it->id);
+            it = outMsgs_.erase(it);
+            continue;
+        }
+        CHECK(server_->dtls_.send(session_, it->data.data(), it->data.size()));
+        ++server_->stats_.txMessages;
+        ++server_->stats_.retransmissions;
+        ++it->retries;
+        it->timeout *= 2;
+        it->sendTime = now;
+        ++it;
+    }
+    // Completion handlers may send new requests so the expired ones are collected first
+    std::vector<uint8_t> expiredReqs;
+    for (const auto& req: requests_) {
+        if (now - req.second.time >= REQUEST_TIMEOUT ||
+                std::find(expiredMsgs.begin(), expiredMsgs.end(), req.second.id) != expiredMsgs.end()) {
+            expiredReqs.push_back(req.first);
+        }
+    }
+    for (const auto token: expiredReqs) {
+        const auto it = requests_.find(token);
+        if (it != requests_.end()) {
+            completeRequest(it, 0 /* code */, CoapMessageDecoder(), SYSTEM_ERROR_TIMEOUT);
+        }
+    }
+    if (update_.state == UpdateState::TRANSFER) {
+        if (update_.v3 && now - update_.lastAckTime >= conf.ackTimeout) {
+            // Retransmit all chunks in the window that haven't been acknowledged yet
+            update_.resendQueue.clear();
+            for (unsigned i = update_.ackedChunks; i < update_.nextChunk; ++i) {
+                const unsigned bit = i - update_.ackedChunks;
+                const size_t word = bit / 32;
+                if (word >= update_.ackBitmap.size() || !(update_.ackBitmap[word] & (1u << (bit % 32)))) {
+                    update_.resendQueue.push_back(i);
+                }
+            }
+            update_.lastAckTime = now;
+        }
+        CHECK(sendUpdateChunks());
+    }
+    return 0;
+}
+
+int CloudServer::Device::handleRequest(const CoapMessageDecoder& d) {
+    auto& stats = server_->stats_;
+    const auto path = uriPath(d);
+    const std::string res = path.empty() ? std::string() : path.front();
+    if (res == "h" && d.code() == CoapCode::POST) {
+        return handleHello(d);
+    }
+    if (res == "A" && d.code() == CoapCode::POST) {
+        return handleChunkAck(d);
+    }
+    if (res == "c" && d.code() == CoapCode::GET) {
+        return handleMissedChunks(d);
+    }
+    if (res == "t" && d.code() == CoapCode::GET) {
+        char t[4] = {};
+        encodeUint32(t, (uint32_t)time(nullptr));
+        return sendAck(d, (unsigned)CoapCode::CONTENT, t, sizeof(t));
+    }
+    if (res == "e" && d.code() == CoapCode::POST) {
+        ++stats.events;
+        if (server_->eventCb_) {
+            std::string name;
+            for (size_t i = 1; i < path.size(); ++i) {
+                if (i > 1) {
+                    name += '/';
+                }
+                name += path[i];
+            }
+            server_->eventCb_(this, name, std::string(d.payload(), d.payloadSize()));
+        }
+    }
+    if (d.type() != CoapType::CON) {
+        return 0;
+    }
+    // Acknowledge blocks of a block-wise transfer (RFC 7959)
+    const auto block1 = d.findOption(CoapOption::BLOCK1);
+    if (block1) {
+        const unsigned val = block1.toUInt();
+        const bool more = val & 0x08;
+        return sendAck(d, more ? coapCode(2, 31) : (unsigned)CoapCode::CHANGED, nullptr, 0, val);
+    }
+    return sendAck(d, (unsigned)CoapCode::EMPTY);
+}
+
+int CloudServer::Device::handleResponse(const CoapMessageDecoder& d) {
+    if (d.type() == CoapType::CON) {
+        CHECK(sendAck(d, (unsigned)CoapCode::EMPTY));
+    }
+    if (d.tokenSize() != 1) {
+        return 0;
+    }
+    const auto it = requests_.find((uint8_t)d.token()[0]);
+    if (it == requests_.end()) {
+        return 0;
+    }
+    completeRequest(it, d.code(), d, 0 /* error */);
+    return 0;
+}
+
+int CloudServer::Device::handleAck(const CoapMessageDecoder& d) {
+    for (auto it = outMsgs_.begin(); it != outMsgs_.end(); ++it) {
+        if (it->id == d.id()) {
+            outMsgs_.erase(it);
+            break;
+        }
+    }
+    auto req = requests_.begin();
+    for (; req != requests_.end(); ++req) {
+        if (req->second.id == d.id()) {
+            break;
+        }
+    }
+    if (req == requests_.end()) {
+        return 0;
+    }
+    if (d.type() == CoapType::RST) {
+        completeRequest(req, 0 /* code */, d, SYSTEM_ERROR_PROTOCOL);
+    } else if (d.code() != CoapCode::EMPTY) {
+        // Piggybacked response
+        completeRequest(req, d.code(), d, 0 /* error */);
+    }
+    return 0;
+}
+
+int CloudServer::Device::handleHello(const CoapMessageDecoder& d) {
+    // Product ID (2), product version (2), flags (2), platform ID (2), reserved (1), device ID
+    // length (1), device ID, system version (2), max message size (2), max binary size (4), OTA
+    // chunk size (2)
+    const char* p = d.payload();
+    const size_t size = d.payloadSize();
+    if (size < 10 || size < 10 + (size_t)(uint8_t)p[9]) {
+        fprintf(stderr, "Invalid Hello message\n");
+        return SYSTEM_ERROR_PROTOCOL;
+    }
+    productId_ = decodeUint16(p);
+    productVersion_ = decodeUint16(p + 2);
+    helloFlags_ = decodeUint16(p + 4);
+    platformId_ = decodeUint16(p + 6);
+    const size_t idLen = (uint8_t)p[9];
+    id_ = toHex(p + 10, idLen);
+    size_t offs = 10 + idLen;
+    systemVersion_ = (offs + 2 <= size) ? decodeUint16(p + offs) : 0;
+    offs += 2;
+    maxMsgSize_ = (offs + 2 <= size) ? decodeUint16(p + offs) : 0;
+    offs += 6; // Skip the max binary size
+    otaChunkSize_ = (offs + 2 <= size) ? decodeUint16(p + offs) : 0;
+    helloTime_ = monotonicMillis();
+    // Requests sent during the previous connection won't be answered
+    failPendingRequests(SYSTEM_ERROR_CANCELLED);
+    if (d.type() == CoapType::CON) {
+        CHECK(sendAck(d, (unsigned)CoapCode::EMPTY));
+    }
+    if (server_->connectedCb_) {
+        server_->connectedCb_(this);
+    }
+    return 0;
+}
+
+int CloudServer::Device::handleChunkAck(const CoapMessageDecoder& d) {
+    if (!update_.v3 || update_.state != UpdateState::TRANSFER) {
+        return 0;
+    }
+    const auto it = d.findOption(OtaCoapOption::CHUNK_INDEX);
+    if (!it) {
+        return SYSTEM_ERROR_PROTOCOL;
+    }
+    const unsigned index = it.toUInt();
+    if (index < update_.ackedChunks || index > update_.chunkCount) {
+        return 0; // Stale ACK
+    }
+    update_.ackedChunks = index;
+    update_.ackBitmap.assign(d.payloadSize() / 4, 0);
+    // The bitmap is sent as an array of 32-bit words in the device's native byte order
+    memcpy(update_.ackBitmap.data(), d.payload(), update_.ackBitmap.size() * 4);
+    update_.lastAckTime = monotonicMillis();
+    if (update_.ackedChunks == update_.chunkCount) {
+        CHECK(sendUpdateFinish());
+    }
+    return 0;
+}
+
+int CloudServer::Device::handleMissedChunks(const CoapMessageDecoder& d) {
+    if (d.type() == CoapType::CON) {
+        CHECK(sendAck(d, (unsigned)CoapCode::EMPTY));
+    }
+    if (update_.v3 || (update_.state != UpdateState::DONE && update_.state != UpdateState::TRANSFER)) {
+        return 0;
+    }
+    for (size_t i = 0; i + 1 < d.payloadSize(); i += 2) {
+        const unsigned index = decodeUint16(d.payload() + i);
+        if (index < update_.chunkCount) {
+            update_.resendQueue.push_back(index);
+        }
+    }
+    update_.state = UpdateState::TRANSFER;
+    return 0;
+}
+
+void CloudServer::Device::completeRequest(std::map<uint8_t, Request>::iterator it, unsigned code,
+        const CoapMessageDecoder& d, int error) {
+    // A zero code indicates that the request has failed locally with `error`
+    if (code) {
+        error = errorForCoapCode(code);
+    }
+    const auto req = std::move(it->second);
+    requests_.erase(it);
+    for (auto msg = outMsgs_.begin(); msg != outMsgs_.end(); ++msg) {
+        if (msg->id == req.id) {
+            outMsgs_.erase(msg);
+            break;
+        }
+    }
+    auto& stats = server_->stats_;
+    switch (req.type) {
+    case RequestType::FUNCTION: {
+        ++stats.functionCalls;
+        if (req.funcCb) {
+            if (error < 0) {
+                req.funcCb(error, 0);
+            } else if (d.payloadSize() != 4) {
+                req.funcCb(SYSTEM_ERROR_BAD_DATA, 0);
+            } else {
+                req.funcCb(0, (int)decodeUint32(d.payload()));
+            }
+        }
+        break;
+    }
+    case RequestType::VARIABLE: {
+        ++stats.variableRequests;
+        if (req.varCb) {
+            req.varCb(error, (error < 0) ? std::string() : std::string(d.payload(), d.payloadSize()));
+        }
+        break;
+    }
+    case RequestType::UPDATE_BEGIN: {
+        // The device replies with UpdateReady once it's ready to receive chunks
+        if (error < 0) {
+            completeUpdate(error);
+        } else if (update_.state == UpdateState::BEGIN) {
+            update_.state = UpdateState::TRANSFER;
+            update_.lastAckTime = monotonicMillis();
+        }
+        break;
+    }
+    case RequestType::UPDATE_DONE: {
+        if (code == CoapCode::BAD_REQUEST) {
+            // Some of the chunks are missing. The device will request them separately
+            break;
+        }
+        completeUpdate(error);
+        break;
+    }
+    case RequestType::UPDATE_START: {
+        if (error < 0) {
+            completeUpdate(error);
+            break;
+        }
+        const auto windowSize = d.findOption(OtaCoapOption::WINDOW_SIZE);
+        const auto fileOffset = d.findOption(OtaCoapOption::FILE_SIZE);
+        if (!windowSize || !fileOffset || !windowSize.toUInt() || fileOffset.toUInt() > update_.data.size()) {
+            completeUpdate(SYSTEM_ERROR_PROTOCOL);
+            break;
+        }
+        // The device may have retained a part of the file from an interrupted transfer
+        update_.ackedChunks = fileOffset.toUInt() / update_.chunkSize;
+        update_.nextChunk = update_.ackedChunks;
+        update_.windowSize = windowSize.toUInt();
+        update_.lastAckTime = monotonicMillis();
+        update_.state = UpdateState::TRANSFER;
+        if (update_.ackedChunks == update_.chunkCount && sendUpdateFinish() < 0) {
+            completeUpdate(SYSTEM_ERROR_IO);
+        }
+        break;
+    }
+    case RequestType::UPDATE_FINISH: {
+        completeUpdate(error);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+int CloudServer::Device::sendUpdateChunks() {
+    unsigned n = server_->conf_.otaChunkBurst;
+    while (n > 0 && !update_.resendQueue.empty()) {
+        const unsigned index = update_.resendQueue.front();
+        update_.resendQueue.pop_front();
+        CHECK(sendChunk(index));
+        --n;
+    }
+    while (n > 0 && update_.nextChunk < update_.chunkCount &&
+            (!update_.v3 || update_.nextChunk < update_.ackedChunks + update_.windowSize)) {
+        CHECK(sendChunk(update_.nextChunk++));
+        --n;
+    }
+    if (!update_.v3 && update_.nextChunk == update_.chunkCount && update_.resendQueue.empty()) {
+        CHECK(sendUpdateDone());
+    }
+    return 0;
+}
+
+int CloudServer::Device::sendChunk(unsigned index) {
+    if (!update_.v3) {
+        return sendLegacyChunk(index);
+    }
+    const size_t offs = index * update_.chunkSize;
+    const size_t size = std::min<size_t>(update_.chunkSize, update_.data.size() - offs);
+    std::string msg;
+    CHECK(encodeMessage(&msg, [&](CoapMessageEncoder& e) {
+        e.type(CoapType::NON);
+        e.code(CoapCode::POST);
+        e.id(0);
+        e.option(CoapOption::URI_PATH, "C");
+        e.option(OtaCoapOption::CHUNK_INDEX, index + 1); // Chunk indices are 1-based
+        e.payload(update_.data.data() + offs, size);
+    }));
+    CHECK(send(std::move(msg)));
+    ++server_->stats_.otaChunks;
+    return 0;
+}
+
+int CloudServer::Device::sendLegacyChunk(unsigned index) {
+    const size_t offs = index * update_.chunkSize;
+    const size_t size = std::min<size_t>(update_.chunkSize, update_.data.size() - offs);
+    boost::crc_32_type crc;
+    crc.process_bytes(update_.data.data() + offs, size);
+    char crcOpt[4] = {};
+    encodeUint32(crcOpt, crc.checksum());
+    char indexOpt[2] = {};
+    encodeUint16(indexOpt, index);
+    // The device's chunk parser expects a one-byte token and exactly these two Uri-Query options
+    std::string msg;
+    CHECK(encodeMessage(&msg, [&](CoapMessageEncoder& e) {
+        e.type(CoapType::NON);
+        e.code(CoapCode::POST);
+        e.id(0);
+        e.token((const char*)&update_.token, sizeof(update_.token));
+        e.option(CoapOption::URI_PATH, "c");
+        e.option(CoapOption::URI_QUERY, crcOpt, sizeof(crcOpt));
+        e.option(CoapOption::URI_QUERY, indexOpt, sizeof(indexOpt));
+        e.payload(update_.data.data() + offs, size);
+    }));
+    CHECK(send(std::move(msg)));
+    ++server_->stats_.otaChunks;
+    return 0;
+}
+
+int CloudServer::Device::sendUpdateDone() {
+    const uint8_t token = nextToken();
+    std::string msg;
+    CHECK(encodeMessage(&msg, [&](CoapMessageEncoder& e) {
+        e.type(CoapType::CON);
+        e.code(CoapCode::PUT);
+        e.id(0);
+        e.token((const char*)&token, sizeof(token));
+        e.option(CoapOption::URI_PATH, "u");
+    }));
+    Request req = {};
+    req.time = monotonicMillis();
+    req.type = RequestType::UPDATE_DONE;
+    CHECK(send(std::move(msg), &req.id));
+    requests_[token] = std::move(req);
+    update_.state = UpdateState::DONE;
+    return 0;
+}
+
+int CloudServer::Device::sendUpdateFinish() {
+    const uint8_t token = nextToken();
+    std::string msg;
+    CHECK(encodeMessage(&msg, [&](CoapMessageEncoder& e) {
+        e.type(CoapType::CON);
+        e.code(CoapCode::POST);
+        e.id(0);
+        e.token((const char*)&token, sizeof(token));
+        e.option(CoapOption::URI_PATH, "F");
+        if (update_.cancel) {
+            e.option(OtaCoapOption::CANCEL_UPDATE);
+        }
+    }));
+    Request req = {};
+    req.time = monotonicMillis();
+    req.type = RequestType::UPDATE_FINISH;
+    CHECK(send(std::move(msg), &req.id));
+    requests_[token] = std::move(req);
+    update_.state = UpdateState::FINISH;
+    return 0;
+}
+
+void CloudServer::Device::completeUpdate(int error) {
+    if (update_.state == UpdateState::NONE) {
+        return;
+    }
+    const auto cb = std::move(update_.cb);
+    update_ = Update();
+    if (cb) {
+        cb(error);
+    }
+}
+
+int CloudServer::Device::send(std::string msg, CoapMessageId* msgId) {
+    const auto type = (CoapType)(((uint8_t)msg[0] >> 4) & 0x03);
+    if (type == CoapType::CON || type == CoapType::NON) {
+        const auto id = nextMsgId_++;
+        encodeUint16(&msg[2], id);
+        if (msgId) {
+            *msgId = id;
+        }
+    }
+    CHECK(server_->dtls_.send(session_, msg.data(), msg.size()));
+    ++server_->stats_.txMessages;
+    if (type == CoapType::CON) {
+        OutMessage m;
+        m.id = decodeUint16(&msg[2]);
+        m.data = std::move(msg);
+        m.sendTime = monotonicMillis();
+        m.timeout = server_->conf_.ackTimeout;
+        m.retries = 0;
+        outMsgs_.push_back(std::move(m));
+    }
+    return 0;
+}
+
+int CloudServer::Device::sendAck(const CoapMessageDecoder& d, unsigned code, const char* payload, size_t payloadSize,
+        int block1) {
+    std::string msg;
+    CHECK(encodeMessage(&msg, [&](CoapMessageEncoder& e) {
+        e.type(CoapType::ACK);
+        e.code(code);
+        e.id(d.id());
+        if (code != CoapCode::EMPTY) {
+            e.token(d.token(), d.tokenSize());
+        }
+        if (block1 >= 0) {
+            e.option(CoapOption::BLOCK1, (unsigned)block1);
+        }
+        if (payloadSize > 0) {
+            e.payload(payload, payloadSize);
+        }
+    }));
+    CHECK(server_->dtls_.send(session_, msg.data(), msg.size()));
+    ++server_->stats_.txMessages;
+    recentAcks_.push_back(std::make_pair(d.id(), std::move(msg)));
+    if (recentAcks_.size() > RECENT_ACK_COUNT) {
+        recentAcks_.pop_front();
+    }
+    return 0;
+}
+
+uint8_t CloudServer::Device::nextToken() {
+    // Skip tokens of requests that are still in flight
+    for (unsigned i = 0; i < 256; ++i) {
+        const uint8_t t = nextToken_++;
+        if (!requests_.count(t) && t != update_.token) {
+            return t;
+        }
+    }
+    return nextToken_++;
+}
+
+void CloudServer::Device::failPendingRequests(int error) {
+    outMsgs_.clear();
+    while (!requests_.empty()) {
+        completeRequest(requests_.begin(), 0 /* code */, CoapMessageDecoder(), error);
+    }
+    completeUpdate(error);
+}
+
+} // namespace test
+
+} // namespace particle
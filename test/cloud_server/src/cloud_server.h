@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "dtls_server.h"
+#include "server_stats.h"
+
+#include "coap_defs.h"
+#include "coap_message_decoder.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <map>
+#include <cstdint>
+
+namespace particle {
+
+namespace test {
+
+/**
+ * Default UDP port of the server.
+ */
+const uint16_t DEFAULT_SERVER_PORT = 5684;
+
+/**
+ * A stand-in for the Device Cloud that implements the subset of the CoAP-based device protocol
+ * needed to exercise and benchmark a device over a local network.
+ *
+ * Only UDP devices are supported.
+ */
+class CloudServer {
+public:
+    class Device;
+
+    typedef std::function<void(Device* device)> DeviceCallback;
+    typedef std::function<void(Device* device, const std::string& name, const std::string& data)> EventCallback;
+
+    struct Config {
+        uint16_t port = DEFAULT_SERVER_PORT;
+        unsigned ackTimeout = 2000; // Initial retransmission timeout (ms)
+        unsigned maxRetransmit = 4; // Maximum number of retransmissions
+        unsigned otaChunkSize = 512; // Maximum OTA chunk size
+        unsigned otaChunkBurst = 16; // Maximum number of OTA chunks sent per poll
+    };
+
+    CloudServer();
+    ~CloudServer();
+
+    // Loads the server's EC private key in DER format and starts listening for devices
+    int init(const char* keyData, size_t keySize, const Config& conf);
+    void destroy();
+
+    // Waits up to `timeout` milliseconds for incoming data and processes pending timeouts
+    int poll(unsigned timeout);
+
+    // Returns a connected device with the given ID, or the most recently connected device if the
+    // ID is empty
+    Device* device(const std::string& id = std::string()) const;
+
+    // Invoked when a device sends a Hello message
+    void onConnected(DeviceCallback cb);
+    void onDisconnected(DeviceCallback cb);
+    void onEvent(EventCallback cb);
+
+    const TrafficStats& trafficStats() const;
+    const CoapStats& coapStats() const;
+    void resetStats();
+
+    const Config& config() const;
+
+private:
+    std::vector<std::unique_ptr<Device>> devices_;
+    DtlsServer dtls_;
+    Config conf_;
+    CoapStats stats_;
+    DeviceCallback connectedCb_;
+    DeviceCallback disconnectedCb_;
+    EventCallback eventCb_;
+
+    friend class Device;
+};
+
+/**
+ * A connected device.
+ */
+class CloudServer::Device {
+public:
+    // Function call result handler. `error` is 0 or a negative result code
+    typedef std::function<void(int error, int result)> FunctionCallback;
+    // Variable request result handler
+    typedef std::function<void(int error, const std::string& value)> VariableCallback;
+    // Firmware update completion handler
+    typedef std::function<void(int error)> UpdateCallback;
+
+    Device(CloudServer* server, DtlsServer::Session* session);
+    ~Device();
+
+    int callFunction(const std::string& name, const std::string& arg, FunctionCallback cb);
+    int getVariable(const std::string& name, VariableCallback cb);
+
+    // Streams `data` to the device as a firmware update. Unless `cancel` is false, the update is
+    // cancelled once all of the data has been transferred so the device doesn't try to apply it
+    int startUpdate(std::string data, bool cancel, UpdateCallback cb);
+    bool isUpdating() const;
+
+    // Number of requests that are waiting for a response from the device
+    size_t pendingRequests() const;
+
+    const std::string& id() const; // Hex-encoded
+    unsigned platformId() const;
+    unsigned productId() const;
+    unsigned productVersion() const;
+    unsigned systemVersion() const;
+    unsigned helloFlags() const;
+    unsigned maxMessageSize() const;
+    unsigned otaChunkSize() const;
+    bool hasOtaProtocolV3() const;
+
+    // Time when the device's Hello message was received (monotonic clock, ms)
+    uint64_t helloTime() const;
+
+    DtlsServer::Session* session() const;
+
+private:
+    // An outgoing confirmable message awaiting an ACK
+    struct OutMessage {
+        std::string data;
+        uint64_t sendTime;
+        unsigned timeout;
+        unsigned retries;
+        protocol::CoapMessageId id;
+    };
+
+    enum class RequestType {
+        FUNCTION,
+        VARIABLE,
+        UPDATE_BEGIN,
+        UPDATE_DONE,
+        UPDATE_START,
+        UPDATE_FINISH
+    };
+
+    // A request awaiting a response
+    struct Request {
+        FunctionCallback funcCb;
+        VariableCallback varCb;
+        uint64_t time;
+        RequestType type;
+        protocol::CoapMessageId id;
+    };
+
+    enum class UpdateState {
+        NONE,
+        BEGIN, // Legacy protocol: waiting for UpdateReady
+        TRANSFER,
+        DONE, // Legacy protocol: waiting for the result of UpdateDone
+        START, // Protocol v3: waiting for the response to Start
+        FINISH // Protocol v3: waiting for the response to Finish
+    };
+
+    struct Update {
+        std::string data;
+        std::vector<uint32_t> ackBitmap; // Protocol v3: acknowledged chunks to the right of the cumulative ACK
+        std::deque<unsigned> resendQueue; // Chunks to retransmit
+        UpdateCallback cb;
+        uint64_t lastAckTime = 0;
+        unsigned chunkSize = 0;
+        unsigned chunkCount = 0;
+        unsigned nextChunk = 0; // 0-based index of the next chunk to send
+        unsigned ackedChunks = 0; // Protocol v3: cumulative ACK
+        unsigned windowSize = 0; // Protocol v3: receiver window size in chunks
+        UpdateState state = UpdateState::NONE;
+        uint8_t token = 0;
+        bool cancel = true;
+        bool v3 = false;
+    };
+
+    std::map<uint8_t, Request> requests_;
+    std::list<OutMessage> outMsgs_;
+    std::deque<std::pair<protocol::CoapMessageId, std::string>> recentAcks_;
+    Update update_;
+    std::string id_;
+    CloudServer* server_;
+    DtlsServer::Session* session_;
+    uint64_t helloTime_;
+    unsigned platformId_;
+    unsigned productId_;
+    unsigned productVersion_;
+    unsigned systemVersion_;
+    unsigned helloFlags_;
+    unsigned maxMsgSize_;
+    unsigned otaChunkSize_;
+    protocol::CoapMessageId nextMsgId_;
+    uint8_t nextToken_;
+
+    int receive(const char* data, size_t size);
+    int process();
+
+    int handleRequest(const protocol::CoapMessageDecoder& d);
+    int handleResponse(const protocol::CoapMessageDecoder& d);
+    int handleAck(const protocol::CoapMessageDecoder& d);
+    int handleHello(const protocol::CoapMessageDecoder& d);
+    int handleChunkAck(const protocol::CoapMessageDecoder& d);
+    int handleMissedChunks(const protocol::CoapMessageDecoder& d);
+    void completeRequest(std::map<uint8_t, Request>::iterator it, unsigned code, const protocol::CoapMessageDecoder& d,
+            int error);
+
+    int sendUpdateChunks();
+    int sendLegacyChunk(unsigned index);
+    int sendChunk(unsigned index);
+    int sendUpdateDone();
+    int sendUpdateFinish();
+    void completeUpdate(int error);
+
+    // Encodes and sends a message. `msgId` is assigned automatically for CON and NON messages
+    int send(std::string msg, protocol::CoapMessageId* msgId = nullptr);
+    int sendAck(const protocol::CoapMessageDecoder& d, unsigned code, const char* payload = nullptr,
+            size_t payloadSize = 0, int block1 = -1);
+    uint8_t nextToken();
+    void failPendingRequests(int error);
+
+    friend class CloudServer;
+};
+
+inline void CloudServer::onConnected(DeviceCallback cb) {
+    connectedCb_ = std::move(cb);
+}
+
+inline void CloudServer::onDisconnected(DeviceCallback cb) {
+    disconnectedCb_ = std::move(cb);
+}
+
+inline void CloudServer::onEvent(EventCallback cb) {
+    eventCb_ = std::move(cb);
+}
+
+inline const TrafficStats& CloudServer::trafficStats() const {
+    return dtls_.stats();
+}
+
+inline const CoapStats& CloudServer::coapStats() const {
+    return stats_;
+}
+
+inline void CloudServer::resetStats() {
+    dtls_.resetStats();
+    stats_ = CoapStats();
+}
+
+inline const CloudServer::Config& CloudServer::config() const {
+    return conf_;
+}
+
+inline bool CloudServer::Device::isUpdating() const {
+    return update_.state != UpdateState::NONE;
+}
+
+inline size_t CloudServer::Device::pendingRequests() const {
+    return requests_.size();
+}
+
+inline const std::string& CloudServer::Device::id() const {
+    return id_;
+}
+
+inline unsigned CloudServer::Device::platformId() const {
+    return platformId_;
+}
+
+inline unsigned CloudServer::Device::productId() const {
+    return productId_;
+}
+
+inline unsigned CloudServer::Device::productVersion() const {
+    return productVersion_;
+}
+
+inline unsigned CloudServer::Device::systemVersion() const {
+    return systemVersion_;
+}
+
+inline unsigned CloudServer::Device::helloFlags() const {
+    return helloFlags_;
+}
+
+inline unsigned CloudServer::Device::maxMessageSize() const {
+    return maxMsgSize_;
+}
+
+inline unsigned CloudServer::Device::otaChunkSize() const {
+    return otaChunkSize_;
+}
+
+inline uint64_t CloudServer::Device::helloTime() const {
+    return helloTime_;
+}
+
+inline DtlsServer::Session* CloudServer::Device::session() const {
+    return session_;
+}
+
+} // namespace test
+
+} // namespace particle
@@ -0,0 +1,467 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dtls_server.h"
+
+#include "system_error.h"
+#include "check.h"
+
+#include <sys/random.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+
+namespace particle {
+
+namespace test {
+
+namespace {
+
+// Custom content type used by the device for the first records sent after it has moved its
+// session to a new address (see DTLSMessageChannel::send())
+const unsigned ALT_CID_CONTENT_TYPE = 253;
+
+// Offset of the connection ID in a DTLS record header: content type (1), version (2), epoch (2),
+// sequence number (6)
+const size_t RECORD_CID_OFFSET = 11;
+
+// Offset of the epoch in a DTLS record header
+const size_t RECORD_EPOCH_OFFSET = 3;
+
+const size_t MAX_DATAGRAM_SIZE = 2048;
+
+// Maximum time to wait for I/O while a handshake is in progress
+const unsigned HANDSHAKE_POLL_INTERVAL = 20;
+
+bool isSameAddress(const sockaddr_storage& a1, socklen_t len1, const sockaddr_storage& a2, socklen_t len2) {
+    return len1 == len2 && len1 > 0 && memcmp(&a1, &a2, len1) == 0;
+}
+
+void logMbedtlsError(const char* msg, int ret) {
+    fprintf(stderr, "%s: -0x%04x\n", msg, (unsigned)-ret);
+}
+
+} // namespace
+
+uint64_t monotonicMillis() {
+    const auto t = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(t).count();
+}
+
+int serverRng(void* ctx, unsigned char* data, size_t size) {
+    while (size > 0) {
+        const ssize_t n = getrandom(data, size, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+        }
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+DtlsServer::Session::Session(DtlsServer* server) :
+        addr_(),
+        addrLen_(0),
+        server_(server),
+        userData_(nullptr),
+        hsStartTime_(0),
+        hsFinishTime_(0),
+        cid_(),
+        state_(HANDSHAKE),
+        resumed_(false) {
+    mbedtls_ssl_init(&ssl_);
+    memset(&timer_, 0, sizeof(timer_));
+}
+
+DtlsServer::Session::~Session() {
+    mbedtls_ssl_free(&ssl_);
+}
+
+std::string DtlsServer::Session::peerAddress() const {
+    char host[INET6_ADDRSTRLEN] = {};
+    unsigned port = 0;
+    if (addr_.ss_family == AF_INET) {
+        const auto a = (const sockaddr_in*)&addr_;
+        inet_ntop(AF_INET, &a->sin_addr, host, sizeof(host));
+        port = ntohs(a->sin_port);
+    } else if (addr_.ss_family == AF_INET6) {
+        const auto a = (const sockaddr_in6*)&addr_;
+        inet_ntop(AF_INET6, &a->sin6_addr, host, sizeof(host));
+        port = ntohs(a->sin6_port);
+    }
+    return std::string(host) + ':' + std::to_string(port);
+}
+
+DtlsServer::DtlsServer() :
+        lastCid_(0),
+        port_(0),
+        sock_(-1) {
+    mbedtls_ssl_config_init(&conf_);
+    mbedtls_ssl_cookie_init(&cookie_);
+    mbedtls_x509_crt_init(&cert_);
+    mbedtls_pk_init(&key_);
+}
+
+DtlsServer::~DtlsServer() {
+    destroy();
+    mbedtls_pk_free(&key_);
+    mbedtls_x509_crt_free(&cert_);
+    mbedtls_ssl_cookie_free(&cookie_);
+    mbedtls_ssl_config_free(&conf_);
+}
+
+int DtlsServer::init(const char* keyData, size_t keySize) {
+    int r = mbedtls_ssl_config_defaults(&conf_, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_DATAGRAM,
+            MBEDTLS_SSL_PRESET_DEFAULT);
+    if (r != 0) {
+        logMbedtlsError("mbedtls_ssl_config_defaults() failed", r);
+        return SYSTEM_ERROR_INTERNAL;
+    }
+    mbedtls_ssl_conf_rng(&conf_, serverRng, nullptr);
+    mbedtls_ssl_conf_min_version(&conf_, MBEDTLS_SSL_MAJOR_VERSION_3, MBEDTLS_SSL_MINOR_VERSION_3);
+    mbedtls_ssl_conf_handshake_timeout(&conf_, 1000, 16000);
+    r = mbedtls_pk_parse_key(&key_, (const unsigned char*)keyData, keySize, nullptr, 0);
+    if (r != 0) {
+        logMbedtlsError("Unable to parse server private key", r);
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    r = mbedtls_ssl_conf_own_cert(&conf_, &cert_, &key_);
+    if (r != 0) {
+        logMbedtlsError("mbedtls_ssl_conf_own_cert() failed", r);
+        return SYSTEM_ERROR_INTERNAL;
+    }
+    // The device key is not known in advance: accept any raw public key and let the upper layer
+    // decide what to do with it
+    mbedtls_ssl_conf_authmode(&conf_, MBEDTLS_SSL_VERIFY_OPTIONAL);
+    static int certTypes[] = { MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY, MBEDTLS_TLS_CERT_TYPE_NONE };
+    mbedtls_ssl_conf_client_certificate_types(&conf_, certTypes);
+    mbedtls_ssl_conf_server_certificate_types(&conf_, certTypes);
+    r = mbedtls_ssl_conf_cid(&conf_, SERVER_CID_SIZE, MBEDTLS_SSL_UNEXPECTED_CID_IGNORE);
+    if (r != 0) {
+        logMbedtlsError("mbedtls_ssl_conf_cid() failed", r);
+        return SYSTEM_ERROR_INTERNAL;
+    }
+    r = mbedtls_ssl_cookie_setup(&cookie_, serverRng, nullptr);
+    if (r != 0) {
+        logMbedtlsError("mbedtls_ssl_cookie_setup() failed", r);
+        return SYSTEM_ERROR_INTERNAL;
+    }
+    mbedtls_ssl_conf_dtls_cookies(&conf_, mbedtls_ssl_cookie_write, mbedtls_ssl_cookie_check, &cookie_);
+    return 0;
+}
+
+int DtlsServer::bind(uint16_t port) {
+    const int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        return SYSTEM_ERROR_IO;
+    }
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (::bind(sock, (const sockaddr*)&addr, sizeof(addr)) < 0 ||
+            fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK) < 0) {
+        fprintf(stderr, "Unable to bind to port %u: %s\n", (unsigned)port, strerror(errno));
+        ::close(sock);
+        return SYSTEM_ERROR_IO;
+    }
+    socklen_t addrLen = sizeof(addr);
+    getsockname(sock, (sockaddr*)&addr, &addrLen);
+    port_ = ntohs(addr.sin_port);
+    sock_ = sock;
+    return 0;
+}
+
+void DtlsServer::destroy() {
+    sessions_.clear();
+    if (sock_ >= 0) {
+        ::close(sock_);
+        sock_ = -1;
+    }
+}
+
+int DtlsServer::poll(unsigned timeout) {
+    if (sock_ < 0) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
+    for (const auto& s: sessions_) {
+        if (s->state_ == Session::HANDSHAKE) {
+            timeout = std::min(timeout, HANDSHAKE_POLL_INTERVAL);
+            break;
+        }
+    }
+    pollfd pfd = {};
+    pfd.fd = sock_;
+    pfd.events = POLLIN;
+    int r = ::poll(&pfd, 1, timeout);
+    if (r < 0 && errno != EINTR) {
+        return SYSTEM_ERROR_IO;
+    }
+    if (r > 0) {
+        for (;;) {
+            char buf[MAX_DATAGRAM_SIZE];
+            sockaddr_storage addr = {};
+            socklen_t addrLen = sizeof(addr);
+            const ssize_t n = recvfrom(sock_, buf, sizeof(buf), 0, (sockaddr*)&addr, &addrLen);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                    break;
+                }
+                return SYSTEM_ERROR_IO;
+            }
+            stats_.rxBytes += n;
+            ++stats_.rxDatagrams;
+            CHECK(processDatagram(buf, n, addr, addrLen));
+        }
+    }
+    // Retransmit handshake flights if necessary
+    for (size_t i = 0; i < sessions_.size(); ++i) {
+        const auto s = sessions_[i].get();
+        if (s->state_ == Session::HANDSHAKE && mbedtls_timing_get_delay(&s->timer_) == 2) {
+            CHECK(processSession(s));
+        }
+    }
+    removeClosedSessions();
+    return 0;
+}
+
+int DtlsServer::send(Session* session, const char* data, size_t size) {
+    if (session->state_ != Session::ESTABLISHED) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
+    const int r = mbedtls_ssl_write(&session->ssl_, (const unsigned char*)data, size);
+    if (r < 0) {
+        logMbedtlsError("mbedtls_ssl_write() failed", r);
+        return SYSTEM_ERROR_IO;
+    }
+    return r;
+}
+
+void DtlsServer::close(Session* session) {
+    if (session->state_ == Session::CLOSED) {
+        return;
+    }
+    if (session->state_ == Session::ESTABLISHED) {
+        mbedtls_ssl_close_notify(&session->ssl_);
+    }
+    session->state_ = Session::CLOSED;
+    if (closedCb_) {
+        closedCb_(session);
+    }
+}
+
+int DtlsServer::processDatagram(const char* data, size_t size, const sockaddr_storage& addr, socklen_t addrLen) {
+    // The device sends 0 and 1 byte datagrams to keep the NAT binding alive
+    if (size <= 1) {
+        return 0;
+    }
+    const unsigned type = (uint8_t)data[0];
+    Session* session = nullptr;
+    bool addrChanged = false;
+    if ((type == MBEDTLS_SSL_MSG_CID || type == ALT_CID_CONTENT_TYPE) && size >= RECORD_CID_OFFSET + SERVER_CID_SIZE) {
+        session = findSessionByCid(data + RECORD_CID_OFFSET);
+        if (session && !isSameAddress(session->addr_, session->addrLen_, addr, addrLen)) {
+            // The device has moved its session to a new address
+            memcpy(&session->addr_, &addr, addrLen);
+            session->addrLen_ = addrLen;
+            session->resumed_ = true;
+            addrChanged = true;
+        }
+    }
+    if (!session) {
+        session = findSession(addr, addrLen);
+        if (session && session->state_ != Session::HANDSHAKE && type == MBEDTLS_SSL_MSG_HANDSHAKE &&
+                data[RECORD_EPOCH_OFFSET] == 0 && data[RECORD_EPOCH_OFFSET + 1] == 0) {
+            // The device is starting a new handshake from the same address. Keep the old session
+            // around in case the device decides to resume it later
+            session->addrLen_ = 0;
+            session = nullptr;
+        }
+    }
+    if (!session) {
+        if (type != MBEDTLS_SSL_MSG_HANDSHAKE) {
+            return 0; // Ignore stray records
+        }
+        CHECK(createSession(addr, addrLen, &session));
+    }
+    std::vector<char> d(data, data + size);
+    if (type == ALT_CID_CONTENT_TYPE) {
+        d[0] = MBEDTLS_SSL_MSG_CID;
+    }
+    session->inQueue_.push_back(std::move(d));
+    if (addrChanged && session->state_ == Session::ESTABLISHED && establishedCb_) {
+        establishedCb_(session);
+    }
+    return processSession(session);
+}
+
+int DtlsServer::processSession(Session* s) {
+    if (s->state_ == Session::HANDSHAKE) {
+        int r = mbedtls_ssl_handshake(&s->ssl_);
+        if (r == MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED) {
+            // The client will send another ClientHello with the cookie
+            mbedtls_ssl_session_reset(&s->ssl_);
+            mbedtls_ssl_set_client_transport_id(&s->ssl_, (const unsigned char*)&s->addr_, s->addrLen_);
+            mbedtls_ssl_set_cid(&s->ssl_, MBEDTLS_SSL_CID_ENABLED, (const unsigned char*)s->cid_, SERVER_CID_SIZE);
+            s->hsStartTime_ = monotonicMillis();
+            return 0;
+        }
+        if (r == MBEDTLS_ERR_SSL_WANT_READ || r == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            return 0;
+        }
+        if (r != 0) {
+            logMbedtlsError("Handshake failed", r);
+            close(s);
+            return 0;
+        }
+        s->hsFinishTime_ = monotonicMillis();
+        s->state_ = Session::ESTABLISHED;
+        const auto cert = mbedtls_ssl_get_peer_cert(&s->ssl_);
+        if (cert) {
+            unsigned char buf[256];
+            const int n = mbedtls_pk_write_pubkey_der((mbedtls_pk_context*)&cert->pk, buf, sizeof(buf));
+            if (n > 0) {
+                s->devPubKey_.assign((const char*)buf + sizeof(buf) - n, n);
+            }
+        }
+        if (establishedCb_) {
+            establishedCb_(s);
+        }
+    }
+    while (s->state_ == Session::ESTABLISHED) {
+        unsigned char buf[MBEDTLS_SSL_IN_CONTENT_LEN];
+        const int r = mbedtls_ssl_read(&s->ssl_, buf, sizeof(buf));
+        if (r > 0) {
+            if (dataCb_) {
+                dataCb_(s, (const char*)buf, r);
+            }
+            continue;
+        }
+        if (r == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+            close(s);
+            break;
+        }
+        if (r != MBEDTLS_ERR_SSL_WANT_READ && r != MBEDTLS_ERR_SSL_WANT_WRITE && r != 0) {
+            // Records that fail authentication or arrive out of the replay window are dropped
+            logMbedtlsError("mbedtls_ssl_read() failed", r);
+        }
+        if (s->inQueue_.empty()) {
+            break;
+        }
+    }
+    return 0;
+}
+
+int DtlsServer::createSession(const sockaddr_storage& addr, socklen_t addrLen, Session** session) {
+    std::unique_ptr<Session> s(new(std::nothrow) Session(this));
+    CHECK_TRUE(s, SYSTEM_ERROR_NO_MEMORY);
+    memcpy(&s->addr_, &addr, addrLen);
+    s->addrLen_ = addrLen;
+    ++lastCid_;
+    for (size_t i = 0; i < SERVER_CID_SIZE; ++i) {
+        s->cid_[i] = (char)(lastCid_ >> ((SERVER_CID_SIZE - i - 1) * 8));
+    }
+    int r = mbedtls_ssl_setup(&s->ssl_, &conf_);
+    if (r != 0) {
+        logMbedtlsError("mbedtls_ssl_setup() failed", r);
+        return SYSTEM_ERROR_INTERNAL;
+    }
+    mbedtls_ssl_set_timer_cb(&s->ssl_, &s->timer_, mbedtls_timing_set_delay, mbedtls_timing_get_delay);
+    mbedtls_ssl_set_bio(&s->ssl_, s.get(), sendCallback, recvCallback, nullptr);
+    r = mbedtls_ssl_set_client_transport_id(&s->ssl_, (const unsigned char*)&s->addr_, s->addrLen_);
+    if (r == 0) {
+        r = mbedtls_ssl_set_cid(&s->ssl_, MBEDTLS_SSL_CID_ENABLED, (const unsigned char*)s->cid_, SERVER_CID_SIZE);
+    }
+    if (r != 0) {
+        logMbedtlsError("Unable to configure session", r);
+        return SYSTEM_ERROR_INTERNAL;
+    }
+    s->hsStartTime_ = monotonicMillis();
+    *session = s.get();
+    sessions_.push_back(std::move(s));
+    return 0;
+}
+
+void DtlsServer::removeClosedSessions() {
+    sessions_.erase(std::remove_if(sessions_.begin(), sessions_.end(), [](const std::unique_ptr<Session>& s) {
+        return s->state_ == Session::CLOSED;
+    }), sessions_.end());
+}
+
+DtlsServer::Session* DtlsServer::findSession(const sockaddr_storage& addr, socklen_t addrLen) const {
+    for (const auto& s: sessions_) {
+        if (s->state_ != Session::CLOSED && isSameAddress(s->addr_, s->addrLen_, addr, addrLen)) {
+            return s.get();
+        }
+    }
+    return nullptr;
+}
+
+DtlsServer::Session* DtlsServer::findSessionByCid(const char* cid) const {
+    for (const auto& s: sessions_) {
+        if (s->state_ == Session::ESTABLISHED && memcmp(s->cid_, cid, SERVER_CID_SIZE) == 0) {
+            return s.get();
+        }
+    }
+    return nullptr;
+}
+
+int DtlsServer::sendCallback(void* ctx, const unsigned char* data, size_t size) {
+    const auto s = (Session*)ctx;
+    const auto self = s->server_;
+    if (!s->addrLen_) {
+        return MBEDTLS_ERR_SSL_WANT_WRITE;
+    }
+    const ssize_t n = sendto(self->sock_, data, size, 0, (const sockaddr*)&s->addr_, s->addrLen_);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return MBEDTLS_ERR_SSL_WANT_WRITE;
+        }
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+    self->stats_.txBytes += n;
+    ++self->stats_.txDatagrams;
+    return n;
+}
+
+int DtlsServer::recvCallback(void* ctx, unsigned char* data, size_t size) {
+    const auto s = (Session*)ctx;
+    if (s->inQueue_.empty()) {
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    }
+    const auto d = std::move(s->inQueue_.front());
+    s->inQueue_.pop_front();
+    const size_t n = std::min(size, d.size());
+    memcpy(data, d.data(), n);
+    return n;
+}
+
+} // namespace test
+
+} // namespace particle
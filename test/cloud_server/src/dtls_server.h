@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "server_stats.h"
+
+#include "mbedtls/ssl.h"
+#include "mbedtls/ssl_cookie.h"
+#include "mbedtls/timing.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/x509_crt.h"
+
+#include <sys/socket.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+namespace test {
+
+/**
+ * Size of the connection ID assigned by the server to each device session.
+ *
+ * Devices require the server to negotiate a connection ID of exactly this size (see
+ * `protocol::DTLS_CID_SIZE`).
+ */
+const size_t SERVER_CID_SIZE = 8;
+
+/**
+ * A minimal DTLS 1.2 server using the same mbedTLS configuration as the device.
+ *
+ * All sessions share a single UDP socket. Sessions are identified by the peer address or, for
+ * records carrying a connection ID, by the CID, which allows a device to resume its session from
+ * a different address or after a restart without performing a new handshake.
+ */
+class DtlsServer {
+public:
+    class Session;
+
+    typedef std::function<void(Session* session)> SessionCallback;
+    typedef std::function<void(Session* session, const char* data, size_t size)> DataCallback;
+
+    DtlsServer();
+    ~DtlsServer();
+
+    // Loads the server's EC private key in DER format
+    int init(const char* keyData, size_t keySize);
+    int bind(uint16_t port);
+    void destroy();
+
+    // Waits up to `timeout` milliseconds for incoming data and processes pending timeouts
+    int poll(unsigned timeout);
+
+    int send(Session* session, const char* data, size_t size);
+    void close(Session* session);
+
+    void onEstablished(SessionCallback cb);
+    void onData(DataCallback cb);
+    void onClosed(SessionCallback cb);
+
+    const TrafficStats& stats() const;
+    void resetStats();
+
+    uint16_t port() const;
+
+private:
+    std::vector<std::unique_ptr<Session>> sessions_;
+    TrafficStats stats_;
+    SessionCallback establishedCb_;
+    DataCallback dataCb_;
+    SessionCallback closedCb_;
+    mbedtls_ssl_config conf_;
+    mbedtls_ssl_cookie_ctx cookie_;
+    mbedtls_x509_crt cert_;
+    mbedtls_pk_context key_;
+    uint64_t lastCid_;
+    uint16_t port_;
+    int sock_;
+
+    int processDatagram(const char* data, size_t size, const sockaddr_storage& addr, socklen_t addrLen);
+    int processSession(Session* session);
+    int createSession(const sockaddr_storage& addr, socklen_t addrLen, Session** session);
+    void removeClosedSessions();
+
+    Session* findSession(const sockaddr_storage& addr, socklen_t addrLen) const;
+    Session* findSessionByCid(const char* cid) const;
+
+    static int sendCallback(void* ctx, const unsigned char* data, size_t size);
+    static int recvCallback(void* ctx, unsigned char* data, size_t size);
+};
+
+/**
+ * A device session.
+ */
+class DtlsServer::Session {
+public:
+    enum State {
+        HANDSHAKE,
+        ESTABLISHED,
+        CLOSED
+    };
+
+    explicit Session(DtlsServer* server);
+    ~Session();
+
+    State state() const;
+    bool isResumed() const;
+
+    // Handshake timestamps in milliseconds (monotonic clock)
+    uint64_t handshakeStartTime() const;
+    uint64_t handshakeFinishTime() const;
+
+    // Raw public key presented by the device during the handshake (DER)
+    const std::string& devicePublicKey() const;
+
+    std::string peerAddress() const;
+
+    // Application-specific data
+    void userData(void* data);
+    void* userData() const;
+
+private:
+    std::deque<std::vector<char>> inQueue_;
+    std::string devPubKey_;
+    mbedtls_ssl_context ssl_;
+    mbedtls_timing_delay_context timer_;
+    sockaddr_storage addr_;
+    socklen_t addrLen_;
+    DtlsServer* server_;
+    void* userData_;
+    uint64_t hsStartTime_;
+    uint64_t hsFinishTime_;
+    char cid_[SERVER_CID_SIZE];
+    State state_;
+    bool resumed_;
+
+    friend class DtlsServer;
+};
+
+inline void DtlsServer::onEstablished(SessionCallback cb) {
+    establishedCb_ = std::move(cb);
+}
+
+inline void DtlsServer::onData(DataCallback cb) {
+    dataCb_ = std::move(cb);
+}
+
+inline void DtlsServer::onClosed(SessionCallback cb) {
+    closedCb_ = std::move(cb);
+}
+
+inline const TrafficStats& DtlsServer::stats() const {
+    return stats_;
+}
+
+inline void DtlsServer::resetStats() {
+    stats_ = TrafficStats();
+}
+
+inline uint16_t DtlsServer::port() const {
+    return port_;
+}
+
+inline DtlsServer::Session::State DtlsServer::Session::state() const {
+    return state_;
+}
+
+inline bool DtlsServer::Session::isResumed() const {
+    return resumed_;
+}
+
+inline uint64_t DtlsServer::Session::handshakeStartTime() const {
+    return hsStartTime_;
+}
+
+inline uint64_t DtlsServer::Session::handshakeFinishTime() const {
+    return hsFinishTime_;
+}
+
+inline const std::string& DtlsServer::Session::devicePublicKey() const {
+    return devPubKey_;
+}
+
+inline void DtlsServer::Session::userData(void* data) {
+    userData_ = data;
+}
+
+inline void* DtlsServer::Session::userData() const {
+    return userData_;
+}
+
+// Returns the value of a monotonic clock in milliseconds
+uint64_t monotonicMillis();
+
+// Random number generator compatible with the mbedTLS RNG callback interface
+int serverRng(void* ctx, unsigned char* data, size_t size);
+
+} // namespace test
+
+} // namespace particle
@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmark of the device-side handshake crypto with and without precomputation.
+ *
+ * Performs the public key operations that the device does during a full ECDHE-ECDSA handshake:
+ * verification of the server's key exchange signature, generation of the ephemeral ECDH key,
+ * computation of the shared secret and signing of the handshake hash. The operations are run
+ * using the device's mbedTLS configuration, first with an empty pool of precomputed values and
+ * then with a full one.
+ */
+
+#include "ecc_precompute.h"
+#include "mbedtls_util.h"
+
+#include "rng_hal.h"
+#include "timer_hal.h"
+#include "system_error.h"
+#include "check.h"
+
+#include "mbedtls/pk.h"
+#include "mbedtls/ecp.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/ecdsa.h"
+#include "mbedtls/sha256.h"
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+
+namespace po = boost::program_options;
+
+namespace {
+
+std::mt19937 g_rand((std::random_device())());
+
+uint64_t monotonicMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class PkContext {
+public:
+    PkContext() {
+        mbedtls_pk_init(&pk_);
+    }
+
+    ~PkContext() {
+        mbedtls_pk_free(&pk_);
+    }
+
+    int generate() {
+        CHECK_MBEDTLS(mbedtls_pk_setup(&pk_, mbedtls_pk_info_from_type(MBEDTLS_PK_ECKEY)));
+        CHECK_MBEDTLS(mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, mbedtls_pk_ec(pk_), mbedtls_default_rng, nullptr));
+        return 0;
+    }
+
+    mbedtls_pk_context* get() {
+        return &pk_;
+    }
+
+private:
+    mbedtls_pk_context pk_;
+};
+
+class EcpGroup {
+public:
+    EcpGroup() {
+        mbedtls_ecp_group_init(&grp_);
+    }
+
+    ~EcpGroup() {
+        mbedtls_ecp_group_free(&grp_);
+    }
+
+    mbedtls_ecp_group* get() {
+        return &grp_;
+    }
+
+private:
+    mbedtls_ecp_group grp_;
+};
+
+class EcpPoint {
+public:
+    EcpPoint() {
+        mbedtls_ecp_point_init(&p_);
+    }
+
+    ~EcpPoint() {
+        mbedtls_ecp_point_free(&p_);
+    }
+
+    mbedtls_ecp_point* get() {
+        return &p_;
+    }
+
+private:
+    mbedtls_ecp_point p_;
+};
+
+class Mpi {
+public:
+    Mpi() {
+        mbedtls_mpi_init(&mpi_);
+    }
+
+    ~Mpi() {
+        mbedtls_mpi_free(&mpi_);
+    }
+
+    mbedtls_mpi* get() {
+        return &mpi_;
+    }
+
+private:
+    mbedtls_mpi mpi_;
+};
+
+void randomHash(unsigned char hash[32]) {
+    unsigned char data[64];
+    mbedtls_default_rng(nullptr, data, sizeof(data));
+    mbedtls_sha256(data, sizeof(data), hash, 0 /* is224 */);
+}
+
+struct PhaseResult {
+    std::string name;
+    std::vector<uint64_t> times; // Handshake crypto (us)
+    uint64_t fillTime = 0; // Background precomputation (us)
+    ecc_precompute_stats stats = {};
+};
+
+class Benchmark {
+public:
+    explicit Benchmark(unsigned handshakes) :
+            serverHash_(),
+            serverSig_(),
+            serverSigLen_(0),
+            handshakes_(handshakes) {
+    }
+
+    int run() {
+        CHECK(deviceKey_.generate());
+        CHECK(serverKey_.generate());
+        // The server's ephemeral key and its signature over the key exchange parameters. Neither is
+        // computed by the device so they're generated only once
+        CHECK_MBEDTLS(mbedtls_ecp_group_load(grp_.get(), MBEDTLS_ECP_DP_SECP256R1));
+        CHECK_MBEDTLS(mbedtls_ecp_gen_keypair(grp_.get(), serverD_.get(), serverQ_.get(), mbedtls_default_rng, nullptr));
+        randomHash(serverHash_);
+        CHECK_MBEDTLS(mbedtls_pk_sign(serverKey_.get(), MBEDTLS_MD_SHA256, serverHash_, sizeof(serverHash_), serverSig_,
+                &serverSigLen_, mbedtls_default_rng, nullptr));
+        PhaseResult onDemand;
+        onDemand.name = "On demand";
+        CHECK(runPhase(false /* precompute */, &onDemand));
+        PhaseResult precomputed;
+        precomputed.name = "Precomputed";
+        CHECK(runPhase(true /* precompute */, &precomputed));
+        printResult(onDemand);
+        printResult(precomputed);
+        return 0;
+    }
+
+private:
+    PkContext deviceKey_;
+    PkContext serverKey_;
+    EcpGroup grp_;
+    Mpi serverD_;
+    EcpPoint serverQ_;
+    unsigned char serverHash_[32];
+    unsigned char serverSig_[MBEDTLS_ECDSA_MAX_LEN];
+    size_t serverSigLen_;
+    unsigned handshakes_;
+
+    // Fills the pool as the system does while waiting for the network
+    int fillPool(uint64_t* time) {
+        const auto t = monotonicMicros();
+        int r = 0;
+        while ((r = ecc_precompute_fill(mbedtls_default_rng, nullptr, nullptr)) > 0) {
+        }
+        if (time) {
+            *time += monotonicMicros() - t;
+        }
+        return r;
+    }
+
+    int runPhase(bool precompute, PhaseResult* res) {
+        ecc_precompute_clear(nullptr);
+        if (precompute) {
+            CHECK(fillPool(nullptr));
+        }
+        ecc_precompute_stats stats = {};
+        stats.size = sizeof(stats);
+        for (unsigned i = 0; i < handshakes_; ++i) {
+            CHECK(ecc_precompute_get_stats(&stats, nullptr));
+            const auto statsBefore = stats;
+            Mpi d, z, peerZ;
+            EcpPoint Q;
+            unsigned char hash[32] = {};
+            unsigned char sig[MBEDTLS_ECDSA_MAX_LEN] = {};
+            size_t sigLen = 0;
+            randomHash(hash);
+            const auto t = monotonicMicros();
+            int ret = mbedtls_pk_verify(serverKey_.get(), MBEDTLS_MD_SHA256, serverHash_, sizeof(serverHash_),
+                    serverSig_, serverSigLen_);
+            if (ret == 0) {
+                ret = mbedtls_ecdh_gen_public(grp_.get(), d.get(), Q.get(), mbedtls_default_rng, nullptr);
+            }
+            if (ret == 0) {
+                ret = mbedtls_ecdh_compute_shared(grp_.get(), z.get(), serverQ_.get(), d.get(), mbedtls_default_rng,
+                        nullptr);
+            }
+            if (ret == 0) {
+                ret = mbedtls_pk_sign(deviceKey_.get(), MBEDTLS_MD_SHA256, hash, sizeof(hash), sig, &sigLen,
+                        mbedtls_default_rng, nullptr);
+            }
+            res->times.push_back(monotonicMicros() - t);
+            // Make sure the results are correct
+            if (ret == 0) {
+                ret = mbedtls_ecdh_compute_shared(grp_.get(), peerZ.get(), Q.get(), serverD_.get(), mbedtls_default_rng,
+                        nullptr);
+            }
+            if (ret == 0 && mbedtls_mpi_cmp_mpi(z.get(), peerZ.get()) != 0) {
+                std::cerr << "Shared secrets don't match" << std::endl;
+                ret = MBEDTLS_ERR_ECP_VERIFY_FAILED;
+            }
+            if (ret == 0) {
+                ret = mbedtls_pk_verify(deviceKey_.get(), MBEDTLS_MD_SHA256, hash, sizeof(hash), sig, sigLen);
+            }
+            if (ret != 0) {
+                std::cerr << "Handshake crypto failed: -0x" << std::hex << -ret << std::dec << std::endl;
+                return SYSTEM_ERROR_CRYPTO;
+            }
+            CHECK(ecc_precompute_get_stats(&stats, nullptr));
+            res->stats.keypair_hits += stats.keypair_hits - statsBefore.keypair_hits;
+            res->stats.keypair_misses += stats.keypair_misses - statsBefore.keypair_misses;
+            res->stats.nonce_hits += stats.nonce_hits - statsBefore.nonce_hits;
+            res->stats.nonce_misses += stats.nonce_misses - statsBefore.nonce_misses;
+            res->stats.saved_time += stats.saved_time - statsBefore.saved_time;
+            if (precompute) {
+                // Replace the values used by the handshake
+                CHECK(fillPool(&res->fillTime));
+            }
+        }
+        return 0;
+    }
+
+    void printResult(const PhaseResult& r) const {
+        auto t = r.times;
+        std::sort(t.begin(), t.end());
+        uint64_t sum = 0;
+        for (auto v: t) {
+            sum += v;
+        }
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << r.name << ":" << std::endl;
+        std::cout << "  handshake crypto (ms): avg " << sum / 1000.0 / t.size() << ", p50 " << t[t.size() / 2] / 1000.0 <<
+                ", max " << t.back() / 1000.0 << std::endl;
+        if (r.fillTime) {
+            std::cout << "  background precomputation: " << r.fillTime / 1000.0 / t.size() << " ms per handshake" <<
+                    std::endl;
+        }
+        std::cout << "  keypairs: " << r.stats.keypair_hits << " precomputed, " << r.stats.keypair_misses <<
+                " on demand" << std::endl;
+        std::cout << "  nonces: " << r.stats.nonce_hits << " precomputed, " << r.stats.nonce_misses << " on demand" <<
+                std::endl;
+        std::cout << "  estimated time saved: " << (double)r.stats.saved_time / t.size() << " ms per handshake" <<
+                std::endl;
+    }
+};
+
+} // namespace
+
+// HAL functions used by the crypto module
+uint32_t HAL_RNG_GetRandomNumber(void) {
+    return g_rand();
+}
+
+system_tick_t HAL_Timer_Get_Micro_Seconds(void) {
+    return monotonicMicros();
+}
+
+system_tick_t HAL_Timer_Get_Milli_Seconds(void) {
+    return monotonicMicros() / 1000;
+}
+
+int main(int argc, char* argv[]) {
+    unsigned handshakes = 0;
+    po::options_description desc("Options");
+    desc.add_options()
+        ("help,h", "display the available options")
+        ("handshakes,n", po::value<unsigned>(&handshakes)->default_value(100), "number of handshakes in each phase");
+    try {
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help")) {
+            std::cout << desc << std::endl;
+            return 0;
+        }
+        po::notify(vm);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (handshakes == 0) {
+        std::cerr << "Invalid arguments" << std::endl;
+        return 1;
+    }
+    Benchmark bench(handshakes);
+    const int r = bench.run();
+    if (r < 0) {
+        std::cerr << "Benchmark failed: " << r << std::endl;
+        return 1;
+    }
+    return 0;
+}
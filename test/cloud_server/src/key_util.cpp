@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "key_util.h"
+
+#include "dtls_server.h"
+
+#include "system_error.h"
+#include "check.h"
+
+#include "mbedtls/pk.h"
+#include "mbedtls/ecp.h"
+
+#include <arpa/inet.h>
+
+#include <fstream>
+#include <cstring>
+#include <sstream>
+
+namespace particle {
+
+namespace test {
+
+namespace {
+
+// Layout of the server key data (see hal/src/gcc/ota_flash_hal.cpp)
+const size_t SERVER_ADDRESS_OFFSET_EC = 192;
+const size_t SERVER_ADDRESS_SIZE = 128;
+const size_t SERVER_KEY_FILE_SIZE = SERVER_ADDRESS_OFFSET_EC + SERVER_ADDRESS_SIZE;
+
+const unsigned SERVER_ADDRESS_TYPE_IP = 0;
+const unsigned SERVER_ADDRESS_TYPE_DOMAIN = 1;
+const size_t MAX_SERVER_DOMAIN_LENGTH = 63; // sizeof(ServerAddress::domain) - 1
+
+const size_t MAX_KEY_DER_SIZE = 256;
+
+class PkContext {
+public:
+    PkContext() {
+        mbedtls_pk_init(&pk_);
+    }
+
+    ~PkContext() {
+        mbedtls_pk_free(&pk_);
+    }
+
+    mbedtls_pk_context* get() {
+        return &pk_;
+    }
+
+private:
+    mbedtls_pk_context pk_;
+};
+
+// mbedtls_pk_write_*_der() functions write data at the end of the buffer
+int writeKey(mbedtls_pk_context* pk, bool pub, std::string* data) {
+    unsigned char buf[MAX_KEY_DER_SIZE];
+    const int n = pub ? mbedtls_pk_write_pubkey_der(pk, buf, sizeof(buf)) : mbedtls_pk_write_key_der(pk, buf, sizeof(buf));
+    if (n <= 0) {
+        return SYSTEM_ERROR_INTERNAL;
+    }
+    data->assign((const char*)buf + sizeof(buf) - n, n);
+    return 0;
+}
+
+} // namespace
+
+int generateKeyPair(std::string* privKey, std::string* pubKey) {
+    PkContext pk;
+    if (mbedtls_pk_setup(pk.get(), mbedtls_pk_info_from_type(MBEDTLS_PK_ECKEY)) != 0 ||
+            mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, mbedtls_pk_ec(*pk.get()), serverRng, nullptr) != 0) {
+        return SYSTEM_ERROR_INTERNAL;
+    }
+    CHECK(writeKey(pk.get(), false /* pub */, privKey));
+    CHECK(writeKey(pk.get(), true /* pub */, pubKey));
+    return 0;
+}
+
+int publicKeyFromPrivateKey(const std::string& privKey, std::string* pubKey) {
+    PkContext pk;
+    if (mbedtls_pk_parse_key(pk.get(), (const unsigned char*)privKey.data(), privKey.size(), nullptr, 0) != 0) {
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    return writeKey(pk.get(), true /* pub */, pubKey);
+}
+
+int encodeServerKeyFile(const std::string& pubKey, const std::string& addr, std::string* data) {
+    if (pubKey.size() > SERVER_ADDRESS_OFFSET_EC) {
+        return SYSTEM_ERROR_TOO_LARGE;
+    }
+    std::string d(SERVER_KEY_FILE_SIZE, '\0');
+    d.replace(0, pubKey.size(), pubKey);
+    // Type, length, value
+    char* const p = &d[SERVER_ADDRESS_OFFSET_EC];
+    in_addr ipAddr = {};
+    if (inet_pton(AF_INET, addr.c_str(), &ipAddr) == 1) {
+        p[0] = SERVER_ADDRESS_TYPE_IP;
+        p[1] = sizeof(ipAddr.s_addr);
+        memcpy(p + 2, &ipAddr.s_addr, sizeof(ipAddr.s_addr)); // Network byte order
+    } else {
+        if (addr.empty() || addr.size() > MAX_SERVER_DOMAIN_LENGTH) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        p[0] = SERVER_ADDRESS_TYPE_DOMAIN;
+        p[1] = addr.size();
+        memcpy(p + 2, addr.data(), addr.size());
+    }
+    *data = std::move(d);
+    return 0;
+}
+
+int readFile(const std::string& path, std::string* data) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) {
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+    std::ostringstream s;
+    s << f.rdbuf();
+    if (!f) {
+        return SYSTEM_ERROR_IO;
+    }
+    *data = s.str();
+    return 0;
+}
+
+int writeFile(const std::string& path, const std::string& data) {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f.write(data.data(), data.size());
+    if (!f) {
+        return SYSTEM_ERROR_IO;
+    }
+    return 0;
+}
+
+} // namespace test
+
+} // namespace particle
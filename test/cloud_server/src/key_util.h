@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+namespace particle {
+
+namespace test {
+
+/**
+ * Generates a P-256 key pair. Both keys are returned in DER format.
+ */
+int generateKeyPair(std::string* privKey, std::string* pubKey);
+
+/**
+ * Extracts the public key from a private key. Both keys are in DER format.
+ */
+int publicKeyFromPrivateKey(const std::string& privKey, std::string* pubKey);
+
+/**
+ * Encodes the server public key and address in the format expected by the virtual device
+ * (see `HAL_FLASH_Read_ServerAddress()` in hal/src/gcc/ota_flash_hal.cpp).
+ *
+ * `addr` can be an IPv4 address or a host name. The virtual device ignores the port number and
+ * always connects to port 5684.
+ */
+int encodeServerKeyFile(const std::string& pubKey, const std::string& addr, std::string* data);
+
+int readFile(const std::string& path, std::string* data);
+int writeFile(const std::string& path, const std::string& data);
+
+} // namespace test
+
+} // namespace particle
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cloud_server.h"
+#include "key_util.h"
+
+#include "check.h"
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+#include <csignal>
+
+namespace po = boost::program_options;
+
+using namespace particle::test;
+
+namespace {
+
+volatile std::sig_atomic_t g_stop = 0;
+
+void signalHandler(int) {
+    g_stop = 1;
+}
+
+// Loads the server key or generates a new one along with the key files for the virtual device
+int loadOrGenerateKeys(const std::string& keyFile, const std::string& outDir, const std::string& addr,
+        std::string* privKey) {
+    std::string pubKey;
+    if (readFile(keyFile, privKey) == 0) {
+        CHECK(publicKeyFromPrivateKey(*privKey, &pubKey));
+    } else {
+        CHECK(generateKeyPair(privKey, &pubKey));
+        CHECK(writeFile(keyFile, *privKey));
+        std::cout << "Generated server key: " << keyFile << std::endl;
+    }
+    std::string serverKeyFile;
+    CHECK(encodeServerKeyFile(pubKey, addr, &serverKeyFile));
+    CHECK(writeFile(outDir + "/server_key.der", serverKeyFile));
+    std::string devPrivKey, devPubKey;
+    const auto devKeyPath = outDir + "/device_key.der";
+    if (readFile(devKeyPath, &devPrivKey) != 0) {
+        CHECK(generateKeyPair(&devPrivKey, &devPubKey));
+        CHECK(writeFile(devKeyPath, devPrivKey));
+    }
+    return 0;
+}
+
+void printStats(const CloudServer& server) {
+    const auto& t = server.trafficStats();
+    const auto& c = server.coapStats();
+    std::cout << "Datagrams: " << t.rxDatagrams << " received, " << t.txDatagrams << " sent" << std::endl;
+    std::cout << "Bytes on wire: " << t.wireBytes() << std::endl;
+    std::cout << "CoAP messages: " << c.rxMessages << " received, " << c.txMessages << " sent, " <<
+            c.retransmissions << " retransmitted, " << c.duplicates << " duplicates" << std::endl;
+    std::cout << "Events: " << c.events << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string keyFile;
+    std::string outDir;
+    std::string addr;
+    CloudServer::Config conf;
+    bool verbose = false;
+    po::options_description opts("Options");
+    opts.add_options()
+        ("help,h", "display the available options")
+        ("port,p", po::value<uint16_t>(&conf.port)->default_value(DEFAULT_SERVER_PORT), "UDP port")
+        ("key,k", po::value<std::string>(&keyFile)->default_value("cloud_server_key.der"),
+                "server private key file; generated if it doesn't exist")
+        ("out-dir,o", po::value<std::string>(&outDir)->default_value("."),
+                "directory for the virtual device's server_key.der and device_key.der")
+        ("address,a", po::value<std::string>(&addr)->default_value("127.0.0.1"),
+                "server IPv4 address or host name stored in server_key.der")
+        ("verbose,v", po::bool_switch(&verbose), "print received events");
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, opts), vm);
+        po::notify(vm);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (vm.count("help")) {
+        std::cout << opts << std::endl;
+        return 0;
+    }
+    std::string privKey;
+    int r = loadOrGenerateKeys(keyFile, outDir, addr, &privKey);
+    if (r < 0) {
+        std::cerr << "Unable to load keys: " << r << std::endl;
+        return 1;
+    }
+    CloudServer server;
+    r = server.init(privKey.data(), privKey.size(), conf);
+    if (r < 0) {
+        std::cerr << "Unable to start server: " << r << std::endl;
+        return 1;
+    }
+    server.onConnected([](CloudServer::Device* dev) {
+        const auto s = dev->session();
+        std::cout << "Device connected: " << dev->id() << " (" << s->peerAddress() << "); platform ID: " <<
+                dev->platformId() << "; handshake: " << (s->handshakeFinishTime() - s->handshakeStartTime()) <<
+                " ms" << (s->isResumed() ? " (resumed)" : "") << std::endl;
+    });
+    server.onDisconnected([](CloudServer::Device* dev) {
+        std::cout << "Device disconnected: " << dev->id() << std::endl;
+    });
+    server.onEvent([verbose](CloudServer::Device* dev, const std::string& name, const std::string& data) {
+        if (verbose) {
+            std::cout << "Event: " << name << ": " << data << std::endl;
+        }
+    });
+    std::signal(SIGINT, signalHandler);
+    std::signal(SIGTERM, signalHandler);
+    std::cout << "Listening on port " << server.config().port << std::endl;
+    while (!g_stop) {
+        r = server.poll(100);
+        if (r < 0) {
+            std::cerr << "Server error: " << r << std::endl;
+            return 1;
+        }
+    }
+    printStats(server);
+    return 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/*
+ * Server-side overrides for the device's mbedTLS configuration (crypto/inc/mbedtls_config_default.h).
+ * Everything else, including the ciphersuite and the maximum record size, is kept the same as on
+ * the device.
+ */
+
+#define MBEDTLS_SSL_SRV_C
+
+// The server asks the device to use a connection ID in the records it sends
+#undef MBEDTLS_SSL_CID_IN_LEN_MAX
+#define MBEDTLS_SSL_CID_IN_LEN_MAX 8
+
+// Use the default implementation of mbedtls_timing_hardclock()
+#undef HAVE_HARDCLOCK
+
+// The server doesn't precompute its handshake crypto
+#undef MBEDTLS_ECDH_GEN_PUBLIC_ALT
+#undef MBEDTLS_ECDSA_SIGN_ALT
@@ -0,0 +1,558 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * End-to-end benchmark of the device protocol stack.
+ *
+ * Starts a local cloud server, spawns the virtual device (built with user/tests/app/cloud_benchmark)
+ * and measures handshake latency, request rates, event rate and OTA throughput along with the
+ * number of bytes sent over the network.
+ */
+
+#include "cloud_server.h"
+#include "key_util.h"
+
+#include "system_error.h"
+#include "check.h"
+
+#include <boost/program_options.hpp>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstdlib>
+
+namespace po = boost::program_options;
+
+using namespace particle::test;
+
+namespace {
+
+// Maximum duration of the OTA phase (ms)
+const unsigned OTA_TIMEOUT = 10 * 60 * 1000;
+
+// Function that makes the device reconnect to the cloud (see user/tests/app/cloud_benchmark)
+const char RECONNECT_FUNCTION[] = "reconnect";
+
+// Function that makes the device reconnect and publish a confirmable event right away
+const char WAKE_FUNCTION[] = "wake";
+
+// Event published by the device after a simulated wake-up
+const char WAKE_EVENT[] = "wake";
+
+struct Options {
+    std::string devicePath;
+    std::string deviceId;
+    std::string workDir;
+    std::string otaFile;
+    std::string functionName;
+    std::string variableName;
+    std::string serverAddress;
+    unsigned duration = 0; // Duration of each request phase (seconds)
+    unsigned concurrency = 0; // Number of requests in flight
+    unsigned connectTimeout = 0;
+    unsigned otaSize = 0;
+    unsigned reconnects = 0; // Number of reconnections in each reconnect phase
+    bool verbose = false;
+};
+
+// Result of a benchmark phase
+struct PhaseResult {
+    std::string name;
+    std::vector<uint64_t> latencies; // Round-trip times (ms)
+    TrafficStats traffic;
+    uint64_t duration = 0; // ms
+    unsigned count = 0; // Completed operations
+    unsigned errors = 0;
+    uint64_t bytes = 0; // Application payload bytes
+    bool skipped = false;
+};
+
+class Benchmark {
+public:
+    explicit Benchmark(const Options& opts) :
+            opts_(opts),
+            pid_(-1) {
+    }
+
+    ~Benchmark() {
+        stopDevice();
+    }
+
+    int run() {
+        CHECK(init());
+        CHECK(startDevice());
+        CHECK(waitConnected());
+        runRequestPhase("Function calls", [this](std::function<void(int)> done) {
+            return device()->callFunction(opts_.functionName, "benchmark", [done](int error, int result) {
+                done(error);
+            });
+        });
+        runRequestPhase("Variable requests", [this](std::function<void(int)> done) {
+            return device()->getVariable(opts_.variableName, [done](int error, const std::string& value) {
+                done(error);
+            });
+        });
+        runEventPhase();
+        runReconnectPhase("Reconnects (resumed session)", "");
+        runReconnectPhase("Reconnects (new session)", "clear_session");
+        runWakePhase("Wake to ACK (session validated)", "");
+        runWakePhase("Wake to ACK (fast resume)", "fast");
+        runUpdatePhase();
+        printResults();
+        return 0;
+    }
+
+private:
+    CloudServer server_;
+    std::vector<PhaseResult> results_;
+    Options opts_;
+    std::string deviceId_;
+    uint64_t spawnTime_ = 0;
+    uint64_t handshakeTime_ = 0;
+    uint64_t connectTime_ = 0;
+    unsigned eventCount_ = 0;
+    unsigned connectCount_ = 0;
+    unsigned wakeCount_ = 0;
+    uint64_t wakeTime_ = 0;
+    pid_t pid_;
+
+    int init() {
+        std::string privKey, pubKey, serverKeyFile, devPrivKey, devPubKey;
+        CHECK(generateKeyPair(&privKey, &pubKey));
+        CHECK(encodeServerKeyFile(pubKey, opts_.serverAddress, &serverKeyFile));
+        CHECK(writeFile(opts_.workDir + "/server_key.der", serverKeyFile));
+        CHECK(generateKeyPair(&devPrivKey, &devPubKey));
+        CHECK(writeFile(opts_.workDir + "/device_key.der", devPrivKey));
+        CloudServer::Config conf;
+        // The virtual device always connects to the default port
+        conf.port = DEFAULT_SERVER_PORT;
+        CHECK(server_.init(privKey.data(), privKey.size(), conf));
+        server_.onConnected([this](CloudServer::Device* dev) {
+            ++connectCount_;
+        });
+        server_.onEvent([this](CloudServer::Device* dev, const std::string& name, const std::string& data) {
+            ++eventCount_;
+            if (name == WAKE_EVENT) {
+                // The server acknowledges the event right after this callback returns
+                ++wakeCount_;
+                wakeTime_ = monotonicMillis();
+            }
+        });
+        server_.onDisconnected([this](CloudServer::Device* dev) {
+            std::cerr << "Device disconnected" << std::endl;
+        });
+        deviceId_ = opts_.deviceId;
+        if (deviceId_.empty()) {
+            char id[12] = {};
+            serverRng(nullptr, (unsigned char*)id, sizeof(id));
+            static const char alpha[] = "0123456789abcdef";
+            for (size_t i = 0; i < sizeof(id); ++i) {
+                deviceId_ += alpha[((uint8_t)id[i] >> 4) & 0x0f];
+                deviceId_ += alpha[(uint8_t)id[i] & 0x0f];
+            }
+        }
+        return 0;
+    }
+
+    int startDevice() {
+        // The device is started in the working directory
+        char* path = realpath(opts_.devicePath.c_str(), nullptr);
+        if (!path) {
+            std::cerr << "Device executable not found: " << opts_.devicePath << std::endl;
+            return SYSTEM_ERROR_NOT_FOUND;
+        }
+        opts_.devicePath = path;
+        free(path);
+        spawnTime_ = monotonicMillis();
+        const pid_t pid = fork();
+        if (pid < 0) {
+            return SYSTEM_ERROR_INTERNAL;
+        }
+        if (pid == 0) {
+            if (chdir(opts_.workDir.c_str()) != 0) {
+                _exit(1);
+            }
+            if (!opts_.verbose) {
+                const int fd = open("/dev/null", O_WRONLY);
+                dup2(fd, STDOUT_FILENO);
+                dup2(fd, STDERR_FILENO);
+            }
+            const std::string verbosity = opts_.verbose ? "1" : "70";
+            execl(opts_.devicePath.c_str(), opts_.devicePath.c_str(), "--device_id", deviceId_.c_str(),
+                    "--device_key", "device_key.der", "--server_key", "server_key.der", "--protocol", "udp",
+                    "--verbosity", verbosity.c_str(), (char*)nullptr);
+            _exit(127);
+        }
+        pid_ = pid;
+        return 0;
+    }
+
+    void stopDevice() {
+        if (pid_ > 0) {
+            kill(pid_, SIGTERM);
+            waitpid(pid_, nullptr, 0);
+            pid_ = -1;
+        }
+    }
+
+    int waitConnected() {
+        const auto t1 = monotonicMillis();
+        while (!device()) {
+            if (monotonicMillis() - t1 >= opts_.connectTimeout * 1000) {
+                std::cerr << "Device didn't connect to the server" << std::endl;
+                return SYSTEM_ERROR_TIMEOUT;
+            }
+            int status = 0;
+            if (waitpid(pid_, &status, WNOHANG) == pid_) {
+                pid_ = -1;
+                std::cerr << "Device process exited unexpectedly" << std::endl;
+                return SYSTEM_ERROR_INVALID_STATE;
+            }
+            CHECK(server_.poll(10));
+        }
+        const auto s = device()->session();
+        handshakeTime_ = s->handshakeFinishTime() - s->handshakeStartTime();
+        connectTime_ = device()->helloTime() - spawnTime_;
+        // Let the device finish sending its describe messages and subscriptions
+        pollFor(1000);
+        return 0;
+    }
+
+    CloudServer::Device* device() const {
+        return server_.device(deviceId_);
+    }
+
+    void pollFor(unsigned ms) {
+        const auto t1 = monotonicMillis();
+        while (monotonicMillis() - t1 < ms) {
+            server_.poll(1);
+        }
+    }
+
+    // Keeps `concurrency` requests in flight for the duration of the phase
+    void runRequestPhase(const std::string& name, std::function<int(std::function<void(int)>)> sendRequest) {
+        PhaseResult res;
+        res.name = name;
+        server_.resetStats();
+        unsigned inFlight = 0;
+        bool notFound = false;
+        const auto t1 = monotonicMillis();
+        const auto end = t1 + opts_.duration * 1000;
+        for (;;) {
+            const auto now = monotonicMillis();
+            while (now < end && inFlight < opts_.concurrency && device() && !notFound) {
+                const auto sendTime = now;
+                const int r = sendRequest([&res, &inFlight, &notFound, sendTime](int error) {
+                    --inFlight;
+                    if (error < 0) {
+                        ++res.errors;
+                        if (error == SYSTEM_ERROR_NOT_FOUND) {
+                            notFound = true;
+                        }
+                        return;
+                    }
+                    ++res.count;
+                    res.latencies.push_back(monotonicMillis() - sendTime);
+                });
+                if (r < 0) {
+                    ++res.errors;
+                    break;
+                }
+                ++inFlight;
+            }
+            if ((now >= end || notFound || !device()) && !inFlight) {
+                break;
+            }
+            server_.poll(1);
+        }
+        res.duration = monotonicMillis() - t1;
+        res.traffic = server_.trafficStats();
+        res.skipped = notFound;
+        results_.push_back(std::move(res));
+    }
+
+    void runEventPhase() {
+        PhaseResult res;
+        res.name = "Events";
+        server_.resetStats();
+        eventCount_ = 0;
+        const auto t1 = monotonicMillis();
+        pollFor(opts_.duration * 1000);
+        res.duration = monotonicMillis() - t1;
+        res.count = eventCount_;
+        res.traffic = server_.trafficStats();
+        results_.push_back(std::move(res));
+    }
+
+    // Makes the device reconnect to the server and measures the time it takes to receive a Hello
+    // message from the device after requesting the reconnection
+    void runReconnectPhase(const std::string& name, const std::string& arg) {
+        PhaseResult res;
+        res.name = name;
+        if (!opts_.reconnects) {
+            res.skipped = true;
+            results_.push_back(std::move(res));
+            return;
+        }
+        server_.resetStats();
+        const auto t1 = monotonicMillis();
+        for (unsigned i = 0; i < opts_.reconnects; ++i) {
+            auto dev = device();
+            if (!dev) {
+                ++res.errors;
+                break;
+            }
+            const auto sendTime = monotonicMillis();
+            const unsigned connectCount = connectCount_;
+            int error = 0;
+            bool done = false;
+            int r = dev->callFunction(RECONNECT_FUNCTION, arg, [&error, &done](int err, int result) {
+                error = err;
+                done = true;
+            });
+            if (r < 0) {
+                ++res.errors;
+                break;
+            }
+            while (connectCount_ == connectCount && !(done && error < 0) &&
+                    monotonicMillis() - sendTime < opts_.connectTimeout * 1000) {
+                server_.poll(1);
+            }
+            if (done && error == SYSTEM_ERROR_NOT_FOUND) {
+                res.skipped = true;
+                break;
+            }
+            if (connectCount_ == connectCount) {
+                std::cerr << "Device didn't reconnect to the server" << std::endl;
+                ++res.errors;
+                break;
+            }
+            ++res.count;
+            res.latencies.push_back(device()->helloTime() - sendTime);
+            // Let the device finish sending its post-connection messages
+            pollFor(1000);
+        }
+        res.duration = monotonicMillis() - t1;
+        res.traffic = server_.trafficStats();
+        results_.push_back(std::move(res));
+    }
+
+    // Makes the device reconnect resuming its session and measures the time until the server
+    // acknowledges the first confirmable event sent by the device after reconnecting. The device
+    // doesn't send a Hello message if its application state hasn't changed, so the phase doesn't
+    // rely on it
+    void runWakePhase(const std::string& name, const std::string& arg) {
+        PhaseResult res;
+        res.name = name;
+        if (!opts_.reconnects) {
+            res.skipped = true;
+            results_.push_back(std::move(res));
+            return;
+        }
+        server_.resetStats();
+        const auto t1 = monotonicMillis();
+        for (unsigned i = 0; i < opts_.reconnects; ++i) {
+            auto dev = device();
+            if (!dev) {
+                ++res.errors;
+                break;
+            }
+            const auto sendTime = monotonicMillis();
+            const unsigned wakeCount = wakeCount_;
+            int error = 0;
+            bool done = false;
+            int r = dev->callFunction(WAKE_FUNCTION, arg, [&error, &done](int err, int result) {
+                error = err;
+                done = true;
+            });
+            if (r < 0) {
+                ++res.errors;
+                break;
+            }
+            while (wakeCount_ == wakeCount && !(done && error < 0) &&
+                    monotonicMillis() - sendTime < opts_.connectTimeout * 1000) {
+                server_.poll(1);
+            }
+            if (done && error == SYSTEM_ERROR_NOT_FOUND) {
+                res.skipped = true;
+                break;
+            }
+            if (wakeCount_ == wakeCount) {
+                std::cerr << "Device didn't send an event after reconnecting" << std::endl;
+                ++res.errors;
+                break;
+            }
+            ++res.count;
+            res.latencies.push_back(wakeTime_ - sendTime);
+            // Let the device finish sending its post-connection messages
+            pollFor(1000);
+        }
+        res.duration = monotonicMillis() - t1;
+        res.traffic = server_.trafficStats();
+        results_.push_back(std::move(res));
+    }
+
+    void runUpdatePhase() {
+        PhaseResult res;
+        res.name = "OTA update";
+        std::string data;
+        if (!opts_.otaFile.empty()) {
+            if (readFile(opts_.otaFile, &data) < 0) {
+                std::cerr << "Unable to read file: " << opts_.otaFile << std::endl;
+                res.skipped = true;
+                results_.push_back(std::move(res));
+                return;
+            }
+        } else {
+            data.resize(opts_.otaSize);
+            serverRng(nullptr, (unsigned char*)&data[0], data.size());
+        }
+        res.bytes = data.size();
+        server_.resetStats();
+        bool done = false;
+        int result = 0;
+        const auto t1 = monotonicMillis();
+        auto dev = device();
+        // A synthetic image is discarded by cancelling the update once it has been transferred
+        const bool cancel = opts_.otaFile.empty();
+        int r = dev ? dev->startUpdate(std::move(data), cancel, [&done, &result](int error) {
+            done = true;
+            result = error;
+        }) : SYSTEM_ERROR_INVALID_STATE;
+        if (r < 0) {
+            res.skipped = true;
+            results_.push_back(std::move(res));
+            return;
+        }
+        while (!done) {
+            if (monotonicMillis() - t1 >= OTA_TIMEOUT) {
+                result = SYSTEM_ERROR_TIMEOUT;
+                break;
+            }
+            server_.poll(1);
+        }
+        res.duration = monotonicMillis() - t1;
+        res.traffic = server_.trafficStats();
+        if (result < 0) {
+            std::cerr << "Firmware update failed: " << result << std::endl;
+            ++res.errors;
+        } else {
+            res.count = server_.coapStats().otaChunks;
+        }
+        results_.push_back(std::move(res));
+    }
+
+    void printResults() const {
+        std::cout << std::fixed << std::setprecision(1);
+        std::cout << "Device ID: " << deviceId_ << std::endl;
+        std::cout << "DTLS handshake: " << handshakeTime_ << " ms" << std::endl;
+        std::cout << "Time to Hello (since process start): " << connectTime_ << " ms" << std::endl;
+        for (const auto& r: results_) {
+            std::cout << std::endl << r.name << ":" << std::endl;
+            if (r.skipped) {
+                std::cout << "  skipped" << std::endl;
+                continue;
+            }
+            const double secs = r.duration / 1000.0;
+            if (r.bytes > 0) {
+                std::cout << "  transferred: " << r.bytes << " bytes in " << r.duration << " ms (" <<
+                        (secs > 0 ? r.bytes / 1024.0 / secs : 0.0) << " KB/s)" << std::endl;
+                std::cout << "  chunks sent: " << r.count << std::endl;
+            } else {
+                std::cout << "  completed: " << r.count << " (" << (secs > 0 ? r.count / secs : 0.0) << "/s)" << std::endl;
+            }
+            if (r.errors > 0) {
+                std::cout << "  errors: " << r.errors << std::endl;
+            }
+            if (!r.latencies.empty()) {
+                auto l = r.latencies;
+                std::sort(l.begin(), l.end());
+                uint64_t sum = 0;
+                for (auto v: l) {
+                    sum += v;
+                }
+                std::cout << "  latency (ms): avg " << (double)sum / l.size() << ", p50 " << l[l.size() / 2] <<
+                        ", p99 " << l[std::min(l.size() - 1, l.size() * 99 / 100)] << ", max " << l.back() << std::endl;
+            }
+            const auto& t = r.traffic;
+            std::cout << "  datagrams: " << t.rxDatagrams << " rx, " << t.txDatagrams << " tx" << std::endl;
+            std::cout << "  bytes on wire: " << t.wireBytes() << " (" << (secs > 0 ? t.wireBytes() / secs : 0.0) <<
+                    " B/s)";
+            if (r.count > 0 && r.bytes == 0) {
+                std::cout << "; " << (double)t.wireBytes() / r.count << " per operation";
+            }
+            std::cout << std::endl;
+        }
+    }
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    po::options_description desc("Options");
+    desc.add_options()
+        ("help,h", "display the available options")
+        ("device,d", po::value<std::string>(&opts.devicePath)->required(), "virtual device executable")
+        ("device-id", po::value<std::string>(&opts.deviceId), "device ID (24 hex characters); random by default")
+        ("work-dir", po::value<std::string>(&opts.workDir)->default_value("."),
+                "working directory of the virtual device; key files are generated there")
+        ("duration", po::value<unsigned>(&opts.duration)->default_value(10), "duration of each phase in seconds")
+        ("concurrency", po::value<unsigned>(&opts.concurrency)->default_value(1), "number of requests in flight")
+        ("function", po::value<std::string>(&opts.functionName)->default_value("bench"), "function name")
+        ("variable", po::value<std::string>(&opts.variableName)->default_value("counter"), "variable name")
+        ("ota-size", po::value<unsigned>(&opts.otaSize)->default_value(256 * 1024), "size of the synthetic OTA image")
+        ("ota-file", po::value<std::string>(&opts.otaFile), "firmware binary to send instead of a synthetic image")
+        ("reconnects", po::value<unsigned>(&opts.reconnects)->default_value(5),
+                "number of reconnections in each reconnect and wake phase; 0 to skip those phases")
+        ("server-address", po::value<std::string>(&opts.serverAddress)->default_value("127.0.0.1"),
+                "server address for the virtual device; a host name makes the device resolve it via DNS")
+        ("connect-timeout", po::value<unsigned>(&opts.connectTimeout)->default_value(30), "connection timeout in seconds")
+        ("verbose,v", po::bool_switch(&opts.verbose), "show the virtual device's output");
+    try {
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help")) {
+            std::cout << desc << std::endl;
+            return 0;
+        }
+        po::notify(vm);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (opts.concurrency == 0 || opts.otaSize == 0) {
+        std::cerr << "Invalid arguments" << std::endl;
+        return 1;
+    }
+    Benchmark bench(opts);
+    const int r = bench.run();
+    if (r < 0) {
+        std::cerr << "Benchmark failed: " << r << std::endl;
+        return 1;
+    }
+    return 0;
+}
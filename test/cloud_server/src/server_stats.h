@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace particle {
+
+namespace test {
+
+/**
+ * Size of the IPv4 and UDP headers added to every datagram on the wire.
+ */
+const unsigned UDP_IPV4_OVERHEAD = 28;
+
+/**
+ * Datagram-level traffic counters.
+ */
+struct TrafficStats {
+    uint64_t rxBytes = 0; // Received UDP payload bytes
+    uint64_t txBytes = 0; // Sent UDP payload bytes
+    unsigned rxDatagrams = 0; // Received datagrams
+    unsigned txDatagrams = 0; // Sent datagrams
+
+    uint64_t wireBytes() const {
+        return rxBytes + txBytes + (uint64_t)(rxDatagrams + txDatagrams) * UDP_IPV4_OVERHEAD;
+    }
+};
+
+/**
+ * CoAP-level counters.
+ */
+struct CoapStats {
+    unsigned rxMessages = 0; // Received CoAP messages
+    unsigned txMessages = 0; // Sent CoAP messages
+    unsigned retransmissions = 0; // Messages retransmitted by the server
+    unsigned duplicates = 0; // Duplicate messages received from the device
+    unsigned events = 0; // Received events
+    unsigned functionCalls = 0; // Completed function calls
+    unsigned variableRequests = 0; // Completed variable requests
+    unsigned otaChunks = 0; // Sent OTA chunks, including retransmitted ones
+};
+
+} // namespace test
+
+} // namespace particle
@@ -16,6 +16,9 @@
  */
 
 #include <limits>
+#include <string>
+#include <vector>
+#include <cstring>
 
 #include "active_object.h"
 #include "protocol_selector.h"
@@ -26,6 +29,8 @@
 
 #include "mock/mock_types.h"
 #include "system_publish_vitals.h"
+#include "system_vitals_delta.h"
+#include "system_error.h"
 
 bool spark_cloud_flag_connected_called;
 int spark_cloud_flag_connected_result;
@@ -39,8 +44,9 @@ ISRTaskQueue SystemISRTaskQueue;
 
 } // namespace particle
 
-void ISRTaskQueue::enqueue(ISRTaskQueue::Task*)
+bool ISRTaskQueue::enqueue(ISRTaskQueue::Task*)
 {
+    return true;
 }
 
 extern "C"
@@ -382,3 +388,295 @@ TEST_CASE("Publishing vitals", "[VitalsPublisher::publish]")
         }
     }
 }
+
+namespace {
+
+using particle::system::VitalsDeltaEncoder;
+
+struct Record
+{
+    uint16_t id;
+    uint32_t value;
+};
+
+// Binary vitals data as produced by the system's diagnostics formatter
+std::string binarySnapshot(const std::vector<Record>& records)
+{
+    std::string s;
+    const uint16_t header[] = { 2 /* ID size */, 4 /* Value size */ };
+    s.append((const char*)header, sizeof(header));
+    for (const auto& r: records)
+    {
+        s.append((const char*)&r.id, sizeof(r.id));
+        s.append((const char*)&r.value, sizeof(r.value));
+    }
+    return s;
+}
+
+bool appendToString(void* data, const uint8_t* buf, size_t size)
+{
+    static_cast<std::string*>(data)->append((const char*)buf, size);
+    return true;
+}
+
+std::string encodeSnapshot(VitalsDeltaEncoder* encoder, const std::vector<Record>& records)
+{
+    const auto snapshot = binarySnapshot(records);
+    std::string out;
+    REQUIRE(encoder->encode(snapshot.data(), snapshot.size(), appendToString, &out) == 0);
+    return out;
+}
+
+bool isDeltaSnapshot(const std::string& data)
+{
+    uint16_t idSize = 0;
+    memcpy(&idSize, data.data(), sizeof(idSize));
+    return idSize & VitalsDeltaEncoder::DELTA_FLAG;
+}
+
+// A snapshot of a typical cellular device. Most of the values don't change between publications
+std::vector<Record> cellularSnapshot()
+{
+    std::vector<Record> records;
+    const uint16_t ids[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24,
+            25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43 };
+    for (auto id: ids)
+    {
+        records.push_back({ id, (uint32_t)id * 1000 });
+    }
+    return records;
+}
+
+void setValue(std::vector<Record>* records, uint16_t id, uint32_t value)
+{
+    for (auto& r: *records)
+    {
+        if (r.id == id)
+        {
+            r.value = value;
+        }
+    }
+}
+
+} // namespace
+
+TEST_CASE("Delta encoding of vitals", "[VitalsDeltaEncoder::encode]")
+{
+    SECTION("Payload size")
+    {
+        GIVEN("An encoder with delta encoding enabled and an acknowledged full snapshot")
+        {
+            VitalsDeltaEncoder encoder;
+            encoder.keyframeInterval(10);
+            auto records = cellularSnapshot();
+            const auto full = encodeSnapshot(&encoder, records);
+            encoder.acknowledge();
+
+            WHEN("Two values have changed")
+            {
+                setValue(&records, 4, 12345); // sys:uptime
+                setValue(&records, 31, (uint32_t)-71); // net:rat:sig
+                const auto delta = encodeSnapshot(&encoder, records);
+
+                THEN("Only the changed values are published")
+                {
+                    CHECK_FALSE(isDeltaSnapshot(full));
+                    CHECK(full == binarySnapshot(cellularSnapshot()));
+                    CHECK(isDeltaSnapshot(delta));
+                    CHECK(full.size() == 4 + 43 * 6);
+                    CHECK(delta.size() == 4 + 2 * 6); // A 95% reduction
+                }
+            }
+
+            WHEN("Nothing has changed")
+            {
+                const auto delta = encodeSnapshot(&encoder, records);
+
+                THEN("Only the header is published")
+                {
+                    CHECK(isDeltaSnapshot(delta));
+                    CHECK(delta.size() == 4);
+                }
+            }
+        }
+    }
+
+    SECTION("Thresholds")
+    {
+        GIVEN("A threshold for a data source")
+        {
+            VitalsDeltaEncoder encoder;
+            encoder.keyframeInterval(10);
+            REQUIRE(encoder.threshold(10, 5) == 0);
+            auto records = cellularSnapshot();
+            encodeSnapshot(&encoder, records);
+            encoder.acknowledge();
+
+            WHEN("The value changes by less than the threshold in several steps")
+            {
+                setValue(&records, 10, 10003);
+                const auto delta1 = encodeSnapshot(&encoder, records);
+                encoder.acknowledge();
+                setValue(&records, 10, 9995);
+                const auto delta2 = encodeSnapshot(&encoder, records);
+                encoder.acknowledge();
+                setValue(&records, 10, 10006);
+                const auto delta3 = encodeSnapshot(&encoder, records);
+
+                THEN("The changes are compared with the last published value")
+                {
+                    CHECK(delta1.size() == 4);
+                    CHECK(delta2.size() == 4);
+                    CHECK(delta3 == binarySnapshot({ { 10, 10006 } }).replace(0, 2, "\x02\x80", 2));
+                }
+            }
+        }
+    }
+
+    SECTION("Keyframes and acknowledgements")
+    {
+        GIVEN("An encoder with a keyframe interval of 3")
+        {
+            VitalsDeltaEncoder encoder;
+            encoder.keyframeInterval(3);
+            const auto records = cellularSnapshot();
+
+            WHEN("The snapshots are acknowledged")
+            {
+                std::vector<bool> deltas;
+                for (int i = 0; i < 6; ++i)
+                {
+                    deltas.push_back(isDeltaSnapshot(encodeSnapshot(&encoder, records)));
+                    encoder.acknowledge();
+                }
+
+                THEN("Every third snapshot is sent in full")
+                {
+                    CHECK(deltas == std::vector<bool>({ false, true, true, false, true, true }));
+                }
+            }
+
+            WHEN("A snapshot is not acknowledged")
+            {
+                const auto s1 = encodeSnapshot(&encoder, records);
+                const auto s2 = encodeSnapshot(&encoder, records);
+
+                THEN("The full snapshot is sent again")
+                {
+                    CHECK_FALSE(isDeltaSnapshot(s1));
+                    CHECK_FALSE(isDeltaSnapshot(s2));
+                }
+            }
+
+            WHEN("A snapshot could not be sent")
+            {
+                encodeSnapshot(&encoder, records);
+                encoder.acknowledge();
+                encodeSnapshot(&encoder, records);
+                encoder.cancel();
+                const auto s = encodeSnapshot(&encoder, records);
+
+                THEN("The baseline is kept")
+                {
+                    CHECK(isDeltaSnapshot(s));
+                }
+            }
+
+            WHEN("A snapshot could not be sent while another one is in flight")
+            {
+                encodeSnapshot(&encoder, records);
+                encoder.acknowledge();
+                encodeSnapshot(&encoder, records);
+                encodeSnapshot(&encoder, records);
+                encoder.cancel();
+                encoder.acknowledge();
+                const auto s = encodeSnapshot(&encoder, records);
+
+                THEN("The full snapshot is sent")
+                {
+                    CHECK_FALSE(isDeltaSnapshot(s));
+                }
+            }
+
+            WHEN("The encoder is reset")
+            {
+                encodeSnapshot(&encoder, records);
+                encoder.acknowledge();
+                encoder.reset();
+                const auto s = encodeSnapshot(&encoder, records);
+
+                THEN("The full snapshot is sent")
+                {
+                    CHECK_FALSE(isDeltaSnapshot(s));
+                }
+            }
+        }
+
+        GIVEN("An encoder with delta encoding disabled")
+        {
+            VitalsDeltaEncoder encoder;
+            const auto records = cellularSnapshot();
+
+            WHEN("The snapshots are acknowledged")
+            {
+                const auto s1 = encodeSnapshot(&encoder, records);
+                encoder.acknowledge();
+                const auto s2 = encodeSnapshot(&encoder, records);
+
+                THEN("The full snapshot is always sent")
+                {
+                    CHECK_FALSE(encoder.isEnabled());
+                    CHECK(s1 == s2);
+                    CHECK_FALSE(isDeltaSnapshot(s2));
+                }
+            }
+        }
+    }
+
+    SECTION("Errors")
+    {
+        GIVEN("An acknowledged snapshot")
+        {
+            VitalsDeltaEncoder encoder;
+            encoder.keyframeInterval(10);
+            REQUIRE(encoder.threshold(5, 100) == 0);
+            auto records = cellularSnapshot();
+            encodeSnapshot(&encoder, records);
+            encoder.acknowledge();
+
+            WHEN("A data source fails to report its value")
+            {
+                setValue(&records, 5, (uint32_t)SYSTEM_ERROR_NOT_SUPPORTED);
+                for (auto& r: records)
+                {
+                    if (r.id == 5)
+                    {
+                        r.id |= 0x8000;
+                    }
+                }
+                const auto delta = encodeSnapshot(&encoder, records);
+
+                THEN("The error is published regardless of the threshold")
+                {
+                    CHECK(delta.size() == 4 + 6);
+                    uint16_t id = 0;
+                    memcpy(&id, delta.data() + 4, sizeof(id));
+                    CHECK(id == (5 | 0x8000));
+                }
+            }
+
+            WHEN("The data is malformed")
+            {
+                auto snapshot = binarySnapshot(records);
+                snapshot.resize(snapshot.size() - 1);
+                std::string out;
+
+                THEN("An error is returned")
+                {
+                    CHECK(encoder.encode(snapshot.data(), snapshot.size(), appendToString, &out) ==
+                          SYSTEM_ERROR_BAD_DATA);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,569 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "coap_blockwise.h"
+#include "protocol.h"
+
+#include "util/coap_message_channel.h"
+#include "util/protocol_stub.h"
+#include "util/descriptor_callbacks.h"
+
+#include "system_error.h"
+
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <deque>
+#include <map>
+#include <random>
+#include <cstdlib>
+
+namespace {
+
+using namespace particle;
+using namespace particle::protocol;
+using namespace particle::protocol::test;
+
+std::string randomData(size_t size, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::string s;
+    s.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+        s.push_back((char)(rng() & 0xff));
+    }
+    return s;
+}
+
+// Generates printable data that can be passed around as a C string
+std::string randomText(size_t size, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::string s;
+    s.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+        s.push_back('a' + rng() % 26);
+    }
+    return s;
+}
+
+// Descriptor callbacks that provide a large variable and record the function calls
+class LargeValueDescriptor: public DescriptorCallbacks {
+public:
+    std::string value;
+    std::vector<std::pair<std::string, std::string>> calls;
+
+    int callFunction(const char* key, const char* arg, SparkDescriptor::FunctionResultCallback callback,
+            void* reserved) override {
+        calls.push_back(std::make_pair(std::string(key), std::string(arg)));
+        callback((const void*)(intptr_t)calls.size(), SparkReturnType::INT);
+        return 0;
+    }
+
+    void getVariable(const char* key, SparkDescriptor::GetVariableCallback callback, void* context) override {
+        const auto data = (char*)malloc(value.size());
+        REQUIRE(data);
+        memcpy(data, value.data(), value.size());
+        callback(ProtocolError::NO_ERROR, SparkReturnType::STRING, data, value.size(), context);
+    }
+};
+
+void setResultCallback(int error, const void* data, void* callbackData, void* reserved) {
+    *(int*)callbackData = error;
+}
+
+// Passes a message from the server to the protocol instance
+void receiveMessage(ProtocolStub* proto, CoapMessageChannel* channel, CoapMessage msg) {
+    channel->sendMessage(std::move(msg));
+    CoAPMessageType::Enum type = CoAPMessageType::NONE;
+    REQUIRE(proto->event_loop(type) == ProtocolError::NO_ERROR);
+}
+
+unsigned blockNum(const CoapMessage& msg, CoapOption opt) {
+    return msg.option(opt).toUInt() >> 4;
+}
+
+// Link that drops and reorders messages
+class LossyLink {
+public:
+    LossyLink(double lossRate, system_tick_t maxLatency, unsigned seed) :
+            rng_(seed),
+            loss_(lossRate),
+            latency_(1, maxLatency) {
+    }
+
+    bool drop() {
+        return loss_(rng_);
+    }
+
+    system_tick_t latency() {
+        return latency_(rng_);
+    }
+
+private:
+    std::mt19937 rng_;
+    std::bernoulli_distribution loss_;
+    std::uniform_int_distribution<system_tick_t> latency_;
+};
+
+struct SimResult {
+    bool complete;
+    unsigned sent;
+    std::string data;
+};
+
+// Transfers the data from a sender to a receiver over a lossy link and returns the received data.
+// Unacknowledged messages are retransmitted with the same message ID, as done by the CoAP layer
+SimResult simulate(const std::string& data, size_t blockSize, unsigned windowSize, double lossRate, unsigned seed) {
+    struct BlockMsg {
+        system_tick_t time;
+        message_id_t id;
+        unsigned num;
+        bool more;
+        std::string data;
+    };
+    struct AckMsg {
+        system_tick_t time;
+        message_id_t id;
+    };
+    struct OutMsg {
+        BlockMsg msg;
+        system_tick_t timeout;
+        unsigned retransmits;
+    };
+    const system_tick_t ackTimeout = 200;
+    const unsigned maxRetransmit = 20;
+    LossyLink link(lossRate, ackTimeout / 4, seed);
+    BlockwiseSender sender;
+    REQUIRE(sender.init(data.data(), data.size(), blockSize, windowSize) == 0);
+    BlockwiseReceiver receiver;
+    receiver.init(data.size());
+    std::deque<BlockMsg> blocks;
+    std::deque<AckMsg> acks;
+    std::deque<OutMsg> outMsgs;
+    message_id_t nextId = 0;
+    unsigned sent = 0;
+    auto transmit = [&](const BlockMsg& msg, system_tick_t now) {
+        ++sent;
+        if (!link.drop()) {
+            blocks.push_back(msg);
+            blocks.back().time = now + link.latency();
+        }
+    };
+    for (system_tick_t now = 0; now < 100000 && !sender.isComplete(); now += 5) {
+        BlockwiseSender::Block b = {};
+        while (sender.nextBlock(&b)) {
+            const auto id = nextId++;
+            REQUIRE(sender.blockSent(b.num, id) == 0);
+            const BlockMsg msg = { now, id, b.num, b.more, std::string(b.data, b.size) };
+            outMsgs.push_back({ msg, now + ackTimeout, 0 });
+            transmit(msg, now);
+        }
+        for (auto it = blocks.begin(); it != blocks.end();) {
+            if (it->time > now) {
+                ++it;
+                continue;
+            }
+            REQUIRE(receiver.receiveBlock(it->num, blockSize, it->more, it->data.data(), it->data.size()) == 0);
+            if (!link.drop()) {
+                acks.push_back({ now + link.latency(), it->id });
+            }
+            it = blocks.erase(it);
+        }
+        for (auto it = acks.begin(); it != acks.end();) {
+            if (it->time > now) {
+                ++it;
+                continue;
+            }
+            for (auto m = outMsgs.begin(); m != outMsgs.end(); ++m) {
+                if (m->msg.id == it->id) {
+                    outMsgs.erase(m);
+                    break;
+                }
+            }
+            sender.ackReceived(it->id); // Acknowledgements of duplicate messages are ignored
+            it = acks.erase(it);
+        }
+        for (auto& m: outMsgs) {
+            if (now >= m.timeout) {
+                REQUIRE(m.retransmits < maxRetransmit);
+                ++m.retransmits;
+                m.timeout = now + (ackTimeout << std::min(m.retransmits, 4u));
+                transmit(m.msg, now);
+            }
+        }
+    }
+    SimResult r = {};
+    r.complete = sender.isComplete() && receiver.isComplete();
+    r.sent = sent;
+    if (receiver.isComplete()) {
+        r.data = std::string(receiver.data(), receiver.size());
+    }
+    return r;
+}
+
+} // namespace
+
+TEST_CASE("encodeBlockOption()/decodeBlockOption()") {
+    SECTION("round-trips all valid block sizes") {
+        for (size_t size = COAP_MIN_BLOCK_SIZE; size <= COAP_MAX_BLOCK_SIZE; size <<= 1) {
+            const auto opt = encodeBlockOption(1234, size, true);
+            unsigned num = 0;
+            size_t sz = 0;
+            bool more = false;
+            CHECK(decodeBlockOption(opt, &num, &sz, &more));
+            CHECK(num == 1234);
+            CHECK(sz == size);
+            CHECK(more);
+        }
+    }
+
+    SECTION("encodes the option fields as defined by RFC 7959") {
+        CHECK(encodeBlockOption(0, 16, false) == 0x00);
+        CHECK(encodeBlockOption(0, 1024, true) == 0x0e);
+        CHECK(encodeBlockOption(3, 512, false) == 0x35);
+    }
+
+    SECTION("rejects the reserved block size") {
+        unsigned num = 0;
+        size_t size = 0;
+        bool more = false;
+        CHECK(!decodeBlockOption(0x07, &num, &size, &more));
+    }
+}
+
+TEST_CASE("blockSizeForMessageSize()") {
+    CHECK(blockSizeForMessageSize(1100, 50) == 1024);
+    CHECK(blockSizeForMessageSize(1073, 50) == 512);
+    CHECK(blockSizeForMessageSize(600, 50) == 512);
+    CHECK(blockSizeForMessageSize(60, 50) == 0);
+}
+
+TEST_CASE("BlockwiseSender") {
+    BlockwiseSender sender;
+    const auto data = randomData(1000, 1);
+
+    SECTION("splits the data into blocks") {
+        REQUIRE(sender.init(data.data(), data.size(), 256, 10) == 0);
+        CHECK(sender.blockCount() == 4);
+        std::string out;
+        BlockwiseSender::Block b = {};
+        unsigned n = 0;
+        while (sender.nextBlock(&b)) {
+            CHECK(b.num == n);
+            CHECK(b.more == (n != 3));
+            out.append(b.data, b.size);
+            REQUIRE(sender.blockSent(b.num, 100 + n) == 0);
+            ++n;
+        }
+        CHECK(n == 4);
+        CHECK(out == data);
+    }
+
+    SECTION("limits the number of blocks in flight") {
+        REQUIRE(sender.init(data.data(), data.size(), 128, 3) == 0);
+        BlockwiseSender::Block b = {};
+        for (unsigned i = 0; i < 3; ++i) {
+            REQUIRE(sender.nextBlock(&b));
+            REQUIRE(sender.blockSent(b.num, i) == 0);
+        }
+        CHECK(sender.blocksInFlight() == 3);
+        CHECK(!sender.nextBlock(&b));
+        // Acknowledgements can arrive out of order
+        CHECK(sender.ackReceived(2) == 2);
+        REQUIRE(sender.nextBlock(&b));
+        CHECK(b.num == 3);
+        CHECK(sender.ackReceived(2) == SYSTEM_ERROR_NOT_FOUND);
+    }
+
+    SECTION("doesn't send a block again") {
+        REQUIRE(sender.init(data.data(), data.size(), 512, 2) == 0);
+        BlockwiseSender::Block b = {};
+        REQUIRE(sender.nextBlock(&b));
+        REQUIRE(sender.blockSent(b.num, 10) == 0);
+        REQUIRE(sender.nextBlock(&b));
+        REQUIRE(sender.blockSent(b.num, 11) == 0);
+        CHECK(!sender.nextBlock(&b));
+        CHECK(sender.blockSent(0, 12) == SYSTEM_ERROR_INVALID_STATE);
+        CHECK(sender.ackReceived(10) == 0);
+        CHECK(sender.ackReceived(10) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(!sender.nextBlock(&b));
+    }
+
+    SECTION("completes when all blocks are acknowledged") {
+        REQUIRE(sender.init(data.data(), data.size(), 512, 2) == 0);
+        BlockwiseSender::Block b = {};
+        message_id_t id = 0;
+        while (sender.nextBlock(&b)) {
+            REQUIRE(sender.blockSent(b.num, id++) == 0);
+        }
+        CHECK(!sender.isComplete());
+        CHECK(sender.ackReceived(1) == 1);
+        CHECK(sender.ackReceived(0) == 0);
+        CHECK(sender.isComplete());
+    }
+}
+
+TEST_CASE("BlockwiseReceiver") {
+    BlockwiseReceiver receiver;
+    const auto data = randomData(600, 2);
+    receiver.init(1024);
+
+    SECTION("reassembles blocks received out of order") {
+        REQUIRE(receiver.receiveBlock(2, 256, false, data.data() + 512, 88) == 0);
+        CHECK(!receiver.isComplete());
+        REQUIRE(receiver.receiveBlock(0, 256, true, data.data(), 256) == 0);
+        CHECK(!receiver.isComplete());
+        REQUIRE(receiver.receiveBlock(1, 256, true, data.data() + 256, 256) == 0);
+        CHECK(receiver.isComplete());
+        CHECK(std::string(receiver.data(), receiver.size()) == data);
+    }
+
+    SECTION("reports the received blocks") {
+        REQUIRE(receiver.receiveBlock(1, 256, true, data.data() + 256, 256) == 0);
+        CHECK(receiver.hasBlock(1));
+        CHECK(!receiver.hasBlock(0));
+        CHECK(!receiver.hasBlock(2));
+    }
+
+    SECTION("ignores duplicate blocks") {
+        REQUIRE(receiver.receiveBlock(0, 512, true, data.data(), 512) == 0);
+        REQUIRE(receiver.receiveBlock(0, 512, true, data.data(), 512) == 0);
+        CHECK(!receiver.isComplete());
+        REQUIRE(receiver.receiveBlock(1, 512, false, data.data() + 512, 88) == 0);
+        CHECK(receiver.isComplete());
+        CHECK(receiver.size() == data.size());
+    }
+
+    SECTION("rejects a block that doesn't match the transfer") {
+        REQUIRE(receiver.receiveBlock(0, 256, true, data.data(), 256) == 0);
+        CHECK(receiver.receiveBlock(1, 512, true, data.data(), 512) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(receiver.receiveBlock(1, 256, true, data.data(), 100) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        REQUIRE(receiver.receiveBlock(1, 256, false, data.data(), 100) == 0);
+        CHECK(receiver.receiveBlock(2, 256, false, data.data(), 100) == SYSTEM_ERROR_INVALID_ARGUMENT);
+    }
+
+    SECTION("rejects data exceeding the maximum size") {
+        CHECK(receiver.receiveBlock(4, 256, true, data.data(), 256) == SYSTEM_ERROR_TOO_LARGE);
+        CHECK(receiver.receiveBlock(3, 256, true, data.data(), 256) == 0);
+    }
+
+    SECTION("can be reused after taking the data") {
+        REQUIRE(receiver.receiveBlock(0, 1024, false, data.data(), data.size()) == 0);
+        CHECK(receiver.isComplete());
+        auto d = receiver.takeData();
+        CHECK(std::string(d.data(), d.size()) == data);
+        CHECK(!receiver.isComplete());
+    }
+}
+
+TEST_CASE("Blockwise transfer over a lossy link") {
+    const auto data = randomData(MAX_BLOCKWISE_DATA_LENGTH, 3);
+
+    SECTION("transfers the data without loss") {
+        for (unsigned window: { 1, 4 }) {
+            const auto r = simulate(data, 512, window, 0.0, 10);
+            REQUIRE(r.complete);
+            CHECK(r.data == data);
+            CHECK(r.sent == data.size() / 512);
+        }
+    }
+
+    SECTION("transfers the data despite lost and reordered messages") {
+        for (double loss: { 0.05, 0.15, 0.3 }) {
+            for (unsigned window: { 1, 4, 8 }) {
+                for (unsigned seed = 0; seed < 5; ++seed) {
+                    CAPTURE(loss, window, seed);
+                    const auto r = simulate(data, 1024, window, loss, seed);
+                    REQUIRE(r.complete);
+                    CHECK(r.data == data);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Blockwise events over a lossy link") {
+    CoapMessageChannel channel;
+    ProtocolStub proto(&channel);
+    proto.set_blockwise_transfers_enabled(true);
+    const auto data = randomText(8 * 1024, 4);
+    int result = 1;
+    REQUIRE(proto.send_event("abc", data.c_str(), 60, EventType::PRIVATE, EventType::WITH_ACK,
+            CompletionHandler(setResultCallback, &result)));
+    std::map<unsigned, CoapMessage> blocks; // Block messages received by the server
+    std::deque<CoapMessageId> unacked;
+    auto receiveBlocks = [&]() {
+        while (channel.hasMessages()) {
+            const auto m = channel.receiveMessage();
+            REQUIRE(m.type() == CoapType::CON);
+            REQUIRE(m.hasOption(CoapOption::BLOCK1));
+            const unsigned num = blockNum(m, CoapOption::BLOCK1);
+            REQUIRE(blocks.count(num) == 0); // A block is never sent again in a new message
+            blocks[num] = m;
+            unacked.push_back(m.id());
+        }
+    };
+    auto ack = [&](CoapMessageId id) {
+        receiveMessage(&proto, &channel, CoapMessage().type(CoapType::ACK).code(CoapCode::CONTINUE).id(id));
+    };
+    receiveBlocks();
+    REQUIRE(unacked.size() == BLOCKWISE_WINDOW_SIZE);
+
+    // The ACK for the first block is lost. The other blocks are acknowledged
+    const auto lostId = unacked.front();
+    unacked.pop_front();
+    for (unsigned i = 0; i < 3; ++i) {
+        const auto id = unacked.front();
+        unacked.pop_front();
+        ack(id);
+        receiveBlocks();
+    }
+    // The block is not sent again by the publisher, however long its acknowledgement takes. The
+    // CoAP layer retransmits the original message instead
+    proto.callbacks()->addMillis(30000);
+    CoAPMessageType::Enum type = CoAPMessageType::NONE;
+    REQUIRE(proto.event_loop(type) == ProtocolError::NO_ERROR);
+    receiveBlocks();
+    CHECK(unacked.size() == BLOCKWISE_WINDOW_SIZE - 1);
+    CHECK(result == 1);
+
+    // The retransmitted message gets acknowledged. A duplicate ACK is ignored
+    ack(lostId);
+    ack(lostId);
+    receiveBlocks();
+    while (!unacked.empty()) {
+        const auto id = unacked.front();
+        unacked.pop_front();
+        ack(id);
+        receiveBlocks();
+    }
+    CHECK(result == 0);
+    std::string out;
+    for (unsigned i = 0; i < blocks.size(); ++i) {
+        REQUIRE(blocks.count(i) == 1);
+        out += blocks[i].payload();
+    }
+    CHECK(out == data);
+}
+
+TEST_CASE("Blockwise variable values over a lossy link") {
+    CoapMessageChannel channel;
+    ProtocolStub proto(&channel);
+    LargeValueDescriptor desc; // Replaces the callbacks of the protocol instance
+    desc.value = randomText(4000, 5);
+    proto.set_blockwise_transfers_enabled(true);
+    const std::string token("\x01", 1);
+    CoapMessageId nextId = 100;
+    auto request = [&](unsigned num, size_t blockSize) {
+        auto m = CoapMessage().type(CoapType::CON).code(CoapCode::GET).id(nextId++).token(token)
+                .option(CoapOption::URI_PATH, "v").option(CoapOption::URI_PATH, "big");
+        if (num > 0) {
+            m.option(CoapOption::BLOCK2, encodeBlockOption(num, blockSize, false /* more */));
+        }
+        receiveMessage(&proto, &channel, m);
+    };
+
+    request(0, 0);
+    auto m = channel.receiveMessage();
+    CHECK(m.type() == CoapType::ACK); // Empty ACK
+    m = channel.receiveMessage();
+    REQUIRE(m.code() == (unsigned)CoapCode::CONTENT);
+    REQUIRE(m.hasOption(CoapOption::BLOCK2));
+    unsigned num = 0;
+    size_t blockSize = 0;
+    bool more = false;
+    REQUIRE(decodeBlockOption(m.option(CoapOption::BLOCK2).toUInt(), &num, &blockSize, &more));
+    REQUIRE(num == 0);
+    REQUIRE(more);
+    std::string out = m.payload();
+    for (num = 1; more; ++num) {
+        request(num, blockSize);
+        m = channel.receiveMessage();
+        if (num == 1) {
+            // The response is lost. The server requests the block again in a new message
+            const auto lost = m;
+            request(num, blockSize);
+            m = channel.receiveMessage();
+            CHECK(m.payload() == lost.payload());
+        }
+        REQUIRE(m.type() == CoapType::ACK);
+        REQUIRE(m.code() == (unsigned)CoapCode::CONTENT);
+        REQUIRE(blockNum(m, CoapOption::BLOCK2) == num);
+        more = m.option(CoapOption::BLOCK2).toUInt() & 0x08;
+        out += m.payload();
+    }
+    CHECK(out == desc.value);
+    CHECK(!channel.hasMessages());
+}
+
+TEST_CASE("Blockwise function arguments over a lossy link") {
+    CoapMessageChannel channel;
+    ProtocolStub proto(&channel);
+    LargeValueDescriptor desc; // Replaces the callbacks of the protocol instance
+    proto.set_blockwise_transfers_enabled(true);
+    const auto arg = randomText(3000, 6);
+    const size_t blockSize = 512;
+    const unsigned blockCount = (arg.size() + blockSize - 1) / blockSize;
+    const std::string token("\x02", 1);
+    CoapMessageId nextId = 200;
+    auto sendBlock = [&](unsigned num) {
+        const size_t offs = num * blockSize;
+        const bool more = num + 1 < blockCount;
+        receiveMessage(&proto, &channel, CoapMessage().type(CoapType::CON).code(CoapCode::POST).id(nextId++)
+                .token(token).option(CoapOption::URI_PATH, "f").option(CoapOption::URI_PATH, "fn")
+                .option(CoapOption::BLOCK1, encodeBlockOption(num, blockSize, more))
+                .payload(arg.substr(offs, blockSize)));
+    };
+    auto receiveAck = [&](CoapCode code) {
+        const auto m = channel.receiveMessage();
+        CHECK(m.type() == CoapType::ACK);
+        CHECK(m.code() == (unsigned)code);
+    };
+
+    SECTION("the argument is reassembled from blocks received out of order") {
+        // Block 1 is lost and arrives after the server has resent it, block 0 is delayed
+        for (unsigned num = 2; num < blockCount; ++num) {
+            sendBlock(num);
+            receiveAck(CoapCode::CONTINUE);
+        }
+        CHECK(desc.calls.empty());
+        sendBlock(0);
+        receiveAck(CoapCode::CONTINUE);
+        CHECK(desc.calls.empty());
+        sendBlock(1);
+        receiveAck(CoapCode::EMPTY);
+        REQUIRE(desc.calls.size() == 1);
+        CHECK(desc.calls[0].first == "fn");
+        CHECK(desc.calls[0].second == arg);
+        const auto m = channel.receiveMessage(); // Separate response
+        CHECK(m.type() == CoapType::CON);
+        CHECK(m.token() == token);
+        CHECK(!channel.hasMessages());
+    }
+
+    SECTION("the call is restarted when the server sends the first block again") {
+        sendBlock(0);
+        receiveAck(CoapCode::CONTINUE);
+        sendBlock(1);
+        receiveAck(CoapCode::CONTINUE);
+        for (unsigned num = 0; num < blockCount; ++num) {
+            sendBlock(num);
+            receiveAck(num + 1 < blockCount ? CoapCode::CONTINUE : CoapCode::EMPTY);
+        }
+        REQUIRE(desc.calls.size() == 1);
+        CHECK(desc.calls[0].second == arg);
+    }
+}
@@ -18,6 +18,8 @@
  */
 
 #include <climits>
+#include <random>
+#include <vector>
 
 #include "coap_channel.h"
 #include "forward_message_channel.h"
@@ -1253,3 +1255,316 @@ SCENARIO("notify_client_messages_processed() is invoked when all client messages
 		}
 	}
 }
+
+SCENARIO("the RTT estimator combines strong and weak round-trip times")
+{
+	GIVEN("a new estimator")
+	{
+		CoapRttEstimator rtt;
+		REQUIRE(!rtt.hasEstimate());
+		REQUIRE(rtt.rto(0)==CoapRttEstimator::DEFAULT_RTO);
+
+		WHEN("a message is acknowledged without retransmissions")
+		{
+			rtt.update(100, 1, 0);
+			THEN("the strong estimate moves the RTO halfway")
+			{
+				REQUIRE(rtt.hasEstimate());
+				REQUIRE(rtt.strongSamples()==1);
+				// RTO(strong) = 100 + 4 * 50
+				REQUIRE(rtt.rto(0)==(300+CoapRttEstimator::DEFAULT_RTO)/2);
+			}
+		}
+
+		WHEN("a message is acknowledged after a retransmission")
+		{
+			rtt.update(1000, 2, 0);
+			THEN("the weak estimate moves the RTO by a quarter")
+			{
+				REQUIRE(rtt.weakSamples()==1);
+				// RTO(weak) = 1000 + 1 * 500
+				REQUIRE(rtt.rto(0)==(1500+CoapRttEstimator::DEFAULT_RTO*3)/4);
+			}
+		}
+
+		WHEN("a message is acknowledged after too many retransmissions")
+		{
+			rtt.update(1000, CoapRttEstimator::MAX_WEAK_RETRANSMITS+2, 0);
+			THEN("the round-trip time is ignored")
+			{
+				REQUIRE(!rtt.hasEstimate());
+				REQUIRE(rtt.rto(0)==CoapRttEstimator::DEFAULT_RTO);
+			}
+		}
+
+		WHEN("the round-trip times are short")
+		{
+			for (int i=0; i<20; i++)
+				rtt.update(20, 1, 0);
+			THEN("the RTO is limited to MIN_RTO")
+			{
+				REQUIRE(rtt.rto(0)==CoapRttEstimator::MIN_RTO);
+
+				AND_WHEN("no round-trip times are measured for a while")
+				{
+					THEN("the RTO is doubled")
+					{
+						REQUIRE(rtt.rto(CoapRttEstimator::MIN_RTO*16-1)==CoapRttEstimator::MIN_RTO);
+						REQUIRE(rtt.rto(CoapRttEstimator::MIN_RTO*16)==CoapRttEstimator::MIN_RTO*2);
+						REQUIRE(rtt.rto(1000000)==CoapRttEstimator::MIN_RTO*2);
+					}
+				}
+			}
+		}
+
+		WHEN("the round-trip times are long")
+		{
+			for (int i=0; i<20; i++)
+				rtt.update(20000, 1, 0);
+			THEN("the RTO is limited to MAX_RTO")
+			{
+				REQUIRE(rtt.rto(0)==CoapRttEstimator::MAX_RTO);
+
+				AND_WHEN("no round-trip times are measured for a while")
+				{
+					THEN("the RTO moves towards 1 second")
+					{
+						REQUIRE(rtt.rto(CoapRttEstimator::MAX_RTO*4)==1000+CoapRttEstimator::MAX_RTO/2);
+						REQUIRE(rtt.rto(1000000)<=3000);
+					}
+				}
+			}
+		}
+
+		WHEN("the estimator is reset")
+		{
+			rtt.update(100, 1, 0);
+			rtt.reset();
+			THEN("it has no estimate")
+			{
+				REQUIRE(!rtt.hasEstimate());
+				REQUIRE(rtt.rto(0)==CoapRttEstimator::DEFAULT_RTO);
+			}
+		}
+	}
+}
+
+SCENARIO("the backoff factor depends on the initial timeout")
+{
+	REQUIRE(CoapRttEstimator::backoff(900, 900)==2700);
+	REQUIRE(CoapRttEstimator::backoff(2000, 2000)==4000);
+	REQUIRE(CoapRttEstimator::backoff(4000, 4000)==6000);
+	REQUIRE(CoapRttEstimator::backoff(6000, 4000)==9000);
+}
+
+/**
+ * A channel that simulates a link with latency and packet loss. Each transmission is either lost
+ * or acknowledged after a random delay.
+ */
+class SimulatedLinkChannel : public Channel
+{
+	struct Ack
+	{
+		system_tick_t time;
+		message_id_t id;
+	};
+
+	struct Transmissions
+	{
+		unsigned count;
+		bool delivered;
+	};
+
+	std::vector<Ack> acks;
+	std::vector<Transmissions> transmissions;
+	system_tick_t min_latency;
+	system_tick_t max_latency;
+	unsigned loss_percent;
+
+public:
+	system_tick_t now;
+	unsigned retransmissions;
+	unsigned spurious_retransmissions;
+
+	SimulatedLinkChannel(system_tick_t min_latency, system_tick_t max_latency, unsigned loss_percent) :
+			min_latency(min_latency), max_latency(max_latency), loss_percent(loss_percent),
+			now(0), retransmissions(0), spurious_retransmissions(0)
+	{
+	}
+
+	ProtocolError send(Message& msg) override
+	{
+		const message_id_t id = msg.get_id();
+		if (transmissions.size()<=id)
+			transmissions.resize(id+1, Transmissions());
+		Transmissions& t = transmissions[id];
+		if (t.count>0)
+		{
+			retransmissions++;
+			// the message would have been acknowledged without this retransmission
+			if (t.delivered)
+				spurious_retransmissions++;
+		}
+		// the network conditions depend only on the message and the transmission number,
+		// so that different retransmission strategies see the same link
+		std::minstd_rand rng((id << 8) + t.count + 1);
+		t.count++;
+		if (rng()%100<loss_percent)
+			return NO_ERROR;
+		t.delivered = true;
+		acks.push_back({ now + min_latency + (system_tick_t)(rng()%(max_latency-min_latency+1)), id });
+		return NO_ERROR;
+	}
+
+	ProtocolError receive(Message& msg) override
+	{
+		msg.set_length(0);
+		return NO_ERROR;
+	}
+
+	ProtocolError command(Command cmd, void* arg) override
+	{
+		return NO_ERROR;
+	}
+
+	/**
+	 * Passes the acknowledgements that have arrived to the message store.
+	 */
+	void deliver(CoAPMessageStore& store)
+	{
+		for (auto it = acks.begin(); it!=acks.end();)
+		{
+			if (it->time<=now)
+			{
+				uint8_t buf[4];
+				Message ack(buf, sizeof(buf), Messages::empty_ack(buf, it->id >> 8, it->id & 0xff));
+				store.receive(ack, *this, now);
+				it = acks.erase(it);
+			}
+			else
+				++it;
+		}
+	}
+};
+
+struct SimulationResult
+{
+	system_tick_t completion_time;
+	unsigned retransmissions;
+	unsigned spurious_retransmissions;
+	unsigned timeouts;
+};
+
+/**
+ * Sends confirmable messages one at a time over the simulated link.
+ *
+ * @param adaptive When false, the estimator is reset after each exchange so that the fixed
+ * 		timeouts are used.
+ */
+SimulationResult simulate_exchanges(SimulatedLinkChannel& link, unsigned count, bool adaptive)
+{
+	srand(1);
+	CoAPMessageStore store;
+	SimulationResult result = {};
+	for (unsigned i=1; i<=count; i++)
+	{
+		uint8_t buf[4] = { 0x40, 0x00, (uint8_t)(i >> 8), (uint8_t)(i & 0xff) };
+		Message msg(buf, sizeof(buf), sizeof(buf));
+		msg.decode_id();
+		REQUIRE(store.send(msg, link.now)==NO_ERROR);
+		link.send(msg);
+		while (store.has_messages())
+		{
+			link.now++;
+			link.deliver(store);
+			if (store.has_messages())
+			{
+				const unsigned remaining = CoAPMessage::messages();
+				store.process(link.now, link);
+				if (CoAPMessage::messages()<remaining)
+					result.timeouts++;
+			}
+		}
+		if (!adaptive)
+			store.rtt_estimator().reset();
+	}
+	result.completion_time = link.now;
+	result.retransmissions = link.retransmissions;
+	result.spurious_retransmissions = link.spurious_retransmissions;
+	return result;
+}
+
+SCENARIO("the retransmission timeout adapts to the round-trip time of the link")
+{
+	GIVEN("a fast link that loses some packets")
+	{
+		SimulatedLinkChannel fixed_link(20, 80, 10);
+		SimulatedLinkChannel adaptive_link(20, 80, 10);
+		const SimulationResult fixed = simulate_exchanges(fixed_link, 100, false);
+		const SimulationResult adaptive = simulate_exchanges(adaptive_link, 100, true);
+
+		THEN("lost messages are retransmitted sooner")
+		{
+			REQUIRE(fixed.retransmissions>0);
+			REQUIRE(fixed.timeouts==0);
+			REQUIRE(adaptive.timeouts==0);
+			REQUIRE(adaptive.completion_time*2<fixed.completion_time);
+			REQUIRE(adaptive.spurious_retransmissions==0);
+		}
+	}
+
+	GIVEN("a congested link with long round-trip times")
+	{
+		SimulatedLinkChannel fixed_link(3000, 6000, 0);
+		SimulatedLinkChannel adaptive_link(3000, 6000, 0);
+		const SimulationResult fixed = simulate_exchanges(fixed_link, 50, false);
+		const SimulationResult adaptive = simulate_exchanges(adaptive_link, 50, true);
+
+		THEN("fewer messages are retransmitted spuriously")
+		{
+			REQUIRE(fixed.spurious_retransmissions>0);
+			REQUIRE(adaptive.spurious_retransmissions*4<fixed.spurious_retransmissions);
+			REQUIRE(adaptive.completion_time<=fixed.completion_time*11/10);
+		}
+	}
+}
+
+SCENARIO("messages are retransmitted within MAX_TRANSMIT_SPAN regardless of the estimated RTO")
+{
+	GIVEN("a message store whose RTO has reached MAX_RTO")
+	{
+		srand(1);
+		SimulatedLinkChannel link(0, 0, 100);
+		CoAPMessageStore store;
+		for (int i=0; i<20; i++)
+			store.rtt_estimator().update(60000, 1, 0);
+		REQUIRE(store.rtt_estimator().rto(0)==CoapRttEstimator::MAX_RTO);
+
+		WHEN("a message is never acknowledged")
+		{
+			uint8_t buf[4] = { 0x40, 0x00, 0x00, 0x01 };
+			Message msg(buf, sizeof(buf), sizeof(buf));
+			msg.decode_id();
+			REQUIRE(store.send(msg, 0)==NO_ERROR);
+			link.send(msg);
+			CoAPMessage* cm = store.from_id(1);
+			REQUIRE(cm->get_initial_timeout()>=CoapRttEstimator::MAX_RTO);
+			system_tick_t last_retransmission = 0;
+			while (store.has_messages())
+			{
+				const system_tick_t timeout = store.from_id(1)->get_timeout();
+				const unsigned sent = link.retransmissions;
+				link.now = timeout;
+				store.process(link.now, link);
+				if (link.retransmissions>sent)
+					last_retransmission = link.now;
+			}
+
+			THEN("the last retransmission happens within MAX_TRANSMIT_SPAN")
+			{
+				REQUIRE(link.retransmissions==CoAPMessage::MAX_RETRANSMIT+0);
+				REQUIRE(last_retransmission<=CoAPMessage::MAX_TRANSMIT_SPAN+0);
+			}
+		}
+	}
+}
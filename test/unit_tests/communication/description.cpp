@@ -180,6 +180,10 @@ public:
         return Mock<DescriptorCallbacks>(*proto_.descriptor());
     }
 
+    Mock<CoapMessageChannel> channelMock() {
+        return Mock<CoapMessageChannel>(channel_);
+    }
+
     ProtocolStub* protocol() {
         return &proto_;
     }
@@ -541,4 +545,24 @@ TEST_CASE("Description") {
         CHECK(m.option(CoapOption::BLOCK2).toUInt() == BlockOption().index(0).more(true));
         d.sendMessage(CoapMessage().type(CoapType::ACK).code(CoapCode::EMPTY).id(m.id()));
     }
+
+    SECTION("notifies the system when a metrics Describe request could not be sent") {
+        When(Method(cb, appendMetrics)).AlwaysDo([](appender_fn append, void* arg, uint32_t flags, uint32_t page, void* reserved) {
+            auto s = std::string(100, 'a');
+            append(arg, (const uint8_t*)s.data(), s.size());
+            return true;
+        });
+        When(Method(cb, appStateSelectorInfo)).AlwaysReturn(0);
+        d.protocol()->descriptor()->appStateSelectorInfoEnabled(true);
+        // The request is sent successfully
+        CHECK(d.get()->sendRequest(DescriptionType::DESCRIBE_METRICS) == ProtocolError::NO_ERROR);
+        d.skipMessages(1);
+        Verify(Method(cb, appStateSelectorInfo)).Never();
+        // The request could not be sent
+        auto ch = d.channelMock();
+        When(Method(ch, send)).Return(ProtocolError::IO_ERROR);
+        CHECK(d.get()->sendRequest(DescriptionType::DESCRIBE_METRICS) == ProtocolError::IO_ERROR);
+        Verify(Method(cb, appStateSelectorInfo).Using(SparkAppStateSelector::DESCRIBE_METRICS,
+                SparkAppStateUpdate::RESET, 0, _)).Once();
+    }
 }
@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "outbound_scheduler.h"
+#include "description.h"
+#include "protocol.h"
+
+#include "util/coap_message_channel.h"
+#include "util/protocol_stub.h"
+
+#include <catch2/catch.hpp>
+
+#include <string>
+
+namespace {
+
+using namespace particle;
+using namespace particle::protocol;
+using namespace particle::protocol::test;
+
+struct SimulationResult {
+    unsigned system;
+    unsigned application;
+};
+
+// Simulates a system and an application producer that always have a message to send, over a window
+// of one message. When a message is acknowledged, its producer asks to send the next message first,
+// and then both producers are polled by the idle loop
+SimulationResult simulate(OutboundScheduler* sched, unsigned rounds, size_t sysMsgSize, size_t appMsgSize) {
+    SimulationResult result = {};
+    message_id_t lastId = 0;
+    OutboundClass lastCls = OutboundClass::APPLICATION;
+    system_tick_t now = 0;
+    auto trySend = [&](OutboundClass cls) {
+        if (!sched->acquire(cls, now)) {
+            return;
+        }
+        const bool sys = (cls == OutboundClass::SYSTEM);
+        sched->sent(cls, ++lastId, sys ? sysMsgSize : appMsgSize, true /* confirmable */, now);
+        lastCls = cls;
+        ++(sys ? result.system : result.application);
+    };
+    sched->windowSize(1);
+    trySend(OutboundClass::APPLICATION);
+    for (unsigned i = 0; i < rounds; ++i) {
+        now += 10;
+        sched->completed(lastId);
+        trySend(lastCls);
+        trySend(OutboundClass::SYSTEM);
+        trySend(OutboundClass::APPLICATION);
+    }
+    return result;
+}
+
+// Describe callbacks that produce system info that needs a blockwise transfer
+class LargeSystemInfo: public DescriptorCallbacks {
+public:
+    bool appendSystemInfo(appender_fn append, void* arg, void* reserved) override {
+        const std::string s(PROTOCOL_BUFFER_SIZE * 2, 'a');
+        return append(arg, (const uint8_t*)s.data(), s.size());
+    }
+};
+
+} // namespace
+
+TEST_CASE("OutboundScheduler") {
+    OutboundScheduler sched;
+
+    SECTION("doesn't defer messages when there's no contention") {
+        for (message_id_t id = 1; id <= 3; ++id) {
+            REQUIRE(sched.acquire(OutboundClass::SYSTEM, 0));
+            sched.sent(OutboundClass::SYSTEM, id, 100, true, 0);
+        }
+        REQUIRE(sched.acquire(OutboundClass::APPLICATION, 0));
+        sched.sent(OutboundClass::APPLICATION, 4, 100, true, 0);
+        CHECK(sched.inFlight(OutboundClass::SYSTEM) == 3);
+        CHECK(sched.inFlight(OutboundClass::APPLICATION) == 1);
+        CHECK(sched.stats(OutboundClass::SYSTEM).sent == 3);
+        CHECK(sched.stats(OutboundClass::SYSTEM).deferred == 0);
+        CHECK(sched.stats(OutboundClass::APPLICATION).maxQueueTime == 0);
+        sched.completed(2);
+        sched.completed(4);
+        CHECK(sched.inFlight(OutboundClass::SYSTEM) == 2);
+        CHECK(sched.inFlight(OutboundClass::APPLICATION) == 0);
+    }
+
+    SECTION("defers messages while the window is full") {
+        sched.windowSize(2);
+        sched.sent(OutboundClass::APPLICATION, 1, 100, true, 0);
+        sched.sent(OutboundClass::SYSTEM, 2, 100, true, 0);
+        CHECK(!sched.acquire(OutboundClass::APPLICATION, 100));
+        CHECK(!sched.acquire(OutboundClass::APPLICATION, 200));
+        CHECK(sched.stats(OutboundClass::APPLICATION).deferred == 1);
+        sched.completed(2);
+        REQUIRE(sched.acquire(OutboundClass::APPLICATION, 300));
+        sched.sent(OutboundClass::APPLICATION, 3, 100, true, 300);
+        CHECK(sched.stats(OutboundClass::APPLICATION).maxQueueTime == 200);
+        CHECK(sched.stats(OutboundClass::APPLICATION).totalQueueTime == 200);
+    }
+
+    SECTION("never defers control messages") {
+        sched.windowSize(1);
+        sched.sent(OutboundClass::APPLICATION, 1, 100, true, 0);
+        CHECK(!sched.acquire(OutboundClass::SYSTEM, 0));
+        CHECK(sched.acquire(OutboundClass::CONTROL, 0));
+        sched.sent(OutboundClass::CONTROL, 2, 4, true, 0);
+        // Control messages don't count towards the window
+        sched.completed(1);
+        CHECK(sched.acquire(OutboundClass::SYSTEM, 0));
+        CHECK(sched.stats(OutboundClass::CONTROL).deferred == 0);
+    }
+
+    SECTION("doesn't count non-confirmable messages") {
+        sched.windowSize(1);
+        sched.sent(OutboundClass::APPLICATION, 1, 100, false, 0);
+        CHECK(sched.inFlight(OutboundClass::APPLICATION) == 0);
+        CHECK(sched.acquire(OutboundClass::APPLICATION, 0));
+    }
+
+    SECTION("limits the number of messages in flight per class") {
+        sched.configure(OutboundClass::APPLICATION, 1, 1);
+        sched.sent(OutboundClass::APPLICATION, 1, 100, true, 0);
+        CHECK(!sched.acquire(OutboundClass::APPLICATION, 0));
+        // The class that reached its limit doesn't hold back the other classes
+        CHECK(sched.acquire(OutboundClass::SYSTEM, 0));
+    }
+
+    SECTION("shares the bandwidth according to the class weights") {
+        auto r = simulate(&sched, 300, 100, 100);
+        CHECK(r.system + r.application == 301);
+        CHECK(r.system >= 198);
+        CHECK(r.system <= 202);
+        // Equal weights
+        OutboundScheduler sched2;
+        sched2.configure(OutboundClass::SYSTEM, 1, 0);
+        r = simulate(&sched2, 300, 100, 100);
+        CHECK(r.system >= 148);
+        CHECK(r.system <= 152);
+        // The share is based on the message sizes
+        OutboundScheduler sched3;
+        r = simulate(&sched3, 300, 400, 100);
+        CHECK(r.system * 2 >= r.application - 4);
+        CHECK(r.system * 2 <= r.application + 4);
+    }
+
+    SECTION("gives the freed slot to the waiting class with the smaller start tag") {
+        sched.windowSize(1);
+        sched.sent(OutboundClass::APPLICATION, 1, 100, true, 0);
+        CHECK(!sched.acquire(OutboundClass::SYSTEM, 0));
+        sched.completed(1);
+        // The application class has already used its share
+        CHECK(!sched.acquire(OutboundClass::APPLICATION, 10));
+        CHECK(sched.acquire(OutboundClass::SYSTEM, 10));
+    }
+
+    SECTION("stops waiting for a producer that no longer asks to send") {
+        sched.windowSize(1);
+        sched.sent(OutboundClass::APPLICATION, 1, 100, true, 0);
+        CHECK(!sched.acquire(OutboundClass::SYSTEM, 0));
+        sched.completed(1);
+        const auto t = OutboundScheduler::WAIT_TIMEOUT;
+        CHECK(!sched.acquire(OutboundClass::APPLICATION, t - 1));
+        CHECK(sched.acquire(OutboundClass::APPLICATION, t));
+        // Same if the producer has cancelled sending
+        sched.sent(OutboundClass::APPLICATION, 2, 100, true, t);
+        CHECK(!sched.acquire(OutboundClass::SYSTEM, t));
+        sched.completed(2);
+        sched.cancel(OutboundClass::SYSTEM);
+        CHECK(sched.acquire(OutboundClass::APPLICATION, t));
+    }
+
+    SECTION("stops tracking messages that are not acknowledged in time") {
+        sched.windowSize(1);
+        sched.sent(OutboundClass::SYSTEM, 1, 100, true, 1000);
+        CHECK(!sched.acquire(OutboundClass::SYSTEM, 1000 + OutboundScheduler::IN_FLIGHT_TIMEOUT - 1));
+        CHECK(sched.acquire(OutboundClass::SYSTEM, 1000 + OutboundScheduler::IN_FLIGHT_TIMEOUT));
+        CHECK(sched.inFlight(OutboundClass::SYSTEM) == 0);
+    }
+
+    SECTION("doesn't track more than the maximum number of messages") {
+        sched.windowSize(0);
+        for (unsigned i = 0; i < OutboundScheduler::MAX_TRACKED_MESSAGES + 2; ++i) {
+            sched.sent(OutboundClass::APPLICATION, i, 100, true, 0);
+        }
+        CHECK(sched.inFlight(OutboundClass::APPLICATION) == OutboundScheduler::MAX_TRACKED_MESSAGES);
+    }
+
+    SECTION("can be reset") {
+        sched.windowSize(1);
+        sched.sent(OutboundClass::APPLICATION, 1, 100, true, 0);
+        CHECK(!sched.acquire(OutboundClass::SYSTEM, 0));
+        sched.reset();
+        CHECK(sched.inFlight(OutboundClass::APPLICATION) == 0);
+        CHECK(sched.stats(OutboundClass::APPLICATION).sent == 0);
+        CHECK(sched.stats(OutboundClass::SYSTEM).deferred == 0);
+        CHECK(sched.acquire(OutboundClass::APPLICATION, 0));
+    }
+}
+
+TEST_CASE("Outbound scheduling of blockwise transfers") {
+    CoapMessageChannel channel;
+    ProtocolStub proto(&channel);
+    LargeSystemInfo descCallbacks; // Replaces the callbacks of the protocol instance
+    Description desc(&proto);
+    auto& sched = proto.get_outbound_scheduler();
+    proto.set_blockwise_transfers_enabled(true);
+    proto.callbacks()->setMillis(200000);
+
+    auto receiveAck = [&](CoapMessageId id) {
+        // Deliver the ACK to the scheduler and the Describe handler the same way the protocol does
+        channel.sendMessage(CoapMessage().type(CoapType::ACK).code(CoapCode::EMPTY).id(id));
+        Message m;
+        REQUIRE(channel.receive(m) == ProtocolError::NO_ERROR);
+        sched.completed(id);
+        int flags = 0;
+        REQUIRE(desc.receiveAckOrRst(m, &flags) == ProtocolError::NO_ERROR);
+    };
+
+    // Start a blockwise event that fills the window
+    const std::string data(8 * 1024, 'b');
+    REQUIRE(proto.send_event("abc", data.c_str(), 60, EventType::PRIVATE, EventType::EMPTY_FLAGS, CompletionHandler()));
+    CoapMessageId eventBlockIds[BLOCKWISE_WINDOW_SIZE] = {};
+    for (unsigned i = 0; i < BLOCKWISE_WINDOW_SIZE; ++i) {
+        const auto m = channel.receiveMessage();
+        REQUIRE(m.hasOption(CoapOption::BLOCK1));
+        eventBlockIds[i] = m.id();
+    }
+    REQUIRE(!channel.hasMessages());
+
+    // Start a blockwise Describe request. The first block is not deferred
+    REQUIRE(desc.sendRequest(DescriptionType::DESCRIBE_SYSTEM) == ProtocolError::NO_ERROR);
+    auto m = channel.receiveMessage();
+    CHECK(m.option(CoapOption::BLOCK1).toUInt() >> 4 == 0);
+    CHECK(sched.inFlight(OutboundClass::SYSTEM) == 1);
+    CHECK(sched.inFlight(OutboundClass::APPLICATION) == BLOCKWISE_WINDOW_SIZE);
+
+    // The next Describe block has to wait while the window is full
+    receiveAck(m.id());
+    CHECK(!channel.hasMessages());
+    CHECK(sched.stats(OutboundClass::SYSTEM).deferred == 1);
+
+    // An acknowledged event block frees a slot in the window, which is given to the Describe request
+    proto.callbacks()->addMillis(50);
+    channel.sendMessage(CoapMessage().type(CoapType::ACK).code(CoapCode::EMPTY).id(eventBlockIds[0]));
+    CoAPMessageType::Enum type = CoAPMessageType::NONE;
+    REQUIRE(proto.event_loop(type) == ProtocolError::NO_ERROR);
+    CHECK(!channel.hasMessages());
+    REQUIRE(desc.processTimeouts() == ProtocolError::NO_ERROR);
+    m = channel.receiveMessage();
+    CHECK(m.option(CoapOption::URI_PATH).toString() == "d");
+    CHECK(m.option(CoapOption::BLOCK1).toUInt() >> 4 == 1);
+    CHECK(sched.stats(OutboundClass::SYSTEM).maxQueueTime == 50);
+    CHECK(sched.stats(OutboundClass::APPLICATION).deferred == 1);
+
+    // The event continues once the window has room
+    REQUIRE(proto.event_loop(type) == ProtocolError::NO_ERROR);
+    CHECK(!channel.hasMessages());
+    channel.sendMessage(CoapMessage().type(CoapType::ACK).code(CoapCode::EMPTY).id(eventBlockIds[1]));
+    REQUIRE(proto.event_loop(type) == ProtocolError::NO_ERROR);
+    m = channel.receiveMessage();
+    CHECK(m.payload() == std::string(m.payload().size(), 'b'));
+    CHECK(m.option(CoapOption::BLOCK1).toUInt() >> 4 == BLOCKWISE_WINDOW_SIZE);
+    CHECK(!channel.hasMessages());
+}
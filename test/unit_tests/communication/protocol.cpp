@@ -19,6 +19,9 @@
 
 #include "protocol.h"
 
+#include "util/coap_message_channel.h"
+#include "util/protocol_stub.h"
+
 #include <catch2/catch.hpp>
 #include "fakeit.hpp"
 using namespace fakeit;
@@ -239,3 +242,32 @@ SCENARIO("Events are non-confirmable over an unreliable channel with the NO_ACK
 {
 	verify_event_type_with_flags(EventType::NO_ACK, CoAPType::NON);
 }
+
+TEST_CASE("Resuming a session")
+{
+	test::CoapMessageChannel channel;
+	test::ProtocolStub proto(&channel);
+	channel.sessionResumed(true);
+
+	SECTION("the session is confirmed with a ping by default")
+	{
+		REQUIRE(proto.begin() == ProtocolError::SESSION_RESUMED);
+		const auto m = channel.receiveMessage();
+		CHECK(m.type() == CoapType::CON);
+		CHECK(m.code() == (unsigned)CoapCode::EMPTY);
+		CHECK(!channel.hasMessages());
+	}
+
+	SECTION("no messages are sent before the application's messages in the fast resume mode")
+	{
+		proto.set_fast_resume_enabled(true);
+		REQUIRE(proto.begin() == ProtocolError::SESSION_RESUMED);
+		CHECK(!channel.hasMessages());
+		REQUIRE(proto.send_event("abc", "def", 60, EventType::PRIVATE, EventType::EMPTY_FLAGS, CompletionHandler()));
+		const auto m = channel.receiveMessage();
+		CHECK(m.type() == CoapType::CON);
+		CHECK(m.code() == (unsigned)CoapCode::POST);
+		CHECK(m.payload() == "def");
+		CHECK(!channel.hasMessages());
+	}
+}
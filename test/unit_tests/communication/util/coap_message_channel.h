@@ -43,6 +43,8 @@ public:
     CoapMessageChannel& skipMessages(unsigned count);
     // Returns true if there's a message received from the device
     bool hasMessages() const;
+    // Makes establish() report that the session has been resumed
+    CoapMessageChannel& sessionResumed(bool resumed);
 
     // Reimplemented from AbstractMessageChannel
     ProtocolError send(Message& msg) override;
@@ -59,10 +61,12 @@ private:
     std::queue<CoapMessage> send_;
     std::queue<CoapMessage> recv_;
     CoapMessageId lastMsgId_;
+    bool sessionResumed_;
 };
 
 inline CoapMessageChannel::CoapMessageChannel() :
-        lastMsgId_(0) {
+        lastMsgId_(0),
+        sessionResumed_(false) {
 }
 
 inline CoapMessageChannel& CoapMessageChannel::sendMessage(CoapMessage msg) {
@@ -93,8 +97,13 @@ inline bool CoapMessageChannel::hasMessages() const {
     return !recv_.empty();
 }
 
+inline CoapMessageChannel& CoapMessageChannel::sessionResumed(bool resumed) {
+    sessionResumed_ = resumed;
+    return *this;
+}
+
 inline ProtocolError CoapMessageChannel::establish() {
-    return ProtocolError::NO_ERROR;
+    return sessionResumed_ ? ProtocolError::SESSION_RESUMED : ProtocolError::NO_ERROR;
 }
 
 inline ProtocolError CoapMessageChannel::command(Command cmd, void* arg) {
@@ -50,6 +50,29 @@ bool appendMetricsCallback(appender_fn append, void* arg, uint32_t flags, uint32
     return false;
 }
 
+int callFunctionCallback(const char* key, const char* arg, SparkDescriptor::FunctionResultCallback callback, void* reserved) {
+    if (g_callbacks) {
+        return g_callbacks->callFunction(key, arg, callback, reserved);
+    }
+    return -1;
+}
+
+void getVariableCallback(const char* key, SparkDescriptor::GetVariableCallback callback, void* context) {
+    if (g_callbacks) {
+        g_callbacks->getVariable(key, callback, context);
+    } else {
+        callback(ProtocolError::NOT_FOUND, 0 /* type */, nullptr /* data */, 0 /* size */, context);
+    }
+}
+
+uint32_t appStateSelectorInfoCallback(SparkAppStateSelector::Enum selector, SparkAppStateUpdate::Enum operation,
+        uint32_t data, void* reserved) {
+    if (g_callbacks) {
+        return g_callbacks->appStateSelectorInfo(selector, operation, data, reserved);
+    }
+    return 0;
+}
+
 } // namespace
 
 DescriptorCallbacks::DescriptorCallbacks() :
@@ -58,6 +81,8 @@ DescriptorCallbacks::DescriptorCallbacks() :
     desc_.append_system_info = appendSystemInfoCallback;
     desc_.append_app_info = appendAppInfoCallback;
     desc_.append_metrics = appendMetricsCallback;
+    desc_.call_function = callFunctionCallback;
+    desc_.get_variable_async = getVariableCallback;
     g_callbacks = this;
 }
 
@@ -65,6 +90,11 @@ DescriptorCallbacks::~DescriptorCallbacks() {
     g_callbacks = nullptr;
 }
 
+DescriptorCallbacks& DescriptorCallbacks::appStateSelectorInfoEnabled(bool enabled) {
+    desc_.app_state_selector_info = enabled ? appStateSelectorInfoCallback : nullptr;
+    return *this;
+}
+
 } // namespace test
 
 } // namespace protocol
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "spark_descriptor.h"
+#include "protocol_defs.h"
 
 namespace particle {
 
@@ -33,9 +34,16 @@ public:
 
     const SparkDescriptor& get() const;
 
+    // Makes the descriptor report the application state updates via appStateSelectorInfo()
+    DescriptorCallbacks& appStateSelectorInfoEnabled(bool enabled);
+
     virtual bool appendSystemInfo(appender_fn append, void* arg, void* reserved);
     virtual bool appendAppInfo(appender_fn append, void* arg, void* reserved);
     virtual bool appendMetrics(appender_fn append, void* arg, uint32_t flags, uint32_t page, void* reserved);
+    virtual int callFunction(const char* key, const char* arg, SparkDescriptor::FunctionResultCallback callback, void* reserved);
+    virtual void getVariable(const char* key, SparkDescriptor::GetVariableCallback callback, void* context);
+    virtual uint32_t appStateSelectorInfo(SparkAppStateSelector::Enum selector, SparkAppStateUpdate::Enum operation,
+            uint32_t data, void* reserved);
 
 private:
     SparkDescriptor desc_;
@@ -57,6 +65,20 @@ inline bool DescriptorCallbacks::appendMetrics(appender_fn append, void* arg, ui
     return false;
 }
 
+inline int DescriptorCallbacks::callFunction(const char* key, const char* arg, SparkDescriptor::FunctionResultCallback callback,
+        void* reserved) {
+    return -1;
+}
+
+inline void DescriptorCallbacks::getVariable(const char* key, SparkDescriptor::GetVariableCallback callback, void* context) {
+    callback(ProtocolError::NOT_FOUND, 0 /* type */, nullptr /* data */, 0 /* size */, context);
+}
+
+inline uint32_t DescriptorCallbacks::appStateSelectorInfo(SparkAppStateSelector::Enum selector,
+        SparkAppStateUpdate::Enum operation, uint32_t data, void* reserved) {
+    return 0;
+}
+
 } // namespace test
 
 } // namespace protocol
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "ecc_precompute.h"
+#include "mbedtls_util.h"
+
+#include "rng_hal.h"
+#include "timer_hal.h"
+#include "system_error.h"
+
+#include "mbedtls/ecp.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/ecdsa.h"
+
+#include <chrono>
+#include <random>
+
+#if !defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT) || !defined(MBEDTLS_ECDSA_SIGN_ALT)
+#error "The precomputation hooks are expected to be enabled on the virtual device"
+#endif
+
+namespace {
+
+std::mt19937 g_rand;
+
+int failingRng(void*, unsigned char*, size_t) {
+    return MBEDTLS_ERR_ECP_RANDOM_FAILED;
+}
+
+class EcpGroup {
+public:
+    EcpGroup() {
+        mbedtls_ecp_group_init(&grp_);
+        REQUIRE(mbedtls_ecp_group_load(&grp_, MBEDTLS_ECP_DP_SECP256R1) == 0);
+    }
+
+    ~EcpGroup() {
+        mbedtls_ecp_group_free(&grp_);
+    }
+
+    mbedtls_ecp_group* get() {
+        return &grp_;
+    }
+
+private:
+    mbedtls_ecp_group grp_;
+};
+
+class EcpPoint {
+public:
+    EcpPoint() {
+        mbedtls_ecp_point_init(&p_);
+    }
+
+    ~EcpPoint() {
+        mbedtls_ecp_point_free(&p_);
+    }
+
+    mbedtls_ecp_point* get() {
+        return &p_;
+    }
+
+private:
+    mbedtls_ecp_point p_;
+};
+
+class Mpi {
+public:
+    Mpi() {
+        mbedtls_mpi_init(&mpi_);
+    }
+
+    ~Mpi() {
+        mbedtls_mpi_free(&mpi_);
+    }
+
+    mbedtls_mpi* get() {
+        return &mpi_;
+    }
+
+private:
+    mbedtls_mpi mpi_;
+};
+
+ecc_precompute_stats getStats() {
+    ecc_precompute_stats stats = {};
+    stats.size = sizeof(stats);
+    REQUIRE(ecc_precompute_get_stats(&stats, nullptr) == 0);
+    return stats;
+}
+
+void fillPool() {
+    int r = 0;
+    while ((r = ecc_precompute_fill(mbedtls_default_rng, nullptr, nullptr)) > 0) {
+    }
+    REQUIRE(r == ECC_PRECOMPUTE_NONE);
+}
+
+// Checks that Q = d * G
+void checkKeypair(mbedtls_ecp_group* grp, mbedtls_mpi* d, mbedtls_ecp_point* Q) {
+    REQUIRE(mbedtls_ecp_check_privkey(grp, d) == 0);
+    REQUIRE(mbedtls_ecp_check_pubkey(grp, Q) == 0);
+    EcpPoint P;
+    REQUIRE(mbedtls_ecp_mul(grp, P.get(), d, &grp->G, mbedtls_default_rng, nullptr) == 0);
+    REQUIRE(mbedtls_ecp_point_cmp(P.get(), Q) == 0);
+}
+
+// Signs a hash with a new key and verifies the signature
+void signAndVerify(mbedtls_ecp_group* grp) {
+    Mpi d, r, s;
+    EcpPoint Q;
+    REQUIRE(mbedtls_ecp_gen_keypair(grp, d.get(), Q.get(), mbedtls_default_rng, nullptr) == 0);
+    unsigned char hash[32] = {};
+    mbedtls_default_rng(nullptr, hash, sizeof(hash));
+    REQUIRE(mbedtls_ecdsa_sign(grp, r.get(), s.get(), d.get(), hash, sizeof(hash), mbedtls_default_rng, nullptr) == 0);
+    REQUIRE(mbedtls_ecdsa_verify(grp, hash, sizeof(hash), Q.get(), r.get(), s.get()) == 0);
+    // Make sure a corrupted hash is rejected
+    hash[0] ^= 0x01;
+    REQUIRE(mbedtls_ecdsa_verify(grp, hash, sizeof(hash), Q.get(), r.get(), s.get()) != 0);
+}
+
+} // namespace
+
+// HAL functions used by the crypto module
+uint32_t HAL_RNG_GetRandomNumber(void) {
+    return g_rand();
+}
+
+system_tick_t HAL_Timer_Get_Micro_Seconds(void) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+system_tick_t HAL_Timer_Get_Milli_Seconds(void) {
+    return HAL_Timer_Get_Micro_Seconds() / 1000;
+}
+
+TEST_CASE("ecc_precompute_fill()") {
+    ecc_precompute_clear(nullptr);
+
+    SECTION("fills the pool with keypairs and nonces alternately") {
+        CHECK(ecc_precompute_fill(mbedtls_default_rng, nullptr, nullptr) == ECC_PRECOMPUTE_KEYPAIR);
+        CHECK(ecc_precompute_fill(mbedtls_default_rng, nullptr, nullptr) == ECC_PRECOMPUTE_NONCE);
+        fillPool();
+        const auto stats = getStats();
+        CHECK(stats.keypairs == ECC_PRECOMPUTE_KEYPAIR_POOL_SIZE);
+        CHECK(stats.nonces == ECC_PRECOMPUTE_NONCE_POOL_SIZE);
+        CHECK(stats.keypair_time > 0);
+        CHECK(stats.nonce_time > 0);
+    }
+
+    SECTION("doesn't add a value to the pool if the RNG fails") {
+        CHECK(ecc_precompute_fill(failingRng, nullptr, nullptr) < 0);
+        const auto stats = getStats();
+        CHECK(stats.keypairs == 0);
+        CHECK(stats.nonces == 0);
+    }
+
+    SECTION("ecc_precompute_clear() empties the pool") {
+        fillPool();
+        ecc_precompute_clear(nullptr);
+        const auto stats = getStats();
+        CHECK(stats.keypairs == 0);
+        CHECK(stats.nonces == 0);
+    }
+}
+
+TEST_CASE("mbedtls_ecdh_gen_public()") {
+    ecc_precompute_clear(nullptr);
+    EcpGroup grp;
+
+    SECTION("takes a keypair from the pool") {
+        fillPool();
+        const auto statsBefore = getStats();
+        Mpi d1, d2;
+        EcpPoint Q1, Q2;
+        REQUIRE(mbedtls_ecdh_gen_public(grp.get(), d1.get(), Q1.get(), failingRng, nullptr) == 0);
+        REQUIRE(mbedtls_ecdh_gen_public(grp.get(), d2.get(), Q2.get(), failingRng, nullptr) == 0);
+        checkKeypair(grp.get(), d1.get(), Q1.get());
+        checkKeypair(grp.get(), d2.get(), Q2.get());
+        // Each keypair is used only once
+        CHECK(mbedtls_mpi_cmp_mpi(d1.get(), d2.get()) != 0);
+        const auto stats = getStats();
+        CHECK(stats.keypairs == statsBefore.keypairs - 2);
+        CHECK(stats.keypair_hits == statsBefore.keypair_hits + 2);
+        CHECK(stats.keypair_misses == statsBefore.keypair_misses);
+    }
+
+    SECTION("generates a keypair on demand if the pool is empty") {
+        const auto statsBefore = getStats();
+        Mpi d;
+        EcpPoint Q;
+        REQUIRE(mbedtls_ecdh_gen_public(grp.get(), d.get(), Q.get(), mbedtls_default_rng, nullptr) == 0);
+        checkKeypair(grp.get(), d.get(), Q.get());
+        const auto stats = getStats();
+        CHECK(stats.keypair_hits == statsBefore.keypair_hits);
+        CHECK(stats.keypair_misses == statsBefore.keypair_misses + 1);
+    }
+
+    SECTION("computes the same shared secret as the peer") {
+        for (int i = 0; i < 2; ++i) {
+            if (i == 0) {
+                fillPool();
+            } else {
+                ecc_precompute_clear(nullptr);
+            }
+            Mpi d, peerD, z, peerZ;
+            EcpPoint Q, peerQ;
+            REQUIRE(mbedtls_ecdh_gen_public(grp.get(), d.get(), Q.get(), mbedtls_default_rng, nullptr) == 0);
+            REQUIRE(mbedtls_ecp_gen_keypair(grp.get(), peerD.get(), peerQ.get(), mbedtls_default_rng, nullptr) == 0);
+            REQUIRE(mbedtls_ecdh_compute_shared(grp.get(), z.get(), peerQ.get(), d.get(), mbedtls_default_rng, nullptr) == 0);
+            REQUIRE(mbedtls_ecdh_compute_shared(grp.get(), peerZ.get(), Q.get(), peerD.get(), mbedtls_default_rng, nullptr) == 0);
+            CHECK(mbedtls_mpi_cmp_mpi(z.get(), peerZ.get()) == 0);
+        }
+    }
+}
+
+TEST_CASE("mbedtls_ecdsa_sign()") {
+    ecc_precompute_clear(nullptr);
+    EcpGroup grp;
+
+    SECTION("uses a nonce from the pool") {
+        fillPool();
+        const auto statsBefore = getStats();
+        signAndVerify(grp.get());
+        const auto stats = getStats();
+        CHECK(stats.nonces == statsBefore.nonces - 1);
+        CHECK(stats.nonce_hits == statsBefore.nonce_hits + 1);
+        CHECK(stats.nonce_misses == statsBefore.nonce_misses);
+        CHECK(stats.saved_time >= statsBefore.saved_time);
+    }
+
+    SECTION("generates a nonce on demand if the pool is empty") {
+        const auto statsBefore = getStats();
+        signAndVerify(grp.get());
+        const auto stats = getStats();
+        CHECK(stats.nonce_hits == statsBefore.nonce_hits);
+        CHECK(stats.nonce_misses == statsBefore.nonce_misses + 1);
+    }
+
+    SECTION("produces valid signatures once the pool runs out of nonces") {
+        fillPool();
+        const auto statsBefore = getStats();
+        for (unsigned i = 0; i < ECC_PRECOMPUTE_NONCE_POOL_SIZE + 2; ++i) {
+            signAndVerify(grp.get());
+        }
+        const auto stats = getStats();
+        CHECK(stats.nonces == 0);
+        CHECK(stats.nonce_hits == statsBefore.nonce_hits + ECC_PRECOMPUTE_NONCE_POOL_SIZE);
+        CHECK(stats.nonce_misses == statsBefore.nonce_misses + 2);
+    }
+
+    SECTION("rejects an invalid private key") {
+        fillPool();
+        Mpi d, r, s;
+        REQUIRE(mbedtls_mpi_lset(d.get(), 0) == 0);
+        unsigned char hash[32] = {};
+        CHECK(mbedtls_ecdsa_sign(grp.get(), r.get(), s.get(), d.get(), hash, sizeof(hash), mbedtls_default_rng, nullptr) ==
+                MBEDTLS_ERR_ECP_INVALID_KEY);
+        // The nonce is not consumed
+        CHECK(getStats().nonces == ECC_PRECOMPUTE_NONCE_POOL_SIZE);
+    }
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "cellular_attach_cache.h"
+#include "at_parser.h"
+#include "timer_hal.h"
+
+#include "fake_modem.h"
+
+#include <string>
+#include <vector>
+
+using namespace particle;
+using particle::test::FakeModem;
+
+namespace {
+
+const char ICCID[] = "89014103211118510720";
+const char OTHER_ICCID[] = "89883030000005421166";
+const char IMSI[] = "310410123456789";
+const char OTHER_IMSI[] = "214074300000001";
+
+const char COPS_SELECT[] = "AT+COPS=4,2,\"310410\",7";
+
+system_tick_t g_millis = 0;
+
+std::vector<std::string> commands(std::initializer_list<const char*> cmds) {
+    return std::vector<std::string>(cmds.begin(), cmds.end());
+}
+
+} // namespace
+
+system_tick_t HAL_Timer_Get_Milli_Seconds() {
+    return g_millis++;
+}
+
+TEST_CASE("CellularAttachCache") {
+    FakeModem modem;
+    modem.response("AT+COPS=3,2", "OK");
+    modem.response("AT+COPS?", "+COPS: 0,2,\"310410\",7\r\nOK");
+    modem.response(COPS_SELECT, "OK");
+    AtParser parser;
+    REQUIRE(parser.init(AtParserConfig().stream(&modem).echoEnabled(false)) == 0);
+    CellularAttachCache cache;
+    cache.iccid(ICCID);
+    cache.imsi(IMSI);
+
+    SECTION("has no profile initially") {
+        CHECK(!cache.hasProfile());
+        CHECK(cache.imsi() == nullptr);
+        CHECK(!cache.automaticSelectionNeeded());
+        CHECK(cache.selectNetwork(&parser, 1000) == SYSTEM_ERROR_INVALID_STATE);
+        CHECK(modem.commands().empty());
+    }
+
+    SECTION("records the network after the first registration") {
+        REQUIRE(cache.registered(&parser, 0x1234, 0x5678) == 0);
+        CHECK(modem.commands() == commands({ "AT+COPS=3,2", "AT+COPS?" }));
+        REQUIRE(cache.hasProfile());
+        CHECK(std::string(cache.profile().iccid) == ICCID);
+        CHECK(std::string(cache.profile().plmn) == "310410");
+        CHECK(cache.profile().act == 7);
+        CHECK(cache.profile().lac == 0x1234);
+        CHECK(cache.profile().cellId == 0x5678);
+        CHECK(std::string(cache.imsi()) == IMSI);
+    }
+
+    SECTION("selects the cached network with a single command") {
+        REQUIRE(cache.registered(&parser, 0x1234, 0x5678) == 0);
+        modem.clearCommands();
+        REQUIRE(cache.selectNetwork(&parser, 1000) == 0);
+        CHECK(modem.commands() == commands({ COPS_SELECT }));
+        // The profile is kept while the modem is in the manual selection mode
+        CHECK(cache.hasProfile());
+        CHECK(!cache.automaticSelectionNeeded());
+    }
+
+    SECTION("doesn't query the network if the serving cell is unchanged") {
+        REQUIRE(cache.registered(&parser, 0x1234, 0x5678) == 0);
+        modem.clearCommands();
+        REQUIRE(cache.registered(&parser, 0x1234, 0x5678) == 0);
+        CHECK(modem.commands().empty());
+        // Registration on a different cell
+        REQUIRE(cache.registered(&parser, 0x1234, 0x9abc) == 0);
+        CHECK(modem.commands() == commands({ "AT+COPS=3,2", "AT+COPS?" }));
+        CHECK(cache.profile().cellId == 0x9abc);
+    }
+
+    SECTION("queries the network if the IMSI has changed") {
+        REQUIRE(cache.registered(&parser, 0x1234, 0x5678) == 0);
+        modem.clearCommands();
+        // A multi-IMSI SIM card switched to a different profile
+        cache.imsi(OTHER_IMSI);
+        modem.response("AT+COPS?", "+COPS: 0,2,\"21407\",7\r\nOK");
+        REQUIRE(cache.registered(&parser, 0x1234, 0x5678) == 0);
+        CHECK(modem.commands() == commands({ "AT+COPS=3,2", "AT+COPS?" }));
+        CHECK(std::string(cache.profile().plmn) == "21407");
+        CHECK(std::string(cache.imsi()) == OTHER_IMSI);
+    }
+
+    SECTION("discards the profile if the SIM card has changed") {
+        REQUIRE(cache.registered(&parser, 0x1234, 0x5678) == 0);
+        REQUIRE(cache.selectNetwork(&parser, 1000) == 0);
+        cache.iccid(ICCID);
+        CHECK(cache.hasProfile());
+        cache.iccid(OTHER_ICCID);
+        CHECK(!cache.hasProfile());
+        CHECK(cache.imsi() == nullptr);
+        // The modem may still be using the network of the other SIM card
+        CHECK(cache.automaticSelectionNeeded());
+        cache.automaticSelectionDone();
+        CHECK(!cache.automaticSelectionNeeded());
+    }
+
+    SECTION("discards the profile if the cached network can't be selected") {
+        REQUIRE(cache.registered(&parser, 0x1234, 0x5678) == 0);
+        modem.clearCommands();
+        modem.response(COPS_SELECT, "+CME ERROR: 30");
+        CHECK(cache.selectNetwork(&parser, 1000) == SYSTEM_ERROR_AT_NOT_OK);
+        CHECK(modem.commands() == commands({ COPS_SELECT }));
+        CHECK(!cache.hasProfile());
+        CHECK(cache.automaticSelectionNeeded());
+    }
+
+    SECTION("doesn't record the network if the response is unexpected") {
+        modem.response("AT+COPS?", "+COPS: 0\r\nOK");
+        CHECK(cache.registered(&parser, 0x1234, 0x5678) == SYSTEM_ERROR_BAD_DATA);
+        CHECK(!cache.hasProfile());
+    }
+
+    SECTION("requires the ICCID to record the network") {
+        CellularAttachCache cache2;
+        CHECK(cache2.registered(&parser, 0x1234, 0x5678) == SYSTEM_ERROR_INVALID_STATE);
+        CHECK(modem.commands().empty());
+    }
+
+    SECTION("can't load the profile without a filesystem") {
+        CHECK(cache.load() == SYSTEM_ERROR_NOT_SUPPORTED);
+    }
+}
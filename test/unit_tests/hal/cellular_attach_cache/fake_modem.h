@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "stream.h"
+
+#include "system_error.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstring>
+
+namespace particle {
+
+namespace test {
+
+/**
+ * Stream that replies to AT commands with scripted responses.
+ *
+ * Commands that have no scripted response are replied to with "ERROR". The stream keeps track of
+ * all commands sent to it, so that the number of round trips can be checked.
+ */
+class FakeModem: public Stream {
+public:
+    /**
+     * Set the response to a command.
+     *
+     * @param cmd Command, e.g. "AT+COPS?".
+     * @param resp Response lines separated with "\r\n", including the final result code.
+     */
+    void response(const std::string& cmd, const std::string& resp) {
+        responses_[cmd] = resp;
+    }
+
+    const std::vector<std::string>& commands() const {
+        return cmds_;
+    }
+
+    void clearCommands() {
+        cmds_.clear();
+    }
+
+    int read(char* data, size_t size) override {
+        const size_t n = peek(data, size);
+        rx_.erase(0, n);
+        return n;
+    }
+
+    int peek(char* data, size_t size) override {
+        const size_t n = std::min(size, rx_.size());
+        memcpy(data, rx_.data(), n);
+        return n;
+    }
+
+    int skip(size_t size) override {
+        const size_t n = std::min(size, rx_.size());
+        rx_.erase(0, n);
+        return n;
+    }
+
+    int availForRead() override {
+        return rx_.size();
+    }
+
+    int write(const char* data, size_t size) override {
+        for (size_t i = 0; i < size; ++i) {
+            if (data[i] == '\r' || data[i] == '\n') {
+                if (!tx_.empty()) {
+                    reply(tx_);
+                    tx_.clear();
+                }
+            } else {
+                tx_ += data[i];
+            }
+        }
+        return size;
+    }
+
+    int flush() override {
+        return 0;
+    }
+
+    int availForWrite() override {
+        return 1024;
+    }
+
+    int waitEvent(unsigned flags, unsigned timeout) override {
+        if ((flags & READABLE) && rx_.empty()) {
+            return SYSTEM_ERROR_TIMEOUT; // Nothing else is going to arrive
+        }
+        return flags;
+    }
+
+private:
+    std::map<std::string, std::string> responses_;
+    std::vector<std::string> cmds_;
+    std::string rx_;
+    std::string tx_;
+
+    void reply(const std::string& cmd) {
+        cmds_.push_back(cmd);
+        const auto it = responses_.find(cmd);
+        rx_ += "\r\n" + ((it != responses_.end()) ? it->second : std::string("ERROR")) + "\r\n";
+    }
+};
+
+} // namespace test
+
+} // namespace particle
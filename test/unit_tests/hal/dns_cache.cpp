@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dns_cache.h"
+#include "system_error.h"
+
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <cstring>
+
+using namespace particle;
+
+namespace {
+
+const int FAMILY_UNSPEC = 0;
+const int FAMILY_INET = 2;
+
+DnsCacheAddress ipv4(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    DnsCacheAddress addr = {};
+    addr.size = 4;
+    addr.addr[0] = a;
+    addr.addr[1] = b;
+    addr.addr[2] = c;
+    addr.addr[3] = d;
+    return addr;
+}
+
+DnsCacheAddress ipv6(uint8_t last) {
+    DnsCacheAddress addr = {};
+    addr.size = 16;
+    addr.addr[0] = 0x20;
+    addr.addr[1] = 0x01;
+    addr.addr[15] = last;
+    return addr;
+}
+
+bool isAddressEqual(const DnsCacheAddress& a, const DnsCacheAddress& b) {
+    return a.size == b.size && memcmp(a.addr, b.addr, a.size) == 0;
+}
+
+} // namespace
+
+TEST_CASE("DnsCache") {
+    DnsCacheData data = {};
+    DnsCache cache(&data);
+    DnsCacheAddress addrs[dns::MAX_CACHED_ADDRESSES] = {};
+
+    SECTION("returns SYSTEM_ERROR_NOT_FOUND for an unknown host") {
+        CHECK(cache.get("device.spark.io", FAMILY_UNSPEC, 1000, addrs, dns::MAX_CACHED_ADDRESSES) == SYSTEM_ERROR_NOT_FOUND);
+    }
+
+    SECTION("returns the cached addresses in the original order") {
+        const DnsCacheAddress a[] = { ipv6(1), ipv4(10, 0, 0, 1), ipv4(10, 0, 0, 2) };
+        REQUIRE(cache.put("device.spark.io", FAMILY_UNSPEC, a, 3, 60, 1000) == 0);
+        REQUIRE(cache.get("device.spark.io", FAMILY_UNSPEC, 1000, addrs, dns::MAX_CACHED_ADDRESSES) == 3);
+        CHECK(isAddressEqual(addrs[0], a[0]));
+        CHECK(isAddressEqual(addrs[1], a[1]));
+        CHECK(isAddressEqual(addrs[2], a[2]));
+    }
+
+    SECTION("doesn't return more addresses than requested") {
+        const DnsCacheAddress a[] = { ipv4(10, 0, 0, 1), ipv4(10, 0, 0, 2) };
+        REQUIRE(cache.put("device.spark.io", FAMILY_UNSPEC, a, 2, 60, 1000) == 0);
+        CHECK(cache.get("device.spark.io", FAMILY_UNSPEC, 1000, addrs, 1) == 1);
+        CHECK(isAddressEqual(addrs[0], a[0]));
+    }
+
+    SECTION("compares host names case-insensitively") {
+        const auto a = ipv4(10, 0, 0, 1);
+        REQUIRE(cache.put("Device.Spark.IO", FAMILY_UNSPEC, &a, 1, 60, 1000) == 0);
+        CHECK(cache.get("device.spark.io", FAMILY_UNSPEC, 1000, addrs, dns::MAX_CACHED_ADDRESSES) == 1);
+        CHECK(cache.get("device.spark.i", FAMILY_UNSPEC, 1000, addrs, dns::MAX_CACHED_ADDRESSES) == SYSTEM_ERROR_NOT_FOUND);
+    }
+
+    SECTION("keeps separate entries for different address families") {
+        const auto a = ipv4(10, 0, 0, 1);
+        REQUIRE(cache.put("device.spark.io", FAMILY_INET, &a, 1, 60, 1000) == 0);
+        CHECK(cache.get("device.spark.io", FAMILY_UNSPEC, 1000, addrs, dns::MAX_CACHED_ADDRESSES) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(cache.get("device.spark.io", FAMILY_INET, 1000, addrs, dns::MAX_CACHED_ADDRESSES) == 1);
+    }
+
+    SECTION("honors the TTL of an entry") {
+        const auto a = ipv4(10, 0, 0, 1);
+        REQUIRE(cache.put("device.spark.io", FAMILY_UNSPEC, &a, 1, 60, 1000) == 0);
+        CHECK(cache.get("device.spark.io", FAMILY_UNSPEC, 1059, addrs, dns::MAX_CACHED_ADDRESSES) == 1);
+        CHECK(cache.get("device.spark.io", FAMILY_UNSPEC, 1060, addrs, dns::MAX_CACHED_ADDRESSES) == SYSTEM_ERROR_NOT_FOUND);
+        // The expired entry is removed
+        CHECK(cache.get("device.spark.io", FAMILY_UNSPEC, 1000, addrs, dns::MAX_CACHED_ADDRESSES) == SYSTEM_ERROR_NOT_FOUND);
+    }
+
+    SECTION("treats an entry as expired if the clock went backwards") {
+        const auto a = ipv4(10, 0, 0, 1);
+        REQUIRE(cache.put("device.spark.io", FAMILY_UNSPEC, &a, 1, 60, 1000) == 0);
+        CHECK(cache.get("device.spark.io", FAMILY_UNSPEC, 999, addrs, dns::MAX_CACHED_ADDRESSES) == SYSTEM_ERROR_NOT_FOUND);
+    }
+
+    SECTION("limits the TTL of an entry") {
+        const auto a = ipv4(10, 0, 0, 1);
+        REQUIRE(cache.put("device.spark.io", FAMILY_UNSPEC, &a, 1, dns::MAX_TTL * 2, 1000) == 0);
+        CHECK(cache.get("device.spark.io", FAMILY_UNSPEC, 1000 + dns::MAX_TTL, addrs, dns::MAX_CACHED_ADDRESSES) ==
+                SYSTEM_ERROR_NOT_FOUND);
+    }
+
+    SECTION("caches negative answers") {
+        REQUIRE(cache.put("nonexistent.particle.io", FAMILY_UNSPEC, nullptr, 0, dns::NEGATIVE_TTL, 1000) == 0);
+        CHECK(cache.get("nonexistent.particle.io", FAMILY_UNSPEC, 1000, addrs, dns::MAX_CACHED_ADDRESSES) == 0);
+        CHECK(cache.get("nonexistent.particle.io", FAMILY_UNSPEC, 1000 + dns::NEGATIVE_TTL, addrs,
+                dns::MAX_CACHED_ADDRESSES) == SYSTEM_ERROR_NOT_FOUND);
+    }
+
+    SECTION("replaces an existing entry") {
+        const auto a = ipv4(10, 0, 0, 1);
+        const auto b = ipv4(10, 0, 0, 2);
+        REQUIRE(cache.put("device.spark.io", FAMILY_UNSPEC, &a, 1, 60, 1000) == 0);
+        REQUIRE(cache.put("device.spark.io", FAMILY_UNSPEC, &b, 1, 60, 1010) == 0);
+        REQUIRE(cache.get("device.spark.io", FAMILY_UNSPEC, 1065, addrs, dns::MAX_CACHED_ADDRESSES) == 1);
+        CHECK(isAddressEqual(addrs[0], b));
+    }
+
+    SECTION("evicts the entry that expires first when the cache is full") {
+        const auto a = ipv4(10, 0, 0, 1);
+        for (size_t i = 0; i < dns::MAX_CACHE_ENTRIES; ++i) {
+            const auto name = "host" + std::to_string(i);
+            // The second host expires first
+            REQUIRE(cache.put(name.c_str(), FAMILY_UNSPEC, &a, 1, (i == 1) ? 30 : 60, 1000) == 0);
+        }
+        REQUIRE(cache.put("device.spark.io", FAMILY_UNSPEC, &a, 1, 60, 1000) == 0);
+        CHECK(cache.get("device.spark.io", FAMILY_UNSPEC, 1000, addrs, dns::MAX_CACHED_ADDRESSES) == 1);
+        CHECK(cache.get("host0", FAMILY_UNSPEC, 1000, addrs, dns::MAX_CACHED_ADDRESSES) == 1);
+        CHECK(cache.get("host1", FAMILY_UNSPEC, 1000, addrs, dns::MAX_CACHED_ADDRESSES) == SYSTEM_ERROR_NOT_FOUND);
+    }
+
+    SECTION("rejects host names that are too long") {
+        const std::string name(dns::MAX_CACHED_NAME_LENGTH + 1, 'a');
+        const auto a = ipv4(10, 0, 0, 1);
+        CHECK(cache.put(name.c_str(), FAMILY_UNSPEC, &a, 1, 60, 1000) == SYSTEM_ERROR_TOO_LARGE);
+    }
+
+    SECTION("removes entries") {
+        const auto a = ipv4(10, 0, 0, 1);
+        REQUIRE(cache.put("device.spark.io", FAMILY_UNSPEC, &a, 1, 60, 1000) == 0);
+        REQUIRE(cache.put("api.particle.io", FAMILY_UNSPEC, &a, 1, 60, 1000) == 0);
+        cache.remove("device.spark.io", FAMILY_UNSPEC);
+        CHECK(cache.get("device.spark.io", FAMILY_UNSPEC, 1000, addrs, dns::MAX_CACHED_ADDRESSES) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(cache.get("api.particle.io", FAMILY_UNSPEC, 1000, addrs, dns::MAX_CACHED_ADDRESSES) == 1);
+        cache.clear();
+        CHECK(cache.get("api.particle.io", FAMILY_UNSPEC, 1000, addrs, dns::MAX_CACHED_ADDRESSES) == SYSTEM_ERROR_NOT_FOUND);
+    }
+
+    SECTION("keeps the entries in the storage") {
+        const auto a = ipv4(10, 0, 0, 1);
+        REQUIRE(cache.put("device.spark.io", FAMILY_UNSPEC, &a, 1, 60, 1000) == 0);
+        // E.g. after waking up from sleep
+        DnsCache cache2(&data);
+        CHECK(cache2.get("device.spark.io", FAMILY_UNSPEC, 1030, addrs, dns::MAX_CACHED_ADDRESSES) == 1);
+    }
+
+    SECTION("discards invalid storage contents") {
+        const auto a = ipv4(10, 0, 0, 1);
+        REQUIRE(cache.put("device.spark.io", FAMILY_UNSPEC, &a, 1, 60, 1000) == 0);
+        DnsCacheData data2 = data;
+        data2.entries[0].count = dns::MAX_CACHED_ADDRESSES + 1;
+        DnsCache cache2(&data2);
+        CHECK(cache2.get("device.spark.io", FAMILY_UNSPEC, 1000, addrs, dns::MAX_CACHED_ADDRESSES) == SYSTEM_ERROR_NOT_FOUND);
+        memset(&data2, 0xff, sizeof(data2));
+        DnsCache cache3(&data2);
+        CHECK(cache3.get("device.spark.io", FAMILY_UNSPEC, 1000, addrs, dns::MAX_CACHED_ADDRESSES) == SYSTEM_ERROR_NOT_FOUND);
+    }
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "filesystem_cache.h"
+#include "system_error.h"
+
+#include "util/flash_simulator.h"
+
+#include <string>
+
+using namespace particle::fs;
+using test::FlashSimulator;
+
+namespace {
+
+const size_t BLOCK_SIZE = 4096;
+const size_t BLOCK_COUNT = 64;
+const size_t READ_SIZE = 256;
+
+FlashSimulator* g_flash = nullptr;
+
+int readFlash(uintptr_t addr, uint8_t* data, size_t size) {
+    return g_flash->read(addr, data, size);
+}
+
+std::string readCached(FlashReadCache& cache, uintptr_t addr, size_t size) {
+    std::string s(size, '\0');
+    REQUIRE(cache.read(addr, (uint8_t*)&s[0], size) == 0);
+    return s;
+}
+
+// Replays the flash access pattern of littlefs opening a file in a subdirectory, reading its
+// contents and occasionally updating it
+class FilesystemWorkload {
+public:
+    explicit FilesystemWorkload(FlashReadCache* cache) :
+            cache_(cache),
+            commitOffs_(1024),
+            activeBlock_(DIR_PAIR[0]) {
+    }
+
+    void run(unsigned iterations) {
+        for (unsigned i = 0; i < iterations; ++i) {
+            fetchPair(ROOT_PAIR);
+            fetchPair(DIR_PAIR);
+            // Read the file contents in one bulk read and the last chunk through the filesystem cache
+            read(DATA_BLOCK * BLOCK_SIZE, READ_SIZE * 4);
+            read(DATA_BLOCK * BLOCK_SIZE + READ_SIZE * 4, READ_SIZE);
+            if (i % 10 == 9) {
+                commit();
+            }
+        }
+    }
+
+private:
+    static constexpr size_t ROOT_PAIR[2] = { 2, 3 };
+    static constexpr size_t DIR_PAIR[2] = { 4, 5 };
+    static constexpr size_t DATA_BLOCK = 10;
+
+    FlashReadCache* cache_;
+    size_t commitOffs_;
+    size_t activeBlock_;
+
+    void fetchPair(const size_t pair[2]) {
+        // Check the revision counts of both blocks and scan the entries of the active one
+        read(pair[0] * BLOCK_SIZE, 16);
+        read(pair[1] * BLOCK_SIZE, 16);
+        const size_t block = (pair == DIR_PAIR) ? activeBlock_ : pair[0];
+        for (size_t offs = 0; offs < 1024; offs += READ_SIZE) {
+            read(block * BLOCK_SIZE + offs, READ_SIZE);
+        }
+    }
+
+    void commit() {
+        if (commitOffs_ + READ_SIZE > BLOCK_SIZE) {
+            // Compact the metadata into the other block of the pair
+            activeBlock_ = (activeBlock_ == DIR_PAIR[0]) ? DIR_PAIR[1] : DIR_PAIR[0];
+            erase(activeBlock_ * BLOCK_SIZE);
+            prog(activeBlock_ * BLOCK_SIZE, 1024);
+            commitOffs_ = 1024;
+        }
+        const uintptr_t addr = activeBlock_ * BLOCK_SIZE + commitOffs_;
+        prog(addr, READ_SIZE);
+        // Validate the written data
+        read(addr, READ_SIZE);
+        commitOffs_ += READ_SIZE;
+    }
+
+    void read(uintptr_t addr, size_t size) {
+        std::string buf(size, '\0');
+        REQUIRE(cache_->read(addr, (uint8_t*)&buf[0], size) == 0);
+    }
+
+    void prog(uintptr_t addr, size_t size) {
+        REQUIRE(g_flash->write(addr, std::string(size, '\x5a').data(), size) == 0);
+        cache_->invalidate(addr, size);
+    }
+
+    void erase(uintptr_t addr) {
+        REQUIRE(g_flash->erase(addr, 1) == 0);
+        cache_->invalidate(addr, BLOCK_SIZE);
+    }
+};
+
+constexpr size_t FilesystemWorkload::ROOT_PAIR[2];
+constexpr size_t FilesystemWorkload::DIR_PAIR[2];
+
+} // namespace
+
+TEST_CASE("FlashReadCache") {
+    FlashSimulator flash(BLOCK_SIZE * BLOCK_COUNT, BLOCK_SIZE);
+    g_flash = &flash;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        flash.store(i, std::string(1, (char)(i * 7)));
+    }
+    FlashReadCache cache;
+    REQUIRE(cache.init(512, 2, readFlash) == 0);
+
+    SECTION("loads whole lines from the flash") {
+        CHECK(readCached(cache, 10, 16) == flash.load(10, 16));
+        CHECK(flash.stats().readCount == 1);
+        CHECK(flash.stats().bytesRead == 512);
+        CHECK(readCached(cache, 100, 256) == flash.load(100, 256));
+        CHECK(flash.stats().readCount == 1);
+        CHECK(cache.stats().hits == 1);
+        CHECK(cache.stats().misses == 1);
+    }
+
+    SECTION("splits reads crossing a line boundary") {
+        CHECK(readCached(cache, 500, 24) == flash.load(500, 24));
+        CHECK(cache.stats().misses == 2);
+        CHECK(flash.stats().readCount == 2);
+    }
+
+    SECTION("evicts the least recently used line") {
+        readCached(cache, 0, 16);
+        readCached(cache, 512, 16);
+        readCached(cache, 0, 16); // Line 0 is now more recent than line 512
+        readCached(cache, 1024, 16);
+        flash.resetStats();
+        readCached(cache, 0, 16);
+        CHECK(flash.stats().readCount == 0);
+        readCached(cache, 512, 16);
+        CHECK(flash.stats().readCount == 1);
+    }
+
+    SECTION("bypasses reads larger than a line") {
+        CHECK(readCached(cache, 0, 1024) == flash.load(0, 1024));
+        CHECK(cache.stats().bypassed == 1);
+        CHECK(flash.stats().bytesRead == 1024);
+        readCached(cache, 0, 16);
+        CHECK(cache.stats().misses == 1);
+    }
+
+    SECTION("invalidates lines when the flash is programmed or erased") {
+        readCached(cache, 0, 16);
+        CHECK(readCached(cache, BLOCK_SIZE + 600, 3) == std::string(3, '\xff'));
+        REQUIRE(flash.write(BLOCK_SIZE + 600, "abc", 3) == 0);
+        cache.invalidate(BLOCK_SIZE + 600, 3);
+        CHECK(readCached(cache, BLOCK_SIZE + 600, 3) == "abc");
+        // The line of the other block is still cached
+        CHECK(readCached(cache, 0, 16) == flash.load(0, 16));
+        CHECK(cache.stats().hits == 1);
+        REQUIRE(flash.erase(0, 1) == 0);
+        cache.invalidate(0, BLOCK_SIZE);
+        CHECK(readCached(cache, 0, 16) == std::string(16, '\xff'));
+    }
+
+    SECTION("reads directly from the flash when disabled") {
+        REQUIRE(cache.init(512, 0, readFlash) == 0);
+        CHECK(readCached(cache, 10, 16) == flash.load(10, 16));
+        CHECK(flash.stats().bytesRead == 16);
+        CHECK(cache.stats().misses == 0);
+    }
+
+    SECTION("rejects invalid line sizes") {
+        CHECK(cache.init(500, 2, readFlash) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(cache.init(0, 2, readFlash) == SYSTEM_ERROR_INVALID_ARGUMENT);
+    }
+}
+
+TEST_CASE("BufferPool") {
+    BufferPool pool;
+    REQUIRE(pool.init(254, 2) == 0);
+    CHECK(pool.bufferSize() == 256);
+
+    SECTION("allocates buffers until the pool is exhausted") {
+        void* p1 = pool.alloc(256);
+        void* p2 = pool.alloc(16);
+        REQUIRE(p1);
+        REQUIRE(p2);
+        CHECK(p1 != p2);
+        CHECK(pool.alloc(16) == nullptr);
+        CHECK(pool.usedCount() == 2);
+        CHECK(pool.free(p1));
+        CHECK(pool.alloc(16) == p1);
+        CHECK(pool.stats().allocs == 3);
+        CHECK(pool.stats().failed == 1);
+        CHECK(pool.stats().maxUsed == 2);
+    }
+
+    SECTION("doesn't serve buffers larger than its buffer size") {
+        CHECK(pool.alloc(257) == nullptr);
+        CHECK(pool.usedCount() == 0);
+    }
+
+    SECTION("doesn't free foreign buffers") {
+        int x = 0;
+        CHECK(!pool.free(&x));
+        CHECK(!pool.free(nullptr));
+    }
+
+    SECTION("can't be reinitialized while buffers are in use") {
+        REQUIRE(pool.alloc(16));
+        CHECK(pool.init(512, 4) == SYSTEM_ERROR_INVALID_STATE);
+    }
+}
+
+TEST_CASE("FlashReadCache benchmark") {
+    const unsigned ITERATIONS = 200;
+
+    FlashSimulator uncachedFlash(BLOCK_SIZE * BLOCK_COUNT, BLOCK_SIZE);
+    g_flash = &uncachedFlash;
+    FlashReadCache uncached;
+    REQUIRE(uncached.init(READ_SIZE, 0, readFlash) == 0);
+    FilesystemWorkload(&uncached).run(ITERATIONS);
+
+    FlashSimulator cachedFlash(BLOCK_SIZE * BLOCK_COUNT, BLOCK_SIZE);
+    g_flash = &cachedFlash;
+    FlashReadCache cached;
+    REQUIRE(cached.init(512, 8, readFlash) == 0);
+    FilesystemWorkload(&cached).run(ITERATIONS);
+
+    const auto& u = uncachedFlash.stats();
+    const auto& c = cachedFlash.stats();
+    // The cache only affects the reads
+    CHECK(c.sectorsErased == u.sectorsErased);
+    CHECK(c.bytesProgrammed == u.bytesProgrammed);
+    CHECK(c.readCount * 10 < u.readCount);
+    CHECK(c.bytesRead * 2 < u.bytesRead);
+    CHECK(cached.stats().hits > cached.stats().misses * 10);
+}
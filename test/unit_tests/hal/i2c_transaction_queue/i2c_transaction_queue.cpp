@@ -0,0 +1,546 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "i2c_hal.h"
+#include "concurrent_hal.h"
+#include "hal_irq_flag.h"
+#include "system_error.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <map>
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+#include <cstdarg>
+#include <memory>
+
+namespace {
+
+const size_t BUFFER_SIZE = 32;
+const auto WAIT_TIMEOUT = std::chrono::seconds(5);
+
+// Simulated slave device with auto-incrementing register pointer
+struct Device {
+    uint8_t regs[256];
+    uint8_t ptr;
+};
+
+// Simulated bus. Accessed only by the thread holding the bus lock
+class Bus {
+public:
+    std::map<uint8_t, Device> devices;
+    std::vector<std::string> log;
+    std::recursive_mutex lock;
+    std::atomic<unsigned> lockWaiters;
+    bool enabled = true;
+
+    uint8_t txAddr = 0;
+    uint8_t txBuf[BUFFER_SIZE] = {};
+    size_t txLen = 0;
+    bool txStop = true;
+    uint8_t rxBuf[BUFFER_SIZE] = {};
+    size_t rxLen = 0;
+    size_t rxPos = 0;
+
+    void reset() {
+        std::lock_guard<std::recursive_mutex> lk(lock);
+        devices.clear();
+        log.clear();
+        enabled = true;
+        lockWaiters = 0;
+    }
+
+    std::vector<std::string> takeLog() {
+        std::lock_guard<std::recursive_mutex> lk(lock);
+        auto l = std::move(log);
+        log.clear();
+        return l;
+    }
+
+    void addLog(const char* fmt, ...) {
+        char buf[128];
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(buf, sizeof(buf), fmt, args);
+        va_end(args);
+        log.push_back(buf);
+    }
+};
+
+Bus g_bus;
+
+std::recursive_mutex g_irqMutex;
+
+struct Semaphore {
+    std::mutex mutex;
+    std::condition_variable cond;
+    unsigned count;
+    unsigned maxCount;
+};
+
+// Collects completion results
+class Completions {
+public:
+    struct Result {
+        std::string name;
+        int error;
+    };
+
+    void add(const char* name, int error) {
+        std::lock_guard<std::mutex> lk(mutex_);
+        results_.push_back({ name, error });
+        cond_.notify_all();
+    }
+
+    bool wait(size_t count) {
+        std::unique_lock<std::mutex> lk(mutex_);
+        return cond_.wait_for(lk, WAIT_TIMEOUT, [&]() { return results_.size() >= count; });
+    }
+
+    std::vector<Result> results() {
+        std::lock_guard<std::mutex> lk(mutex_);
+        return results_;
+    }
+
+    std::vector<std::string> names() {
+        std::lock_guard<std::mutex> lk(mutex_);
+        std::vector<std::string> n;
+        for (const auto& r: results_) {
+            n.push_back(r.name);
+        }
+        return n;
+    }
+
+private:
+    std::vector<Result> results_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
+
+struct Transaction {
+    hal_i2c_transaction_t hal;
+    std::vector<hal_i2c_transaction_segment_t> segs;
+    Completions* completions;
+    std::string name;
+
+    Transaction(Completions* c, const std::string& n, uint8_t address) :
+            hal(),
+            completions(c),
+            name(n) {
+        hal.size = sizeof(hal);
+        hal.address = address;
+        hal.callback = [](hal_i2c_transaction_t* t, int error, void* ctx) {
+            auto self = static_cast<Transaction*>(ctx);
+            self->completions->add(self->name.c_str(), error);
+        };
+        hal.context = this;
+    }
+
+    Transaction& write(const void* data, size_t size, uint32_t flags = 0) {
+        segs.push_back({ const_cast<void*>(data), (uint32_t)size, flags });
+        return *this;
+    }
+
+    Transaction& read(void* data, size_t size, uint32_t flags = 0) {
+        segs.push_back({ data, (uint32_t)size, flags | HAL_I2C_TRANSACTION_SEGMENT_FLAG_READ });
+        return *this;
+    }
+
+    hal_i2c_transaction_t* get() {
+        hal.segments = segs.data();
+        hal.segment_count = segs.size();
+        return &hal;
+    }
+};
+
+} // namespace
+
+// Mock HAL and concurrency functions
+
+int HAL_disable_irq() {
+    g_irqMutex.lock();
+    return 1;
+}
+
+void HAL_enable_irq(int mask) {
+    g_irqMutex.unlock();
+}
+
+os_result_t os_thread_create(os_thread_t* thread, const char* name, os_thread_prio_t priority, os_thread_fn_t fun,
+        void* param, size_t stackSize) {
+    // The worker thread never exits
+    auto t = new std::thread(fun, param);
+    t->detach();
+    *thread = t;
+    return 0;
+}
+
+os_result_t os_thread_exit(os_thread_t thread) {
+    return 0;
+}
+
+int os_semaphore_create(os_semaphore_t* sem, unsigned maxCount, unsigned initCount) {
+    // Never destroyed, as the worker thread may be waiting on it when the process exits
+    auto s = new Semaphore();
+    s->count = initCount;
+    s->maxCount = maxCount;
+    *sem = s;
+    return 0;
+}
+
+int os_semaphore_destroy(os_semaphore_t sem) {
+    delete static_cast<Semaphore*>(sem);
+    return 0;
+}
+
+int os_semaphore_take(os_semaphore_t sem, system_tick_t timeout, bool reserved) {
+    auto s = static_cast<Semaphore*>(sem);
+    std::unique_lock<std::mutex> lk(s->mutex);
+    s->cond.wait(lk, [s]() { return s->count > 0; });
+    --s->count;
+    return 0;
+}
+
+int os_semaphore_give(os_semaphore_t sem, bool reserved) {
+    auto s = static_cast<Semaphore*>(sem);
+    std::lock_guard<std::mutex> lk(s->mutex);
+    if (s->count >= s->maxCount) {
+        return 1;
+    }
+    ++s->count;
+    s->cond.notify_one();
+    return 0;
+}
+
+bool hal_i2c_is_enabled(hal_i2c_interface_t i2c, void* reserved) {
+    return g_bus.enabled;
+}
+
+int32_t hal_i2c_lock(hal_i2c_interface_t i2c, void* reserved) {
+    ++g_bus.lockWaiters;
+    g_bus.lock.lock();
+    --g_bus.lockWaiters;
+    return 0;
+}
+
+int32_t hal_i2c_unlock(hal_i2c_interface_t i2c, void* reserved) {
+    g_bus.lock.unlock();
+    return 0;
+}
+
+void hal_i2c_begin_transmission(hal_i2c_interface_t i2c, uint8_t address, const hal_i2c_transmission_config_t* config) {
+    g_bus.txAddr = address;
+    g_bus.txLen = 0;
+    g_bus.txStop = config->flags & HAL_I2C_TRANSMISSION_FLAG_STOP;
+}
+
+uint32_t hal_i2c_write(hal_i2c_interface_t i2c, uint8_t data, void* reserved) {
+    if (g_bus.txLen >= BUFFER_SIZE) {
+        return 0;
+    }
+    g_bus.txBuf[g_bus.txLen++] = data;
+    return 1;
+}
+
+int hal_i2c_end_transmission_ext(hal_i2c_interface_t i2c, uint8_t stop, void* reserved) {
+    auto it = g_bus.devices.find(g_bus.txAddr);
+    if (it == g_bus.devices.end()) {
+        g_bus.addLog("W %02x nack", g_bus.txAddr);
+        return SYSTEM_ERROR_I2C_TX_ADDR_TIMEOUT;
+    }
+    auto& dev = it->second;
+    std::string data;
+    for (size_t i = 0; i < g_bus.txLen; ++i) {
+        char b[4];
+        snprintf(b, sizeof(b), " %02x", g_bus.txBuf[i]);
+        data += b;
+        if (i == 0) {
+            dev.ptr = g_bus.txBuf[i];
+        } else {
+            dev.regs[dev.ptr++] = g_bus.txBuf[i];
+        }
+    }
+    g_bus.addLog("W %02x%s %s", g_bus.txAddr, data.c_str(), g_bus.txStop ? "P" : "Sr");
+    return 0;
+}
+
+int32_t hal_i2c_request_ex(hal_i2c_interface_t i2c, const hal_i2c_transmission_config_t* config, void* reserved) {
+    auto it = g_bus.devices.find(config->address);
+    const bool stop = config->flags & HAL_I2C_TRANSMISSION_FLAG_STOP;
+    if (it == g_bus.devices.end()) {
+        g_bus.addLog("R %02x nack", config->address);
+        return 0;
+    }
+    auto& dev = it->second;
+    const size_t n = std::min<size_t>(config->quantity, BUFFER_SIZE);
+    for (size_t i = 0; i < n; ++i) {
+        g_bus.rxBuf[i] = dev.regs[dev.ptr++];
+    }
+    g_bus.rxLen = n;
+    g_bus.rxPos = 0;
+    g_bus.addLog("R %02x %u %s", config->address, (unsigned)n, stop ? "P" : "Sr");
+    return n;
+}
+
+int32_t hal_i2c_read(hal_i2c_interface_t i2c, void* reserved) {
+    if (g_bus.rxPos >= g_bus.rxLen) {
+        return -1;
+    }
+    return g_bus.rxBuf[g_bus.rxPos++];
+}
+
+int hal_i2c_reset(hal_i2c_interface_t i2c, uint32_t reserved, void* reserved1) {
+    g_bus.addLog("reset");
+    return 0;
+}
+
+namespace {
+
+void waitForLockWaiters(unsigned count) {
+    const auto t = std::chrono::steady_clock::now();
+    while (g_bus.lockWaiters < count) {
+        REQUIRE(std::chrono::steady_clock::now() - t < WAIT_TIMEOUT);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+Device& addDevice(uint8_t address) {
+    auto& dev = g_bus.devices[address];
+    for (unsigned i = 0; i < sizeof(dev.regs); ++i) {
+        dev.regs[i] = (uint8_t)(address + i);
+    }
+    dev.ptr = 0;
+    return dev;
+}
+
+} // namespace
+
+TEST_CASE("hal_i2c_queue_transaction()") {
+    g_bus.reset();
+    Completions done;
+    uint8_t buf[8] = {};
+
+    SECTION("validates the arguments") {
+        Transaction t(&done, "a", 0x10);
+        CHECK(hal_i2c_queue_transaction(HAL_I2C_INTERFACE1, t.get(), nullptr) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        t.read(buf, 0);
+        CHECK(hal_i2c_queue_transaction(HAL_I2C_INTERFACE1, t.get(), nullptr) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        t.segs.clear();
+        t.read(nullptr, 1);
+        CHECK(hal_i2c_queue_transaction(HAL_I2C_INTERFACE1, t.get(), nullptr) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        t.segs.clear();
+        t.read(buf, 1);
+        CHECK(hal_i2c_queue_transaction((hal_i2c_interface_t)HAL_PLATFORM_I2C_NUM, t.get(), nullptr) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(hal_i2c_queue_transaction(HAL_I2C_INTERFACE1, nullptr, nullptr) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        g_bus.enabled = false;
+        CHECK(hal_i2c_queue_transaction(HAL_I2C_INTERFACE1, t.get(), nullptr) == SYSTEM_ERROR_INVALID_STATE);
+        CHECK(done.results().empty());
+    }
+
+    SECTION("reads registers using a repeated start condition") {
+        addDevice(0x6b);
+        const uint8_t reg = 0x02;
+        Transaction t(&done, "a", 0x6b);
+        t.write(&reg, 1).read(buf, 4);
+        REQUIRE(hal_i2c_queue_transaction(HAL_I2C_INTERFACE1, t.get(), nullptr) == 0);
+        REQUIRE(done.wait(1));
+        CHECK(done.results()[0].error == 0);
+        CHECK(g_bus.takeLog() == std::vector<std::string>({ "W 6b 02 Sr", "R 6b 4 P" }));
+        CHECK(memcmp(buf, "\x6d\x6e\x6f\x70", 4) == 0);
+    }
+
+    SECTION("generates a stop condition after segments marked with the stop flag") {
+        auto& dev = addDevice(0x36);
+        const uint8_t data[] = { 0x0c, 0xaa, 0xbb };
+        const uint8_t reg = 0x0c;
+        Transaction t(&done, "a", 0x36);
+        t.write(data, sizeof(data), HAL_I2C_TRANSACTION_SEGMENT_FLAG_STOP).write(&reg, 1).read(buf, 2);
+        REQUIRE(hal_i2c_queue_transaction(HAL_I2C_INTERFACE1, t.get(), nullptr) == 0);
+        REQUIRE(done.wait(1));
+        CHECK(done.results()[0].error == 0);
+        CHECK(g_bus.takeLog() == std::vector<std::string>({ "W 36 0c aa bb P", "W 36 0c Sr", "R 36 2 P" }));
+        CHECK(dev.regs[0x0c] == 0xaa);
+        CHECK(buf[0] == 0xaa);
+        CHECK(buf[1] == 0xbb);
+    }
+
+    SECTION("performs transactions in the order they were queued") {
+        addDevice(0x10);
+        addDevice(0x20);
+        const uint8_t reg = 0;
+        std::vector<std::unique_ptr<Transaction>> trans;
+        std::vector<std::string> expected;
+        {
+            // Keep the worker thread from starting the transactions until all of them are queued
+            std::lock_guard<std::recursive_mutex> lk(g_bus.lock);
+            for (int i = 0; i < 10; ++i) {
+                const auto name = std::to_string(i);
+                trans.emplace_back(new Transaction(&done, name, (i % 2) ? 0x20 : 0x10));
+                trans.back()->write(&reg, 1).read(buf, 1);
+                REQUIRE(hal_i2c_queue_transaction(HAL_I2C_INTERFACE1, trans.back()->get(), nullptr) == 0);
+                expected.push_back(name);
+            }
+        }
+        REQUIRE(done.wait(expected.size()));
+        CHECK(done.names() == expected);
+    }
+
+    SECTION("doesn't block the calling thread while another thread holds the bus lock") {
+        addDevice(0x10);
+        const uint8_t reg = 0;
+        Transaction t(&done, "a", 0x10);
+        t.write(&reg, 1).read(buf, 1);
+        std::mutex m;
+        std::condition_variable cv;
+        bool locked = false;
+        bool release = false;
+        std::thread sync([&]() {
+            std::unique_lock<std::mutex> lk(m);
+            hal_i2c_lock(HAL_I2C_INTERFACE1, nullptr);
+            locked = true;
+            cv.notify_all();
+            cv.wait(lk, [&]() { return release; });
+            hal_i2c_unlock(HAL_I2C_INTERFACE1, nullptr);
+        });
+        {
+            std::unique_lock<std::mutex> lk(m);
+            cv.wait(lk, [&]() { return locked; });
+        }
+        REQUIRE(hal_i2c_queue_transaction(HAL_I2C_INTERFACE1, t.get(), nullptr) == 0);
+        waitForLockWaiters(1);
+        CHECK(done.results().empty());
+        {
+            std::lock_guard<std::mutex> lk(m);
+            release = true;
+            cv.notify_all();
+        }
+        sync.join();
+        REQUIRE(done.wait(1));
+        CHECK(done.results()[0].error == 0);
+    }
+
+    SECTION("concurrent submitters") {
+        addDevice(0x10);
+        addDevice(0x20);
+        const unsigned THREADS = 4;
+        const unsigned COUNT = 50;
+        std::vector<Completions> perThread(THREADS);
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < THREADS; ++i) {
+            threads.emplace_back([&, i]() {
+                const uint8_t reg = i;
+                uint8_t data[COUNT] = {};
+                std::vector<std::unique_ptr<Transaction>> trans;
+                for (unsigned j = 0; j < COUNT; ++j) {
+                    trans.emplace_back(new Transaction(&perThread[i], std::to_string(j), (j % 2) ? 0x20 : 0x10));
+                    trans.back()->write(&reg, 1).read(&data[j], 1);
+                    REQUIRE(hal_i2c_queue_transaction(HAL_I2C_INTERFACE1, trans.back()->get(), nullptr) == 0);
+                }
+                REQUIRE(perThread[i].wait(COUNT));
+                for (unsigned j = 0; j < COUNT; ++j) {
+                    CHECK(data[j] == (uint8_t)(((j % 2) ? 0x20 : 0x10) + reg));
+                }
+            });
+        }
+        for (auto& t: threads) {
+            t.join();
+        }
+        for (auto& c: perThread) {
+            std::vector<std::string> expected;
+            for (unsigned j = 0; j < COUNT; ++j) {
+                expected.push_back(std::to_string(j));
+            }
+            // Transactions queued by the same thread complete in order
+            CHECK(c.names() == expected);
+            for (const auto& r: c.results()) {
+                CHECK(r.error == 0);
+            }
+        }
+    }
+
+    SECTION("reports an error if the device doesn't respond") {
+        const uint8_t reg = 0;
+        Transaction a(&done, "a", 0x50);
+        a.write(&reg, 1).read(buf, 1);
+        Transaction b(&done, "b", 0x50);
+        b.read(buf, 1);
+        REQUIRE(hal_i2c_queue_transaction(HAL_I2C_INTERFACE1, a.get(), nullptr) == 0);
+        REQUIRE(hal_i2c_queue_transaction(HAL_I2C_INTERFACE1, b.get(), nullptr) == 0);
+        REQUIRE(done.wait(2));
+        CHECK(done.results()[0].error == SYSTEM_ERROR_I2C_TX_ADDR_TIMEOUT);
+        CHECK(done.results()[1].error == SYSTEM_ERROR_I2C_ABORT);
+        CHECK(g_bus.takeLog() == std::vector<std::string>({ "W 50 nack", "R 50 nack" }));
+    }
+
+    SECTION("releases the bus if a segment that follows a repeated start fails") {
+        addDevice(0x10);
+        const uint8_t reg = 0;
+        uint8_t big[BUFFER_SIZE + 1] = {};
+        Transaction t(&done, "a", 0x10);
+        t.write(&reg, 1).write(big, sizeof(big));
+        REQUIRE(hal_i2c_queue_transaction(HAL_I2C_INTERFACE1, t.get(), nullptr) == 0);
+        REQUIRE(done.wait(1));
+        CHECK(done.results()[0].error == SYSTEM_ERROR_TOO_LARGE);
+        CHECK(g_bus.takeLog() == std::vector<std::string>({ "W 10 00 Sr", "reset" }));
+    }
+}
+
+TEST_CASE("hal_i2c_cancel_transactions()") {
+    g_bus.reset();
+    addDevice(0x10);
+    Completions done;
+    uint8_t buf[4] = {};
+    const uint8_t reg = 0;
+    Transaction a(&done, "a", 0x10);
+    a.write(&reg, 1).read(buf, 1);
+    Transaction b(&done, "b", 0x10);
+    b.write(&reg, 1).read(buf, 1);
+    Transaction c(&done, "c", 0x10);
+    c.write(&reg, 1).read(buf, 1);
+
+    SECTION("does nothing if there are no queued transactions") {
+        CHECK(hal_i2c_cancel_transactions(HAL_I2C_INTERFACE1, nullptr) == 0);
+        CHECK(done.results().empty());
+    }
+
+    SECTION("cancels the transactions that haven't been started") {
+        {
+            std::lock_guard<std::recursive_mutex> lk(g_bus.lock);
+            REQUIRE(hal_i2c_queue_transaction(HAL_I2C_INTERFACE1, a.get(), nullptr) == 0);
+            // Wait until the worker thread takes the first transaction
+            waitForLockWaiters(1);
+            REQUIRE(hal_i2c_queue_transaction(HAL_I2C_INTERFACE1, b.get(), nullptr) == 0);
+            REQUIRE(hal_i2c_queue_transaction(HAL_I2C_INTERFACE1, c.get(), nullptr) == 0);
+            CHECK(hal_i2c_cancel_transactions(HAL_I2C_INTERFACE1, nullptr) == 0);
+            CHECK(done.names() == std::vector<std::string>({ "b", "c" }));
+        }
+        REQUIRE(done.wait(3));
+        const auto r = done.results();
+        CHECK(r[0].error == SYSTEM_ERROR_CANCELLED);
+        CHECK(r[1].error == SYSTEM_ERROR_CANCELLED);
+        CHECK(r[2].name == "a");
+        CHECK(r[2].error == 0);
+    }
+}
@@ -0,0 +1,443 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ppp_hdlc.h"
+
+#include "system_error.h"
+
+#include "catch2/catch.hpp"
+
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+using namespace particle::net::ppp;
+
+namespace {
+
+// Bitwise FCS implementation from RFC 1662, appendix C
+uint16_t refFcs16(uint16_t fcs, const std::string& data) {
+    for (uint8_t c: data) {
+        fcs ^= c;
+        for (int i = 0; i < 8; ++i) {
+            fcs = (fcs & 1) ? (fcs >> 1) ^ 0x8408 : fcs >> 1;
+        }
+    }
+    return fcs;
+}
+
+std::string encodeFrame(const std::string& data, uint32_t accm = 0xffffffff) {
+    std::string s = data;
+    const uint16_t fcs = refFcs16(HDLC_FCS_INIT, data) ^ 0xffff;
+    s.push_back(fcs & 0xff);
+    s.push_back(fcs >> 8);
+    std::string out(1, HDLC_FLAG);
+    for (uint8_t c: s) {
+        if (c == HDLC_FLAG || c == HDLC_ESCAPE || (c < 0x20 && (accm & (1u << c)))) {
+            out.push_back(HDLC_ESCAPE);
+            out.push_back(c ^ HDLC_TRANS);
+        } else {
+            out.push_back(c);
+        }
+    }
+    out.push_back(HDLC_FLAG);
+    return out;
+}
+
+std::string randomData(std::mt19937& rng, size_t size) {
+    std::string s;
+    for (size_t i = 0; i < size; ++i) {
+        s.push_back(rng() & 0xff);
+    }
+    return s;
+}
+
+// Stores the frame data in fixed-size buffers, similarly to a chain of pbufs
+class TestSink: public HdlcFrameSink {
+public:
+    explicit TestSink(size_t bufSize = 64, size_t maxBufs = 1000) :
+            bufSize_(bufSize),
+            maxBufs_(maxBufs) {
+    }
+
+    uint8_t* frameBuffer(size_t* size) override {
+        if (bufs_.size() >= maxBufs_) {
+            return nullptr;
+        }
+        bufs_.emplace_back(bufSize_);
+        *size = bufSize_;
+        return bufs_.back().data();
+    }
+
+    void frameReceived(size_t size) override {
+        std::string f;
+        for (const auto& b: bufs_) {
+            f.append((const char*)b.data(), b.size());
+        }
+        f.resize(size);
+        frames.push_back(f);
+        bufs_.clear();
+    }
+
+    void frameDropped(int error) override {
+        errors.push_back(error);
+        bufs_.clear();
+    }
+
+    std::vector<std::string> frames;
+    std::vector<int> errors;
+
+private:
+    std::vector<std::vector<uint8_t>> bufs_;
+    size_t bufSize_;
+    size_t maxBufs_;
+};
+
+// Byte-at-a-time decoder, equivalent to the input processing in pppos_input()
+class RefDecoder {
+public:
+    explicit RefDecoder(HdlcFrameSink* sink) :
+            sink_(sink),
+            buf_(nullptr),
+            bufSize_(0),
+            bufOffs_(0),
+            frameSize_(0),
+            fcs_(HDLC_FCS_INIT),
+            escaped_(false) {
+    }
+
+    void input(const uint8_t* data, size_t size) {
+        while (size-- > 0) {
+            uint8_t c = *data++;
+            if (c == HDLC_FLAG) {
+                if (frameSize_ > HDLC_FCS_SIZE && fcs_ == HDLC_FCS_GOOD) {
+                    sink_->frameReceived(frameSize_ - HDLC_FCS_SIZE);
+                } else if (frameSize_) {
+                    sink_->frameDropped(SYSTEM_ERROR_BAD_DATA);
+                }
+                buf_ = nullptr;
+                bufSize_ = bufOffs_ = frameSize_ = 0;
+                fcs_ = HDLC_FCS_INIT;
+                escaped_ = false;
+            } else if (c == HDLC_ESCAPE) {
+                escaped_ = true;
+            } else {
+                if (escaped_) {
+                    c ^= HDLC_TRANS;
+                    escaped_ = false;
+                }
+                if (bufOffs_ == bufSize_) {
+                    buf_ = sink_->frameBuffer(&bufSize_);
+                    bufOffs_ = 0;
+                }
+                buf_[bufOffs_++] = c;
+                ++frameSize_;
+                fcs_ = refFcsByte(fcs_, c);
+            }
+        }
+    }
+
+private:
+    HdlcFrameSink* sink_;
+    uint8_t* buf_;
+    size_t bufSize_;
+    size_t bufOffs_;
+    size_t frameSize_;
+    uint16_t fcs_;
+    bool escaped_;
+
+    static uint16_t refFcsByte(uint16_t fcs, uint8_t c) {
+        static uint16_t table[256] = {};
+        if (!table[1]) {
+            for (unsigned i = 0; i < 256; ++i) {
+                uint16_t v = i;
+                for (int j = 0; j < 8; ++j) {
+                    v = (v & 1) ? (v >> 1) ^ 0x8408 : v >> 1;
+                }
+                table[i] = v;
+            }
+        }
+        return (fcs >> 8) ^ table[(fcs ^ c) & 0xff];
+    }
+};
+
+// Generates a stream of frames resembling a PPP session: a few LCP/IPCP frames with all control
+// characters escaped, followed by IP frames of various sizes
+std::string makeTraffic(std::mt19937& rng, size_t frameCount, std::vector<std::string>* frames) {
+    std::string stream;
+    for (size_t i = 0; i < frameCount; ++i) {
+        std::string f = "\xff\x03";
+        uint32_t accm = 0;
+        if (i < 4) {
+            f.append("\xc0\x21\x01", 3);
+            f.push_back(i + 1);
+            f.append("\x00\x0e\x02\x06\x00\x00\x00\x00\x05\x06", 10);
+            f.append(randomData(rng, 4));
+            accm = 0xffffffff;
+        } else {
+            f.append("\x00\x21", 2);
+            const size_t sizes[] = { 40, 52, 576, 1400, 1500 };
+            f.append(randomData(rng, sizes[rng() % (sizeof(sizes) / sizeof(sizes[0]))]));
+        }
+        frames->push_back(f);
+        stream.append(encodeFrame(f, accm));
+    }
+    return stream;
+}
+
+// Feeds the data in chunks of random size, similarly to the CMUX channel
+template<typename DecoderT>
+void feed(DecoderT& decoder, const std::string& data, std::mt19937& rng, size_t maxChunk = 127) {
+    size_t offs = 0;
+    while (offs < data.size()) {
+        const size_t n = std::min<size_t>(1 + rng() % maxChunk, data.size() - offs);
+        decoder.input((const uint8_t*)data.data() + offs, n);
+        offs += n;
+    }
+}
+
+} // namespace
+
+TEST_CASE("hdlcFcs16()") {
+    SECTION("computes the FCS of the test vector") {
+        const std::string s = "123456789";
+        CHECK((uint16_t)(hdlcFcs16(HDLC_FCS_INIT, (const uint8_t*)s.data(), s.size()) ^ 0xffff) == 0x906e);
+    }
+
+    SECTION("matches the bitwise implementation for any data size and alignment") {
+        std::mt19937 rng(1);
+        const auto data = randomData(rng, 300);
+        for (size_t offs = 0; offs < 4; ++offs) {
+            for (size_t size = 0; size < 260; ++size) {
+                const uint16_t fcs = hdlcFcs16(HDLC_FCS_INIT, (const uint8_t*)data.data() + offs, size);
+                CHECK(fcs == refFcs16(HDLC_FCS_INIT, data.substr(offs, size)));
+            }
+        }
+    }
+
+    SECTION("produces the good FCS value over a frame with its FCS") {
+        std::string data("\xff\x03\xc0\x21\x01\x01\x00\x04", 8);
+        const uint16_t fcs = refFcs16(HDLC_FCS_INIT, data) ^ 0xffff;
+        data.push_back(fcs & 0xff);
+        data.push_back(fcs >> 8);
+        CHECK(hdlcFcs16(HDLC_FCS_INIT, (const uint8_t*)data.data(), data.size()) == HDLC_FCS_GOOD);
+    }
+}
+
+TEST_CASE("hdlcFindSpecial()") {
+    std::mt19937 rng(2);
+    SECTION("finds the first special byte at any position and alignment") {
+        for (uint8_t special: { HDLC_FLAG, HDLC_ESCAPE }) {
+            for (size_t offs = 0; offs < 4; ++offs) {
+                for (size_t pos = 0; pos < 40; ++pos) {
+                    std::string s(64, 'a');
+                    s[offs + pos] = special;
+                    CHECK(hdlcFindSpecial((const uint8_t*)s.data() + offs, s.size() - offs) == pos);
+                }
+            }
+        }
+    }
+
+    SECTION("returns the data size if there are no special bytes") {
+        const std::string s(37, 'x');
+        CHECK(hdlcFindSpecial((const uint8_t*)s.data(), s.size()) == s.size());
+        CHECK(hdlcFindSpecial((const uint8_t*)s.data(), 0) == 0);
+    }
+
+    SECTION("treats the control characters according to the map") {
+        std::string s(32, 'a');
+        s[9] = 0x11;
+        s[20] = 0x13;
+        CHECK(hdlcFindSpecial((const uint8_t*)s.data(), s.size()) == s.size());
+        CHECK(hdlcFindSpecial((const uint8_t*)s.data(), s.size(), 1u << 0x13) == 20);
+        CHECK(hdlcFindSpecial((const uint8_t*)s.data(), s.size(), 0xffffffff) == 9);
+    }
+
+    SECTION("matches a bytewise search on random data") {
+        for (int i = 0; i < 1000; ++i) {
+            const auto s = randomData(rng, 1 + rng() % 100);
+            const uint32_t accm = (i & 1) ? rng() : 0;
+            size_t expected = s.size();
+            for (size_t j = 0; j < s.size(); ++j) {
+                const uint8_t c = s[j];
+                if (c == HDLC_FLAG || c == HDLC_ESCAPE || (c < 0x20 && (accm & (1u << c)))) {
+                    expected = j;
+                    break;
+                }
+            }
+            CHECK(hdlcFindSpecial((const uint8_t*)s.data(), s.size(), accm) == expected);
+        }
+    }
+}
+
+TEST_CASE("HdlcDecoder") {
+    std::mt19937 rng(3);
+    TestSink sink;
+    HdlcDecoder decoder(&sink, 1600);
+
+    SECTION("decodes frames split into chunks of any size") {
+        std::vector<std::string> frames;
+        const auto stream = makeTraffic(rng, 50, &frames);
+        feed(decoder, stream, rng);
+        CHECK(sink.errors.empty());
+        CHECK(sink.frames == frames);
+    }
+
+    SECTION("decodes frames fed a byte at a time") {
+        std::vector<std::string> frames;
+        const auto stream = makeTraffic(rng, 10, &frames);
+        feed(decoder, stream, rng, 1);
+        CHECK(sink.frames == frames);
+    }
+
+    SECTION("decodes frames that share the flag") {
+        auto s = encodeFrame("abcdef");
+        s.pop_back();
+        s += encodeFrame("\x7e\x7d\x01");
+        decoder.input((const uint8_t*)s.data(), s.size());
+        CHECK(sink.frames == std::vector<std::string>({ "abcdef", "\x7e\x7d\x01" }));
+    }
+
+    SECTION("drops a frame with an invalid FCS") {
+        auto s = encodeFrame("hello world");
+        s[3] ^= 0x01;
+        s += encodeFrame("ok");
+        decoder.input((const uint8_t*)s.data(), s.size());
+        CHECK(sink.frames == std::vector<std::string>({ "ok" }));
+        CHECK(sink.errors == std::vector<int>({ SYSTEM_ERROR_BAD_DATA }));
+    }
+
+    SECTION("drops an aborted frame") {
+        const std::string s = "\x7e" "abc\x7d\x7e";
+        decoder.input((const uint8_t*)s.data(), s.size());
+        CHECK(sink.frames.empty());
+        CHECK(sink.errors == std::vector<int>({ SYSTEM_ERROR_ABORTED }));
+    }
+
+    SECTION("ignores empty frames") {
+        const std::string s = "\x7e\x7e\x7e";
+        decoder.input((const uint8_t*)s.data(), s.size());
+        CHECK(sink.frames.empty());
+        CHECK(sink.errors.empty());
+        CHECK(decoder.isIdle());
+    }
+
+    SECTION("discards unescaped control characters that are in the map") {
+        auto s = encodeFrame("payload", 0);
+        s.insert(3, "\x11\x13");
+        decoder.accm(0);
+        decoder.input((const uint8_t*)s.data(), s.size());
+        CHECK(sink.errors == std::vector<int>({ SYSTEM_ERROR_BAD_DATA }));
+        sink.errors.clear();
+        decoder.accm((1u << 0x11) | (1u << 0x13));
+        decoder.input((const uint8_t*)s.data(), s.size());
+        CHECK(sink.frames == std::vector<std::string>({ "payload" }));
+        CHECK(sink.errors.empty());
+    }
+
+    SECTION("drops a frame exceeding the maximum size and resynchronizes on the next flag") {
+        const auto big = encodeFrame(std::string(1700, 'x'), 0);
+        const auto small = encodeFrame("small", 0);
+        const auto s = big + small;
+        feed(decoder, s, rng);
+        CHECK(sink.errors == std::vector<int>({ SYSTEM_ERROR_TOO_LARGE }));
+        CHECK(sink.frames == std::vector<std::string>({ "small" }));
+    }
+
+    SECTION("drops a frame if no buffer can be allocated") {
+        TestSink small(16, 2);
+        HdlcDecoder d(&small, 1600);
+        const auto s = encodeFrame(std::string(100, 'x'), 0) + encodeFrame("fits", 0);
+        d.input((const uint8_t*)s.data(), s.size());
+        CHECK(small.errors == std::vector<int>({ SYSTEM_ERROR_NO_MEMORY }));
+        CHECK(small.frames == std::vector<std::string>({ "fits" }));
+    }
+
+    SECTION("reports whether it's between frames") {
+        CHECK(!decoder.isIdle());
+        const std::string s = "\x7e";
+        decoder.input((const uint8_t*)s.data(), s.size());
+        CHECK(decoder.isIdle());
+        decoder.input((const uint8_t*)"a", 1);
+        CHECK(!decoder.isIdle());
+        decoder.reset();
+        CHECK(sink.errors == std::vector<int>({ SYSTEM_ERROR_CANCELLED }));
+        CHECK(!decoder.isIdle());
+    }
+
+    SECTION("produces the same frames as a bytewise decoder") {
+        std::vector<std::string> frames;
+        const auto stream = makeTraffic(rng, 100, &frames);
+        TestSink refSink;
+        RefDecoder ref(&refSink);
+        std::mt19937 rng1(4), rng2(4);
+        feed(ref, stream, rng1);
+        feed(decoder, stream, rng2);
+        CHECK(sink.frames == refSink.frames);
+    }
+}
+
+TEST_CASE("FlowControlHysteresis") {
+    FlowControlHysteresis fc(2, 6);
+    CHECK(fc.update(10) == 0);
+    CHECK(fc.update(2) == 1);
+    CHECK(fc.isStopped());
+    CHECK(fc.update(1) == 0);
+    // The flow is not resumed until the high threshold is reached
+    CHECK(fc.update(3) == 0);
+    CHECK(fc.update(5) == 0);
+    CHECK(fc.isStopped());
+    CHECK(fc.update(6) == -1);
+    CHECK(!fc.isStopped());
+    CHECK(fc.update(7) == 0);
+    CHECK(fc.stop());
+    CHECK(!fc.stop());
+    CHECK(fc.resume());
+    CHECK(!fc.resume());
+}
+
+TEST_CASE("HdlcDecoder benchmark", "[.benchmark]") {
+    std::mt19937 rng(5);
+    std::vector<std::string> frames;
+    std::string stream;
+    while (stream.size() < 4 * 1024 * 1024) {
+        stream += makeTraffic(rng, 100, &frames);
+    }
+    typedef std::chrono::duration<double> Seconds;
+    const unsigned iterations = 5;
+    std::mt19937 rng1(6), rng2(6);
+    TestSink refSink(1536);
+    RefDecoder ref(&refSink);
+    auto t1 = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < iterations; ++i) {
+        feed(ref, stream, rng1);
+        refSink.frames.clear();
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    TestSink sink(1536);
+    HdlcDecoder decoder(&sink, 1600);
+    for (unsigned i = 0; i < iterations; ++i) {
+        feed(decoder, stream, rng2);
+        sink.frames.clear();
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    const double mb = (double)stream.size() * iterations / (1024 * 1024);
+    WARN("Bytewise decoder: " << mb / Seconds(t2 - t1).count() << " MB/s");
+    WARN("HdlcDecoder: " << mb / Seconds(t3 - t2).count() << " MB/s");
+}
@@ -0,0 +1,565 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "spi_hal.h"
+#include "gpio_hal.h"
+#include "concurrent_hal.h"
+#include "hal_irq_flag.h"
+#include "system_error.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+
+namespace {
+
+const auto WAIT_TIMEOUT = std::chrono::seconds(5);
+
+// Simulated interface. The DMA transfers are completed immediately unless the interface is paused,
+// in which case they are completed by resume()
+struct Spi {
+    hal_spi_dma_user_callback callback;
+    const void* tx;
+    void* rx;
+    uint32_t length;
+    bool active;
+    bool paused;
+    uint8_t clockDivider;
+    uint8_t setDefault;
+    uint8_t dataMode;
+};
+
+// State shared by the test and the worker threads
+class Bus {
+public:
+    Spi spi[HAL_PLATFORM_SPI_NUM];
+    std::vector<std::string> log;
+    std::vector<std::string> errors; // Failed checks in the worker threads
+    std::thread::id lockOwner[HAL_PLATFORM_SPI_NUM];
+    unsigned lockCount[HAL_PLATFORM_SPI_NUM];
+    bool enabled = true;
+    hal_spi_mode_t mode = SPI_MODE_MASTER;
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    void reset() {
+        std::lock_guard<std::mutex> lk(mutex);
+        memset(spi, 0, sizeof(spi));
+        for (auto& s: spi) {
+            s.setDefault = 1;
+        }
+        log.clear();
+        errors.clear();
+        for (unsigned i = 0; i < HAL_PLATFORM_SPI_NUM; ++i) {
+            lockOwner[i] = std::thread::id();
+            lockCount[i] = 0;
+        }
+        enabled = true;
+        mode = SPI_MODE_MASTER;
+    }
+
+    void addLog(const char* fmt, unsigned v) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), fmt, v);
+        log.push_back(buf);
+        cond.notify_all();
+    }
+
+    std::vector<std::string> takeLog() {
+        std::lock_guard<std::mutex> lk(mutex);
+        auto l = std::move(log);
+        log.clear();
+        return l;
+    }
+
+    // Waits until the specified entry is the last one in the log
+    bool waitLog(const std::string& entry) {
+        std::unique_lock<std::mutex> lk(mutex);
+        return cond.wait_for(lk, WAIT_TIMEOUT, [&]() {
+            return !log.empty() && log.back() == entry;
+        });
+    }
+
+    void pause(hal_spi_interface_t i) {
+        std::lock_guard<std::mutex> lk(mutex);
+        spi[i].paused = true;
+    }
+
+    // Completes the pending transfer and the subsequent ones
+    void resume(hal_spi_interface_t i) {
+        hal_spi_dma_user_callback cb = nullptr;
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            spi[i].paused = false;
+            if (spi[i].active) {
+                cb = complete(i);
+            }
+        }
+        if (cb) {
+            cb(); // Simulated ISR
+        }
+    }
+
+    // Waits until a transfer is started on a paused interface
+    bool waitActive(hal_spi_interface_t i) {
+        std::unique_lock<std::mutex> lk(mutex);
+        return cond.wait_for(lk, WAIT_TIMEOUT, [&]() { return spi[i].active; });
+    }
+
+    hal_spi_dma_user_callback complete(hal_spi_interface_t i) {
+        auto& s = spi[i];
+        if (s.rx) {
+            if (s.tx) {
+                memcpy(s.rx, s.tx, s.length); // Loopback
+            } else {
+                memset(s.rx, 0, s.length);
+            }
+        }
+        s.active = false;
+        return s.callback;
+    }
+
+    void checkLocked(hal_spi_interface_t i, const char* func) {
+        if (lockOwner[i] != std::this_thread::get_id()) {
+            errors.push_back(std::string(func) + "() called without holding the bus lock");
+        }
+    }
+};
+
+Bus g_bus;
+
+std::recursive_mutex g_irqMutex;
+std::recursive_mutex g_busMutex[HAL_PLATFORM_SPI_NUM];
+
+struct Semaphore {
+    std::mutex mutex;
+    std::condition_variable cond;
+    unsigned count;
+    unsigned maxCount;
+};
+
+// Collects completion results
+class Completions {
+public:
+    struct Result {
+        std::string name;
+        int error;
+    };
+
+    void add(const std::string& name, int error) {
+        std::lock_guard<std::mutex> lk(mutex_);
+        results_.push_back({ name, error });
+        cond_.notify_all();
+    }
+
+    bool wait(size_t count) {
+        std::unique_lock<std::mutex> lk(mutex_);
+        return cond_.wait_for(lk, WAIT_TIMEOUT, [&]() { return results_.size() >= count; });
+    }
+
+    std::vector<Result> results() {
+        std::lock_guard<std::mutex> lk(mutex_);
+        return results_;
+    }
+
+    std::vector<std::string> names() {
+        std::lock_guard<std::mutex> lk(mutex_);
+        std::vector<std::string> n;
+        for (const auto& r: results_) {
+            n.push_back(r.name);
+        }
+        return n;
+    }
+
+private:
+    std::vector<Result> results_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
+
+struct Transaction {
+    hal_spi_transaction_t hal;
+    std::vector<hal_spi_transaction_segment_t> segs;
+    Completions* completions;
+    std::string name;
+    std::function<void()> onDone;
+
+    Transaction(Completions* c, const std::string& n, hal_pin_t cs, uint8_t clockDiv) :
+            hal(),
+            completions(c),
+            name(n) {
+        hal.size = sizeof(hal);
+        hal.cs_pin = cs;
+        hal.clock_divider = clockDiv;
+        hal.bit_order = MSBFIRST;
+        hal.data_mode = SPI_MODE0;
+        hal.callback = [](hal_spi_transaction_t* t, int error, void* ctx) {
+            auto self = static_cast<Transaction*>(ctx);
+            if (self->onDone) {
+                self->onDone();
+            }
+            self->completions->add(self->name, error);
+        };
+        hal.context = this;
+    }
+
+    Transaction& add(const void* tx, void* rx, size_t length) {
+        segs.push_back({ tx, rx, (uint32_t)length });
+        return *this;
+    }
+
+    hal_spi_transaction_t* get() {
+        hal.segments = segs.data();
+        hal.segment_count = segs.size();
+        return &hal;
+    }
+};
+
+} // namespace
+
+// Mock HAL and concurrency functions
+extern "C" {
+
+int HAL_disable_irq() {
+    g_irqMutex.lock();
+    return 1;
+}
+
+void HAL_enable_irq(int mask) {
+    g_irqMutex.unlock();
+}
+
+} // extern "C"
+
+os_result_t os_thread_create(os_thread_t* thread, const char* name, os_thread_prio_t priority, os_thread_fn_t fun,
+        void* param, size_t stackSize) {
+    // The worker thread never exits
+    auto t = new std::thread(fun, param);
+    t->detach();
+    *thread = t;
+    return 0;
+}
+
+os_result_t os_thread_exit(os_thread_t thread) {
+    return 0;
+}
+
+int os_semaphore_create(os_semaphore_t* sem, unsigned maxCount, unsigned initCount) {
+    // Never destroyed, as the worker thread may be waiting on it when the process exits
+    auto s = new Semaphore();
+    s->count = initCount;
+    s->maxCount = maxCount;
+    *sem = s;
+    return 0;
+}
+
+int os_semaphore_destroy(os_semaphore_t sem) {
+    delete static_cast<Semaphore*>(sem);
+    return 0;
+}
+
+int os_semaphore_take(os_semaphore_t sem, system_tick_t timeout, bool reserved) {
+    auto s = static_cast<Semaphore*>(sem);
+    std::unique_lock<std::mutex> lk(s->mutex);
+    const auto ready = [s]() { return s->count > 0; };
+    if (timeout == CONCURRENT_WAIT_FOREVER) {
+        s->cond.wait(lk, ready);
+    } else if (!s->cond.wait_for(lk, std::chrono::milliseconds(timeout), ready)) {
+        return 1;
+    }
+    --s->count;
+    return 0;
+}
+
+int os_semaphore_give(os_semaphore_t sem, bool reserved) {
+    auto s = static_cast<Semaphore*>(sem);
+    std::lock_guard<std::mutex> lk(s->mutex);
+    if (s->count >= s->maxCount) {
+        return 1;
+    }
+    ++s->count;
+    s->cond.notify_one();
+    return 0;
+}
+
+int32_t hal_spi_acquire(hal_spi_interface_t spi, const hal_spi_acquire_config_t* conf) {
+    g_busMutex[spi].lock();
+    std::lock_guard<std::mutex> lk(g_bus.mutex);
+    if (g_bus.lockCount[spi]++ == 0) {
+        g_bus.lockOwner[spi] = std::this_thread::get_id();
+        g_bus.addLog("lock%u", spi);
+    }
+    return 0;
+}
+
+int32_t hal_spi_release(hal_spi_interface_t spi, void* reserved) {
+    {
+        std::lock_guard<std::mutex> lk(g_bus.mutex);
+        if (--g_bus.lockCount[spi] == 0) {
+            g_bus.lockOwner[spi] = std::thread::id();
+            g_bus.addLog("unlock%u", spi);
+        }
+    }
+    g_busMutex[spi].unlock();
+    return 0;
+}
+
+void hal_gpio_write(hal_pin_t pin, uint8_t value) {
+    std::lock_guard<std::mutex> lk(g_bus.mutex);
+    g_bus.addLog(value ? "cs%u:1" : "cs%u:0", pin);
+}
+
+void hal_spi_transfer_dma(hal_spi_interface_t spi, const void* tx_buffer, void* rx_buffer, uint32_t length,
+        hal_spi_dma_user_callback userCallback) {
+    hal_spi_dma_user_callback cb = nullptr;
+    {
+        std::lock_guard<std::mutex> lk(g_bus.mutex);
+        g_bus.checkLocked(spi, "hal_spi_transfer_dma");
+        auto& s = g_bus.spi[spi];
+        if (s.active) {
+            g_bus.errors.push_back("DMA transfer started while another one is in progress");
+        }
+        s.tx = tx_buffer;
+        s.rx = rx_buffer;
+        s.length = length;
+        s.callback = userCallback;
+        s.active = true;
+        g_bus.addLog("xfer:%u", length);
+        if (!s.paused) {
+            cb = g_bus.complete(spi);
+        }
+    }
+    if (cb) {
+        cb(); // Simulated ISR
+    }
+}
+
+void hal_spi_transfer_dma_cancel(hal_spi_interface_t spi) {
+    std::lock_guard<std::mutex> lk(g_bus.mutex);
+    g_bus.spi[spi].active = false;
+    g_bus.spi[spi].callback = nullptr;
+    g_bus.addLog("cancel%u", spi);
+}
+
+int32_t hal_spi_set_settings(hal_spi_interface_t spi, uint8_t set_default, uint8_t clockdiv, uint8_t order,
+        uint8_t mode, void* reserved) {
+    std::lock_guard<std::mutex> lk(g_bus.mutex);
+    g_bus.checkLocked(spi, "hal_spi_set_settings");
+    auto& s = g_bus.spi[spi];
+    s.setDefault = set_default;
+    s.clockDivider = set_default ? SPI_CLOCK_DIV16 : clockdiv;
+    s.dataMode = mode;
+    g_bus.addLog("set:%u", s.clockDivider);
+    return 0;
+}
+
+void hal_spi_info(hal_spi_interface_t spi, hal_spi_info_t* info, void* reserved) {
+    std::lock_guard<std::mutex> lk(g_bus.mutex);
+    info->enabled = g_bus.enabled;
+    info->mode = g_bus.mode;
+}
+
+TEST_CASE("hal_spi_queue_transaction()") {
+    g_bus.reset();
+    uint8_t cmd = 0x9f;
+    uint8_t tx[16] = {};
+    uint8_t rx[16] = {};
+    for (size_t i = 0; i < sizeof(tx); ++i) {
+        tx[i] = i + 1;
+    }
+    Completions done;
+
+    SECTION("validates the arguments") {
+        Transaction t(&done, "a", PIN_INVALID, SPI_CLOCK_DIV8);
+        t.add(tx, rx, 0);
+        CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, t.get(), nullptr) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        t.segs.clear();
+        CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, t.get(), nullptr) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, nullptr, nullptr) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        t.add(tx, rx, sizeof(tx));
+        CHECK(hal_spi_queue_transaction((hal_spi_interface_t)HAL_PLATFORM_SPI_NUM, t.get(), nullptr) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        g_bus.mode = SPI_MODE_SLAVE;
+        CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, t.get(), nullptr) == SYSTEM_ERROR_INVALID_STATE);
+        g_bus.mode = SPI_MODE_MASTER;
+        g_bus.enabled = false;
+        CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, t.get(), nullptr) == SYSTEM_ERROR_INVALID_STATE);
+        CHECK(g_bus.takeLog().empty());
+        CHECK(done.results().empty());
+    }
+
+    SECTION("transfers all segments with the chip select asserted and the bus locked") {
+        Transaction t(&done, "a", 5, SPI_CLOCK_DIV8);
+        t.add(&cmd, nullptr, 1).add(tx, rx, sizeof(tx)).add(nullptr, rx, 4);
+        CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, t.get(), nullptr) == 0);
+        REQUIRE(g_bus.waitLog("unlock0"));
+        CHECK(g_bus.takeLog() == std::vector<std::string>({ "lock0", "set:16", "cs5:0", "xfer:1", "xfer:16", "xfer:4", "cs5:1", "unlock0" }));
+        REQUIRE(done.wait(1));
+        CHECK(done.results()[0].error == 0);
+        CHECK(t.hal.next == nullptr);
+        CHECK(memcmp(rx, "\0\0\0\0", 4) == 0);
+        CHECK(memcmp(rx + 4, tx + 4, sizeof(tx) - 4) == 0);
+        CHECK(g_bus.errors.empty());
+    }
+
+    SECTION("performs queued transactions in order and reconfigures the bus only when needed") {
+        Transaction a(&done, "a", 1, SPI_CLOCK_DIV8);
+        Transaction b(&done, "b", 2, SPI_CLOCK_DIV8);
+        Transaction c(&done, "c", 3, SPI_CLOCK_DIV64);
+        Transaction d(&done, "d", PIN_INVALID, SPI_CLOCK_DIV64);
+        a.add(tx, nullptr, 2);
+        b.add(tx, nullptr, 3);
+        c.add(tx, nullptr, 4);
+        d.add(tx, nullptr, 5);
+        d.hal.data_mode = SPI_MODE3;
+        g_bus.pause(HAL_SPI_INTERFACE1);
+        CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, a.get(), nullptr) == 0);
+        REQUIRE(g_bus.waitActive(HAL_SPI_INTERFACE1));
+        CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, b.get(), nullptr) == 0);
+        CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, c.get(), nullptr) == 0);
+        CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, d.get(), nullptr) == 0);
+        g_bus.resume(HAL_SPI_INTERFACE1);
+        REQUIRE(g_bus.waitLog("unlock0"));
+        CHECK(g_bus.takeLog() == std::vector<std::string>({
+                "lock0", "set:16", "cs1:0", "xfer:2", "cs1:1",
+                "cs2:0", "xfer:3", "cs2:1",
+                "set:40", "cs3:0", "xfer:4", "cs3:1",
+                "set:40", "xfer:5", "unlock0" }));
+        REQUIRE(done.wait(4));
+        CHECK(done.names() == std::vector<std::string>({ "a", "b", "c", "d" }));
+        CHECK(g_bus.spi[HAL_SPI_INTERFACE1].dataMode == SPI_MODE3);
+
+        SECTION("the settings are applied again after the bus is unlocked") {
+            CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, d.get(), nullptr) == 0);
+            REQUIRE(g_bus.waitLog("unlock0"));
+            CHECK(g_bus.takeLog() == std::vector<std::string>({ "lock0", "set:40", "xfer:5", "unlock0" }));
+        }
+    }
+
+    SECTION("waits for other users of the bus to release the lock") {
+        Transaction a(&done, "a", 1, SPI_CLOCK_DIV8);
+        a.add(tx, nullptr, 8);
+        hal_spi_acquire(HAL_SPI_INTERFACE1, nullptr);
+        CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, a.get(), nullptr) == 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK(g_bus.takeLog() == std::vector<std::string>({ "lock0" }));
+        hal_spi_release(HAL_SPI_INTERFACE1, nullptr);
+        REQUIRE(done.wait(1));
+        REQUIRE(g_bus.waitLog("unlock0"));
+        CHECK(g_bus.takeLog() == std::vector<std::string>({ "unlock0", "lock0", "set:16", "cs1:0", "xfer:8", "cs1:1", "unlock0" }));
+    }
+
+    SECTION("a transaction can be queued from the completion callback") {
+        Transaction a(&done, "a", 1, SPI_CLOCK_DIV8);
+        Transaction b(&done, "b", 2, SPI_CLOCK_DIV8);
+        a.add(tx, nullptr, 8);
+        b.add(tx, nullptr, 8);
+        int result = -1;
+        a.onDone = [&]() {
+            result = hal_spi_queue_transaction(HAL_SPI_INTERFACE1, b.get(), nullptr);
+        };
+        CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, a.get(), nullptr) == 0);
+        REQUIRE(done.wait(2));
+        CHECK(result == 0);
+        CHECK(done.names() == std::vector<std::string>({ "a", "b" }));
+        REQUIRE(g_bus.waitLog("unlock0"));
+        CHECK(g_bus.takeLog() == std::vector<std::string>({ "lock0", "set:16", "cs1:0", "xfer:8", "cs1:1", "cs2:0", "xfer:8", "cs2:1", "unlock0" }));
+    }
+
+    SECTION("interfaces have independent queues") {
+        Transaction a(&done, "a", 1, SPI_CLOCK_DIV8);
+        Transaction b(&done, "b", 2, SPI_CLOCK_DIV8);
+        a.add(tx, nullptr, 8);
+        b.add(tx, nullptr, 8);
+        g_bus.pause(HAL_SPI_INTERFACE1);
+        CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, a.get(), nullptr) == 0);
+        REQUIRE(g_bus.waitActive(HAL_SPI_INTERFACE1));
+        CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE2, b.get(), nullptr) == 0);
+        REQUIRE(done.wait(1));
+        CHECK(done.names() == std::vector<std::string>({ "b" }));
+        g_bus.resume(HAL_SPI_INTERFACE1);
+        REQUIRE(done.wait(2));
+        CHECK(done.names() == std::vector<std::string>({ "b", "a" }));
+    }
+
+    SECTION("fails the transaction if a transfer doesn't complete") {
+        Transaction a(&done, "a", 1, SPI_CLOCK_DIV8);
+        a.add(tx, nullptr, 8).add(tx, nullptr, 4);
+        g_bus.pause(HAL_SPI_INTERFACE1);
+        CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, a.get(), nullptr) == 0);
+        REQUIRE(done.wait(1));
+        CHECK(done.results()[0].error == SYSTEM_ERROR_TIMEOUT);
+        REQUIRE(g_bus.waitLog("unlock0"));
+        CHECK(g_bus.takeLog() == std::vector<std::string>({ "lock0", "set:16", "cs1:0", "xfer:8", "cancel0", "cs1:1", "unlock0" }));
+        g_bus.resume(HAL_SPI_INTERFACE1);
+    }
+
+    CHECK(g_bus.errors.empty());
+}
+
+TEST_CASE("hal_spi_cancel_transactions()") {
+    g_bus.reset();
+    uint8_t tx[8] = {};
+    Completions done;
+    Transaction a(&done, "a", 1, SPI_CLOCK_DIV8);
+    Transaction b(&done, "b", 2, SPI_CLOCK_DIV8);
+    a.add(tx, nullptr, sizeof(tx)).add(tx, nullptr, sizeof(tx));
+    b.add(tx, nullptr, sizeof(tx));
+
+    SECTION("does nothing if the queue is empty") {
+        CHECK(hal_spi_cancel_transactions(HAL_SPI_INTERFACE1, nullptr) == 0);
+        CHECK(g_bus.takeLog().empty());
+        CHECK(done.results().empty());
+    }
+
+    SECTION("cancels the current and all queued transactions") {
+        g_bus.pause(HAL_SPI_INTERFACE1);
+        CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, a.get(), nullptr) == 0);
+        REQUIRE(g_bus.waitActive(HAL_SPI_INTERFACE1));
+        CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, b.get(), nullptr) == 0);
+        CHECK(hal_spi_cancel_transactions(HAL_SPI_INTERFACE1, nullptr) == 0);
+        // The queued transaction is cancelled immediately
+        CHECK(done.names() == std::vector<std::string>({ "b" }));
+        // The current one is completed once the DMA transfer of its current segment is finished
+        g_bus.resume(HAL_SPI_INTERFACE1);
+        REQUIRE(done.wait(2));
+        REQUIRE(g_bus.waitLog("unlock0"));
+        CHECK(g_bus.takeLog() == std::vector<std::string>({ "lock0", "set:16", "cs1:0", "xfer:8", "cs1:1", "unlock0" }));
+        const auto r = done.results();
+        CHECK(r[0].error == SYSTEM_ERROR_CANCELLED);
+        CHECK(r[1].name == "a");
+        CHECK(r[1].error == SYSTEM_ERROR_CANCELLED);
+
+        SECTION("the interface can be used again") {
+            CHECK(hal_spi_queue_transaction(HAL_SPI_INTERFACE1, b.get(), nullptr) == 0);
+            REQUIRE(done.wait(3));
+            CHECK(done.results()[2].error == 0);
+            REQUIRE(g_bus.waitLog("unlock0"));
+            CHECK(g_bus.takeLog() == std::vector<std::string>({ "lock0", "set:16", "cs2:0", "xfer:8", "cs2:1", "unlock0" }));
+        }
+    }
+
+    CHECK(g_bus.errors.empty());
+}
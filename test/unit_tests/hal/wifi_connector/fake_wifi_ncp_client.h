@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "wifi_ncp_client.h"
+
+#include "system_error.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace particle {
+
+namespace test {
+
+/**
+ * WiFi NCP client that simulates a set of access points.
+ *
+ * The client doesn't wait for anything. Instead, it keeps track of the time each operation would
+ * take on a real device.
+ */
+class FakeWifiNcpClient: public WifiNcpClient {
+public:
+    // Durations of the simulated operations in milliseconds
+    static constexpr unsigned CONNECT_TIME = 1500;
+    static constexpr unsigned CONNECT_TIMEOUT = 5000;
+    static constexpr unsigned SCAN_TIME = 3000;
+    static constexpr unsigned CHANNEL_SCAN_TIME = 250;
+    static constexpr unsigned COMMAND_TIME = 10;
+
+    struct AccessPoint {
+        std::string ssid;
+        MacAddress bssid;
+        int channel;
+        int rssi;
+        std::string password;
+    };
+
+    explicit FakeWifiNcpClient(int ncpId = PLATFORM_NCP_ESP32) :
+            ncpId_(ncpId),
+            connected_(nullptr),
+            elapsed_(0),
+            scanCount_(0),
+            channelScanCount_(0),
+            connectCount_(0),
+            channelScanSupported_(true) {
+    }
+
+    FakeWifiNcpClient& addAccessPoint(const std::string& ssid, const MacAddress& bssid, int channel, int rssi,
+            const std::string& password) {
+        aps_.push_back(AccessPoint{ ssid, bssid, channel, rssi, password });
+        return *this;
+    }
+
+    void removeAccessPoint(const MacAddress& bssid) {
+        aps_.erase(std::remove_if(aps_.begin(), aps_.end(), [&bssid](const AccessPoint& ap) {
+            return ap.bssid == bssid;
+        }), aps_.end());
+    }
+
+    void channelScanSupported(bool supported) {
+        channelScanSupported_ = supported;
+    }
+
+    // Time spent in the simulated operations
+    unsigned elapsed() const {
+        return elapsed_;
+    }
+
+    unsigned scanCount() const {
+        return scanCount_;
+    }
+
+    unsigned channelScanCount() const {
+        return channelScanCount_;
+    }
+
+    unsigned connectCount() const {
+        return connectCount_;
+    }
+
+    const AccessPoint* connectedAccessPoint() const {
+        return connected_;
+    }
+
+    void resetStats() {
+        elapsed_ = 0;
+        scanCount_ = 0;
+        channelScanCount_ = 0;
+        connectCount_ = 0;
+        connected_ = nullptr;
+    }
+
+    int connect(const char* ssid, const MacAddress& bssid, WifiSecurity sec, const WifiCredentials& cred) override {
+        if (connected_) {
+            return SYSTEM_ERROR_INVALID_STATE;
+        }
+        ++connectCount_;
+        const AccessPoint* ap = nullptr;
+        for (const auto& a: aps_) {
+            if (a.ssid != ssid || (bssid != INVALID_MAC_ADDRESS && a.bssid != bssid)) {
+                continue;
+            }
+            // ESP32 connects to the first access point it finds, other NCPs pick the strongest one
+            if (!ap || (ncpId_ != PLATFORM_NCP_ESP32 && a.rssi > ap->rssi)) {
+                ap = &a;
+            }
+        }
+        const char* pwd = (cred.type() == WifiCredentials::PASSWORD) ? cred.password() : "";
+        if (!ap || ap->password != pwd) {
+            elapsed_ += CONNECT_TIMEOUT;
+            return SYSTEM_ERROR_NOT_FOUND;
+        }
+        elapsed_ += CONNECT_TIME;
+        connected_ = ap;
+        return 0;
+    }
+
+    int getNetworkInfo(WifiNetworkInfo* info) override {
+        if (!connected_) {
+            return SYSTEM_ERROR_INVALID_STATE;
+        }
+        elapsed_ += COMMAND_TIME;
+        *info = WifiNetworkInfo().ssid(connected_->ssid.c_str()).bssid(connected_->bssid)
+                .channel(connected_->channel).rssi(connected_->rssi);
+        return 0;
+    }
+
+    int scan(WifiScanCallback callback, void* data) override {
+        ++scanCount_;
+        elapsed_ += SCAN_TIME;
+        for (const auto& ap: aps_) {
+            const int r = callback(toScanResult(ap), data);
+            if (r < 0) {
+                return r;
+            }
+        }
+        return 0;
+    }
+
+    int scanChannel(const char* ssid, int channel, WifiScanCallback callback, void* data) override {
+        if (!channelScanSupported_) {
+            return WifiNcpClient::scanChannel(ssid, channel, callback, data);
+        }
+        ++channelScanCount_;
+        elapsed_ += CHANNEL_SCAN_TIME;
+        for (const auto& ap: aps_) {
+            if (ap.ssid != ssid || ap.channel != channel) {
+                continue;
+            }
+            const int r = callback(toScanResult(ap), data);
+            if (r < 0) {
+                return r;
+            }
+        }
+        return 0;
+    }
+
+    int disconnect() override {
+        connected_ = nullptr;
+        return 0;
+    }
+
+    NcpConnectionState connectionState() override {
+        return connected_ ? NcpConnectionState::CONNECTED : NcpConnectionState::DISCONNECTED;
+    }
+
+    int ncpId() const override {
+        return ncpId_;
+    }
+
+    int getMacAddress(MacAddress* addr) override {
+        return SYSTEM_ERROR_NOT_SUPPORTED;
+    }
+
+    int getFirmwareModuleVersion(uint16_t* ver) override {
+        return SYSTEM_ERROR_NOT_SUPPORTED;
+    }
+
+    int init(const NcpClientConfig& conf) override {
+        return 0;
+    }
+
+    void destroy() override {
+    }
+
+    int on() override {
+        return 0;
+    }
+
+    int off() override {
+        return 0;
+    }
+
+    int enable() override {
+        return 0;
+    }
+
+    void disable() override {
+    }
+
+    NcpState ncpState() override {
+        return NcpState::ON;
+    }
+
+    NcpPowerState ncpPowerState() override {
+        return NcpPowerState::ON;
+    }
+
+    int getFirmwareVersionString(char* buf, size_t size) override {
+        return SYSTEM_ERROR_NOT_SUPPORTED;
+    }
+
+    int updateFirmware(InputStream* file, size_t size) override {
+        return SYSTEM_ERROR_NOT_SUPPORTED;
+    }
+
+    int dataChannelWrite(int id, const uint8_t* data, size_t size) override {
+        return SYSTEM_ERROR_NOT_SUPPORTED;
+    }
+
+    int dataChannelFlowControl(bool state) override {
+        return 0;
+    }
+
+    void processEvents() override {
+    }
+
+    int checkParser() override {
+        return 0;
+    }
+
+    AtParser* atParser() override {
+        return nullptr;
+    }
+
+    void lock() override {
+    }
+
+    void unlock() override {
+    }
+
+private:
+    std::vector<AccessPoint> aps_;
+    int ncpId_;
+    const AccessPoint* connected_;
+    unsigned elapsed_;
+    unsigned scanCount_;
+    unsigned channelScanCount_;
+    unsigned connectCount_;
+    bool channelScanSupported_;
+
+    static WifiScanResult toScanResult(const AccessPoint& ap) {
+        return WifiScanResult().ssid(ap.ssid.c_str()).bssid(ap.bssid).channel(ap.channel).rssi(ap.rssi)
+                .security(ap.password.empty() ? WifiSecurity::NONE : WifiSecurity::WPA2_PSK);
+    }
+};
+
+} // namespace test
+
+} // namespace particle
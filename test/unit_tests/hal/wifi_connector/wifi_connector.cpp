@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "wifi_connector.h"
+
+#include "fake_wifi_ncp_client.h"
+
+using namespace particle;
+using particle::test::FakeWifiNcpClient;
+using spark::Vector;
+
+namespace {
+
+const MacAddress AP1 = { { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 } };
+const MacAddress AP2 = { { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 } };
+const MacAddress AP3 = { { 0x02, 0x00, 0x00, 0x00, 0x00, 0x03 } };
+const MacAddress OTHER_AP = { { 0x02, 0x00, 0x00, 0x00, 0x00, 0x04 } };
+
+WifiNetworkConfig network(const char* ssid, const char* password) {
+    return WifiNetworkConfig().ssid(ssid).security(WifiSecurity::WPA2_PSK)
+            .credentials(WifiCredentials().type(WifiCredentials::PASSWORD).password(password));
+}
+
+} // namespace
+
+TEST_CASE("WifiConnector") {
+    FakeWifiNcpClient client;
+    // Several unrelated networks are in range, the configured network is not the first one found
+    client.addAccessPoint("Other", OTHER_AP, 1, -40, "password");
+    client.addAccessPoint("Home", AP1, 6, -60, "secret");
+    client.addAccessPoint("Home", AP2, 6, -50, "secret");
+    Vector<WifiNetworkConfig> networks;
+    REQUIRE(networks.append(network("Home", "secret")));
+    WifiConnector connector(&client);
+    bool updated = false;
+
+    // Connect once to get the hints
+    REQUIRE(connector.connect(&networks, nullptr, &updated) == 0);
+    CHECK(updated);
+    CHECK(client.scanCount() == 1);
+    // The strongest access point is picked
+    CHECK(networks[0].bssid() == AP2);
+    CHECK(networks[0].channel() == 6);
+    const unsigned firstConnectTime = client.elapsed();
+    client.disconnect();
+    client.resetStats();
+
+    SECTION("reconnects without scanning") {
+        REQUIRE(connector.connect(&networks, "Home", &updated) == 0);
+        CHECK_FALSE(updated);
+        CHECK(client.scanCount() == 0);
+        CHECK(client.channelScanCount() == 0);
+        CHECK(client.connectedAccessPoint()->bssid == AP2);
+        CHECK(client.elapsed() == FakeWifiNcpClient::CONNECT_TIME);
+        CHECK(client.elapsed() < firstConnectTime);
+    }
+
+    SECTION("scans the last known channel if the access point is not available") {
+        client.removeAccessPoint(AP2);
+        REQUIRE(connector.connect(&networks, nullptr, &updated) == 0);
+        CHECK(updated);
+        CHECK(client.scanCount() == 0);
+        CHECK(client.channelScanCount() == 1);
+        CHECK(networks[0].bssid() == AP1);
+        CHECK(client.elapsed() == FakeWifiNcpClient::CONNECT_TIMEOUT + FakeWifiNcpClient::CHANNEL_SCAN_TIME +
+                FakeWifiNcpClient::CONNECT_TIME);
+    }
+
+    SECTION("scans all channels if the network is not found on the last known channel") {
+        client.removeAccessPoint(AP1);
+        client.removeAccessPoint(AP2);
+        client.addAccessPoint("Home", AP3, 11, -70, "secret");
+        REQUIRE(connector.connect(&networks, nullptr, &updated) == 0);
+        CHECK(updated);
+        CHECK(client.channelScanCount() == 1);
+        CHECK(client.scanCount() == 1);
+        CHECK(networks[0].bssid() == AP3);
+        CHECK(networks[0].channel() == 11);
+    }
+
+    SECTION("falls back to a full scan if the NCP can't scan a single channel") {
+        client.channelScanSupported(false);
+        client.removeAccessPoint(AP2);
+        REQUIRE(connector.connect(&networks, nullptr, &updated) == 0);
+        CHECK(client.scanCount() == 1);
+        CHECK(networks[0].bssid() == AP1);
+    }
+
+    SECTION("fails if no access point of the network is available") {
+        client.removeAccessPoint(AP1);
+        client.removeAccessPoint(AP2);
+        CHECK(connector.connect(&networks, nullptr, &updated) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(client.scanCount() == 1);
+        CHECK(client.channelScanCount() == 1);
+    }
+
+    SECTION("connects to another configured network") {
+        REQUIRE(networks.append(network("Other", "password")));
+        client.removeAccessPoint(AP1);
+        client.removeAccessPoint(AP2);
+        CHECK(connector.connect(&networks, nullptr, &updated) == 1);
+        CHECK(networks[1].bssid() == OTHER_AP);
+        CHECK(networks[1].channel() == 1);
+    }
+
+    SECTION("fails if the network is not configured") {
+        CHECK(connector.connect(&networks, "Other", &updated) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(client.connectCount() == 0);
+    }
+}
+
+TEST_CASE("WifiConnector with an NCP that selects the access point") {
+    FakeWifiNcpClient client(PLATFORM_NCP_REALTEK_RTL872X);
+    client.addAccessPoint("Home", AP1, 6, -60, "secret");
+    client.addAccessPoint("Home", AP2, 6, -50, "secret");
+    Vector<WifiNetworkConfig> networks;
+    REQUIRE(networks.append(network("Home", "secret")));
+    WifiConnector connector(&client);
+    bool updated = false;
+
+    SECTION("connects without scanning and stores the hints") {
+        REQUIRE(connector.connect(&networks, nullptr, &updated) == 0);
+        CHECK(updated);
+        CHECK(client.scanCount() == 0);
+        CHECK(networks[0].bssid() == AP2);
+        CHECK(networks[0].channel() == 6);
+    }
+
+    SECTION("performs a full scan if the connection fails and there are no hints") {
+        networks[0] = network("Home", "wrong");
+        CHECK(connector.connect(&networks, nullptr, &updated) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(client.channelScanCount() == 0);
+        CHECK(client.scanCount() == 1);
+    }
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "atomic_block_pool.h"
+
+#include "catch2/catch.hpp"
+
+#include <thread>
+#include <vector>
+#include <set>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+
+using namespace particle;
+
+namespace {
+
+const size_t BLOCK_SIZE = 48;
+const size_t BLOCK_COUNT = 16;
+
+typedef AtomicBlockPool<BLOCK_SIZE, BLOCK_COUNT> Pool;
+
+// Each thread repeatedly allocates a block, fills it with a thread-specific pattern and checks
+// that the pattern is intact before freeing the block
+template<typename AllocFn, typename FreeFn>
+bool stress(unsigned threadCount, unsigned iterations, AllocFn allocFn, FreeFn freeFn) {
+    std::vector<std::thread> threads;
+    std::vector<int> ok(threadCount, 1);
+    for (unsigned t = 0; t < threadCount; ++t) {
+        threads.emplace_back([=, &ok]() {
+            for (unsigned i = 0; i < iterations; ++i) {
+                auto p = (char*)allocFn();
+                if (!p) {
+                    continue;
+                }
+                memset(p, 'a' + t, BLOCK_SIZE);
+                for (size_t j = 0; j < BLOCK_SIZE; ++j) {
+                    if (p[j] != (char)('a' + t)) {
+                        ok[t] = 0;
+                    }
+                }
+                freeFn(p);
+            }
+        });
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+    for (auto v: ok) {
+        if (!v) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+TEST_CASE("AtomicBlockPool") {
+    Pool pool;
+
+    SECTION("allocates distinct aligned blocks until the pool is exhausted") {
+        std::set<void*> blocks;
+        for (size_t i = 0; i < BLOCK_COUNT; ++i) {
+            void* p = pool.alloc();
+            REQUIRE(p);
+            CHECK(pool.owns(p));
+            CHECK(((uintptr_t)p % alignof(std::max_align_t)) == 0);
+            blocks.insert(p);
+        }
+        CHECK(blocks.size() == BLOCK_COUNT);
+        CHECK(pool.available() == 0);
+        CHECK(!pool.alloc());
+        void* p = *blocks.begin();
+        pool.free(p);
+        CHECK(pool.available() == 1);
+        CHECK(pool.alloc() == p);
+    }
+
+    SECTION("does not own foreign pointers") {
+        int x = 0;
+        CHECK(!pool.owns(&x));
+    }
+
+    SECTION("supports concurrent allocation and deallocation") {
+        const bool ok = stress(8, 20000, [&pool]() {
+            return pool.alloc();
+        }, [&pool](void* p) {
+            pool.free(p);
+        });
+        CHECK(ok);
+        CHECK(pool.available() == BLOCK_COUNT);
+    }
+}
+
+TEST_CASE("AtomicBlockPool benchmark", "[.benchmark]") {
+    static Pool pool;
+    const unsigned threads = 4;
+    const unsigned iterations = 1000000;
+    auto t1 = std::chrono::steady_clock::now();
+    stress(threads, iterations, []() {
+        return pool.alloc();
+    }, [](void* p) {
+        pool.free(p);
+    });
+    auto t2 = std::chrono::steady_clock::now();
+    stress(threads, iterations, []() {
+        return malloc(BLOCK_SIZE);
+    }, [](void* p) {
+        free(p);
+    });
+    auto t3 = std::chrono::steady_clock::now();
+    typedef std::chrono::duration<double, std::nano> Nanoseconds;
+    const double n = (double)threads * iterations;
+    WARN("AtomicBlockPool: " << Nanoseconds(t2 - t1).count() / n << " ns per alloc/free");
+    WARN("malloc/free: " << Nanoseconds(t3 - t2).count() / n << " ns per alloc/free");
+}
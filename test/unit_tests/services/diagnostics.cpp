@@ -4,6 +4,9 @@
 
 #include <functional>
 #include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <chrono>
 #include <cassert>
 
 namespace {
@@ -535,6 +538,60 @@ TEST_CASE("Service API") {
         }
     }
 
+    SECTION("diag_snapshot()") {
+        auto d1 = DiagSource(1).type(DIAG_TYPE_INT).get([](GetData d) {
+            return d.setInt(-1234);
+        }).add();
+        auto d3 = DiagSource(3).type(DIAG_TYPE_UINT).get([](GetData) {
+            return SYSTEM_ERROR_UNKNOWN;
+        }).add();
+        auto d2 = DiagSource(2).type(DIAG_TYPE_UINT).get([](GetData d) {
+            return d.setUInt(5678);
+        }).add();
+
+        SECTION("fails if the service is not started") {
+            diag_snapshot_entry entries[3] = {};
+            size_t count = 3;
+            CHECK(diag_snapshot(entries, &count, nullptr) == SYSTEM_ERROR_INVALID_STATE);
+        }
+
+        SECTION("retrieves the values of all data sources ordered by ID") {
+            diag.start();
+            diag_snapshot_entry entries[4] = {};
+            size_t count = 4;
+            CHECK(diag_snapshot(entries, &count, nullptr) == 0);
+            REQUIRE(count == 3);
+            CHECK(entries[0].id == 1);
+            CHECK(entries[0].type == DIAG_TYPE_INT);
+            CHECK(entries[0].error == 0);
+            CHECK((int32_t)entries[0].value == -1234);
+            CHECK(entries[1].id == 2);
+            CHECK(entries[1].type == DIAG_TYPE_UINT);
+            CHECK(entries[1].error == 0);
+            CHECK(entries[1].value == 5678);
+            CHECK(entries[2].id == 3);
+            CHECK(entries[2].error == SYSTEM_ERROR_UNKNOWN);
+            CHECK(entries[3].id == 0); // Not used
+        }
+
+        SECTION("retrieves only as many sources as the array can hold") {
+            diag.start();
+            diag_snapshot_entry entries[2] = {};
+            size_t count = 1;
+            CHECK(diag_snapshot(entries, &count, nullptr) == 0);
+            CHECK(count == 3);
+            CHECK(entries[0].id == 1);
+            CHECK(entries[1].id == 0);
+        }
+
+        SECTION("accepts NULL as the entries argument") {
+            diag.start();
+            size_t count = 10;
+            CHECK(diag_snapshot(nullptr /* entries */, &count, nullptr) == 0);
+            CHECK(count == 3);
+        }
+    }
+
     SECTION("diag_command()") {
         SECTION("can be used to start the diagnostics service") {
             CHECK(diag_command(DIAG_SERVICE_CMD_START, nullptr, nullptr) == 0);
@@ -666,4 +723,136 @@ TEST_CASE("Wiring API") {
         testPersistentEnumDiagnosticData<PersistentEnumDiagnosticData, NoConcurrency>(diag);
         // testPersistentEnumDiagnosticData<PersistentEnumDiagnosticData, AtomicConcurrency>(diag);
     }
+
+    SECTION("AtomicUnsignedIntegerDiagnosticData") {
+        AtomicUnsignedIntegerDiagnosticData d(1, 10);
+        diag.start();
+        CHECK(++d == 11);
+        CHECK(d++ == 11);
+        CHECK(--d == 11);
+        CHECK(d-- == 11);
+        CHECK((d += 5) == 15);
+        CHECK((d -= 3) == 12);
+        uint32_t val = 0;
+        CHECK(AbstractUnsignedIntegerDiagnosticData::get(1, val) == 0);
+        CHECK(val == 12);
+        d = 0;
+        CHECK(d == 0);
+    }
+
+    SECTION("ShardedCounterDiagnosticData") {
+        ShardedCounterDiagnosticData<4> d(1, "counter");
+        diag.start();
+        CHECK(d == 0);
+        ++d;
+        d++;
+        d += 3;
+        CHECK(d == 5);
+        uint32_t val = 0;
+        CHECK(AbstractUnsignedIntegerDiagnosticData::get(1, val) == 0);
+        CHECK(val == 5);
+        d.reset();
+        CHECK(d == 0);
+    }
+}
+
+TEST_CASE("ShardedCounterDiagnosticData") {
+    DiagService diag;
+
+    SECTION("can be updated concurrently from multiple threads") {
+        ShardedCounterDiagnosticData<> d(1);
+        diag.start();
+        const unsigned threadCount = 8;
+        const unsigned iterations = 100000;
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < threadCount; ++i) {
+            threads.emplace_back([&d]() {
+                for (unsigned j = 0; j < iterations; ++j) {
+                    ++d;
+                }
+            });
+        }
+        // Read the counter while it's being updated
+        uint32_t prev = 0;
+        for (unsigned i = 0; i < 1000; ++i) {
+            diag_snapshot_entry e = {};
+            size_t count = 1;
+            REQUIRE(diag_snapshot(&e, &count, nullptr) == 0);
+            REQUIRE(e.value >= prev);
+            prev = e.value;
+        }
+        for (auto& t: threads) {
+            t.join();
+        }
+        CHECK(d == threadCount * iterations);
+    }
+}
+
+TEST_CASE("Diagnostic counters benchmark", "[.benchmark]") {
+    DiagService diag;
+    AtomicUnsignedIntegerDiagnosticData atomicCounter(1);
+    ShardedCounterDiagnosticData<> shardedCounter(2);
+    std::mutex mutex;
+    uint32_t lockedCounter = 0;
+    std::vector<DiagSource> sources;
+    for (unsigned i = 0; i < 48; ++i) {
+        sources.push_back(DiagSource(i + 3).type(DIAG_TYPE_UINT).get([i](GetData d) {
+            return d.setUInt(i);
+        }).add());
+    }
+    diag.start();
+
+    typedef std::chrono::duration<double, std::nano> Nanoseconds;
+    const unsigned iterations = 1000000;
+    // Returns the wall time per increment
+    auto run = [](unsigned threadCount, auto fn) {
+        const auto t1 = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < threadCount; ++i) {
+            threads.emplace_back([&fn]() {
+                for (unsigned j = 0; j < iterations; ++j) {
+                    fn();
+                }
+            });
+        }
+        for (auto& t: threads) {
+            t.join();
+        }
+        const auto t2 = std::chrono::steady_clock::now();
+        return Nanoseconds(t2 - t1).count() / ((double)threadCount * iterations);
+    };
+
+    for (unsigned threads: { 1, 4, 8 }) {
+        const double locked = run(threads, [&]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++lockedCounter;
+        });
+        const double atomic = run(threads, [&]() {
+            ++atomicCounter;
+        });
+        const double sharded = run(threads, [&]() {
+            ++shardedCounter;
+        });
+        CATCH_WARN(threads << " thread(s): mutex: " << locked << " ns, atomic: " << atomic << " ns, sharded: " << sharded <<
+                " ns per increment");
+    }
+
+    const unsigned snapshots = 100000;
+    auto t1 = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < snapshots; ++i) {
+        EnumSourcesCallback cb([](const diag_source* src) {
+            uint32_t val = 0;
+            return AbstractUnsignedIntegerDiagnosticData::get(src, val);
+        });
+        REQUIRE(diag_enum_sources(cb.func(), nullptr, cb.data(), nullptr) == 0);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < snapshots; ++i) {
+        diag_snapshot_entry entries[50];
+        size_t count = 50;
+        REQUIRE(diag_snapshot(entries, &count, nullptr) == 0);
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    CATCH_WARN("diag_enum_sources(): " << Nanoseconds(t2 - t1).count() / snapshots << " ns per 50 sources");
+    CATCH_WARN("diag_snapshot(): " << Nanoseconds(t3 - t2).count() / snapshots << " ns per 50 sources");
 }
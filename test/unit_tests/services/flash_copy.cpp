@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "flash_copy.h"
+#include "system_error.h"
+
+#include "util/random_old.h"
+#include "util/flash_simulator.h"
+
+#include "catch2/catch.hpp"
+
+#include <string>
+
+using test::FlashSimulator;
+
+namespace {
+
+const size_t SECTOR_SIZE = 4096;
+
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc) {
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (unsigned j = 0; j < 8; ++j) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+uint32_t crc32(const std::string& data) {
+    return crc32((const uint8_t*)data.data(), data.size(), 0);
+}
+
+flash_copy_device makeDevice(FlashSimulator* flash) {
+    flash_copy_device dev = {};
+    dev.read = [](uintptr_t addr, uint8_t* data, size_t size, void* userData) {
+        return static_cast<FlashSimulator*>(userData)->read(addr, data, size);
+    };
+    dev.write = [](uintptr_t addr, const uint8_t* data, size_t size, void* userData) {
+        return static_cast<FlashSimulator*>(userData)->write(addr, data, size);
+    };
+    dev.erase = [](uintptr_t addr, size_t count, void* userData) {
+        return static_cast<FlashSimulator*>(userData)->erase(addr, count);
+    };
+    dev.sector_size = flash->sectorSize();
+    dev.user_data = flash;
+    return dev;
+}
+
+// Copy procedure that verifies the CRC of the source data, then erases and programs the entire
+// destination range
+void copyBaseline(FlashSimulator* src, size_t srcAddr, FlashSimulator* dest, size_t destAddr, size_t size, uint32_t* crc) {
+    uint8_t buf[FLASH_COPY_BLOCK_SIZE];
+    *crc = 0;
+    for (size_t offs = 0; offs < size; offs += sizeof(buf)) {
+        const size_t n = std::min(size - offs, sizeof(buf));
+        REQUIRE(src->read(srcAddr + offs, buf, n) == 0);
+        *crc = crc32(buf, n, *crc);
+    }
+    REQUIRE(dest->erase(destAddr, (size + dest->sectorSize() - 1) / dest->sectorSize()) == 0);
+    for (size_t offs = 0; offs < size; offs += sizeof(buf)) {
+        const size_t n = std::min(size - offs, sizeof(buf));
+        REQUIRE(src->read(srcAddr + offs, buf, n) == 0);
+        REQUIRE(dest->write(destAddr + offs, buf, n) == 0);
+    }
+}
+
+} // namespace
+
+TEST_CASE("flash_copy") {
+    const size_t IMAGE_SIZE = SECTOR_SIZE * 16;
+    const size_t SRC_ADDR = 0x1000;
+    const size_t DEST_ADDR = SECTOR_SIZE * 4;
+
+    FlashSimulator src(0x40000, SECTOR_SIZE);
+    FlashSimulator dest(0x40000, SECTOR_SIZE);
+    const auto srcDev = makeDevice(&src);
+    const auto destDev = makeDevice(&dest);
+
+    const auto image = ::test::randomBytes(IMAGE_SIZE);
+    src.store(SRC_ADDR, image);
+    flash_copy_ctx ctx = {};
+
+    SECTION("only updates the sectors that differ") {
+        // The installed image differs in two sectors
+        auto installed = image;
+        installed[SECTOR_SIZE * 3 + 100] ^= 0x01;
+        installed[SECTOR_SIZE * 10 + SECTOR_SIZE - 1] ^= 0x80;
+        dest.store(DEST_ADDR, installed);
+
+        REQUIRE(flash_copy_init(&ctx, &srcDev, SRC_ADDR, &destDev, DEST_ADDR, IMAGE_SIZE) == 0);
+        REQUIRE(flash_copy_set_crc(&ctx, crc32, IMAGE_SIZE, 0) == 0);
+        REQUIRE(flash_copy_prepare(&ctx) == 0);
+        CHECK(flash_copy_crc(&ctx) == crc32(image));
+        CHECK(flash_copy_dirty_sector_count(&ctx) == 2);
+        // Nothing is modified until the copy is committed
+        CHECK(dest.stats().sectorsErased == 0);
+        CHECK(dest.stats().bytesProgrammed == 0);
+        // The source is read once
+        CHECK(src.stats().bytesRead == IMAGE_SIZE);
+
+        REQUIRE(flash_copy_commit(&ctx) == 0);
+        CHECK(dest.load(DEST_ADDR, IMAGE_SIZE) == image);
+        CHECK(dest.stats().sectorsErased == 2);
+        CHECK(dest.stats().bytesProgrammed == SECTOR_SIZE * 2);
+        CHECK(src.stats().bytesRead == IMAGE_SIZE + SECTOR_SIZE * 2);
+
+        // Compare with erasing and programming the entire image
+        FlashSimulator src2(0x40000, SECTOR_SIZE);
+        FlashSimulator dest2(0x40000, SECTOR_SIZE);
+        src2.store(SRC_ADDR, image);
+        dest2.store(DEST_ADDR, installed);
+        uint32_t crc = 0;
+        copyBaseline(&src2, SRC_ADDR, &dest2, DEST_ADDR, IMAGE_SIZE, &crc);
+        CHECK(crc == crc32(image));
+        CHECK(dest2.load(DEST_ADDR, IMAGE_SIZE) == image);
+        CHECK(dest2.stats().sectorsErased == 16);
+        CHECK(dest2.stats().bytesProgrammed == IMAGE_SIZE);
+        CHECK(src2.stats().bytesRead == IMAGE_SIZE * 2);
+    }
+
+    SECTION("doesn't modify the destination if it already contains the data") {
+        dest.store(DEST_ADDR, image);
+        REQUIRE(flash_copy_init(&ctx, &srcDev, SRC_ADDR, &destDev, DEST_ADDR, IMAGE_SIZE) == 0);
+        REQUIRE(flash_copy_prepare(&ctx) == 0);
+        CHECK(flash_copy_dirty_sector_count(&ctx) == 0);
+        REQUIRE(flash_copy_commit(&ctx) == 0);
+        CHECK(dest.stats().sectorsErased == 0);
+        CHECK(dest.stats().bytesProgrammed == 0);
+    }
+
+    SECTION("copies to an erased destination") {
+        REQUIRE(flash_copy_init(&ctx, &srcDev, SRC_ADDR, &destDev, DEST_ADDR, IMAGE_SIZE) == 0);
+        REQUIRE(flash_copy_prepare(&ctx) == 0);
+        CHECK(flash_copy_dirty_sector_count(&ctx) == 16);
+        REQUIRE(flash_copy_commit(&ctx) == 0);
+        CHECK(dest.load(DEST_ADDR, IMAGE_SIZE) == image);
+    }
+
+    SECTION("handles a partial last sector") {
+        const size_t size = IMAGE_SIZE - 1000;
+        auto installed = image.substr(0, size);
+        installed[size - 1] ^= 0xff;
+        dest.store(DEST_ADDR, installed);
+        REQUIRE(flash_copy_init(&ctx, &srcDev, SRC_ADDR, &destDev, DEST_ADDR, size) == 0);
+        REQUIRE(flash_copy_prepare(&ctx) == 0);
+        CHECK(flash_copy_dirty_sector_count(&ctx) == 1);
+        REQUIRE(flash_copy_commit(&ctx) == 0);
+        CHECK(dest.load(DEST_ADDR, size) == image.substr(0, size));
+        CHECK(dest.stats().bytesProgrammed == SECTOR_SIZE - 1000);
+    }
+
+    SECTION("computes the CRC of a part of the data and can continue a CRC") {
+        // Module data followed by its CRC, the module info header is not copied
+        const size_t headerSize = 24;
+        const size_t crcSize = IMAGE_SIZE - headerSize - 4;
+        const uint32_t headerCrc = crc32((const uint8_t*)image.data(), headerSize, 0);
+        REQUIRE(flash_copy_init(&ctx, &srcDev, SRC_ADDR + headerSize, &destDev, DEST_ADDR, IMAGE_SIZE - headerSize) == 0);
+        REQUIRE(flash_copy_set_crc(&ctx, crc32, crcSize, headerCrc) == 0);
+        REQUIRE(flash_copy_prepare(&ctx) == 0);
+        CHECK(flash_copy_crc(&ctx) == crc32(image.substr(0, IMAGE_SIZE - 4)));
+    }
+
+    SECTION("updates the sectors that were modified after the copy was prepared") {
+        dest.store(DEST_ADDR, image);
+        REQUIRE(flash_copy_init(&ctx, &srcDev, SRC_ADDR, &destDev, DEST_ADDR, IMAGE_SIZE) == 0);
+        REQUIRE(flash_copy_prepare(&ctx) == 0);
+        CHECK(flash_copy_dirty_sector_count(&ctx) == 0);
+        REQUIRE(dest.erase(DEST_ADDR + SECTOR_SIZE * 5, 1) == 0);
+        REQUIRE(flash_copy_invalidate(&ctx, DEST_ADDR + SECTOR_SIZE * 5, SECTOR_SIZE) == 0);
+        // Ranges outside of the destination are ignored
+        REQUIRE(flash_copy_invalidate(&ctx, DEST_ADDR + IMAGE_SIZE, SECTOR_SIZE) == 0);
+        REQUIRE(flash_copy_invalidate(&ctx, 0, DEST_ADDR) == 0);
+        CHECK(flash_copy_dirty_sector_count(&ctx) == 1);
+        REQUIRE(flash_copy_commit(&ctx) == 0);
+        CHECK(dest.load(DEST_ADDR, IMAGE_SIZE) == image);
+        CHECK(dest.stats().sectorsErased == 2);
+    }
+
+    SECTION("validates the arguments and the order of calls") {
+        CHECK(flash_copy_init(&ctx, &srcDev, SRC_ADDR, &destDev, DEST_ADDR + 1, IMAGE_SIZE) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(flash_copy_init(&ctx, &srcDev, SRC_ADDR, &destDev, 0, SECTOR_SIZE * (FLASH_COPY_MAX_SECTORS + 1)) == SYSTEM_ERROR_TOO_LARGE);
+        REQUIRE(flash_copy_init(&ctx, &srcDev, SRC_ADDR, &destDev, DEST_ADDR, IMAGE_SIZE) == 0);
+        CHECK(flash_copy_set_crc(&ctx, crc32, IMAGE_SIZE + 1, 0) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(flash_copy_commit(&ctx) == SYSTEM_ERROR_INVALID_STATE);
+        CHECK(flash_copy_invalidate(&ctx, DEST_ADDR, SECTOR_SIZE) == SYSTEM_ERROR_INVALID_STATE);
+        REQUIRE(flash_copy_prepare(&ctx) == 0);
+        CHECK(flash_copy_prepare(&ctx) == SYSTEM_ERROR_INVALID_STATE);
+        CHECK(flash_copy_set_crc(&ctx, crc32, IMAGE_SIZE, 0) == SYSTEM_ERROR_INVALID_STATE);
+    }
+}
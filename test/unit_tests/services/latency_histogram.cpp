@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "latency_histogram.h"
+
+#include "catch2/catch.hpp"
+
+using namespace particle;
+
+TEST_CASE("LatencyHistogram") {
+    LatencyHistogram hist;
+
+    SECTION("reports zeros when empty") {
+        CHECK(hist.count() == 0);
+        CHECK(hist.min() == 0);
+        CHECK(hist.max() == 0);
+        CHECK(hist.percentile(99) == 0);
+    }
+
+    SECTION("maps values to contiguous buckets") {
+        size_t prev = 0;
+        for (uint32_t v = 1; v <= 100000; ++v) {
+            const size_t i = LatencyHistogram::bucketIndex(v);
+            REQUIRE((i == prev || i == prev + 1));
+            REQUIRE(LatencyHistogram::bucketLowerBound(i) <= v);
+            if (i + 1 < LatencyHistogram::BUCKET_COUNT) {
+                REQUIRE(LatencyHistogram::bucketLowerBound(i + 1) > v);
+            }
+            prev = i;
+        }
+        CHECK(LatencyHistogram::bucketIndex(LatencyHistogram::MAX_VALUE) == LatencyHistogram::BUCKET_COUNT - 1);
+        CHECK(LatencyHistogram::bucketIndex(0xffffffff) == LatencyHistogram::BUCKET_COUNT - 1);
+    }
+
+    SECTION("tracks the minimum and maximum values exactly") {
+        hist.record(1234);
+        hist.record(17);
+        hist.record(50000000);
+        CHECK(hist.count() == 3);
+        CHECK(hist.min() == 17);
+        CHECK(hist.max() == 50000000);
+    }
+
+    SECTION("reports percentiles within the bucket resolution") {
+        for (uint32_t v = 1; v <= 1000; ++v) {
+            hist.record(v);
+        }
+        const auto p50 = hist.percentile(50);
+        CHECK(p50 >= 500);
+        CHECK(p50 <= 625);
+        const auto p99 = hist.percentile(99);
+        CHECK(p99 >= 990);
+        CHECK(p99 <= 1000); // Clamped to the maximum value
+        CHECK(hist.percentile(100) == 1000);
+    }
+
+    SECTION("isolates rare outliers in the upper percentile") {
+        for (int i = 0; i < 995; ++i) {
+            hist.record(100);
+        }
+        for (int i = 0; i < 5; ++i) {
+            hist.record(3000000);
+        }
+        CHECK(hist.percentile(99) < 128);
+        CHECK(hist.percentile(100) == 3000000);
+    }
+
+    SECTION("halves the counters instead of overflowing") {
+        for (int i = 0; i < 70000; ++i) {
+            hist.record(10);
+        }
+        hist.record(1000);
+        CHECK(hist.count() < 70001);
+        CHECK(hist.percentile(50) < 16);
+        CHECK(hist.max() == 1000);
+    }
+
+    SECTION("can be reset") {
+        hist.record(10);
+        hist.reset();
+        CHECK(hist.count() == 0);
+        CHECK(hist.max() == 0);
+        CHECK(hist.percentile(99) == 0);
+    }
+}
@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "module_patch.h"
+#include "varint.h"
+#include "system_error.h"
+
+#include "util/random_old.h"
+#include "util/flash_simulator.h"
+
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+#include <string>
+
+using namespace particle;
+using test::FlashSimulator;
+
+namespace {
+
+class PatchBuilder {
+public:
+    PatchBuilder(const std::string& base) :
+            base_(base),
+            pos_(0) {
+    }
+
+    // Append a record. `diffTarget` is encoded as a diff against the base image at the current
+    // position, `extra` is copied as is
+    PatchBuilder& record(const std::string& diffTarget, const std::string& extra, int64_t adjustment) {
+        REQUIRE(pos_ + diffTarget.size() <= base_.size());
+        appendVarint(diffTarget.size());
+        for (size_t i = 0; i < diffTarget.size(); ++i) {
+            patch_ += (char)(diffTarget[i] - base_[pos_ + i]);
+        }
+        appendVarint(extra.size());
+        patch_ += extra;
+        appendVarint((adjustment < 0) ? ((uint64_t)(-adjustment - 1) << 1) | 1 : (uint64_t)adjustment << 1);
+        target_ += diffTarget;
+        target_ += extra;
+        pos_ += diffTarget.size() + adjustment;
+        return *this;
+    }
+
+    // Copy a range of the base image, changing some of its bytes
+    PatchBuilder& copy(size_t size, const std::string& extra, int64_t adjustment, unsigned changes = 0) {
+        auto data = base_.substr(pos_, size);
+        for (unsigned i = 0; i < changes; ++i) {
+            data[test::randomInt(0, data.size() - 1)] += 1;
+        }
+        return record(data, extra, adjustment);
+    }
+
+    PatchBuilder& raw(const std::string& data) {
+        patch_ += data;
+        return *this;
+    }
+
+    const std::string& patch() const {
+        return patch_;
+    }
+
+    const std::string& target() const {
+        return target_;
+    }
+
+    size_t pos() const {
+        return pos_;
+    }
+
+private:
+    std::string base_;
+    std::string patch_;
+    std::string target_;
+    size_t pos_;
+
+    void appendVarint(uint64_t val) {
+        char buf[10];
+        const int n = encodeUnsignedVarint(buf, sizeof(buf), val);
+        patch_.append(buf, n);
+    }
+};
+
+const size_t BASE_ADDRESS = 0;
+const size_t TARGET_ADDRESS = 0x10000;
+
+// Applies a patch to the base image stored in the flash device
+class Applier {
+public:
+    explicit Applier(FlashSimulator* flash) :
+            flash_(flash),
+            writeOffs_(0) {
+    }
+
+    int init(size_t baseSize, size_t targetSize) {
+        return module_patch_init(&ctx_, baseSize, targetSize, readBase, writeTarget, this);
+    }
+
+    // Feeds the patch data in chunks of the specified size
+    int apply(const std::string& patch, size_t chunkSize) {
+        for (size_t offs = 0; offs < patch.size(); offs += chunkSize) {
+            const int r = module_patch_input(&ctx_, patch.data() + offs, std::min(chunkSize, patch.size() - offs));
+            if (r < 0) {
+                return r;
+            }
+        }
+        return module_patch_finish(&ctx_);
+    }
+
+    size_t bytesWritten() const {
+        return writeOffs_;
+    }
+
+private:
+    module_patch_ctx ctx_;
+    FlashSimulator* flash_;
+    size_t writeOffs_;
+
+    static int readBase(size_t offset, char* data, size_t size, void* userData) {
+        const auto self = static_cast<Applier*>(userData);
+        return self->flash_->read(BASE_ADDRESS + offset, data, size);
+    }
+
+    static int writeTarget(const char* data, size_t size, void* userData) {
+        const auto self = static_cast<Applier*>(userData);
+        const int r = self->flash_->write(TARGET_ADDRESS + self->writeOffs_, data, size);
+        if (r < 0) {
+            return r;
+        }
+        self->writeOffs_ += size;
+        return 0;
+    }
+};
+
+} // namespace
+
+TEST_CASE("module_patch") {
+    const size_t BASE_SIZE = 0x8000;
+    const auto base = test::randomBytes(BASE_SIZE);
+    FlashSimulator flash(0x20000);
+    flash.store(BASE_ADDRESS, base);
+    Applier applier(&flash);
+
+    SECTION("reconstructs the target image") {
+        PatchBuilder b(base);
+        b.copy(0x2000, test::randomBytes(100), 200 /* Skip a range of the base image */, 10 /* Changes */);
+        b.copy(0x3000, "", -(int64_t)0x4000 /* Go back */, 3);
+        b.copy(0x1000, "", (int64_t)0x5000 - (int64_t)(b.pos() + 0x1000));
+        b.copy(BASE_SIZE - 0x5000, test::randomBytes(50), 0, 5);
+        const auto& target = b.target();
+        REQUIRE(applier.init(BASE_SIZE, target.size()) == 0);
+        SECTION("fed in one go") {
+            CHECK(applier.apply(b.patch(), b.patch().size()) == 0);
+        }
+        SECTION("fed byte by byte") {
+            CHECK(applier.apply(b.patch(), 1) == 0);
+        }
+        SECTION("fed in odd-sized chunks") {
+            CHECK(applier.apply(b.patch(), 77) == 0);
+        }
+        CHECK(applier.bytesWritten() == target.size());
+        CHECK(flash.load(TARGET_ADDRESS, target.size()) == target);
+        // The base image is left intact
+        CHECK(flash.load(BASE_ADDRESS, BASE_SIZE) == base);
+        // Apart from the varints, an unchanged range of the base image is encoded as zero bytes
+        CHECK(std::count(b.patch().begin(), b.patch().end(), '\0') > (long)(BASE_SIZE * 9 / 10));
+    }
+
+    SECTION("reads the base image in bounded chunks") {
+        PatchBuilder b(base);
+        b.copy(BASE_SIZE, "", 0);
+        REQUIRE(applier.init(BASE_SIZE, BASE_SIZE) == 0);
+        CHECK(applier.apply(b.patch(), b.patch().size()) == 0);
+        CHECK(flash.stats().readCount == BASE_SIZE / MODULE_PATCH_BUFFER_SIZE);
+        CHECK(flash.load(TARGET_ADDRESS, BASE_SIZE) == base);
+    }
+
+    SECTION("fails if the patch data is truncated") {
+        PatchBuilder b(base);
+        b.copy(0x1000, test::randomBytes(10), 0);
+        const auto patch = b.patch().substr(0, b.patch().size() - 5);
+        REQUIRE(applier.init(BASE_SIZE, b.target().size()) == 0);
+        CHECK(applier.apply(patch, patch.size()) == SYSTEM_ERROR_NOT_ENOUGH_DATA);
+    }
+
+    SECTION("fails if the target image is not complete") {
+        PatchBuilder b(base);
+        b.copy(0x1000, "", 0);
+        REQUIRE(applier.init(BASE_SIZE, b.target().size() + 1) == 0);
+        CHECK(applier.apply(b.patch(), b.patch().size()) == SYSTEM_ERROR_NOT_ENOUGH_DATA);
+    }
+
+    SECTION("fails if the target image would exceed its size") {
+        PatchBuilder b(base);
+        b.copy(0x1000, test::randomBytes(10), 0);
+        REQUIRE(applier.init(BASE_SIZE, b.target().size() - 1) == 0);
+        CHECK(applier.apply(b.patch(), b.patch().size()) == SYSTEM_ERROR_BAD_DATA);
+        // Nothing is written past the end of the target image
+        CHECK(applier.bytesWritten() <= b.target().size() - 1);
+    }
+
+    SECTION("fails if the patch refers to data outside of the base image") {
+        PatchBuilder b(base);
+        b.copy(0x1000, "", 0);
+        SECTION("when reading") {
+            b.raw("\x80\x80\x02"); // Diff block of 0x8000 bytes
+            b.raw(std::string(0x8000, '\0')).raw(std::string("\0\0", 2));
+            REQUIRE(applier.init(BASE_SIZE, b.target().size() + 0x8000) == 0);
+        }
+        SECTION("when adjusting the position") {
+            b.raw(std::string("\0\0", 2)).raw("\x81\x40"); // Position adjustment of -0x1001
+            REQUIRE(applier.init(BASE_SIZE, b.target().size()) == 0);
+        }
+        CHECK(applier.apply(b.patch(), b.patch().size()) == SYSTEM_ERROR_BAD_DATA);
+    }
+
+    SECTION("fails if a varint is too large") {
+        REQUIRE(applier.init(BASE_SIZE, BASE_SIZE) == 0);
+        CHECK(applier.apply("\xff\xff\xff\xff\x7f", 1) == SYSTEM_ERROR_BAD_DATA);
+    }
+
+    SECTION("reports the first error on subsequent calls") {
+        REQUIRE(applier.init(BASE_SIZE, BASE_SIZE) == 0);
+        CHECK(applier.apply("\xff\xff\xff\xff\x7f", 5) == SYSTEM_ERROR_BAD_DATA);
+        CHECK(applier.apply(std::string("\0", 1), 1) == SYSTEM_ERROR_BAD_DATA);
+    }
+
+    SECTION("fails if the target location is not erased") {
+        flash.store(TARGET_ADDRESS + 10, "x");
+        PatchBuilder b(base);
+        b.copy(0x1000, "", 0);
+        REQUIRE(applier.init(BASE_SIZE, b.target().size()) == 0);
+        CHECK(applier.apply(b.patch(), b.patch().size()) == SYSTEM_ERROR_FLASH_IO);
+    }
+}
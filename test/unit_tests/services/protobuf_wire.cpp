@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "protobuf_wire.h"
+#include "system_error.h"
+
+#include <catch2/catch.hpp>
+
+#include <string>
+
+using namespace particle;
+
+namespace {
+
+std::string readBytes(const ProtobufField& field) {
+    return std::string(field.data, field.size);
+}
+
+} // namespace
+
+TEST_CASE("ProtobufReader") {
+    ProtobufField field = {};
+
+    SECTION("reads the fields of a message") {
+        // FirmwareUpdateDataRequest { data: "abc", offset: 300 } followed by an unknown fixed32 field
+        // and an unknown fixed64 field
+        const std::string msg("\x0a\x03" "abc" "\x10\xac\x02" "\x1d\x01\x02\x03\x04" "\x21\x01\x00\x00\x00\x00\x00\x00\x80", 22);
+        ProtobufReader reader(msg.data(), msg.size());
+        REQUIRE(reader.next(&field) == 1);
+        CHECK(field.tag == 1);
+        CHECK(field.type == ProtobufWireType::LENGTH_DELIMITED);
+        CHECK(readBytes(field) == "abc");
+        // The data is not copied
+        CHECK(field.data == msg.data() + 2);
+        REQUIRE(reader.next(&field) == 1);
+        CHECK(field.tag == 2);
+        CHECK(field.type == ProtobufWireType::VARINT);
+        CHECK(field.value == 300);
+        REQUIRE(reader.next(&field) == 1);
+        CHECK(field.tag == 3);
+        CHECK(field.type == ProtobufWireType::FIXED32);
+        CHECK(field.value == 0x04030201);
+        REQUIRE(reader.next(&field) == 1);
+        CHECK(field.tag == 4);
+        CHECK(field.type == ProtobufWireType::FIXED64);
+        CHECK(field.value == 0x8000000000000001ull);
+        CHECK(reader.next(&field) == 0);
+        CHECK(reader.next(&field) == 0);
+    }
+
+    SECTION("reads an empty message") {
+        ProtobufReader reader(nullptr, 0);
+        CHECK(reader.next(&field) == 0);
+    }
+
+    SECTION("reads fields with large numbers and values") {
+        const std::string msg("\xf8\xff\xff\xff\x0f\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01", 15);
+        ProtobufReader reader(msg.data(), msg.size());
+        REQUIRE(reader.next(&field) == 1);
+        CHECK(field.tag == 0x1fffffff);
+        CHECK(field.value == UINT64_MAX);
+        CHECK(reader.next(&field) == 0);
+    }
+
+    SECTION("fails if the message is truncated") {
+        const std::string msgs[] = {
+            std::string("\x0a\x03" "ab", 4), // Length-delimited field
+            std::string("\x10\xac", 2), // Varint
+            std::string("\x1d\x01\x02\x03", 4), // Fixed32
+            std::string("\x21\x01\x02\x03\x04\x05\x06\x07", 8), // Fixed64
+            std::string("\x80", 1) // Key
+        };
+        for (const auto& msg: msgs) {
+            ProtobufReader reader(msg.data(), msg.size());
+            CHECK(reader.next(&field) == SYSTEM_ERROR_BAD_DATA);
+        }
+    }
+
+    SECTION("fails if a varint is too long") {
+        const std::string msg("\x08\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01", 12);
+        ProtobufReader reader(msg.data(), msg.size());
+        CHECK(reader.next(&field) == SYSTEM_ERROR_BAD_DATA);
+    }
+
+    SECTION("fails if the field number is 0") {
+        const std::string msg("\x00\x01", 2);
+        ProtobufReader reader(msg.data(), msg.size());
+        CHECK(reader.next(&field) == SYSTEM_ERROR_BAD_DATA);
+    }
+
+    SECTION("doesn't support groups") {
+        const std::string msg("\x0b\x0c", 2);
+        ProtobufReader reader(msg.data(), msg.size());
+        CHECK(reader.next(&field) == SYSTEM_ERROR_NOT_SUPPORTED);
+    }
+}
+
+TEST_CASE("ProtobufWriter") {
+    SECTION("writes the fields of a message") {
+        char buf[32] = {};
+        ProtobufWriter writer(buf, sizeof(buf));
+        writer.writeBytes(1, "abc", 3).writeVarint(2, 300);
+        CHECK(std::string(buf, writer.dataSize()) == std::string("\x0a\x03" "abc" "\x10\xac\x02", 8));
+    }
+
+    SECTION("writes embedded messages") {
+        // Module { index: 1, dependencies: [Dependency { version: 2 }] }
+        ProtobufWriter depSize;
+        depSize.writeVarint(3, 2);
+        CHECK(depSize.dataSize() == 2);
+        char buf[32] = {};
+        ProtobufWriter writer(buf, sizeof(buf));
+        writer.writeVarint(2, 1).writeMessageHeader(6, depSize.dataSize()).writeVarint(3, 2);
+        const std::string msg(buf, writer.dataSize());
+        CHECK(msg == std::string("\x10\x01\x32\x02\x18\x02", 6));
+        // Read the message back
+        ProtobufReader reader(msg.data(), msg.size());
+        ProtobufField field = {};
+        REQUIRE(reader.next(&field) == 1);
+        REQUIRE(reader.next(&field) == 1);
+        CHECK(field.tag == 6);
+        ProtobufReader depReader(field.data, field.size);
+        REQUIRE(depReader.next(&field) == 1);
+        CHECK(field.tag == 3);
+        CHECK(field.value == 2);
+    }
+
+    SECTION("calculates the size of a message without a buffer") {
+        ProtobufWriter writer;
+        writer.writeVarint(1, UINT64_MAX).writeBytes(0x1fffffff, "abc", 3);
+        CHECK(writer.dataSize() == 11 + 9);
+    }
+
+    SECTION("doesn't write more than the size of the buffer") {
+        char buf[4] = {};
+        ProtobufWriter writer(buf, 3);
+        writer.writeBytes(1, "abc", 3);
+        CHECK(writer.dataSize() == 5);
+        CHECK(std::string(buf, 4) == std::string("\x0a\x03" "a" "\x00", 4));
+    }
+}
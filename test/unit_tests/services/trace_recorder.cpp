@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace_recorder.h"
+#include "timer_hal.h"
+
+#include "catch2/catch.hpp"
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+namespace {
+
+system_tick_t g_micros = 0;
+
+bool appendToString(void* appender, const uint8_t* data, size_t size) {
+    static_cast<std::string*>(appender)->append((const char*)data, size);
+    return true;
+}
+
+struct Dump {
+    trace_dump_header header;
+    std::vector<trace_record> records;
+};
+
+Dump dump() {
+    std::string data;
+    REQUIRE(trace_dump(appendToString, &data, nullptr) == 0);
+    REQUIRE(data.size() >= sizeof(trace_dump_header));
+    Dump d = {};
+    memcpy(&d.header, data.data(), sizeof(d.header));
+    REQUIRE(d.header.magic == TRACE_DUMP_MAGIC);
+    REQUIRE(d.header.version == TRACE_DUMP_VERSION);
+    REQUIRE(d.header.record_size == sizeof(trace_record));
+    REQUIRE(data.size() == sizeof(trace_dump_header) + d.header.count * sizeof(trace_record));
+    d.records.resize(d.header.count);
+    if (d.header.count > 0) {
+        memcpy(d.records.data(), data.data() + sizeof(trace_dump_header), d.header.count * sizeof(trace_record));
+    }
+    return d;
+}
+
+} // namespace
+
+system_tick_t HAL_Timer_Get_Micro_Seconds() {
+    return g_micros;
+}
+
+TEST_CASE("trace_recorder") {
+    trace_set_enabled(true);
+    trace_clear();
+    g_micros = 1000;
+
+    SECTION("dump is empty after the buffer is cleared") {
+        const auto d = dump();
+        CHECK(d.header.count == 0);
+        CHECK(d.header.dropped == 0);
+    }
+
+    SECTION("records events in order") {
+        TRACE_EVENT(TRACE_ID_SYSTEM_PUBLISH, 10, 20);
+        g_micros = 2000;
+        {
+            TRACE_SCOPE(TRACE_ID_PROTOCOL_HANDLE_MESSAGE, 1, 2);
+            g_micros = 2500;
+        }
+        TRACE_COUNTER(TRACE_ID_USER, 42);
+        const auto d = dump();
+        REQUIRE(d.header.count == 4);
+        CHECK(d.records[0].id == TRACE_ID_SYSTEM_PUBLISH);
+        CHECK(d.records[0].type == TRACE_EVENT_INSTANT);
+        CHECK(d.records[0].time == 1000);
+        CHECK(d.records[0].arg1 == 10);
+        CHECK(d.records[0].arg2 == 20);
+        CHECK(d.records[1].id == TRACE_ID_PROTOCOL_HANDLE_MESSAGE);
+        CHECK(d.records[1].type == TRACE_EVENT_BEGIN);
+        CHECK(d.records[1].time == 2000);
+        CHECK(d.records[1].arg1 == 1);
+        CHECK(d.records[2].type == TRACE_EVENT_END);
+        CHECK(d.records[2].time == 2500);
+        CHECK(d.records[3].type == TRACE_EVENT_COUNTER);
+        CHECK(d.records[3].arg1 == 42);
+        for (size_t i = 1; i < d.records.size(); ++i) {
+            CHECK(d.records[i].seq == d.records[i - 1].seq + 1);
+        }
+    }
+
+    SECTION("keeps the most recent events when the buffer overflows") {
+        for (unsigned i = 0; i < PARTICLE_TRACE_BUFFER_SIZE + 10; ++i) {
+            TRACE_EVENT(TRACE_ID_USER, i, 0);
+        }
+        const auto d = dump();
+        REQUIRE(d.header.count == PARTICLE_TRACE_BUFFER_SIZE);
+        CHECK(d.header.dropped == 10);
+        CHECK(d.records.front().arg1 == 10);
+        CHECK(d.records.back().arg1 == PARTICLE_TRACE_BUFFER_SIZE + 9);
+    }
+
+    SECTION("does not record events while disabled") {
+        trace_set_enabled(false);
+        TRACE_EVENT(TRACE_ID_USER, 0, 0);
+        trace_set_enabled(true);
+        CHECK(dump().header.count == 0);
+    }
+}
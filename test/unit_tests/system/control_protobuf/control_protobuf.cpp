@@ -0,0 +1,413 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define CATCH_CONFIG_MAIN
+
+#include "control/common.h"
+#include "ota_flash_hal.h"
+#include "protobuf_wire.h"
+
+#include "control/storage.pb.h"
+#include "firmware_update.pb.h"
+
+#include "catch2/catch.hpp"
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+#define PB(_name) particle_ctrl_##_name
+#define EXT(_name) particle_firmware_##_name
+
+// The fast decoders and encoders below mirror the ones in system/src/control/storage.cpp, and the
+// nanopb ones mirror the fallback decoder and the module info encoder used before the fast path
+
+namespace {
+
+using namespace particle;
+using namespace particle::control::common;
+
+const size_t CHUNK_SIZE = 1024; // Chunk size of the firmware update requests
+const uint32_t CHUNK_OFFSET = 123 * CHUNK_SIZE;
+
+class Request {
+public:
+    explicit Request(std::string data = std::string()) :
+            data_(std::move(data)) {
+        req_ = {};
+        req_.size = sizeof(req_);
+        req_.request_data = &data_.front();
+        req_.request_size = data_.size();
+        req_.channel = this;
+    }
+
+    ctrl_request* get() {
+        return &req_;
+    }
+
+    void allocReply(size_t size) {
+        reply_.resize(size);
+        req_.reply_data = &reply_.front();
+        req_.reply_size = size;
+    }
+
+    const std::string& reply() const {
+        return reply_;
+    }
+
+private:
+    ctrl_request req_;
+    std::string data_;
+    std::string reply_;
+};
+
+std::string encode(const std::function<void(ProtobufWriter*)>& fn) {
+    ProtobufWriter size;
+    fn(&size);
+    std::string buf(size.dataSize(), '\0');
+    ProtobufWriter writer(&buf.front(), buf.size());
+    fn(&writer);
+    return buf;
+}
+
+std::string dataRequest(const std::string& chunk, uint32_t offset) {
+    return encode([&](ProtobufWriter* w) {
+        w->writeBytes(PB(FirmwareUpdateDataRequest_data_tag), chunk.data(), chunk.size());
+        w->writeVarint(EXT(FirmwareUpdateDataRequestExt_offset_tag), offset);
+    });
+}
+
+int decodeDataRequestFast(ctrl_request* req, uint32_t* offset, const char** data, size_t* size) {
+    *offset = 0;
+    *data = nullptr;
+    *size = 0;
+    ProtobufReader reader((const char*)req->request_data, req->request_size);
+    ProtobufField field = {};
+    int r = 0;
+    while ((r = reader.next(&field)) > 0) {
+        if (field.tag == PB(FirmwareUpdateDataRequest_data_tag)) {
+            if (field.type != ProtobufWireType::LENGTH_DELIMITED) {
+                return SYSTEM_ERROR_NOT_SUPPORTED;
+            }
+            *data = field.data;
+            *size = field.size;
+        } else if (field.tag == EXT(FirmwareUpdateDataRequestExt_offset_tag)) {
+            if (field.type != ProtobufWireType::VARINT) {
+                return SYSTEM_ERROR_NOT_SUPPORTED;
+            }
+            *offset = field.value;
+        }
+    }
+    return (r < 0) ? SYSTEM_ERROR_BAD_DATA : 0;
+}
+
+int decodeDataRequestPb(ctrl_request* req, uint32_t* offset, const char** data, size_t* size) {
+    PB(FirmwareUpdateDataRequest) pbReq = {};
+    DecodedString pbData(&pbReq.data);
+    int r = decodeRequestMessage(req, PB(FirmwareUpdateDataRequest_fields), &pbReq);
+    if (r < 0) {
+        return r;
+    }
+    EXT(FirmwareUpdateDataRequestExt) pbExt = {};
+    r = decodeRequestMessage(req, EXT(FirmwareUpdateDataRequestExt_fields), &pbExt);
+    if (r < 0) {
+        return r;
+    }
+    *offset = pbExt.offset;
+    *data = pbData.data;
+    *size = pbData.size;
+    return 0;
+}
+
+PB(FirmwareModuleType) moduleFunctionToPb(unsigned func) {
+    switch (func) {
+    case MODULE_FUNCTION_BOOTLOADER:
+        return PB(FirmwareModuleType_BOOTLOADER);
+    case MODULE_FUNCTION_MONO_FIRMWARE:
+        return PB(FirmwareModuleType_MONO_FIRMWARE);
+    case MODULE_FUNCTION_SYSTEM_PART:
+        return PB(FirmwareModuleType_SYSTEM_PART);
+    case MODULE_FUNCTION_USER_PART:
+        return PB(FirmwareModuleType_USER_PART);
+    case MODULE_FUNCTION_NCP_FIRMWARE:
+        return PB(FirmwareModuleType_NCP_FIRMWARE);
+    case MODULE_FUNCTION_RADIO_STACK:
+        return PB(FirmwareModuleType_RADIO_STACK);
+    default:
+        return PB(FirmwareModuleType_INVALID_FIRMWARE_MODULE);
+    }
+}
+
+unsigned moduleValidity(const hal_module_t& module) {
+    unsigned valid = 0;
+    if (!(module.validity_result & MODULE_VALIDATION_INTEGRITY)) {
+        valid |= PB(FirmwareModuleValidityFlag_INTEGRITY_CHECK_FAILED);
+    }
+    if (!(module.validity_result & MODULE_VALIDATION_DEPENDENCIES)) {
+        valid |= PB(FirmwareModuleValidityFlag_DEPENDENCY_CHECK_FAILED);
+    }
+    return valid;
+}
+
+uint32_t moduleSize(const hal_module_t& module) {
+    return (uintptr_t)module.info.module_end_address - (uintptr_t)module.info.module_start_address;
+}
+
+bool isReportedModule(const hal_module_t& module) {
+    return module.bounds.store == MODULE_STORE_MAIN &&
+            moduleFunctionToPb(module.info.module_function) != PB(FirmwareModuleType_INVALID_FIRMWARE_MODULE);
+}
+
+void writeUInt(ProtobufWriter* writer, unsigned tag, uint32_t val) {
+    if (val) {
+        writer->writeVarint(tag, val);
+    }
+}
+
+void encodeModuleDependencyFast(ProtobufWriter* writer, PB(FirmwareModuleType) type, const module_dependency_t& dep) {
+    writeUInt(writer, PB(GetModuleInfoReply_Dependency_type_tag), type);
+    writeUInt(writer, PB(GetModuleInfoReply_Dependency_index_tag), dep.module_index);
+    writeUInt(writer, PB(GetModuleInfoReply_Dependency_version_tag), dep.module_version);
+}
+
+void encodeModuleFast(ProtobufWriter* writer, const hal_module_t& module) {
+    writeUInt(writer, PB(GetModuleInfoReply_Module_type_tag), moduleFunctionToPb(module.info.module_function));
+    writeUInt(writer, PB(GetModuleInfoReply_Module_index_tag), module.info.module_index);
+    writeUInt(writer, PB(GetModuleInfoReply_Module_version_tag), module.info.module_version);
+    writeUInt(writer, PB(GetModuleInfoReply_Module_size_tag), moduleSize(module));
+    writeUInt(writer, PB(GetModuleInfoReply_Module_validity_tag), moduleValidity(module));
+    for (unsigned i = 0; i < 2; ++i) {
+        const module_dependency_t& dep = (i == 0) ? module.info.dependency : module.info.dependency2;
+        const auto type = moduleFunctionToPb(dep.module_function);
+        if (type == PB(FirmwareModuleType_INVALID_FIRMWARE_MODULE)) {
+            continue;
+        }
+        ProtobufWriter depSize;
+        encodeModuleDependencyFast(&depSize, type, dep);
+        writer->writeMessageHeader(PB(GetModuleInfoReply_Module_dependencies_tag), depSize.dataSize());
+        encodeModuleDependencyFast(writer, type, dep);
+    }
+}
+
+size_t encodeModuleInfoReplyFast(const hal_system_info_t& info, char* buf, size_t size) {
+    ProtobufWriter writer(buf, size);
+    for (size_t i = 0; i < info.module_count; ++i) {
+        const hal_module_t& module = info.modules[i];
+        if (!isReportedModule(module)) {
+            continue;
+        }
+        ProtobufWriter moduleSize;
+        encodeModuleFast(&moduleSize, module);
+        writer.writeMessageHeader(PB(GetModuleInfoReply_modules_tag), moduleSize.dataSize());
+        encodeModuleFast(&writer, module);
+    }
+    return writer.dataSize();
+}
+
+int encodeModuleInfoFast(ctrl_request* req, const hal_system_info_t& info) {
+    const size_t size = encodeModuleInfoReplyFast(info, nullptr, 0);
+    const int r = system_ctrl_alloc_reply_data(req, size, nullptr);
+    if (r < 0) {
+        return r;
+    }
+    encodeModuleInfoReplyFast(info, (char*)req->reply_data, size);
+    return 0;
+}
+
+bool encodeModuleDependenciesPb(pb_ostream_t* strm, const pb_field_iter_t* field, void* const* arg) {
+    const auto info = (const module_info_t*)*arg;
+    for (unsigned i = 0; i < 2; ++i) {
+        const module_dependency_t& dep = (i == 0) ? info->dependency : info->dependency2;
+        const auto type = moduleFunctionToPb(dep.module_function);
+        if (type == PB(FirmwareModuleType_INVALID_FIRMWARE_MODULE)) {
+            continue;
+        }
+        PB(GetModuleInfoReply_Dependency) pbDep = {};
+        pbDep.type = type;
+        pbDep.index = dep.module_index;
+        pbDep.version = dep.module_version;
+        if (!pb_encode_tag_for_field(strm, field)) {
+            return false;
+        }
+        if (!pb_encode_submessage(strm, PB(GetModuleInfoReply_Dependency_fields), &pbDep)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool encodeModulesPb(pb_ostream_t* strm, const pb_field_iter_t* field, void* const* arg) {
+    const auto info = (const hal_system_info_t*)*arg;
+    for (size_t i = 0; i < info->module_count; ++i) {
+        const hal_module_t& module = info->modules[i];
+        if (!isReportedModule(module)) {
+            continue;
+        }
+        PB(GetModuleInfoReply_Module) pbModule = {};
+        pbModule.type = moduleFunctionToPb(module.info.module_function);
+        pbModule.index = module.info.module_index;
+        pbModule.version = module.info.module_version;
+        pbModule.size = moduleSize(module);
+        pbModule.validity = moduleValidity(module);
+        pbModule.dependencies.arg = const_cast<module_info_t*>(&module.info);
+        pbModule.dependencies.funcs.encode = encodeModuleDependenciesPb;
+        if (!pb_encode_tag_for_field(strm, field)) {
+            return false;
+        }
+        if (!pb_encode_submessage(strm, PB(GetModuleInfoReply_Module_fields), &pbModule)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int encodeModuleInfoPb(ctrl_request* req, const hal_system_info_t& info) {
+    PB(GetModuleInfoReply) pbRep = {};
+    pbRep.modules.arg = const_cast<hal_system_info_t*>(&info);
+    pbRep.modules.funcs.encode = encodeModulesPb;
+    return encodeReplyMessage(req, PB(GetModuleInfoReply_fields), &pbRep);
+}
+
+hal_module_t makeModule(module_function_t func, uint8_t index, uint16_t version, uint32_t size,
+        const module_dependency_t& dep = module_dependency_t(), const module_dependency_t& dep2 = module_dependency_t()) {
+    hal_module_t m = {};
+    m.bounds.store = MODULE_STORE_MAIN;
+    m.info.module_function = func;
+    m.info.module_index = index;
+    m.info.module_version = version;
+    m.info.module_start_address = (const void*)(uintptr_t)0x30000;
+    m.info.module_end_address = (const void*)(uintptr_t)(0x30000 + size);
+    m.info.dependency = dep;
+    m.info.dependency2 = dep2;
+    m.validity_checked = MODULE_VALIDATION_INTEGRITY | MODULE_VALIDATION_DEPENDENCIES;
+    m.validity_result = m.validity_checked;
+    return m;
+}
+
+// Modules reported by a typical Gen 3 device
+std::vector<hal_module_t> deviceModules() {
+    const module_dependency_t sysDep = { MODULE_FUNCTION_SYSTEM_PART, 1, 5302 };
+    const module_dependency_t bootDep = { MODULE_FUNCTION_BOOTLOADER, 0, 2200 };
+    const module_dependency_t radioDep = { MODULE_FUNCTION_RADIO_STACK, 0, 202 };
+    std::vector<hal_module_t> modules;
+    modules.push_back(makeModule(MODULE_FUNCTION_BOOTLOADER, 0, 2200, 48 * 1024, sysDep));
+    modules.push_back(makeModule(MODULE_FUNCTION_SYSTEM_PART, 1, 5302, 860 * 1024, bootDep, radioDep));
+    modules.push_back(makeModule(MODULE_FUNCTION_USER_PART, 1, 6, 12 * 1024, sysDep));
+    modules.push_back(makeModule(MODULE_FUNCTION_RADIO_STACK, 0, 202, 150 * 1024));
+    modules.push_back(makeModule(MODULE_FUNCTION_NCP_FIRMWARE, 0, 7, 0));
+    // Not reported
+    auto fac = makeModule(MODULE_FUNCTION_USER_PART, 1, 6, 12 * 1024, sysDep);
+    fac.bounds.store = MODULE_STORE_FACTORY;
+    modules.push_back(fac);
+    // Failed validation
+    modules[2].validity_result = MODULE_VALIDATION_INTEGRITY;
+    return modules;
+}
+
+hal_system_info_t systemInfo(std::vector<hal_module_t>& modules) {
+    hal_system_info_t info = {};
+    info.size = sizeof(info);
+    info.modules = modules.data();
+    info.module_count = modules.size();
+    return info;
+}
+
+typedef std::chrono::duration<double, std::nano> Nanoseconds;
+
+template<typename F>
+double nsPerCall(unsigned iterations, F fn) {
+    const auto t1 = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < iterations; ++i) {
+        fn();
+    }
+    const auto t2 = std::chrono::steady_clock::now();
+    return Nanoseconds(t2 - t1).count() / iterations;
+}
+
+} // namespace
+
+int system_ctrl_alloc_reply_data(ctrl_request* req, size_t size, void* reserved) {
+    static_cast<Request*>(req->channel)->allocReply(size);
+    return 0;
+}
+
+TEST_CASE("FirmwareUpdateDataRequest decoding") {
+    const std::string chunk(CHUNK_SIZE, 'x');
+    Request req(dataRequest(chunk, CHUNK_OFFSET));
+
+    SECTION("ProtobufReader and nanopb decode the same values") {
+        uint32_t offset1 = 0, offset2 = 0;
+        const char* data1 = nullptr;
+        const char* data2 = nullptr;
+        size_t size1 = 0, size2 = 0;
+        REQUIRE(decodeDataRequestFast(req.get(), &offset1, &data1, &size1) == 0);
+        REQUIRE(decodeDataRequestPb(req.get(), &offset2, &data2, &size2) == 0);
+        CHECK(offset1 == CHUNK_OFFSET);
+        CHECK(offset2 == CHUNK_OFFSET);
+        CHECK(size1 == CHUNK_SIZE);
+        CHECK(size2 == CHUNK_SIZE);
+        // Both decoders return a pointer into the request buffer
+        CHECK(data1 == data2);
+        CHECK(std::string(data1, size1) == chunk);
+    }
+}
+
+TEST_CASE("GetModuleInfoReply encoding") {
+    auto modules = deviceModules();
+    const auto info = systemInfo(modules);
+
+    SECTION("ProtobufWriter and nanopb produce the same message") {
+        Request req1, req2;
+        REQUIRE(encodeModuleInfoFast(req1.get(), info) == 0);
+        REQUIRE(encodeModuleInfoPb(req2.get(), info) == 0);
+        CHECK(!req1.reply().empty());
+        CHECK(req1.reply() == req2.reply());
+    }
+}
+
+TEST_CASE("Control request protobuf benchmark", "[.benchmark]") {
+    const unsigned iterations = 200000;
+
+    const std::string chunk(CHUNK_SIZE, 'x');
+    Request dataReq(dataRequest(chunk, CHUNK_OFFSET));
+    uint32_t offset = 0;
+    const char* data = nullptr;
+    size_t size = 0;
+    const double decodeFast = nsPerCall(iterations, [&]() {
+        decodeDataRequestFast(dataReq.get(), &offset, &data, &size);
+    });
+    const double decodePb = nsPerCall(iterations, [&]() {
+        decodeDataRequestPb(dataReq.get(), &offset, &data, &size);
+    });
+    WARN("FirmwareUpdateDataRequest, ProtobufReader: " << decodeFast << " ns per request");
+    WARN("FirmwareUpdateDataRequest, pb_decode: " << decodePb << " ns per request");
+
+    auto modules = deviceModules();
+    const auto info = systemInfo(modules);
+    Request infoReq;
+    const double encodeFast = nsPerCall(iterations, [&]() {
+        encodeModuleInfoFast(infoReq.get(), info);
+    });
+    const double encodePb = nsPerCall(iterations, [&]() {
+        encodeModuleInfoPb(infoReq.get(), info);
+    });
+    WARN("GetModuleInfoReply (" << infoReq.reply().size() << " bytes), ProtobufWriter: " << encodeFast << " ns per reply");
+    WARN("GetModuleInfoReply (" << infoReq.reply().size() << " bytes), pb_encode: " << encodePb << " ns per reply");
+}
@@ -0,0 +1,523 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define CATCH_CONFIG_MAIN
+
+#include "control/storage.h"
+#include "control/firmware_chunk_pipeline.h"
+#include "firmware_update.h"
+#include "system_update.h"
+#include "system_threading.h"
+#include "ota_flash_hal.h"
+#include "concurrent_hal.h"
+#include "core_hal.h"
+
+#include "protocol_defs.h"
+#include "protobuf_wire.h"
+
+#include "control/storage.pb.h"
+#include "firmware_update.pb.h"
+
+#include "catch2/catch.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <functional>
+#include <memory>
+#include <cstring>
+
+#define PB(_name) particle_ctrl_##_name
+#define EXT(_name) particle_firmware_##_name
+
+namespace particle {
+
+ISRTaskQueue SystemISRTaskQueue;
+
+} // namespace particle
+
+namespace {
+
+using namespace particle;
+using namespace particle::control;
+
+const uint32_t FILE_ADDRESS = 0x10000;
+const size_t CHUNK_SIZE = 16;
+const auto WAIT_TIMEOUT = std::chrono::seconds(5);
+
+// Control request issued by the simulated host
+class Request {
+public:
+    explicit Request(std::string data = std::string()) :
+            data_(std::move(data)),
+            result_(0),
+            done_(false) {
+        req_.size = sizeof(req_);
+        req_.request_data = &data_.front();
+        req_.request_size = data_.size();
+        req_.reply_data = nullptr;
+        req_.reply_size = 0;
+        req_.channel = this;
+    }
+
+    ctrl_request* get() {
+        return &req_;
+    }
+
+    void setResult(int result, ctrl_completion_handler_fn handler, void* data) {
+        result_ = result;
+        done_ = true;
+        if (handler) {
+            handler(0 /* result */, data);
+        }
+    }
+
+    void allocReply(size_t size) {
+        reply_.resize(size);
+        req_.reply_data = &reply_.front();
+        req_.reply_size = size;
+    }
+
+    // Returns the value of a varint field of the reply, or 0 if the field is not present
+    uint32_t replyField(unsigned tag) const {
+        ProtobufReader reader(reply_.data(), reply_.size());
+        ProtobufField field = {};
+        while (reader.next(&field) > 0) {
+            if (field.tag == tag) {
+                return field.value;
+            }
+        }
+        return 0;
+    }
+
+    int result() const {
+        return result_;
+    }
+
+    bool done() const {
+        return done_;
+    }
+
+private:
+    ctrl_request req_;
+    std::string data_;
+    std::string reply_;
+    int result_;
+    bool done_;
+};
+
+std::string encode(const std::function<void(ProtobufWriter*)>& fn) {
+    ProtobufWriter size;
+    fn(&size);
+    std::string buf(size.dataSize(), '\0');
+    ProtobufWriter writer(&buf.front(), buf.size());
+    fn(&writer);
+    return buf;
+}
+
+std::unique_ptr<Request> startRequest(size_t fileSize, size_t maxPendingChunks = 0) {
+    auto data = encode([=](ProtobufWriter* w) {
+        w->writeVarint(PB(StartFirmwareUpdateRequest_size_tag), fileSize);
+        if (maxPendingChunks) {
+            w->writeVarint(EXT(StartFirmwareUpdateRequestExt_max_pending_chunks_tag), maxPendingChunks);
+        }
+    });
+    return std::make_unique<Request>(std::move(data));
+}
+
+std::unique_ptr<Request> dataRequest(const std::string& chunk, size_t offset) {
+    auto data = encode([&](ProtobufWriter* w) {
+        w->writeBytes(PB(FirmwareUpdateDataRequest_data_tag), chunk.data(), chunk.size());
+        if (offset) {
+            w->writeVarint(EXT(FirmwareUpdateDataRequestExt_offset_tag), offset);
+        }
+    });
+    return std::make_unique<Request>(std::move(data));
+}
+
+std::unique_ptr<Request> finishRequest() {
+    return std::make_unique<Request>();
+}
+
+// Simulated OTA section and system update state
+class Device {
+public:
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::string flash; // Contents of the OTA section
+    std::vector<std::string> log;
+    std::thread::id mainThread;
+    std::thread::id flashThread; // Thread that performed the last write via HAL_FLASH_Update()
+    size_t flashWrites = 0;
+    size_t chunksWritten = 0; // Number of chunks reported via FirmwareUpdate::chunkWritten()
+    size_t chunkWrittenOffset = 0;
+    int flashError = 0;
+    bool flashBlocked = false;
+    bool chunkWrittenOnOtherThread = false;
+
+    void reset() {
+        std::lock_guard<std::mutex> lk(mutex);
+        flash.clear();
+        log.clear();
+        mainThread = std::this_thread::get_id();
+        flashThread = std::thread::id();
+        flashWrites = 0;
+        chunksWritten = 0;
+        chunkWrittenOffset = 0;
+        flashError = 0;
+        flashBlocked = false;
+        chunkWrittenOnOtherThread = false;
+    }
+
+    void write(uint32_t addr, const char* data, size_t size) {
+        const size_t offs = addr - FILE_ADDRESS;
+        if (flash.size() < offs + size) {
+            flash.resize(offs + size);
+        }
+        memcpy(&flash[offs], data, size);
+    }
+
+    bool waitFlashWrites(size_t count) {
+        std::unique_lock<std::mutex> lk(mutex);
+        return cond.wait_for(lk, WAIT_TIMEOUT, [=]() { return flashWrites >= count; });
+    }
+
+    void setFlashBlocked(bool blocked) {
+        std::lock_guard<std::mutex> lk(mutex);
+        flashBlocked = blocked;
+        cond.notify_all();
+    }
+};
+
+Device g_device;
+
+// Processes the tasks posted to the system thread, e.g. the completion of the written chunks,
+// until the condition is met
+template<typename F>
+bool processSystemTasksUntil(F cond) {
+    const auto t = std::chrono::steady_clock::now() + WAIT_TIMEOUT;
+    while (!cond()) {
+        if (std::chrono::steady_clock::now() >= t) {
+            return false;
+        }
+        SystemISRTaskQueue.process();
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+std::string makeFirmware(size_t size) {
+    std::string s(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+        s[i] = (char)(i * 7 + 1);
+    }
+    return s;
+}
+
+struct Semaphore {
+    std::mutex mutex;
+    std::condition_variable cond;
+    unsigned count;
+    unsigned maxCount;
+};
+
+} // namespace
+
+int system_ctrl_alloc_reply_data(ctrl_request* req, size_t size, void* reserved) {
+    static_cast<Request*>(req->channel)->allocReply(size);
+    return 0;
+}
+
+void system_ctrl_set_result(ctrl_request* req, int result, ctrl_completion_handler_fn handler, void* data, void* reserved) {
+    static_cast<Request*>(req->channel)->setResult(result, handler, data);
+}
+
+int Spark_Prepare_For_Firmware_Update(FileTransfer::Descriptor& file, uint32_t flags, void* reserved) {
+    g_device.log.push_back("prepare");
+    file.file_address = FILE_ADDRESS;
+    file.chunk_size = CHUNK_SIZE;
+    return 0;
+}
+
+int Spark_Save_Firmware_Chunk(FileTransfer::Descriptor& file, const uint8_t* chunk, void* reserved) {
+    REQUIRE(std::this_thread::get_id() == g_device.mainThread);
+    const int r = HAL_FLASH_Update(chunk, file.chunk_address, file.chunk_size, nullptr);
+    if (r != 0) {
+        return SYSTEM_ERROR_FLASH_IO;
+    }
+    return particle::system::FirmwareUpdate::instance()->chunkWritten((const char*)chunk, file.chunk_size,
+            file.chunk_address - file.file_address, 0 /* partialSize */);
+}
+
+int Spark_Finish_Firmware_Update(FileTransfer::Descriptor& file, uint32_t flags, void* reserved) {
+    using namespace particle::protocol;
+    if (!(flags & UpdateFlag::SUCCESS)) {
+        g_device.log.push_back("error");
+    } else if (flags & UpdateFlag::VALIDATE_ONLY) {
+        g_device.log.push_back("validate");
+    } else {
+        g_device.log.push_back("apply");
+    }
+    return 0;
+}
+
+int HAL_FLASH_Update(const uint8_t* data, uint32_t addr, uint32_t size, void* reserved) {
+    std::unique_lock<std::mutex> lk(g_device.mutex);
+    g_device.cond.wait(lk, []() { return !g_device.flashBlocked; });
+    g_device.flashThread = std::this_thread::get_id();
+    int r = g_device.flashError;
+    if (r == 0) {
+        g_device.write(addr, (const char*)data, size);
+    }
+    ++g_device.flashWrites;
+    g_device.cond.notify_all();
+    return r;
+}
+
+int HAL_System_Info(hal_system_info_t* info, bool create, void* reserved) {
+    return 0;
+}
+
+namespace particle {
+
+namespace system {
+
+FirmwareUpdate::FirmwareUpdate() :
+        fileDesc_(),
+        lastActiveTime_(0),
+        updating_(false),
+        ledOverridden_(false) {
+}
+
+FirmwareUpdate* FirmwareUpdate::instance() {
+    static FirmwareUpdate instance;
+    return &instance;
+}
+
+// The firmware update state is owned by the system thread
+int FirmwareUpdate::chunkWritten(const char* chunkData, size_t chunkSize, size_t chunkOffset, size_t partialSize) {
+    if (std::this_thread::get_id() != g_device.mainThread) {
+        g_device.chunkWrittenOnOtherThread = true;
+    }
+    ++g_device.chunksWritten;
+    g_device.chunkWrittenOffset = chunkOffset + chunkSize;
+    return 0;
+}
+
+} // namespace system
+
+} // namespace particle
+
+os_result_t os_thread_create(os_thread_t* thread, const char* name, os_thread_prio_t priority, os_thread_fn_t fun,
+        void* param, size_t stackSize) {
+    *thread = new std::thread(fun, param);
+    return 0;
+}
+
+os_result_t os_thread_join(os_thread_t thread) {
+    static_cast<std::thread*>(thread)->join();
+    return 0;
+}
+
+os_result_t os_thread_cleanup(os_thread_t thread) {
+    delete static_cast<std::thread*>(thread);
+    return 0;
+}
+
+os_result_t os_thread_exit(os_thread_t thread) {
+    return 0;
+}
+
+int os_semaphore_create(os_semaphore_t* sem, unsigned maxCount, unsigned initCount) {
+    auto s = new Semaphore();
+    s->count = initCount;
+    s->maxCount = maxCount;
+    *sem = s;
+    return 0;
+}
+
+int os_semaphore_destroy(os_semaphore_t sem) {
+    delete static_cast<Semaphore*>(sem);
+    return 0;
+}
+
+int os_semaphore_take(os_semaphore_t sem, system_tick_t timeout, bool reserved) {
+    auto s = static_cast<Semaphore*>(sem);
+    std::unique_lock<std::mutex> lk(s->mutex);
+    if (!s->cond.wait_for(lk, std::chrono::milliseconds(timeout), [s]() { return s->count > 0; })) {
+        return 1;
+    }
+    --s->count;
+    return 0;
+}
+
+int os_semaphore_give(os_semaphore_t sem, bool reserved) {
+    auto s = static_cast<Semaphore*>(sem);
+    std::lock_guard<std::mutex> lk(s->mutex);
+    if (s->count >= s->maxCount) {
+        return 1;
+    }
+    ++s->count;
+    s->cond.notify_one();
+    return 0;
+}
+
+TEST_CASE("Firmware update control requests") {
+    g_device.reset();
+    const auto fw = makeFirmware(CHUNK_SIZE * 3 + 5);
+
+    SECTION("synchronous mode") {
+        auto start = startRequest(fw.size());
+        REQUIRE(startFirmwareUpdateRequest(start->get()) == 0);
+        CHECK(start->replyField(PB(StartFirmwareUpdateReply_chunk_size_tag)) == CHUNK_SIZE);
+        CHECK(start->replyField(EXT(StartFirmwareUpdateReplyExt_max_pending_chunks_tag)) == 0);
+        size_t offs = 0;
+        while (offs < fw.size()) {
+            const size_t n = std::min(CHUNK_SIZE, fw.size() - offs);
+            auto data = dataRequest(fw.substr(offs, n), offs);
+            firmwareUpdateDataRequest(data->get());
+            // The chunk is written synchronously by the system thread
+            REQUIRE(data->done());
+            REQUIRE(data->result() == 0);
+            offs += n;
+            CHECK(data->replyField(EXT(FirmwareUpdateDataReplyExt_bytes_written_tag)) == offs);
+            CHECK(g_device.flashThread == g_device.mainThread);
+        }
+        auto finish = finishRequest();
+        finishFirmwareUpdateRequest(finish->get());
+        REQUIRE(finish->done());
+        CHECK(finish->result() == 0);
+        CHECK(g_device.flash == fw);
+        CHECK(g_device.chunksWritten == 4);
+        CHECK(g_device.log == std::vector<std::string>({ "prepare", "validate", "apply" }));
+    }
+
+    SECTION("pipelined mode") {
+        auto start = startRequest(fw.size(), 8 /* maxPendingChunks */);
+        REQUIRE(startFirmwareUpdateRequest(start->get()) == 0);
+        CHECK(start->replyField(PB(StartFirmwareUpdateReply_chunk_size_tag)) == CHUNK_SIZE);
+        CHECK(start->replyField(EXT(StartFirmwareUpdateReplyExt_max_pending_chunks_tag)) == FirmwareChunkPipeline::MAX_PENDING_CHUNKS);
+        std::vector<std::unique_ptr<Request>> reqs;
+        size_t offs = 0;
+        while (offs < fw.size()) {
+            const size_t n = std::min(CHUNK_SIZE, fw.size() - offs);
+            auto data = dataRequest(fw.substr(offs, n), offs);
+            firmwareUpdateDataRequest(data->get());
+            // The request is completed once the chunk is written
+            CHECK_FALSE(data->done());
+            reqs.push_back(std::move(data));
+            offs += n;
+        }
+        REQUIRE(g_device.waitFlashWrites(reqs.size()));
+        // The chunks are written by the flash worker, but the requests are only completed, and the
+        // firmware update state updated, by the system thread
+        CHECK(g_device.flashThread != g_device.mainThread);
+        for (auto& r: reqs) {
+            CHECK_FALSE(r->done());
+        }
+        CHECK(g_device.chunksWritten == 0);
+        REQUIRE(processSystemTasksUntil([&]() { return reqs.back()->done(); }));
+        offs = 0;
+        for (auto& r: reqs) {
+            REQUIRE(r->done());
+            CHECK(r->result() == 0);
+            offs = std::min(offs + CHUNK_SIZE, fw.size());
+            CHECK(r->replyField(EXT(FirmwareUpdateDataReplyExt_bytes_written_tag)) == offs);
+        }
+        CHECK(g_device.chunksWritten == 4);
+        CHECK(g_device.chunkWrittenOffset == fw.size());
+        CHECK_FALSE(g_device.chunkWrittenOnOtherThread);
+        auto finish = finishRequest();
+        finishFirmwareUpdateRequest(finish->get());
+        REQUIRE(finish->done());
+        CHECK(finish->result() == 0);
+        CHECK(g_device.flash == fw);
+        CHECK(g_device.log == std::vector<std::string>({ "prepare", "validate", "apply" }));
+    }
+
+    SECTION("finishing the update while chunks are being written fails with BUSY") {
+        auto start = startRequest(CHUNK_SIZE, 4 /* maxPendingChunks */);
+        REQUIRE(startFirmwareUpdateRequest(start->get()) == 0);
+        g_device.setFlashBlocked(true);
+        auto data = dataRequest(fw.substr(0, CHUNK_SIZE), 0);
+        firmwareUpdateDataRequest(data->get());
+        auto finish = finishRequest();
+        finishFirmwareUpdateRequest(finish->get());
+        REQUIRE(finish->done());
+        CHECK(finish->result() == SYSTEM_ERROR_BUSY);
+        g_device.setFlashBlocked(false);
+        REQUIRE(processSystemTasksUntil([&]() { return data->done(); }));
+        CHECK(data->result() == 0);
+        finish = finishRequest();
+        finishFirmwareUpdateRequest(finish->get());
+        REQUIRE(finish->done());
+        CHECK(finish->result() == 0);
+        CHECK(g_device.log == std::vector<std::string>({ "prepare", "validate", "apply" }));
+    }
+
+    SECTION("a chunk with an unexpected offset cancels the update") {
+        auto start = startRequest(fw.size(), 4 /* maxPendingChunks */);
+        REQUIRE(startFirmwareUpdateRequest(start->get()) == 0);
+        auto data1 = dataRequest(fw.substr(0, CHUNK_SIZE), 0);
+        firmwareUpdateDataRequest(data1->get());
+        auto data2 = dataRequest(fw.substr(CHUNK_SIZE * 2, CHUNK_SIZE), CHUNK_SIZE * 2);
+        firmwareUpdateDataRequest(data2->get());
+        REQUIRE(data2->done());
+        CHECK(data2->result() == SYSTEM_ERROR_OUT_OF_RANGE);
+        // The first request has not been completed by the system thread yet, so it's cancelled
+        // along with the update, whether or not the chunk has already been written
+        REQUIRE(data1->done());
+        CHECK(data1->result() == SYSTEM_ERROR_CANCELLED);
+        CHECK(g_device.chunksWritten == 0);
+        CHECK(g_device.log == std::vector<std::string>({ "prepare", "error" }));
+    }
+
+    SECTION("a flash error cancels the update") {
+        auto start = startRequest(fw.size(), 4 /* maxPendingChunks */);
+        REQUIRE(startFirmwareUpdateRequest(start->get()) == 0);
+        g_device.flashError = -1;
+        auto data = dataRequest(fw.substr(0, CHUNK_SIZE), 0);
+        firmwareUpdateDataRequest(data->get());
+        REQUIRE(processSystemTasksUntil([&]() { return data->done(); }));
+        CHECK(data->result() == SYSTEM_ERROR_FLASH_IO);
+        CHECK(g_device.chunksWritten == 0);
+        CHECK(g_device.log == std::vector<std::string>({ "prepare", "error" }));
+        auto finish = finishRequest();
+        finishFirmwareUpdateRequest(finish->get());
+        REQUIRE(finish->done());
+        CHECK(finish->result() == SYSTEM_ERROR_INVALID_STATE);
+    }
+
+    SECTION("a chunk with an unexpected encoding is rejected without the nanopb fallback") {
+        auto start = startRequest(fw.size());
+        REQUIRE(startFirmwareUpdateRequest(start->get()) == 0);
+        // The data field is encoded as a varint
+        auto data = std::make_unique<Request>(encode([](ProtobufWriter* w) {
+            w->writeVarint(PB(FirmwareUpdateDataRequest_data_tag), CHUNK_SIZE);
+        }));
+        firmwareUpdateDataRequest(data->get());
+        REQUIRE(data->done());
+        CHECK(data->result() == SYSTEM_ERROR_BAD_DATA);
+        CHECK(g_device.chunksWritten == 0);
+    }
+
+    // Make sure the update is not left running for the next test
+    cancelFirmwareUpdateRequest(nullptr);
+}
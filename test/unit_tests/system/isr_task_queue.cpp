@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "active_object.h"
+
+#include "catch2/catch.hpp"
+
+#include <thread>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+namespace {
+
+struct CountingTask: ISRTaskQueue::Task {
+    std::vector<int>* log;
+    int id;
+    int count;
+
+    CountingTask(std::vector<int>* log = nullptr, int id = 0) :
+            Task(invoke),
+            log(log),
+            id(id),
+            count(0) {
+    }
+
+    static void invoke(ISRTaskQueue::Task* task) {
+        const auto t = static_cast<CountingTask*>(task);
+        ++t->count;
+        if (t->log) {
+            t->log->push_back(t->id);
+        }
+    }
+};
+
+struct OneShotTask: ISRTaskQueue::Task {
+    std::atomic<int>* counter;
+
+    explicit OneShotTask(std::atomic<int>* counter) :
+            Task(invoke),
+            counter(counter) {
+    }
+
+    static void invoke(ISRTaskQueue::Task* task) {
+        const auto t = static_cast<OneShotTask*>(task);
+        ++*t->counter;
+        delete t;
+    }
+};
+
+} // namespace
+
+TEST_CASE("ISRTaskQueue") {
+    ISRTaskQueue queue;
+
+    SECTION("returns false if there are no tasks") {
+        CHECK(!queue.process());
+    }
+
+    SECTION("invokes the tasks in the order they were enqueued") {
+        std::vector<int> log;
+        CountingTask t1(&log, 1), t2(&log, 2), t3(&log, 3);
+        CHECK(queue.enqueue(&t1));
+        CHECK(queue.enqueue(&t2));
+        CHECK(queue.enqueue(&t3));
+        CHECK(queue.process());
+        CHECK(log == std::vector<int>({ 1, 2, 3 }));
+        CHECK(!queue.process());
+    }
+
+    SECTION("coalesces a task that is already pending") {
+        CountingTask t;
+        CHECK(queue.enqueue(&t));
+        CHECK(!queue.enqueue(&t));
+        CHECK(queue.process());
+        CHECK(t.count == 1);
+        CHECK(queue.enqueue(&t));
+        CHECK(queue.process());
+        CHECK(t.count == 2);
+    }
+
+    SECTION("defers the tasks enqueued while processing to the next call") {
+        struct ReenqueueTask: ISRTaskQueue::Task {
+            ISRTaskQueue* queue;
+            int count;
+
+            explicit ReenqueueTask(ISRTaskQueue* queue) :
+                    Task(invoke),
+                    queue(queue),
+                    count(0) {
+            }
+
+            static void invoke(ISRTaskQueue::Task* task) {
+                const auto t = static_cast<ReenqueueTask*>(task);
+                if (++t->count < 3) {
+                    t->queue->enqueue(t);
+                }
+            }
+        };
+        ReenqueueTask t(&queue);
+        queue.enqueue(&t);
+        CHECK(queue.process());
+        CHECK(t.count == 1);
+        CHECK(queue.process());
+        CHECK(queue.process());
+        CHECK(t.count == 3);
+        CHECK(!queue.process());
+    }
+
+    SECTION("supports many concurrent producers") {
+        const int producerCount = 16;
+        const int tasksPerProducer = 5000;
+        std::atomic<int> counter(0);
+        std::atomic<int> running(producerCount);
+        std::vector<std::thread> producers;
+        for (int i = 0; i < producerCount; ++i) {
+            producers.emplace_back([&]() {
+                for (int j = 0; j < tasksPerProducer; ++j) {
+                    queue.enqueue(new OneShotTask(&counter));
+                }
+                --running;
+            });
+        }
+        // Process the tasks concurrently with the producers
+        while (running > 0) {
+            queue.process();
+        }
+        for (auto& t: producers) {
+            t.join();
+        }
+        while (queue.process()) {
+        }
+        CHECK(counter == producerCount * tasksPerProducer);
+    }
+
+    SECTION("invokes each pending task once under concurrent enqueues") {
+        const int producerCount = 8;
+        const int iterations = 20000;
+        CountingTask tasks[4];
+        std::atomic<int> enqueued(0);
+        std::atomic<int> running(producerCount);
+        std::vector<std::thread> producers;
+        for (int i = 0; i < producerCount; ++i) {
+            producers.emplace_back([&, i]() {
+                for (int j = 0; j < iterations; ++j) {
+                    if (queue.enqueue(&tasks[(i + j) % 4])) {
+                        ++enqueued;
+                    }
+                }
+                --running;
+            });
+        }
+        while (running > 0) {
+            queue.process();
+        }
+        for (auto& t: producers) {
+            t.join();
+        }
+        while (queue.process()) {
+        }
+        int invoked = 0;
+        for (const auto& t: tasks) {
+            invoked += t.count;
+        }
+        CHECK(invoked == enqueued);
+    }
+}
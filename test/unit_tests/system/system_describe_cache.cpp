@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "system_describe_cache.h"
+
+#include "catch2/catch.hpp"
+
+#include <string>
+#include <cstring>
+
+using namespace particle::system;
+
+namespace {
+
+int g_serializeCount = 0;
+int g_checksumCount = 0;
+std::string g_content;
+bool g_failCaching = false;
+
+bool appendToString(void* data, const uint8_t* buf, size_t size) {
+    static_cast<std::string*>(data)->append((const char*)buf, size);
+    return true;
+}
+
+bool serialize(appender_fn appender, void* data, void* reserved) {
+    ++g_serializeCount;
+    if (g_failCaching && appender != appendToString) {
+        return false;
+    }
+    return appender(data, (const uint8_t*)g_content.data(), g_content.size());
+}
+
+uint32_t checksum() {
+    ++g_checksumCount;
+    return g_content.size();
+}
+
+std::string append(DescribeCache* cache, DescribeCache::Section section) {
+    std::string s;
+    REQUIRE(cache->append(section, serialize, appendToString, &s));
+    return s;
+}
+
+void reset() {
+    g_serializeCount = 0;
+    g_checksumCount = 0;
+    g_content.clear();
+    g_failCaching = false;
+}
+
+} // namespace
+
+TEST_CASE("DescribeCache") {
+    reset();
+    DescribeCache cache;
+
+    SECTION("serializes a section only once") {
+        g_content = "\"f\":[\"a\"],\"v\":{}";
+        CHECK(append(&cache, DescribeCache::APPLICATION) == g_content);
+        CHECK(append(&cache, DescribeCache::APPLICATION) == g_content);
+        CHECK(g_serializeCount == 1);
+        CHECK(cache.hasData(DescribeCache::APPLICATION));
+        CHECK_FALSE(cache.hasData(DescribeCache::SYSTEM));
+    }
+
+    SECTION("computes a checksum only once") {
+        g_content = "abc";
+        CHECK(cache.checksum(DescribeCache::SYSTEM, checksum) == 3);
+        g_content = "abcd";
+        CHECK(cache.checksum(DescribeCache::SYSTEM, checksum) == 3);
+        CHECK(g_checksumCount == 1);
+    }
+
+    SECTION("regenerates an invalidated section") {
+        g_content = "\"p\":6";
+        CHECK(append(&cache, DescribeCache::SYSTEM) == "\"p\":6");
+        CHECK(append(&cache, DescribeCache::APPLICATION) == "\"p\":6");
+        CHECK(cache.checksum(DescribeCache::SYSTEM, checksum) == 5);
+        g_content = "\"p\":32";
+        cache.invalidate(DescribeCache::SYSTEM);
+        CHECK_FALSE(cache.hasData(DescribeCache::SYSTEM));
+        CHECK(append(&cache, DescribeCache::SYSTEM) == "\"p\":32");
+        CHECK(cache.checksum(DescribeCache::SYSTEM, checksum) == 6);
+        // Other sections are not affected
+        CHECK(append(&cache, DescribeCache::APPLICATION) == "\"p\":6");
+        CHECK(g_serializeCount == 3);
+        CHECK(g_checksumCount == 2);
+        cache.invalidateAll();
+        CHECK(append(&cache, DescribeCache::APPLICATION) == "\"p\":32");
+        CHECK(g_serializeCount == 4);
+    }
+
+    SECTION("regenerates the system section when the fingerprint of the system properties changes") {
+        g_content = "\"imei\":\"\"";
+        CHECK(append(&cache, DescribeCache::SYSTEM) == g_content);
+        CHECK(append(&cache, DescribeCache::APPLICATION) == g_content);
+        // The properties have been obtained for the first time
+        g_content = "\"imei\":\"352753090000001\"";
+        CHECK(cache.updateSystemFingerprint(0x1234));
+        CHECK_FALSE(cache.hasData(DescribeCache::SYSTEM));
+        CHECK(append(&cache, DescribeCache::SYSTEM) == g_content);
+        // The properties haven't changed
+        CHECK_FALSE(cache.updateSystemFingerprint(0x1234));
+        CHECK(cache.hasData(DescribeCache::SYSTEM));
+        // The properties have changed
+        g_content = "\"imei\":\"352753090000002\"";
+        CHECK(cache.updateSystemFingerprint(0x5678));
+        CHECK(append(&cache, DescribeCache::SYSTEM) == g_content);
+        CHECK(g_serializeCount == 4);
+        // The application section is not affected
+        CHECK(append(&cache, DescribeCache::APPLICATION) == "\"imei\":\"\"");
+    }
+
+    SECTION("caches an empty section") {
+        CHECK(append(&cache, DescribeCache::APPLICATION).empty());
+        CHECK(append(&cache, DescribeCache::APPLICATION).empty());
+        CHECK(g_serializeCount == 1);
+    }
+
+    SECTION("serializes directly to the destination if the section cannot be cached") {
+        g_content = "\"f\":[]";
+        g_failCaching = true;
+        CHECK(append(&cache, DescribeCache::APPLICATION) == g_content);
+        CHECK_FALSE(cache.hasData(DescribeCache::APPLICATION));
+        CHECK(g_serializeCount == 2);
+    }
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "system_loop_scheduler.h"
+
+#include "catch2/catch.hpp"
+
+using namespace particle::system;
+
+namespace {
+
+system_tick_t g_micros = 0;
+
+system_tick_t micros() {
+    return g_micros;
+}
+
+void advance(system_tick_t ms) {
+    g_micros += ms * 1000;
+}
+
+} // namespace
+
+TEST_CASE("LoopScheduler") {
+    g_micros = 0;
+    LoopScheduler sched(micros);
+
+    SECTION("sleeps for the maximum time if there are no deadlines") {
+        sched.beginPass();
+        sched.endPass();
+        CHECK(sched.nextTimeout(1000) == 1000);
+    }
+
+    SECTION("sleeps until the earliest deadline") {
+        sched.beginPass();
+        sched.wakeIn(500);
+        sched.wakeIn(100);
+        sched.wakeIn(300);
+        sched.endPass();
+        CHECK(sched.nextTimeout(1000) == 100);
+        advance(40);
+        CHECK(sched.nextTimeout(1000) == 60);
+        CHECK(sched.nextTimeout(50) == 50);
+        advance(60);
+        CHECK(sched.nextTimeout(1000) == 0);
+        advance(10);
+        CHECK(sched.nextTimeout(1000) == 0);
+    }
+
+    SECTION("rounds partial milliseconds up") {
+        sched.beginPass();
+        sched.wakeIn(10);
+        sched.endPass();
+        g_micros += 9500;
+        CHECK(sched.nextTimeout(1000) == 1);
+    }
+
+    SECTION("discards the deadlines at the beginning of a pass") {
+        sched.beginPass();
+        sched.wakeIn(100);
+        sched.endPass();
+        sched.beginPass();
+        sched.endPass();
+        CHECK(sched.nextTimeout(1000) == 1000);
+    }
+
+    SECTION("wakes up immediately when an event is signaled") {
+        sched.beginPass();
+        sched.wakeIn(100);
+        sched.endPass();
+        sched.wakeUp();
+        CHECK(sched.nextTimeout(1000) == 0);
+        sched.beginPass();
+        sched.endPass();
+        CHECK(sched.nextTimeout(1000) == 1000);
+    }
+
+    SECTION("keeps an event signaled during a pass") {
+        sched.beginPass();
+        sched.wakeUp();
+        sched.endPass();
+        CHECK(sched.nextTimeout(1000) == 0);
+    }
+
+    SECTION("handles the timer wraparound") {
+        g_micros = 0xffffffff - 50000;
+        sched.beginPass();
+        sched.wakeIn(100);
+        sched.endPass();
+        CHECK(sched.nextTimeout(1000) == 100);
+        advance(80);
+        CHECK(sched.nextTimeout(1000) == 20);
+        advance(20);
+        CHECK(sched.nextTimeout(1000) == 0);
+    }
+
+    SECTION("measures the number of passes per second and the loop load") {
+        CHECK(sched.wakeupsPerSecond() == 0);
+        CHECK(sched.load() == 0);
+        // 10 passes taking 5 ms each, 100 ms apart
+        for (int i = 0; i < 10; ++i) {
+            sched.beginPass();
+            advance(5);
+            sched.endPass();
+            advance(95);
+        }
+        sched.beginPass();
+        sched.endPass();
+        CHECK(sched.wakeupsPerSecond() == 11);
+        CHECK(sched.load() == 500); // 5%
+        // Idle for a few seconds
+        advance(3999);
+        sched.beginPass();
+        advance(1);
+        sched.endPass();
+        CHECK(sched.wakeupsPerSecond() == 0); // 1 pass in 4 seconds
+        CHECK(sched.load() == 3); // 0.025%
+    }
+
+    SECTION("counts recursive passes as one") {
+        sched.beginPass();
+        sched.wakeIn(100);
+        sched.beginPass();
+        sched.wakeIn(50);
+        sched.endPass();
+        advance(1000);
+        sched.endPass();
+        CHECK(sched.nextTimeout(1000) == 0);
+        CHECK(sched.wakeupsPerSecond() == 1);
+        CHECK(sched.load() == 10000);
+    }
+}
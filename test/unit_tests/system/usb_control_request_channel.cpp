@@ -1,4 +1,5 @@
 #include "usb_control_request_channel.h"
+#include "control/firmware_chunk_pipeline.h"
 #include "active_object.h"
 
 #include "mock/alloc.h"
@@ -905,3 +906,226 @@ TEST_CASE("UsbControlRequestChannel") {
         channel.checkMemory(); // Ensure there are no memory leaks
     }
 }
+
+namespace {
+
+using particle::control::FirmwareChunkPipeline;
+
+// Simulated host uploading a firmware binary via FIRMWARE_UPDATE_DATA-like requests. Time is
+// simulated: the host is charged for every control transfer it makes, the device for every chunk
+// it writes to flash
+class UploadSimulator {
+public:
+    // Duration of a control transfer, in microseconds
+    static const unsigned CONTROL_TRANSFER_TIME = 1000;
+    // Time it takes to write a chunk to flash, in microseconds
+    static const unsigned FLASH_WRITE_TIME = 10000;
+
+    UploadSimulator(Channel* channel, bool pipelined) :
+            pipeline_(writeChunk, completeRequest, this),
+            channel_(channel),
+            now_(0),
+            writeEndTime_(0),
+            writing_(false),
+            pipelined_(pipelined) {
+        channel_->requestHandler([this](ctrl_request* req, ControlRequestChannel* ch) {
+            if (pipelined_) {
+                // Queue the chunk, the request is completed by the flash worker
+                const int r = pipeline_.push(req, req->request_data, req->request_size);
+                if (r < 0) {
+                    ch->setResult(req, r);
+                }
+            } else {
+                // Write the chunk synchronously
+                const size_t offset = flash_.size();
+                flash_.append(req->request_data, req->request_size);
+                now_ += FLASH_WRITE_TIME;
+                completeRequest(req, req->request_data, req->request_size, offset, 0, this);
+            }
+        });
+    }
+
+    // Returns the achieved throughput in bytes per second
+    double upload(const std::string& data, size_t chunkSize, unsigned maxPendingChunks) {
+        struct Chunk {
+            uint16_t id;
+            size_t end; // Offset of the end of the chunk
+        };
+        std::list<Chunk> pending;
+        size_t offset = 0;
+        size_t acked = 0;
+        while (offset < data.size() || !pending.empty()) {
+            // Keep the window full
+            while (pending.size() < maxPendingChunks && offset < data.size()) {
+                const auto chunk = data.substr(offset, chunkSize);
+                REQUIRE(transfer(channel_->serviceRequest(ServiceRequest::INIT).type(CTRL_REQUEST_FIRMWARE_UPDATE_DATA).size(chunk.size())));
+                auto rep = channel_->serviceReply();
+                const auto id = rep.id();
+                while (rep.status() == ServiceReply::PENDING) {
+                    REQUIRE(transfer(channel_->serviceRequest(ServiceRequest::CHECK).id(id)));
+                    rep = channel_->serviceReply();
+                }
+                REQUIRE(rep.status() == ServiceReply::OK);
+                REQUIRE(transfer(channel_->serviceRequest(ServiceRequest::SEND).id(id).data(chunk)));
+                offset += chunk.size();
+                pending.push_back({ id, offset });
+            }
+            // Poll the oldest request
+            const auto& chunk = pending.front();
+            REQUIRE(transfer(channel_->serviceRequest(ServiceRequest::CHECK).id(chunk.id)));
+            const auto rep = channel_->serviceReply();
+            if (rep.status() == ServiceReply::PENDING) {
+                continue;
+            }
+            REQUIRE(rep.status() == ServiceReply::OK);
+            REQUIRE(rep.result() == SYSTEM_ERROR_NONE);
+            REQUIRE(rep.size() == 4);
+            REQUIRE(transfer(channel_->serviceRequest(ServiceRequest::RECV).id(chunk.id).size(4)));
+            // The acknowledgement is cumulative
+            Buffer buf(channel_->serviceReply().data());
+            const size_t written = buf.readLe<uint32_t>();
+            REQUIRE(written >= chunk.end);
+            REQUIRE(written >= acked);
+            acked = written;
+            pending.pop_front();
+        }
+        REQUIRE(acked == data.size());
+        REQUIRE(flash_ == data);
+        return data.size() * 1000000.0 / now_;
+    }
+
+private:
+    FirmwareChunkPipeline pipeline_;
+    std::string flash_;
+    Channel* channel_;
+    uint64_t now_;
+    uint64_t writeEndTime_;
+    bool writing_;
+    bool pipelined_;
+
+    bool transfer(ServiceRequest req) {
+        const bool ok = req.send();
+        advance(CONTROL_TRANSFER_TIME);
+        // The system thread picks up the requests immediately
+        processAllTasks();
+        return ok;
+    }
+
+    // Run the flash worker in parallel with the host
+    void advance(uint64_t dt) {
+        const auto t = now_ + dt;
+        for (;;) {
+            if (!writing_ && pipeline_.pendingCount() > 0) {
+                writing_ = true;
+                writeEndTime_ = now_ + FLASH_WRITE_TIME;
+            }
+            if (!writing_ || writeEndTime_ > t) {
+                break;
+            }
+            now_ = writeEndTime_;
+            REQUIRE(pipeline_.process());
+            // The system thread completes the request
+            REQUIRE(pipeline_.complete());
+            writing_ = false;
+        }
+        now_ = t;
+    }
+
+    static int writeChunk(const char* data, size_t size, size_t offset, void* ctx) {
+        const auto self = static_cast<UploadSimulator*>(ctx);
+        REQUIRE(offset == self->flash_.size());
+        self->flash_.append(data, size);
+        return 0;
+    }
+
+    static void completeRequest(ctrl_request* req, const char* data, size_t size, size_t offset, int result, void* ctx) {
+        const auto ch = static_cast<ControlRequestChannel*>(req->channel);
+        if (result == 0) {
+            const size_t bytesWritten = offset + size;
+            REQUIRE(ch->allocReplyData(req, 4) == 0);
+            // Little-endian
+            for (size_t i = 0; i < 4; ++i) {
+                req->reply_data[i] = (bytesWritten >> (i * 8)) & 0xff;
+            }
+        }
+        ch->setResult(req, result);
+    }
+};
+
+} // namespace
+
+TEST_CASE("FirmwareChunkPipeline") {
+    Channel channel;
+
+    const size_t CHUNK_SIZE = 1024;
+    const auto data = randomBytes(CHUNK_SIZE * 64 + CHUNK_SIZE / 3);
+
+    SECTION("completes queued requests once their chunks are written") {
+        std::vector<std::pair<int, size_t>> results;
+        std::string flash;
+        struct Ctx {
+            std::vector<std::pair<int, size_t>>* results;
+            std::string* flash;
+            int writeResult;
+        } ctx = { &results, &flash, 0 };
+        FirmwareChunkPipeline p([](const char* data, size_t size, size_t offset, void* ctx) {
+            const auto c = static_cast<Ctx*>(ctx);
+            if (c->writeResult == 0) {
+                c->flash->append(data, size);
+            }
+            return c->writeResult;
+        }, [](ctrl_request* req, const char* data, size_t size, size_t offset, int result, void* ctx) {
+            static_cast<Ctx*>(ctx)->results->push_back(std::make_pair(result, offset + size));
+        }, &ctx);
+        ctrl_request reqs[FirmwareChunkPipeline::MAX_PENDING_CHUNKS + 1] = {};
+        for (size_t i = 0; i < FirmwareChunkPipeline::MAX_PENDING_CHUNKS; ++i) {
+            CHECK(p.push(&reqs[i], data.data() + i * 10, 10) == 0);
+        }
+        CHECK(p.push(&reqs[FirmwareChunkPipeline::MAX_PENDING_CHUNKS], data.data(), 10) == SYSTEM_ERROR_LIMIT_EXCEEDED);
+        CHECK(p.pendingCount() == FirmwareChunkPipeline::MAX_PENDING_CHUNKS);
+        CHECK(p.process());
+        CHECK(p.process());
+        // Written chunks are not completed until the control thread picks them up
+        CHECK(results.empty());
+        CHECK(p.pendingCount() == FirmwareChunkPipeline::MAX_PENDING_CHUNKS);
+        CHECK(p.push(&reqs[FirmwareChunkPipeline::MAX_PENDING_CHUNKS], data.data(), 10) == SYSTEM_ERROR_LIMIT_EXCEEDED);
+        CHECK(p.complete());
+        CHECK_FALSE(p.complete());
+        CHECK(p.pendingCount() == FirmwareChunkPipeline::MAX_PENDING_CHUNKS - 2);
+        CHECK(results == std::vector<std::pair<int, size_t>>({ { 0, 10 }, { 0, 20 } }));
+        CHECK(flash == data.substr(0, 20));
+        // A write error is reported for the remaining chunks and the chunks queued afterwards
+        ctx.writeResult = SYSTEM_ERROR_FLASH_IO;
+        CHECK(p.process());
+        CHECK(p.error() == SYSTEM_ERROR_FLASH_IO);
+        CHECK(p.push(&reqs[FirmwareChunkPipeline::MAX_PENDING_CHUNKS], data.data(), 10) == SYSTEM_ERROR_FLASH_IO);
+        CHECK(p.complete());
+        p.cancel();
+        CHECK_FALSE(p.process());
+        CHECK_FALSE(p.complete());
+        CHECK(p.pendingCount() == 0);
+        CHECK(p.bytesWritten() == 20);
+        CHECK(results == std::vector<std::pair<int, size_t>>({ { 0, 10 }, { 0, 20 }, { SYSTEM_ERROR_FLASH_IO, 30 },
+                { SYSTEM_ERROR_CANCELLED, 40 } }));
+    }
+
+    SECTION("keeping several data requests in flight improves the upload throughput") {
+        double syncRate = 0;
+        {
+            UploadSimulator sim(&channel, false /* pipelined */);
+            syncRate = sim.upload(data, CHUNK_SIZE, 1);
+        }
+        channel.reset();
+        double pipelinedRate = 0;
+        {
+            UploadSimulator sim(&channel, true /* pipelined */);
+            pipelinedRate = sim.upload(data, CHUNK_SIZE, FirmwareChunkPipeline::MAX_PENDING_CHUNKS);
+        }
+        INFO("Synchronous: " << (unsigned)syncRate << " B/s, pipelined: " << (unsigned)pipelinedRate << " B/s");
+        // The upload becomes bound by the flash write time
+        const double flashRate = CHUNK_SIZE * 1000000.0 / UploadSimulator::FLASH_WRITE_TIME;
+        CHECK(pipelinedRate > syncRate * 1.4);
+        CHECK(pipelinedRate > flashRate * 0.9);
+        channel.checkMemory();
+    }
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2023 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_error.h"
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+namespace test {
+
+/**
+ * In-memory NOR flash device.
+ *
+ * Erased bytes read as 0xff. Programming a location that is not erased fails, so that a missing
+ * erase is caught by the tests. The device counts the operations performed on it.
+ */
+class FlashSimulator {
+public:
+    struct Stats {
+        size_t readCount = 0;
+        size_t bytesRead = 0;
+        size_t bytesProgrammed = 0;
+        size_t sectorsErased = 0;
+    };
+
+    explicit FlashSimulator(size_t size, size_t sectorSize = 4096) :
+            mem_(size, '\xff'),
+            sectorSize_(sectorSize) {
+    }
+
+    int read(size_t addr, void* data, size_t size) {
+        if (addr + size > mem_.size()) {
+            return SYSTEM_ERROR_OUT_OF_RANGE;
+        }
+        memcpy(data, mem_.data() + addr, size);
+        ++stats_.readCount;
+        stats_.bytesRead += size;
+        return 0;
+    }
+
+    int write(size_t addr, const void* data, size_t size) {
+        if (addr + size > mem_.size()) {
+            return SYSTEM_ERROR_OUT_OF_RANGE;
+        }
+        for (size_t i = 0; i < size; ++i) {
+            if (mem_[addr + i] != '\xff') {
+                return SYSTEM_ERROR_FLASH_IO; // Not erased
+            }
+        }
+        memcpy(&mem_[addr], data, size);
+        stats_.bytesProgrammed += size;
+        return 0;
+    }
+
+    int erase(size_t addr, size_t sectorCount) {
+        if (addr % sectorSize_ != 0 || addr + sectorCount * sectorSize_ > mem_.size()) {
+            return SYSTEM_ERROR_OUT_OF_RANGE;
+        }
+        memset(&mem_[addr], 0xff, sectorCount * sectorSize_);
+        stats_.sectorsErased += sectorCount;
+        return 0;
+    }
+
+    // Store data bypassing the statistics. The location doesn't need to be erased
+    void store(size_t addr, const std::string& data) {
+        mem_.replace(addr, data.size(), data);
+    }
+
+    std::string load(size_t addr, size_t size) const {
+        return mem_.substr(addr, size);
+    }
+
+    const Stats& stats() const {
+        return stats_;
+    }
+
+    void resetStats() {
+        stats_ = Stats();
+    }
+
+    size_t sectorSize() const {
+        return sectorSize_;
+    }
+
+    size_t size() const {
+        return mem_.size();
+    }
+
+private:
+    std::string mem_;
+    Stats stats_;
+    size_t sectorSize_;
+};
+
+} // namespace test
@@ -0,0 +1,76 @@
+/*
+ * Device-side counterpart of the protocol benchmark in test/cloud_server.
+ *
+ * Build it for the virtual device and pass the resulting binary to the benchmark:
+ *
+ *   cd main && make PLATFORM=gcc TEST=app/cloud_benchmark
+ */
+
+#include "application.h"
+
+namespace {
+
+// Interval between published events. The system allows up to 4 events per second
+const system_tick_t PUBLISH_INTERVAL = 250;
+
+int counter = 0;
+unsigned publishCount = 0;
+system_tick_t lastPublish = 0;
+
+enum class Reconnect {
+    NONE,
+    RESUME_SESSION,
+    CLEAR_SESSION,
+    WAKE,
+    WAKE_FAST_RESUME
+};
+
+Reconnect reconnect = Reconnect::NONE;
+
+// The return value lets the benchmark verify that the call has actually reached the application
+int benchFunction(String arg) {
+    return ++counter + arg.length();
+}
+
+// The device reconnects from the application loop so that the response to this call can be sent
+int reconnectFunction(String arg) {
+    reconnect = (arg == "clear_session") ? Reconnect::CLEAR_SESSION : Reconnect::RESUME_SESSION;
+    return 0;
+}
+
+// Simulates a wake-up from sleep: the device reconnects resuming its session and sends a confirmable
+// event as soon as it is connected
+int wakeFunction(String arg) {
+    reconnect = (arg == "fast") ? Reconnect::WAKE_FAST_RESUME : Reconnect::WAKE;
+    return 0;
+}
+
+} // namespace
+
+void setup() {
+    Particle.function("bench", benchFunction);
+    Particle.function("reconnect", reconnectFunction);
+    Particle.function("wake", wakeFunction);
+    Particle.variable("counter", counter);
+}
+
+void loop() {
+    if (reconnect != Reconnect::NONE) {
+        const bool wake = (reconnect == Reconnect::WAKE || reconnect == Reconnect::WAKE_FAST_RESUME);
+        if (wake) {
+            Particle.setFastResume(reconnect == Reconnect::WAKE_FAST_RESUME);
+        }
+        Particle.disconnect(CloudDisconnectOptions().clearSession(reconnect == Reconnect::CLEAR_SESSION));
+        waitUntil(Particle.disconnected);
+        reconnect = Reconnect::NONE;
+        Particle.connect();
+        if (wake) {
+            waitUntil(Particle.connected);
+            Particle.publish("wake", PRIVATE, WITH_ACK);
+        }
+    }
+    if (Particle.connected() && millis() - lastPublish >= PUBLISH_INTERVAL) {
+        Particle.publish("bench", String(++publishCount), PRIVATE);
+        lastPublish = millis();
+    }
+}
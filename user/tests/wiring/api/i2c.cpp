@@ -35,3 +35,20 @@ test(i2c_hal_backwards_compatibility)
     API_COMPILE(HAL_I2C_Release(i2c, NULL));
 #pragma GCC diagnostic pop
 }
+
+test(i2c_transaction_queue)
+{
+    uint8_t buf[4] = {};
+    int r = 0;
+    particle::I2cTransaction t(0x6b);
+    t.readRegisters(0x08, buf, 2).writeRegister(0x00, 0x30).timeout(100);
+    t.onComplete([](particle::I2cTransaction* t, int error, void* ctx) {
+    }, nullptr);
+    (void)t.isPending();
+    (void)t.segmentCount();
+    API_COMPILE(r = Wire.transfer(t));
+    API_COMPILE(r = Wire.cancelTransactions());
+    API_COMPILE(r = Wire.readRegisters(0x6b, 0x08, buf, sizeof(buf)));
+    API_COMPILE(r = Wire.writeRegisters(0x6b, 0x00, buf, sizeof(buf), 100));
+    (void)r;
+}
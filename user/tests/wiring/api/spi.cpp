@@ -145,6 +145,8 @@ test(spi_transfer)
     API_COMPILE(SPI.transfer(NULL, NULL, 1, NULL));
     API_COMPILE(SPI.transferCancel());
     API_COMPILE(SPI.endTransaction());
+    API_COMPILE({ SpiTransaction t; int r = SPI.transfer(t.add(NULL, NULL, 1)); (void)r; });
+    API_COMPILE({ int r = SPI.cancelTransactions(); (void)r; });
 
 #if Wiring_SPI1
     API_COMPILE({ int32_t r = SPI1.beginTransaction(); (void)r; });
@@ -153,6 +155,8 @@ test(spi_transfer)
     API_COMPILE(SPI1.transfer(NULL, NULL, 1, NULL));
     API_COMPILE(SPI1.transferCancel());
     API_COMPILE(SPI1.endTransaction());
+    API_COMPILE({ SpiTransaction t; int r = SPI1.transfer(t.add(NULL, NULL, 1)); (void)r; });
+    API_COMPILE({ int r = SPI1.cancelTransactions(); (void)r; });
 #endif // Wiring_SPI1
 
 #if Wiring_SPI2
@@ -162,6 +166,8 @@ test(spi_transfer)
     API_COMPILE(SPI2.transfer(NULL, NULL, 1, NULL));
     API_COMPILE(SPI2.transferCancel());
     API_COMPILE(SPI2.endTransaction());
+    API_COMPILE({ SpiTransaction t; int r = SPI2.transfer(t.add(NULL, NULL, 1)); (void)r; });
+    API_COMPILE({ int r = SPI2.cancelTransactions(); (void)r; });
 #endif // Wiring_SPI2
 }
 
@@ -385,6 +385,22 @@ public:
     }
 
     inline static void keepAlive(std::chrono::seconds s) { keepAlive(s.count()); }
+
+    /**
+     * Enable or disable fast resumption of the cloud session.
+     *
+     * When enabled, a session restored after waking up from sleep is used without confirming it
+     * with the server first, and no system messages are sent if the state of the device hasn't
+     * changed. If the server no longer has the session, the first publish will time out and the
+     * device will perform a full handshake.
+     *
+     * @param enabled Whether the fast resumption is enabled.
+     * @return 0 on success, otherwise an error code defined by `system_error_t`.
+     */
+    inline static int setFastResume(bool enabled)
+    {
+        return spark_set_connection_property(SPARK_CLOUD_FAST_RESUME_ENABLED, enabled, nullptr, nullptr);
+    }
 #endif
 
     /**
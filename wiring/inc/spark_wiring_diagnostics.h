@@ -26,9 +26,28 @@
 #include "combine_hash.h"
 #include "underlying_type.h"
 #include "debug.h"
+#include "platforms.h"
 
 #include <atomic>
 
+/**
+ * Default number of shards of a `ShardedCounterDiagnosticData`.
+ */
+#ifndef PARTICLE_DIAGNOSTIC_COUNTER_SHARD_COUNT
+#if PLATFORM_ID == PLATFORM_GCC
+#define PARTICLE_DIAGNOSTIC_COUNTER_SHARD_COUNT 8
+#else
+#define PARTICLE_DIAGNOSTIC_COUNTER_SHARD_COUNT 1
+#endif
+#endif // !defined(PARTICLE_DIAGNOSTIC_COUNTER_SHARD_COUNT)
+
+/**
+ * Alignment of the shards of a `ShardedCounterDiagnosticData` (the cache line size).
+ */
+#ifndef PARTICLE_DIAGNOSTIC_COUNTER_SHARD_ALIGNMENT
+#define PARTICLE_DIAGNOSTIC_COUNTER_SHARD_ALIGNMENT 64
+#endif
+
 #define PARTICLE_RETAINED_INTEGER_DIAGNOSTIC_DATA(_var, _id, _name, _val, ...) \
         PARTICLE_RETAINED ::particle::RetainedIntegerDiagnosticDataStorage _storage##_id; \
         ::particle::PersistentIntegerDiagnosticData<decltype(_storage##_id), ##__VA_ARGS__> _var(_storage##_id, _id, _name, _val);
@@ -327,6 +346,135 @@ private:
     }
 };
 
+template<>
+class UnsignedIntegerDiagnosticData<AtomicConcurrency>: public AbstractUnsignedIntegerDiagnosticData {
+public:
+    explicit UnsignedIntegerDiagnosticData(DiagnosticDataId id, IntType val = 0) :
+            UnsignedIntegerDiagnosticData(id, nullptr, val) {
+    }
+
+    UnsignedIntegerDiagnosticData(DiagnosticDataId id, const char* name, IntType val = 0) :
+            AbstractUnsignedIntegerDiagnosticData(id, name),
+            val_(val) {
+    }
+
+    IntType operator++() {
+        return (val_.fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+
+    IntType operator++(int) {
+        return val_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    IntType operator--() {
+        return (val_.fetch_sub(1, std::memory_order_relaxed) - 1);
+    }
+
+    IntType operator--(int) {
+        return val_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    IntType operator+=(IntType val) {
+        return (val_.fetch_add(val, std::memory_order_relaxed) + val);
+    }
+
+    IntType operator-=(IntType val) {
+        return (val_.fetch_sub(val, std::memory_order_relaxed) - val);
+    }
+
+    UnsignedIntegerDiagnosticData& operator=(IntType val) {
+        val_.store(val, std::memory_order_relaxed);
+        return *this;
+    }
+
+    operator IntType() const {
+        return val_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<IntType> val_;
+
+    virtual int get(IntType& val) override { // AbstractUnsignedIntegerDiagnosticData
+        val = val_.load(std::memory_order_relaxed);
+        return SYSTEM_ERROR_NONE;
+    }
+};
+
+/**
+ * A counter that can be incremented concurrently from multiple threads and ISRs without locking.
+ *
+ * The counter is split into `ShardCountT` atomic shards, each in its own cache line. An update
+ * goes to the shard selected by the current stack pointer, so that threads running on different
+ * cores rarely touch the same cache line. Reading the counter sums all shards.
+ *
+ * On single-core MCUs there's no such contention and a single shard is used by default, which makes
+ * the counter equivalent to a relaxed `std::atomic<uint32_t>`.
+ */
+template<size_t ShardCountT = PARTICLE_DIAGNOSTIC_COUNTER_SHARD_COUNT>
+class ShardedCounterDiagnosticData: public AbstractUnsignedIntegerDiagnosticData {
+public:
+    static_assert(ShardCountT > 0, "Invalid number of shards");
+
+    explicit ShardedCounterDiagnosticData(DiagnosticDataId id, const char* name = nullptr) :
+            AbstractUnsignedIntegerDiagnosticData(id, name),
+            shards_() {
+    }
+
+    // The increment operators don't return the counter value, since getting it requires summing
+    // all the shards
+    void operator++() {
+        shard().fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void operator++(int) {
+        shard().fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ShardedCounterDiagnosticData& operator+=(IntType val) {
+        shard().fetch_add(val, std::memory_order_relaxed);
+        return *this;
+    }
+
+    // Note that resetting the counter concurrently with an update may lose the update
+    void reset() {
+        for (auto& s: shards_) {
+            s.val.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    operator IntType() const {
+        IntType val = 0;
+        for (const auto& s: shards_) {
+            val += s.val.load(std::memory_order_relaxed);
+        }
+        return val;
+    }
+
+private:
+    struct alignas((ShardCountT > 1) ? PARTICLE_DIAGNOSTIC_COUNTER_SHARD_ALIGNMENT : alignof(std::atomic<IntType>)) Shard {
+        std::atomic<IntType> val;
+    };
+
+    Shard shards_[ShardCountT];
+
+    std::atomic<IntType>& shard() {
+        if (ShardCountT == 1) {
+            return shards_[0].val;
+        }
+        // Each thread runs on its own stack, so the stack pointer is a cheap thread identifier that
+        // doesn't require calling into the OS. The shift discards the bits that change with the call
+        // depth, and the multiplication spreads the remaining bits, since the stacks are usually
+        // allocated at regular intervals
+        const uint32_t sp = (uintptr_t)__builtin_frame_address(0) >> 12;
+        return shards_[((sp * 2654435761u) >> 16) % ShardCountT].val;
+    }
+
+    virtual int get(IntType& val) override { // AbstractUnsignedIntegerDiagnosticData
+        val = *this;
+        return SYSTEM_ERROR_NONE;
+    }
+};
+
 template<typename StorageT, typename ConcurrencyT = NoConcurrency>
 class PersistentIntegerDiagnosticData:
         public AbstractIntegerDiagnosticData,
@@ -575,6 +723,7 @@ typedef IntegerDiagnosticData<NoConcurrency> SimpleIntegerDiagnosticData;
 typedef UnsignedIntegerDiagnosticData<NoConcurrency> SimpleUnsignedIntegerDiagnosticData;
 typedef IntegerDiagnosticData<AtomicConcurrency> AtomicIntegerDiagnosticData;
 typedef UnsignedIntegerDiagnosticData<AtomicConcurrency> AtomicUnsignedIntegerDiagnosticData;
+typedef ShardedCounterDiagnosticData<> CounterDiagnosticData;
 typedef RetainedDiagnosticDataStorage<AbstractIntegerDiagnosticData::IntType> RetainedIntegerDiagnosticDataStorage;
 
 template<typename EnumT>
@@ -32,6 +32,8 @@
 #include "i2c_hal.h"
 #include <chrono>
 
+class TwoWire;
+
 class WireTransmission {
 public:
   WireTransmission(uint8_t address)
@@ -82,6 +84,158 @@ private:
   system_tick_t timeout_;
 };
 
+namespace particle {
+
+/**
+ * A transaction that is queued with TwoWire::transfer(I2cTransaction&).
+ *
+ * Segments are separated by repeated start conditions unless stop() is called after adding a
+ * segment. The transaction object and the buffers must remain valid until the completion
+ * callback is invoked.
+ */
+class I2cTransaction {
+public:
+  /**
+   * Completion callback. Invoked from the worker thread of the interface.
+   *
+   * @param transaction Transaction.
+   * @param error 0 on success, otherwise an error code defined by `system_error_t`.
+   * @param context User data.
+   */
+  typedef void (*CompletionCallback)(I2cTransaction* transaction, int error, void* context);
+
+  /**
+   * Maximum number of segments in a transaction.
+   */
+  static const unsigned MAX_SEGMENTS = 4;
+
+  explicit I2cTransaction(uint8_t address)
+      : halTransaction_(),
+        segments_(),
+        inline_(),
+        callback_(nullptr),
+        context_(nullptr),
+        timeout_(HAL_I2C_DEFAULT_TIMEOUT_MS),
+        address_(address),
+        count_(0),
+        overflow_(false),
+        pending_(false) {
+  }
+
+  // Prevent copying
+  I2cTransaction(const I2cTransaction&) = delete;
+  I2cTransaction& operator=(const I2cTransaction&) = delete;
+
+  I2cTransaction& write(const void* data, size_t size) {
+    return add(const_cast<void*>(data), size, HAL_I2C_TRANSACTION_SEGMENT_FLAG_NONE);
+  }
+
+  I2cTransaction& read(void* data, size_t size) {
+    return add(data, size, HAL_I2C_TRANSACTION_SEGMENT_FLAG_READ);
+  }
+
+  /**
+   * Read consecutive registers of the slave device.
+   *
+   * The register address is written and the data is read after a repeated start condition.
+   */
+  I2cTransaction& readRegisters(uint8_t reg, void* data, size_t size) {
+    if (count_ < MAX_SEGMENTS) {
+      inline_[count_][0] = reg;
+      write(inline_[count_], 1);
+    } else {
+      overflow_ = true;
+    }
+    return read(data, size).stop();
+  }
+
+  /**
+   * Write a single register of the slave device.
+   */
+  I2cTransaction& writeRegister(uint8_t reg, uint8_t value) {
+    if (count_ < MAX_SEGMENTS) {
+      inline_[count_][0] = reg;
+      inline_[count_][1] = value;
+      write(inline_[count_], 2);
+    } else {
+      overflow_ = true;
+    }
+    return stop();
+  }
+
+  /**
+   * Generate a stop condition after the last added segment.
+   */
+  I2cTransaction& stop() {
+    if (count_ > 0) {
+      segments_[count_ - 1].flags |= HAL_I2C_TRANSACTION_SEGMENT_FLAG_STOP;
+    }
+    return *this;
+  }
+
+  I2cTransaction& timeout(system_tick_t ms) {
+    timeout_ = ms;
+    return *this;
+  }
+
+  I2cTransaction& timeout(std::chrono::milliseconds ms) {
+    return timeout((system_tick_t)ms.count());
+  }
+
+  I2cTransaction& onComplete(CompletionCallback callback, void* context = nullptr) {
+    callback_ = callback;
+    context_ = context;
+    return *this;
+  }
+
+  /**
+   * Remove all segments.
+   */
+  I2cTransaction& clear() {
+    count_ = 0;
+    overflow_ = false;
+    return *this;
+  }
+
+  size_t segmentCount() const {
+    return count_;
+  }
+
+  /**
+   * Check if the transaction is queued or being performed.
+   */
+  bool isPending() const {
+    return pending_;
+  }
+
+private:
+  friend class ::TwoWire;
+
+  hal_i2c_transaction_t halTransaction_;
+  hal_i2c_transaction_segment_t segments_[MAX_SEGMENTS];
+  uint8_t inline_[MAX_SEGMENTS][2]; // Register addresses and values
+  CompletionCallback callback_;
+  void* context_;
+  system_tick_t timeout_;
+  uint8_t address_;
+  uint8_t count_;
+  bool overflow_;
+  volatile bool pending_;
+
+  I2cTransaction& add(void* data, size_t size, uint32_t flags) {
+    if (count_ < MAX_SEGMENTS) {
+      segments_[count_++] = { data, (uint32_t)size, flags };
+    } else {
+      overflow_ = true;
+    }
+    return *this;
+  }
+
+  static void halCallback(hal_i2c_transaction_t* transaction, int error, void* context);
+};
+
+} // namespace particle
+
 class TwoWire : public Stream
 {
 private:
@@ -120,6 +274,39 @@ public:
   bool lock();
   bool unlock();
 
+  /**
+   * Read consecutive registers of a slave device.
+   *
+   * The register address is written and the data is read after a repeated start condition.
+   *
+   * @return 0 on success, otherwise an error code defined by `system_error_t`.
+   */
+  int readRegisters(uint8_t address, uint8_t reg, uint8_t* data, size_t size, system_tick_t timeout = HAL_I2C_DEFAULT_TIMEOUT_MS);
+
+  /**
+   * Write consecutive registers of a slave device.
+   *
+   * @return 0 on success, otherwise an error code defined by `system_error_t`.
+   */
+  int writeRegisters(uint8_t address, uint8_t reg, const uint8_t* data, size_t size, system_tick_t timeout = HAL_I2C_DEFAULT_TIMEOUT_MS);
+
+  /**
+   * Queue a transaction.
+   *
+   * The transaction is performed asynchronously by a worker thread, which acquires the bus lock
+   * only for the duration of the transaction. The calling thread doesn't block.
+   *
+   * @return 0 on success, otherwise an error code defined by `system_error_t`.
+   */
+  int transfer(particle::I2cTransaction& transaction);
+
+  /**
+   * Cancel all queued transactions that haven't been started yet.
+   *
+   * The completion callbacks are invoked with `SYSTEM_ERROR_CANCELLED`.
+   */
+  int cancelTransactions();
+
   inline size_t write(unsigned long n) { return write((uint8_t)n); }
   inline size_t write(long n) { return write((uint8_t)n); }
   inline size_t write(unsigned int n) { return write((uint8_t)n); }
@@ -140,6 +140,128 @@ private:
 // Compatibility typedef
 typedef SPISettings __SPISettings;
 
+/**
+ * A transaction that is queued with SPIClass::transfer(SpiTransaction&).
+ *
+ * All segments of a transaction are transferred back-to-back with the chip select asserted.
+ * Queued transactions are performed by a worker thread that keeps the bus locked until the queue
+ * is drained. The transaction object and the buffers must remain valid until the completion
+ * callback is invoked. The buffers must be located in RAM.
+ */
+class SpiTransaction {
+public:
+  /**
+   * Completion callback. Invoked by the worker thread of the interface.
+   *
+   * @param transaction Transaction.
+   * @param error 0 on success, otherwise an error code defined by `system_error_t`.
+   * @param context User data.
+   */
+  typedef void (*CompletionCallback)(SpiTransaction* transaction, int error, void* context);
+
+  /**
+   * Maximum number of segments in a transaction.
+   */
+  static const unsigned MAX_SEGMENTS = 4;
+
+  SpiTransaction()
+    : halTransaction_(),
+      segments_(),
+      callback_(nullptr),
+      context_(nullptr),
+      csPin_(PIN_INVALID),
+      count_(0),
+      overflow_(false),
+      pending_(false)
+  {
+  }
+
+  // Prevent copying
+  SpiTransaction(const SpiTransaction&) = delete;
+  SpiTransaction& operator=(const SpiTransaction&) = delete;
+
+  /**
+   * Set the settings of the bus for this transaction.
+   *
+   * The peripheral is only reconfigured if the settings differ from those of the previous
+   * queued transaction.
+   */
+  SpiTransaction& settings(const SPISettings& settings) {
+    settings_ = settings;
+    return *this;
+  }
+
+  /**
+   * Set the chip select pin (active low).
+   *
+   * The pin must be configured as an output.
+   */
+  SpiTransaction& chipSelect(hal_pin_t pin) {
+    csPin_ = pin;
+    return *this;
+  }
+
+  /**
+   * Add a segment.
+   *
+   * @param tx Data to send, or `nullptr` to send zeros.
+   * @param rx Buffer for the received data, or `nullptr` to discard it.
+   * @param length Segment length.
+   */
+  SpiTransaction& add(const void* tx, void* rx, size_t length) {
+    if (count_ < MAX_SEGMENTS) {
+      segments_[count_++] = { tx, rx, (uint32_t)length };
+    } else {
+      overflow_ = true;
+    }
+    return *this;
+  }
+
+  /**
+   * Set the completion callback.
+   */
+  SpiTransaction& onComplete(CompletionCallback callback, void* context = nullptr) {
+    callback_ = callback;
+    context_ = context;
+    return *this;
+  }
+
+  /**
+   * Remove all segments.
+   */
+  SpiTransaction& clear() {
+    count_ = 0;
+    overflow_ = false;
+    return *this;
+  }
+
+  size_t segmentCount() const {
+    return count_;
+  }
+
+  /**
+   * Check if the transaction is queued or being transferred.
+   */
+  bool isPending() const {
+    return pending_;
+  }
+
+private:
+  friend class ::SPIClass;
+
+  hal_spi_transaction_t halTransaction_;
+  hal_spi_transaction_segment_t segments_[MAX_SEGMENTS];
+  SPISettings settings_;
+  CompletionCallback callback_;
+  void* context_;
+  hal_pin_t csPin_;
+  uint8_t count_;
+  bool overflow_;
+  volatile bool pending_;
+
+  static void halCallback(hal_spi_transaction_t* transaction, int error, void* context);
+};
+
 }
 
 // NOTE: when modifying this class (method signatures, adding/removing methods)
@@ -230,6 +352,23 @@ public:
   void transferCancel();
   int32_t available();
 
+  /**
+   * Queue a transaction.
+   *
+   * The interface must be enabled in master mode. Other threads using the interface are blocked
+   * in lock() until all queued transactions are complete.
+   *
+   * @return 0 on success, otherwise an error code defined by `system_error_t`.
+   */
+  int transfer(particle::SpiTransaction& transaction);
+
+  /**
+   * Cancel all queued transactions.
+   *
+   * The completion callbacks are invoked with `SYSTEM_ERROR_CANCELLED`.
+   */
+  int cancelTransactions();
+
   bool trylock()
   {
 #if HAL_PLATFORM_SPI_HAL_THREAD_SAFETY
@@ -96,6 +96,12 @@ public:
     int32_t available() {
         return instance().available();
     }
+    int transfer(SpiTransaction& transaction) {
+        return instance().transfer(transaction);
+    }
+    int cancelTransactions() {
+        return instance().cancelTransactions();
+    }
     bool trylock() {
         return instance().trylock();
     }
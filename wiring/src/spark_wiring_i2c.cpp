@@ -28,6 +28,8 @@
 #include "i2c_hal.h"
 #include "spark_wiring_thread.h"
 #include <cstdlib>
+#include <cstring>
+#include <mutex>
 
 // Constructors ////////////////////////////////////////////////////////////////
 
@@ -219,3 +221,84 @@ bool TwoWire::unlock()
 {
   return hal_i2c_unlock(_i2c, NULL) == 0;
 }
+
+int TwoWire::readRegisters(uint8_t address, uint8_t reg, uint8_t* data, size_t size, system_tick_t timeout)
+{
+  if (!data || !size) {
+    return SYSTEM_ERROR_INVALID_ARGUMENT;
+  }
+  std::lock_guard<TwoWire> lk(*this);
+  beginTransmission(WireTransmission(address).timeout(timeout).stop(false));
+  write(reg);
+  int r = hal_i2c_end_transmission_ext(_i2c, false, nullptr);
+  if (r < 0) {
+    return r;
+  }
+  if (requestFrom(WireTransmission(address).quantity(size).timeout(timeout)) != size) {
+    return SYSTEM_ERROR_I2C_ABORT;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = read();
+  }
+  return 0;
+}
+
+int TwoWire::writeRegisters(uint8_t address, uint8_t reg, const uint8_t* data, size_t size, system_tick_t timeout)
+{
+  if (!data || !size) {
+    return SYSTEM_ERROR_INVALID_ARGUMENT;
+  }
+  std::lock_guard<TwoWire> lk(*this);
+  beginTransmission(WireTransmission(address).timeout(timeout));
+  if (!write(reg)) {
+    return SYSTEM_ERROR_TOO_LARGE;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    if (!write(data[i])) {
+      return SYSTEM_ERROR_TOO_LARGE;
+    }
+  }
+  return hal_i2c_end_transmission_ext(_i2c, true, nullptr);
+}
+
+int TwoWire::transfer(particle::I2cTransaction& transaction)
+{
+  if (transaction.pending_) {
+    return SYSTEM_ERROR_BUSY;
+  }
+  if (transaction.overflow_) {
+    return SYSTEM_ERROR_LIMIT_EXCEEDED;
+  }
+  if (!transaction.count_) {
+    return SYSTEM_ERROR_INVALID_ARGUMENT;
+  }
+  auto& t = transaction.halTransaction_;
+  memset(&t, 0, sizeof(t));
+  t.size = sizeof(t);
+  t.segments = transaction.segments_;
+  t.segment_count = transaction.count_;
+  t.address = transaction.address_;
+  t.timeout_ms = transaction.timeout_;
+  t.callback = particle::I2cTransaction::halCallback;
+  t.context = &transaction;
+  transaction.pending_ = true;
+  const int r = hal_i2c_queue_transaction(_i2c, &t, nullptr);
+  if (r < 0) {
+    transaction.pending_ = false;
+  }
+  return r;
+}
+
+int TwoWire::cancelTransactions()
+{
+  return hal_i2c_cancel_transactions(_i2c, nullptr);
+}
+
+void particle::I2cTransaction::halCallback(hal_i2c_transaction_t* transaction, int error, void* context)
+{
+  const auto t = static_cast<I2cTransaction*>(context);
+  t->pending_ = false;
+  if (t->callback_) {
+    t->callback_(t, error, t->context_);
+  }
+}
@@ -305,6 +305,59 @@ int32_t SPIClass::available()
     return result;
 }
 
+int SPIClass::transfer(particle::SpiTransaction& transaction)
+{
+    CHECK_FALSE(transaction.pending_, SYSTEM_ERROR_BUSY);
+    CHECK_FALSE(transaction.overflow_, SYSTEM_ERROR_LIMIT_EXCEEDED);
+    CHECK_TRUE(transaction.count_ > 0, SYSTEM_ERROR_INVALID_ARGUMENT);
+
+    auto& t = transaction.halTransaction_;
+    memset(&t, 0, sizeof(t));
+    t.size = sizeof(t);
+    t.segments = transaction.segments_;
+    t.segment_count = transaction.count_;
+    t.cs_pin = transaction.csPin_;
+    t.set_default = transaction.settings_.default_;
+    if (!transaction.settings_.default_)
+    {
+        hal_spi_info_t info;
+        CHECK(lock());
+        querySpiInfo(_spi, &info);
+        unlock();
+        uint8_t divisor = 0;
+        unsigned int clock; // intentionally left uninitialized
+        computeClockDivider((unsigned int)info.system_clock, transaction.settings_.clock_, divisor, clock);
+        t.clock_divider = divisor;
+        t.bit_order = transaction.settings_.bitOrder_;
+        t.data_mode = transaction.settings_.dataMode_;
+    }
+    t.callback = particle::SpiTransaction::halCallback;
+    t.context = &transaction;
+
+    transaction.pending_ = true;
+    const int r = hal_spi_queue_transaction(_spi, &t, nullptr);
+    if (r < 0)
+    {
+        transaction.pending_ = false;
+    }
+    return r;
+}
+
+int SPIClass::cancelTransactions()
+{
+    return hal_spi_cancel_transactions(_spi, nullptr);
+}
+
+void particle::SpiTransaction::halCallback(hal_spi_transaction_t* transaction, int error, void* context)
+{
+    const auto t = static_cast<SpiTransaction*>(context);
+    t->pending_ = false;
+    if (t->callback_)
+    {
+        t->callback_(t, error, t->context_);
+    }
+}
+
 void SPIClass::attachInterrupt()
 {
     // TODO: Implement